@@ -0,0 +1,275 @@
+#include "AnimationClip.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "ScratchStack.h"
+
+namespace
+{
+    const uint32_t ChannelComponents[3] = { 4u, 3u, 3u };
+    const float QuantizedMaximum = 65535.0f;
+
+    void readChannel(const JointTransform &transform, uint32_t channel, float *values)
+    {
+        const float rotation[4] = { transform.rotation.x, transform.rotation.y, transform.rotation.z, transform.rotation.w };
+        const float translation[3] = { transform.translation.x, transform.translation.y, transform.translation.z };
+        const float scale[3] = { transform.scale.x, transform.scale.y, transform.scale.z };
+        const float *source = channel == 0u ? rotation : channel == 1u ? translation : scale;
+        std::copy_n(source, ChannelComponents[channel], values);
+    }
+
+    // What sampling returns between two decoded keys, the same operations as interpolatePoses
+    void interpolateKeys(uint32_t channel, const float *a, const float *b, float t, float *out)
+    {
+        if (channel != 0u)
+        {
+            for (uint32_t i = 0u; i < 3u; ++i)
+            {
+                out[i] = a[i] + (b[i] - a[i]) * t;
+            }
+            return;
+        }
+
+        const float cosine = ((a[0] * b[0] + a[1] * b[1]) + a[2] * b[2]) + a[3] * b[3];
+        const float sign = cosine < 0.0f ? -1.0f : 1.0f;
+        const float aFactor = 1.0f - t;
+        const float bFactor = t * sign;
+        for (uint32_t i = 0u; i < 4u; ++i)
+        {
+            out[i] = a[i] * aFactor + b[i] * bFactor;
+        }
+        const float lengthSquared = ((out[0] * out[0] + out[1] * out[1]) + out[2] * out[2]) + out[3] * out[3];
+        const float scale = 0.0f < lengthSquared ? 1.0f / std::sqrt(lengthSquared) : 0.0f;
+        for (uint32_t i = 0u; i < 4u; ++i)
+        {
+            out[i] = out[i] * scale;
+        }
+    }
+
+    // Angle between two rotations, or distance between two vectors
+    float measureError(uint32_t channel, const float *value, const float *expected)
+    {
+        if (channel != 0u)
+        {
+            const Vec3 difference{ value[0] - expected[0], value[1] - expected[1], value[2] - expected[2] };
+            return length(difference);
+        }
+
+        // The rotation from one to the other, measured from its vector part which stays accurate
+        // for small angles
+        const Quat a = normalize(Quat{ value[0], value[1], value[2], value[3] });
+        const Quat b = normalize(Quat{ expected[0], expected[1], expected[2], expected[3] });
+        const Quat delta = conjugate(b) * a;
+        const float sine = std::sqrt(delta.x * delta.x + delta.y * delta.y + delta.z * delta.z);
+        return 2.0f * std::atan2(sine, std::fabs(delta.w));
+    }
+}
+
+AnimationClip::AnimationClip()
+    : m_sampleRate(30.0f)
+    , m_frameCount(0u)
+    , m_jointCount(0u)
+{
+}
+
+AnimationClip::AnimationClip(const RawAnimationClip &raw, const AnimationCompressionSettings &settings)
+    : m_sampleRate(raw.sampleRate)
+    , m_frameCount(raw.frameCount)
+    , m_jointCount(raw.jointCount)
+{
+    const float tolerances[ChannelCount] = { settings.rotationTolerance, settings.translationTolerance, settings.scaleTolerance };
+    const uint32_t frameCount = m_frameCount;
+
+    std::vector<float> rawValues(static_cast<size_t>(frameCount) * 4u);
+    std::vector<uint16_t> quantized(static_cast<size_t>(frameCount) * 4u);
+    std::vector<float> decoded(static_cast<size_t>(frameCount) * 4u);
+    std::vector<uint32_t> keys;
+
+    m_tracks.resize(static_cast<size_t>(m_jointCount) * ChannelCount);
+    for (uint32_t joint = 0u; joint < m_jointCount; ++joint)
+    {
+        for (uint32_t channel = 0u; channel < ChannelCount; ++channel)
+        {
+            const uint32_t components = ChannelComponents[channel];
+            const float tolerance = tolerances[channel];
+            float *values = rawValues.data();
+            for (uint32_t frame = 0u; frame < frameCount; ++frame)
+            {
+                readChannel(raw.frames[static_cast<size_t>(frame) * m_jointCount + joint], channel, values + frame * components);
+            }
+
+            // Keep neighbouring rotations in the same hemisphere, which narrows the ranges
+            if (channel == Rotation)
+            {
+                for (uint32_t frame = 1u; frame < frameCount; ++frame)
+                {
+                    float *previous = values + (frame - 1u) * 4u;
+                    float *current = values + frame * 4u;
+                    if (previous[0] * current[0] + previous[1] * current[1] + previous[2] * current[2] + previous[3] * current[3] < 0.0f)
+                    {
+                        for (uint32_t i = 0u; i < 4u; ++i)
+                        {
+                            current[i] = -current[i];
+                        }
+                    }
+                }
+            }
+
+            Track &track = m_tracks[static_cast<size_t>(joint) * ChannelCount + channel];
+            for (uint32_t i = 0u; i < 4u; ++i)
+            {
+                track.minimum[i] = 0.0f;
+                track.step[i] = 0.0f;
+            }
+            for (uint32_t i = 0u; i < components; ++i)
+            {
+                float minimum = values[i];
+                float maximum = values[i];
+                for (uint32_t frame = 1u; frame < frameCount; ++frame)
+                {
+                    minimum = (std::min)(minimum, values[frame * components + i]);
+                    maximum = (std::max)(maximum, values[frame * components + i]);
+                }
+                track.minimum[i] = minimum;
+                track.step[i] = (maximum - minimum) / QuantizedMaximum;
+            }
+
+            for (uint32_t frame = 0u; frame < frameCount; ++frame)
+            {
+                for (uint32_t i = 0u; i < components; ++i)
+                {
+                    const size_t index = static_cast<size_t>(frame) * components + i;
+                    const float level = track.step[i] > 0.0f ? std::round((values[index] - track.minimum[i]) / track.step[i]) : 0.0f;
+                    quantized[index] = static_cast<uint16_t>((std::min)((std::max)(level, 0.0f), QuantizedMaximum));
+                    decoded[index] = track.minimum[i] + static_cast<float>(quantized[index]) * track.step[i];
+                }
+            }
+
+            // Does interpolating from key frame first to key frame last reproduce every frame between them
+            float interpolated[4];
+            auto fits = [&](uint32_t first, uint32_t last)
+            {
+                const float span = static_cast<float>(last - first);
+                for (uint32_t frame = first + 1u; frame < last; ++frame)
+                {
+                    const float t = static_cast<float>(frame - first) / span;
+                    interpolateKeys(channel, &decoded[first * components], &decoded[last * components], t, interpolated);
+                    if (measureError(channel, interpolated, &values[frame * components]) > tolerance)
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            };
+
+            // A single key when the track stays around its first frame
+            bool constant = true;
+            for (uint32_t frame = 1u; frame < frameCount && constant; ++frame)
+            {
+                interpolateKeys(channel, &decoded[0], &decoded[0], 0.0f, interpolated);
+                constant = measureError(channel, interpolated, &values[frame * components]) <= tolerance;
+            }
+
+            keys.assign(1u, 0u);
+            if (!constant)
+            {
+                uint32_t first = 0u;
+                while (first + 1u < frameCount)
+                {
+                    uint32_t last = first + 1u;
+                    while (last + 1u < frameCount && fits(first, last + 1u))
+                    {
+                        ++last;
+                    }
+                    keys.push_back(last);
+                    first = last;
+                }
+            }
+
+            track.firstKey = static_cast<uint32_t>(m_keyFrames.size());
+            track.keyCount = static_cast<uint32_t>(keys.size());
+            track.firstValue = static_cast<uint32_t>(m_keyValues.size());
+            for (uint32_t key : keys)
+            {
+                m_keyFrames.push_back(static_cast<uint16_t>(key));
+                m_keyValues.insert(m_keyValues.end(), quantized.begin() + key * components, quantized.begin() + (key + 1u) * components);
+            }
+        }
+    }
+}
+
+float AnimationClip::getDuration() const
+{
+    return m_frameCount > 1u ? static_cast<float>(m_frameCount - 1u) / m_sampleRate : 0.0f;
+}
+
+size_t AnimationClip::getCompressedSize() const
+{
+    return m_tracks.size() * sizeof(Track) + m_keyFrames.size() * sizeof(uint16_t) + m_keyValues.size() * sizeof(uint16_t);
+}
+
+void AnimationClip::gatherKeys(float time, AnimationPose &a, AnimationPose &b, float *const *weights) const
+{
+    const float lastFrame = static_cast<float>(m_frameCount > 0u ? m_frameCount - 1u : 0u);
+    const float frame = (std::min)((std::max)(time * m_sampleRate, 0.0f), lastFrame);
+    const uint16_t wholeFrame = static_cast<uint16_t>(frame);
+
+    float *aStreams[AnimationPose::StreamCount];
+    float *bStreams[AnimationPose::StreamCount];
+    for (uint32_t stream = 0u; stream < AnimationPose::StreamCount; ++stream)
+    {
+        aStreams[stream] = a.getStream(static_cast<AnimationPose::Stream>(stream));
+        bStreams[stream] = b.getStream(static_cast<AnimationPose::Stream>(stream));
+    }
+    const uint32_t firstStreams[ChannelCount] = { AnimationPose::RotationX, AnimationPose::TranslationX, AnimationPose::ScaleX };
+
+    for (uint32_t joint = 0u; joint < m_jointCount; ++joint)
+    {
+        for (uint32_t channel = 0u; channel < ChannelCount; ++channel)
+        {
+            const Track &track = m_tracks[static_cast<size_t>(joint) * ChannelCount + channel];
+            const uint16_t *keyFrames = &m_keyFrames[track.firstKey];
+
+            // The last key at or before the frame, the first key is always frame 0
+            const uint32_t key = static_cast<uint32_t>(std::upper_bound(keyFrames, keyFrames + track.keyCount, wholeFrame) - keyFrames) - 1u;
+            const uint32_t nextKey = (std::min)(key + 1u, track.keyCount - 1u);
+            weights[channel][joint] = nextKey == key ? 0.0f :
+                (frame - static_cast<float>(keyFrames[key])) / static_cast<float>(keyFrames[nextKey] - keyFrames[key]);
+
+            const uint32_t components = ChannelComponents[channel];
+            const uint16_t *aValues = &m_keyValues[track.firstValue + key * components];
+            const uint16_t *bValues = &m_keyValues[track.firstValue + nextKey * components];
+            for (uint32_t i = 0u; i < components; ++i)
+            {
+                aStreams[firstStreams[channel] + i][joint] = track.minimum[i] + static_cast<float>(aValues[i]) * track.step[i];
+                bStreams[firstStreams[channel] + i][joint] = track.minimum[i] + static_cast<float>(bValues[i]) * track.step[i];
+            }
+        }
+    }
+}
+
+void AnimationClip::sample(float time, AnimationPose &pose) const
+{
+    ScratchScope scratch;
+    const uint32_t paddedJointCount = pose.getPaddedJointCount();
+    AnimationPose nextKeys(scratch.allocateArray<float>(AnimationPose::getStorageSize(m_jointCount)), m_jointCount);
+    float *weights = scratch.allocateArray<float>(static_cast<size_t>(ChannelCount) * paddedJointCount);
+    std::fill_n(weights, static_cast<size_t>(ChannelCount) * paddedJointCount, 0.0f);
+    float *const channelWeights[ChannelCount] = { weights, weights + paddedJointCount, weights + 2u * paddedJointCount };
+
+    gatherKeys(time, pose, nextKeys, channelWeights);
+    interpolatePoses(pose, nextKeys, channelWeights[Rotation], channelWeights[Translation], channelWeights[Scale], pose);
+}
+
+void AnimationClip::sampleReference(float time, AnimationPose &pose) const
+{
+    std::vector<float> storage(AnimationPose::getStorageSize(m_jointCount));
+    AnimationPose nextKeys(storage.data(), m_jointCount);
+    const uint32_t paddedJointCount = pose.getPaddedJointCount();
+    std::vector<float> weights(static_cast<size_t>(ChannelCount) * paddedJointCount, 0.0f);
+    float *const channelWeights[ChannelCount] = { weights.data(), weights.data() + paddedJointCount, weights.data() + 2u * paddedJointCount };
+
+    gatherKeys(time, pose, nextKeys, channelWeights);
+    interpolatePosesReference(pose, nextKeys, channelWeights[Rotation], channelWeights[Translation], channelWeights[Scale], pose);
+}
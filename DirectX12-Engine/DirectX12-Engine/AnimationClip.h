@@ -0,0 +1,85 @@
+#pragma once
+
+// Compressed animation clips.
+// A raw clip samples the local transform of every joint at a fixed rate. Compression works on
+// tracks, the rotation, translation or scale of one joint. Key values are quantized to 16 bits
+// per component inside the track's own range, then a curve is fitted through them: starting from
+// the first frame, each segment is stretched for as long as interpolating between its two end
+// keys (nlerp for rotations, lerp otherwise) stays within the tolerance at every frame it spans,
+// and a track that never leaves the tolerance around its first frame keeps that single key. The
+// fit is measured against the quantized keys, so the tolerance bounds the error of the compressed
+// track at every frame between two keys, and only the quantization error is left at the keys.
+// Sampling finds the two keys around the sample time in every track and interpolates all joints
+// at once with interpolatePoses.
+// This file is platform independent so it can be built and profiled off Windows.
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "AnimationPose.h"
+
+struct RawAnimationClip
+{
+    float sampleRate = 30.0f; // Frames per second
+    uint32_t frameCount = 0u;
+    uint32_t jointCount = 0u;
+    std::vector<JointTransform> frames; // Every joint of frame 0, then of frame 1 and so on
+};
+
+struct AnimationCompressionSettings
+{
+    float rotationTolerance = 0.001f;     // Radians
+    float translationTolerance = 0.0005f; // In the units of the skeleton
+    float scaleTolerance = 0.0005f;
+};
+
+class AnimationClip
+{
+public:
+    AnimationClip();
+
+    // Between 1 and 65536 frames
+    AnimationClip(const RawAnimationClip &raw, const AnimationCompressionSettings &settings);
+
+    uint32_t getJointCount() const { return m_jointCount; }
+    float getDuration() const;
+
+    uint32_t getKeyCount() const { return static_cast<uint32_t>(m_keyFrames.size()); }
+
+    // Bytes of the tracks and keys, against frameCount * jointCount * sizeof(JointTransform) raw
+    size_t getCompressedSize() const;
+
+    // The time is clamped to the clip. The pose must have the clip's joint count.
+    void sample(float time, AnimationPose &pose) const;
+    void sampleReference(float time, AnimationPose &pose) const;
+
+private:
+    enum Channel : uint32_t
+    {
+        Rotation,
+        Translation,
+        Scale,
+        ChannelCount
+    };
+
+    // Quantized values decode as minimum + value * step per component
+    struct Track
+    {
+        uint32_t firstKey;
+        uint32_t keyCount;
+        uint32_t firstValue;
+        float minimum[4];
+        float step[4];
+    };
+
+    // Writes the keys around the time into a and b and the weight between them
+    void gatherKeys(float time, AnimationPose &a, AnimationPose &b, float *const *weights) const;
+
+    float m_sampleRate;
+    uint32_t m_frameCount;
+    uint32_t m_jointCount;
+    std::vector<Track> m_tracks;        // Rotation, translation and scale of every joint in turn
+    std::vector<uint16_t> m_keyFrames;  // Frame of every key, in order within each track
+    std::vector<uint16_t> m_keyValues;  // Four components per rotation key, three per other key
+};
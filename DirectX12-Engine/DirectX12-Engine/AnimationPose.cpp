@@ -0,0 +1,404 @@
+#include "AnimationPose.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "ScratchStack.h"
+
+namespace
+{
+    // The widest lane count, every stream is padded to it
+    const uint32_t PosePadding = 8u;
+
+    // Rows 0 to 2 of a local joint matrix and its translation, as streams
+    const uint32_t LocalMatrixStreamCount = 12u;
+
+    // Coefficients of the slerp polynomial, u[i] = 1 / (i (2i + 1)) and v[i] = i / (2i + 1) for
+    // i = 1..8, with the last pair scaled to spread the truncation error over the range
+    const float SlerpCorrection = 1.85298109240830f;
+    const float SlerpU[8] = { 1.0f / 3.0f, 1.0f / 10.0f, 1.0f / 21.0f, 1.0f / 36.0f, 1.0f / 55.0f, 1.0f / 78.0f, 1.0f / 105.0f, SlerpCorrection / 136.0f };
+    const float SlerpV[8] = { 1.0f / 3.0f, 2.0f / 5.0f, 3.0f / 7.0f, 4.0f / 9.0f, 5.0f / 11.0f, 6.0f / 13.0f, 7.0f / 15.0f, SlerpCorrection * 8.0f / 17.0f };
+
+    // One joint per lane, the reference path. The operations match the SIMD versions exactly.
+    struct ScalarLanes
+    {
+        typedef float Float;
+        typedef bool Mask;
+        static const uint32_t Count = 1u;
+
+        static Float load(const float *source) { return *source; }
+        static void store(float *destination, Float value) { *destination = value; }
+        static Float splat(float value) { return value; }
+        static Float add(Float a, Float b) { return a + b; }
+        static Float subtract(Float a, Float b) { return a - b; }
+        static Float multiply(Float a, Float b) { return a * b; }
+        static Float divide(Float a, Float b) { return a / b; }
+        static Float squareRoot(Float a) { return std::sqrt(a); }
+        static Mask lessThan(Float a, Float b) { return a < b; }
+        static Float select(Mask mask, Float a, Float b) { return mask ? a : b; }
+    };
+
+#if defined(VECTOR_MATH_AVX2)
+    struct SimdLanes
+    {
+        typedef __m256 Float;
+        typedef __m256 Mask;
+        static const uint32_t Count = 8u;
+
+        static Float load(const float *source) { return _mm256_loadu_ps(source); }
+        static void store(float *destination, Float value) { _mm256_storeu_ps(destination, value); }
+        static Float splat(float value) { return _mm256_set1_ps(value); }
+        static Float add(Float a, Float b) { return _mm256_add_ps(a, b); }
+        static Float subtract(Float a, Float b) { return _mm256_sub_ps(a, b); }
+        static Float multiply(Float a, Float b) { return _mm256_mul_ps(a, b); }
+        static Float divide(Float a, Float b) { return _mm256_div_ps(a, b); }
+        static Float squareRoot(Float a) { return _mm256_sqrt_ps(a); }
+        static Mask lessThan(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+        static Float select(Mask mask, Float a, Float b) { return _mm256_blendv_ps(b, a, mask); }
+    };
+#elif defined(VECTOR_MATH_SSE)
+    struct SimdLanes
+    {
+        typedef __m128 Float;
+        typedef __m128 Mask;
+        static const uint32_t Count = 4u;
+
+        static Float load(const float *source) { return _mm_loadu_ps(source); }
+        static void store(float *destination, Float value) { _mm_storeu_ps(destination, value); }
+        static Float splat(float value) { return _mm_set1_ps(value); }
+        static Float add(Float a, Float b) { return _mm_add_ps(a, b); }
+        static Float subtract(Float a, Float b) { return _mm_sub_ps(a, b); }
+        static Float multiply(Float a, Float b) { return _mm_mul_ps(a, b); }
+        static Float divide(Float a, Float b) { return _mm_div_ps(a, b); }
+        static Float squareRoot(Float a) { return _mm_sqrt_ps(a); }
+        static Mask lessThan(Float a, Float b) { return _mm_cmplt_ps(a, b); }
+        static Float select(Mask mask, Float a, Float b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+    };
+#elif defined(VECTOR_MATH_NEON) && (defined(__aarch64__) || defined(_M_ARM64))
+    // Vector division and square root need AArch64
+    struct SimdLanes
+    {
+        typedef float32x4_t Float;
+        typedef uint32x4_t Mask;
+        static const uint32_t Count = 4u;
+
+        static Float load(const float *source) { return vld1q_f32(source); }
+        static void store(float *destination, Float value) { vst1q_f32(destination, value); }
+        static Float splat(float value) { return vdupq_n_f32(value); }
+        static Float add(Float a, Float b) { return vaddq_f32(a, b); }
+        static Float subtract(Float a, Float b) { return vsubq_f32(a, b); }
+        static Float multiply(Float a, Float b) { return vmulq_f32(a, b); }
+        static Float divide(Float a, Float b) { return vdivq_f32(a, b); }
+        static Float squareRoot(Float a) { return vsqrtq_f32(a); }
+        static Mask lessThan(Float a, Float b) { return vcltq_f32(a, b); }
+        static Float select(Mask mask, Float a, Float b) { return vbslq_f32(mask, a, b); }
+    };
+#else
+    typedef ScalarLanes SimdLanes;
+#endif
+
+    static_assert(PosePadding % SimdLanes::Count == 0u, "Streams must hold whole lanes");
+
+    template<typename L>
+    struct UniformWeight
+    {
+        typename L::Float value;
+        typename L::Float get(uint32_t) const { return value; }
+    };
+
+    template<typename L>
+    struct JointWeights
+    {
+        const float *weights;
+        typename L::Float get(uint32_t joint) const { return L::load(weights + joint); }
+    };
+
+    // Blends joints [begin, end) lane by lane, every input of a joint is read before its output is
+    // written so out may be a or b
+    template<typename L, typename Weights>
+    void blendJoints(const AnimationPose &a, const AnimationPose &b, const Weights &rotationWeights, const Weights &translationWeights,
+        const Weights &scaleWeights, QuatBlend mode, uint32_t begin, uint32_t end, AnimationPose &out)
+    {
+        typedef typename L::Float Float;
+
+        const float *aStreams[AnimationPose::StreamCount];
+        const float *bStreams[AnimationPose::StreamCount];
+        float *outStreams[AnimationPose::StreamCount];
+        for (uint32_t stream = 0u; stream < AnimationPose::StreamCount; ++stream)
+        {
+            aStreams[stream] = a.getStream(static_cast<AnimationPose::Stream>(stream));
+            bStreams[stream] = b.getStream(static_cast<AnimationPose::Stream>(stream));
+            outStreams[stream] = out.getStream(static_cast<AnimationPose::Stream>(stream));
+        }
+
+        const Float zero = L::splat(0.0f);
+        const Float one = L::splat(1.0f);
+        const Float minusOne = L::splat(-1.0f);
+
+        for (uint32_t joint = begin; joint < end; joint += L::Count)
+        {
+            Float aRotation[4];
+            Float bRotation[4];
+            for (uint32_t i = 0u; i < 4u; ++i)
+            {
+                aRotation[i] = L::load(aStreams[AnimationPose::RotationX + i] + joint);
+                bRotation[i] = L::load(bStreams[AnimationPose::RotationX + i] + joint);
+            }
+
+            // Along the shorter arc, flipping b when the two are in opposite hemispheres
+            const Float t = rotationWeights.get(joint);
+            const Float cosine = L::add(L::add(L::add(L::multiply(aRotation[0], bRotation[0]), L::multiply(aRotation[1], bRotation[1])),
+                L::multiply(aRotation[2], bRotation[2])), L::multiply(aRotation[3], bRotation[3]));
+            const Float sign = L::select(L::lessThan(cosine, zero), minusOne, one);
+
+            Float aFactor;
+            Float bFactor;
+            if (mode == QuatBlend::Nlerp)
+            {
+                aFactor = L::subtract(one, t);
+                bFactor = L::multiply(t, sign);
+            }
+            else
+            {
+                // Nested polynomials in t and 1 - t of the cosine, innermost term first
+                const Float x = L::multiply(cosine, sign);
+                const Float xMinusOne = L::subtract(x, one);
+                const Float d = L::subtract(one, t);
+                const Float tSquared = L::multiply(t, t);
+                const Float dSquared = L::multiply(d, d);
+                Float tFactor = one;
+                Float dFactor = one;
+                for (int32_t i = 7; i >= 0; --i)
+                {
+                    const Float u = L::splat(SlerpU[i]);
+                    const Float v = L::splat(SlerpV[i]);
+                    tFactor = L::add(one, L::multiply(L::multiply(L::subtract(L::multiply(u, tSquared), v), xMinusOne), tFactor));
+                    dFactor = L::add(one, L::multiply(L::multiply(L::subtract(L::multiply(u, dSquared), v), xMinusOne), dFactor));
+                }
+                aFactor = L::multiply(d, dFactor);
+                bFactor = L::multiply(L::multiply(t, tFactor), sign);
+            }
+
+            Float rotation[4];
+            for (uint32_t i = 0u; i < 4u; ++i)
+            {
+                rotation[i] = L::add(L::multiply(aRotation[i], aFactor), L::multiply(bRotation[i], bFactor));
+            }
+
+            // Slerp stays unit length on its own
+            if (mode == QuatBlend::Nlerp)
+            {
+                const Float lengthSquared = L::add(L::add(L::add(L::multiply(rotation[0], rotation[0]), L::multiply(rotation[1], rotation[1])),
+                    L::multiply(rotation[2], rotation[2])), L::multiply(rotation[3], rotation[3]));
+                const Float scale = L::select(L::lessThan(zero, lengthSquared), L::divide(one, L::squareRoot(lengthSquared)), zero);
+                for (uint32_t i = 0u; i < 4u; ++i)
+                {
+                    rotation[i] = L::multiply(rotation[i], scale);
+                }
+            }
+
+            Float vectors[6];
+            const Float vectorWeights[2] = { translationWeights.get(joint), scaleWeights.get(joint) };
+            for (uint32_t i = 0u; i < 6u; ++i)
+            {
+                const Float aValue = L::load(aStreams[AnimationPose::TranslationX + i] + joint);
+                const Float bValue = L::load(bStreams[AnimationPose::TranslationX + i] + joint);
+                vectors[i] = L::add(aValue, L::multiply(L::subtract(bValue, aValue), vectorWeights[i / 3u]));
+            }
+
+            for (uint32_t i = 0u; i < 4u; ++i)
+            {
+                L::store(outStreams[AnimationPose::RotationX + i] + joint, rotation[i]);
+            }
+            for (uint32_t i = 0u; i < 6u; ++i)
+            {
+                L::store(outStreams[AnimationPose::TranslationX + i] + joint, vectors[i]);
+            }
+        }
+    }
+
+    // Scale, rotation and translation of joints [begin, end) into the rows of their local
+    // matrices, the same arithmetic as affineMatrix
+    template<typename L>
+    void computeLocalMatrices(const AnimationPose &pose, uint32_t begin, uint32_t end, float *const *matrices)
+    {
+        typedef typename L::Float Float;
+
+        const Float one = L::splat(1.0f);
+        const Float two = L::splat(2.0f);
+        for (uint32_t joint = begin; joint < end; joint += L::Count)
+        {
+            const Float x = L::load(pose.getStream(AnimationPose::RotationX) + joint);
+            const Float y = L::load(pose.getStream(AnimationPose::RotationY) + joint);
+            const Float z = L::load(pose.getStream(AnimationPose::RotationZ) + joint);
+            const Float w = L::load(pose.getStream(AnimationPose::RotationW) + joint);
+            const Float scaleX = L::load(pose.getStream(AnimationPose::ScaleX) + joint);
+            const Float scaleY = L::load(pose.getStream(AnimationPose::ScaleY) + joint);
+            const Float scaleZ = L::load(pose.getStream(AnimationPose::ScaleZ) + joint);
+
+            const Float xx = L::multiply(x, x);
+            const Float yy = L::multiply(y, y);
+            const Float zz = L::multiply(z, z);
+            const Float xy = L::multiply(x, y);
+            const Float xz = L::multiply(x, z);
+            const Float yz = L::multiply(y, z);
+            const Float wx = L::multiply(w, x);
+            const Float wy = L::multiply(w, y);
+            const Float wz = L::multiply(w, z);
+
+            L::store(matrices[0] + joint, L::multiply(L::subtract(one, L::multiply(two, L::add(yy, zz))), scaleX));
+            L::store(matrices[1] + joint, L::multiply(L::multiply(two, L::add(xy, wz)), scaleX));
+            L::store(matrices[2] + joint, L::multiply(L::multiply(two, L::subtract(xz, wy)), scaleX));
+            L::store(matrices[3] + joint, L::multiply(L::multiply(two, L::subtract(xy, wz)), scaleY));
+            L::store(matrices[4] + joint, L::multiply(L::subtract(one, L::multiply(two, L::add(xx, zz))), scaleY));
+            L::store(matrices[5] + joint, L::multiply(L::multiply(two, L::add(yz, wx)), scaleY));
+            L::store(matrices[6] + joint, L::multiply(L::multiply(two, L::add(xz, wy)), scaleZ));
+            L::store(matrices[7] + joint, L::multiply(L::multiply(two, L::subtract(yz, wx)), scaleZ));
+            L::store(matrices[8] + joint, L::multiply(L::subtract(one, L::multiply(two, L::add(xx, yy))), scaleZ));
+            L::store(matrices[9] + joint, L::load(pose.getStream(AnimationPose::TranslationX) + joint));
+            L::store(matrices[10] + joint, L::load(pose.getStream(AnimationPose::TranslationY) + joint));
+            L::store(matrices[11] + joint, L::load(pose.getStream(AnimationPose::TranslationZ) + joint));
+        }
+    }
+
+    // Local matrices times the parents' model matrices, then the inverse bind matrices in front
+    // when skinning matrices are wanted
+    void composeHierarchy(const Skeleton &skeleton, uint32_t jointCount, uint32_t stride, const float *localMatrices,
+        Mat4 *modelMatrices, Mat4 *skinningMatrices)
+    {
+        const float *m[LocalMatrixStreamCount];
+        for (uint32_t i = 0u; i < LocalMatrixStreamCount; ++i)
+        {
+            m[i] = localMatrices + static_cast<size_t>(i) * stride;
+        }
+
+        for (uint32_t joint = 0u; joint < jointCount; ++joint)
+        {
+            const Mat4 local{ {
+                { m[0][joint], m[1][joint], m[2][joint], 0.0f },
+                { m[3][joint], m[4][joint], m[5][joint], 0.0f },
+                { m[6][joint], m[7][joint], m[8][joint], 0.0f },
+                { m[9][joint], m[10][joint], m[11][joint], 1.0f } } };
+
+            const int32_t parent = skeleton.parents[joint];
+            modelMatrices[joint] = parent < 0 ? local : multiply(local, modelMatrices[parent]);
+            if (skinningMatrices != nullptr)
+            {
+                skinningMatrices[joint] = multiply(skeleton.inverseBindMatrices[joint], modelMatrices[joint]);
+            }
+        }
+    }
+
+    template<typename L>
+    void computeMatrices(const Skeleton &skeleton, const AnimationPose &pose, uint32_t end, Mat4 *modelMatrices, Mat4 *skinningMatrices)
+    {
+        ScratchScope scratch;
+        const uint32_t stride = pose.getPaddedJointCount();
+        float *localMatrices = scratch.allocateArray<float>(static_cast<size_t>(LocalMatrixStreamCount) * stride);
+        float *streams[LocalMatrixStreamCount];
+        for (uint32_t i = 0u; i < LocalMatrixStreamCount; ++i)
+        {
+            streams[i] = localMatrices + static_cast<size_t>(i) * stride;
+        }
+
+        computeLocalMatrices<L>(pose, 0u, end, streams);
+        if (modelMatrices == nullptr)
+        {
+            modelMatrices = scratch.allocateArray<Mat4>(pose.getJointCount());
+        }
+        composeHierarchy(skeleton, pose.getJointCount(), stride, localMatrices, modelMatrices, skinningMatrices);
+    }
+}
+
+uint32_t AnimationPose::getPaddedJointCount(uint32_t jointCount)
+{
+    return (jointCount + PosePadding - 1u) / PosePadding * PosePadding;
+}
+
+AnimationPose::AnimationPose()
+    : m_storage(nullptr)
+    , m_jointCount(0u)
+    , m_paddedJointCount(0u)
+{
+}
+
+AnimationPose::AnimationPose(float *storage, uint32_t jointCount)
+    : m_storage(storage)
+    , m_jointCount(jointCount)
+    , m_paddedJointCount(getPaddedJointCount(jointCount))
+{
+    setIdentity();
+}
+
+JointTransform AnimationPose::getJoint(uint32_t joint) const
+{
+    JointTransform transform;
+    transform.rotation = Quat{ getStream(RotationX)[joint], getStream(RotationY)[joint], getStream(RotationZ)[joint], getStream(RotationW)[joint] };
+    transform.translation = Vec3{ getStream(TranslationX)[joint], getStream(TranslationY)[joint], getStream(TranslationZ)[joint] };
+    transform.scale = Vec3{ getStream(ScaleX)[joint], getStream(ScaleY)[joint], getStream(ScaleZ)[joint] };
+    return transform;
+}
+
+void AnimationPose::setJoint(uint32_t joint, const JointTransform &transform)
+{
+    getStream(RotationX)[joint] = transform.rotation.x;
+    getStream(RotationY)[joint] = transform.rotation.y;
+    getStream(RotationZ)[joint] = transform.rotation.z;
+    getStream(RotationW)[joint] = transform.rotation.w;
+    getStream(TranslationX)[joint] = transform.translation.x;
+    getStream(TranslationY)[joint] = transform.translation.y;
+    getStream(TranslationZ)[joint] = transform.translation.z;
+    getStream(ScaleX)[joint] = transform.scale.x;
+    getStream(ScaleY)[joint] = transform.scale.y;
+    getStream(ScaleZ)[joint] = transform.scale.z;
+}
+
+void AnimationPose::setIdentity()
+{
+    const float identity[StreamCount] = { 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f };
+    for (uint32_t stream = 0u; stream < StreamCount; ++stream)
+    {
+        std::fill_n(getStream(static_cast<Stream>(stream)), m_paddedJointCount, identity[stream]);
+    }
+}
+
+void blendPoses(const AnimationPose &a, const AnimationPose &b, float weight, QuatBlend mode, AnimationPose &out)
+{
+    const UniformWeight<SimdLanes> weights = { SimdLanes::splat(weight) };
+    blendJoints<SimdLanes>(a, b, weights, weights, weights, mode, 0u, out.getPaddedJointCount(), out);
+}
+
+void blendPosesReference(const AnimationPose &a, const AnimationPose &b, float weight, QuatBlend mode, AnimationPose &out)
+{
+    const UniformWeight<ScalarLanes> weights = { weight };
+    blendJoints<ScalarLanes>(a, b, weights, weights, weights, mode, 0u, out.getJointCount(), out);
+}
+
+void interpolatePoses(const AnimationPose &a, const AnimationPose &b, const float *rotationWeights, const float *translationWeights,
+    const float *scaleWeights, AnimationPose &out)
+{
+    blendJoints<SimdLanes>(a, b, JointWeights<SimdLanes>{ rotationWeights }, JointWeights<SimdLanes>{ translationWeights },
+        JointWeights<SimdLanes>{ scaleWeights }, QuatBlend::Nlerp, 0u, out.getPaddedJointCount(), out);
+}
+
+void interpolatePosesReference(const AnimationPose &a, const AnimationPose &b, const float *rotationWeights, const float *translationWeights,
+    const float *scaleWeights, AnimationPose &out)
+{
+    blendJoints<ScalarLanes>(a, b, JointWeights<ScalarLanes>{ rotationWeights }, JointWeights<ScalarLanes>{ translationWeights },
+        JointWeights<ScalarLanes>{ scaleWeights }, QuatBlend::Nlerp, 0u, out.getJointCount(), out);
+}
+
+void computeSkinningMatrices(const Skeleton &skeleton, const AnimationPose &pose, Mat4 *skinningMatrices)
+{
+    computeMatrices<SimdLanes>(skeleton, pose, pose.getPaddedJointCount(), nullptr, skinningMatrices);
+}
+
+void computeSkinningMatricesReference(const Skeleton &skeleton, const AnimationPose &pose, Mat4 *skinningMatrices)
+{
+    computeMatrices<ScalarLanes>(skeleton, pose, pose.getJointCount(), nullptr, skinningMatrices);
+}
+
+void computeModelMatrices(const Skeleton &skeleton, const AnimationPose &pose, Mat4 *modelMatrices)
+{
+    computeMatrices<SimdLanes>(skeleton, pose, pose.getPaddedJointCount(), modelMatrices, nullptr);
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+// Skeletons, poses and skinning matrices for skeletal animation.
+// A pose holds the local transform of every joint as a structure of arrays, one stream per
+// component, each padded to a whole number of SIMD lanes, so sampling, blending and building the
+// joint matrices run over four or eight joints at a time. Rotations are blended either with nlerp,
+// which is cheap and accurate enough between nearby rotations, or with a polynomial slerp
+// (Eberly, "A Fast and Accurate Algorithm for Computing SLERP") that keeps a constant angular
+// speed over wide blends and needs no trigonometry, so it vectorizes like the rest.
+// Every kernel also has a reference path that runs one joint at a time through the same
+// operations and produces the same bits.
+// This file is platform independent so it can be built and profiled off Windows.
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "VectorMath.h"
+
+// Joints are ordered so that a parent always comes before its children
+struct Skeleton
+{
+    std::vector<int32_t> parents;          // -1 for a root
+    std::vector<Mat4> inverseBindMatrices; // Model space to joint space in the bind pose
+};
+
+// Scale, then rotate, then translate into the parent joint's space
+struct JointTransform
+{
+    Quat rotation;
+    Vec3 translation;
+    Vec3 scale;
+};
+
+enum class QuatBlend : uint8_t
+{
+    Nlerp,
+    Slerp
+};
+
+class AnimationPose
+{
+public:
+    enum Stream : uint32_t
+    {
+        RotationX,
+        RotationY,
+        RotationZ,
+        RotationW,
+        TranslationX,
+        TranslationY,
+        TranslationZ,
+        ScaleX,
+        ScaleY,
+        ScaleZ,
+        StreamCount
+    };
+
+    // Joints per stream rounded up to the widest lane count
+    static uint32_t getPaddedJointCount(uint32_t jointCount);
+
+    // Floats of storage a pose of jointCount joints views
+    static size_t getStorageSize(uint32_t jointCount) { return static_cast<size_t>(StreamCount) * getPaddedJointCount(jointCount); }
+
+    AnimationPose();
+
+    // Views storage of getStorageSize(jointCount) floats, which must outlive the pose. Every joint,
+    // padding included, starts out as the identity.
+    AnimationPose(float *storage, uint32_t jointCount);
+
+    uint32_t getJointCount() const { return m_jointCount; }
+    uint32_t getPaddedJointCount() const { return m_paddedJointCount; }
+
+    float *getStream(Stream stream) { return m_storage + static_cast<size_t>(stream) * m_paddedJointCount; }
+    const float *getStream(Stream stream) const { return m_storage + static_cast<size_t>(stream) * m_paddedJointCount; }
+
+    JointTransform getJoint(uint32_t joint) const;
+    void setJoint(uint32_t joint, const JointTransform &transform);
+
+    void setIdentity();
+
+private:
+    float *m_storage;
+    uint32_t m_jointCount;
+    uint32_t m_paddedJointCount;
+};
+
+// Blend every joint from a towards b by weight. out may be a or b.
+void blendPoses(const AnimationPose &a, const AnimationPose &b, float weight, QuatBlend mode, AnimationPose &out);
+void blendPosesReference(const AnimationPose &a, const AnimationPose &b, float weight, QuatBlend mode, AnimationPose &out);
+
+// Nlerp and lerp with a weight per joint and channel, each array holding getPaddedJointCount()
+// floats. Clip sampling uses this to interpolate between the keys around the sample time.
+void interpolatePoses(const AnimationPose &a, const AnimationPose &b, const float *rotationWeights, const float *translationWeights,
+    const float *scaleWeights, AnimationPose &out);
+void interpolatePosesReference(const AnimationPose &a, const AnimationPose &b, const float *rotationWeights, const float *translationWeights,
+    const float *scaleWeights, AnimationPose &out);
+
+// Walk the hierarchy to model space and write one skinning matrix per joint, the inverse bind
+// matrix followed by the joint's model transform. The matrices are row major like every Mat4 and
+// can be copied to the GPU as is.
+void computeSkinningMatrices(const Skeleton &skeleton, const AnimationPose &pose, Mat4 *skinningMatrices);
+void computeSkinningMatricesReference(const Skeleton &skeleton, const AnimationPose &pose, Mat4 *skinningMatrices);
+
+// Model transform of every joint, without the inverse bind matrices
+void computeModelMatrices(const Skeleton &skeleton, const AnimationPose &pose, Mat4 *modelMatrices);
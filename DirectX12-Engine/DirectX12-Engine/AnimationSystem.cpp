@@ -0,0 +1,137 @@
+#include "AnimationSystem.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+#include "ScratchStack.h"
+#include "WorkerPool.h"
+
+namespace
+{
+    // Characters per worker task
+    const uint32_t CharacterBatchSize = 16u;
+
+    void runTasks(WorkerPool *workerPool, uint32_t count, const std::function<void(uint32_t)> &func)
+    {
+        if (workerPool != nullptr && count > 1u)
+        {
+            workerPool->parallelFor(count, func);
+            return;
+        }
+        for (uint32_t i = 0u; i < count; ++i)
+        {
+            func(i);
+        }
+    }
+
+    template<bool Reference>
+    void evaluateCharacter(const AnimationCharacter &character, Mat4 *skinningMatrices)
+    {
+        const Skeleton &skeleton = *character.skeleton;
+        const uint32_t jointCount = static_cast<uint32_t>(skeleton.parents.size());
+
+        ScratchScope scratch;
+        AnimationPose pose(scratch.allocateArray<float>(AnimationPose::getStorageSize(jointCount)), jointCount);
+        auto sample = [](const AnimationClip &clip, float time, AnimationPose &out)
+        {
+            if (Reference)
+            {
+                clip.sampleReference(time, out);
+            }
+            else
+            {
+                clip.sample(time, out);
+            }
+        };
+
+        // Only blend when both clips contribute
+        if (character.blendWeight <= 0.0f)
+        {
+            sample(*character.clips[0], character.times[0], pose);
+        }
+        else if (character.blendWeight >= 1.0f)
+        {
+            sample(*character.clips[1], character.times[1], pose);
+        }
+        else
+        {
+            AnimationPose other(scratch.allocateArray<float>(AnimationPose::getStorageSize(jointCount)), jointCount);
+            sample(*character.clips[0], character.times[0], pose);
+            sample(*character.clips[1], character.times[1], other);
+            if (Reference)
+            {
+                blendPosesReference(pose, other, character.blendWeight, character.blendMode, pose);
+            }
+            else
+            {
+                blendPoses(pose, other, character.blendWeight, character.blendMode, pose);
+            }
+        }
+
+        if (Reference)
+        {
+            computeSkinningMatricesReference(skeleton, pose, skinningMatrices);
+        }
+        else
+        {
+            computeSkinningMatrices(skeleton, pose, skinningMatrices);
+        }
+    }
+}
+
+uint32_t AnimationSystem::addCharacter(const AnimationCharacter &character)
+{
+    m_characters.push_back(character);
+    m_matrixOffsets.push_back(static_cast<uint32_t>(m_skinningMatrices.size()));
+    m_skinningMatrices.resize(m_skinningMatrices.size() + character.skeleton->parents.size(), identityMatrix());
+    return static_cast<uint32_t>(m_characters.size() - 1u);
+}
+
+void AnimationSystem::advance(float deltaTime)
+{
+    for (AnimationCharacter &character : m_characters)
+    {
+        for (uint32_t i = 0u; i < 2u; ++i)
+        {
+            if (character.clips[i] == nullptr)
+            {
+                continue;
+            }
+            const float duration = character.clips[i]->getDuration();
+            float time = character.times[i] + deltaTime * character.speeds[i];
+            if (duration > 0.0f)
+            {
+                time = std::fmod(time, duration);
+                time = time < 0.0f ? time + duration : time;
+            }
+            character.times[i] = time;
+        }
+    }
+}
+
+void AnimationSystem::update(float deltaTime, WorkerPool *workerPool)
+{
+    advance(deltaTime);
+
+    const uint32_t characterCount = getCharacterCount();
+    const uint32_t batchCount = (characterCount + CharacterBatchSize - 1u) / CharacterBatchSize;
+    runTasks(workerPool, batchCount, [&](uint32_t batch)
+    {
+        const uint32_t end = (std::min)((batch + 1u) * CharacterBatchSize, characterCount);
+        for (uint32_t i = batch * CharacterBatchSize; i < end; ++i)
+        {
+            evaluateCharacter<false>(m_characters[i], &m_skinningMatrices[m_matrixOffsets[i]]);
+        }
+    });
+}
+
+void AnimationSystem::updateReference(float deltaTime)
+{
+    advance(deltaTime);
+
+    for (uint32_t i = 0u; i < getCharacterCount(); ++i)
+    {
+        evaluateCharacter<true>(m_characters[i], &m_skinningMatrices[m_matrixOffsets[i]]);
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+// Evaluates the skinning matrices of many animated characters every frame.
+// Each character plays two looping clips blended by a weight, walk into run for instance, and
+// ends up as one skinning matrix per joint in a single array the renderer can copy to the GPU as
+// is. Characters do not depend on each other, so update() splits them into batches on a
+// WorkerPool; the poses in between live on the worker's ScratchStack.
+// This file is platform independent so it can be built and profiled off Windows.
+
+#include <cstdint>
+#include <vector>
+
+#include "AnimationClip.h"
+#include "AnimationPose.h"
+
+class WorkerPool;
+
+struct AnimationCharacter
+{
+    const Skeleton *skeleton = nullptr;
+    const AnimationClip *clips[2] = {}; // Either may be null when its weight is zero
+    float times[2] = {};                // Seconds into each clip
+    float speeds[2] = { 1.0f, 1.0f };   // Playback rates
+    float blendWeight = 0.0f;           // 0 plays clips[0] alone, 1 clips[1] alone
+    QuatBlend blendMode = QuatBlend::Nlerp;
+};
+
+class AnimationSystem
+{
+public:
+    // The skeleton and clips must outlive the system. Returns the character's index.
+    uint32_t addCharacter(const AnimationCharacter &character);
+
+    uint32_t getCharacterCount() const { return static_cast<uint32_t>(m_characters.size()); }
+    AnimationCharacter &getCharacter(uint32_t index) { return m_characters[index]; }
+
+    // Advance every clip by deltaTime, wrapping around its end, then evaluate the characters,
+    // spread over workerPool when it is not null
+    void update(float deltaTime, WorkerPool *workerPool);
+
+    // The same one joint at a time on the calling thread, the output is identical to update
+    void updateReference(float deltaTime);
+
+    // Every character's matrices back to back, see getSkinningMatrixOffset
+    const std::vector<Mat4> &getSkinningMatrices() const { return m_skinningMatrices; }
+    uint32_t getSkinningMatrixOffset(uint32_t index) const { return m_matrixOffsets[index]; }
+
+private:
+    void advance(float deltaTime);
+
+    std::vector<AnimationCharacter> m_characters;
+    std::vector<uint32_t> m_matrixOffsets;
+    std::vector<Mat4> m_skinningMatrices;
+};
@@ -1,23 +1,60 @@
 #include "pch.h"
+#include "EngineLoop.h"
+#include "GpuResourceRegistry.h"
+#include "PickingIndex.h"
 #include "Renderer.h"
+#include "TripleBuffer.h"
+
+#include <filesystem>
+#include <sstream>
+
+#include <winrt/Windows.Storage.h>
+#include <winrt/Windows.System.h>
 
 using namespace winrt;
 
 using namespace Windows;
 using namespace Windows::ApplicationModel::Core;
 using namespace Windows::Foundation::Numerics;
-using namespace Windows::UI;
 using namespace Windows::UI::Core;
-using namespace Windows::UI::Composition;
 
 struct App : implements<App, IFrameworkViewSource, IFrameworkView>
 {
-    CompositionTarget m_target{ nullptr };
-    VisualCollection m_visuals{ nullptr };
-    Visual m_selected{ nullptr };
+    uint32_t m_selectedId = PickingIndex::InvalidId;
     float2 m_offset{};
 
+    // Blocks placed by clicking, drawn by the renderer's sprite batcher in m_drawOrder
+    std::vector<Sprite> m_sprites;
+    std::vector<uint32_t> m_drawOrder;     // Indices into m_sprites, back to front
+    std::vector<uint32_t> m_drawPositions; // Position of each sprite in m_drawOrder
+
+    // Copies of the sprite list handed to the render thread, see PublishSprites
+    struct SpriteFrame
+    {
+        std::vector<Sprite> sprites;
+        uint64_t version = 0u; // The publish that last wrote the slot, 0 if none did
+    };
+    TripleBuffer<SpriteFrame> m_spriteFrames;
+    const std::vector<Sprite> m_noSprites;
+
+    // Sprites only ever change from some draw position to the top: dragging moves the topmost one
+    // and clicking brings one to the front. Each publish records that position so a slot coming
+    // back to the writer only copies what changed since it was written.
+    static const size_t NothingChanged = SIZE_MAX;
+    static const uint64_t ChangeHistory = 8u;
+    uint64_t m_spriteVersion = 0u;
+    size_t m_firstChanged = NothingChanged;
+    size_t m_changedFrom[ChangeHistory] = {};
+
+    // Mirrors the position and size of every sprite, user data is the index into m_sprites
+    PickingIndex m_pickingIndex;
+
+    // CaptureBench puts PNG at 60 frames a second at about 4 encoders, fewer drop most frames
+    static const uint32_t PngCaptureEncoders = 4u;
+    bool m_capturing = false;
+
     Renderer *renderer;
+    EngineLoop *engineLoop;
 
     IFrameworkView CreateView()
     {
@@ -34,7 +71,15 @@ struct App : implements<App, IFrameworkViewSource, IFrameworkView>
 
     void Uninitialize()
     {
+        delete(engineLoop);
         delete(renderer);
+
+        // Every GPU resource should be gone with the renderer
+        std::ostringstream leaks;
+        if (getGpuResourceRegistry().writeLeakReport(leaks) != 0u)
+        {
+            OutputDebugStringA(leaks.str().c_str());
+        }
     }
 
     void Run()
@@ -42,115 +87,206 @@ struct App : implements<App, IFrameworkViewSource, IFrameworkView>
         CoreWindow window = CoreWindow::GetForCurrentThread();
         window.Activate();
 
-        while (true)
-        {
-            window.Dispatcher().ProcessEvents(CoreProcessEventsOption::ProcessAllIfPresent);
-            renderer->render();
-        }
+        // Simulation and rendering run on their own threads, this thread only pumps window events
+        engineLoop->start();
+        window.Dispatcher().ProcessEvents(CoreProcessEventsOption::ProcessUntilQuit);
+        engineLoop->stop();
 
         renderer->cleanUp();
     }
 
     void SetWindow(CoreWindow const & window)
     {
-        Compositor compositor;
-        ContainerVisual root = compositor.CreateContainerVisual();
-        m_target = compositor.CreateTargetForCurrentView();
-        m_target.Root(root);
-        m_visuals = root.Children();
-
         window.PointerPressed({ this, &App::OnPointerPressed });
         window.PointerMoved({ this, &App::OnPointerMoved });
+        window.KeyDown({ this, &App::OnKeyDown });
 
-        window.PointerReleased([&](auto && ...)
+        window.PointerReleased([&](IInspectable const &, PointerEventArgs const & args)
         {
-            m_selected = nullptr;
+            m_selectedId = PickingIndex::InvalidId;
+            PushInput(InputEvent::Type::PointerReleased, args);
         });
 
         renderer = new Renderer();
+        engineLoop = new EngineLoop([this](const SceneState &scene)
+        {
+            // Runs on the render thread, which is the only reader of m_spriteFrames
+            const SpriteFrame *frame = m_spriteFrames.acquireLatest();
+            renderer->render(scene, frame != nullptr ? frame->sprites : m_noSprites);
+        });
     }
 
     void OnPointerPressed(IInspectable const &, PointerEventArgs const & args)
     {
+        PushInput(InputEvent::Type::PointerPressed, args);
+
         float2 const point = args.CurrentPoint().Position();
 
-        for (Visual visual : m_visuals)
+        uint32_t const id = m_pickingIndex.pickTopmost(point.x, point.y);
+        if (id != PickingIndex::InvalidId)
         {
-            float3 const offset = visual.Offset();
-            float2 const size = visual.Size();
+            PickingIndex::Rect const & rect = m_pickingIndex.getRect(id);
 
-            if (point.x >= offset.x &&
-                point.x < offset.x + size.x &&
-                point.y >= offset.y &&
-                point.y < offset.y + size.y)
-            {
-                m_selected = visual;
-                m_offset.x = offset.x - point.x;
-                m_offset.y = offset.y - point.y;
-            }
-        }
+            m_selectedId = id;
+            m_offset.x = rect.minX - point.x;
+            m_offset.y = rect.minY - point.y;
 
-        if (m_selected)
-        {
-            m_visuals.Remove(m_selected);
-            m_visuals.InsertAtTop(m_selected);
+            BringToFront(m_pickingIndex.getUserData(id));
+            m_pickingIndex.bringToFront(id);
         }
         else
         {
-            AddVisual(point);
+            AddSprite(point);
         }
+
+        PublishSprites();
     }
 
     void OnPointerMoved(IInspectable const &, PointerEventArgs const & args)
     {
-        if (m_selected)
+        PushInput(InputEvent::Type::PointerMoved, args);
+
+        if (m_selectedId != PickingIndex::InvalidId)
         {
             float2 const point = args.CurrentPoint().Position();
 
-            m_selected.Offset(
-            {
-                point.x + m_offset.x,
-                point.y + m_offset.y,
-                0.0f
-            });
+            Sprite & sprite = m_sprites[m_pickingIndex.getUserData(m_selectedId)];
+            sprite.position[0] = point.x + m_offset.x;
+            sprite.position[1] = point.y + m_offset.y;
+
+            PickingIndex::Rect rect;
+            rect.minX = sprite.position[0];
+            rect.minY = sprite.position[1];
+            rect.maxX = rect.minX + sprite.size[0];
+            rect.maxY = rect.minY + sprite.size[1];
+            m_pickingIndex.move(m_selectedId, rect);
+
+            MarkChanged(m_drawPositions[m_pickingIndex.getUserData(m_selectedId)]);
+            PublishSprites();
+        }
+    }
+
+    // C starts and stops writing every presented frame as a PNG into a new folder under the app's local folder.
+    // The renderer applies the request on the render thread at the start of its next frame.
+    void OnKeyDown(IInspectable const &, KeyEventArgs const & args)
+    {
+        if (args.VirtualKey() != Windows::System::VirtualKey::C || args.KeyStatus().WasKeyDown)
+        {
+            return;
+        }
+
+        if (m_capturing)
+        {
+            renderer->stopCapture();
+        }
+        else
+        {
+            long long const seconds = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+            std::filesystem::path const directory = std::filesystem::path(Windows::Storage::ApplicationData::Current().LocalFolder().Path().c_str())
+                / ("capture_" + std::to_string(seconds));
+            renderer->startCapture(Renderer::CaptureSource::BackBuffer, std::make_unique<PngCaptureSink>(directory), PngCaptureEncoders);
+        }
+        m_capturing = !m_capturing;
+    }
+
+    // Forward a pointer event to the simulation thread in normalized device coordinates
+    void PushInput(InputEvent::Type type, PointerEventArgs const & args)
+    {
+        float2 const point = args.CurrentPoint().Position();
+        Windows::Foundation::Rect const bounds = CoreWindow::GetForCurrentThread().Bounds();
+
+        InputEvent event;
+        event.type = type;
+        event.x = point.x / bounds.Width * 2.0f - 1.0f;
+        event.y = 1.0f - point.y / bounds.Height * 2.0f;
+        event.timestamp = std::chrono::steady_clock::now();
+        engineLoop->pushInput(event);
+    }
+
+    // Move a sprite to the end of the draw order. Only the sprites above it shift, which the next
+    // publish has to copy anyway.
+    void BringToFront(uint32_t const spriteIndex)
+    {
+        size_t const position = m_drawPositions[spriteIndex];
+        std::rotate(m_drawOrder.begin() + position, m_drawOrder.begin() + position + 1, m_drawOrder.end());
+        for (size_t i = position; i < m_drawOrder.size(); ++i)
+        {
+            m_drawPositions[m_drawOrder[i]] = static_cast<uint32_t>(i);
         }
+        MarkChanged(position);
+    }
+
+    void MarkChanged(size_t const position)
+    {
+        m_firstChanged = (std::min)(m_firstChanged, position);
     }
 
-    void AddVisual(float2 const point)
+    // Hand the render thread the sprites in draw order. The slot keeps its contents between frames,
+    // so only the draw positions changed since it was last written are copied, unless it is too old
+    // for the change history.
+    void PublishSprites()
     {
-        Compositor compositor = m_visuals.Compositor();
-        SpriteVisual visual = compositor.CreateSpriteVisual();
+        uint64_t const version = ++m_spriteVersion;
+        m_changedFrom[version % ChangeHistory] = m_firstChanged;
+        m_firstChanged = NothingChanged;
+
+        SpriteFrame & frame = m_spriteFrames.beginWrite();
+        size_t first = 0;
+        if (frame.version != 0u && version - frame.version <= ChangeHistory)
+        {
+            first = frame.sprites.size();
+            for (uint64_t v = frame.version + 1u; v <= version; ++v)
+            {
+                first = (std::min)(first, m_changedFrom[v % ChangeHistory]);
+            }
+        }
+
+        frame.sprites.resize(m_drawOrder.size());
+        for (size_t i = first; i < m_drawOrder.size(); ++i)
+        {
+            frame.sprites[i] = m_sprites[m_drawOrder[i]];
+        }
+        frame.version = version;
+        m_spriteFrames.publish();
+    }
 
-        static Color colors[] =
+    void AddSprite(float2 const point)
+    {
+        // RGBA8 with the red channel in the low byte
+        static uint32_t const colors[] =
         {
-            { 0xDC, 0x5B, 0x9B, 0xD5 },
-            { 0xDC, 0xED, 0x7D, 0x31 },
-            { 0xDC, 0x70, 0xAD, 0x47 },
-            { 0xDC, 0xFF, 0xC0, 0x00 }
+            0xDCD59B5B,
+            0xDC317DED,
+            0xDC47AD70,
+            0xDC00C0FF
         };
 
         static unsigned last = 0;
         unsigned const next = ++last % _countof(colors);
-        visual.Brush(compositor.CreateColorBrush(colors[next]));
 
         float const BlockSize = 100.0f;
 
-        visual.Size(
-        {
-            BlockSize,
-            BlockSize
-        });
+        Sprite sprite;
+        sprite.position[0] = point.x - BlockSize / 2.0f;
+        sprite.position[1] = point.y - BlockSize / 2.0f;
+        sprite.size[0] = BlockSize;
+        sprite.size[1] = BlockSize;
+        sprite.color = colors[next];
+        sprite.image = static_cast<uint32_t>(last / _countof(colors)) % Renderer::SpriteImageCount; // Next shape once every color was used
 
-        visual.Offset(
-        {
-            point.x - BlockSize / 2.0f,
-            point.y - BlockSize / 2.0f,
-            0.0f,
-        });
+        uint32_t const spriteIndex = static_cast<uint32_t>(m_sprites.size());
+        m_sprites.push_back(sprite);
+        m_drawPositions.push_back(static_cast<uint32_t>(m_drawOrder.size()));
+        m_drawOrder.push_back(spriteIndex);
+        MarkChanged(m_drawPositions.back());
 
-        m_visuals.InsertAtTop(visual);
+        PickingIndex::Rect rect;
+        rect.minX = sprite.position[0];
+        rect.minY = sprite.position[1];
+        rect.maxX = rect.minX + BlockSize;
+        rect.maxY = rect.minY + BlockSize;
 
-        m_selected = visual;
+        m_selectedId = m_pickingIndex.insert(rect, spriteIndex);
         m_offset.x = -BlockSize / 2.0f;
         m_offset.y = -BlockSize / 2.0f;
     }
@@ -0,0 +1,594 @@
+#include "AsyncFileReader.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+    // Heap order, true when a is served after b
+    struct ServedLater
+    {
+        template <typename State>
+        bool operator()(const State *a, const State *b) const
+        {
+            if (a->request.priority != b->request.priority)
+            {
+                return a->request.priority > b->request.priority;
+            }
+            if (a->request.deadline != b->request.deadline)
+            {
+                return a->request.deadline > b->request.deadline;
+            }
+            return a->sequence > b->sequence;
+        }
+    };
+
+    uint32_t latencyBucket(uint64_t microseconds)
+    {
+        if (microseconds <= 1u)
+        {
+            return 0u;
+        }
+        double bucket = std::log2(static_cast<double>(microseconds)) * 4.0;
+        return (std::min)(static_cast<uint32_t>(bucket), 127u);
+    }
+
+    double bucketMilliseconds(uint32_t bucket)
+    {
+        // Upper edge of the bucket
+        return std::exp2((bucket + 1u) * 0.25) / 1000.0;
+    }
+}
+
+AsyncFileReader::AsyncFileReader() : AsyncFileReader(Settings())
+{
+}
+
+AsyncFileReader::AsyncFileReader(const Settings &settings)
+    : m_settings(settings)
+    , m_nextId(1u)
+    , m_outstanding(0u)
+    , m_quit(false)
+    , m_submittedRequests(0u)
+    , m_completedRequests(0u)
+    , m_failedRequests(0u)
+    , m_cancelledRequests(0u)
+    , m_missedDeadlines(0u)
+    , m_totalLatencyMicroseconds(0u)
+    , m_maxLatencyMicroseconds(0u)
+    , m_reads(0u)
+    , m_coalescedRequests(0u)
+    , m_bytesRead(0u)
+    , m_maxReadsInFlight(0u)
+    , m_chunksInFlight(0u)
+    , m_workersQuit(false)
+{
+    m_settings.queueDepth = (std::max)(m_settings.queueDepth, 1u);
+    m_settings.maxReadSize = (std::max)(m_settings.maxReadSize, 4096u);
+    m_settings.workerThreads = (std::max)(m_settings.workerThreads, 1u);
+    memset(m_latencyHistogram, 0, sizeof(m_latencyHistogram));
+
+    m_backend = FileReadBackend::create(m_settings.queueDepth);
+
+    m_ioThread = std::thread(&AsyncFileReader::ioLoop, this);
+    for (uint32_t i = 0u; i < m_settings.workerThreads; ++i)
+    {
+        m_workers.emplace_back(&AsyncFileReader::workerLoop, this);
+    }
+}
+
+AsyncFileReader::~AsyncFileReader()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+        for (RequestState *state : m_pending)
+        {
+            state->queued = false;
+            deliver(state, Status::Cancelled, std::vector<uint8_t>());
+        }
+        m_pending.clear();
+    }
+    m_backend->wake();
+    m_ioThread.join();
+
+    // Let the workers run every callback that is still owed before they stop
+    waitIdle();
+    {
+        std::lock_guard<std::mutex> lock(m_deliveryMutex);
+        m_workersQuit = true;
+    }
+    m_deliveryCondition.notify_all();
+    for (std::thread &worker : m_workers)
+    {
+        worker.join();
+    }
+
+    for (auto &openFile : m_openFiles)
+    {
+        m_backend->close(openFile.second.handle);
+    }
+}
+
+std::vector<AsyncFileReader::RequestId> AsyncFileReader::submit(std::vector<Request> batch)
+{
+    std::vector<RequestId> ids;
+    ids.reserve(batch.size());
+
+    Clock::time_point now = Clock::now();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (Request &request : batch)
+        {
+            std::unique_ptr<RequestState> state(new RequestState());
+            state->id = m_nextId++;
+            state->sequence = state->id;
+            state->pathKey = request.path.lexically_normal().string();
+            state->request = std::move(request);
+            state->submitTime = now;
+            state->queued = true;
+            state->cancelled = false;
+            state->delivering = false;
+
+            m_pending.push_back(state.get());
+            std::push_heap(m_pending.begin(), m_pending.end(), ServedLater());
+
+            ids.push_back(state->id);
+            m_requests.emplace(state->id, std::move(state));
+        }
+        m_outstanding += batch.size();
+        m_submittedRequests += batch.size();
+    }
+    m_backend->wake();
+
+    return ids;
+}
+
+AsyncFileReader::RequestId AsyncFileReader::submit(Request request)
+{
+    std::vector<Request> batch;
+    batch.push_back(std::move(request));
+    return submit(std::move(batch))[0];
+}
+
+bool AsyncFileReader::cancel(RequestId id)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto found = m_requests.find(id);
+    if (found == m_requests.end())
+    {
+        return false;
+    }
+    RequestState *state = found->second.get();
+    if (state->cancelled || state->delivering)
+    {
+        return false;
+    }
+
+    state->cancelled = true;
+    if (state->queued)
+    {
+        // Not read yet, drop it from the queue. Requests already being read finish their read
+        // and are reported as cancelled by the worker.
+        popPending(std::find(m_pending.begin(), m_pending.end(), state) - m_pending.begin());
+        deliver(state, Status::Cancelled, std::vector<uint8_t>());
+    }
+    return true;
+}
+
+void AsyncFileReader::waitIdle()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idleCondition.wait(lock, [this]() { return m_outstanding == 0u; });
+}
+
+AsyncFileReader::Stats AsyncFileReader::getStats() const
+{
+    Stats stats = {};
+    stats.reads = m_reads.load(std::memory_order_relaxed);
+    stats.coalescedRequests = m_coalescedRequests.load(std::memory_order_relaxed);
+    stats.bytesRead = m_bytesRead.load(std::memory_order_relaxed);
+    stats.maxReadsInFlight = m_maxReadsInFlight.load(std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    stats.submittedRequests = m_submittedRequests;
+    stats.completedRequests = m_completedRequests;
+    stats.failedRequests = m_failedRequests;
+    stats.cancelledRequests = m_cancelledRequests;
+    stats.missedDeadlines = m_missedDeadlines;
+
+    uint64_t delivered = m_completedRequests + m_failedRequests + m_cancelledRequests;
+    if (delivered > 0u)
+    {
+        stats.averageLatencyMs = m_totalLatencyMicroseconds / 1000.0 / delivered;
+        stats.maxLatencyMs = m_maxLatencyMicroseconds / 1000.0;
+
+        uint64_t medianRank = (delivered + 1u) / 2u;
+        uint64_t p99Rank = (delivered * 99u + 99u) / 100u;
+        uint64_t seen = 0u;
+        for (uint32_t bucket = 0u; bucket < LatencyBuckets; ++bucket)
+        {
+            uint64_t before = seen;
+            seen += m_latencyHistogram[bucket];
+            if (before < medianRank && seen >= medianRank)
+            {
+                stats.medianLatencyMs = (std::min)(bucketMilliseconds(bucket), stats.maxLatencyMs);
+            }
+            if (before < p99Rank && seen >= p99Rank)
+            {
+                stats.p99LatencyMs = (std::min)(bucketMilliseconds(bucket), stats.maxLatencyMs);
+                break;
+            }
+        }
+    }
+    return stats;
+}
+
+void AsyncFileReader::ioLoop()
+{
+    std::vector<FileReadBackend::Read *> completed;
+    while (issueReads())
+    {
+        // Nothing to do until a read finishes or a request arrives
+        completed.clear();
+        m_backend->wait(completed, true);
+        for (FileReadBackend::Read *read : completed)
+        {
+            onChunkComplete(read);
+        }
+    }
+}
+
+bool AsyncFileReader::issueReads()
+{
+    while (m_chunksInFlight < m_settings.queueDepth)
+    {
+        // Operations already started come first, they were started in priority order
+        ReadOperation *operation = nullptr;
+        for (ReadOperation *active : m_activeOperations)
+        {
+            if (!active->failed && active->nextOffset < active->end)
+            {
+                operation = active;
+                break;
+            }
+        }
+        if (operation == nullptr)
+        {
+            operation = startOperation();
+            if (operation == nullptr)
+            {
+                break;
+            }
+        }
+
+        uint64_t size = (std::min)(operation->end - operation->nextOffset, static_cast<uint64_t>(m_settings.maxReadSize));
+        issueChunk(operation, operation->nextOffset, size);
+        operation->nextOffset += size;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return !m_quit || m_chunksInFlight > 0u;
+}
+
+AsyncFileReader::ReadOperation *AsyncFileReader::startOperation()
+{
+    while (true)
+    {
+        RequestState *first = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_pending.empty() || m_quit)
+            {
+                return nullptr;
+            }
+            first = m_pending.front();
+            popPending(0u);
+        }
+
+        // Opening can block on the disk, so it happens outside the lock
+        OpenFile *file = openFile(*first);
+        uint64_t begin = 0u;
+        uint64_t end = 0u;
+        if (file == nullptr || !resolveRange(*first, *file, begin, end))
+        {
+            if (file != nullptr)
+            {
+                releaseFile(file);
+            }
+            std::lock_guard<std::mutex> lock(m_mutex);
+            deliver(first, Status::Failed, std::vector<uint8_t>());
+            continue;
+        }
+
+        ReadOperation *operation = m_operations.create();
+        operation->file = file;
+        operation->begin = begin;
+        operation->end = end;
+        operation->chunksInFlight = 0u;
+        operation->failed = false;
+        operation->requests.push_back(first);
+
+        // Pull in queued requests for nearby ranges of the same file, whatever their priority,
+        // since they cost little extra on top of this read
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            bool merged = true;
+            while (merged)
+            {
+                merged = false;
+                for (size_t i = 0u; i < m_pending.size();)
+                {
+                    RequestState *candidate = m_pending[i];
+                    uint64_t candidateBegin = 0u;
+                    uint64_t candidateEnd = 0u;
+                    if (candidate->pathKey != first->pathKey || !resolveRange(*candidate, *file, candidateBegin, candidateEnd) ||
+                        candidateBegin > operation->end + m_settings.coalesceGap ||
+                        candidateEnd + m_settings.coalesceGap < operation->begin)
+                    {
+                        ++i;
+                        continue;
+                    }
+
+                    uint64_t mergedBegin = (std::min)(operation->begin, candidateBegin);
+                    uint64_t mergedEnd = (std::max)(operation->end, candidateEnd);
+                    if (mergedEnd - mergedBegin > m_settings.maxCoalescedSize)
+                    {
+                        ++i;
+                        continue;
+                    }
+
+                    operation->begin = mergedBegin;
+                    operation->end = mergedEnd;
+                    operation->requests.push_back(candidate);
+                    candidate->queued = false;
+                    m_pending[i] = m_pending.back();
+                    m_pending.pop_back();
+                    merged = true;
+                }
+            }
+            if (operation->requests.size() > 1u)
+            {
+                std::make_heap(m_pending.begin(), m_pending.end(), ServedLater());
+                m_coalescedRequests.fetch_add(operation->requests.size(), std::memory_order_relaxed);
+            }
+        }
+
+        operation->nextOffset = operation->begin;
+        operation->buffer.resize(static_cast<size_t>(operation->end - operation->begin));
+        if (operation->begin == operation->end)
+        {
+            // Empty range, nothing to read
+            finishOperation(operation);
+            continue;
+        }
+
+        m_activeOperations.push_back(operation);
+        return operation;
+    }
+}
+
+void AsyncFileReader::issueChunk(ReadOperation *operation, uint64_t offset, uint64_t size)
+{
+    Chunk *chunk = m_chunks.create();
+    chunk->operation = operation;
+    chunk->read.file = operation->file->handle;
+    chunk->read.offset = offset;
+    chunk->read.size = static_cast<uint32_t>(size);
+    chunk->read.buffer = operation->buffer.data() + (offset - operation->begin);
+    chunk->read.userData = chunk;
+    chunk->read.result = 0;
+
+    ++operation->chunksInFlight;
+    ++m_chunksInFlight;
+    m_reads.fetch_add(1u, std::memory_order_relaxed);
+    if (m_chunksInFlight > m_maxReadsInFlight.load(std::memory_order_relaxed))
+    {
+        m_maxReadsInFlight.store(m_chunksInFlight, std::memory_order_relaxed);
+    }
+
+    m_backend->submit(&chunk->read);
+}
+
+void AsyncFileReader::onChunkComplete(FileReadBackend::Read *read)
+{
+    Chunk *chunk = static_cast<Chunk *>(read->userData);
+    ReadOperation *operation = chunk->operation;
+    --operation->chunksInFlight;
+    --m_chunksInFlight;
+
+    if (read->result <= 0)
+    {
+        // An error, or the file shrank under us
+        operation->failed = true;
+    }
+    else
+    {
+        m_bytesRead.fetch_add(static_cast<uint64_t>(read->result), std::memory_order_relaxed);
+        if (static_cast<uint64_t>(read->result) < read->size && !operation->failed)
+        {
+            // Short read, ask for the rest
+            issueChunk(operation, read->offset + read->result, read->size - read->result);
+        }
+    }
+    m_chunks.destroy(chunk);
+
+    if (operation->chunksInFlight == 0u && (operation->failed || operation->nextOffset == operation->end))
+    {
+        m_activeOperations.erase(std::find(m_activeOperations.begin(), m_activeOperations.end(), operation));
+        finishOperation(operation);
+    }
+}
+
+void AsyncFileReader::finishOperation(ReadOperation *operation)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (RequestState *state : operation->requests)
+    {
+        if (operation->failed)
+        {
+            deliver(state, Status::Failed, std::vector<uint8_t>());
+            continue;
+        }
+
+        uint64_t begin = 0u;
+        uint64_t end = 0u;
+        resolveRange(*state, *operation->file, begin, end);
+        if (operation->requests.size() == 1u && begin == operation->begin && end == operation->end)
+        {
+            deliver(state, Status::Completed, std::move(operation->buffer));
+        }
+        else
+        {
+            const uint8_t *data = operation->buffer.data() + (begin - operation->begin);
+            deliver(state, Status::Completed, std::vector<uint8_t>(data, data + (end - begin)));
+        }
+    }
+
+    releaseFile(operation->file);
+    m_operations.destroy(operation);
+}
+
+bool AsyncFileReader::resolveRange(const RequestState &state, const OpenFile &file, uint64_t &begin, uint64_t &end) const
+{
+    const Request &request = state.request;
+    if (request.offset > file.size)
+    {
+        return false;
+    }
+    begin = request.offset;
+    end = request.size == 0u ? file.size : request.offset + request.size;
+    return end >= begin && end <= file.size;
+}
+
+AsyncFileReader::OpenFile *AsyncFileReader::openFile(const RequestState &state)
+{
+    auto found = m_openFiles.find(state.pathKey);
+    if (found == m_openFiles.end())
+    {
+        OpenFile file = {};
+        file.handle = m_backend->open(state.request.path, file.size);
+        if (file.handle == FileReadBackend::InvalidFile)
+        {
+            return nullptr;
+        }
+        found = m_openFiles.emplace(state.pathKey, file).first;
+    }
+    ++found->second.users;
+    return &found->second;
+}
+
+void AsyncFileReader::releaseFile(OpenFile *file)
+{
+    if (--file->users > 0u)
+    {
+        return;
+    }
+    for (auto it = m_openFiles.begin(); it != m_openFiles.end(); ++it)
+    {
+        if (&it->second == file)
+        {
+            m_backend->close(file->handle);
+            m_openFiles.erase(it);
+            return;
+        }
+    }
+}
+
+void AsyncFileReader::popPending(size_t index)
+{
+    // Caller holds m_mutex
+    m_pending[index]->queued = false;
+    if (index == 0u)
+    {
+        std::pop_heap(m_pending.begin(), m_pending.end(), ServedLater());
+        m_pending.pop_back();
+        return;
+    }
+    m_pending[index] = m_pending.back();
+    m_pending.pop_back();
+    std::make_heap(m_pending.begin(), m_pending.end(), ServedLater());
+}
+
+void AsyncFileReader::deliver(RequestState *state, Status status, std::vector<uint8_t> &&data)
+{
+    // Caller holds m_mutex
+    {
+        std::lock_guard<std::mutex> lock(m_deliveryMutex);
+        m_deliveries.push_back(Delivery{ state, status, std::move(data) });
+    }
+    m_deliveryCondition.notify_one();
+}
+
+void AsyncFileReader::workerLoop()
+{
+    while (true)
+    {
+        Delivery delivery;
+        {
+            std::unique_lock<std::mutex> lock(m_deliveryMutex);
+            m_deliveryCondition.wait(lock, [this]() { return m_workersQuit || !m_deliveries.empty(); });
+            if (m_deliveries.empty())
+            {
+                return;
+            }
+            delivery = std::move(m_deliveries.front());
+            m_deliveries.pop_front();
+        }
+
+        RequestState *state = delivery.state;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (state->cancelled)
+            {
+                delivery.status = Status::Cancelled;
+            }
+            state->delivering = true;
+        }
+
+        if (delivery.status == Status::Completed && state->request.decompress && !state->request.decompress(delivery.data))
+        {
+            delivery.status = Status::Failed;
+        }
+        if (delivery.status != Status::Completed)
+        {
+            delivery.data.clear();
+        }
+
+        Clock::time_point now = Clock::now();
+        if (state->request.onComplete)
+        {
+            state->request.onComplete(state->id, delivery.status, delivery.data);
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        uint64_t latency = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(now - state->submitTime).count());
+        m_totalLatencyMicroseconds += latency;
+        m_maxLatencyMicroseconds = (std::max)(m_maxLatencyMicroseconds, latency);
+        ++m_latencyHistogram[latencyBucket(latency)];
+        switch (delivery.status)
+        {
+        case Status::Completed:
+            ++m_completedRequests;
+            if (now > state->request.deadline)
+            {
+                ++m_missedDeadlines;
+            }
+            break;
+        case Status::Failed:
+            ++m_failedRequests;
+            break;
+        case Status::Cancelled:
+            ++m_cancelledRequests;
+            break;
+        }
+
+        m_requests.erase(state->id);
+        if (--m_outstanding == 0u)
+        {
+            m_idleCondition.notify_all();
+        }
+    }
+}
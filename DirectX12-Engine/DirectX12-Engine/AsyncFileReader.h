@@ -0,0 +1,224 @@
+#pragma once
+
+// Asynchronous file reads for asset loading.
+// Requests are submitted in batches and served in order of priority, then deadline, then
+// submission. A dedicated I/O thread keeps up to queueDepth reads in flight through the
+// platform backend (io_uring, overlapped I/O or a thread pool, see FileReadBackend), folds
+// requests for nearby ranges of the same file into one read, and splits large requests into
+// several reads that run side by side. Finished data goes to a few worker threads that run the
+// request's optional decompression step and then its completion callback, so neither ever
+// stalls the reads behind them.
+// This file is platform independent so it can be built and profiled off Windows.
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "FileReadBackend.h"
+#include "ObjectPool.h"
+
+class AsyncFileReader
+{
+public:
+    typedef uint64_t RequestId;
+    static const RequestId InvalidRequest = 0u;
+
+    typedef std::chrono::steady_clock Clock;
+
+    enum class Priority : uint32_t
+    {
+        Critical,
+        High,
+        Normal,
+        Low
+    };
+
+    enum class Status
+    {
+        Completed,
+        Failed,    // Missing file, range past the end, read error or decompression failure
+        Cancelled
+    };
+
+    // Turn the bytes read into the final data in place, return false if they are corrupt
+    typedef std::function<bool(std::vector<uint8_t> &data)> DecompressFunction;
+    typedef std::function<void(RequestId id, Status status, std::vector<uint8_t> &data)> CompletionFunction;
+
+    struct Request
+    {
+        std::filesystem::path path;
+        uint64_t offset = 0u;
+        uint64_t size = 0u;                                    // Zero reads to the end of the file
+        Priority priority = Priority::Normal;
+        Clock::time_point deadline = Clock::time_point::max(); // Orders requests of equal priority, a miss is only counted
+        DecompressFunction decompress;                         // Optional, runs on a worker thread
+        CompletionFunction onComplete;                         // Runs on a worker thread
+    };
+
+    struct Settings
+    {
+        uint32_t queueDepth = 32u;            // Reads in flight at once
+        uint32_t maxReadSize = 1u << 20;      // Larger requests are split into reads of this size
+        uint32_t coalesceGap = 64u << 10;     // Requests on one file closer than this share a read
+        uint32_t maxCoalescedSize = 4u << 20; // Upper bound for a shared read
+        uint32_t workerThreads = 2u;          // Run decompression and completion callbacks
+    };
+
+    struct Stats
+    {
+        uint64_t submittedRequests;
+        uint64_t completedRequests;
+        uint64_t failedRequests;
+        uint64_t cancelledRequests;
+        uint64_t missedDeadlines;
+        uint64_t reads;             // Reads issued to the backend
+        uint64_t coalescedRequests; // Requests that shared a read with at least one other
+        uint64_t bytesRead;
+        uint32_t maxReadsInFlight;
+        double averageLatencyMs;    // From submission to the completion callback
+        double medianLatencyMs;
+        double p99LatencyMs;
+        double maxLatencyMs;
+    };
+
+    AsyncFileReader();
+    explicit AsyncFileReader(const Settings &settings);
+
+    // Cancels everything still queued and waits for the reads in flight
+    ~AsyncFileReader();
+
+    AsyncFileReader(const AsyncFileReader &) = delete;
+    AsyncFileReader &operator=(const AsyncFileReader &) = delete;
+
+    // Thread safe. Returns one id per request in the order given.
+    std::vector<RequestId> submit(std::vector<Request> batch);
+    RequestId submit(Request request);
+
+    // Thread safe. Returns false if the request has already been delivered or was never submitted.
+    // A cancelled request still gets its callback, with Status::Cancelled and no data.
+    bool cancel(RequestId id);
+
+    // Block until every submitted request has been delivered
+    void waitIdle();
+
+    Stats getStats() const;
+    const char *getBackendName() const { return m_backend->getName(); }
+
+private:
+    struct RequestState
+    {
+        RequestId id;
+        uint64_t sequence;
+        Request request;
+        std::string pathKey;
+        Clock::time_point submitTime;
+
+        bool queued;     // In m_pending, guarded by m_mutex
+        bool cancelled;  // Guarded by m_mutex
+        bool delivering; // Guarded by m_mutex, set once a worker has started on it
+    };
+
+    struct OpenFile
+    {
+        FileReadBackend::FileHandle handle;
+        uint64_t size;
+        uint32_t users;
+    };
+
+    // One contiguous range of a file that serves one or more requests
+    struct ReadOperation
+    {
+        OpenFile *file;
+        uint64_t begin;
+        uint64_t end;
+        uint64_t nextOffset;     // Start of the next chunk to issue
+        uint32_t chunksInFlight;
+        bool failed;
+        std::vector<RequestState *> requests;
+        std::vector<uint8_t> buffer;
+    };
+
+    struct Chunk
+    {
+        FileReadBackend::Read read;
+        ReadOperation *operation;
+    };
+
+    struct Delivery
+    {
+        RequestState *state;
+        Status status;
+        std::vector<uint8_t> data;
+    };
+
+    static const uint32_t LatencyBuckets = 128u; // Quarter octaves from one microsecond
+
+    void ioLoop();
+    void workerLoop();
+
+    bool issueReads();
+    ReadOperation *startOperation();
+    void issueChunk(ReadOperation *operation, uint64_t offset, uint64_t size);
+    void onChunkComplete(FileReadBackend::Read *read);
+    void finishOperation(ReadOperation *operation);
+
+    bool resolveRange(const RequestState &state, const OpenFile &file, uint64_t &begin, uint64_t &end) const;
+    OpenFile *openFile(const RequestState &state);
+    void releaseFile(OpenFile *file);
+
+    void popPending(size_t index);
+    void deliver(RequestState *state, Status status, std::vector<uint8_t> &&data);
+
+    Settings m_settings;
+    std::unique_ptr<FileReadBackend> m_backend;
+
+    // Requests waiting for a read, a heap ordered by priority, deadline and submission
+    mutable std::mutex m_mutex;
+    std::condition_variable m_idleCondition;
+    std::vector<RequestState *> m_pending;
+    std::unordered_map<RequestId, std::unique_ptr<RequestState>> m_requests;
+    RequestId m_nextId;
+    uint64_t m_outstanding;
+    bool m_quit;
+
+    // Statistics guarded by m_mutex
+    uint64_t m_submittedRequests;
+    uint64_t m_completedRequests;
+    uint64_t m_failedRequests;
+    uint64_t m_cancelledRequests;
+    uint64_t m_missedDeadlines;
+    uint64_t m_totalLatencyMicroseconds;
+    uint64_t m_maxLatencyMicroseconds;
+    uint64_t m_latencyHistogram[LatencyBuckets];
+
+    // Statistics written by the I/O thread
+    std::atomic<uint64_t> m_reads;
+    std::atomic<uint64_t> m_coalescedRequests;
+    std::atomic<uint64_t> m_bytesRead;
+    std::atomic<uint32_t> m_maxReadsInFlight;
+
+    // Owned by the I/O thread
+    std::thread m_ioThread;
+    std::unordered_map<std::string, OpenFile> m_openFiles;
+    ObjectPool<ReadOperation> m_operations;
+    ObjectPool<Chunk> m_chunks;
+    std::vector<ReadOperation *> m_activeOperations; // In the order they were started
+    uint32_t m_chunksInFlight;
+
+    // Deliveries waiting for a worker
+    std::mutex m_deliveryMutex;
+    std::condition_variable m_deliveryCondition;
+    std::deque<Delivery> m_deliveries;
+    bool m_workersQuit;
+    std::vector<std::thread> m_workers;
+};
@@ -0,0 +1,173 @@
+#include "AtlasPacker.h"
+
+#include <algorithm>
+#include <numeric>
+
+AtlasPacker::AtlasPacker(uint32_t pageWidth, uint32_t pageHeight, uint32_t padding)
+    : m_pageWidth(pageWidth)
+    , m_pageHeight(pageHeight)
+    , m_padding(padding)
+    , m_usedArea(0u)
+{
+}
+
+bool AtlasPacker::pack(uint32_t width, uint32_t height, Region &region)
+{
+    if (width == 0u || height == 0u || width > m_pageWidth || height > m_pageHeight)
+    {
+        return false;
+    }
+
+    // Padding may be dropped at the page edge where there is nothing to bleed into
+    const uint32_t paddedWidth = std::min(width + m_padding, m_pageWidth);
+    const uint32_t paddedHeight = std::min(height + m_padding, m_pageHeight);
+
+    uint32_t x = 0u;
+    uint32_t y = 0u;
+    uint32_t page = 0u;
+    while (page < m_pages.size() && !packInPage(m_pages[page], paddedWidth, paddedHeight, x, y))
+    {
+        ++page;
+    }
+
+    if (page == m_pages.size())
+    {
+        m_pages.push_back(createPage());
+        packInPage(m_pages.back(), paddedWidth, paddedHeight, x, y);
+    }
+
+    region.page = page;
+    region.x = x;
+    region.y = y;
+    region.width = width;
+    region.height = height;
+
+    m_usedArea += static_cast<uint64_t>(width) * height;
+    return true;
+}
+
+bool AtlasPacker::packAll(const uint32_t *widths, const uint32_t *heights, uint32_t count, Region *regions)
+{
+    std::vector<uint32_t> order(count);
+    std::iota(order.begin(), order.end(), 0u);
+    std::sort(order.begin(), order.end(), [widths, heights](uint32_t a, uint32_t b)
+    {
+        return heights[a] != heights[b] ? heights[a] > heights[b] : widths[a] > widths[b];
+    });
+
+    bool packedAll = true;
+    for (uint32_t index : order)
+    {
+        if (!pack(widths[index], heights[index], regions[index]))
+        {
+            regions[index] = {};
+            packedAll = false;
+        }
+    }
+    return packedAll;
+}
+
+void AtlasPacker::reset()
+{
+    m_pages.clear();
+    m_usedArea = 0u;
+}
+
+float AtlasPacker::getOccupancy() const
+{
+    const uint64_t pageArea = static_cast<uint64_t>(m_pageWidth) * m_pageHeight * m_pages.size();
+    return pageArea > 0u ? static_cast<float>(static_cast<double>(m_usedArea) / static_cast<double>(pageArea)) : 0.0f;
+}
+
+// Find the position where the image's top edge ends up lowest, ties go to the narrowest segment.
+bool AtlasPacker::packInPage(Skyline &skyline, uint32_t width, uint32_t height, uint32_t &x, uint32_t &y) const
+{
+    size_t bestIndex = skyline.size();
+    uint32_t bestBottom = UINT32_MAX;
+    uint32_t bestWidth = UINT32_MAX;
+    uint32_t bestY = 0u;
+
+    for (size_t i = 0u; i < skyline.size(); ++i)
+    {
+        const uint32_t left = skyline[i].x;
+        if (left + width > m_pageWidth)
+        {
+            break;
+        }
+
+        // The image rests on the highest segment it spans
+        uint32_t top = 0u;
+        uint32_t covered = 0u;
+        for (size_t j = i; covered < width; ++j)
+        {
+            top = std::max(top, skyline[j].y);
+            covered = skyline[j].x + skyline[j].width - left;
+        }
+
+        const uint32_t bottom = top + height;
+        if (bottom > m_pageHeight)
+        {
+            continue;
+        }
+
+        if (bottom < bestBottom || (bottom == bestBottom && skyline[i].width < bestWidth))
+        {
+            bestIndex = i;
+            bestBottom = bottom;
+            bestWidth = skyline[i].width;
+            bestY = top;
+        }
+    }
+
+    if (bestIndex == skyline.size())
+    {
+        return false;
+    }
+
+    x = skyline[bestIndex].x;
+    y = bestY;
+    addSegment(skyline, bestIndex, x, bestBottom, width);
+    return true;
+}
+
+void AtlasPacker::addSegment(Skyline &skyline, size_t index, uint32_t x, uint32_t y, uint32_t width)
+{
+    skyline.insert(skyline.begin() + index, Segment{ x, y, width });
+
+    // Trim the segments that are now hidden under the new one
+    const uint32_t right = x + width;
+    size_t next = index + 1u;
+    while (next < skyline.size() && skyline[next].x < right)
+    {
+        const uint32_t segmentRight = skyline[next].x + skyline[next].width;
+        if (segmentRight <= right)
+        {
+            skyline.erase(skyline.begin() + next);
+        }
+        else
+        {
+            skyline[next].width = segmentRight - right;
+            skyline[next].x = right;
+            break;
+        }
+    }
+
+    // Merge neighbours at the same height
+    for (size_t i = 0u; i + 1u < skyline.size();)
+    {
+        if (skyline[i].y == skyline[i + 1u].y)
+        {
+            skyline[i].width += skyline[i + 1u].width;
+            skyline.erase(skyline.begin() + i + 1u);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+}
+
+AtlasPacker::Skyline AtlasPacker::createPage() const
+{
+    return Skyline{ Segment{ 0u, 0u, m_pageWidth } };
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+// Packs sprite images into fixed size atlas pages using the skyline bottom left heuristic.
+// Each page keeps the outline of its filled area as a list of horizontal segments, and an image is
+// placed where it raises that outline the least. A new page is opened when an image does not fit.
+// This file is platform independent so packing can be tuned off Windows.
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class AtlasPacker
+{
+public:
+    struct Region
+    {
+        uint32_t page;
+        uint32_t x;
+        uint32_t y;
+        uint32_t width;
+        uint32_t height;
+    };
+
+    // padding is left empty to the right of and below every image so filtering does not bleed
+    AtlasPacker(uint32_t pageWidth, uint32_t pageHeight, uint32_t padding = 1u);
+
+    // Returns false if the image is larger than a page
+    bool pack(uint32_t width, uint32_t height, Region &region);
+
+    // Pack many images at once, tallest first, which wastes less space than packing in arrival order.
+    // Regions are written in input order. Returns false if any image is larger than a page.
+    bool packAll(const uint32_t *widths, const uint32_t *heights, uint32_t count, Region *regions);
+
+    void reset();
+
+    uint32_t getPageCount() const { return static_cast<uint32_t>(m_pages.size()); }
+    uint32_t getPageWidth() const { return m_pageWidth; }
+    uint32_t getPageHeight() const { return m_pageHeight; }
+
+    // Fraction of the area of all open pages covered by images, padding excluded
+    float getOccupancy() const;
+
+private:
+    struct Segment
+    {
+        uint32_t x;
+        uint32_t y; // Top of the free space above this segment
+        uint32_t width;
+    };
+
+    typedef std::vector<Segment> Skyline;
+
+    bool packInPage(Skyline &skyline, uint32_t width, uint32_t height, uint32_t &x, uint32_t &y) const;
+    static void addSegment(Skyline &skyline, size_t index, uint32_t x, uint32_t y, uint32_t width);
+    Skyline createPage() const;
+
+    uint32_t m_pageWidth;
+    uint32_t m_pageHeight;
+    uint32_t m_padding;
+    std::vector<Skyline> m_pages;
+    uint64_t m_usedArea;
+};
@@ -0,0 +1,542 @@
+#include "CaptureSink.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+    // Deflate's length and distance codes, see RFC 1951 section 3.2.5
+    const uint16_t LengthBases[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    const uint8_t LengthExtraBits[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    const uint16_t DistanceBases[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    const uint8_t DistanceExtraBits[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+    const uint32_t MinMatch = 3u;
+    const uint32_t MaxMatch = 258u;
+    const uint32_t WindowSize = 32768u;
+    const uint32_t HashBits = 15u;
+
+    uint32_t reverseBits(uint32_t value, uint32_t count)
+    {
+        uint32_t reversed = 0u;
+        for (uint32_t i = 0u; i < count; ++i)
+        {
+            reversed = (reversed << 1) | ((value >> i) & 1u);
+        }
+        return reversed;
+    }
+
+    // The fixed literal and length codes, already reversed for the LSB first bit stream
+    struct FixedCodes
+    {
+        uint16_t literalCodes[288];
+        uint8_t literalLengths[288];
+        uint8_t distanceCodes[30];
+        uint8_t lengthSymbols[MaxMatch + 1u]; // Index into LengthBases of every match length
+
+        FixedCodes()
+        {
+            for (uint32_t symbol = 0u; symbol < 288u; ++symbol)
+            {
+                uint32_t code;
+                uint32_t length;
+                if (symbol < 144u)
+                {
+                    code = 0x30u + symbol;
+                    length = 8u;
+                }
+                else if (symbol < 256u)
+                {
+                    code = 0x190u + symbol - 144u;
+                    length = 9u;
+                }
+                else if (symbol < 280u)
+                {
+                    code = symbol - 256u;
+                    length = 7u;
+                }
+                else
+                {
+                    code = 0xc0u + symbol - 280u;
+                    length = 8u;
+                }
+                literalCodes[symbol] = static_cast<uint16_t>(reverseBits(code, length));
+                literalLengths[symbol] = static_cast<uint8_t>(length);
+            }
+            for (uint32_t symbol = 0u; symbol < 30u; ++symbol)
+            {
+                distanceCodes[symbol] = static_cast<uint8_t>(reverseBits(symbol, 5u));
+            }
+            uint32_t symbol = 0u;
+            for (uint32_t length = MinMatch; length <= MaxMatch; ++length)
+            {
+                while (symbol + 1u < 29u && LengthBases[symbol + 1u] <= length)
+                {
+                    ++symbol;
+                }
+                lengthSymbols[length] = static_cast<uint8_t>(symbol);
+            }
+        }
+    };
+
+    const FixedCodes &getFixedCodes()
+    {
+        static const FixedCodes codes;
+        return codes;
+    }
+
+    class BitWriter
+    {
+    public:
+        explicit BitWriter(std::vector<uint8_t> &out)
+            : m_out(out)
+            , m_bits(0u)
+            , m_count(0u)
+        {
+        }
+
+        void put(uint32_t value, uint32_t count)
+        {
+            m_bits |= static_cast<uint64_t>(value) << m_count;
+            m_count += count;
+            while (m_count >= 8u)
+            {
+                m_out.push_back(static_cast<uint8_t>(m_bits));
+                m_bits >>= 8;
+                m_count -= 8u;
+            }
+        }
+
+        void flush()
+        {
+            if (m_count > 0u)
+            {
+                m_out.push_back(static_cast<uint8_t>(m_bits));
+            }
+            m_bits = 0u;
+            m_count = 0u;
+        }
+
+    private:
+        std::vector<uint8_t> &m_out;
+        uint64_t m_bits;
+        uint32_t m_count;
+    };
+
+    // One fixed Huffman block with greedy matches against the last position of every 3 byte hash
+    void deflateFixed(const uint8_t *data, size_t size, std::vector<uint8_t> &out)
+    {
+        const FixedCodes &codes = getFixedCodes();
+        BitWriter writer(out);
+        writer.put(1u, 1u); // Final block
+        writer.put(1u, 2u); // Fixed Huffman codes
+
+        std::vector<int32_t> head(static_cast<size_t>(1u) << HashBits, -1);
+        auto hash = [data](size_t position)
+        {
+            const uint32_t value = static_cast<uint32_t>(data[position]) | (static_cast<uint32_t>(data[position + 1u]) << 8) | (static_cast<uint32_t>(data[position + 2u]) << 16);
+            return (value * 2654435761u) >> (32u - HashBits);
+        };
+
+        size_t position = 0u;
+        while (position < size)
+        {
+            uint32_t matchLength = 0u;
+            uint32_t matchDistance = 0u;
+            if (position + MinMatch <= size)
+            {
+                const uint32_t key = hash(position);
+                const int32_t candidate = head[key];
+                head[key] = static_cast<int32_t>(position);
+                if (candidate >= 0 && position - static_cast<size_t>(candidate) <= WindowSize)
+                {
+                    const uint32_t limit = static_cast<uint32_t>((std::min)(static_cast<size_t>(MaxMatch), size - position));
+                    const uint8_t *match = data + candidate;
+                    const uint8_t *current = data + position;
+                    uint32_t length = 0u;
+                    while (length < limit && match[length] == current[length])
+                    {
+                        ++length;
+                    }
+                    if (length >= MinMatch)
+                    {
+                        matchLength = length;
+                        matchDistance = static_cast<uint32_t>(position - static_cast<size_t>(candidate));
+                    }
+                }
+            }
+
+            if (matchLength == 0u)
+            {
+                writer.put(codes.literalCodes[data[position]], codes.literalLengths[data[position]]);
+                ++position;
+                continue;
+            }
+
+            const uint32_t lengthSymbol = codes.lengthSymbols[matchLength];
+            writer.put(codes.literalCodes[257u + lengthSymbol], codes.literalLengths[257u + lengthSymbol]);
+            writer.put(matchLength - LengthBases[lengthSymbol], LengthExtraBits[lengthSymbol]);
+
+            const uint32_t distanceSymbol = static_cast<uint32_t>(std::upper_bound(DistanceBases, DistanceBases + 30, matchDistance) - DistanceBases) - 1u;
+            writer.put(codes.distanceCodes[distanceSymbol], 5u);
+            writer.put(matchDistance - DistanceBases[distanceSymbol], DistanceExtraBits[distanceSymbol]);
+
+            // Remember the positions inside the match too, long runs are what images repeat most
+            const size_t end = position + matchLength;
+            for (++position; position < end; ++position)
+            {
+                if (position + MinMatch <= size)
+                {
+                    head[hash(position)] = static_cast<int32_t>(position);
+                }
+            }
+        }
+
+        writer.put(codes.literalCodes[256], codes.literalLengths[256]); // End of block
+        writer.flush();
+    }
+
+    uint32_t adler32(const uint8_t *data, size_t size)
+    {
+        uint32_t a = 1u;
+        uint32_t b = 0u;
+        while (size > 0u)
+        {
+            // The largest run before b can overflow 32 bits
+            const size_t run = (std::min)(size, static_cast<size_t>(5552u));
+            for (size_t i = 0u; i < run; ++i)
+            {
+                a += data[i];
+                b += a;
+            }
+            a %= 65521u;
+            b %= 65521u;
+            data += run;
+            size -= run;
+        }
+        return (b << 16) | a;
+    }
+
+    uint32_t crc32(const uint8_t *data, size_t size, uint32_t crc = 0u)
+    {
+        struct Table
+        {
+            uint32_t entries[256];
+
+            Table()
+            {
+                for (uint32_t i = 0u; i < 256u; ++i)
+                {
+                    uint32_t value = i;
+                    for (uint32_t bit = 0u; bit < 8u; ++bit)
+                    {
+                        value = (value & 1u) != 0u ? 0xedb88320u ^ (value >> 1) : value >> 1;
+                    }
+                    entries[i] = value;
+                }
+            }
+        };
+        static const Table table;
+
+        crc = ~crc;
+        for (size_t i = 0u; i < size; ++i)
+        {
+            crc = table.entries[(crc ^ data[i]) & 0xffu] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+
+    void appendBigEndian(std::vector<uint8_t> &out, uint32_t value)
+    {
+        out.push_back(static_cast<uint8_t>(value >> 24));
+        out.push_back(static_cast<uint8_t>(value >> 16));
+        out.push_back(static_cast<uint8_t>(value >> 8));
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    // Length, type and data are appended by the caller from chunkStart on, this adds the CRC
+    void finishChunk(std::vector<uint8_t> &png, size_t chunkStart)
+    {
+        const uint32_t dataSize = static_cast<uint32_t>(png.size() - chunkStart - 8u);
+        png[chunkStart] = static_cast<uint8_t>(dataSize >> 24);
+        png[chunkStart + 1u] = static_cast<uint8_t>(dataSize >> 16);
+        png[chunkStart + 2u] = static_cast<uint8_t>(dataSize >> 8);
+        png[chunkStart + 3u] = static_cast<uint8_t>(dataSize);
+        appendBigEndian(png, crc32(&png[chunkStart + 4u], dataSize + 4u));
+    }
+
+    void beginChunk(std::vector<uint8_t> &png, const char *type)
+    {
+        appendBigEndian(png, 0u);
+        png.insert(png.end(), type, type + 4);
+    }
+
+    uint8_t toGrey(float value)
+    {
+        return static_cast<uint8_t>((std::min)((std::max)(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+    }
+
+    // The neighbour closest to left + up - upLeft, written with selects so it compiles without
+    // branches
+    int32_t paethPredictor(int32_t left, int32_t up, int32_t upLeft)
+    {
+        const int32_t toLeft = std::abs(up - upLeft);
+        const int32_t toUp = std::abs(left - upLeft);
+        const int32_t toUpLeft = std::abs(left + up - 2 * upLeft);
+        const int32_t upOrUpLeft = toUp <= toUpLeft ? up : upLeft;
+        return toLeft <= toUp && toLeft <= toUpLeft ? left : upOrUpLeft;
+    }
+
+    // Rows of 8 bit samples as the PNG stores them, RGB or grey
+    void gatherPngRow(const CaptureFrame &frame, uint32_t y, uint8_t *row)
+    {
+        const uint8_t *source = frame.data + static_cast<size_t>(y) * frame.rowPitch;
+        if (frame.format == CaptureFormat::Rgba8)
+        {
+            for (uint32_t x = 0u; x < frame.width; ++x)
+            {
+                row[x * 3u] = source[x * 4u];
+                row[x * 3u + 1u] = source[x * 4u + 1u];
+                row[x * 3u + 2u] = source[x * 4u + 2u];
+            }
+            return;
+        }
+        for (uint32_t x = 0u; x < frame.width; ++x)
+        {
+            float value;
+            memcpy(&value, source + x * sizeof(float), sizeof(float));
+            row[x] = toGrey(value);
+        }
+    }
+
+    std::filesystem::path makeFramePath(const std::filesystem::path &directory, uint64_t frameNumber, const char *suffix)
+    {
+        char name[96];
+        std::snprintf(name, sizeof(name), "frame_%06llu%s", static_cast<unsigned long long>(frameNumber), suffix);
+        return directory / name;
+    }
+
+    void writeFile(const std::filesystem::path &path, const std::vector<uint8_t> &data)
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char *>(data.data()), static_cast<std::streamsize>(data.size()));
+    }
+}
+
+uint32_t getCaptureBytesPerPixel(CaptureFormat format)
+{
+    switch (format)
+    {
+    case CaptureFormat::Rgba8:
+        return 4u;
+    case CaptureFormat::R32Float:
+        return static_cast<uint32_t>(sizeof(float));
+    }
+    return 0u;
+}
+
+RawCaptureSink::RawCaptureSink(const std::filesystem::path &directory)
+    : m_directory(directory)
+{
+    std::filesystem::create_directories(m_directory);
+}
+
+void RawCaptureSink::encode(const CaptureFrame &frame, std::vector<uint8_t> &encoded)
+{
+    const size_t rowSize = static_cast<size_t>(frame.width) * getCaptureBytesPerPixel(frame.format);
+    encoded.resize(rowSize * frame.height);
+    for (uint32_t y = 0u; y < frame.height; ++y)
+    {
+        memcpy(&encoded[y * rowSize], frame.data + static_cast<size_t>(y) * frame.rowPitch, rowSize);
+    }
+}
+
+void RawCaptureSink::write(const CaptureFrame &frame, const std::vector<uint8_t> &encoded)
+{
+    char suffix[64];
+    std::snprintf(suffix, sizeof(suffix), "_%ux%u_%s.raw", frame.width, frame.height, frame.format == CaptureFormat::Rgba8 ? "rgba8" : "r32f");
+    writeFile(makeFramePath(m_directory, frame.frameNumber, suffix), encoded);
+}
+
+PngCaptureSink::PngCaptureSink(const std::filesystem::path &directory)
+    : m_directory(directory)
+{
+    std::filesystem::create_directories(m_directory);
+}
+
+void PngCaptureSink::encode(const CaptureFrame &frame, std::vector<uint8_t> &encoded)
+{
+    encodePng(frame, encoded);
+}
+
+void PngCaptureSink::write(const CaptureFrame &frame, const std::vector<uint8_t> &encoded)
+{
+    writeFile(makeFramePath(m_directory, frame.frameNumber, ".png"), encoded);
+}
+
+void PngCaptureSink::encodePng(const CaptureFrame &frame, std::vector<uint8_t> &png)
+{
+    const uint32_t channels = frame.format == CaptureFormat::Rgba8 ? 3u : 1u;
+    const size_t rowSize = static_cast<size_t>(frame.width) * channels;
+
+    // Every row gets the filter that leaves the smallest sum of absolute differences, the usual
+    // guess at what deflates best. The row before the first is all zeros, as the format defines.
+    std::vector<uint8_t> filtered((rowSize + 1u) * frame.height);
+    std::vector<uint8_t> rows(2u * rowSize, 0u);
+    std::vector<uint8_t> candidates(3u * rowSize);
+    uint8_t *sub = candidates.data();
+    uint8_t *up = sub + rowSize;
+    uint8_t *paeth = up + rowSize;
+    for (uint32_t y = 0u; y < frame.height; ++y)
+    {
+        uint8_t *row = &rows[(y & 1u) * rowSize];
+        const uint8_t *previous = &rows[((y & 1u) ^ 1u) * rowSize];
+        gatherPngRow(frame, y, row);
+
+        // The filters only read unfiltered samples, so nothing carries from one sample to the
+        // next. The first pixel has nothing to its left, which keeps the conditions out of the
+        // main loop.
+        uint32_t noneSum = 0u;
+        uint32_t subSum = 0u;
+        uint32_t upSum = 0u;
+        uint32_t paethSum = 0u;
+        auto filterSamples = [&](size_t begin, size_t end, const uint8_t *left, const uint8_t *upLeft, size_t shift)
+        {
+            for (size_t i = begin; i < end; ++i)
+            {
+                const int32_t value = row[i];
+                const int32_t above = previous[i];
+                sub[i] = static_cast<uint8_t>(value - left[i - shift]);
+                up[i] = static_cast<uint8_t>(value - above);
+                paeth[i] = static_cast<uint8_t>(value - paethPredictor(left[i - shift], above, upLeft[i - shift]));
+                noneSum += static_cast<uint32_t>(std::abs(static_cast<int32_t>(static_cast<int8_t>(value))));
+                subSum += static_cast<uint32_t>(std::abs(static_cast<int32_t>(static_cast<int8_t>(sub[i]))));
+                upSum += static_cast<uint32_t>(std::abs(static_cast<int32_t>(static_cast<int8_t>(up[i]))));
+                paethSum += static_cast<uint32_t>(std::abs(static_cast<int32_t>(static_cast<int8_t>(paeth[i]))));
+            }
+        };
+        const uint8_t zeros[3] = {};
+        filterSamples(0u, (std::min)(static_cast<size_t>(channels), rowSize), zeros, zeros, 0u);
+        filterSamples(channels, rowSize, row, previous, channels);
+
+        // None, sub, up and Paeth
+        const uint8_t filterTypes[4] = { 0u, 1u, 2u, 4u };
+        const uint8_t *sources[4] = { row, sub, up, paeth };
+        const uint32_t sums[4] = { noneSum, subSum, upSum, paethSum };
+        const uint32_t best = static_cast<uint32_t>(std::min_element(sums, sums + 4) - sums);
+        uint8_t *out = &filtered[y * (rowSize + 1u)];
+        out[0] = filterTypes[best];
+        memcpy(out + 1, sources[best], rowSize);
+    }
+
+    static const uint8_t Signature[8] = { 0x89u, 'P', 'N', 'G', 0x0du, 0x0au, 0x1au, 0x0au };
+    png.assign(Signature, Signature + 8);
+
+    size_t chunkStart = png.size();
+    beginChunk(png, "IHDR");
+    appendBigEndian(png, frame.width);
+    appendBigEndian(png, frame.height);
+    png.push_back(8u);                                // Bits per sample
+    png.push_back(channels == 3u ? 2u : 0u);         // Truecolor or greyscale
+    png.push_back(0u);                                // Deflate
+    png.push_back(0u);                                // Adaptive filtering
+    png.push_back(0u);                                // Not interlaced
+    finishChunk(png, chunkStart);
+
+    chunkStart = png.size();
+    beginChunk(png, "IDAT");
+    png.push_back(0x78u); // zlib header, deflate with a 32KB window
+    png.push_back(0x01u);
+    png.reserve(png.size() + filtered.size() + filtered.size() / 8u + 64u); // Fixed codes expand incompressible data by at most 1/8
+    deflateFixed(filtered.data(), filtered.size(), png);
+    appendBigEndian(png, adler32(filtered.data(), filtered.size()));
+    finishChunk(png, chunkStart);
+
+    chunkStart = png.size();
+    beginChunk(png, "IEND");
+    finishChunk(png, chunkStart);
+}
+
+Y4mCaptureSink::Y4mCaptureSink(const std::filesystem::path &path, uint32_t framesPerSecond)
+    : m_path(path)
+    , m_framesPerSecond((std::max)(framesPerSecond, 1u))
+{
+    if (m_path.has_parent_path())
+    {
+        std::filesystem::create_directories(m_path.parent_path());
+    }
+}
+
+void Y4mCaptureSink::encode(const CaptureFrame &frame, std::vector<uint8_t> &encoded)
+{
+    convertToYuv420(frame, encoded);
+}
+
+void Y4mCaptureSink::write(const CaptureFrame &frame, const std::vector<uint8_t> &encoded)
+{
+    if (!m_stream.is_open())
+    {
+        m_stream.open(m_path, std::ios::binary | std::ios::trunc);
+        m_stream << "YUV4MPEG2 W" << frame.width << " H" << frame.height << " F" << m_framesPerSecond << ":1 Ip A1:1 C420jpeg\n";
+    }
+    m_stream << "FRAME\n";
+    m_stream.write(reinterpret_cast<const char *>(encoded.data()), static_cast<std::streamsize>(encoded.size()));
+}
+
+void Y4mCaptureSink::convertToYuv420(const CaptureFrame &frame, std::vector<uint8_t> &planes)
+{
+    const uint32_t chromaWidth = (frame.width + 1u) / 2u;
+    const uint32_t chromaHeight = (frame.height + 1u) / 2u;
+    const size_t lumaSize = static_cast<size_t>(frame.width) * frame.height;
+    const size_t chromaSize = static_cast<size_t>(chromaWidth) * chromaHeight;
+    planes.resize(lumaSize + 2u * chromaSize);
+    uint8_t *yPlane = planes.data();
+    uint8_t *uPlane = yPlane + lumaSize;
+    uint8_t *vPlane = uPlane + chromaSize;
+
+    // Grey levels of a float frame, or the red, green and blue of a color frame
+    auto readPixel = [&frame](uint32_t x, uint32_t y, int32_t *rgb)
+    {
+        const uint8_t *source = frame.data + static_cast<size_t>(y) * frame.rowPitch + static_cast<size_t>(x) * 4u;
+        if (frame.format == CaptureFormat::Rgba8)
+        {
+            rgb[0] = source[0];
+            rgb[1] = source[1];
+            rgb[2] = source[2];
+            return;
+        }
+        float value;
+        memcpy(&value, source, sizeof(float));
+        rgb[0] = rgb[1] = rgb[2] = toGrey(value);
+    };
+
+    for (uint32_t chromaY = 0u; chromaY < chromaHeight; ++chromaY)
+    {
+        for (uint32_t chromaX = 0u; chromaX < chromaWidth; ++chromaX)
+        {
+            // Chroma of the average color of the 2x2 block, or what is left of it at an odd edge
+            int32_t sum[3] = {};
+            int32_t count = 0;
+            for (uint32_t y = chromaY * 2u; y < (std::min)(chromaY * 2u + 2u, frame.height); ++y)
+            {
+                for (uint32_t x = chromaX * 2u; x < (std::min)(chromaX * 2u + 2u, frame.width); ++x)
+                {
+                    int32_t rgb[3];
+                    readPixel(x, y, rgb);
+                    yPlane[static_cast<size_t>(y) * frame.width + x] = static_cast<uint8_t>(((66 * rgb[0] + 129 * rgb[1] + 25 * rgb[2] + 128) >> 8) + 16);
+                    sum[0] += rgb[0];
+                    sum[1] += rgb[1];
+                    sum[2] += rgb[2];
+                    ++count;
+                }
+            }
+            const int32_t r = (sum[0] + count / 2) / count;
+            const int32_t g = (sum[1] + count / 2) / count;
+            const int32_t b = (sum[2] + count / 2) / count;
+            uPlane[static_cast<size_t>(chromaY) * chromaWidth + chromaX] = static_cast<uint8_t>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+            vPlane[static_cast<size_t>(chromaY) * chromaWidth + chromaX] = static_cast<uint8_t>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+        }
+    }
+}
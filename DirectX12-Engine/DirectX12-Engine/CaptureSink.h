@@ -0,0 +1,98 @@
+#pragma once
+
+// Destinations for frames read back from the GPU, see FrameCapture.
+// A sink works in two steps. encode() turns the mapped readback data into whatever the sink
+// stores and runs on the encoder threads, several frames at once, so the heavy work lives there.
+// write() then stores the encoded bytes one frame at a time in capture order, which lets a video
+// stream append frames while still-image sinks just write one file per frame.
+//  - RawCaptureSink writes the tightly packed pixels of every frame to its own file.
+//  - PngCaptureSink writes every frame as a PNG, filtered per row and deflated with the fixed
+//    Huffman codes and a single hash probe per position, fast rather than small.
+//  - Y4mCaptureSink appends frames to one YUV4MPEG2 stream in 4:2:0, which video tools such as
+//    ffmpeg read directly.
+// Float captures, such as an R32_FLOAT UAV, are stored as is by the raw sink and as grey levels
+// of their value clamped to [0, 1] by the others.
+// This file is platform independent so it can be built and profiled off Windows.
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+enum class CaptureFormat : uint32_t
+{
+    Rgba8,   // DXGI_FORMAT_R8G8B8A8_UNORM
+    R32Float // DXGI_FORMAT_R32_FLOAT
+};
+
+uint32_t getCaptureBytesPerPixel(CaptureFormat format);
+
+struct CaptureFrame
+{
+    uint64_t frameNumber;
+    uint32_t width;
+    uint32_t height;
+    uint32_t rowPitch; // Bytes from one row to the next, readback rows are padded to 256 bytes
+    CaptureFormat format;
+    const uint8_t *data;
+};
+
+class CaptureSink
+{
+public:
+    virtual ~CaptureSink() {}
+
+    // Any encoder thread, for several frames at once. frame.data is only valid during the call.
+    virtual void encode(const CaptureFrame &frame, std::vector<uint8_t> &encoded) = 0;
+
+    // One call at a time, in capture order. The frame's data pointer is null by then.
+    virtual void write(const CaptureFrame &frame, const std::vector<uint8_t> &encoded) = 0;
+};
+
+class RawCaptureSink : public CaptureSink
+{
+public:
+    // Files are named frame_<number>_<width>x<height>_<format>.raw
+    explicit RawCaptureSink(const std::filesystem::path &directory);
+
+    void encode(const CaptureFrame &frame, std::vector<uint8_t> &encoded) override;
+    void write(const CaptureFrame &frame, const std::vector<uint8_t> &encoded) override;
+
+private:
+    std::filesystem::path m_directory;
+};
+
+class PngCaptureSink : public CaptureSink
+{
+public:
+    // Files are named frame_<number>.png
+    explicit PngCaptureSink(const std::filesystem::path &directory);
+
+    void encode(const CaptureFrame &frame, std::vector<uint8_t> &encoded) override;
+    void write(const CaptureFrame &frame, const std::vector<uint8_t> &encoded) override;
+
+    // A complete PNG file, RGB for Rgba8 frames since the swap chain ignores alpha and 8 bit
+    // grey for float frames
+    static void encodePng(const CaptureFrame &frame, std::vector<uint8_t> &png);
+
+private:
+    std::filesystem::path m_directory;
+};
+
+class Y4mCaptureSink : public CaptureSink
+{
+public:
+    Y4mCaptureSink(const std::filesystem::path &path, uint32_t framesPerSecond);
+
+    void encode(const CaptureFrame &frame, std::vector<uint8_t> &encoded) override;
+    void write(const CaptureFrame &frame, const std::vector<uint8_t> &encoded) override;
+
+    // The Y, U and V planes of one frame, BT.601 limited range. The chroma planes are half the
+    // size rounded up in both directions.
+    static void convertToYuv420(const CaptureFrame &frame, std::vector<uint8_t> &planes);
+
+private:
+    std::filesystem::path m_path;
+    uint32_t m_framesPerSecond;
+    std::ofstream m_stream; // Opened by the first frame, whose size goes into the stream header
+};
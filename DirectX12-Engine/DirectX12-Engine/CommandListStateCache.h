@@ -0,0 +1,480 @@
+#pragma once
+
+// A thin wrapper in front of a graphics command list that remembers the currently bound state
+// and drops calls that would set it to the same value again. The wrapper is templated on the
+// command list type and the D3D12 argument structs are compared as plain bytes, so the same code
+// runs against ID3D12GraphicsCommandList or a recording command list off Windows.
+//
+// Binding rules mirrored from D3D12:
+//  - Resetting the command list clears all state.
+//  - Graphics and compute have their own root signature and root arguments.
+//  - Changing a root signature invalidates every root argument bound through it.
+//  - Changing the descriptor heaps invalidates the descriptor table root arguments of both.
+// Calls that are not filtered (barriers, clears, draws...) go straight to get().
+
+#include <cstdint>
+#include <cstring>
+
+template <typename CommandList>
+class CommandListStateCache
+{
+public:
+    static const uint32_t MaxRootParameters = 64u;
+    static const uint32_t MaxRootConstants = 32u; // Root constants past this offset are always forwarded
+    static const uint32_t MaxViewports = 16u;
+    static const uint32_t MaxVertexBuffers = 32u;
+    static const uint32_t MaxDescriptorHeaps = 2u;
+
+    struct Stats
+    {
+        uint64_t issuedCalls;
+        uint64_t filteredCalls;
+    };
+
+    CommandListStateCache()
+        : m_commandList(nullptr)
+    {
+        resetStats();
+        invalidate();
+    }
+
+    void attach(CommandList *commandList)
+    {
+        m_commandList = commandList;
+        invalidate();
+    }
+
+    CommandList *get() const { return m_commandList; }
+
+    // Forget all cached state, must be called if the list is modified behind the cache's back
+    void invalidate()
+    {
+        m_pipelineState = nullptr;
+        m_graphicsRootSignature = nullptr;
+        m_computeRootSignature = nullptr;
+        m_descriptorHeapCount = UnknownCount;
+        m_viewportCount = UnknownCount;
+        m_scissorRectCount = UnknownCount;
+        m_primitiveTopology = UnknownValue;
+        m_indexBufferValid = false;
+        m_vertexBufferValidMask = 0u;
+        invalidateRootArguments(m_graphicsRootArguments);
+        invalidateRootArguments(m_computeRootArguments);
+    }
+
+    const Stats &getStats() const { return m_stats; }
+
+    void resetStats()
+    {
+        m_stats.issuedCalls = 0u;
+        m_stats.filteredCalls = 0u;
+    }
+
+    template <typename Allocator, typename PipelineState>
+    auto Reset(Allocator *allocator, PipelineState *initialState)
+    {
+        invalidate();
+        m_pipelineState = initialState;
+        ++m_stats.issuedCalls;
+        return m_commandList->Reset(allocator, initialState);
+    }
+
+    template <typename PipelineState>
+    void SetPipelineState(PipelineState *pipelineState)
+    {
+        if (filter(m_pipelineState == pipelineState))
+        {
+            return;
+        }
+        m_pipelineState = pipelineState;
+        m_commandList->SetPipelineState(pipelineState);
+    }
+
+    template <typename RootSignature>
+    void SetGraphicsRootSignature(RootSignature *rootSignature)
+    {
+        if (filter(m_graphicsRootSignature == rootSignature))
+        {
+            return;
+        }
+        m_graphicsRootSignature = rootSignature;
+        invalidateRootArguments(m_graphicsRootArguments);
+        m_commandList->SetGraphicsRootSignature(rootSignature);
+    }
+
+    template <typename RootSignature>
+    void SetComputeRootSignature(RootSignature *rootSignature)
+    {
+        if (filter(m_computeRootSignature == rootSignature))
+        {
+            return;
+        }
+        m_computeRootSignature = rootSignature;
+        invalidateRootArguments(m_computeRootArguments);
+        m_commandList->SetComputeRootSignature(rootSignature);
+    }
+
+    template <typename DescriptorHeap>
+    void SetDescriptorHeaps(uint32_t count, DescriptorHeap *const *descriptorHeaps)
+    {
+        bool same = count == m_descriptorHeapCount;
+        for (uint32_t i = 0u; same && i < count; ++i)
+        {
+            same = m_descriptorHeaps[i] == descriptorHeaps[i];
+        }
+        if (filter(same))
+        {
+            return;
+        }
+
+        m_descriptorHeapCount = count <= MaxDescriptorHeaps ? count : UnknownCount;
+        for (uint32_t i = 0u; i < count && i < MaxDescriptorHeaps; ++i)
+        {
+            m_descriptorHeaps[i] = descriptorHeaps[i];
+        }
+
+        for (uint32_t i = 0u; i < MaxRootParameters; ++i)
+        {
+            if (m_graphicsRootArguments[i].kind == RootArgumentKind::DescriptorTable)
+            {
+                m_graphicsRootArguments[i].kind = RootArgumentKind::None;
+            }
+            if (m_computeRootArguments[i].kind == RootArgumentKind::DescriptorTable)
+            {
+                m_computeRootArguments[i].kind = RootArgumentKind::None;
+            }
+        }
+        m_commandList->SetDescriptorHeaps(count, descriptorHeaps);
+    }
+
+    template <typename GpuDescriptorHandle>
+    void SetGraphicsRootDescriptorTable(uint32_t rootParameterIndex, GpuDescriptorHandle baseDescriptor)
+    {
+        if (filter(updateRootArgument(m_graphicsRootArguments, rootParameterIndex, RootArgumentKind::DescriptorTable, baseDescriptor.ptr)))
+        {
+            return;
+        }
+        m_commandList->SetGraphicsRootDescriptorTable(rootParameterIndex, baseDescriptor);
+    }
+
+    void SetGraphicsRootConstantBufferView(uint32_t rootParameterIndex, uint64_t bufferLocation)
+    {
+        if (filter(updateRootArgument(m_graphicsRootArguments, rootParameterIndex, RootArgumentKind::ConstantBufferView, bufferLocation)))
+        {
+            return;
+        }
+        m_commandList->SetGraphicsRootConstantBufferView(rootParameterIndex, bufferLocation);
+    }
+
+    void SetGraphicsRootShaderResourceView(uint32_t rootParameterIndex, uint64_t bufferLocation)
+    {
+        if (filter(updateRootArgument(m_graphicsRootArguments, rootParameterIndex, RootArgumentKind::ShaderResourceView, bufferLocation)))
+        {
+            return;
+        }
+        m_commandList->SetGraphicsRootShaderResourceView(rootParameterIndex, bufferLocation);
+    }
+
+    void SetGraphicsRootUnorderedAccessView(uint32_t rootParameterIndex, uint64_t bufferLocation)
+    {
+        if (filter(updateRootArgument(m_graphicsRootArguments, rootParameterIndex, RootArgumentKind::UnorderedAccessView, bufferLocation)))
+        {
+            return;
+        }
+        m_commandList->SetGraphicsRootUnorderedAccessView(rootParameterIndex, bufferLocation);
+    }
+
+    void SetGraphicsRoot32BitConstant(uint32_t rootParameterIndex, uint32_t srcData, uint32_t destOffsetIn32BitValues)
+    {
+        if (filter(updateRootConstants(m_graphicsRootArguments, rootParameterIndex, 1u, &srcData, destOffsetIn32BitValues)))
+        {
+            return;
+        }
+        m_commandList->SetGraphicsRoot32BitConstant(rootParameterIndex, srcData, destOffsetIn32BitValues);
+    }
+
+    void SetGraphicsRoot32BitConstants(uint32_t rootParameterIndex, uint32_t num32BitValuesToSet, const void *srcData, uint32_t destOffsetIn32BitValues)
+    {
+        if (filter(updateRootConstants(m_graphicsRootArguments, rootParameterIndex, num32BitValuesToSet, srcData, destOffsetIn32BitValues)))
+        {
+            return;
+        }
+        m_commandList->SetGraphicsRoot32BitConstants(rootParameterIndex, num32BitValuesToSet, srcData, destOffsetIn32BitValues);
+    }
+
+    template <typename GpuDescriptorHandle>
+    void SetComputeRootDescriptorTable(uint32_t rootParameterIndex, GpuDescriptorHandle baseDescriptor)
+    {
+        if (filter(updateRootArgument(m_computeRootArguments, rootParameterIndex, RootArgumentKind::DescriptorTable, baseDescriptor.ptr)))
+        {
+            return;
+        }
+        m_commandList->SetComputeRootDescriptorTable(rootParameterIndex, baseDescriptor);
+    }
+
+    void SetComputeRootConstantBufferView(uint32_t rootParameterIndex, uint64_t bufferLocation)
+    {
+        if (filter(updateRootArgument(m_computeRootArguments, rootParameterIndex, RootArgumentKind::ConstantBufferView, bufferLocation)))
+        {
+            return;
+        }
+        m_commandList->SetComputeRootConstantBufferView(rootParameterIndex, bufferLocation);
+    }
+
+    void SetComputeRootShaderResourceView(uint32_t rootParameterIndex, uint64_t bufferLocation)
+    {
+        if (filter(updateRootArgument(m_computeRootArguments, rootParameterIndex, RootArgumentKind::ShaderResourceView, bufferLocation)))
+        {
+            return;
+        }
+        m_commandList->SetComputeRootShaderResourceView(rootParameterIndex, bufferLocation);
+    }
+
+    void SetComputeRootUnorderedAccessView(uint32_t rootParameterIndex, uint64_t bufferLocation)
+    {
+        if (filter(updateRootArgument(m_computeRootArguments, rootParameterIndex, RootArgumentKind::UnorderedAccessView, bufferLocation)))
+        {
+            return;
+        }
+        m_commandList->SetComputeRootUnorderedAccessView(rootParameterIndex, bufferLocation);
+    }
+
+    void SetComputeRoot32BitConstant(uint32_t rootParameterIndex, uint32_t srcData, uint32_t destOffsetIn32BitValues)
+    {
+        if (filter(updateRootConstants(m_computeRootArguments, rootParameterIndex, 1u, &srcData, destOffsetIn32BitValues)))
+        {
+            return;
+        }
+        m_commandList->SetComputeRoot32BitConstant(rootParameterIndex, srcData, destOffsetIn32BitValues);
+    }
+
+    void SetComputeRoot32BitConstants(uint32_t rootParameterIndex, uint32_t num32BitValuesToSet, const void *srcData, uint32_t destOffsetIn32BitValues)
+    {
+        if (filter(updateRootConstants(m_computeRootArguments, rootParameterIndex, num32BitValuesToSet, srcData, destOffsetIn32BitValues)))
+        {
+            return;
+        }
+        m_commandList->SetComputeRoot32BitConstants(rootParameterIndex, num32BitValuesToSet, srcData, destOffsetIn32BitValues);
+    }
+
+    template <typename Viewport>
+    void RSSetViewports(uint32_t count, const Viewport *viewports)
+    {
+        if (filter(updateBlock(m_viewports, sizeof(m_viewports), m_viewportCount, count, viewports, sizeof(Viewport))))
+        {
+            return;
+        }
+        m_commandList->RSSetViewports(count, viewports);
+    }
+
+    template <typename Rect>
+    void RSSetScissorRects(uint32_t count, const Rect *rects)
+    {
+        if (filter(updateBlock(m_scissorRects, sizeof(m_scissorRects), m_scissorRectCount, count, rects, sizeof(Rect))))
+        {
+            return;
+        }
+        m_commandList->RSSetScissorRects(count, rects);
+    }
+
+    template <typename PrimitiveTopology>
+    void IASetPrimitiveTopology(PrimitiveTopology primitiveTopology)
+    {
+        const int64_t value = static_cast<int64_t>(primitiveTopology);
+        if (filter(m_primitiveTopology == value))
+        {
+            return;
+        }
+        m_primitiveTopology = value;
+        m_commandList->IASetPrimitiveTopology(primitiveTopology);
+    }
+
+    template <typename VertexBufferView>
+    void IASetVertexBuffers(uint32_t startSlot, uint32_t count, const VertexBufferView *views)
+    {
+        static_assert(sizeof(VertexBufferView) <= ViewBytes, "Vertex buffer view does not fit the cache");
+
+        bool same = views != nullptr && startSlot + count <= MaxVertexBuffers;
+        for (uint32_t i = 0u; same && i < count; ++i)
+        {
+            const uint32_t slot = startSlot + i;
+            same = (m_vertexBufferValidMask & (1u << slot)) != 0u && std::memcmp(m_vertexBuffers[slot], &views[i], sizeof(VertexBufferView)) == 0;
+        }
+        if (filter(same))
+        {
+            return;
+        }
+
+        for (uint32_t i = 0u; i < count && startSlot + i < MaxVertexBuffers; ++i)
+        {
+            const uint32_t slot = startSlot + i;
+            if (views)
+            {
+                std::memcpy(m_vertexBuffers[slot], &views[i], sizeof(VertexBufferView));
+                m_vertexBufferValidMask |= 1u << slot;
+            }
+            else
+            {
+                m_vertexBufferValidMask &= ~(1u << slot);
+            }
+        }
+        m_commandList->IASetVertexBuffers(startSlot, count, views);
+    }
+
+    template <typename IndexBufferView>
+    void IASetIndexBuffer(const IndexBufferView *view)
+    {
+        static_assert(sizeof(IndexBufferView) <= ViewBytes, "Index buffer view does not fit the cache");
+
+        if (filter(view != nullptr && m_indexBufferValid && std::memcmp(m_indexBuffer, view, sizeof(IndexBufferView)) == 0))
+        {
+            return;
+        }
+
+        m_indexBufferValid = view != nullptr;
+        if (view)
+        {
+            std::memcpy(m_indexBuffer, view, sizeof(IndexBufferView));
+        }
+        m_commandList->IASetIndexBuffer(view);
+    }
+
+private:
+    static const uint32_t UnknownCount = ~0u;
+    static const int64_t UnknownValue = -1;
+    static const uint32_t ViewBytes = 32u;
+
+    enum class RootArgumentKind : uint32_t
+    {
+        None,
+        DescriptorTable,
+        ConstantBufferView,
+        ShaderResourceView,
+        UnorderedAccessView,
+        Constants
+    };
+
+    struct RootArgument
+    {
+        RootArgumentKind kind;
+        uint64_t value;
+        uint32_t constantValidMask; // One bit per cached root constant
+        uint32_t constants[MaxRootConstants];
+    };
+
+    // Count the call and return true if it is redundant
+    bool filter(bool redundant)
+    {
+        if (redundant)
+        {
+            ++m_stats.filteredCalls;
+        }
+        else
+        {
+            ++m_stats.issuedCalls;
+        }
+        return redundant;
+    }
+
+    static void invalidateRootArguments(RootArgument (&arguments)[MaxRootParameters])
+    {
+        for (RootArgument &argument : arguments)
+        {
+            argument.kind = RootArgumentKind::None;
+            argument.constantValidMask = 0u;
+        }
+    }
+
+    // Returns true if the argument already holds the value
+    static bool updateRootArgument(RootArgument (&arguments)[MaxRootParameters], uint32_t index, RootArgumentKind kind, uint64_t value)
+    {
+        if (index >= MaxRootParameters)
+        {
+            return false;
+        }
+
+        RootArgument &argument = arguments[index];
+        if (argument.kind == kind && argument.value == value)
+        {
+            return true;
+        }
+        argument.kind = kind;
+        argument.value = value;
+        return false;
+    }
+
+    static bool updateRootConstants(RootArgument (&arguments)[MaxRootParameters], uint32_t index, uint32_t count, const void *data, uint32_t offset)
+    {
+        if (index >= MaxRootParameters)
+        {
+            return false;
+        }
+
+        RootArgument &argument = arguments[index];
+        if (argument.kind != RootArgumentKind::Constants)
+        {
+            argument.kind = RootArgumentKind::Constants;
+            argument.constantValidMask = 0u;
+        }
+
+        // Constants outside the cached range can not be compared, so forget them and forward
+        if (offset + count > MaxRootConstants)
+        {
+            for (uint32_t i = offset; i < MaxRootConstants; ++i)
+            {
+                argument.constantValidMask &= ~(1u << i);
+            }
+            return false;
+        }
+
+        const uint32_t mask = (count >= 32u ? ~0u : ((1u << count) - 1u)) << offset;
+        const bool same = (argument.constantValidMask & mask) == mask && std::memcmp(&argument.constants[offset], data, count * sizeof(uint32_t)) == 0;
+
+        std::memcpy(&argument.constants[offset], data, count * sizeof(uint32_t));
+        argument.constantValidMask |= mask;
+        return same;
+    }
+
+    // Shared by the viewport and scissor arrays, returns true if the block already holds the data
+    static bool updateBlock(unsigned char *storage, size_t storageSize, uint32_t &storedCount, uint32_t count, const void *data, size_t elementSize)
+    {
+        const size_t size = count * elementSize;
+        if (size > storageSize)
+        {
+            storedCount = UnknownCount;
+            return false;
+        }
+
+        if (storedCount == count && std::memcmp(storage, data, size) == 0)
+        {
+            return true;
+        }
+
+        storedCount = count;
+        std::memcpy(storage, data, size);
+        return false;
+    }
+
+    CommandList *m_commandList;
+    Stats m_stats;
+
+    const void *m_pipelineState;
+    const void *m_graphicsRootSignature;
+    const void *m_computeRootSignature;
+    RootArgument m_graphicsRootArguments[MaxRootParameters];
+    RootArgument m_computeRootArguments[MaxRootParameters];
+
+    uint32_t m_descriptorHeapCount;
+    const void *m_descriptorHeaps[MaxDescriptorHeaps];
+
+    uint32_t m_viewportCount;
+    uint32_t m_scissorRectCount;
+    alignas(8) unsigned char m_viewports[MaxViewports * 24u];
+    alignas(8) unsigned char m_scissorRects[MaxViewports * 16u];
+
+    int64_t m_primitiveTopology;
+    bool m_indexBufferValid;
+    uint32_t m_vertexBufferValidMask;
+    alignas(8) unsigned char m_indexBuffer[ViewBytes];
+    alignas(8) unsigned char m_vertexBuffers[MaxVertexBuffers][ViewBytes];
+};
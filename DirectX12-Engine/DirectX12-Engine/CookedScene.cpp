@@ -0,0 +1,254 @@
+#include "CookedScene.h"
+
+#include <fstream>
+
+#include "MemoryTracker.h"
+
+uint64_t getCookedSceneSectionSize(const CookedSceneHeader &header, CookedSceneSection section)
+{
+    const uint64_t nodeCount = header.nodeCount;
+    switch (section)
+    {
+    case CookedSceneSection::Translations:
+    case CookedSceneSection::Scales:
+        return nodeCount * sizeof(Vec3);
+    case CookedSceneSection::Rotations:
+        return nodeCount * sizeof(Quat);
+    case CookedSceneSection::Bounds:
+        return nodeCount * sizeof(Aabb);
+    case CookedSceneSection::Parents:
+    case CookedSceneSection::NodeMeshes:
+    case CookedSceneSection::NodeMaterials:
+    case CookedSceneSection::NodeNames:
+        return nodeCount * sizeof(uint32_t);
+    case CookedSceneSection::Meshes:
+        return static_cast<uint64_t>(header.meshCount) * sizeof(CookedSceneMesh);
+    case CookedSceneSection::Materials:
+        return static_cast<uint64_t>(header.materialCount) * sizeof(CookedSceneMaterial);
+    default:
+        return 0u;
+    }
+}
+
+const char *getCookedSceneStatusName(CookedSceneStatus status)
+{
+    switch (status)
+    {
+    case CookedSceneStatus::Ok: return "ok";
+    case CookedSceneStatus::FileError: return "the file could not be read";
+    case CookedSceneStatus::OutOfMemory: return "out of memory";
+    case CookedSceneStatus::BadAlignment: return "the data is not aligned";
+    case CookedSceneStatus::TooSmall: return "the file is truncated";
+    case CookedSceneStatus::BadMagic: return "not a cooked scene";
+    case CookedSceneStatus::BadVersion: return "cooked with another version, cook it again";
+    case CookedSceneStatus::BadLayout: return "the section table is corrupt";
+    default: return "unknown";
+    }
+}
+
+CookedScene::CookedScene()
+    : m_header(nullptr)
+    , m_sections()
+    , m_memory(nullptr)
+    , m_memorySize(0u)
+{
+}
+
+CookedScene::~CookedScene()
+{
+    release();
+}
+
+CookedSceneStatus CookedScene::load(const std::filesystem::path &path)
+{
+    release();
+
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+    {
+        return CookedSceneStatus::FileError;
+    }
+    const std::streamoff fileSize = file.tellg();
+    if (fileSize < static_cast<std::streamoff>(sizeof(CookedSceneHeader)))
+    {
+        return fileSize < 0 ? CookedSceneStatus::FileError : CookedSceneStatus::TooSmall;
+    }
+
+    // Pages are aligned well past CookedSceneSectionAlignment
+    const uint64_t size = static_cast<uint64_t>(fileSize);
+    void *memory = allocatePages(static_cast<size_t>(size), false, MemoryTag::Scene);
+    if (memory == nullptr)
+    {
+        return CookedSceneStatus::OutOfMemory;
+    }
+
+    file.seekg(0);
+    if (!file.read(static_cast<char *>(memory), fileSize))
+    {
+        freePages(memory, static_cast<size_t>(size), false, MemoryTag::Scene);
+        return CookedSceneStatus::FileError;
+    }
+
+    const CookedSceneStatus status = attach(memory, size);
+    if (status != CookedSceneStatus::Ok)
+    {
+        freePages(memory, static_cast<size_t>(size), false, MemoryTag::Scene);
+        return status;
+    }
+    m_memory = memory;
+    m_memorySize = size;
+    return CookedSceneStatus::Ok;
+}
+
+CookedSceneStatus CookedScene::attach(const void *data, uint64_t size)
+{
+    if (data != m_memory)
+    {
+        release();
+    }
+
+    if (reinterpret_cast<uintptr_t>(data) % CookedSceneSectionAlignment != 0u)
+    {
+        return CookedSceneStatus::BadAlignment;
+    }
+    if (size < sizeof(CookedSceneHeader))
+    {
+        return CookedSceneStatus::TooSmall;
+    }
+
+    const CookedSceneHeader *header = static_cast<const CookedSceneHeader *>(data);
+    if (header->magic != CookedSceneMagic)
+    {
+        return CookedSceneStatus::BadMagic;
+    }
+    if (header->version != CookedSceneVersion)
+    {
+        return CookedSceneStatus::BadVersion;
+    }
+    if (header->headerSize != sizeof(CookedSceneHeader) || header->sectionCount != static_cast<uint32_t>(CookedSceneSection::Count))
+    {
+        return CookedSceneStatus::BadLayout;
+    }
+    if (header->fileSize > size)
+    {
+        return CookedSceneStatus::TooSmall;
+    }
+
+    // Every array has to be where the table says, aligned, inside the file and exactly as large as its count needs
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    const uint8_t *sections[static_cast<size_t>(CookedSceneSection::Count)];
+    for (uint32_t i = 0u; i < static_cast<uint32_t>(CookedSceneSection::Count); ++i)
+    {
+        const CookedSceneSection section = static_cast<CookedSceneSection>(i);
+        const CookedSceneSectionRange &range = header->sections[i];
+        if (range.offset % CookedSceneSectionAlignment != 0u || range.offset < sizeof(CookedSceneHeader) ||
+            range.offset > header->fileSize || range.size > header->fileSize - range.offset)
+        {
+            return CookedSceneStatus::BadLayout;
+        }
+
+        const bool sizeMatches = section == CookedSceneSection::Strings ?
+            range.size > 0u && bytes[range.offset + range.size - 1u] == 0u :
+            range.size == getCookedSceneSectionSize(*header, section);
+        if (!sizeMatches)
+        {
+            return CookedSceneStatus::BadLayout;
+        }
+        sections[i] = bytes + range.offset;
+    }
+
+    m_header = header;
+    for (uint32_t i = 0u; i < static_cast<uint32_t>(CookedSceneSection::Count); ++i)
+    {
+        m_sections[i] = sections[i];
+    }
+    return CookedSceneStatus::Ok;
+}
+
+void CookedScene::release()
+{
+    if (m_memory != nullptr)
+    {
+        freePages(m_memory, static_cast<size_t>(m_memorySize), false, MemoryTag::Scene);
+    }
+    m_header = nullptr;
+    m_memory = nullptr;
+    m_memorySize = 0u;
+    for (const uint8_t *&section : m_sections)
+    {
+        section = nullptr;
+    }
+}
+
+bool CookedScene::validate() const
+{
+    if (!isLoaded())
+    {
+        return false;
+    }
+
+    const uint64_t stringsSize = m_header->sections[static_cast<size_t>(CookedSceneSection::Strings)].size;
+    auto validString = [stringsSize](uint32_t offset, bool optional)
+    {
+        return (optional && offset == CookedSceneNone) || offset < stringsSize;
+    };
+
+    const uint32_t *parents = getParents();
+    const uint32_t *nodeMeshes = getNodeMeshes();
+    const uint32_t *nodeMaterials = getNodeMaterials();
+    const uint32_t *nodeNames = getNodeNames();
+    for (uint32_t node = 0u; node < m_header->nodeCount; ++node)
+    {
+        if ((parents[node] != CookedSceneNone && parents[node] >= node) ||
+            (nodeMeshes[node] != CookedSceneNone && nodeMeshes[node] >= m_header->meshCount) ||
+            (nodeMaterials[node] != CookedSceneNone && nodeMaterials[node] >= m_header->materialCount) ||
+            !validString(nodeNames[node], false))
+        {
+            return false;
+        }
+    }
+
+    const CookedSceneMesh *meshes = getMeshes();
+    for (uint32_t mesh = 0u; mesh < m_header->meshCount; ++mesh)
+    {
+        if (!validString(meshes[mesh].name, false) || !validString(meshes[mesh].file, true))
+        {
+            return false;
+        }
+    }
+
+    const CookedSceneMaterial *materials = getMaterials();
+    for (uint32_t material = 0u; material < m_header->materialCount; ++material)
+    {
+        if (!validString(materials[material].name, false) || !validString(materials[material].baseColorTexture, true))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+const char *CookedScene::getString(uint32_t offset) const
+{
+    const uint64_t stringsSize = m_header->sections[static_cast<size_t>(CookedSceneSection::Strings)].size;
+    if (offset >= stringsSize)
+    {
+        return "";
+    }
+
+    // The section ends with a zero, so any offset inside it is a terminated string
+    return reinterpret_cast<const char *>(m_sections[static_cast<size_t>(CookedSceneSection::Strings)]) + offset;
+}
+
+void CookedScene::computeWorldMatrices(Mat4 *worldMatrices) const
+{
+    const Vec3 *translations = getTranslations();
+    const Quat *rotations = getRotations();
+    const Vec3 *scales = getScales();
+    const uint32_t *parents = getParents();
+    for (uint32_t node = 0u; node < m_header->nodeCount; ++node)
+    {
+        const Mat4 local = affineMatrix(scales[node], rotations[node], translations[node]);
+        worldMatrices[node] = parents[node] == CookedSceneNone ? local : multiply(local, worldMatrices[parents[node]]);
+    }
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+// The cooked scene container written by the offline SceneCooker tool.
+// The file is laid out exactly as the scene sits in memory: a versioned header with a table of
+// sections, then one array per section, each starting on a CookedSceneSectionAlignment boundary.
+// Nodes are stored as structure of arrays (translations, rotations, scales, parents, world
+// bounds, mesh and material references, names), ordered so every parent comes before its
+// children. Nothing in the file is a pointer: nodes, meshes and materials refer to each other
+// by index and to their names by an offset into the string section.
+// Loading is one read of the file into page aligned memory. attach() then only checks the header
+// and the section table and records where each array starts, so it costs the same for ten
+// nodes as for a million. validate() does the per object checks for files that are not trusted.
+// The layout is little endian with the VectorMath types as they are on every target we ship.
+// This file is platform independent so the tool and the loader can be built off Windows.
+
+#include <cstdint>
+#include <filesystem>
+
+#include "VectorMath.h"
+
+const uint32_t CookedSceneMagic = 0x4e435344u; // "DSCN"
+const uint32_t CookedSceneVersion = 1u;
+
+// A cache line, and enough for the widest SIMD loads of the node arrays
+const uint32_t CookedSceneSectionAlignment = 64u;
+
+// Marks a missing parent, mesh, material or string
+const uint32_t CookedSceneNone = 0xffffffffu;
+
+enum class CookedSceneSection : uint32_t
+{
+    Translations,  // Vec3 per node, relative to the parent
+    Rotations,     // Quat per node
+    Scales,        // Vec3 per node
+    Parents,       // uint32_t per node, always below the node's own index, CookedSceneNone for roots
+    Bounds,        // Aabb per node in world space, min above max for nodes without a mesh
+    NodeMeshes,    // uint32_t per node
+    NodeMaterials, // uint32_t per node, CookedSceneNone for the default material
+    NodeNames,     // uint32_t per node, offset into Strings
+    Meshes,        // CookedSceneMesh per mesh
+    Materials,     // CookedSceneMaterial per material
+    Strings,       // Zero terminated UTF-8 strings, the last byte is always zero
+    Count
+};
+
+// Offset from the start of the file and size, both in bytes
+struct CookedSceneSectionRange
+{
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct CookedSceneHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t headerSize;   // sizeof(CookedSceneHeader), catches a layout change without a version bump
+    uint32_t sectionCount;
+    uint64_t fileSize;
+    uint32_t nodeCount;
+    uint32_t meshCount;
+    uint32_t materialCount;
+    uint32_t padding;
+    CookedSceneSectionRange sections[static_cast<size_t>(CookedSceneSection::Count)];
+};
+
+struct CookedSceneMesh
+{
+    Aabb bounds;   // In the mesh's own space
+    uint32_t name; // Offsets into Strings
+    uint32_t file; // Where the vertex data lives, CookedSceneNone when it is embedded in the source
+};
+
+struct CookedSceneMaterial
+{
+    Vec4 baseColor;
+    float metallic;
+    float roughness;
+    uint32_t name;             // Offsets into Strings
+    uint32_t baseColorTexture; // Image file, CookedSceneNone without one
+};
+
+static_assert(sizeof(Vec3) == 12u && sizeof(Quat) == 16u && sizeof(Aabb) == 24u, "The cooked scene layout relies on tightly packed VectorMath types");
+static_assert(sizeof(CookedSceneMesh) == 32u && sizeof(CookedSceneMaterial) == 32u, "Cooked scene records changed size, bump CookedSceneVersion");
+
+inline uint64_t alignCookedScene(uint64_t value)
+{
+    return (value + CookedSceneSectionAlignment - 1u) & ~static_cast<uint64_t>(CookedSceneSectionAlignment - 1u);
+}
+
+// Size a section must have for the counts in the header, zero for the string section whose size is free
+uint64_t getCookedSceneSectionSize(const CookedSceneHeader &header, CookedSceneSection section);
+
+enum class CookedSceneStatus : uint32_t
+{
+    Ok,
+    FileError,
+    OutOfMemory,
+    BadAlignment,
+    TooSmall,
+    BadMagic,
+    BadVersion,
+    BadLayout
+};
+
+const char *getCookedSceneStatusName(CookedSceneStatus status);
+
+class CookedScene
+{
+public:
+    CookedScene();
+    ~CookedScene();
+
+    CookedScene(const CookedScene &) = delete;
+    CookedScene &operator=(const CookedScene &) = delete;
+
+    // Reads the whole file with one read into page aligned memory the scene owns, then attaches to it
+    CookedSceneStatus load(const std::filesystem::path &path);
+
+    // Uses memory the caller keeps alive for as long as the scene, a mapped file for example. It has
+    // to be aligned to CookedSceneSectionAlignment. Only the header and the section table are checked.
+    CookedSceneStatus attach(const void *data, uint64_t size);
+
+    void release();
+
+    bool isLoaded() const { return m_header != nullptr; }
+
+    // Checks every index and string offset in the scene, the cost grows with its size
+    bool validate() const;
+
+    uint32_t getNodeCount() const { return m_header->nodeCount; }
+    uint32_t getMeshCount() const { return m_header->meshCount; }
+    uint32_t getMaterialCount() const { return m_header->materialCount; }
+    uint64_t getSize() const { return m_header->fileSize; }
+
+    const Vec3 *getTranslations() const { return getSection<Vec3>(CookedSceneSection::Translations); }
+    const Quat *getRotations() const { return getSection<Quat>(CookedSceneSection::Rotations); }
+    const Vec3 *getScales() const { return getSection<Vec3>(CookedSceneSection::Scales); }
+    const uint32_t *getParents() const { return getSection<uint32_t>(CookedSceneSection::Parents); }
+    const Aabb *getBounds() const { return getSection<Aabb>(CookedSceneSection::Bounds); }
+    const uint32_t *getNodeMeshes() const { return getSection<uint32_t>(CookedSceneSection::NodeMeshes); }
+    const uint32_t *getNodeMaterials() const { return getSection<uint32_t>(CookedSceneSection::NodeMaterials); }
+    const uint32_t *getNodeNames() const { return getSection<uint32_t>(CookedSceneSection::NodeNames); }
+    const CookedSceneMesh *getMeshes() const { return getSection<CookedSceneMesh>(CookedSceneSection::Meshes); }
+    const CookedSceneMaterial *getMaterials() const { return getSection<CookedSceneMaterial>(CookedSceneSection::Materials); }
+
+    // An empty string for CookedSceneNone or an offset past the string section
+    const char *getString(uint32_t offset) const;
+
+    // Local to world matrices of every node in one forward pass, which works because parents come first
+    void computeWorldMatrices(Mat4 *worldMatrices) const;
+
+private:
+    template <typename T>
+    const T *getSection(CookedSceneSection section) const
+    {
+        return reinterpret_cast<const T *>(m_sections[static_cast<size_t>(section)]);
+    }
+
+    const CookedSceneHeader *m_header;
+    const uint8_t *m_sections[static_cast<size_t>(CookedSceneSection::Count)];
+
+    // Set when load() read the file
+    void *m_memory;
+    uint64_t m_memorySize;
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+// The cooked texture container written by the offline TextureCooker tool.
+// A header is followed by one CookedSubresource per mip level and then the texel data. Every
+// subresource is already laid out the way D3D12 wants it in an upload buffer: rows are padded
+// to D3D12_TEXTURE_DATA_PITCH_ALIGNMENT and each level starts on a
+// D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT boundary. Loading is one memcpy of the data block into
+// an upload buffer followed by a CopyTextureRegion per level, using the stored offsets and pitches.
+// This file is platform independent so the tool can be built off Windows.
+
+#include <cstdint>
+
+const uint32_t CookedTextureMagic = 0x58544344u; // "DCTX"
+const uint32_t CookedTextureVersion = 1u;
+
+// Match D3D12_TEXTURE_DATA_PITCH_ALIGNMENT and D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT
+const uint32_t CookedTextureRowPitchAlignment = 256u;
+const uint32_t CookedTextureSubresourceAlignment = 512u;
+
+struct CookedTextureHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t dxgiFormat;  // DXGI_FORMAT value
+    uint32_t width;
+    uint32_t height;
+    uint32_t mipCount;
+    uint64_t dataOffset;  // From the start of the file, aligned to CookedTextureSubresourceAlignment
+    uint64_t dataSize;
+};
+
+// One mip level, offsets are relative to the start of the data block
+struct CookedSubresource
+{
+    uint64_t offset;
+    uint32_t width;
+    uint32_t height;
+    uint32_t rowPitch;    // Bytes between rows in the data block
+    uint32_t rowCount;    // Rows of blocks for compressed formats, rows of texels otherwise
+    uint32_t rowSize;     // Bytes of real data in each row
+    uint32_t padding;
+};
+
+inline uint64_t alignCookedTexture(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1u) & ~(alignment - 1u);
+}
@@ -0,0 +1,186 @@
+#include "EngineLoop.h"
+
+#include <algorithm>
+
+EngineLoop::EngineLoop(RenderFunction render)
+    : EngineLoop(render, Settings())
+{
+}
+
+EngineLoop::EngineLoop(RenderFunction render, const Settings &settings)
+    : m_render(render)
+    , m_settings(settings)
+    , m_running(false)
+    , m_simulationTicks(0u)
+    , m_renderedFrames(0u)
+    , m_staleFrames(0u)
+    , m_droppedInputEvents(0u)
+    , m_latencySamples(0u)
+    , m_totalLatencyMicroseconds(0u)
+    , m_maxLatencyMicroseconds(0u)
+{
+    m_settings.simulationRate = std::max(m_settings.simulationRate, 1.0f);
+    m_settings.maxTicksPerUpdate = std::max(m_settings.maxTicksPerUpdate, 1u);
+}
+
+EngineLoop::~EngineLoop()
+{
+    stop();
+}
+
+void EngineLoop::start()
+{
+    if (m_running.exchange(true))
+    {
+        return;
+    }
+
+    m_simulationThread = std::thread(&EngineLoop::simulationLoop, this);
+    m_renderThread = std::thread(&EngineLoop::renderLoop, this);
+}
+
+void EngineLoop::stop()
+{
+    if (!m_running.exchange(false))
+    {
+        return;
+    }
+
+    m_simulationThread.join();
+    m_renderThread.join();
+}
+
+bool EngineLoop::pushInput(const InputEvent &event)
+{
+    if (!m_inputQueue.push(event))
+    {
+        m_droppedInputEvents.fetch_add(1u, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+EngineLoop::Stats EngineLoop::getStats() const
+{
+    Stats stats = {};
+    stats.simulationTicks = m_simulationTicks.load(std::memory_order_relaxed);
+    stats.renderedFrames = m_renderedFrames.load(std::memory_order_relaxed);
+    stats.staleFrames = m_staleFrames.load(std::memory_order_relaxed);
+    stats.droppedInputEvents = m_droppedInputEvents.load(std::memory_order_relaxed);
+    stats.latencySamples = m_latencySamples.load(std::memory_order_relaxed);
+
+    if (stats.latencySamples > 0u)
+    {
+        stats.averageInputLatencyMs = m_totalLatencyMicroseconds.load(std::memory_order_relaxed) / 1000.0 / stats.latencySamples;
+    }
+    stats.maxInputLatencyMs = m_maxLatencyMicroseconds.load(std::memory_order_relaxed) / 1000.0;
+
+    return stats;
+}
+
+void EngineLoop::simulationLoop()
+{
+    const float stepSeconds = 1.0f / m_settings.simulationRate;
+    const Clock::duration step = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(stepSeconds));
+
+    SceneState state = createInitialSceneState();
+    uint64_t tick = 0u;
+    Clock::time_point newestInput;
+
+    // Publish the initial state straight away so the render thread has something to draw
+    Clock::time_point nextTick = Clock::now();
+    {
+        FrameSnapshot &snapshot = m_snapshots.beginWrite();
+        snapshot.previous = state;
+        snapshot.current = state;
+        snapshot.tick = tick;
+        snapshot.tickTime = nextTick;
+        snapshot.newestInput = newestInput;
+        m_snapshots.publish();
+    }
+    nextTick += step;
+
+    while (m_running.load(std::memory_order_acquire))
+    {
+        std::this_thread::sleep_until(nextTick);
+
+        const Clock::time_point now = Clock::now();
+        uint32_t ticks = 0u;
+        while (nextTick <= now && ticks < m_settings.maxTicksPerUpdate)
+        {
+            InputEvent event;
+            while (m_inputQueue.pop(event))
+            {
+                applySceneInput(state, event);
+                newestInput = std::max(newestInput, event.timestamp);
+            }
+
+            const SceneState previous = state;
+            stepScene(state, stepSeconds);
+            ++tick;
+
+            FrameSnapshot &snapshot = m_snapshots.beginWrite();
+            snapshot.previous = previous;
+            snapshot.current = state;
+            snapshot.tick = tick;
+            snapshot.tickTime = nextTick;
+            snapshot.newestInput = newestInput;
+            m_snapshots.publish();
+
+            nextTick += step;
+            ++ticks;
+        }
+        m_simulationTicks.fetch_add(ticks, std::memory_order_relaxed);
+
+        // After a long stall skip ahead instead of trying to catch up
+        if (nextTick <= now)
+        {
+            nextTick = now + step;
+        }
+    }
+}
+
+void EngineLoop::renderLoop()
+{
+    const float stepSeconds = 1.0f / m_settings.simulationRate;
+
+    uint64_t lastTick = 0u;
+    bool hasRendered = false;
+    Clock::time_point lastInput;
+
+    while (m_running.load(std::memory_order_acquire))
+    {
+        const FrameSnapshot *snapshot = m_snapshots.acquireLatest();
+        if (snapshot == nullptr)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        if (hasRendered && snapshot->tick == lastTick)
+        {
+            m_staleFrames.fetch_add(1u, std::memory_order_relaxed);
+        }
+        lastTick = snapshot->tick;
+        hasRendered = true;
+
+        // Draw one tick behind the simulation, blending towards the newest state as time passes
+        const float elapsed = std::chrono::duration<float>(Clock::now() - snapshot->tickTime).count();
+        const float alpha = std::clamp(elapsed / stepSeconds, 0.0f, 1.0f);
+        m_render(interpolateScene(snapshot->previous, snapshot->current, alpha));
+        m_renderedFrames.fetch_add(1u, std::memory_order_relaxed);
+
+        // The snapshot stays valid until the next acquire so it can still be read here
+        if (snapshot->newestInput > lastInput)
+        {
+            const uint64_t latency = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - snapshot->newestInput).count());
+            m_latencySamples.fetch_add(1u, std::memory_order_relaxed);
+            m_totalLatencyMicroseconds.fetch_add(latency, std::memory_order_relaxed);
+            if (latency > m_maxLatencyMicroseconds.load(std::memory_order_relaxed))
+            {
+                m_maxLatencyMicroseconds.store(latency, std::memory_order_relaxed);
+            }
+            lastInput = snapshot->newestInput;
+        }
+    }
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+// Runs the simulation and rendering on their own threads so a slow frame never stalls the game update.
+// The simulation thread advances the scene at a fixed rate and publishes each tick as an immutable
+// snapshot through a triple buffer. The render thread picks up the newest snapshot whenever it starts
+// a frame and interpolates between its two states, so motion stays smooth at any display rate.
+// Input is queued from the UI thread to the simulation thread without locks.
+// This file is platform independent, rendering is supplied as a callback.
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <thread>
+
+#include "SceneSimulation.h"
+#include "SpscQueue.h"
+#include "TripleBuffer.h"
+
+class EngineLoop
+{
+public:
+    struct Settings
+    {
+        float simulationRate = 60.0f;   // Ticks per second
+        uint32_t maxTicksPerUpdate = 5u; // Drop simulation time beyond this after a long stall
+    };
+
+    struct Stats
+    {
+        uint64_t simulationTicks;
+        uint64_t renderedFrames;
+        uint64_t staleFrames;          // Frames that started without a new snapshot
+        uint64_t droppedInputEvents;   // Events lost because the queue was full
+        uint64_t latencySamples;       // Frames that showed new input
+        double averageInputLatencyMs;  // From the newest event to the end of the first frame that shows it
+        double maxInputLatencyMs;
+    };
+
+    typedef std::function<void(const SceneState &)> RenderFunction;
+
+    explicit EngineLoop(RenderFunction render);
+    EngineLoop(RenderFunction render, const Settings &settings);
+
+    ~EngineLoop();
+
+    EngineLoop(const EngineLoop &) = delete;
+    EngineLoop &operator=(const EngineLoop &) = delete;
+
+    void start();
+
+    // Blocks until both threads have finished their current iteration
+    void stop();
+
+    // Only call from one thread. Returns false if the event had to be dropped.
+    bool pushInput(const InputEvent &event);
+
+    Stats getStats() const;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    // Everything the render thread needs from one simulation tick
+    struct FrameSnapshot
+    {
+        SceneState previous;
+        SceneState current;
+        uint64_t tick;
+        Clock::time_point tickTime;    // When current became valid
+        Clock::time_point newestInput; // Timestamp of the newest event applied so far
+    };
+
+    void simulationLoop();
+    void renderLoop();
+
+    RenderFunction m_render;
+    Settings m_settings;
+
+    std::thread m_simulationThread;
+    std::thread m_renderThread;
+    std::atomic<bool> m_running;
+
+    SpscQueue<InputEvent, 256> m_inputQueue;
+    TripleBuffer<FrameSnapshot> m_snapshots;
+
+    std::atomic<uint64_t> m_simulationTicks;
+    std::atomic<uint64_t> m_renderedFrames;
+    std::atomic<uint64_t> m_staleFrames;
+    std::atomic<uint64_t> m_droppedInputEvents;
+    std::atomic<uint64_t> m_latencySamples;
+    std::atomic<uint64_t> m_totalLatencyMicroseconds;
+    std::atomic<uint64_t> m_maxLatencyMicroseconds;
+};
@@ -0,0 +1,534 @@
+#include "FileReadBackend.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include "ObjectPool.h"
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+namespace
+{
+#if defined(_WIN32)
+    // Overlapped reads completed through an I/O completion port
+    class CompletionPortBackend : public FileReadBackend
+    {
+    public:
+        CompletionPortBackend()
+            : m_port(CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 1))
+        {
+        }
+
+        ~CompletionPortBackend() override
+        {
+            CloseHandle(m_port);
+        }
+
+        const char *getName() const override { return "overlapped"; }
+
+        FileHandle open(const std::filesystem::path &path, uint64_t &size) override
+        {
+            CREATEFILE2_EXTENDED_PARAMETERS extendedParams = { 0 };
+            extendedParams.dwSize = sizeof(CREATEFILE2_EXTENDED_PARAMETERS);
+            extendedParams.dwFileAttributes = FILE_ATTRIBUTE_NORMAL;
+            extendedParams.dwFileFlags = FILE_FLAG_OVERLAPPED;
+            extendedParams.dwSecurityQosFlags = SECURITY_ANONYMOUS;
+
+            HANDLE file = CreateFile2(path.c_str(), GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING, &extendedParams);
+            if (file == INVALID_HANDLE_VALUE)
+            {
+                return InvalidFile;
+            }
+
+            FILE_STANDARD_INFO fileInfo = { 0 };
+            if (!GetFileInformationByHandleEx(file, FileStandardInfo, &fileInfo, sizeof(fileInfo)) ||
+                CreateIoCompletionPort(file, m_port, 0, 0) == nullptr)
+            {
+                CloseHandle(file);
+                return InvalidFile;
+            }
+
+            size = static_cast<uint64_t>(fileInfo.EndOfFile.QuadPart);
+            return reinterpret_cast<FileHandle>(file);
+        }
+
+        void close(FileHandle file) override
+        {
+            CloseHandle(reinterpret_cast<HANDLE>(file));
+        }
+
+        void submit(Read *read) override
+        {
+            OverlappedRead *overlappedRead = m_overlappedReads.create();
+            std::memset(&overlappedRead->overlapped, 0, sizeof(OVERLAPPED));
+            overlappedRead->overlapped.Offset = static_cast<DWORD>(read->offset);
+            overlappedRead->overlapped.OffsetHigh = static_cast<DWORD>(read->offset >> 32);
+            overlappedRead->read = read;
+
+            if (!ReadFile(reinterpret_cast<HANDLE>(read->file), read->buffer, read->size, nullptr, &overlappedRead->overlapped))
+            {
+                const DWORD error = GetLastError();
+                if (error != ERROR_IO_PENDING)
+                {
+                    read->result = error == ERROR_HANDLE_EOF ? 0 : -static_cast<int64_t>(error);
+                    m_overlappedReads.destroy(overlappedRead);
+                    m_failedSubmits.push_back(read);
+                }
+            }
+        }
+
+        void wait(std::vector<Read *> &completed, bool block) override
+        {
+            if (!m_failedSubmits.empty())
+            {
+                completed.insert(completed.end(), m_failedSubmits.begin(), m_failedSubmits.end());
+                m_failedSubmits.clear();
+                block = false;
+            }
+
+            OVERLAPPED_ENTRY entries[64];
+            ULONG removed = 0;
+            if (!GetQueuedCompletionStatusEx(m_port, entries, _countof(entries), &removed, block ? INFINITE : 0, FALSE))
+            {
+                return;
+            }
+
+            for (ULONG i = 0; i < removed; ++i)
+            {
+                // A null overlapped is a wake up
+                if (entries[i].lpOverlapped == nullptr)
+                {
+                    continue;
+                }
+
+                OverlappedRead *overlappedRead = CONTAINING_RECORD(entries[i].lpOverlapped, OverlappedRead, overlapped);
+                Read *read = overlappedRead->read;
+
+                DWORD bytesRead = 0;
+                if (GetOverlappedResult(reinterpret_cast<HANDLE>(read->file), &overlappedRead->overlapped, &bytesRead, FALSE))
+                {
+                    read->result = bytesRead;
+                }
+                else
+                {
+                    const DWORD error = GetLastError();
+                    read->result = error == ERROR_HANDLE_EOF ? 0 : -static_cast<int64_t>(error);
+                }
+
+                m_overlappedReads.destroy(overlappedRead);
+                completed.push_back(read);
+            }
+        }
+
+        void wake() override
+        {
+            PostQueuedCompletionStatus(m_port, 0, 0, nullptr);
+        }
+
+    private:
+        struct OverlappedRead
+        {
+            OVERLAPPED overlapped;
+            Read *read;
+        };
+
+        HANDLE m_port;
+        ObjectPool<OverlappedRead> m_overlappedReads;
+        std::vector<Read *> m_failedSubmits;
+    };
+#else
+    FileReadBackend::FileHandle openPosix(const std::filesystem::path &path, uint64_t &size)
+    {
+        const int file = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (file < 0)
+        {
+            return FileReadBackend::InvalidFile;
+        }
+
+        struct stat fileStatus;
+        if (fstat(file, &fileStatus) != 0)
+        {
+            ::close(file);
+            return FileReadBackend::InvalidFile;
+        }
+
+        size = static_cast<uint64_t>(fileStatus.st_size);
+        return file;
+    }
+
+    // Blocking preads on a few threads, one read in flight per thread
+    class ThreadBackend : public FileReadBackend
+    {
+    public:
+        explicit ThreadBackend(uint32_t queueDepth)
+            : m_quit(false)
+            , m_woken(false)
+        {
+            const uint32_t threadCount = std::min(std::max(queueDepth, 1u), 16u);
+            for (uint32_t i = 0u; i < threadCount; ++i)
+            {
+                m_threads.emplace_back(&ThreadBackend::workerLoop, this);
+            }
+        }
+
+        ~ThreadBackend() override
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_quit = true;
+            }
+            m_workCondition.notify_all();
+            for (std::thread &thread : m_threads)
+            {
+                thread.join();
+            }
+        }
+
+        const char *getName() const override { return "threads"; }
+
+        FileHandle open(const std::filesystem::path &path, uint64_t &size) override
+        {
+            return openPosix(path, size);
+        }
+
+        void close(FileHandle file) override
+        {
+            ::close(static_cast<int>(file));
+        }
+
+        void submit(Read *read) override
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_pending.push_back(read);
+            }
+            m_workCondition.notify_one();
+        }
+
+        void wait(std::vector<Read *> &completed, bool block) override
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (block)
+            {
+                m_doneCondition.wait(lock, [this]() { return !m_completed.empty() || m_woken; });
+            }
+            m_woken = false;
+
+            completed.insert(completed.end(), m_completed.begin(), m_completed.end());
+            m_completed.clear();
+        }
+
+        void wake() override
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_woken = true;
+            }
+            m_doneCondition.notify_one();
+        }
+
+    private:
+        void workerLoop()
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            while (true)
+            {
+                m_workCondition.wait(lock, [this]() { return m_quit || !m_pending.empty(); });
+                if (m_quit)
+                {
+                    return;
+                }
+
+                Read *read = m_pending.front();
+                m_pending.pop_front();
+                lock.unlock();
+
+                const ssize_t result = pread(static_cast<int>(read->file), read->buffer, read->size, static_cast<off_t>(read->offset));
+                read->result = result >= 0 ? result : -static_cast<int64_t>(errno);
+
+                lock.lock();
+                m_completed.push_back(read);
+                m_doneCondition.notify_one();
+            }
+        }
+
+        std::vector<std::thread> m_threads;
+        std::mutex m_mutex;
+        std::condition_variable m_workCondition;
+        std::condition_variable m_doneCondition;
+        std::deque<Read *> m_pending;
+        std::vector<Read *> m_completed;
+        bool m_quit;
+        bool m_woken;
+    };
+#endif
+
+#if defined(__linux__)
+    // io_uring driven through the raw system calls so there is no liburing dependency.
+    // An eventfd poll stays armed in the ring so wake() can interrupt a blocking wait.
+    class IoUringBackend : public FileReadBackend
+    {
+    public:
+        explicit IoUringBackend(uint32_t queueDepth)
+            : m_ringFd(-1)
+            , m_wakeFd(-1)
+            , m_submissionRing(nullptr)
+            , m_completionRing(nullptr)
+            , m_submissionEntries(nullptr)
+            , m_submissionRingSize(0u)
+            , m_completionRingSize(0u)
+            , m_submissionEntriesSize(0u)
+            , m_unsubmitted(0u)
+        {
+            io_uring_params params;
+            std::memset(&params, 0, sizeof(params));
+
+            // One extra entry for the wake up poll
+            m_ringFd = static_cast<int>(syscall(__NR_io_uring_setup, queueDepth + 1u, &params));
+            if (m_ringFd < 0)
+            {
+                return;
+            }
+
+            // IORING_OP_READ arrived shortly before fast poll, older kernels use the thread backend
+            if (!(params.features & IORING_FEAT_FAST_POLL))
+            {
+                ::close(m_ringFd);
+                m_ringFd = -1;
+                return;
+            }
+
+            m_submissionRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+            m_completionRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            const bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0u;
+            if (singleMap)
+            {
+                m_submissionRingSize = m_completionRingSize = std::max(m_submissionRingSize, m_completionRingSize);
+            }
+
+            m_submissionRing = mmap(nullptr, m_submissionRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQ_RING);
+            m_completionRing = singleMap ? m_submissionRing : mmap(nullptr, m_completionRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_CQ_RING);
+            m_submissionEntriesSize = params.sq_entries * sizeof(io_uring_sqe);
+            void *entries = mmap(nullptr, m_submissionEntriesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQES);
+            if (m_submissionRing == MAP_FAILED || m_completionRing == MAP_FAILED || entries == MAP_FAILED)
+            {
+                m_submissionRing = m_submissionRing == MAP_FAILED ? nullptr : m_submissionRing;
+                m_completionRing = m_completionRing == MAP_FAILED ? nullptr : m_completionRing;
+                releaseRing();
+                return;
+            }
+            m_submissionEntries = static_cast<io_uring_sqe *>(entries);
+
+            uint8_t *submissionRing = static_cast<uint8_t *>(m_submissionRing);
+            m_submissionHead = reinterpret_cast<uint32_t *>(submissionRing + params.sq_off.head);
+            m_submissionTail = reinterpret_cast<uint32_t *>(submissionRing + params.sq_off.tail);
+            m_submissionMask = *reinterpret_cast<uint32_t *>(submissionRing + params.sq_off.ring_mask);
+            m_submissionArray = reinterpret_cast<uint32_t *>(submissionRing + params.sq_off.array);
+
+            uint8_t *completionRing = static_cast<uint8_t *>(m_completionRing);
+            m_completionHead = reinterpret_cast<uint32_t *>(completionRing + params.cq_off.head);
+            m_completionTail = reinterpret_cast<uint32_t *>(completionRing + params.cq_off.tail);
+            m_completionMask = *reinterpret_cast<uint32_t *>(completionRing + params.cq_off.ring_mask);
+            m_completions = reinterpret_cast<io_uring_cqe *>(completionRing + params.cq_off.cqes);
+
+            m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (m_wakeFd < 0)
+            {
+                releaseRing();
+                return;
+            }
+            armWakePoll();
+        }
+
+        ~IoUringBackend() override
+        {
+            releaseRing();
+        }
+
+        bool isValid() const { return m_ringFd >= 0; }
+
+        const char *getName() const override { return "io_uring"; }
+
+        FileHandle open(const std::filesystem::path &path, uint64_t &size) override
+        {
+            return openPosix(path, size);
+        }
+
+        void close(FileHandle file) override
+        {
+            ::close(static_cast<int>(file));
+        }
+
+        void submit(Read *read) override
+        {
+            io_uring_sqe *entry = nextEntry();
+            entry->opcode = IORING_OP_READ;
+            entry->fd = static_cast<int>(read->file);
+            entry->addr = reinterpret_cast<uint64_t>(read->buffer);
+            entry->len = read->size;
+            entry->off = read->offset;
+            entry->user_data = reinterpret_cast<uint64_t>(read);
+        }
+
+        void wait(std::vector<Read *> &completed, bool block) override
+        {
+            // Submissions are batched into the same system call as the wait. EAGAIN and EBUSY mean the
+            // kernel wants completions reaped first, which happens below either way.
+            long submitted;
+            do
+            {
+                submitted = syscall(__NR_io_uring_enter, m_ringFd, m_unsubmitted, block ? 1u : 0u, block ? IORING_ENTER_GETEVENTS : 0u, nullptr, 0);
+            } while (submitted < 0 && errno == EINTR);
+
+            if (submitted > 0)
+            {
+                m_unsubmitted -= static_cast<uint32_t>(submitted);
+            }
+
+            uint32_t head = *m_completionHead;
+            const uint32_t tail = __atomic_load_n(m_completionTail, __ATOMIC_ACQUIRE);
+            bool rearm = false;
+            for (; head != tail; ++head)
+            {
+                const io_uring_cqe &completion = m_completions[head & m_completionMask];
+                if (completion.user_data == WakeUserData)
+                {
+                    uint64_t value;
+                    while (::read(m_wakeFd, &value, sizeof(value)) > 0)
+                    {
+                    }
+                    rearm = true;
+                    continue;
+                }
+
+                Read *read = reinterpret_cast<Read *>(completion.user_data);
+                read->result = completion.res;
+                completed.push_back(read);
+            }
+            __atomic_store_n(m_completionHead, head, __ATOMIC_RELEASE);
+
+            if (rearm)
+            {
+                armWakePoll();
+            }
+        }
+
+        void wake() override
+        {
+            const uint64_t value = 1u;
+            (void)!::write(m_wakeFd, &value, sizeof(value));
+        }
+
+    private:
+        static const uint64_t WakeUserData = 0u;
+
+        io_uring_sqe *nextEntry()
+        {
+            const uint32_t tail = *m_submissionTail;
+            const uint32_t index = tail & m_submissionMask;
+
+            io_uring_sqe *entry = &m_submissionEntries[index];
+            std::memset(entry, 0, sizeof(*entry));
+            m_submissionArray[index] = index;
+            __atomic_store_n(m_submissionTail, tail + 1u, __ATOMIC_RELEASE);
+            ++m_unsubmitted;
+            return entry;
+        }
+
+        void armWakePoll()
+        {
+            io_uring_sqe *entry = nextEntry();
+            entry->opcode = IORING_OP_POLL_ADD;
+            entry->fd = m_wakeFd;
+            entry->poll_events = POLLIN;
+            entry->user_data = WakeUserData;
+        }
+
+        void releaseRing()
+        {
+            if (m_submissionEntries != nullptr)
+            {
+                munmap(m_submissionEntries, m_submissionEntriesSize);
+            }
+            if (m_completionRing != nullptr && m_completionRing != m_submissionRing)
+            {
+                munmap(m_completionRing, m_completionRingSize);
+            }
+            if (m_submissionRing != nullptr)
+            {
+                munmap(m_submissionRing, m_submissionRingSize);
+            }
+            if (m_wakeFd >= 0)
+            {
+                ::close(m_wakeFd);
+            }
+            if (m_ringFd >= 0)
+            {
+                ::close(m_ringFd);
+            }
+            m_submissionEntries = nullptr;
+            m_completionRing = nullptr;
+            m_submissionRing = nullptr;
+            m_wakeFd = -1;
+            m_ringFd = -1;
+        }
+
+        int m_ringFd;
+        int m_wakeFd;
+
+        void *m_submissionRing;
+        void *m_completionRing;
+        io_uring_sqe *m_submissionEntries;
+        size_t m_submissionRingSize;
+        size_t m_completionRingSize;
+        size_t m_submissionEntriesSize;
+
+        uint32_t *m_submissionHead;
+        uint32_t *m_submissionTail;
+        uint32_t m_submissionMask;
+        uint32_t *m_submissionArray;
+
+        uint32_t *m_completionHead;
+        uint32_t *m_completionTail;
+        uint32_t m_completionMask;
+        io_uring_cqe *m_completions;
+
+        uint32_t m_unsubmitted; // Entries queued in the ring but not yet passed to the kernel
+    };
+#endif
+}
+
+std::unique_ptr<FileReadBackend> FileReadBackend::create(uint32_t queueDepth)
+{
+#if defined(_WIN32)
+    (void)queueDepth;
+    return std::make_unique<CompletionPortBackend>();
+#else
+#if defined(__linux__)
+    std::unique_ptr<IoUringBackend> ioUring = std::make_unique<IoUringBackend>(queueDepth);
+    if (ioUring->isValid())
+    {
+        return ioUring;
+    }
+#endif
+    return std::make_unique<ThreadBackend>(queueDepth);
+#endif
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+// Platform layer under AsyncFileReader: opens files and keeps many reads in flight at once.
+// Linux uses io_uring through the raw system calls, Windows uses overlapped reads on an I/O
+// completion port. Where neither is available (io_uring disabled by a sandbox, other POSIX
+// systems) a small pool of threads issuing blocking preads stands in.
+// Every call except wake() must come from the one thread that owns the backend.
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+class FileReadBackend
+{
+public:
+    // Native file handle, a file descriptor or a HANDLE
+    typedef intptr_t FileHandle;
+    static const FileHandle InvalidFile = -1;
+
+    struct Read
+    {
+        FileHandle file;
+        uint64_t offset;
+        uint32_t size;
+        uint8_t *buffer;
+        void *userData;
+
+        int64_t result; // Bytes read, negative on failure. Filled in on completion.
+    };
+
+    // Creates the best backend for the platform. queueDepth is the most reads that will be in flight.
+    static std::unique_ptr<FileReadBackend> create(uint32_t queueDepth);
+
+    virtual ~FileReadBackend() {}
+
+    virtual const char *getName() const = 0;
+
+    // Returns InvalidFile on failure
+    virtual FileHandle open(const std::filesystem::path &path, uint64_t &size) = 0;
+    virtual void close(FileHandle file) = 0;
+
+    // The read must stay alive until it comes back from wait()
+    virtual void submit(Read *read) = 0;
+
+    // Append finished reads. With block set, waits until at least one read finishes or wake() is called.
+    virtual void wait(std::vector<Read *> &completed, bool block) = 0;
+
+    // Thread safe, makes a blocking wait() return
+    virtual void wake() = 0;
+};
@@ -0,0 +1,219 @@
+#include "FrameCapture.h"
+
+#include <algorithm>
+
+namespace
+{
+    double millisecondsBetween(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+    {
+        return std::chrono::duration<double, std::milli>(end - start).count();
+    }
+}
+
+FrameCapture::FrameCapture(const CaptureLayout &layout, const std::vector<const uint8_t *> &slots, std::unique_ptr<CaptureSink> sink, const Settings &settings)
+    : m_layout(layout)
+    , m_slots(slots)
+    , m_sink(std::move(sink))
+    , m_ring(static_cast<uint32_t>(slots.size()))
+    , m_slotFrameNumbers(slots.size(), 0u)
+    , m_nextSequence(0u)
+    , m_capturedFrames(0u)
+    , m_droppedFrames(0u)
+    , m_outstanding(0u)
+    , m_quit(false)
+    , m_nextWrite(0u)
+    , m_writing(false)
+    , m_writtenFrames(0u)
+    , m_encodedBytes(0u)
+    , m_totalEncodeMs(0.0)
+    , m_maxEncodeMs(0.0)
+    , m_totalLatencyMs(0.0)
+    , m_maxLatencyMs(0.0)
+{
+    m_completed.reserve(slots.size());
+    const uint32_t encoderThreads = (std::max)(settings.encoderThreads, 1u);
+    for (uint32_t i = 0u; i < encoderThreads; ++i)
+    {
+        m_encoders.emplace_back(&FrameCapture::encoderLoop, this);
+    }
+}
+
+FrameCapture::~FrameCapture()
+{
+    waitIdle();
+    {
+        std::lock_guard<std::mutex> lock(m_jobMutex);
+        m_quit = true;
+    }
+    m_jobCondition.notify_all();
+    for (std::thread &encoder : m_encoders)
+    {
+        encoder.join();
+    }
+}
+
+ReadbackRing::Slot FrameCapture::beginFrame(uint64_t frameNumber)
+{
+    const ReadbackRing::Slot slot = m_ring.acquire();
+    if (slot == ReadbackRing::NoSlot)
+    {
+        ++m_droppedFrames;
+        return slot;
+    }
+    m_slotFrameNumbers[slot] = frameNumber;
+    return slot;
+}
+
+void FrameCapture::submitFrame(ReadbackRing::Slot slot, uint64_t fenceValue)
+{
+    m_ring.submit(slot, fenceValue);
+    ++m_capturedFrames;
+}
+
+void FrameCapture::poll(uint64_t completedFenceValue)
+{
+    m_completed.clear();
+    m_ring.poll(completedFenceValue, m_completed);
+    if (m_completed.empty())
+    {
+        return;
+    }
+
+    const Clock::time_point now = Clock::now();
+    {
+        std::lock_guard<std::mutex> lock(m_jobMutex);
+        for (ReadbackRing::Slot slot : m_completed)
+        {
+            m_jobs.push_back(Job{ slot, m_slotFrameNumbers[slot], m_nextSequence++, now });
+            ++m_outstanding;
+        }
+    }
+    if (m_completed.size() == 1u)
+    {
+        m_jobCondition.notify_one();
+    }
+    else
+    {
+        m_jobCondition.notify_all();
+    }
+}
+
+void FrameCapture::waitIdle()
+{
+    std::unique_lock<std::mutex> lock(m_jobMutex);
+    m_idleCondition.wait(lock, [this]() { return m_outstanding == 0u; });
+}
+
+FrameCapture::Stats FrameCapture::getStats() const
+{
+    Stats stats;
+    stats.capturedFrames = m_capturedFrames;
+    stats.droppedFrames = m_droppedFrames;
+
+    std::lock_guard<std::mutex> lock(m_writeMutex);
+    stats.writtenFrames = m_writtenFrames;
+    stats.encodedBytes = m_encodedBytes;
+    stats.averageEncodeMs = m_writtenFrames > 0u ? m_totalEncodeMs / static_cast<double>(m_writtenFrames) : 0.0;
+    stats.maxEncodeMs = m_maxEncodeMs;
+    stats.averageLatencyMs = m_writtenFrames > 0u ? m_totalLatencyMs / static_cast<double>(m_writtenFrames) : 0.0;
+    stats.maxLatencyMs = m_maxLatencyMs;
+    return stats;
+}
+
+void FrameCapture::encoderLoop()
+{
+    while (true)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(m_jobMutex);
+            m_jobCondition.wait(lock, [this]() { return m_quit || !m_jobs.empty(); });
+            if (m_jobs.empty())
+            {
+                return;
+            }
+            job = m_jobs.front();
+            m_jobs.pop_front();
+        }
+
+        EncodedFrame frame;
+        frame.frameNumber = job.frameNumber;
+        frame.pollTime = job.pollTime;
+        frame.data = takeBuffer();
+
+        const CaptureFrame source = { job.frameNumber, m_layout.width, m_layout.height, m_layout.rowPitch, m_layout.format, m_slots[job.slot] };
+        const Clock::time_point start = Clock::now();
+        m_sink->encode(source, frame.data);
+        const double encodeMs = millisecondsBetween(start, Clock::now());
+
+        // The readback memory is free for another copy as soon as it has been encoded
+        m_ring.release(job.slot);
+
+        {
+            std::lock_guard<std::mutex> lock(m_writeMutex);
+            m_totalEncodeMs += encodeMs;
+            m_maxEncodeMs = (std::max)(m_maxEncodeMs, encodeMs);
+        }
+        writeInOrder(job.sequence, std::move(frame));
+    }
+}
+
+void FrameCapture::writeInOrder(uint64_t sequence, EncodedFrame &&frame)
+{
+    std::unique_lock<std::mutex> lock(m_writeMutex);
+    m_encoded.emplace(sequence, std::move(frame));
+    if (m_writing)
+    {
+        // The encoder that is writing checks for this frame before it stops
+        return;
+    }
+
+    m_writing = true;
+    uint64_t written = 0u;
+    while (!m_encoded.empty() && m_encoded.begin()->first == m_nextWrite)
+    {
+        EncodedFrame next = std::move(m_encoded.begin()->second);
+        m_encoded.erase(m_encoded.begin());
+        lock.unlock();
+
+        const CaptureFrame info = { next.frameNumber, m_layout.width, m_layout.height, m_layout.rowPitch, m_layout.format, nullptr };
+        m_sink->write(info, next.data);
+        const double latencyMs = millisecondsBetween(next.pollTime, Clock::now());
+
+        lock.lock();
+        ++m_nextWrite;
+        ++m_writtenFrames;
+        ++written;
+        m_encodedBytes += next.data.size();
+        m_totalLatencyMs += latencyMs;
+        m_maxLatencyMs = (std::max)(m_maxLatencyMs, latencyMs);
+        if (m_spareBuffers.size() < m_slots.size() + m_encoders.size())
+        {
+            m_spareBuffers.push_back(std::move(next.data));
+        }
+    }
+    m_writing = false;
+    lock.unlock();
+
+    if (written > 0u)
+    {
+        std::lock_guard<std::mutex> jobLock(m_jobMutex);
+        m_outstanding -= written;
+        if (m_outstanding == 0u)
+        {
+            m_idleCondition.notify_all();
+        }
+    }
+}
+
+std::vector<uint8_t> FrameCapture::takeBuffer()
+{
+    std::lock_guard<std::mutex> lock(m_writeMutex);
+    if (m_spareBuffers.empty())
+    {
+        return std::vector<uint8_t>();
+    }
+    std::vector<uint8_t> buffer = std::move(m_spareBuffers.back());
+    m_spareBuffers.pop_back();
+    return buffer;
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+// Continuous capture of GPU frames without stalling the render thread.
+// The caller owns the readback buffers, one per ReadbackRing slot and persistently mapped, and
+// records a copy into the slot beginFrame() returns. poll() runs once a frame with the fence's
+// completed value and queues the finished slots for a few encoder threads, which run the sink's
+// encode() straight from the mapped memory and release the slot as soon as they are done with
+// it. Encoded frames are then written in capture order by whichever encoder thread finishes the
+// oldest one, so a slow write never holds up the encoding of later frames. When every slot is
+// still busy a frame is dropped and counted instead of waiting.
+// This file is platform independent so it can be built and profiled off Windows.
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "CaptureSink.h"
+#include "ReadbackRing.h"
+
+struct CaptureLayout
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t rowPitch; // Of the copy's placed footprint
+    CaptureFormat format;
+};
+
+class FrameCapture
+{
+public:
+    struct Settings
+    {
+        uint32_t encoderThreads = 2u;
+    };
+
+    struct Stats
+    {
+        uint64_t capturedFrames; // Copies submitted
+        uint64_t droppedFrames;  // Frames skipped because no slot was free
+        uint64_t writtenFrames;
+        uint64_t encodedBytes;
+        double averageEncodeMs;
+        double maxEncodeMs;
+        double averageLatencyMs; // From poll() handing the slot over to the frame being written
+        double maxLatencyMs;
+    };
+
+    // slots holds the mapped memory of every readback buffer, at least rowPitch * height bytes each
+    FrameCapture(const CaptureLayout &layout, const std::vector<const uint8_t *> &slots, std::unique_ptr<CaptureSink> sink, const Settings &settings);
+
+    // Writes every frame already polled. Copies still in flight are abandoned, so wait for the
+    // GPU and poll() first to keep them.
+    ~FrameCapture();
+
+    FrameCapture(const FrameCapture &) = delete;
+    FrameCapture &operator=(const FrameCapture &) = delete;
+
+    const CaptureLayout &getLayout() const { return m_layout; }
+
+    // Render thread. The slot to copy frameNumber into, or NoSlot to skip capturing this frame.
+    ReadbackRing::Slot beginFrame(uint64_t frameNumber);
+
+    // Render thread. The copy was submitted and is done once the fence reaches fenceValue.
+    void submitFrame(ReadbackRing::Slot slot, uint64_t fenceValue);
+
+    // Render thread, never blocks. Hands the finished copies to the encoders.
+    void poll(uint64_t completedFenceValue);
+
+    // Blocks until every frame handed to the encoders has been written
+    void waitIdle();
+
+    // Render thread
+    Stats getStats() const;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Job
+    {
+        ReadbackRing::Slot slot;
+        uint64_t frameNumber;
+        uint64_t sequence; // Order of capture, frame numbers skip dropped frames
+        Clock::time_point pollTime;
+    };
+
+    struct EncodedFrame
+    {
+        uint64_t frameNumber;
+        Clock::time_point pollTime;
+        std::vector<uint8_t> data;
+    };
+
+    void encoderLoop();
+    void writeInOrder(uint64_t sequence, EncodedFrame &&frame);
+    std::vector<uint8_t> takeBuffer();
+
+    CaptureLayout m_layout;
+    std::vector<const uint8_t *> m_slots;
+    std::unique_ptr<CaptureSink> m_sink;
+    ReadbackRing m_ring;
+
+    // Owned by the render thread
+    std::vector<uint64_t> m_slotFrameNumbers;
+    std::vector<ReadbackRing::Slot> m_completed;
+    uint64_t m_nextSequence;
+    uint64_t m_capturedFrames;
+    uint64_t m_droppedFrames;
+
+    // Jobs waiting for an encoder
+    mutable std::mutex m_jobMutex;
+    std::condition_variable m_jobCondition;
+    std::condition_variable m_idleCondition;
+    std::deque<Job> m_jobs;
+    uint64_t m_outstanding; // Jobs queued or not yet written
+    bool m_quit;
+
+    // Encoded frames waiting for the ones before them, guarded by m_writeMutex. One encoder at a
+    // time writes, the others leave their frames here and go back to encoding.
+    mutable std::mutex m_writeMutex;
+    std::map<uint64_t, EncodedFrame> m_encoded;
+    std::vector<std::vector<uint8_t>> m_spareBuffers; // Written frames' buffers, kept for the next ones
+    uint64_t m_nextWrite;
+    bool m_writing;
+    uint64_t m_writtenFrames;
+    uint64_t m_encodedBytes;
+    double m_totalEncodeMs;
+    double m_maxEncodeMs;
+    double m_totalLatencyMs;
+    double m_maxLatencyMs;
+
+    std::vector<std::thread> m_encoders;
+};
@@ -0,0 +1,448 @@
+#include "GpuResourceRegistry.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <istream>
+#include <ostream>
+#include <sstream>
+
+namespace
+{
+    const char *const HeapTypeNames[] =
+    {
+        "Default",
+        "Upload",
+        "Readback"
+    };
+
+    const char *const CategoryNames[] =
+    {
+        "Geometry",
+        "Constants",
+        "Textures",
+        "RenderTargets",
+        "UnorderedAccess",
+        "Staging",
+        "Readback"
+    };
+
+    static_assert(sizeof(HeapTypeNames) / sizeof(HeapTypeNames[0]) == GpuHeapTypeCount, "Every heap type needs a name");
+    static_assert(sizeof(CategoryNames) / sizeof(CategoryNames[0]) == GpuResourceCategoryCount, "Every category needs a name");
+
+    const char *const SnapshotHeader = "GpuMemorySnapshot 1";
+
+    template<typename T>
+    bool findName(const char *const *names, uint32_t count, const std::string &name, T &value)
+    {
+        for (uint32_t i = 0u; i < count; ++i)
+        {
+            if (name == names[i])
+            {
+                value = static_cast<T>(i);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Snapshot fields are tab separated, one resource per line
+    std::string sanitize(const std::string &text)
+    {
+        std::string result = text;
+        std::replace_if(result.begin(), result.end(), [](char c) { return c == '\t' || c == '\n' || c == '\r'; }, ' ');
+        return result;
+    }
+
+    // Only the file name of the source, build paths differ between machines
+    std::string formatSource(const GpuResourceSource &source)
+    {
+        std::string file = source.file != nullptr ? source.file : "";
+        size_t slash = file.find_last_of("/\\");
+        if (slash != std::string::npos)
+        {
+            file.erase(0u, slash + 1u);
+        }
+        return sanitize(file + ":" + std::to_string(source.line) + " " + (source.function != nullptr ? source.function : ""));
+    }
+
+    std::string formatBytes(int64_t bytes)
+    {
+        const char *const units[] = { "B", "KiB", "MiB", "GiB" };
+        double value = static_cast<double>(bytes < 0 ? -bytes : bytes);
+        uint32_t unit = 0u;
+        while (value >= 1024.0 && unit < 3u)
+        {
+            value /= 1024.0;
+            ++unit;
+        }
+
+        char text[32];
+        std::snprintf(text, sizeof(text), unit == 0u ? "%s%.0f %s" : "%s%.2f %s", bytes < 0 ? "-" : "", value, units[unit]);
+        return text;
+    }
+
+    std::string formatDelta(int64_t bytes)
+    {
+        return bytes > 0 ? "+" + formatBytes(bytes) : formatBytes(bytes);
+    }
+
+    std::string getMatchKey(const GpuResourceRecord &record)
+    {
+        return record.name + '\t' + CategoryNames[static_cast<uint32_t>(record.category)] + '\t' +
+            HeapTypeNames[static_cast<uint32_t>(record.heap)] + '\t' + record.source;
+    }
+
+    void writeRecord(const GpuResourceRecord &record, std::ostream &stream)
+    {
+        stream << "  " << formatBytes(static_cast<int64_t>(record.size)) << "  " << CategoryNames[static_cast<uint32_t>(record.category)]
+               << " " << HeapTypeNames[static_cast<uint32_t>(record.heap)] << " '" << record.name << "' created in frame "
+               << record.createdFrame << " at " << record.source << "\n";
+    }
+}
+
+const char *getGpuHeapTypeName(GpuHeapType heap)
+{
+    return heap < GpuHeapType::Count ? HeapTypeNames[static_cast<uint32_t>(heap)] : "Unknown";
+}
+
+const char *getGpuResourceCategoryName(GpuResourceCategory category)
+{
+    return category < GpuResourceCategory::Count ? CategoryNames[static_cast<uint32_t>(category)] : "Unknown";
+}
+
+GpuResourceRegistry::GpuResourceRegistry(uint32_t historyLength)
+    : m_nextId(1u)
+    , m_frame(0u)
+    , m_heapBytes{}
+    , m_peakHeapBytes{}
+    , m_categoryBytes{}
+    , m_peakCategoryBytes{}
+    , m_historyLength((std::max)(historyLength, 1u))
+    , m_historyNext(0u)
+{
+    m_history.reserve(m_historyLength);
+}
+
+GpuResourceRegistry::ResourceId GpuResourceRegistry::add(const char *name, GpuResourceCategory category, GpuHeapType heap, uint64_t size, const GpuResourceSource &source)
+{
+    Entry entry;
+    entry.name = name != nullptr ? name : "";
+    entry.category = category;
+    entry.heap = heap;
+    entry.size = size;
+    entry.source = source;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ResourceId id = m_nextId++;
+    entry.createdFrame = m_frame;
+    addBytes(heap, category, size);
+    m_resources.emplace(id, std::move(entry));
+    return id;
+}
+
+void GpuResourceRegistry::remove(ResourceId id)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto resource = m_resources.find(id);
+    if (resource == m_resources.end())
+    {
+        return;
+    }
+
+    m_heapBytes[static_cast<uint32_t>(resource->second.heap)] -= resource->second.size;
+    m_categoryBytes[static_cast<uint32_t>(resource->second.category)] -= resource->second.size;
+    m_resources.erase(resource);
+}
+
+void GpuResourceRegistry::addBytes(GpuHeapType heap, GpuResourceCategory category, uint64_t size)
+{
+    uint32_t heapIndex = static_cast<uint32_t>(heap);
+    uint32_t categoryIndex = static_cast<uint32_t>(category);
+    m_heapBytes[heapIndex] += size;
+    m_categoryBytes[categoryIndex] += size;
+    m_peakHeapBytes[heapIndex] = (std::max)(m_peakHeapBytes[heapIndex], m_heapBytes[heapIndex]);
+    m_peakCategoryBytes[categoryIndex] = (std::max)(m_peakCategoryBytes[categoryIndex], m_categoryBytes[categoryIndex]);
+}
+
+void GpuResourceRegistry::endFrame()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    GpuMemorySample sample;
+    sample.frame = m_frame;
+    std::copy(m_heapBytes, m_heapBytes + GpuHeapTypeCount, sample.heapBytes);
+    std::copy(m_categoryBytes, m_categoryBytes + GpuResourceCategoryCount, sample.categoryBytes);
+    if (m_history.size() < m_historyLength)
+    {
+        m_history.push_back(sample);
+    }
+    else
+    {
+        m_history[m_historyNext] = sample;
+    }
+    m_historyNext = (m_historyNext + 1u) % m_historyLength;
+
+    ++m_frame;
+}
+
+uint64_t GpuResourceRegistry::getFrame() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_frame;
+}
+
+uint64_t GpuResourceRegistry::getHeapBytes(GpuHeapType heap) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_heapBytes[static_cast<uint32_t>(heap)];
+}
+
+uint64_t GpuResourceRegistry::getPeakHeapBytes(GpuHeapType heap) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_peakHeapBytes[static_cast<uint32_t>(heap)];
+}
+
+uint64_t GpuResourceRegistry::getCategoryBytes(GpuResourceCategory category) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_categoryBytes[static_cast<uint32_t>(category)];
+}
+
+uint64_t GpuResourceRegistry::getPeakCategoryBytes(GpuResourceCategory category) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_peakCategoryBytes[static_cast<uint32_t>(category)];
+}
+
+uint32_t GpuResourceRegistry::getLiveCount() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return static_cast<uint32_t>(m_resources.size());
+}
+
+void GpuResourceRegistry::getHistory(std::vector<GpuMemorySample> &history) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Until the ring wraps m_historyNext is the end of the samples, afterwards the oldest one
+    history.clear();
+    uint32_t first = m_history.size() < m_historyLength ? 0u : m_historyNext;
+    for (size_t i = 0u; i < m_history.size(); ++i)
+    {
+        history.push_back(m_history[(first + i) % m_history.size()]);
+    }
+}
+
+void GpuResourceRegistry::captureSnapshot(GpuMemorySnapshot &snapshot) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    snapshot.frame = m_frame;
+    snapshot.resources.clear();
+    snapshot.resources.reserve(m_resources.size());
+    for (const auto &resource : m_resources)
+    {
+        const Entry &entry = resource.second;
+
+        GpuResourceRecord record;
+        record.id = resource.first;
+        record.name = sanitize(entry.name);
+        record.category = entry.category;
+        record.heap = entry.heap;
+        record.size = entry.size;
+        record.createdFrame = entry.createdFrame;
+        record.source = formatSource(entry.source);
+        snapshot.resources.push_back(std::move(record));
+    }
+    std::sort(snapshot.resources.begin(), snapshot.resources.end(),
+        [](const GpuResourceRecord &a, const GpuResourceRecord &b) { return a.id < b.id; });
+    std::copy(m_heapBytes, m_heapBytes + GpuHeapTypeCount, snapshot.heapBytes);
+    std::copy(m_categoryBytes, m_categoryBytes + GpuResourceCategoryCount, snapshot.categoryBytes);
+}
+
+uint32_t GpuResourceRegistry::writeLeakReport(std::ostream &stream) const
+{
+    GpuMemorySnapshot snapshot;
+    captureSnapshot(snapshot);
+    if (snapshot.resources.empty())
+    {
+        return 0u;
+    }
+
+    std::stable_sort(snapshot.resources.begin(), snapshot.resources.end(),
+        [](const GpuResourceRecord &a, const GpuResourceRecord &b) { return a.size > b.size; });
+
+    uint64_t leakedBytes = 0u;
+    for (const GpuResourceRecord &record : snapshot.resources)
+    {
+        leakedBytes += record.size;
+    }
+    stream << snapshot.resources.size() << " GPU resources leaked, " << formatBytes(static_cast<int64_t>(leakedBytes)) << "\n";
+    for (const GpuResourceRecord &record : snapshot.resources)
+    {
+        writeRecord(record, stream);
+    }
+    return static_cast<uint32_t>(snapshot.resources.size());
+}
+
+GpuResourceRegistry &getGpuResourceRegistry()
+{
+    static GpuResourceRegistry registry;
+    return registry;
+}
+
+bool writeGpuMemorySnapshot(const GpuMemorySnapshot &snapshot, std::ostream &stream)
+{
+    stream << SnapshotHeader << "\n";
+    stream << "frame\t" << snapshot.frame << "\n";
+    for (const GpuResourceRecord &record : snapshot.resources)
+    {
+        stream << "resource\t" << record.id << "\t" << CategoryNames[static_cast<uint32_t>(record.category)] << "\t"
+               << HeapTypeNames[static_cast<uint32_t>(record.heap)] << "\t" << record.size << "\t" << record.createdFrame << "\t"
+               << record.source << "\t" << record.name << "\n";
+    }
+    return static_cast<bool>(stream);
+}
+
+bool readGpuMemorySnapshot(std::istream &stream, GpuMemorySnapshot &snapshot)
+{
+    snapshot = GpuMemorySnapshot();
+
+    std::string line;
+    if (!std::getline(stream, line) || line != SnapshotHeader)
+    {
+        return false;
+    }
+
+    while (std::getline(stream, line))
+    {
+        if (line.empty())
+        {
+            continue;
+        }
+
+        std::vector<std::string> fields;
+        std::istringstream lineStream(line);
+        std::string field;
+        while (std::getline(lineStream, field, '\t'))
+        {
+            fields.push_back(field);
+        }
+        if (line.back() == '\t')
+        {
+            fields.push_back(""); // An empty name
+        }
+
+        if (fields.size() == 2u && fields[0] == "frame")
+        {
+            snapshot.frame = std::stoull(fields[1]);
+            continue;
+        }
+        if (fields.size() != 8u || fields[0] != "resource")
+        {
+            return false;
+        }
+
+        GpuResourceRecord record;
+        if (!findName(CategoryNames, GpuResourceCategoryCount, fields[2], record.category) ||
+            !findName(HeapTypeNames, GpuHeapTypeCount, fields[3], record.heap))
+        {
+            return false;
+        }
+        record.id = std::stoull(fields[1]);
+        record.size = std::stoull(fields[4]);
+        record.createdFrame = std::stoull(fields[5]);
+        record.source = fields[6];
+        record.name = fields[7];
+
+        snapshot.heapBytes[static_cast<uint32_t>(record.heap)] += record.size;
+        snapshot.categoryBytes[static_cast<uint32_t>(record.category)] += record.size;
+        snapshot.resources.push_back(std::move(record));
+    }
+    return true;
+}
+
+void diffGpuMemorySnapshots(const GpuMemorySnapshot &before, const GpuMemorySnapshot &after, GpuMemoryDiff &diff)
+{
+    diff = GpuMemoryDiff();
+
+    // Resources with the same key pair up in creation order
+    std::unordered_map<std::string, std::vector<size_t>> beforeByKey;
+    for (size_t i = before.resources.size(); i-- > 0u;)
+    {
+        beforeByKey[getMatchKey(before.resources[i])].push_back(i);
+    }
+
+    std::vector<uint8_t> matched(before.resources.size(), 0u);
+    for (const GpuResourceRecord &record : after.resources)
+    {
+        auto candidates = beforeByKey.find(getMatchKey(record));
+        if (candidates == beforeByKey.end() || candidates->second.empty())
+        {
+            diff.added.push_back(record);
+            continue;
+        }
+
+        size_t match = candidates->second.back();
+        candidates->second.pop_back();
+        matched[match] = 1u;
+        if (before.resources[match].size != record.size)
+        {
+            diff.resized.push_back(record);
+            diff.resizedDeltas.push_back(static_cast<int64_t>(record.size) - static_cast<int64_t>(before.resources[match].size));
+        }
+    }
+
+    for (size_t i = 0u; i < before.resources.size(); ++i)
+    {
+        if (!matched[i])
+        {
+            diff.removed.push_back(before.resources[i]);
+        }
+    }
+
+    for (uint32_t heap = 0u; heap < GpuHeapTypeCount; ++heap)
+    {
+        diff.heapDeltas[heap] = static_cast<int64_t>(after.heapBytes[heap]) - static_cast<int64_t>(before.heapBytes[heap]);
+    }
+    for (uint32_t category = 0u; category < GpuResourceCategoryCount; ++category)
+    {
+        diff.categoryDeltas[category] = static_cast<int64_t>(after.categoryBytes[category]) - static_cast<int64_t>(before.categoryBytes[category]);
+    }
+}
+
+void writeGpuMemoryDiff(const GpuMemoryDiff &diff, std::ostream &stream)
+{
+    stream << "Heaps:";
+    for (uint32_t heap = 0u; heap < GpuHeapTypeCount; ++heap)
+    {
+        stream << " " << HeapTypeNames[heap] << " " << formatDelta(diff.heapDeltas[heap]);
+    }
+    stream << "\nCategories:";
+    for (uint32_t category = 0u; category < GpuResourceCategoryCount; ++category)
+    {
+        if (diff.categoryDeltas[category] != 0)
+        {
+            stream << " " << CategoryNames[category] << " " << formatDelta(diff.categoryDeltas[category]);
+        }
+    }
+    stream << "\n";
+
+    stream << diff.added.size() << " added\n";
+    for (const GpuResourceRecord &record : diff.added)
+    {
+        writeRecord(record, stream);
+    }
+    stream << diff.removed.size() << " removed\n";
+    for (const GpuResourceRecord &record : diff.removed)
+    {
+        writeRecord(record, stream);
+    }
+    stream << diff.resized.size() << " resized\n";
+    for (size_t i = 0u; i < diff.resized.size(); ++i)
+    {
+        stream << "  " << formatDelta(diff.resizedDeltas[i]);
+        writeRecord(diff.resized[i], stream);
+    }
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+// Accounting of GPU memory by heap type and category.
+// Every resource the renderer creates is registered with a category, debug name, allocation size
+// and the place in the source that created it, and removed again when the resource is destroyed.
+// The registry keeps live and peak bytes per heap and category, a sample of them for every frame
+// over a bounded history, and can list whatever is still alive at shutdown as a leak.
+//
+// Snapshots of the live resources can be written to a text file and compared, either two taken
+// in one run or the same point of two runs, with diffGpuMemorySnapshots or the GpuMemoryDiff tool.
+// This file is platform independent so it can be built and profiled off Windows.
+
+#include <cstdint>
+#include <iosfwd>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+enum class GpuHeapType : uint8_t
+{
+    Default,
+    Upload,
+    Readback,
+    Count
+};
+
+enum class GpuResourceCategory : uint8_t
+{
+    Geometry,
+    Constants,
+    Textures,
+    RenderTargets,
+    UnorderedAccess,
+    Staging,
+    Readback,
+    Count
+};
+
+const uint32_t GpuHeapTypeCount = static_cast<uint32_t>(GpuHeapType::Count);
+const uint32_t GpuResourceCategoryCount = static_cast<uint32_t>(GpuResourceCategory::Count);
+
+const char *getGpuHeapTypeName(GpuHeapType heap);
+const char *getGpuResourceCategoryName(GpuResourceCategory category);
+
+// Where a resource was created, see GPU_RESOURCE_SOURCE
+struct GpuResourceSource
+{
+    const char *file;
+    const char *function;
+    uint32_t line;
+};
+
+#define GPU_RESOURCE_SOURCE GpuResourceSource{ __FILE__, __func__, static_cast<uint32_t>(__LINE__) }
+
+struct GpuResourceRecord
+{
+    uint64_t id;
+    std::string name;
+    GpuResourceCategory category;
+    GpuHeapType heap;
+    uint64_t size;
+    uint64_t createdFrame;
+    std::string source; // file:line function
+};
+
+// Live bytes at the end of a frame
+struct GpuMemorySample
+{
+    uint64_t frame;
+    uint64_t heapBytes[GpuHeapTypeCount];
+    uint64_t categoryBytes[GpuResourceCategoryCount];
+};
+
+struct GpuMemorySnapshot
+{
+    uint64_t frame = 0u;
+    std::vector<GpuResourceRecord> resources; // In creation order
+    uint64_t heapBytes[GpuHeapTypeCount] = {};
+    uint64_t categoryBytes[GpuResourceCategoryCount] = {};
+};
+
+struct GpuMemoryDiff
+{
+    std::vector<GpuResourceRecord> added;
+    std::vector<GpuResourceRecord> removed;
+    std::vector<GpuResourceRecord> resized; // Size in the later snapshot
+    std::vector<int64_t> resizedDeltas;     // Size change of every resized resource
+    int64_t heapDeltas[GpuHeapTypeCount] = {};
+    int64_t categoryDeltas[GpuResourceCategoryCount] = {};
+};
+
+class GpuResourceRegistry
+{
+public:
+    typedef uint64_t ResourceId;
+
+    static const ResourceId InvalidId = 0u;
+
+    // historyLength is the number of frame samples kept
+    explicit GpuResourceRegistry(uint32_t historyLength = 600u);
+
+    // Thread safe, resources may be created and released on any thread
+    ResourceId add(const char *name, GpuResourceCategory category, GpuHeapType heap, uint64_t size, const GpuResourceSource &source);
+    void remove(ResourceId id);
+
+    // Records the live bytes as the sample of the current frame and starts the next one
+    void endFrame();
+    uint64_t getFrame() const;
+
+    uint64_t getHeapBytes(GpuHeapType heap) const;
+    uint64_t getPeakHeapBytes(GpuHeapType heap) const;
+    uint64_t getCategoryBytes(GpuResourceCategory category) const;
+    uint64_t getPeakCategoryBytes(GpuResourceCategory category) const;
+    uint32_t getLiveCount() const;
+
+    // Oldest sample first
+    void getHistory(std::vector<GpuMemorySample> &history) const;
+
+    void captureSnapshot(GpuMemorySnapshot &snapshot) const;
+
+    // Lists every live resource, largest first. Call once everything should have been released,
+    // returns the number of leaked resources.
+    uint32_t writeLeakReport(std::ostream &stream) const;
+
+private:
+    // The source is formatted only when a record is read back
+    struct Entry
+    {
+        std::string name;
+        GpuResourceCategory category;
+        GpuHeapType heap;
+        uint64_t size;
+        uint64_t createdFrame;
+        GpuResourceSource source;
+    };
+
+    void addBytes(GpuHeapType heap, GpuResourceCategory category, uint64_t size);
+
+    mutable std::mutex m_mutex;
+    ResourceId m_nextId;
+    uint64_t m_frame;
+    std::unordered_map<ResourceId, Entry> m_resources;
+    uint64_t m_heapBytes[GpuHeapTypeCount];
+    uint64_t m_peakHeapBytes[GpuHeapTypeCount];
+    uint64_t m_categoryBytes[GpuResourceCategoryCount];
+    uint64_t m_peakCategoryBytes[GpuResourceCategoryCount];
+
+    // Ring of frame samples
+    std::vector<GpuMemorySample> m_history;
+    uint32_t m_historyLength;
+    uint32_t m_historyNext;
+};
+
+// The registry the renderer reports to, it outlives the renderer so leaks can be listed after it
+GpuResourceRegistry &getGpuResourceRegistry();
+
+bool writeGpuMemorySnapshot(const GpuMemorySnapshot &snapshot, std::ostream &stream);
+bool readGpuMemorySnapshot(std::istream &stream, GpuMemorySnapshot &snapshot);
+
+// Resources are matched by name, category, heap and source so snapshots of different runs
+// compare as well as two of the same run. Matched resources whose size differs count as resized.
+void diffGpuMemorySnapshots(const GpuMemorySnapshot &before, const GpuMemorySnapshot &after, GpuMemoryDiff &diff);
+
+void writeGpuMemoryDiff(const GpuMemoryDiff &diff, std::ostream &stream);
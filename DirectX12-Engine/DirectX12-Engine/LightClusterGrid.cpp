@@ -0,0 +1,518 @@
+#include "LightClusterGrid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+#include "WorkerPool.h"
+
+namespace
+{
+    // Lights per range task
+    const uint32_t LightBatchSize = 1024u;
+
+    // Stands in for the slope of a tangent that does not exist, lights crossing the near plane
+    // cover the whole screen
+    const float UnboundedSlope = 1e30f;
+
+    // Everything the range computation needs from the config, precomputed once per build
+    struct RangeConstants
+    {
+        float nearZ;
+        float farZ;
+        float tilesX;
+        float tilesY;
+        float halfTilesX;      // Tile of the screen centre
+        float halfTilesY;
+        float slopeToTileX;    // Tiles per unit of x / z
+        float slopeToTileY;
+        float lastTileX;       // Clamp below tilesX that floors to the last tile
+        float lastTileY;
+        const float *innerSliceDepths; // Slice boundaries between the near and far plane
+        uint32_t innerSliceCount;
+    };
+
+    // One light per lane, the reference path and the tail of every batch. The operations match
+    // the SIMD versions exactly, including which operand min and max return.
+    struct ScalarLanes
+    {
+        typedef float Float;
+        typedef int32_t Int;
+        typedef bool Mask;
+        static const uint32_t Count = 1u;
+
+        static Float load(const float *source) { return *source; }
+        static void store(int32_t *destination, Int value) { *destination = value; }
+        static Float splat(float value) { return value; }
+        static Int splatInt(int32_t value) { return value; }
+        static Float add(Float a, Float b) { return a + b; }
+        static Float subtract(Float a, Float b) { return a - b; }
+        static Float multiply(Float a, Float b) { return a * b; }
+        static Float divide(Float a, Float b) { return a / b; }
+        static Float squareRoot(Float a) { return std::sqrt(a); }
+        static Float minimum(Float a, Float b) { return a < b ? a : b; }
+        static Float maximum(Float a, Float b) { return a > b ? a : b; }
+        static Mask lessThan(Float a, Float b) { return a < b; }
+        static Mask lessEqual(Float a, Float b) { return a <= b; }
+        static Mask either(Mask a, Mask b) { return a || b; }
+        static Float select(Mask mask, Float a, Float b) { return mask ? a : b; }
+        static Int selectInt(Mask mask, Int a, Int b) { return mask ? a : b; }
+        static Int countIf(Int count, Mask mask) { return count + (mask ? 1 : 0); }
+        static Int floorToInt(Float a) { return static_cast<int32_t>(std::floor(a)); }
+    };
+
+#if defined(VECTOR_MATH_AVX2)
+    struct SimdLanes
+    {
+        typedef __m256 Float;
+        typedef __m256i Int;
+        typedef __m256 Mask;
+        static const uint32_t Count = 8u;
+
+        static Float load(const float *source) { return _mm256_loadu_ps(source); }
+        static void store(int32_t *destination, Int value) { _mm256_storeu_si256(reinterpret_cast<__m256i *>(destination), value); }
+        static Float splat(float value) { return _mm256_set1_ps(value); }
+        static Int splatInt(int32_t value) { return _mm256_set1_epi32(value); }
+        static Float add(Float a, Float b) { return _mm256_add_ps(a, b); }
+        static Float subtract(Float a, Float b) { return _mm256_sub_ps(a, b); }
+        static Float multiply(Float a, Float b) { return _mm256_mul_ps(a, b); }
+        static Float divide(Float a, Float b) { return _mm256_div_ps(a, b); }
+        static Float squareRoot(Float a) { return _mm256_sqrt_ps(a); }
+        static Float minimum(Float a, Float b) { return _mm256_min_ps(a, b); }
+        static Float maximum(Float a, Float b) { return _mm256_max_ps(a, b); }
+        static Mask lessThan(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+        static Mask lessEqual(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+        static Mask either(Mask a, Mask b) { return _mm256_or_ps(a, b); }
+        static Float select(Mask mask, Float a, Float b) { return _mm256_blendv_ps(b, a, mask); }
+        static Int selectInt(Mask mask, Int a, Int b) { return _mm256_blendv_epi8(b, a, _mm256_castps_si256(mask)); }
+        static Int countIf(Int count, Mask mask) { return _mm256_sub_epi32(count, _mm256_castps_si256(mask)); }
+        static Int floorToInt(Float a)
+        {
+            // Truncate, then step down where that rounded up
+            const __m256i truncated = _mm256_cvttps_epi32(a);
+            return _mm256_add_epi32(truncated, _mm256_castps_si256(_mm256_cmp_ps(_mm256_cvtepi32_ps(truncated), a, _CMP_GT_OQ)));
+        }
+    };
+#elif defined(VECTOR_MATH_SSE)
+    struct SimdLanes
+    {
+        typedef __m128 Float;
+        typedef __m128i Int;
+        typedef __m128 Mask;
+        static const uint32_t Count = 4u;
+
+        static Float load(const float *source) { return _mm_loadu_ps(source); }
+        static void store(int32_t *destination, Int value) { _mm_storeu_si128(reinterpret_cast<__m128i *>(destination), value); }
+        static Float splat(float value) { return _mm_set1_ps(value); }
+        static Int splatInt(int32_t value) { return _mm_set1_epi32(value); }
+        static Float add(Float a, Float b) { return _mm_add_ps(a, b); }
+        static Float subtract(Float a, Float b) { return _mm_sub_ps(a, b); }
+        static Float multiply(Float a, Float b) { return _mm_mul_ps(a, b); }
+        static Float divide(Float a, Float b) { return _mm_div_ps(a, b); }
+        static Float squareRoot(Float a) { return _mm_sqrt_ps(a); }
+        static Float minimum(Float a, Float b) { return _mm_min_ps(a, b); }
+        static Float maximum(Float a, Float b) { return _mm_max_ps(a, b); }
+        static Mask lessThan(Float a, Float b) { return _mm_cmplt_ps(a, b); }
+        static Mask lessEqual(Float a, Float b) { return _mm_cmple_ps(a, b); }
+        static Mask either(Mask a, Mask b) { return _mm_or_ps(a, b); }
+        static Float select(Mask mask, Float a, Float b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+        static Int selectInt(Mask mask, Int a, Int b) { return _mm_castps_si128(select(mask, _mm_castsi128_ps(a), _mm_castsi128_ps(b))); }
+        static Int countIf(Int count, Mask mask) { return _mm_sub_epi32(count, _mm_castps_si128(mask)); }
+        static Int floorToInt(Float a)
+        {
+            const __m128i truncated = _mm_cvttps_epi32(a);
+            return _mm_add_epi32(truncated, _mm_castps_si128(_mm_cmpgt_ps(_mm_cvtepi32_ps(truncated), a)));
+        }
+    };
+#elif defined(VECTOR_MATH_NEON) && (defined(__aarch64__) || defined(_M_ARM64))
+    // Vector division and square root need AArch64
+    struct SimdLanes
+    {
+        typedef float32x4_t Float;
+        typedef int32x4_t Int;
+        typedef uint32x4_t Mask;
+        static const uint32_t Count = 4u;
+
+        static Float load(const float *source) { return vld1q_f32(source); }
+        static void store(int32_t *destination, Int value) { vst1q_s32(destination, value); }
+        static Float splat(float value) { return vdupq_n_f32(value); }
+        static Int splatInt(int32_t value) { return vdupq_n_s32(value); }
+        static Float add(Float a, Float b) { return vaddq_f32(a, b); }
+        static Float subtract(Float a, Float b) { return vsubq_f32(a, b); }
+        static Float multiply(Float a, Float b) { return vmulq_f32(a, b); }
+        static Float divide(Float a, Float b) { return vdivq_f32(a, b); }
+        static Float squareRoot(Float a) { return vsqrtq_f32(a); }
+        static Float minimum(Float a, Float b) { return vbslq_f32(vcltq_f32(a, b), a, b); }
+        static Float maximum(Float a, Float b) { return vbslq_f32(vcgtq_f32(a, b), a, b); }
+        static Mask lessThan(Float a, Float b) { return vcltq_f32(a, b); }
+        static Mask lessEqual(Float a, Float b) { return vcleq_f32(a, b); }
+        static Mask either(Mask a, Mask b) { return vorrq_u32(a, b); }
+        static Float select(Mask mask, Float a, Float b) { return vbslq_f32(mask, a, b); }
+        static Int selectInt(Mask mask, Int a, Int b) { return vbslq_s32(mask, a, b); }
+        static Int countIf(Int count, Mask mask) { return vsubq_s32(count, vreinterpretq_s32_u32(mask)); }
+        static Int floorToInt(Float a)
+        {
+            const int32x4_t truncated = vcvtq_s32_f32(a);
+            return vaddq_s32(truncated, vreinterpretq_s32_u32(vcgtq_f32(vcvtq_f32_s32(truncated), a)));
+        }
+    };
+#else
+    typedef ScalarLanes SimdLanes;
+#endif
+
+    RangeConstants makeRangeConstants(const LightClusterConfig &config, const std::vector<float> &sliceDepths)
+    {
+        RangeConstants constants;
+        constants.nearZ = config.nearZ;
+        constants.farZ = config.farZ;
+        constants.tilesX = static_cast<float>(config.tilesX);
+        constants.tilesY = static_cast<float>(config.tilesY);
+        constants.halfTilesX = 0.5f * constants.tilesX;
+        constants.halfTilesY = 0.5f * constants.tilesY;
+        constants.slopeToTileX = 0.5f * config.projectionScaleX * constants.tilesX;
+        constants.slopeToTileY = 0.5f * config.projectionScaleY * constants.tilesY;
+        constants.lastTileX = constants.tilesX - 0.5f;
+        constants.lastTileY = constants.tilesY - 0.5f;
+        constants.innerSliceDepths = sliceDepths.data() + 1;
+        constants.innerSliceCount = config.slices - 1u;
+        return constants;
+    }
+
+    // Range of x / z (or y / z) over a sphere wholly in front of the camera, from the two tangent
+    // lines through the eye. a is the centre along the axis.
+    template<typename L>
+    void getSlopeRange(typename L::Float a, typename L::Float z, typename L::Float zSquared, typename L::Float radius,
+        typename L::Float radiusSquared, typename L::Mask crossesNear, typename L::Float &minSlope, typename L::Float &maxSlope)
+    {
+        const typename L::Float one = L::splat(1.0f);
+        const typename L::Float tangent = L::squareRoot(L::maximum(L::subtract(L::add(L::multiply(a, a), zSquared), radiusSquared), L::splat(0.0f)));
+        const typename L::Float at = L::multiply(a, tangent);
+        const typename L::Float rz = L::multiply(radius, z);
+        const typename L::Float zt = L::multiply(z, tangent);
+        const typename L::Float ar = L::multiply(a, radius);
+
+        // The denominators are positive once the sphere is in front of the near plane
+        const typename L::Float minDenominator = L::select(crossesNear, one, L::add(zt, ar));
+        const typename L::Float maxDenominator = L::select(crossesNear, one, L::subtract(zt, ar));
+        minSlope = L::select(crossesNear, L::splat(-UnboundedSlope), L::divide(L::subtract(at, rz), minDenominator));
+        maxSlope = L::select(crossesNear, L::splat(UnboundedSlope), L::divide(L::add(at, rz), maxDenominator));
+    }
+
+    // Tile and slice ranges of L::Count lights, ranges[6] are the LightRanges streams at the first light
+    template<typename L>
+    void computeLightRanges(const RangeConstants &constants, const float *x, const float *y, const float *z, const float *radius, int32_t *const *ranges)
+    {
+        typedef typename L::Float Float;
+        typedef typename L::Mask Mask;
+        typedef typename L::Int Int;
+
+        const Float px = L::load(x);
+        const Float py = L::load(y);
+        const Float pz = L::load(z);
+        const Float pr = L::load(radius);
+        const Float zero = L::splat(0.0f);
+        const Float nearZ = L::splat(constants.nearZ);
+
+        // Depth
+        const Float closest = L::subtract(pz, pr);
+        const Float farthest = L::add(pz, pr);
+        const Mask crossesNear = L::lessEqual(closest, nearZ);
+        Mask culled = L::either(L::lessThan(farthest, nearZ), L::lessThan(L::splat(constants.farZ), closest));
+
+        const Float clampedClosest = L::maximum(closest, nearZ);
+        Int minSlice = L::splatInt(0);
+        Int maxSlice = L::splatInt(0);
+        for (uint32_t i = 0u; i < constants.innerSliceCount; ++i)
+        {
+            const Float boundary = L::splat(constants.innerSliceDepths[i]);
+            minSlice = L::countIf(minSlice, L::lessEqual(boundary, clampedClosest));
+            maxSlice = L::countIf(maxSlice, L::lessEqual(boundary, farthest));
+        }
+
+        // Screen rectangle
+        const Float zSquared = L::multiply(pz, pz);
+        const Float radiusSquared = L::multiply(pr, pr);
+        Float minSlopeX, maxSlopeX, minSlopeY, maxSlopeY;
+        getSlopeRange<L>(px, pz, zSquared, pr, radiusSquared, crossesNear, minSlopeX, maxSlopeX);
+        getSlopeRange<L>(py, pz, zSquared, pr, radiusSquared, crossesNear, minSlopeY, maxSlopeY);
+
+        const Float tilesX = L::splat(constants.tilesX);
+        const Float halfTilesX = L::splat(constants.halfTilesX);
+        const Float slopeToTileX = L::splat(constants.slopeToTileX);
+        const Float left = L::add(L::multiply(minSlopeX, slopeToTileX), halfTilesX);
+        const Float right = L::add(L::multiply(maxSlopeX, slopeToTileX), halfTilesX);
+
+        // Rows count down from the top of the screen
+        const Float tilesY = L::splat(constants.tilesY);
+        const Float halfTilesY = L::splat(constants.halfTilesY);
+        const Float slopeToTileY = L::splat(constants.slopeToTileY);
+        const Float top = L::subtract(halfTilesY, L::multiply(maxSlopeY, slopeToTileY));
+        const Float bottom = L::subtract(halfTilesY, L::multiply(minSlopeY, slopeToTileY));
+
+        culled = L::either(culled, L::either(L::lessThan(right, zero), L::lessEqual(tilesX, left)));
+        culled = L::either(culled, L::either(L::lessThan(bottom, zero), L::lessEqual(tilesY, top)));
+
+        const Float lastTileX = L::splat(constants.lastTileX);
+        const Float lastTileY = L::splat(constants.lastTileY);
+        L::store(ranges[0], L::floorToInt(L::minimum(L::maximum(left, zero), lastTileX)));
+        L::store(ranges[1], L::floorToInt(L::minimum(L::maximum(right, zero), lastTileX)));
+        L::store(ranges[2], L::floorToInt(L::minimum(L::maximum(top, zero), lastTileY)));
+        L::store(ranges[3], L::floorToInt(L::minimum(L::maximum(bottom, zero), lastTileY)));
+        L::store(ranges[4], L::selectInt(culled, L::splatInt(1), minSlice));
+        L::store(ranges[5], L::selectInt(culled, L::splatInt(0), maxSlice));
+    }
+
+    void runTasks(WorkerPool *workerPool, uint32_t count, const std::function<void(uint32_t)> &func)
+    {
+        if (workerPool != nullptr && count > 1u)
+        {
+            workerPool->parallelFor(count, func);
+            return;
+        }
+        for (uint32_t i = 0u; i < count; ++i)
+        {
+            func(i);
+        }
+    }
+}
+
+LightClusterGrid::LightClusterGrid(const LightClusterConfig &config)
+    : m_config(config)
+    , m_droppedCount(0u)
+{
+    // Exponential slices, computed in double so every platform agrees on the boundaries
+    m_sliceDepths.resize(config.slices + 1u);
+    const double ratio = static_cast<double>(config.farZ) / config.nearZ;
+    for (uint32_t i = 0u; i <= config.slices; ++i)
+    {
+        m_sliceDepths[i] = static_cast<float>(config.nearZ * std::pow(ratio, static_cast<double>(i) / config.slices));
+    }
+    m_clusters.assign(getClusterCount(), LightClusterRange{ 0u, 0u });
+}
+
+uint32_t LightClusterGrid::getSlice(float depth) const
+{
+    uint32_t slice = 0u;
+    for (uint32_t i = 1u; i < m_config.slices; ++i)
+    {
+        slice += m_sliceDepths[i] <= depth ? 1u : 0u;
+    }
+    return slice;
+}
+
+float LightClusterGrid::getSliceScale() const
+{
+    return static_cast<float>(m_config.slices / std::log2(static_cast<double>(m_config.farZ) / m_config.nearZ));
+}
+
+float LightClusterGrid::getSliceBias() const
+{
+    return static_cast<float>(-std::log2(static_cast<double>(m_config.nearZ)) * getSliceScale());
+}
+
+void LightClusterGrid::resizeRanges(uint32_t count)
+{
+    // Padded so the last SIMD batch can store whole lanes
+    const size_t size = (count + SimdLanes::Count - 1u) / SimdLanes::Count * SimdLanes::Count;
+    m_ranges.minX.resize(size);
+    m_ranges.maxX.resize(size);
+    m_ranges.minY.resize(size);
+    m_ranges.maxY.resize(size);
+    m_ranges.minSlice.resize(size);
+    m_ranges.maxSlice.resize(size);
+}
+
+void LightClusterGrid::assignOffsets()
+{
+    uint32_t offset = 0u;
+    uint32_t dropped = 0u;
+    for (LightClusterRange &cluster : m_clusters)
+    {
+        const uint32_t kept = (std::min)(cluster.count, m_config.maxLightIndices - offset);
+        dropped += cluster.count - kept;
+        cluster.offset = offset;
+        cluster.count = kept;
+        offset += kept;
+    }
+    m_lightIndices.resize(offset);
+    m_droppedCount = dropped;
+}
+
+void LightClusterGrid::build(const ClusterLight *lights, uint32_t count, WorkerPool *workerPool)
+{
+    const uint32_t sliceCount = m_config.slices;
+    const uint32_t tileCount = m_config.tilesX * m_config.tilesY;
+    const uint32_t batchCount = (count + LightBatchSize - 1u) / LightBatchSize;
+    const RangeConstants constants = makeRangeConstants(m_config, m_sliceDepths);
+
+    resizeRanges(count);
+    m_batchSliceCounts.assign(static_cast<size_t>(batchCount) * sliceCount, 0u);
+
+    // Ranges of every light with SIMD, and how many lights of each batch touch each slice
+    runTasks(workerPool, batchCount, [&](uint32_t batch)
+    {
+        const uint32_t begin = batch * LightBatchSize;
+        const uint32_t end = (std::min)(begin + LightBatchSize, count);
+
+        uint32_t i = begin;
+        for (; i + SimdLanes::Count <= end; i += SimdLanes::Count)
+        {
+            float x[SimdLanes::Count], y[SimdLanes::Count], z[SimdLanes::Count], radius[SimdLanes::Count];
+            for (uint32_t lane = 0u; lane < SimdLanes::Count; ++lane)
+            {
+                const ClusterLight &light = lights[i + lane];
+                x[lane] = light.position.x;
+                y[lane] = light.position.y;
+                z[lane] = light.position.z;
+                radius[lane] = light.radius;
+            }
+            int32_t *const ranges[6] = { &m_ranges.minX[i], &m_ranges.maxX[i], &m_ranges.minY[i], &m_ranges.maxY[i], &m_ranges.minSlice[i], &m_ranges.maxSlice[i] };
+            computeLightRanges<SimdLanes>(constants, x, y, z, radius, ranges);
+        }
+        for (; i < end; ++i)
+        {
+            const ClusterLight &light = lights[i];
+            int32_t *const ranges[6] = { &m_ranges.minX[i], &m_ranges.maxX[i], &m_ranges.minY[i], &m_ranges.maxY[i], &m_ranges.minSlice[i], &m_ranges.maxSlice[i] };
+            computeLightRanges<ScalarLanes>(constants, &light.position.x, &light.position.y, &light.position.z, &light.radius, ranges);
+        }
+
+        uint32_t *sliceCounts = &m_batchSliceCounts[static_cast<size_t>(batch) * sliceCount];
+        for (i = begin; i < end; ++i)
+        {
+            for (int32_t slice = m_ranges.minSlice[i]; slice <= m_ranges.maxSlice[i]; ++slice)
+            {
+                ++sliceCounts[slice];
+            }
+        }
+    });
+
+    // Lay the slice lists out one after the other, batches in order so lights stay sorted
+    m_sliceOffsets.resize(sliceCount + 1u);
+    uint32_t sliceLightCount = 0u;
+    for (uint32_t slice = 0u; slice < sliceCount; ++slice)
+    {
+        m_sliceOffsets[slice] = sliceLightCount;
+        for (uint32_t batch = 0u; batch < batchCount; ++batch)
+        {
+            uint32_t &batchSlice = m_batchSliceCounts[static_cast<size_t>(batch) * sliceCount + slice];
+            const uint32_t lightCount = batchSlice;
+            batchSlice = sliceLightCount;
+            sliceLightCount += lightCount;
+        }
+    }
+    m_sliceOffsets[sliceCount] = sliceLightCount;
+    m_sliceLights.resize(sliceLightCount);
+
+    runTasks(workerPool, batchCount, [&](uint32_t batch)
+    {
+        const uint32_t begin = batch * LightBatchSize;
+        const uint32_t end = (std::min)(begin + LightBatchSize, count);
+        uint32_t *cursors = &m_batchSliceCounts[static_cast<size_t>(batch) * sliceCount];
+        for (uint32_t i = begin; i < end; ++i)
+        {
+            for (int32_t slice = m_ranges.minSlice[i]; slice <= m_ranges.maxSlice[i]; ++slice)
+            {
+                m_sliceLights[cursors[slice]++] = i;
+            }
+        }
+    });
+
+    // Count the lights of every cluster, each task owns one slice of the grid
+    m_clusters.assign(getClusterCount(), LightClusterRange{ 0u, 0u });
+    runTasks(workerPool, sliceCount, [&](uint32_t slice)
+    {
+        LightClusterRange *sliceClusters = &m_clusters[static_cast<size_t>(slice) * tileCount];
+        for (uint32_t k = m_sliceOffsets[slice]; k < m_sliceOffsets[slice + 1u]; ++k)
+        {
+            const uint32_t light = m_sliceLights[k];
+            for (int32_t y = m_ranges.minY[light]; y <= m_ranges.maxY[light]; ++y)
+            {
+                LightClusterRange *row = sliceClusters + y * m_config.tilesX;
+                for (int32_t x = m_ranges.minX[light]; x <= m_ranges.maxX[light]; ++x)
+                {
+                    ++row[x].count;
+                }
+            }
+        }
+    });
+
+    assignOffsets();
+
+    // Fill the index list, a cluster's lights arrive in light order
+    m_clusterCursors.resize(getClusterCount());
+    runTasks(workerPool, sliceCount, [&](uint32_t slice)
+    {
+        const size_t firstCluster = static_cast<size_t>(slice) * tileCount;
+        const LightClusterRange *sliceClusters = &m_clusters[firstCluster];
+        uint32_t *cursors = &m_clusterCursors[firstCluster];
+        std::fill_n(cursors, tileCount, 0u);
+        const bool truncated = m_droppedCount > 0u;
+        for (uint32_t k = m_sliceOffsets[slice]; k < m_sliceOffsets[slice + 1u]; ++k)
+        {
+            const uint32_t light = m_sliceLights[k];
+            const int32_t minX = m_ranges.minX[light];
+            const int32_t maxX = m_ranges.maxX[light];
+            for (int32_t y = m_ranges.minY[light]; y <= m_ranges.maxY[light]; ++y)
+            {
+                const uint32_t row = y * m_config.tilesX;
+                for (int32_t x = minX; x <= maxX; ++x)
+                {
+                    const uint32_t tile = row + x;
+                    if (!truncated || cursors[tile] < sliceClusters[tile].count)
+                    {
+                        m_lightIndices[sliceClusters[tile].offset + cursors[tile]++] = light;
+                    }
+                }
+            }
+        }
+    });
+}
+
+void LightClusterGrid::buildReference(const ClusterLight *lights, uint32_t count)
+{
+    const RangeConstants constants = makeRangeConstants(m_config, m_sliceDepths);
+
+    resizeRanges(count);
+    for (uint32_t i = 0u; i < count; ++i)
+    {
+        const ClusterLight &light = lights[i];
+        int32_t *const ranges[6] = { &m_ranges.minX[i], &m_ranges.maxX[i], &m_ranges.minY[i], &m_ranges.maxY[i], &m_ranges.minSlice[i], &m_ranges.maxSlice[i] };
+        computeLightRanges<ScalarLanes>(constants, &light.position.x, &light.position.y, &light.position.z, &light.radius, ranges);
+    }
+
+    m_clusters.assign(getClusterCount(), LightClusterRange{ 0u, 0u });
+    for (uint32_t i = 0u; i < count; ++i)
+    {
+        for (int32_t slice = m_ranges.minSlice[i]; slice <= m_ranges.maxSlice[i]; ++slice)
+        {
+            for (int32_t y = m_ranges.minY[i]; y <= m_ranges.maxY[i]; ++y)
+            {
+                for (int32_t x = m_ranges.minX[i]; x <= m_ranges.maxX[i]; ++x)
+                {
+                    ++m_clusters[getClusterIndex(x, y, slice)].count;
+                }
+            }
+        }
+    }
+
+    assignOffsets();
+
+    m_clusterCursors.assign(getClusterCount(), 0u);
+    for (uint32_t i = 0u; i < count; ++i)
+    {
+        for (int32_t slice = m_ranges.minSlice[i]; slice <= m_ranges.maxSlice[i]; ++slice)
+        {
+            for (int32_t y = m_ranges.minY[i]; y <= m_ranges.maxY[i]; ++y)
+            {
+                for (int32_t x = m_ranges.minX[i]; x <= m_ranges.maxX[i]; ++x)
+                {
+                    const uint32_t cluster = getClusterIndex(x, y, slice);
+                    if (m_clusterCursors[cluster] < m_clusters[cluster].count)
+                    {
+                        m_lightIndices[m_clusters[cluster].offset + m_clusterCursors[cluster]++] = i;
+                    }
+                }
+            }
+        }
+    }
+}
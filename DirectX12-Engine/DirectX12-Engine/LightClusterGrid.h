@@ -0,0 +1,124 @@
+#pragma once
+
+// Clustered light culling for forward shading.
+// The view frustum is split into tilesX x tilesY screen tiles and a number of depth slices whose
+// bounds grow exponentially from nearZ to farZ, which keeps clusters roughly as deep as they are
+// wide. Every frame the lights are binned into the clusters they may reach, and the result is a
+// compact grid of (offset, count) pairs, one per cluster, indexing a single list of light indices.
+// The pixel shader finds the cluster of its pixel and only walks that cluster's lights.
+//
+// Binning is conservative: a light is listed in every cluster that its sphere's screen rectangle
+// and depth range overlap. build() computes those ranges with SIMD over batches of lights and
+// fills the grid one depth slice per task on a worker pool. buildReference() bins one light and
+// one cluster at a time and produces identical output, it is there to check build() against.
+// This file is platform independent so it can be built and profiled off Windows.
+
+#include <cstdint>
+#include <vector>
+
+#include "VectorMath.h"
+
+class WorkerPool;
+
+// A point light as the pixel shader reads it, the position is in view space
+struct ClusterLight
+{
+    Vec3 position;
+    float radius; // Distance at which the light has faded out
+    Vec3 color;
+    float padding;
+};
+
+static_assert(sizeof(ClusterLight) == 32u, "The light must match the HLSL struct");
+
+struct LightClusterConfig
+{
+    uint32_t tilesX = 16u;
+    uint32_t tilesY = 9u;
+    uint32_t slices = 24u;
+    float nearZ = 0.1f;
+    float farZ = 100.0f;
+
+    // The diagonal of the projection, r[0].x and r[1].y of perspectiveMatrix
+    float projectionScaleX = 1.0f;
+    float projectionScaleY = 1.0f;
+
+    // Length of the light index list. When the lights need more, the clusters at the end of the
+    // grid, which are the farthest ones, lose their lights first.
+    uint32_t maxLightIndices = 1u << 20;
+};
+
+// Where a cluster's lights are in the light index list
+struct LightClusterRange
+{
+    uint32_t offset;
+    uint32_t count;
+};
+
+class LightClusterGrid
+{
+public:
+    explicit LightClusterGrid(const LightClusterConfig &config);
+
+    const LightClusterConfig &getConfig() const { return m_config; }
+    uint32_t getClusterCount() const { return m_config.tilesX * m_config.tilesY * m_config.slices; }
+
+    // Tiles count from the top left of the screen, slices from the near plane
+    uint32_t getClusterIndex(uint32_t x, uint32_t y, uint32_t slice) const { return (slice * m_config.tilesY + y) * m_config.tilesX + x; }
+
+    // View space depth where a slice starts, boundary slices is the far plane
+    float getSliceDepth(uint32_t boundary) const { return m_sliceDepths[boundary]; }
+
+    // The slice a view space depth falls in, as binning sees it
+    uint32_t getSlice(float depth) const;
+
+    // The shader approximates getSlice as floor(log2(depth) * scale + bias)
+    float getSliceScale() const;
+    float getSliceBias() const;
+
+    // Bin the lights with SIMD, spread over workerPool when it is not null
+    void build(const ClusterLight *lights, uint32_t count, WorkerPool *workerPool);
+
+    // Bin the lights one at a time, the output is identical to build
+    void buildReference(const ClusterLight *lights, uint32_t count);
+
+    // One range per cluster, see getClusterIndex
+    const std::vector<LightClusterRange> &getClusters() const { return m_clusters; }
+
+    // Light indices of every cluster in turn, each cluster's in ascending order
+    const std::vector<uint32_t> &getLightIndices() const { return m_lightIndices; }
+
+    // Light references that did not fit in maxLightIndices in the last build
+    uint32_t getDroppedCount() const { return m_droppedCount; }
+
+private:
+    // Inclusive tile and slice ranges of every light, structure of arrays. Lights that reach no
+    // cluster have minSlice > maxSlice.
+    struct LightRanges
+    {
+        std::vector<int32_t> minX;
+        std::vector<int32_t> maxX;
+        std::vector<int32_t> minY;
+        std::vector<int32_t> maxY;
+        std::vector<int32_t> minSlice;
+        std::vector<int32_t> maxSlice;
+    };
+
+    void resizeRanges(uint32_t count);
+
+    // Turns m_clusters counts into offsets and applies maxLightIndices
+    void assignOffsets();
+
+    LightClusterConfig m_config;
+    std::vector<float> m_sliceDepths;
+    LightRanges m_ranges;
+    std::vector<LightClusterRange> m_clusters;
+    std::vector<uint32_t> m_lightIndices;
+    std::vector<uint32_t> m_clusterCursors; // Lights written to every cluster so far
+    uint32_t m_droppedCount;
+
+    // Lights touching every slice, in light order, and where each slice's list starts
+    std::vector<uint32_t> m_sliceLights;
+    std::vector<uint32_t> m_sliceOffsets;
+    std::vector<uint32_t> m_batchSliceCounts; // Per light batch and slice, then where each batch writes
+};
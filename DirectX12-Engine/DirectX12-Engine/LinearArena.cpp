@@ -0,0 +1,108 @@
+#include "LinearArena.h"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+namespace
+{
+    // Freed memory is filled with this in debug builds so stale pointers read garbage
+    const int ResetFillByte = 0xCD;
+}
+
+LinearArena::LinearArena(size_t capacity, MemoryTag tag, bool guardPages)
+    : m_base(nullptr)
+    , m_capacity(roundUpToPages(capacity))
+    , m_tag(tag)
+    , m_guardPages(guardPages)
+    , m_offset(0u)
+    , m_allocations(0u)
+    , m_overflowBytes(0u)
+    , m_highWaterBytes(0u)
+{
+    m_base = static_cast<uint8_t *>(allocatePages(m_capacity, m_guardPages, m_tag));
+    if (m_base == nullptr)
+    {
+        // Everything will go through the overflow path
+        m_capacity = 0u;
+    }
+}
+
+LinearArena::~LinearArena()
+{
+    reset();
+    freePages(m_base, m_capacity, m_guardPages, m_tag);
+}
+
+void *LinearArena::allocate(size_t size, size_t alignment)
+{
+    m_allocations.fetch_add(1u, std::memory_order_relaxed);
+
+    const uintptr_t base = reinterpret_cast<uintptr_t>(m_base);
+    size_t offset = m_offset.load(std::memory_order_relaxed);
+    while (true)
+    {
+        const size_t alignedOffset = static_cast<size_t>(((base + offset + alignment - 1u) & ~static_cast<uintptr_t>(alignment - 1u)) - base);
+        const size_t end = alignedOffset + size;
+        if (end > m_capacity || end < alignedOffset)
+        {
+            return allocateOverflow(size, alignment);
+        }
+
+        if (m_offset.compare_exchange_weak(offset, end, std::memory_order_relaxed))
+        {
+            return m_base + alignedOffset;
+        }
+    }
+}
+
+void *LinearArena::allocateOverflow(size_t size, size_t alignment)
+{
+    alignment = std::max(alignment, alignof(std::max_align_t));
+    void *pointer = ::operator new(size, std::align_val_t(alignment));
+    recordAllocation(m_tag, size);
+
+    std::lock_guard<std::mutex> lock(m_overflowMutex);
+    m_overflowBlocks.push_back({ pointer, size, alignment });
+    m_overflowBytes += size;
+    return pointer;
+}
+
+void LinearArena::reset()
+{
+    const Stats stats = getStats();
+    m_highWaterBytes = std::max(m_highWaterBytes, stats.usedBytes + stats.overflowBytes);
+
+#if defined(_DEBUG)
+    if (m_base != nullptr)
+    {
+        std::memset(m_base, ResetFillByte, std::min(m_offset.load(std::memory_order_relaxed), m_capacity));
+    }
+#else
+    (void)ResetFillByte;
+#endif
+
+    for (const OverflowBlock &block : m_overflowBlocks)
+    {
+        ::operator delete(block.pointer, std::align_val_t(block.alignment));
+        recordFree(m_tag, block.size);
+    }
+    m_overflowBlocks.clear();
+    m_overflowBytes = 0u;
+
+    m_offset.store(0u, std::memory_order_relaxed);
+    m_allocations.store(0u, std::memory_order_relaxed);
+}
+
+LinearArena::Stats LinearArena::getStats() const
+{
+    Stats stats;
+    stats.allocations = m_allocations.load(std::memory_order_relaxed);
+    stats.usedBytes = std::min(m_offset.load(std::memory_order_relaxed), m_capacity);
+
+    std::lock_guard<std::mutex> lock(m_overflowMutex);
+    stats.overflowAllocations = m_overflowBlocks.size();
+    stats.overflowBytes = m_overflowBytes;
+    stats.highWaterBytes = std::max(m_highWaterBytes, stats.usedBytes + stats.overflowBytes);
+    return stats;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+// Bump allocator for memory that lives until a known point, typically the end of a frame.
+// The renderer keeps one arena per frame in flight and resets it when the fence for that frame
+// retires, so per frame data (draw lists, constants, culling results) costs a pointer bump and
+// is freed all at once. Allocation is lock free and safe from any number of threads; requests
+// that do not fit fall back to the heap until the next reset and are reported in the stats so
+// the capacity can be tuned.
+// This file is platform independent so it can be built and profiled off Windows.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "MemoryTracker.h"
+
+class LinearArena
+{
+public:
+    struct Stats
+    {
+        uint64_t allocations;         // Since the last reset
+        uint64_t usedBytes;           // Since the last reset, including alignment padding
+        uint64_t overflowAllocations; // Since the last reset, served by the heap
+        uint64_t overflowBytes;
+        uint64_t highWaterBytes;      // Largest usedBytes + overflowBytes seen at any reset
+    };
+
+    // The capacity is rounded up to whole pages
+    LinearArena(size_t capacity, MemoryTag tag, bool guardPages = DefaultGuardPages);
+
+    ~LinearArena();
+
+    LinearArena(const LinearArena &) = delete;
+    LinearArena &operator=(const LinearArena &) = delete;
+
+    // Thread safe. The alignment must be a power of two. Never returns nullptr.
+    void *allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+    template <typename T>
+    T *allocateArray(size_t count)
+    {
+        return static_cast<T *>(allocate(sizeof(T) * count, alignof(T)));
+    }
+
+    // Release everything allocated since the last reset. Nothing may be using the arena.
+    void reset();
+
+    size_t getCapacity() const { return m_capacity; }
+    Stats getStats() const;
+
+private:
+    void *allocateOverflow(size_t size, size_t alignment);
+
+    uint8_t *m_base;
+    size_t m_capacity;
+    MemoryTag m_tag;
+    bool m_guardPages;
+
+    std::atomic<size_t> m_offset;
+    std::atomic<uint64_t> m_allocations;
+
+    // Heap blocks for requests that did not fit, freed at reset
+    struct OverflowBlock
+    {
+        void *pointer;
+        size_t size;
+        size_t alignment;
+    };
+
+    mutable std::mutex m_overflowMutex;
+    std::vector<OverflowBlock> m_overflowBlocks;
+    uint64_t m_overflowBytes;
+
+    uint64_t m_highWaterBytes;
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+// Runtime LOD choice for meshes built with buildLodChain.
+// Every level stores how far it strays from the full detail surface. The selector projects that
+// error to the screen at the object's distance and picks the coarsest level that stays under a
+// pixel threshold, so small or distant objects drop to cheap index ranges on their own.
+// This file is platform independent so it can be built and profiled off Windows.
+
+#include <cmath>
+#include <cstdint>
+
+#include "MeshSimplifier.h"
+#include "VectorMath.h"
+
+class LodSelector
+{
+public:
+    LodSelector()
+        : m_pixelsPerUnit(1.0f)
+        , m_threshold(1.0f)
+        , m_nearDistance(0.01f)
+    {
+    }
+
+    // verticalFov in radians. thresholdPixels is the largest error allowed on screen.
+    void setProjection(float verticalFov, float viewportHeight, float thresholdPixels, float nearDistance)
+    {
+        m_pixelsPerUnit = viewportHeight / (2.0f * std::tan(verticalFov * 0.5f));
+        m_threshold = thresholdPixels;
+        m_nearDistance = nearDistance;
+    }
+
+    // Pixels covered by one world unit at the given distance
+    float getPixelsPerUnit(float distance) const
+    {
+        return m_pixelsPerUnit / (distance > m_nearDistance ? distance : m_nearDistance);
+    }
+
+    // bounds is the object's world space bounding sphere and scale the largest axis scale of its
+    // world transform, turning object space errors into world units
+    uint32_t select(const LodLevel *levels, uint32_t levelCount, const Sphere &bounds, float scale, const Vec3 &cameraPosition) const
+    {
+        float distance = length(bounds.center - cameraPosition) - bounds.radius;
+        float maxError = m_threshold / (getPixelsPerUnit(distance) * scale);
+
+        // Errors only grow along the chain
+        uint32_t level = 0u;
+        while (level + 1u < levelCount && levels[level + 1u].error <= maxError)
+        {
+            ++level;
+        }
+        return level;
+    }
+
+    // Projected diameter of the bounds in pixels, for culling objects too small to matter
+    float getProjectedSize(const Sphere &bounds, const Vec3 &cameraPosition) const
+    {
+        float distance = length(bounds.center - cameraPosition) - bounds.radius;
+        return 2.0f * bounds.radius * getPixelsPerUnit(distance);
+    }
+
+private:
+    float m_pixelsPerUnit; // At a distance of one unit
+    float m_threshold;
+    float m_nearDistance;
+};
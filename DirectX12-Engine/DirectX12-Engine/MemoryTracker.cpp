@@ -0,0 +1,152 @@
+#include "MemoryTracker.h"
+
+#include <atomic>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    struct TagCounters
+    {
+        std::atomic<uint64_t> currentBytes;
+        std::atomic<uint64_t> peakBytes;
+        std::atomic<uint64_t> allocations;
+        std::atomic<uint64_t> frees;
+    };
+
+    TagCounters g_tagCounters[static_cast<size_t>(MemoryTag::Count)];
+
+    const char *const TagNames[] =
+    {
+        "General",
+        "Renderer",
+        "Shaders",
+        "Sprites",
+        "Simulation",
+        "FrameArena",
+        "Scratch",
+        "ObjectPool",
+        "Scene"
+    };
+
+    static_assert(sizeof(TagNames) / sizeof(TagNames[0]) == static_cast<size_t>(MemoryTag::Count), "Every memory tag needs a name");
+}
+
+const char *getMemoryTagName(MemoryTag tag)
+{
+    return tag < MemoryTag::Count ? TagNames[static_cast<size_t>(tag)] : "Unknown";
+}
+
+void recordAllocation(MemoryTag tag, size_t size)
+{
+    TagCounters &counters = g_tagCounters[static_cast<size_t>(tag)];
+    counters.allocations.fetch_add(1u, std::memory_order_relaxed);
+    const uint64_t current = counters.currentBytes.fetch_add(size, std::memory_order_relaxed) + size;
+
+    uint64_t peak = counters.peakBytes.load(std::memory_order_relaxed);
+    while (current > peak && !counters.peakBytes.compare_exchange_weak(peak, current, std::memory_order_relaxed))
+    {
+    }
+}
+
+void recordFree(MemoryTag tag, size_t size)
+{
+    TagCounters &counters = g_tagCounters[static_cast<size_t>(tag)];
+    counters.frees.fetch_add(1u, std::memory_order_relaxed);
+    counters.currentBytes.fetch_sub(size, std::memory_order_relaxed);
+}
+
+MemoryTagStats getMemoryTagStats(MemoryTag tag)
+{
+    const TagCounters &counters = g_tagCounters[static_cast<size_t>(tag)];
+
+    MemoryTagStats stats;
+    stats.currentBytes = counters.currentBytes.load(std::memory_order_relaxed);
+    stats.peakBytes = counters.peakBytes.load(std::memory_order_relaxed);
+    stats.allocations = counters.allocations.load(std::memory_order_relaxed);
+    stats.frees = counters.frees.load(std::memory_order_relaxed);
+    return stats;
+}
+
+size_t getPageSize()
+{
+    static const size_t pageSize = []()
+    {
+#if defined(_WIN32)
+        SYSTEM_INFO systemInfo;
+        GetSystemInfo(&systemInfo);
+        return static_cast<size_t>(systemInfo.dwPageSize);
+#else
+        return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+    }();
+    return pageSize;
+}
+
+size_t roundUpToPages(size_t size)
+{
+    const size_t pageSize = getPageSize();
+    return (size + pageSize - 1u) / pageSize * pageSize;
+}
+
+void *allocatePages(size_t size, bool guardPages, MemoryTag tag)
+{
+    const size_t pageSize = getPageSize();
+    const size_t committedSize = roundUpToPages(size);
+    const size_t guardSize = guardPages ? pageSize : 0u;
+    const size_t reservedSize = committedSize + 2u * guardSize;
+
+    // Reserve the whole range and commit only the middle, the guard pages stay inaccessible
+#if defined(_WIN32)
+    uint8_t *reserved = static_cast<uint8_t *>(VirtualAlloc(nullptr, reservedSize, MEM_RESERVE, PAGE_NOACCESS));
+    if (reserved == nullptr)
+    {
+        return nullptr;
+    }
+    if (VirtualAlloc(reserved + guardSize, committedSize, MEM_COMMIT, PAGE_READWRITE) == nullptr)
+    {
+        VirtualFree(reserved, 0u, MEM_RELEASE);
+        return nullptr;
+    }
+#else
+    void *mapping = mmap(nullptr, reservedSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED)
+    {
+        return nullptr;
+    }
+    uint8_t *reserved = static_cast<uint8_t *>(mapping);
+    if (mprotect(reserved + guardSize, committedSize, PROT_READ | PROT_WRITE) != 0)
+    {
+        munmap(reserved, reservedSize);
+        return nullptr;
+    }
+#endif
+
+    recordAllocation(tag, committedSize);
+    return reserved + guardSize;
+}
+
+void freePages(void *pointer, size_t size, bool guardPages, MemoryTag tag)
+{
+    if (pointer == nullptr)
+    {
+        return;
+    }
+
+    const size_t committedSize = roundUpToPages(size);
+    const size_t guardSize = guardPages ? getPageSize() : 0u;
+    uint8_t *reserved = static_cast<uint8_t *>(pointer) - guardSize;
+
+#if defined(_WIN32)
+    VirtualFree(reserved, 0u, MEM_RELEASE);
+#else
+    munmap(reserved, committedSize + 2u * guardSize);
+#endif
+
+    recordFree(tag, committedSize);
+}
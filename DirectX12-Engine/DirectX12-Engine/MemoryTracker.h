@@ -0,0 +1,58 @@
+#pragma once
+
+// Tagged allocation statistics and page allocation for the engine's allocators.
+// Every allocator reports the bytes it takes from the system under a tag, so the cost of each
+// subsystem can be read at runtime. The counters are relaxed atomics and cheap enough to keep
+// in release builds.
+//
+// Page allocations can be surrounded by guard pages that are reserved but never committed, so a
+// write past either end of the block faults at the offending instruction instead of corrupting
+// a neighbour. Guard pages are on by default in debug builds.
+// This file is platform independent so the allocators can be profiled off Windows.
+
+#include <cstddef>
+#include <cstdint>
+
+enum class MemoryTag : uint32_t
+{
+    General,
+    Renderer,
+    Shaders,
+    Sprites,
+    Simulation,
+    FrameArena,
+    Scratch,
+    ObjectPool,
+    Scene,
+    Count
+};
+
+struct MemoryTagStats
+{
+    uint64_t currentBytes;
+    uint64_t peakBytes;
+    uint64_t allocations; // Since startup
+    uint64_t frees;
+};
+
+#if defined(_DEBUG)
+const bool DefaultGuardPages = true;
+#else
+const bool DefaultGuardPages = false;
+#endif
+
+const char *getMemoryTagName(MemoryTag tag);
+
+void recordAllocation(MemoryTag tag, size_t size);
+void recordFree(MemoryTag tag, size_t size);
+MemoryTagStats getMemoryTagStats(MemoryTag tag);
+
+size_t getPageSize();
+
+// Round a size up to whole pages
+size_t roundUpToPages(size_t size);
+
+// Commit size bytes (rounded up to whole pages) of zeroed memory, optionally between two guard pages.
+// Returns nullptr if the system is out of memory. The tag is only used for the statistics.
+void *allocatePages(size_t size, bool guardPages, MemoryTag tag);
+void freePages(void *pointer, size_t size, bool guardPages, MemoryTag tag);
@@ -0,0 +1,681 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <numeric>
+
+#include "WorkerPool.h"
+
+namespace
+{
+    const uint32_t None = ~0u;
+    const uint32_t Multiple = ~1u;
+
+    // Open border edges count this much more than a triangle of the same size, seams the same
+    const double BorderWeight = 10.0;
+    const double SeamWeight = 1.0;
+
+    enum class VertexKind : uint8_t
+    {
+        Manifold, // Collapses onto any neighbour
+        Border,   // On one open border, collapses along it
+        Seam,     // One of two vertices sharing a position along an attribute seam, collapses along it
+        Locked    // Corners, seam and border junctions and non-manifold vertices
+    };
+
+    struct Position
+    {
+        double x;
+        double y;
+        double z;
+    };
+
+    Position operator-(const Position &a, const Position &b) { return Position{ a.x - b.x, a.y - b.y, a.z - b.z }; }
+    double dot(const Position &a, const Position &b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+    Position cross(const Position &a, const Position &b) { return Position{ a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+
+    // Sum of weighted squared distances to a set of planes
+    struct Quadric
+    {
+        double a00, a11, a22, a10, a20, a21;
+        double b0, b1, b2;
+        double c;
+        double weight;
+    };
+
+    void addPlane(Quadric &q, const Position &normal, double distance, double weight)
+    {
+        q.a00 += weight * normal.x * normal.x;
+        q.a11 += weight * normal.y * normal.y;
+        q.a22 += weight * normal.z * normal.z;
+        q.a10 += weight * normal.y * normal.x;
+        q.a20 += weight * normal.z * normal.x;
+        q.a21 += weight * normal.z * normal.y;
+        q.b0 += weight * normal.x * distance;
+        q.b1 += weight * normal.y * distance;
+        q.b2 += weight * normal.z * distance;
+        q.c += weight * distance * distance;
+        q.weight += weight;
+    }
+
+    void addQuadric(Quadric &q, const Quadric &r)
+    {
+        q.a00 += r.a00;
+        q.a11 += r.a11;
+        q.a22 += r.a22;
+        q.a10 += r.a10;
+        q.a20 += r.a20;
+        q.a21 += r.a21;
+        q.b0 += r.b0;
+        q.b1 += r.b1;
+        q.b2 += r.b2;
+        q.c += r.c;
+        q.weight += r.weight;
+    }
+
+    // Weighted mean squared distance of p to the planes
+    double evaluate(const Quadric &q, const Position &p)
+    {
+        double r = q.a00 * p.x * p.x + q.a11 * p.y * p.y + q.a22 * p.z * p.z
+            + 2.0 * (q.a10 * p.x * p.y + q.a20 * p.x * p.z + q.a21 * p.y * p.z)
+            + 2.0 * (q.b0 * p.x + q.b1 * p.y + q.b2 * p.z) + q.c;
+        return q.weight > 0.0 ? std::fabs(r) / q.weight : 0.0;
+    }
+
+    // Compressed lists of what touches every vertex, directed edges or triangles
+    struct Adjacency
+    {
+        std::vector<uint32_t> offsets;
+        std::vector<uint32_t> items;
+
+        uint32_t begin(uint32_t v) const { return offsets[v]; }
+        uint32_t end(uint32_t v) const { return offsets[v + 1u]; }
+    };
+
+    // Edges a -> b of every triangle, listed under map[a] and storing b
+    void buildEdges(Adjacency &adjacency, const uint32_t *indices, size_t indexCount, const uint32_t *map, uint32_t vertexCount)
+    {
+        adjacency.offsets.assign(vertexCount + 1u, 0u);
+        for (size_t i = 0u; i < indexCount; ++i)
+        {
+            ++adjacency.offsets[map[indices[i]] + 1u];
+        }
+        std::partial_sum(adjacency.offsets.begin(), adjacency.offsets.end(), adjacency.offsets.begin());
+
+        std::vector<uint32_t> cursor(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+        adjacency.items.resize(indexCount);
+        for (size_t i = 0u; i < indexCount; i += 3u)
+        {
+            for (uint32_t e = 0u; e < 3u; ++e)
+            {
+                uint32_t a = indices[i + e];
+                uint32_t b = indices[i + (e + 1u) % 3u];
+                adjacency.items[cursor[map[a]]++] = b;
+            }
+        }
+    }
+
+    // Triangles using every vertex
+    void buildTriangles(Adjacency &adjacency, const std::vector<uint32_t> &indices, uint32_t vertexCount)
+    {
+        adjacency.offsets.assign(vertexCount + 1u, 0u);
+        for (uint32_t index : indices)
+        {
+            ++adjacency.offsets[index + 1u];
+        }
+        std::partial_sum(adjacency.offsets.begin(), adjacency.offsets.end(), adjacency.offsets.begin());
+
+        std::vector<uint32_t> cursor(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+        adjacency.items.resize(indices.size());
+        for (size_t i = 0u; i < indices.size(); ++i)
+        {
+            adjacency.items[cursor[indices[i]]++] = static_cast<uint32_t>(i / 3u);
+        }
+    }
+
+    bool hasEdge(const Adjacency &edges, const uint32_t *map, uint32_t from, uint32_t to)
+    {
+        for (uint32_t i = edges.begin(from); i < edges.end(from); ++i)
+        {
+            if (map[edges.items[i]] == to)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Record the edges without a twin running the other way, None when there are none and
+    // Multiple when there is more than one
+    void findOpenEdges(const Adjacency &edges, const uint32_t *map, uint32_t vertexCount, std::vector<uint32_t> &openOut, std::vector<uint32_t> &openIn)
+    {
+        openOut.assign(vertexCount, None);
+        openIn.assign(vertexCount, None);
+        for (uint32_t from = 0u; from < vertexCount; ++from)
+        {
+            for (uint32_t i = edges.begin(from); i < edges.end(from); ++i)
+            {
+                uint32_t to = edges.items[i];
+                if (hasEdge(edges, map, map[to], from))
+                {
+                    continue;
+                }
+                openOut[from] = openOut[from] == None ? to : Multiple;
+                openIn[map[to]] = openIn[map[to]] == None ? from : Multiple;
+            }
+        }
+    }
+
+    bool isSingle(uint32_t v)
+    {
+        return v != None && v != Multiple;
+    }
+
+    struct Collapse
+    {
+        uint32_t from;
+        uint32_t to;
+        double error;
+    };
+
+    class Simplifier
+    {
+    public:
+        explicit Simplifier(const SimplifyMesh &mesh);
+
+        double run(uint32_t targetIndexCount, double maxError, std::vector<uint32_t> &indices);
+
+    private:
+        void buildPositionRemap();
+        void classifyVertices();
+        void buildQuadrics();
+
+        uint32_t getSeamTarget(uint32_t from, uint32_t to) const;
+        bool canCollapse(uint32_t from, uint32_t to) const;
+        bool hasFlips(uint32_t from, uint32_t to, const std::vector<uint32_t> &indices) const;
+        uint32_t countRemovedTriangles(uint32_t from, uint32_t to, const std::vector<uint32_t> &indices) const;
+
+        const SimplifyMesh &m_mesh;
+        uint32_t m_vertexCount;
+
+        std::vector<Position> m_positions;
+        std::vector<uint32_t> m_remap; // First vertex with the same position
+        std::vector<uint32_t> m_wedge; // Next vertex with the same position, in a ring
+        std::vector<VertexKind> m_kinds;
+        std::vector<uint32_t> m_loop;     // Next vertex along the border or seam
+        std::vector<uint32_t> m_loopBack; // Previous vertex along the border or seam
+        std::vector<Quadric> m_quadrics;  // Per position, indexed by m_remap
+
+        // Per pass state
+        Adjacency m_triangles;
+        std::vector<uint32_t> m_collapseRemap;
+    };
+
+    Simplifier::Simplifier(const SimplifyMesh &mesh)
+        : m_mesh(mesh)
+        , m_vertexCount(mesh.vertexCount)
+    {
+        m_positions.resize(m_vertexCount);
+        for (uint32_t v = 0u; v < m_vertexCount; ++v)
+        {
+            const float *position = reinterpret_cast<const float *>(reinterpret_cast<const uint8_t *>(mesh.positions) + size_t(v) * mesh.vertexStride);
+            m_positions[v] = Position{ position[0], position[1], position[2] };
+        }
+
+        buildPositionRemap();
+        classifyVertices();
+        buildQuadrics();
+    }
+
+    void Simplifier::buildPositionRemap()
+    {
+        std::vector<uint32_t> order(m_vertexCount);
+        std::iota(order.begin(), order.end(), 0u);
+        auto less = [this](uint32_t a, uint32_t b)
+        {
+            const Position &pa = m_positions[a];
+            const Position &pb = m_positions[b];
+            if (pa.x != pb.x)
+            {
+                return pa.x < pb.x;
+            }
+            if (pa.y != pb.y)
+            {
+                return pa.y < pb.y;
+            }
+            if (pa.z != pb.z)
+            {
+                return pa.z < pb.z;
+            }
+            return a < b;
+        };
+        std::sort(order.begin(), order.end(), less);
+
+        m_remap.resize(m_vertexCount);
+        m_wedge.resize(m_vertexCount);
+        for (uint32_t i = 0u; i < m_vertexCount;)
+        {
+            uint32_t first = order[i];
+            uint32_t j = i + 1u;
+            while (j < m_vertexCount && m_positions[first].x == m_positions[order[j]].x &&
+                m_positions[first].y == m_positions[order[j]].y && m_positions[first].z == m_positions[order[j]].z)
+            {
+                ++j;
+            }
+            for (uint32_t k = i; k < j; ++k)
+            {
+                m_remap[order[k]] = first;
+                m_wedge[order[k]] = order[k + 1u < j ? k + 1u : i];
+            }
+            i = j;
+        }
+    }
+
+    void Simplifier::classifyVertices()
+    {
+        std::vector<uint32_t> identity(m_vertexCount);
+        std::iota(identity.begin(), identity.end(), 0u);
+
+        Adjacency edges;
+        std::vector<uint32_t> positionOut;
+        std::vector<uint32_t> positionIn;
+        buildEdges(edges, m_mesh.indices, m_mesh.indexCount, m_remap.data(), m_vertexCount);
+        findOpenEdges(edges, m_remap.data(), m_vertexCount, positionOut, positionIn);
+
+        std::vector<uint32_t> vertexOut;
+        std::vector<uint32_t> vertexIn;
+        buildEdges(edges, m_mesh.indices, m_mesh.indexCount, identity.data(), m_vertexCount);
+        findOpenEdges(edges, identity.data(), m_vertexCount, vertexOut, vertexIn);
+
+        m_kinds.assign(m_vertexCount, VertexKind::Locked);
+        m_loop.assign(m_vertexCount, None);
+        m_loopBack.assign(m_vertexCount, None);
+        for (uint32_t v = 0u; v < m_vertexCount; ++v)
+        {
+            if (m_remap[v] != v)
+            {
+                continue;
+            }
+
+            bool onBorder = positionOut[v] != None || positionIn[v] != None;
+            if (m_wedge[v] == v)
+            {
+                if (!onBorder)
+                {
+                    m_kinds[v] = VertexKind::Manifold;
+                }
+                else if (isSingle(positionOut[v]) && isSingle(positionIn[v]) && m_remap[positionOut[v]] != m_remap[positionIn[v]])
+                {
+                    m_kinds[v] = VertexKind::Border;
+                    m_loop[v] = positionOut[v];
+                    m_loopBack[v] = positionIn[v];
+                }
+            }
+            else if (m_wedge[m_wedge[v]] == v && !onBorder)
+            {
+                // Two vertices at one position, each with one open edge in and out that match
+                // the other side of the seam
+                uint32_t w = m_wedge[v];
+                if (isSingle(vertexOut[v]) && isSingle(vertexIn[v]) && isSingle(vertexOut[w]) && isSingle(vertexIn[w]) &&
+                    m_remap[vertexOut[v]] == m_remap[vertexIn[w]] && m_remap[vertexIn[v]] == m_remap[vertexOut[w]] &&
+                    m_remap[vertexOut[v]] != m_remap[vertexIn[v]])
+                {
+                    m_kinds[v] = VertexKind::Seam;
+                    m_kinds[w] = VertexKind::Seam;
+                    m_loop[v] = vertexOut[v];
+                    m_loopBack[v] = vertexIn[v];
+                    m_loop[w] = vertexOut[w];
+                    m_loopBack[w] = vertexIn[w];
+                }
+            }
+        }
+    }
+
+    void Simplifier::buildQuadrics()
+    {
+        m_quadrics.assign(m_vertexCount, Quadric{});
+
+        std::vector<uint32_t> identity(m_vertexCount);
+        std::iota(identity.begin(), identity.end(), 0u);
+        Adjacency edges;
+        Adjacency positionEdges;
+        buildEdges(edges, m_mesh.indices, m_mesh.indexCount, identity.data(), m_vertexCount);
+        buildEdges(positionEdges, m_mesh.indices, m_mesh.indexCount, m_remap.data(), m_vertexCount);
+
+        for (uint32_t i = 0u; i + 2u < m_mesh.indexCount; i += 3u)
+        {
+            const uint32_t corners[3] = { m_mesh.indices[i], m_mesh.indices[i + 1u], m_mesh.indices[i + 2u] };
+            const Position &p0 = m_positions[corners[0]];
+            Position normal = cross(m_positions[corners[1]] - p0, m_positions[corners[2]] - p0);
+            double length = std::sqrt(dot(normal, normal));
+            if (length == 0.0)
+            {
+                continue;
+            }
+            normal = Position{ normal.x / length, normal.y / length, normal.z / length };
+
+            double area = 0.5 * length;
+            for (uint32_t corner : corners)
+            {
+                addPlane(m_quadrics[m_remap[corner]], normal, -dot(normal, p0), area);
+            }
+
+            // Planes through open edges at right angles to the triangle keep borders and seams in place
+            for (uint32_t e = 0u; e < 3u; ++e)
+            {
+                uint32_t a = corners[e];
+                uint32_t b = corners[(e + 1u) % 3u];
+                if (hasEdge(edges, identity.data(), b, a))
+                {
+                    continue;
+                }
+
+                Position edge = m_positions[b] - m_positions[a];
+                Position edgeNormal = cross(edge, normal);
+                double edgeLength = std::sqrt(dot(edgeNormal, edgeNormal));
+                if (edgeLength == 0.0)
+                {
+                    continue;
+                }
+                edgeNormal = Position{ edgeNormal.x / edgeLength, edgeNormal.y / edgeLength, edgeNormal.z / edgeLength };
+
+                bool border = !hasEdge(positionEdges, m_remap.data(), m_remap[b], m_remap[a]);
+                double weight = dot(edge, edge) * (border ? BorderWeight : SeamWeight);
+                double distance = -dot(edgeNormal, m_positions[a]);
+                addPlane(m_quadrics[m_remap[a]], edgeNormal, distance, weight);
+                addPlane(m_quadrics[m_remap[b]], edgeNormal, distance, weight);
+            }
+        }
+    }
+
+    // The vertex the other half of a seam collapses onto, None when the seam does not continue to 'to'
+    uint32_t Simplifier::getSeamTarget(uint32_t from, uint32_t to) const
+    {
+        uint32_t sibling = m_wedge[from];
+        if (m_loop[sibling] != None && m_remap[m_loop[sibling]] == m_remap[to])
+        {
+            return m_loop[sibling];
+        }
+        if (m_loopBack[sibling] != None && m_remap[m_loopBack[sibling]] == m_remap[to])
+        {
+            return m_loopBack[sibling];
+        }
+        return None;
+    }
+
+    bool Simplifier::canCollapse(uint32_t from, uint32_t to) const
+    {
+        switch (m_kinds[from])
+        {
+        case VertexKind::Manifold:
+            return true;
+        case VertexKind::Border:
+            return m_kinds[to] == VertexKind::Border && (m_loop[from] == to || m_loopBack[from] == to);
+        case VertexKind::Seam:
+            return m_kinds[to] == VertexKind::Seam && (m_loop[from] == to || m_loopBack[from] == to) && getSeamTarget(from, to) != None;
+        default:
+            return false;
+        }
+    }
+
+    // True if moving 'from' onto 'to' turns any remaining triangle around
+    bool Simplifier::hasFlips(uint32_t from, uint32_t to, const std::vector<uint32_t> &indices) const
+    {
+        const Position &target = m_positions[to];
+        uint32_t vertex = from;
+        do
+        {
+            for (uint32_t t = m_triangles.begin(vertex); t < m_triangles.end(vertex); ++t)
+            {
+                uint32_t triangle = m_triangles.items[t];
+                uint32_t corners[3];
+                bool collapses = false;
+                for (uint32_t c = 0u; c < 3u; ++c)
+                {
+                    corners[c] = m_collapseRemap[indices[triangle * 3u + c]];
+                    collapses |= m_remap[corners[c]] == m_remap[to];
+                }
+                if (collapses)
+                {
+                    continue;
+                }
+
+                Position before[3];
+                Position after[3];
+                for (uint32_t c = 0u; c < 3u; ++c)
+                {
+                    before[c] = m_positions[corners[c]];
+                    after[c] = m_remap[corners[c]] == m_remap[from] ? target : before[c];
+                }
+                Position normalBefore = cross(before[1] - before[0], before[2] - before[0]);
+                Position normalAfter = cross(after[1] - after[0], after[2] - after[0]);
+                if (dot(normalBefore, normalAfter) <= 0.0)
+                {
+                    return true;
+                }
+            }
+            vertex = m_wedge[vertex];
+        } while (vertex != from);
+
+        return false;
+    }
+
+    uint32_t Simplifier::countRemovedTriangles(uint32_t from, uint32_t to, const std::vector<uint32_t> &indices) const
+    {
+        uint32_t removed = 0u;
+        uint32_t vertex = from;
+        do
+        {
+            for (uint32_t t = m_triangles.begin(vertex); t < m_triangles.end(vertex); ++t)
+            {
+                uint32_t triangle = m_triangles.items[t];
+                for (uint32_t c = 0u; c < 3u; ++c)
+                {
+                    if (m_remap[m_collapseRemap[indices[triangle * 3u + c]]] == m_remap[to])
+                    {
+                        ++removed;
+                        break;
+                    }
+                }
+            }
+            vertex = m_wedge[vertex];
+        } while (vertex != from);
+
+        return removed;
+    }
+
+    double Simplifier::run(uint32_t targetIndexCount, double maxError, std::vector<uint32_t> &indices)
+    {
+        indices.assign(m_mesh.indices, m_mesh.indices + m_mesh.indexCount);
+
+        m_collapseRemap.resize(m_vertexCount);
+        std::iota(m_collapseRemap.begin(), m_collapseRemap.end(), 0u);
+        std::vector<uint8_t> touched(m_vertexCount, 0u);
+        std::vector<Collapse> collapses;
+
+        double maxErrorSquared = maxError * maxError;
+        double resultError = 0.0;
+        while (indices.size() > targetIndexCount)
+        {
+            buildTriangles(m_triangles, indices, m_vertexCount);
+
+            // Every edge is seen from both of its triangles, the second copy is skipped below
+            // because its vertices are already touched
+            collapses.clear();
+            for (size_t i = 0u; i < indices.size(); i += 3u)
+            {
+                for (uint32_t e = 0u; e < 3u; ++e)
+                {
+                    uint32_t a = indices[i + e];
+                    uint32_t b = indices[i + (e + 1u) % 3u];
+                    if (m_remap[a] == m_remap[b])
+                    {
+                        continue;
+                    }
+
+                    double errorAB = canCollapse(a, b) ? evaluate(m_quadrics[m_remap[a]], m_positions[b]) : -1.0;
+                    double errorBA = canCollapse(b, a) ? evaluate(m_quadrics[m_remap[b]], m_positions[a]) : -1.0;
+                    if (errorAB >= 0.0 && (errorBA < 0.0 || errorAB <= errorBA))
+                    {
+                        collapses.push_back(Collapse{ a, b, errorAB });
+                    }
+                    else if (errorBA >= 0.0)
+                    {
+                        collapses.push_back(Collapse{ b, a, errorBA });
+                    }
+                }
+            }
+            std::sort(collapses.begin(), collapses.end(), [](const Collapse &a, const Collapse &b) { return a.error < b.error; });
+
+            uint32_t trianglesToRemove = static_cast<uint32_t>((indices.size() - targetIndexCount + 2u) / 3u);
+            uint32_t trianglesRemoved = 0u;
+            uint32_t collapsed = 0u;
+            for (const Collapse &collapse : collapses)
+            {
+                if (collapse.error > maxErrorSquared || trianglesRemoved >= trianglesToRemove)
+                {
+                    break;
+                }
+
+                uint32_t fromPosition = m_remap[collapse.from];
+                uint32_t toPosition = m_remap[collapse.to];
+                if (touched[fromPosition] || touched[toPosition] || hasFlips(collapse.from, collapse.to, indices))
+                {
+                    continue;
+                }
+
+                trianglesRemoved += countRemovedTriangles(collapse.from, collapse.to, indices);
+
+                m_collapseRemap[collapse.from] = collapse.to;
+                if (m_kinds[collapse.from] == VertexKind::Seam)
+                {
+                    m_collapseRemap[m_wedge[collapse.from]] = getSeamTarget(collapse.from, collapse.to);
+                }
+
+                addQuadric(m_quadrics[toPosition], m_quadrics[fromPosition]);
+                touched[fromPosition] = 1u;
+                touched[toPosition] = 1u;
+                resultError = (std::max)(resultError, collapse.error);
+                ++collapsed;
+            }
+
+            if (collapsed == 0u)
+            {
+                break;
+            }
+
+            // Follow the collapses through the border and seam loops
+            for (uint32_t v = 0u; v < m_vertexCount; ++v)
+            {
+                uint32_t next = m_loop[v];
+                if (next != None)
+                {
+                    uint32_t remapped = m_collapseRemap[next];
+                    m_loop[v] = remapped != v ? remapped : (m_loop[next] != None ? m_collapseRemap[m_loop[next]] : None);
+                }
+                uint32_t previous = m_loopBack[v];
+                if (previous != None)
+                {
+                    uint32_t remapped = m_collapseRemap[previous];
+                    m_loopBack[v] = remapped != v ? remapped : (m_loopBack[previous] != None ? m_collapseRemap[m_loopBack[previous]] : None);
+                }
+            }
+
+            // Apply the collapses and drop the triangles that closed up
+            size_t written = 0u;
+            for (size_t i = 0u; i < indices.size(); i += 3u)
+            {
+                uint32_t a = m_collapseRemap[indices[i]];
+                uint32_t b = m_collapseRemap[indices[i + 1u]];
+                uint32_t c = m_collapseRemap[indices[i + 2u]];
+                if (m_remap[a] == m_remap[b] || m_remap[b] == m_remap[c] || m_remap[a] == m_remap[c])
+                {
+                    continue;
+                }
+                indices[written++] = a;
+                indices[written++] = b;
+                indices[written++] = c;
+            }
+            indices.resize(written);
+
+            std::iota(m_collapseRemap.begin(), m_collapseRemap.end(), 0u);
+            std::fill(touched.begin(), touched.end(), uint8_t(0u));
+        }
+
+        return std::sqrt(resultError);
+    }
+}
+
+float simplifyMesh(const SimplifyMesh &mesh, uint32_t targetIndexCount, float maxError, std::vector<uint32_t> &indices)
+{
+    Simplifier simplifier(mesh);
+    return static_cast<float>(simplifier.run(targetIndexCount - targetIndexCount % 3u, maxError, indices));
+}
+
+float getMeshRadius(const SimplifyMesh &mesh)
+{
+    float minimum[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float maximum[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for (uint32_t i = 0u; i < mesh.indexCount; ++i)
+    {
+        const float *position = reinterpret_cast<const float *>(reinterpret_cast<const uint8_t *>(mesh.positions) + size_t(mesh.indices[i]) * mesh.vertexStride);
+        for (uint32_t axis = 0u; axis < 3u; ++axis)
+        {
+            minimum[axis] = (std::min)(minimum[axis], position[axis]);
+            maximum[axis] = (std::max)(maximum[axis], position[axis]);
+        }
+    }
+    if (mesh.indexCount == 0u)
+    {
+        return 0.0f;
+    }
+
+    float extent[3] = { maximum[0] - minimum[0], maximum[1] - minimum[1], maximum[2] - minimum[2] };
+    return 0.5f * std::sqrt(extent[0] * extent[0] + extent[1] * extent[1] + extent[2] * extent[2]);
+}
+
+void buildLodChain(const SimplifyMesh &mesh, const LodChainSettings &settings, WorkerPool *workerPool, LodChain &chain)
+{
+    chain.indices.assign(mesh.indices, mesh.indices + mesh.indexCount);
+    chain.levels.assign(1u, LodLevel{ 0u, mesh.indexCount, 0.0f });
+
+    uint32_t simplifiedCount = settings.maxLevels > 1u ? settings.maxLevels - 1u : 0u;
+    std::vector<std::vector<uint32_t>> levelIndices(simplifiedCount);
+    std::vector<float> levelErrors(simplifiedCount, 0.0f);
+
+    float maxError = settings.maxError * getMeshRadius(mesh);
+    uint32_t triangleCount = mesh.indexCount / 3u;
+    auto simplifyLevel = [&](uint32_t level)
+    {
+        uint32_t targetTriangles = static_cast<uint32_t>(triangleCount * std::pow(settings.reduction, static_cast<float>(level + 1u)));
+        levelErrors[level] = simplifyMesh(mesh, targetTriangles * 3u, maxError, levelIndices[level]);
+    };
+
+    if (workerPool != nullptr)
+    {
+        workerPool->parallelFor(simplifiedCount, simplifyLevel);
+    }
+    else
+    {
+        for (uint32_t level = 0u; level < simplifiedCount; ++level)
+        {
+            simplifyLevel(level);
+        }
+    }
+
+    // Skip levels that ran into the error limit and barely improve on the one before, and keep
+    // the errors rising so the selector can walk the chain
+    for (uint32_t level = 0u; level < simplifiedCount; ++level)
+    {
+        const LodLevel &previous = chain.levels.back();
+        const std::vector<uint32_t> &indices = levelIndices[level];
+        if (indices.empty() || indices.size() > previous.indexCount * settings.minReduction)
+        {
+            continue;
+        }
+
+        chain.levels.push_back(LodLevel{ static_cast<uint32_t>(chain.indices.size()), static_cast<uint32_t>(indices.size()), (std::max)(levelErrors[level], previous.error) });
+        chain.indices.insert(chain.indices.end(), indices.begin(), indices.end());
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+// Mesh simplification and LOD chains for indexed triangle meshes.
+// Simplification collapses edges in order of quadric error (Garland and Heckbert). Every
+// collapse moves a vertex onto one of its neighbours, so each LOD is just a new index buffer
+// over the unchanged vertex buffer. Vertices that share a position but differ in other
+// attributes (UV or normal seams) only collapse along the seam and together, open borders only
+// along the border, and anything more tangled than that stays put.
+// This file is platform independent so it can be built and profiled off Windows.
+
+#include <cstdint>
+#include <vector>
+
+class WorkerPool;
+
+// Positions are three floats at the start of every vertex, the rest of the vertex is never read
+struct SimplifyMesh
+{
+    const float *positions;
+    uint32_t vertexStride; // In bytes
+    uint32_t vertexCount;
+    const uint32_t *indices;
+    uint32_t indexCount;
+};
+
+// Collapse edges until at most targetIndexCount indices remain or the next collapse would move
+// the surface further than maxError (in object space units). Writes the new index buffer and
+// returns the error it reached.
+float simplifyMesh(const SimplifyMesh &mesh, uint32_t targetIndexCount, float maxError, std::vector<uint32_t> &indices);
+
+// Radius of the sphere around the bounds of the referenced vertices
+float getMeshRadius(const SimplifyMesh &mesh);
+
+struct LodLevel
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    float error; // Object space distance from the full detail surface
+};
+
+struct LodChainSettings
+{
+    uint32_t maxLevels = 6u;
+    float reduction = 0.5f;    // Triangle count of each level relative to the one before
+    float maxError = 0.05f;    // Largest error of any level, relative to the mesh radius
+    float minReduction = 0.8f; // Drop a level that keeps more than this share of the previous one
+};
+
+// Level 0 is the source mesh. All levels index the same vertex buffer and live back to back in
+// one index buffer.
+struct LodChain
+{
+    std::vector<uint32_t> indices;
+    std::vector<LodLevel> levels;
+};
+
+// Levels are simplified from the source mesh independently, spread over the pool when given
+void buildLodChain(const SimplifyMesh &mesh, const LodChainSettings &settings, WorkerPool *workerPool, LodChain &chain);
@@ -0,0 +1,108 @@
+#pragma once
+
+// Fixed size pool for engine objects of a single type.
+// Objects live in slabs that are only released when the pool is destroyed, so pointers stay
+// valid for the object's lifetime and creation never touches the general heap once the pool
+// has warmed up. Freed slots are kept on an intrusive free list. Not thread safe, give each
+// thread that creates objects its own pool.
+// This file is platform independent so it can be built and profiled off Windows.
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "MemoryTracker.h"
+
+template <typename T, uint32_t SlabSize = 256u>
+class ObjectPool
+{
+public:
+    explicit ObjectPool(MemoryTag tag = MemoryTag::ObjectPool)
+        : m_tag(tag)
+        , m_freeList(nullptr)
+        , m_liveCount(0u)
+    {
+    }
+
+    ~ObjectPool()
+    {
+        // Objects still alive are leaked rather than destroyed, their owners may hold pointers to them
+        assert(m_liveCount == 0u);
+
+        for (Slot *slab : m_slabs)
+        {
+            ::operator delete(slab, std::align_val_t(alignof(Slot)));
+            recordFree(m_tag, sizeof(Slot) * SlabSize);
+        }
+    }
+
+    ObjectPool(const ObjectPool &) = delete;
+    ObjectPool &operator=(const ObjectPool &) = delete;
+
+    template <typename... Args>
+    T *create(Args &&... args)
+    {
+        if (m_freeList == nullptr)
+        {
+            addSlab();
+        }
+
+        Slot *slot = m_freeList;
+        m_freeList = slot->next;
+        ++m_liveCount;
+        return new (slot->storage) T(std::forward<Args>(args)...);
+    }
+
+    void destroy(T *object)
+    {
+        if (object == nullptr)
+        {
+            return;
+        }
+
+        object->~T();
+
+        Slot *slot = reinterpret_cast<Slot *>(object);
+#if defined(_DEBUG)
+        // Make use after free obvious
+        std::memset(slot->storage, 0xDD, sizeof(slot->storage));
+#endif
+        slot->next = m_freeList;
+        m_freeList = slot;
+        --m_liveCount;
+    }
+
+    uint32_t getLiveCount() const { return m_liveCount; }
+    uint32_t getCapacity() const { return static_cast<uint32_t>(m_slabs.size()) * SlabSize; }
+
+private:
+    union Slot
+    {
+        Slot *next;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    void addSlab()
+    {
+        Slot *slab = static_cast<Slot *>(::operator new(sizeof(Slot) * SlabSize, std::align_val_t(alignof(Slot))));
+        recordAllocation(m_tag, sizeof(Slot) * SlabSize);
+        m_slabs.push_back(slab);
+
+        // Thread the new slots onto the free list in address order
+        for (uint32_t i = 0u; i + 1u < SlabSize; ++i)
+        {
+            slab[i].next = &slab[i + 1u];
+        }
+        slab[SlabSize - 1u].next = m_freeList;
+        m_freeList = slab;
+    }
+
+    MemoryTag m_tag;
+    std::vector<Slot *> m_slabs;
+    Slot *m_freeList;
+    uint32_t m_liveCount;
+};
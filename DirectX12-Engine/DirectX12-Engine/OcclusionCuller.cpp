@@ -0,0 +1,406 @@
+#include "OcclusionCuller.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "WorkerPool.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define OCCLUSION_CULLER_AVX2
+#elif defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define OCCLUSION_CULLER_SSE2
+#endif
+
+namespace
+{
+    // Vertices closer than this in w are treated as crossing the near plane
+    const float MinimumW = 1e-5f;
+
+    // Degenerate triangles are not worth rasterizing
+    const float MinimumArea = 1e-6f;
+
+    // Rasterize TileWidth pixels of a row starting at x, keeping the nearest depth inside the triangle.
+    // Pixel centres on an edge follow the top-left fill rule, so triangles sharing an edge leave no gap.
+    inline void rasterizeSpan(float *row, int x, float py,
+        const float *edgeA, const float *edgeB, const float *edgeC, const bool *topLeft,
+        float depthA, float depthB, float depthC, float maxDepth)
+    {
+        const float px = static_cast<float>(x) + 0.5f;
+
+#if defined(OCCLUSION_CULLER_AVX2)
+        const __m256 laneOffsets = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+        const __m256 pxs = _mm256_add_ps(_mm256_set1_ps(px), laneOffsets);
+        const __m256 zero = _mm256_setzero_ps();
+
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (int i = 0; i < 3; ++i)
+        {
+            const float rowTerm = edgeB[i] * py + edgeC[i];
+            const __m256 e = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(edgeA[i]), pxs), _mm256_set1_ps(rowTerm));
+            const __m256 covered = topLeft[i] ? _mm256_cmp_ps(e, zero, _CMP_GE_OQ) : _mm256_cmp_ps(e, zero, _CMP_GT_OQ);
+            inside = _mm256_and_ps(inside, covered);
+        }
+
+        if (_mm256_movemask_ps(inside) == 0)
+        {
+            return;
+        }
+
+        __m256 depth = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(depthA), pxs), _mm256_set1_ps(depthB * py + depthC));
+        depth = _mm256_min_ps(depth, _mm256_set1_ps(maxDepth));
+
+        const __m256 current = _mm256_loadu_ps(row + x);
+        _mm256_storeu_ps(row + x, _mm256_blendv_ps(current, _mm256_min_ps(current, depth), inside));
+#elif defined(OCCLUSION_CULLER_SSE2)
+        const __m128 laneOffsets = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+        const __m128 zero = _mm_setzero_ps();
+
+        for (int half = 0; half < 2; ++half)
+        {
+            const __m128 pxs = _mm_add_ps(_mm_set1_ps(px + 4.0f * half), laneOffsets);
+
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (int i = 0; i < 3; ++i)
+            {
+                const float rowTerm = edgeB[i] * py + edgeC[i];
+                const __m128 e = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edgeA[i]), pxs), _mm_set1_ps(rowTerm));
+                const __m128 covered = topLeft[i] ? _mm_cmpge_ps(e, zero) : _mm_cmpgt_ps(e, zero);
+                inside = _mm_and_ps(inside, covered);
+            }
+
+            if (_mm_movemask_ps(inside) == 0)
+            {
+                continue;
+            }
+
+            __m128 depth = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(depthA), pxs), _mm_set1_ps(depthB * py + depthC));
+            depth = _mm_min_ps(depth, _mm_set1_ps(maxDepth));
+
+            float *dst = row + x + 4 * half;
+            const __m128 current = _mm_loadu_ps(dst);
+            const __m128 nearest = _mm_min_ps(current, depth);
+
+            // SSE2 has no blendv so select with masks
+            _mm_storeu_ps(dst, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, current)));
+        }
+#else
+        for (uint32_t lane = 0u; lane < OcclusionCuller::TileWidth; ++lane)
+        {
+            const float lx = px + static_cast<float>(lane);
+            bool inside = true;
+            for (int i = 0; i < 3; ++i)
+            {
+                const float e = edgeA[i] * lx + edgeB[i] * py + edgeC[i];
+                inside = inside && (topLeft[i] ? e >= 0.0f : e > 0.0f);
+            }
+
+            if (inside)
+            {
+                const float depth = std::min(depthA * lx + depthB * py + depthC, maxDepth);
+                row[x + lane] = std::min(row[x + lane], depth);
+            }
+        }
+#endif
+    }
+}
+
+OcclusionCuller::OcclusionCuller(uint32_t width, uint32_t height, WorkerPool *workerPool)
+    : m_workerPool(workerPool)
+    , m_occluderTriangles(0u)
+    , m_rasterizedTriangles(0u)
+    , m_testedObjects(0u)
+    , m_culledObjects(0u)
+{
+    m_tilesX = std::max((width + TileWidth - 1u) / TileWidth, 1u);
+    m_tilesY = std::max((height + TileHeight - 1u) / TileHeight, 1u);
+    m_width = m_tilesX * TileWidth;
+    m_height = m_tilesY * TileHeight;
+
+    // Use a couple of bands per thread so uneven occluder coverage still balances
+    const uint32_t threadCount = m_workerPool ? m_workerPool->getThreadCount() : 1u;
+    const uint32_t targetBands = std::min(threadCount * 2u, m_tilesY);
+    m_tileRowsPerBand = (m_tilesY + targetBands - 1u) / targetBands;
+    m_bandCount = (m_tilesY + m_tileRowsPerBand - 1u) / m_tileRowsPerBand;
+
+    m_depth.resize(static_cast<size_t>(m_width) * m_height);
+    m_tileMaxDepth.resize(static_cast<size_t>(m_tilesX) * m_tilesY);
+
+    clear();
+}
+
+void OcclusionCuller::clear()
+{
+    std::fill(m_depth.begin(), m_depth.end(), 1.0f);
+    std::fill(m_tileMaxDepth.begin(), m_tileMaxDepth.end(), 1.0f);
+}
+
+void OcclusionCuller::renderOccluders(const float *clipVertices, const uint32_t *indices, uint32_t triangleCount)
+{
+    m_occluderTriangles += triangleCount;
+
+    // Transform to screen space and set up edge and depth equations
+    m_triangles.clear();
+    m_triangles.reserve(triangleCount);
+
+    const float halfWidth = 0.5f * static_cast<float>(m_width);
+    const float halfHeight = 0.5f * static_cast<float>(m_height);
+
+    for (uint32_t t = 0u; t < triangleCount; ++t)
+    {
+        float x[3];
+        float y[3];
+        float z[3];
+        bool clipped = false;
+
+        for (uint32_t v = 0u; v < 3u; ++v)
+        {
+            const float *vertex = clipVertices + 4u * indices[3u * t + v];
+            if (vertex[3] < MinimumW)
+            {
+                clipped = true;
+                break;
+            }
+
+            const float invW = 1.0f / vertex[3];
+            x[v] = (vertex[0] * invW + 1.0f) * halfWidth;
+            y[v] = (1.0f - vertex[1] * invW) * halfHeight;
+            z[v] = vertex[2] * invW;
+
+            if (z[v] < 0.0f)
+            {
+                clipped = true;
+                break;
+            }
+        }
+
+        if (clipped)
+        {
+            continue;
+        }
+
+        const float area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+        if (std::fabs(area) < MinimumArea)
+        {
+            continue;
+        }
+
+        ScreenTriangle triangle;
+
+        // Occluders are double sided, flip the edges so the inside is always positive
+        const float orientation = area > 0.0f ? 1.0f : -1.0f;
+        for (int i = 0; i < 3; ++i)
+        {
+            const int a = (i + 1) % 3;
+            const int b = (i + 2) % 3;
+            triangle.edgeA[i] = orientation * (y[a] - y[b]);
+            triangle.edgeB[i] = orientation * (x[b] - x[a]);
+            triangle.edgeC[i] = orientation * (x[a] * y[b] - y[a] * x[b]);
+
+            // With y pointing down the inside is right of a left edge and below a top edge
+            triangle.topLeft[i] = triangle.edgeA[i] > 0.0f || (triangle.edgeA[i] == 0.0f && triangle.edgeB[i] > 0.0f);
+        }
+
+        triangle.depthA = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) / area;
+        triangle.depthB = ((z[2] - z[0]) * (x[1] - x[0]) - (z[1] - z[0]) * (x[2] - x[0])) / area;
+        triangle.depthC = z[0] - triangle.depthA * x[0] - triangle.depthB * y[0];
+        triangle.maxDepth = std::max(z[0], std::max(z[1], z[2]));
+
+        triangle.minX = std::max(static_cast<int>(std::floor(std::min(x[0], std::min(x[1], x[2])))), 0);
+        triangle.minY = std::max(static_cast<int>(std::floor(std::min(y[0], std::min(y[1], y[2])))), 0);
+        triangle.maxX = std::min(static_cast<int>(std::ceil(std::max(x[0], std::max(x[1], x[2])))), static_cast<int>(m_width) - 1);
+        triangle.maxY = std::min(static_cast<int>(std::ceil(std::max(y[0], std::max(y[1], y[2])))), static_cast<int>(m_height) - 1);
+
+        if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+        {
+            continue;
+        }
+
+        m_triangles.push_back(triangle);
+    }
+
+    m_rasterizedTriangles += m_triangles.size();
+
+    if (m_workerPool)
+    {
+        m_workerPool->parallelFor(m_bandCount, [this](uint32_t band) { rasterizeBand(band); });
+    }
+    else
+    {
+        for (uint32_t band = 0u; band < m_bandCount; ++band)
+        {
+            rasterizeBand(band);
+        }
+    }
+}
+
+void OcclusionCuller::rasterizeBand(uint32_t band)
+{
+    const uint32_t tileRowBegin = band * m_tileRowsPerBand;
+    const uint32_t tileRowEnd = std::min(tileRowBegin + m_tileRowsPerBand, m_tilesY);
+
+    const int bandMinY = static_cast<int>(tileRowBegin * TileHeight);
+    const int bandMaxY = static_cast<int>(tileRowEnd * TileHeight) - 1;
+
+    for (const ScreenTriangle &triangle : m_triangles)
+    {
+        if (triangle.maxY >= bandMinY && triangle.minY <= bandMaxY)
+        {
+            rasterizeTriangle(triangle, bandMinY, bandMaxY);
+        }
+    }
+
+    updateHiZ(tileRowBegin, tileRowEnd);
+}
+
+void OcclusionCuller::rasterizeTriangle(const ScreenTriangle &triangle, int bandMinY, int bandMaxY)
+{
+    const int minY = std::max(triangle.minY, bandMinY);
+    const int maxY = std::min(triangle.maxY, bandMaxY);
+
+    // Spans always start on a tile boundary so a SIMD row never leaves the buffer
+    const int minX = triangle.minX & ~static_cast<int>(TileWidth - 1u);
+
+    for (int y = minY; y <= maxY; ++y)
+    {
+        float *row = m_depth.data() + static_cast<size_t>(y) * m_width;
+        const float py = static_cast<float>(y) + 0.5f;
+
+        for (int x = minX; x <= triangle.maxX; x += TileWidth)
+        {
+            rasterizeSpan(row, x, py,
+                triangle.edgeA, triangle.edgeB, triangle.edgeC, triangle.topLeft,
+                triangle.depthA, triangle.depthB, triangle.depthC, triangle.maxDepth);
+        }
+    }
+}
+
+void OcclusionCuller::updateHiZ(uint32_t tileRowBegin, uint32_t tileRowEnd)
+{
+    for (uint32_t tileY = tileRowBegin; tileY < tileRowEnd; ++tileY)
+    {
+        for (uint32_t tileX = 0u; tileX < m_tilesX; ++tileX)
+        {
+            float maxDepth = 0.0f;
+            for (uint32_t y = 0u; y < TileHeight; ++y)
+            {
+                const float *row = m_depth.data() + static_cast<size_t>(tileY * TileHeight + y) * m_width + tileX * TileWidth;
+                for (uint32_t x = 0u; x < TileWidth; ++x)
+                {
+                    maxDepth = std::max(maxDepth, row[x]);
+                }
+            }
+            m_tileMaxDepth[tileY * m_tilesX + tileX] = maxDepth;
+        }
+    }
+}
+
+bool OcclusionCuller::testRect(float ndcMinX, float ndcMinY, float ndcMaxX, float ndcMaxY, float nearestDepth)
+{
+    ++m_testedObjects;
+
+    const float halfWidth = 0.5f * static_cast<float>(m_width);
+    const float halfHeight = 0.5f * static_cast<float>(m_height);
+
+    const float left = (ndcMinX + 1.0f) * halfWidth;
+    const float right = (ndcMaxX + 1.0f) * halfWidth;
+    const float top = (1.0f - ndcMaxY) * halfHeight;
+    const float bottom = (1.0f - ndcMinY) * halfHeight;
+
+    // Entirely off screen
+    if (right < 0.0f || bottom < 0.0f || left >= static_cast<float>(m_width) || top >= static_cast<float>(m_height))
+    {
+        ++m_culledObjects;
+        return false;
+    }
+
+    // Anything reaching in front of the near plane can not be hidden
+    if (nearestDepth <= 0.0f)
+    {
+        return true;
+    }
+
+    const int maxTileX = static_cast<int>(m_tilesX) - 1;
+    const int maxTileY = static_cast<int>(m_tilesY) - 1;
+    const int tileMinX = std::clamp(static_cast<int>(std::floor(left)) / static_cast<int>(TileWidth), 0, maxTileX);
+    const int tileMaxX = std::clamp(static_cast<int>(std::floor(right)) / static_cast<int>(TileWidth), 0, maxTileX);
+    const int tileMinY = std::clamp(static_cast<int>(std::floor(top)) / static_cast<int>(TileHeight), 0, maxTileY);
+    const int tileMaxY = std::clamp(static_cast<int>(std::floor(bottom)) / static_cast<int>(TileHeight), 0, maxTileY);
+
+    for (int tileY = tileMinY; tileY <= tileMaxY; ++tileY)
+    {
+        const float *tileRow = m_tileMaxDepth.data() + static_cast<size_t>(tileY) * m_tilesX;
+        for (int tileX = tileMinX; tileX <= tileMaxX; ++tileX)
+        {
+            if (tileRow[tileX] > nearestDepth)
+            {
+                return true;
+            }
+        }
+    }
+
+    ++m_culledObjects;
+    return false;
+}
+
+bool OcclusionCuller::testAabb(const float *clipCorners)
+{
+    float minX = 1.0f;
+    float minY = 1.0f;
+    float maxX = -1.0f;
+    float maxY = -1.0f;
+    float minZ = 1.0f;
+
+    for (uint32_t i = 0u; i < 8u; ++i)
+    {
+        const float *corner = clipCorners + 4u * i;
+
+        // The box straddles the camera plane, treat it as visible
+        if (corner[3] < MinimumW)
+        {
+            ++m_testedObjects;
+            return true;
+        }
+
+        const float invW = 1.0f / corner[3];
+        const float x = corner[0] * invW;
+        const float y = corner[1] * invW;
+        const float z = corner[2] * invW;
+
+        if (i == 0u)
+        {
+            minX = maxX = x;
+            minY = maxY = y;
+            minZ = z;
+        }
+        else
+        {
+            minX = std::min(minX, x);
+            maxX = std::max(maxX, x);
+            minY = std::min(minY, y);
+            maxY = std::max(maxY, y);
+            minZ = std::min(minZ, z);
+        }
+    }
+
+    return testRect(minX, minY, maxX, maxY, minZ);
+}
+
+OcclusionCuller::Stats OcclusionCuller::getStats() const
+{
+    Stats stats;
+    stats.occluderTriangles = m_occluderTriangles.load();
+    stats.rasterizedTriangles = m_rasterizedTriangles.load();
+    stats.testedObjects = m_testedObjects.load();
+    stats.culledObjects = m_culledObjects.load();
+    return stats;
+}
+
+void OcclusionCuller::resetStats()
+{
+    m_occluderTriangles = 0u;
+    m_rasterizedTriangles = 0u;
+    m_testedObjects = 0u;
+    m_culledObjects = 0u;
+}
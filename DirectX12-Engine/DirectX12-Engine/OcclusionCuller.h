@@ -0,0 +1,102 @@
+#pragma once
+
+// CPU occlusion culling in the style of masked software occlusion culling.
+// A handful of large occluder triangles are rasterized into a low resolution depth
+// buffer with SIMD (AVX2 / SSE2 / scalar), a hierarchical tile level keeps the farthest
+// depth of each tile, and object bounds are tested against that tile level before
+// they are submitted for drawing. Rasterization is split into horizontal bands of
+// tiles that run on the worker pool.
+//
+// Conventions follow D3D: clip space vertices are (x, y, z, w), depth is in [0, 1]
+// and a smaller depth is closer to the camera.
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+class WorkerPool;
+
+class OcclusionCuller
+{
+public:
+    // Each SIMD row of the rasterizer covers a full tile row
+    static const uint32_t TileWidth = 8u;
+    static const uint32_t TileHeight = 8u;
+
+    struct Stats
+    {
+        uint64_t occluderTriangles;   // Triangles submitted as occluders
+        uint64_t rasterizedTriangles; // Triangles that survived setup and were rasterized
+        uint64_t testedObjects;
+        uint64_t culledObjects;
+    };
+
+    // The buffer size is rounded up to a whole number of tiles. The worker pool is optional.
+    OcclusionCuller(uint32_t width, uint32_t height, WorkerPool *workerPool = nullptr);
+
+    // Reset the depth buffer to the far plane, must be called once per frame before rendering occluders
+    void clear();
+
+    // Rasterize indexed occluder triangles. Vertices are clip space float4s.
+    // Triangles that cross the near plane are skipped, which keeps the result conservative.
+    void renderOccluders(const float *clipVertices, const uint32_t *indices, uint32_t triangleCount);
+
+    // Returns false if the screen rectangle (in normalized device coordinates) is hidden
+    // behind the occluders at the given nearest depth.
+    bool testRect(float ndcMinX, float ndcMinY, float ndcMaxX, float ndcMaxY, float nearestDepth);
+
+    // Returns false if the bounding box given by its eight clip space corners (float4 each) is hidden
+    bool testAabb(const float *clipCorners);
+
+    Stats getStats() const;
+    void resetStats();
+
+    uint32_t getWidth() const { return m_width; }
+    uint32_t getHeight() const { return m_height; }
+
+    // Per pixel depth, for debug visualization
+    const float *getDepthBuffer() const { return m_depth.data(); }
+
+private:
+    struct ScreenTriangle
+    {
+        // Edge functions, positive inside the triangle
+        float edgeA[3];
+        float edgeB[3];
+        float edgeC[3];
+        bool topLeft[3]; // Top and left edges own the pixel centres exactly on them
+
+        // Depth plane
+        float depthA;
+        float depthB;
+        float depthC;
+        float maxDepth;
+
+        int minX;
+        int minY;
+        int maxX;
+        int maxY;
+    };
+
+    void rasterizeBand(uint32_t band);
+    void rasterizeTriangle(const ScreenTriangle &triangle, int bandMinY, int bandMaxY);
+    void updateHiZ(uint32_t tileRowBegin, uint32_t tileRowEnd);
+
+    uint32_t m_width;
+    uint32_t m_height;
+    uint32_t m_tilesX;
+    uint32_t m_tilesY;
+    uint32_t m_tileRowsPerBand;
+    uint32_t m_bandCount;
+
+    WorkerPool *m_workerPool;
+
+    std::vector<float> m_depth;
+    std::vector<float> m_tileMaxDepth;
+    std::vector<ScreenTriangle> m_triangles;
+
+    std::atomic<uint64_t> m_occluderTriangles;
+    std::atomic<uint64_t> m_rasterizedTriangles;
+    std::atomic<uint64_t> m_testedObjects;
+    std::atomic<uint64_t> m_culledObjects;
+};
@@ -0,0 +1,340 @@
+#include "ParticleSimulation.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+
+#include "WorkerPool.h"
+
+namespace
+{
+    // Particles per worker task, a multiple of every lane count
+    const uint32_t BatchSize = 4096u;
+
+    // The widest lane count, streams are padded to it so the last batch needs no scalar tail
+    const uint32_t StreamPadding = 8u;
+
+#if defined(VECTOR_MATH_AVX2)
+    typedef __m256 Lanes;
+    const uint32_t LaneCount = 8u;
+
+    inline Lanes load(const float *source) { return _mm256_loadu_ps(source); }
+    inline void store(float *destination, Lanes value) { _mm256_storeu_ps(destination, value); }
+    inline Lanes splat(float value) { return _mm256_set1_ps(value); }
+    inline Lanes add(Lanes a, Lanes b) { return _mm256_add_ps(a, b); }
+    inline Lanes multiply(Lanes a, Lanes b) { return _mm256_mul_ps(a, b); }
+    inline Lanes lessThan(Lanes a, Lanes b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    inline Lanes select(Lanes mask, Lanes a, Lanes b) { return _mm256_blendv_ps(b, a, mask); }
+    inline uint32_t getMask(Lanes mask) { return static_cast<uint32_t>(_mm256_movemask_ps(mask)); }
+#elif defined(VECTOR_MATH_SSE)
+    typedef __m128 Lanes;
+    const uint32_t LaneCount = 4u;
+
+    inline Lanes load(const float *source) { return _mm_loadu_ps(source); }
+    inline void store(float *destination, Lanes value) { _mm_storeu_ps(destination, value); }
+    inline Lanes splat(float value) { return _mm_set1_ps(value); }
+    inline Lanes add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+    inline Lanes multiply(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+    inline Lanes lessThan(Lanes a, Lanes b) { return _mm_cmplt_ps(a, b); }
+    inline Lanes select(Lanes mask, Lanes a, Lanes b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+    inline uint32_t getMask(Lanes mask) { return static_cast<uint32_t>(_mm_movemask_ps(mask)); }
+#elif defined(VECTOR_MATH_NEON)
+    typedef float32x4_t Lanes;
+    const uint32_t LaneCount = 4u;
+
+    inline Lanes load(const float *source) { return vld1q_f32(source); }
+    inline void store(float *destination, Lanes value) { vst1q_f32(destination, value); }
+    inline Lanes splat(float value) { return vdupq_n_f32(value); }
+    inline Lanes add(Lanes a, Lanes b) { return vaddq_f32(a, b); }
+    inline Lanes multiply(Lanes a, Lanes b) { return vmulq_f32(a, b); }
+    inline Lanes lessThan(Lanes a, Lanes b) { return vreinterpretq_f32_u32(vcltq_f32(a, b)); }
+    inline Lanes select(Lanes mask, Lanes a, Lanes b) { return vbslq_f32(vreinterpretq_u32_f32(mask), a, b); }
+    inline uint32_t getMask(Lanes mask)
+    {
+        const uint32_t laneBits[4] = { 1u, 2u, 4u, 8u };
+        uint32x4_t bits = vandq_u32(vreinterpretq_u32_f32(mask), vld1q_u32(laneBits));
+        return vgetq_lane_u32(bits, 0) | vgetq_lane_u32(bits, 1) | vgetq_lane_u32(bits, 2) | vgetq_lane_u32(bits, 3);
+    }
+#else
+    typedef float Lanes;
+    const uint32_t LaneCount = 1u;
+
+    inline Lanes load(const float *source) { return *source; }
+    inline void store(float *destination, Lanes value) { *destination = value; }
+    inline Lanes splat(float value) { return value; }
+    inline Lanes add(Lanes a, Lanes b) { return a + b; }
+    inline Lanes multiply(Lanes a, Lanes b) { return a * b; }
+    inline Lanes lessThan(Lanes a, Lanes b) { return a < b ? 1.0f : 0.0f; }
+    inline Lanes select(Lanes mask, Lanes a, Lanes b) { return mask != 0.0f ? a : b; }
+    inline uint32_t getMask(Lanes mask) { return mask != 0.0f ? 1u : 0u; }
+#endif
+
+    static_assert(BatchSize % LaneCount == 0u && StreamPadding % LaneCount == 0u, "Batches must hold whole lanes");
+
+    void runBatches(WorkerPool *workerPool, uint32_t count, const std::function<void(uint32_t)> &func)
+    {
+        if (workerPool != nullptr && count > 1u)
+        {
+            workerPool->parallelFor(count, func);
+            return;
+        }
+        for (uint32_t i = 0u; i < count; ++i)
+        {
+            func(i);
+        }
+    }
+}
+
+ParticleFrameConstants makeParticleFrameConstants(const ParticleEmitterSettings &settings, float deltaTime, uint32_t capacity, float &emitCarry)
+{
+    const float emitterPosition[3] = { settings.position.x, settings.position.y, settings.position.z };
+    const float emitterExtent[3] = { settings.extent.x, settings.extent.y, settings.extent.z };
+    const float velocity[3] = { settings.velocity.x, settings.velocity.y, settings.velocity.z };
+    const float velocitySpread[3] = { settings.velocitySpread.x, settings.velocitySpread.y, settings.velocitySpread.z };
+    const float gravity[3] = { settings.gravity.x, settings.gravity.y, settings.gravity.z };
+
+    ParticleFrameConstants constants;
+    for (uint32_t axis = 0u; axis < 3u; ++axis)
+    {
+        constants.emitterPosition[axis] = emitterPosition[axis];
+        constants.emitterExtent[axis] = emitterExtent[axis];
+        constants.velocity[axis] = velocity[axis];
+        constants.velocitySpread[axis] = velocitySpread[axis];
+        constants.gravityStep[axis] = gravity[axis] * deltaTime;
+    }
+    constants.minLifetime = settings.minLifetime;
+    constants.lifetimeRange = settings.lifetimeRange;
+    constants.deltaTime = deltaTime;
+    constants.dragFactor = (std::max)(1.0f - settings.drag * deltaTime, 0.0f);
+    constants.floorHeight = settings.floorHeight;
+    constants.bounceFactor = -settings.restitution;
+
+    const float wanted = settings.emitRate * deltaTime + emitCarry;
+    constants.emitCount = static_cast<uint32_t>(wanted);
+    emitCarry = wanted - static_cast<float>(constants.emitCount);
+
+    constants.seed = settings.seed;
+    constants.capacity = capacity;
+    return constants;
+}
+
+uint32_t compareParticles(const ParticleState *a, uint32_t countA, const ParticleState *b, uint32_t countB)
+{
+    std::vector<ParticleState> sortedA(a, a + countA);
+    std::vector<ParticleState> sortedB(b, b + countB);
+    auto byId = [](const ParticleState &x, const ParticleState &y) { return x.id < y.id; };
+    std::sort(sortedA.begin(), sortedA.end(), byId);
+    std::sort(sortedB.begin(), sortedB.end(), byId);
+
+    // Everything but the padding
+    const size_t comparedSize = offsetof(ParticleState, padding);
+
+    uint32_t differences = 0u;
+    size_t i = 0u;
+    size_t j = 0u;
+    while (i < sortedA.size() || j < sortedB.size())
+    {
+        if (j == sortedB.size() || (i < sortedA.size() && sortedA[i].id < sortedB[j].id))
+        {
+            ++differences;
+            ++i;
+        }
+        else if (i == sortedA.size() || sortedB[j].id < sortedA[i].id)
+        {
+            ++differences;
+            ++j;
+        }
+        else
+        {
+            differences += std::memcmp(&sortedA[i], &sortedB[j], comparedSize) != 0 ? 1u : 0u;
+            ++i;
+            ++j;
+        }
+    }
+    return differences;
+}
+
+ParticleSimulation::ParticleSimulation(uint32_t capacity)
+    : m_capacity(capacity)
+    , m_aliveCount(0u)
+    , m_emittedCount(0u)
+{
+    const uint32_t paddedSize = (capacity + StreamPadding - 1u) / StreamPadding * StreamPadding;
+    resizeStreams(m_streams, paddedSize);
+    resizeStreams(m_compacted, paddedSize);
+    m_alive.resize(paddedSize);
+}
+
+void ParticleSimulation::resizeStreams(Streams &streams, uint32_t size)
+{
+    for (uint32_t axis = 0u; axis < 3u; ++axis)
+    {
+        streams.position[axis].assign(size, 0.0f);
+        streams.velocity[axis].assign(size, 0.0f);
+    }
+    streams.age.assign(size, 0.0f);
+    streams.lifetime.assign(size, 0.0f);
+    streams.id.assign(size, 0u);
+}
+
+void ParticleSimulation::clear()
+{
+    m_aliveCount = 0u;
+    m_emittedCount = 0u;
+}
+
+void ParticleSimulation::setParticle(uint32_t index, const ParticleState &particle)
+{
+    for (uint32_t axis = 0u; axis < 3u; ++axis)
+    {
+        m_streams.position[axis][index] = particle.position[axis];
+        m_streams.velocity[axis][index] = particle.velocity[axis];
+    }
+    m_streams.age[index] = particle.age;
+    m_streams.lifetime[index] = particle.lifetime;
+    m_streams.id[index] = particle.id;
+}
+
+void ParticleSimulation::emit(const ParticleFrameConstants &constants)
+{
+    // Like the GPU, emit only as many as there are dead particles to reuse
+    const uint32_t count = (std::min)(constants.emitCount, m_capacity - m_aliveCount);
+    for (uint32_t i = 0u; i < count; ++i)
+    {
+        setParticle(m_aliveCount + i, emitParticle(constants, m_emittedCount + i));
+    }
+    m_aliveCount += count;
+    m_emittedCount += count;
+}
+
+void ParticleSimulation::update(const ParticleFrameConstants &constants, WorkerPool *workerPool)
+{
+    emit(constants);
+
+    const uint32_t count = m_aliveCount;
+    const uint32_t batchCount = (count + BatchSize - 1u) / BatchSize;
+    m_batchOffsets.assign(batchCount + 1u, 0u);
+
+    // Integrate in place and count the survivors of every batch
+    runBatches(workerPool, batchCount, [this, &constants, count](uint32_t batch)
+    {
+        const uint32_t begin = batch * BatchSize;
+        const uint32_t end = (std::min)(begin + BatchSize, count);
+
+        const Lanes dragFactor = splat(constants.dragFactor);
+        const Lanes deltaTime = splat(constants.deltaTime);
+        const Lanes floorHeight = splat(constants.floorHeight);
+        const Lanes bounceFactor = splat(constants.bounceFactor);
+        const Lanes gravityStep[3] = { splat(constants.gravityStep[0]), splat(constants.gravityStep[1]), splat(constants.gravityStep[2]) };
+
+        float *position[3] = { m_streams.position[0].data(), m_streams.position[1].data(), m_streams.position[2].data() };
+        float *velocity[3] = { m_streams.velocity[0].data(), m_streams.velocity[1].data(), m_streams.velocity[2].data() };
+        float *age = m_streams.age.data();
+        const float *lifetime = m_streams.lifetime.data();
+
+        uint32_t survivors = 0u;
+        for (uint32_t i = begin; i < end; i += LaneCount)
+        {
+            // Lanes past the last alive particle only touch the padding or unused slots
+            Lanes newVelocity[3];
+            Lanes newPosition[3];
+            for (uint32_t axis = 0u; axis < 3u; ++axis)
+            {
+                newVelocity[axis] = add(multiply(load(velocity[axis] + i), dragFactor), gravityStep[axis]);
+                newPosition[axis] = add(load(position[axis] + i), multiply(newVelocity[axis], deltaTime));
+            }
+
+            const Lanes belowFloor = lessThan(newPosition[1], floorHeight);
+            newPosition[1] = select(belowFloor, floorHeight, newPosition[1]);
+            newVelocity[1] = select(belowFloor, multiply(newVelocity[1], bounceFactor), newVelocity[1]);
+
+            const Lanes newAge = add(load(age + i), deltaTime);
+            const uint32_t aliveMask = getMask(lessThan(newAge, load(lifetime + i)));
+
+            for (uint32_t axis = 0u; axis < 3u; ++axis)
+            {
+                store(velocity[axis] + i, newVelocity[axis]);
+                store(position[axis] + i, newPosition[axis]);
+            }
+            store(age + i, newAge);
+
+            const uint32_t laneEnd = (std::min)(LaneCount, end - i);
+            for (uint32_t lane = 0u; lane < laneEnd; ++lane)
+            {
+                const uint8_t alive = static_cast<uint8_t>((aliveMask >> lane) & 1u);
+                m_alive[i + lane] = alive;
+                survivors += alive;
+            }
+        }
+        m_batchOffsets[batch + 1u] = survivors;
+    });
+
+    for (uint32_t batch = 0u; batch < batchCount; ++batch)
+    {
+        m_batchOffsets[batch + 1u] += m_batchOffsets[batch];
+    }
+
+    // Move the survivors to the front of the other streams, in order
+    runBatches(workerPool, batchCount, [this, count](uint32_t batch)
+    {
+        const uint32_t begin = batch * BatchSize;
+        const uint32_t end = (std::min)(begin + BatchSize, count);
+        uint32_t output = m_batchOffsets[batch];
+        for (uint32_t i = begin; i < end; ++i)
+        {
+            if (!m_alive[i])
+            {
+                continue;
+            }
+            for (uint32_t axis = 0u; axis < 3u; ++axis)
+            {
+                m_compacted.position[axis][output] = m_streams.position[axis][i];
+                m_compacted.velocity[axis][output] = m_streams.velocity[axis][i];
+            }
+            m_compacted.age[output] = m_streams.age[i];
+            m_compacted.lifetime[output] = m_streams.lifetime[i];
+            m_compacted.id[output] = m_streams.id[i];
+            ++output;
+        }
+    });
+
+    std::swap(m_streams, m_compacted);
+    m_aliveCount = m_batchOffsets[batchCount];
+}
+
+void ParticleSimulation::updateScalar(const ParticleFrameConstants &constants)
+{
+    emit(constants);
+
+    std::vector<ParticleState> particles;
+    getParticles(particles);
+
+    uint32_t survivors = 0u;
+    for (ParticleState &particle : particles)
+    {
+        if (simulateParticle(constants, particle))
+        {
+            setParticle(survivors++, particle);
+        }
+    }
+    m_aliveCount = survivors;
+}
+
+void ParticleSimulation::getParticles(std::vector<ParticleState> &particles) const
+{
+    particles.resize(m_aliveCount);
+    for (uint32_t i = 0u; i < m_aliveCount; ++i)
+    {
+        ParticleState &particle = particles[i];
+        particle = {};
+        for (uint32_t axis = 0u; axis < 3u; ++axis)
+        {
+            particle.position[axis] = m_streams.position[axis][i];
+            particle.velocity[axis] = m_streams.velocity[axis][i];
+        }
+        particle.age = m_streams.age[i];
+        particle.lifetime = m_streams.lifetime[i];
+        particle.id = m_streams.id[i];
+    }
+}
@@ -0,0 +1,177 @@
+#pragma once
+
+// Particle emission and integration shared by the GPU particle passes and a CPU reference.
+// The compute shaders (Shader/ParticleCommon.hlsli) run the same arithmetic as emitParticle and
+// simulateParticle below, operation for operation: only adds, multiplies, compares and integer
+// hashing, no transcendental functions or divisions, and `precise` on the GPU so nothing is fused
+// into a multiply add. Every value derived from the settings is computed once into
+// ParticleFrameConstants and handed to both sides, so the CPU reproduces the GPU bit for bit.
+// The CPU build must not contract either, which is the default for MSVC; GCC and Clang need
+// -ffp-contract=off when FMA instructions are enabled.
+//
+// Particles are identified by the order they were emitted in, which is the same on both sides,
+// while the slots they occupy are not: the GPU compacts its lists with atomics. Compare sets of
+// particles by id.
+// This file is platform independent so it can be built and profiled off Windows.
+
+#include <cstdint>
+#include <vector>
+
+#include "VectorMath.h"
+
+class WorkerPool;
+
+struct ParticleEmitterSettings
+{
+    Vec3 position = Vec3{ 0.0f, 0.0f, 0.0f };
+    Vec3 extent = Vec3{ 0.1f, 0.1f, 0.1f };          // Size of the box particles start in
+    Vec3 velocity = Vec3{ 0.0f, 4.0f, 0.0f };
+    Vec3 velocitySpread = Vec3{ 2.0f, 1.0f, 2.0f };  // Random offset per axis, centered on velocity
+    Vec3 gravity = Vec3{ 0.0f, -9.81f, 0.0f };
+    float minLifetime = 1.0f;
+    float lifetimeRange = 1.0f;
+    float drag = 0.2f;          // Fraction of the velocity lost per second
+    float floorHeight = 0.0f;
+    float restitution = 0.5f;   // Vertical speed kept when bouncing off the floor
+    float emitRate = 10000.0f;  // Particles per second
+    uint32_t seed = 1u;
+};
+
+// Root constants of the particle passes, laid out like the ParticleConstants cbuffer
+struct ParticleFrameConstants
+{
+    float emitterPosition[3];
+    float minLifetime;
+    float emitterExtent[3];
+    float lifetimeRange;
+    float velocity[3];
+    float deltaTime;
+    float velocitySpread[3];
+    float dragFactor;      // Velocity kept over one step
+    float gravityStep[3];  // Gravity times the step
+    float floorHeight;
+    float bounceFactor;    // Negated restitution
+    uint32_t emitCount;    // Requested this step, fewer are emitted when the pool is full
+    uint32_t seed;
+    uint32_t capacity;
+};
+
+static_assert(sizeof(ParticleFrameConstants) == 24u * sizeof(uint32_t), "The constants must match the HLSL cbuffer");
+
+// One particle as stored in the GPU structured buffer
+struct ParticleState
+{
+    float position[3];
+    float age;
+    float velocity[3];
+    float lifetime;
+    uint32_t id;
+    uint32_t padding[3];
+};
+
+static_assert(sizeof(ParticleState) == 48u, "The particle must match the HLSL struct");
+
+// emitCarry keeps the fraction of a particle left over between steps, start it at zero
+ParticleFrameConstants makeParticleFrameConstants(const ParticleEmitterSettings &settings, float deltaTime, uint32_t capacity, float &emitCarry);
+
+inline uint32_t hashParticle(uint32_t value)
+{
+    // PCG output permutation
+    uint32_t state = value * 747796405u + 2891336453u;
+    uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+// A float in [0, 1) from the top 24 bits, exact on both sides
+inline float getParticleRandom(uint32_t &state)
+{
+    state = hashParticle(state);
+    return static_cast<float>(state >> 8u) * (1.0f / 16777216.0f);
+}
+
+inline ParticleState emitParticle(const ParticleFrameConstants &constants, uint32_t id)
+{
+    uint32_t random = id ^ hashParticle(constants.seed);
+
+    ParticleState particle = {};
+    for (uint32_t axis = 0u; axis < 3u; ++axis)
+    {
+        particle.position[axis] = constants.emitterPosition[axis] + (getParticleRandom(random) - 0.5f) * constants.emitterExtent[axis];
+    }
+    for (uint32_t axis = 0u; axis < 3u; ++axis)
+    {
+        particle.velocity[axis] = constants.velocity[axis] + (getParticleRandom(random) - 0.5f) * constants.velocitySpread[axis];
+    }
+    particle.age = 0.0f;
+    particle.lifetime = constants.minLifetime + getParticleRandom(random) * constants.lifetimeRange;
+    particle.id = id;
+    return particle;
+}
+
+// One step, returns false once the particle has died
+inline bool simulateParticle(const ParticleFrameConstants &constants, ParticleState &particle)
+{
+    for (uint32_t axis = 0u; axis < 3u; ++axis)
+    {
+        particle.velocity[axis] = particle.velocity[axis] * constants.dragFactor + constants.gravityStep[axis];
+        particle.position[axis] = particle.position[axis] + particle.velocity[axis] * constants.deltaTime;
+    }
+    if (particle.position[1] < constants.floorHeight)
+    {
+        particle.position[1] = constants.floorHeight;
+        particle.velocity[1] = particle.velocity[1] * constants.bounceFactor;
+    }
+    particle.age = particle.age + constants.deltaTime;
+    return particle.age < particle.lifetime;
+}
+
+// Returns the number of particles whose bits differ, matched by id. Particles missing from
+// either side count as differing.
+uint32_t compareParticles(const ParticleState *a, uint32_t countA, const ParticleState *b, uint32_t countB);
+
+// The CPU reference. Particles live as structure of arrays and every step integrates them with
+// SIMD over batches spread across a worker pool, then compacts the survivors in order.
+class ParticleSimulation
+{
+public:
+    explicit ParticleSimulation(uint32_t capacity);
+
+    // Emit up to constants.emitCount particles and advance every particle by one step, like one
+    // frame of the GPU passes. workerPool may be null to run on the calling thread.
+    void update(const ParticleFrameConstants &constants, WorkerPool *workerPool);
+
+    // The same step one particle at a time through simulateParticle, for checking update
+    void updateScalar(const ParticleFrameConstants &constants);
+
+    void clear();
+
+    uint32_t getCapacity() const { return m_capacity; }
+    uint32_t getAliveCount() const { return m_aliveCount; }
+    uint32_t getEmittedCount() const { return m_emittedCount; }
+
+    // Alive particles in emission order
+    void getParticles(std::vector<ParticleState> &particles) const;
+
+private:
+    // Structure of arrays, padded to whole SIMD batches
+    struct Streams
+    {
+        std::vector<float> position[3];
+        std::vector<float> velocity[3];
+        std::vector<float> age;
+        std::vector<float> lifetime;
+        std::vector<uint32_t> id;
+    };
+
+    void resizeStreams(Streams &streams, uint32_t size);
+    void emit(const ParticleFrameConstants &constants);
+    void setParticle(uint32_t index, const ParticleState &particle);
+
+    uint32_t m_capacity;
+    uint32_t m_aliveCount;
+    uint32_t m_emittedCount;
+    Streams m_streams;
+    Streams m_compacted;
+    std::vector<uint8_t> m_alive;
+    std::vector<uint32_t> m_batchOffsets;
+};
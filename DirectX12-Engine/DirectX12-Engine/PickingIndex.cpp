@@ -0,0 +1,433 @@
+#include "PickingIndex.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+
+namespace
+{
+    PickingIndex::Rect combine(const PickingIndex::Rect &a, const PickingIndex::Rect &b)
+    {
+        PickingIndex::Rect rect;
+        rect.minX = std::min(a.minX, b.minX);
+        rect.minY = std::min(a.minY, b.minY);
+        rect.maxX = std::max(a.maxX, b.maxX);
+        rect.maxY = std::max(a.maxY, b.maxY);
+        return rect;
+    }
+
+    // Perimeter is the 2D equivalent of the surface area heuristic
+    float perimeter(const PickingIndex::Rect &rect)
+    {
+        return 2.0f * ((rect.maxX - rect.minX) + (rect.maxY - rect.minY));
+    }
+
+    bool contains(const PickingIndex::Rect &outer, const PickingIndex::Rect &inner)
+    {
+        return outer.minX <= inner.minX && outer.minY <= inner.minY && outer.maxX >= inner.maxX && outer.maxY >= inner.maxY;
+    }
+
+    bool overlaps(const PickingIndex::Rect &a, const PickingIndex::Rect &b)
+    {
+        return a.minX <= b.maxX && a.maxX >= b.minX && a.minY <= b.maxY && a.maxY >= b.minY;
+    }
+
+    // Half open on the far edges to match the hit test the visuals used before
+    bool containsPoint(const PickingIndex::Rect &rect, float x, float y)
+    {
+        return x >= rect.minX && x < rect.maxX && y >= rect.minY && y < rect.maxY;
+    }
+}
+
+PickingIndex::PickingIndex(float margin)
+    : m_root(InvalidId)
+    , m_freeList(InvalidId)
+    , m_leafCount(0u)
+    , m_nextOrder(0u)
+    , m_margin(margin)
+    , m_stats()
+{
+}
+
+uint32_t PickingIndex::insert(const Rect &rect, uint32_t userData)
+{
+    const uint32_t id = allocateNode();
+    Node &node = m_nodes[id];
+    node.rect = rect;
+    node.fatRect.minX = rect.minX - m_margin;
+    node.fatRect.minY = rect.minY - m_margin;
+    node.fatRect.maxX = rect.maxX + m_margin;
+    node.fatRect.maxY = rect.maxY + m_margin;
+    node.order = ++m_nextOrder;
+    node.maxOrder = node.order;
+    node.height = 0;
+    node.userData = userData;
+
+    insertLeaf(id);
+    ++m_leafCount;
+    return id;
+}
+
+void PickingIndex::remove(uint32_t id)
+{
+    assert(id < m_nodes.size() && m_nodes[id].isLeaf());
+
+    removeLeaf(id);
+    freeNode(id);
+    --m_leafCount;
+}
+
+void PickingIndex::move(uint32_t id, const Rect &rect)
+{
+    assert(id < m_nodes.size() && m_nodes[id].isLeaf());
+
+    ++m_stats.moves;
+    m_nodes[id].rect = rect;
+
+    // Small moves stay inside the padded bounds and leave the tree alone
+    if (contains(m_nodes[id].fatRect, rect))
+    {
+        return;
+    }
+
+    ++m_stats.reinsertions;
+    removeLeaf(id);
+
+    Node &node = m_nodes[id];
+    node.fatRect.minX = rect.minX - m_margin;
+    node.fatRect.minY = rect.minY - m_margin;
+    node.fatRect.maxX = rect.maxX + m_margin;
+    node.fatRect.maxY = rect.maxY + m_margin;
+
+    insertLeaf(id);
+}
+
+void PickingIndex::bringToFront(uint32_t id)
+{
+    assert(id < m_nodes.size() && m_nodes[id].isLeaf());
+
+    // The new order is the highest in the index so every ancestor takes it as is
+    const uint64_t order = ++m_nextOrder;
+    m_nodes[id].order = order;
+    for (uint32_t index = id; index != InvalidId; index = m_nodes[index].parent)
+    {
+        m_nodes[index].maxOrder = order;
+    }
+}
+
+uint32_t PickingIndex::pickTopmost(float x, float y) const
+{
+    ++m_stats.queries;
+
+    uint32_t best = InvalidId;
+    uint64_t bestOrder = 0u;
+
+    m_stack.clear();
+    if (m_root != InvalidId)
+    {
+        m_stack.push_back(m_root);
+    }
+
+    while (!m_stack.empty())
+    {
+        const uint32_t index = m_stack.back();
+        m_stack.pop_back();
+
+        const Node &node = m_nodes[index];
+        ++m_stats.nodesVisited;
+
+        // Nothing below can be above the current hit
+        if ((best != InvalidId && node.maxOrder <= bestOrder) || !containsPoint(node.fatRect, x, y))
+        {
+            continue;
+        }
+
+        if (node.isLeaf())
+        {
+            if (containsPoint(node.rect, x, y))
+            {
+                best = index;
+                bestOrder = node.order;
+            }
+            continue;
+        }
+
+        // Visit the child that may hold the higher stacking order first so the other is more likely to be pruned
+        if (m_nodes[node.child1].maxOrder > m_nodes[node.child2].maxOrder)
+        {
+            m_stack.push_back(node.child2);
+            m_stack.push_back(node.child1);
+        }
+        else
+        {
+            m_stack.push_back(node.child1);
+            m_stack.push_back(node.child2);
+        }
+    }
+
+    return best;
+}
+
+void PickingIndex::queryRect(const Rect &rect, std::vector<uint32_t> &ids) const
+{
+    ++m_stats.queries;
+
+    ids.clear();
+
+    m_stack.clear();
+    if (m_root != InvalidId)
+    {
+        m_stack.push_back(m_root);
+    }
+
+    while (!m_stack.empty())
+    {
+        const uint32_t index = m_stack.back();
+        m_stack.pop_back();
+
+        const Node &node = m_nodes[index];
+        ++m_stats.nodesVisited;
+
+        if (!overlaps(node.fatRect, rect))
+        {
+            continue;
+        }
+
+        if (node.isLeaf())
+        {
+            if (overlaps(node.rect, rect))
+            {
+                ids.push_back(index);
+            }
+            continue;
+        }
+
+        m_stack.push_back(node.child1);
+        m_stack.push_back(node.child2);
+    }
+
+    std::sort(ids.begin(), ids.end(), [this](uint32_t a, uint32_t b)
+    {
+        return m_nodes[a].order > m_nodes[b].order;
+    });
+}
+
+uint32_t PickingIndex::getHeight() const
+{
+    return m_root == InvalidId ? 0u : static_cast<uint32_t>(m_nodes[m_root].height);
+}
+
+uint32_t PickingIndex::allocateNode()
+{
+    uint32_t index = m_freeList;
+    if (index != InvalidId)
+    {
+        m_freeList = m_nodes[index].parent;
+    }
+    else
+    {
+        index = static_cast<uint32_t>(m_nodes.size());
+        m_nodes.emplace_back();
+    }
+
+    Node &node = m_nodes[index];
+    node.parent = InvalidId;
+    node.child1 = InvalidId;
+    node.child2 = InvalidId;
+    node.height = 0;
+    node.order = 0u;
+    node.maxOrder = 0u;
+    node.userData = 0u;
+    return index;
+}
+
+void PickingIndex::freeNode(uint32_t index)
+{
+    m_nodes[index].parent = m_freeList;
+    m_nodes[index].height = -1;
+    m_freeList = index;
+}
+
+void PickingIndex::insertLeaf(uint32_t leaf)
+{
+    if (m_root == InvalidId)
+    {
+        m_root = leaf;
+        m_nodes[leaf].parent = InvalidId;
+        return;
+    }
+
+    // Walk down towards the sibling that grows the tree's total perimeter the least
+    const Rect leafRect = m_nodes[leaf].fatRect;
+    uint32_t index = m_root;
+    while (!m_nodes[index].isLeaf())
+    {
+        const Node &node = m_nodes[index];
+        const float nodePerimeter = perimeter(node.fatRect);
+        const float combinedPerimeter = perimeter(combine(node.fatRect, leafRect));
+
+        // Cost of pairing the leaf with this node, and the cost pushed onto every child if we descend
+        const float cost = 2.0f * combinedPerimeter;
+        const float inheritanceCost = 2.0f * (combinedPerimeter - nodePerimeter);
+
+        float childCosts[2];
+        const uint32_t children[2] = { node.child1, node.child2 };
+        for (uint32_t i = 0u; i < 2u; ++i)
+        {
+            const Node &child = m_nodes[children[i]];
+            const float childCombined = perimeter(combine(child.fatRect, leafRect));
+            childCosts[i] = (child.isLeaf() ? childCombined : childCombined - perimeter(child.fatRect)) + inheritanceCost;
+        }
+
+        if (cost < childCosts[0] && cost < childCosts[1])
+        {
+            break;
+        }
+
+        index = childCosts[0] < childCosts[1] ? children[0] : children[1];
+    }
+
+    // Pair the leaf with the chosen sibling under a new parent
+    const uint32_t sibling = index;
+    const uint32_t oldParent = m_nodes[sibling].parent;
+    const uint32_t newParent = allocateNode();
+
+    m_nodes[newParent].parent = oldParent;
+    m_nodes[newParent].child1 = sibling;
+    m_nodes[newParent].child2 = leaf;
+    m_nodes[sibling].parent = newParent;
+    m_nodes[leaf].parent = newParent;
+    refit(newParent);
+
+    if (oldParent == InvalidId)
+    {
+        m_root = newParent;
+    }
+    else if (m_nodes[oldParent].child1 == sibling)
+    {
+        m_nodes[oldParent].child1 = newParent;
+    }
+    else
+    {
+        m_nodes[oldParent].child2 = newParent;
+    }
+
+    for (index = oldParent; index != InvalidId; index = m_nodes[index].parent)
+    {
+        index = balance(index);
+        refit(index);
+    }
+}
+
+void PickingIndex::removeLeaf(uint32_t leaf)
+{
+    if (leaf == m_root)
+    {
+        m_root = InvalidId;
+        return;
+    }
+
+    const uint32_t parent = m_nodes[leaf].parent;
+    const uint32_t grandParent = m_nodes[parent].parent;
+    const uint32_t sibling = m_nodes[parent].child1 == leaf ? m_nodes[parent].child2 : m_nodes[parent].child1;
+
+    // The sibling takes the place of the parent
+    if (grandParent == InvalidId)
+    {
+        m_root = sibling;
+        m_nodes[sibling].parent = InvalidId;
+    }
+    else
+    {
+        if (m_nodes[grandParent].child1 == parent)
+        {
+            m_nodes[grandParent].child1 = sibling;
+        }
+        else
+        {
+            m_nodes[grandParent].child2 = sibling;
+        }
+        m_nodes[sibling].parent = grandParent;
+
+        for (uint32_t index = grandParent; index != InvalidId; index = m_nodes[index].parent)
+        {
+            index = balance(index);
+            refit(index);
+        }
+    }
+
+    freeNode(parent);
+    m_nodes[leaf].parent = InvalidId;
+}
+
+// Rotate the taller grandchild up if the subtree at index is out of balance and return the new subtree root.
+uint32_t PickingIndex::balance(uint32_t index)
+{
+    Node &a = m_nodes[index];
+    if (a.isLeaf() || a.height < 2)
+    {
+        return index;
+    }
+
+    const uint32_t indexB = a.child1;
+    const uint32_t indexC = a.child2;
+    const int32_t difference = m_nodes[indexC].height - m_nodes[indexB].height;
+    if (std::abs(difference) <= 1)
+    {
+        return index;
+    }
+
+    // Promote the taller child, called up, and hand one of its children down to a
+    const uint32_t indexUp = difference > 0 ? indexC : indexB;
+    Node &up = m_nodes[indexUp];
+    const uint32_t indexF = up.child1;
+    const uint32_t indexG = up.child2;
+
+    up.child1 = index;
+    up.parent = a.parent;
+    a.parent = indexUp;
+
+    if (up.parent == InvalidId)
+    {
+        m_root = indexUp;
+    }
+    else if (m_nodes[up.parent].child1 == index)
+    {
+        m_nodes[up.parent].child1 = indexUp;
+    }
+    else
+    {
+        m_nodes[up.parent].child2 = indexUp;
+    }
+
+    // Keep the taller grandchild up and give the shorter one to a in place of the promoted child
+    const bool keepF = m_nodes[indexF].height > m_nodes[indexG].height;
+    const uint32_t kept = keepF ? indexF : indexG;
+    const uint32_t given = keepF ? indexG : indexF;
+
+    up.child2 = kept;
+    if (difference > 0)
+    {
+        a.child2 = given;
+    }
+    else
+    {
+        a.child1 = given;
+    }
+    m_nodes[given].parent = index;
+
+    refit(index);
+    refit(indexUp);
+    return indexUp;
+}
+
+void PickingIndex::refit(uint32_t index)
+{
+    Node &node = m_nodes[index];
+    const Node &child1 = m_nodes[node.child1];
+    const Node &child2 = m_nodes[node.child2];
+
+    node.fatRect = combine(child1.fatRect, child2.fatRect);
+    node.height = 1 + std::max(child1.height, child2.height);
+    node.maxOrder = std::max(child1.maxOrder, child2.maxOrder);
+}
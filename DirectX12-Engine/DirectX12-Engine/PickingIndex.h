@@ -0,0 +1,93 @@
+#pragma once
+
+// Spatial index used to find which visual is under the pointer without walking every visual.
+// Rectangles live in the leaves of a dynamic AABB tree that is kept balanced with tree rotations.
+// Leaves are stored with a small margin so dragging an item only touches the tree once it leaves
+// its padded bounds. Every rectangle carries a stacking order and each node tracks the highest
+// order below it, so topmost queries can skip whole subtrees that could not beat the current hit.
+// This file is platform independent so it can be built and profiled off Windows.
+
+#include <cstdint>
+#include <vector>
+
+class PickingIndex
+{
+public:
+    static const uint32_t InvalidId = 0xFFFFFFFFu;
+
+    struct Rect
+    {
+        float minX;
+        float minY;
+        float maxX;
+        float maxY;
+    };
+
+    struct Stats
+    {
+        uint64_t moves;
+        uint64_t reinsertions; // Moves that left the padded bounds and had to update the tree
+        uint64_t queries;
+        uint64_t nodesVisited;
+    };
+
+    // margin is how far a rectangle may move before its leaf is reinserted
+    explicit PickingIndex(float margin = 8.0f);
+
+    // Add a rectangle above everything already in the index and return its id
+    uint32_t insert(const Rect &rect, uint32_t userData);
+    void remove(uint32_t id);
+    void move(uint32_t id, const Rect &rect);
+
+    // Place a rectangle above everything else
+    void bringToFront(uint32_t id);
+
+    // The id of the topmost rectangle containing the point, or InvalidId
+    uint32_t pickTopmost(float x, float y) const;
+
+    // Collect the ids of all rectangles overlapping rect, topmost first
+    void queryRect(const Rect &rect, std::vector<uint32_t> &ids) const;
+
+    const Rect &getRect(uint32_t id) const { return m_nodes[id].rect; }
+    uint32_t getUserData(uint32_t id) const { return m_nodes[id].userData; }
+    uint32_t getCount() const { return m_leafCount; }
+    uint32_t getHeight() const;
+
+    const Stats &getStats() const { return m_stats; }
+    void resetStats() { m_stats = {}; }
+
+private:
+    struct Node
+    {
+        Rect fatRect;       // Bounds of everything below, padded by the margin at the leaves
+        Rect rect;          // Exact bounds, leaves only
+        uint64_t order;     // Stacking order, leaves only
+        uint64_t maxOrder;  // Highest order of any leaf below
+        uint32_t parent;    // Next free node when the node is unused
+        uint32_t child1;
+        uint32_t child2;
+        int32_t height;     // Leaves are 0, free nodes are -1
+        uint32_t userData;
+
+        bool isLeaf() const { return child1 == InvalidId; }
+    };
+
+    uint32_t allocateNode();
+    void freeNode(uint32_t index);
+
+    void insertLeaf(uint32_t leaf);
+    void removeLeaf(uint32_t leaf);
+    uint32_t balance(uint32_t index);
+    void refit(uint32_t index);
+
+    std::vector<Node> m_nodes;
+    uint32_t m_root;
+    uint32_t m_freeList;
+    uint32_t m_leafCount;
+    uint64_t m_nextOrder;
+    float m_margin;
+
+    // Reused by the queries to avoid allocating, which is why they are logically const
+    mutable std::vector<uint32_t> m_stack;
+    mutable Stats m_stats;
+};
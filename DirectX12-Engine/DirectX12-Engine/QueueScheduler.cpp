@@ -0,0 +1,581 @@
+#include "QueueScheduler.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+
+namespace
+{
+    bool isWrite(ResourceAccess access)
+    {
+        return access == ResourceAccess::CopyDest || access == ResourceAccess::UnorderedAccess ||
+            access == ResourceAccess::RenderTarget || access == ResourceAccess::DepthWrite;
+    }
+
+    const char *getQueueName(QueueType queue)
+    {
+        static const char *names[] = { "direct", "compute", "copy" };
+        return names[static_cast<uint32_t>(queue)];
+    }
+
+    const char *getAccessName(ResourceAccess access)
+    {
+        static const char *names[] = { "common", "copy source", "copy dest", "compute read", "graphics read", "unordered access", "render target", "depth write" };
+        return names[static_cast<uint32_t>(access)];
+    }
+
+    // Work time in the simulation never drops to zero so a work item always begins before it ends
+    const float MinimumDuration = 1e-6f;
+}
+
+QueueScheduler::QueueScheduler()
+{
+}
+
+QueueScheduler::WorkId QueueScheduler::addWork(const char *name, QueueType queue, float cost, bool pinned)
+{
+    Work work;
+    work.name = name;
+    work.queue = queue;
+    work.cost = cost;
+    work.pinned = pinned;
+    m_work.push_back(std::move(work));
+    return static_cast<WorkId>(m_work.size() - 1u);
+}
+
+QueueScheduler::ResourceId QueueScheduler::addResource(const char *name)
+{
+    m_resourceNames.push_back(name);
+    return static_cast<ResourceId>(m_resourceNames.size() - 1u);
+}
+
+void QueueScheduler::addAccess(WorkId work, ResourceId resource, ResourceAccess access)
+{
+    assert(resource < m_resourceNames.size());
+    m_work[work].accesses.push_back(Access{ resource, access });
+}
+
+void QueueScheduler::addDependency(WorkId before, WorkId after)
+{
+    assert(before < after);
+    m_work[after].dependencies.push_back(before);
+}
+
+void QueueScheduler::clear()
+{
+    m_work.clear();
+    m_resourceNames.clear();
+}
+
+bool QueueScheduler::supportsAccess(QueueType queue, ResourceAccess access)
+{
+    switch (queue)
+    {
+    case QueueType::Direct:
+        return true;
+    case QueueType::Compute:
+        return access == ResourceAccess::Common || access == ResourceAccess::CopySource || access == ResourceAccess::CopyDest ||
+            access == ResourceAccess::ComputeRead || access == ResourceAccess::UnorderedAccess;
+    default:
+        return access == ResourceAccess::Common || access == ResourceAccess::CopySource || access == ResourceAccess::CopyDest;
+    }
+}
+
+void QueueScheduler::buildDependencies(std::vector<std::vector<WorkId>> &dependencies, std::vector<Transition> &transitions) const
+{
+    struct ResourceState
+    {
+        ResourceAccess access = ResourceAccess::Common;
+        std::vector<WorkId> users; // Since the last state change or write
+    };
+    std::vector<ResourceState> resources(m_resourceNames.size());
+
+    dependencies.assign(m_work.size(), std::vector<WorkId>());
+    transitions.clear();
+    for (WorkId w = 0u; w < m_work.size(); ++w)
+    {
+        std::vector<WorkId> &workDependencies = dependencies[w];
+        workDependencies = m_work[w].dependencies;
+
+        for (const Access &access : m_work[w].accesses)
+        {
+            ResourceState &resource = resources[access.resource];
+            if (access.access == resource.access && !isWrite(access.access))
+            {
+                // Readers in the same state run side by side after whoever put it there
+                if (!resource.users.empty())
+                {
+                    workDependencies.push_back(resource.users.front());
+                }
+                resource.users.push_back(w);
+                continue;
+            }
+
+            // A write or a state change waits for everyone since the last one
+            workDependencies.insert(workDependencies.end(), resource.users.begin(), resource.users.end());
+            if (access.access != resource.access || access.access == ResourceAccess::UnorderedAccess)
+            {
+                Transition transition;
+                transition.work = w;
+                transition.barrier = Barrier{ access.resource, resource.access, access.access };
+                transition.previousUsers = resource.users;
+                transitions.push_back(std::move(transition));
+            }
+            resource.access = access.access;
+            resource.users.assign(1u, w);
+        }
+
+        std::sort(workDependencies.begin(), workDependencies.end());
+        workDependencies.erase(std::unique(workDependencies.begin(), workDependencies.end()), workDependencies.end());
+    }
+}
+
+void QueueScheduler::compile(const Settings &settings, Schedule &schedule) const
+{
+    const uint32_t workCount = static_cast<uint32_t>(m_work.size());
+
+    std::vector<std::vector<WorkId>> dependencies;
+    std::vector<Transition> transitions;
+    buildDependencies(dependencies, transitions);
+
+    std::vector<std::vector<uint32_t>> workTransitions(workCount);
+    for (uint32_t i = 0u; i < transitions.size(); ++i)
+    {
+        workTransitions[transitions[i].work].push_back(i);
+    }
+
+    // The queue the previous users of a transition share, or Direct with false when they do not share one
+    auto getUserQueue = [&](const Transition &transition, QueueType &queue)
+    {
+        queue = QueueType::Direct;
+        for (size_t i = 0u; i < transition.previousUsers.size(); ++i)
+        {
+            QueueType userQueue = schedule.queues[transition.previousUsers[i]];
+            if (i > 0u && userQueue != queue)
+            {
+                return false;
+            }
+            queue = userQueue;
+        }
+        return !transition.previousUsers.empty();
+    };
+
+    // Place every item in recording order, on the queue where it would finish first
+    schedule.queues.assign(workCount, QueueType::Direct);
+    std::vector<float> finish(workCount, 0.0f);
+    float queueFree[QueueCount] = {};
+    for (WorkId w = 0u; w < workCount; ++w)
+    {
+        const Work &work = m_work[w];
+
+        QueueType candidates[QueueCount];
+        uint32_t candidateCount = 0u;
+        candidates[candidateCount++] = work.queue;
+        if (!work.pinned && settings.allowQueueMoves)
+        {
+            if (work.queue == QueueType::Copy)
+            {
+                candidates[candidateCount++] = QueueType::Compute;
+            }
+            if (work.queue != QueueType::Direct)
+            {
+                candidates[candidateCount++] = QueueType::Direct;
+            }
+        }
+        else if (work.queue != QueueType::Direct)
+        {
+            // Only used when the requested queue cannot handle the work's resource states
+            candidates[candidateCount++] = QueueType::Direct;
+        }
+
+        float bestFinish = 0.0f;
+        float bestScore = 0.0f;
+        bool found = false;
+        for (uint32_t c = 0u; c < candidateCount; ++c)
+        {
+            QueueType queue = candidates[c];
+            bool valid = std::all_of(work.accesses.begin(), work.accesses.end(), [queue](const Access &access) { return supportsAccess(queue, access.access); });
+            for (uint32_t t : workTransitions[w])
+            {
+                // Either this queue makes the transition or the queue handing the resource over does
+                const Barrier &barrier = transitions[t].barrier;
+                QueueType userQueue;
+                valid = valid && ((supportsAccess(queue, barrier.before) && supportsAccess(queue, barrier.after)) ||
+                    (getUserQueue(transitions[t], userQueue) && supportsAccess(userQueue, barrier.before) && supportsAccess(userQueue, barrier.after)));
+            }
+            if (!valid || (found && work.pinned))
+            {
+                continue;
+            }
+
+            float start = queueFree[static_cast<uint32_t>(queue)];
+            for (WorkId d : dependencies[w])
+            {
+                start = (std::max)(start, finish[d] + (schedule.queues[d] != queue ? settings.fenceLatency : 0.0f));
+            }
+            // Moving is only worth it when the work would otherwise wait longer than it runs,
+            // short gaps on the other queues are better left to the work recorded for them
+            float score = start + work.cost + (found ? work.cost : 0.0f);
+            if (!found || score < bestScore)
+            {
+                bestFinish = start + work.cost;
+                bestScore = score;
+                schedule.queues[w] = queue;
+                found = true;
+            }
+        }
+        assert(found);
+
+        finish[w] = bestFinish;
+        queueFree[static_cast<uint32_t>(schedule.queues[w])] = bestFinish;
+    }
+
+    // Position of every item on its queue, counted from one so zero means none
+    std::vector<uint32_t> positions(workCount);
+    std::vector<WorkId> queueOrders[QueueCount];
+    for (WorkId w = 0u; w < workCount; ++w)
+    {
+        std::vector<WorkId> &order = queueOrders[static_cast<uint32_t>(schedule.queues[w])];
+        order.push_back(w);
+        positions[w] = static_cast<uint32_t>(order.size());
+    }
+
+    // Vector clocks: the last position on every queue known to be finished when an item finishes.
+    // A dependency needs no wait when the clock of its queue already covers it.
+    std::vector<std::array<uint32_t, QueueCount>> clocks(workCount);
+    std::array<uint32_t, QueueCount> queueClocks[QueueCount] = {};
+    std::vector<std::vector<WorkId>> waits(workCount);
+    std::vector<uint8_t> signalled(workCount, 0u);
+    schedule.crossQueueDependencies = 0u;
+    schedule.waitCount = 0u;
+    for (WorkId w = 0u; w < workCount; ++w)
+    {
+        uint32_t queue = static_cast<uint32_t>(schedule.queues[w]);
+        std::array<uint32_t, QueueCount> &queueClock = queueClocks[queue];
+
+        uint32_t needed[QueueCount] = {};
+        WorkId neededWork[QueueCount] = {};
+        for (WorkId d : dependencies[w])
+        {
+            uint32_t dependencyQueue = static_cast<uint32_t>(schedule.queues[d]);
+            if (dependencyQueue == queue)
+            {
+                continue;
+            }
+            ++schedule.crossQueueDependencies;
+            if (queueClock[dependencyQueue] < positions[d] && needed[dependencyQueue] < positions[d])
+            {
+                needed[dependencyQueue] = positions[d];
+                neededWork[dependencyQueue] = d;
+            }
+        }
+
+        // A wait on one queue can cover the other, when that queue's work had waited for it already
+        for (uint32_t source = 0u; source < QueueCount; ++source)
+        {
+            for (uint32_t other = 0u; other < QueueCount && needed[source] != 0u; ++other)
+            {
+                if (other != source && needed[other] != 0u && clocks[neededWork[other]][source] >= needed[source])
+                {
+                    needed[source] = 0u;
+                }
+            }
+        }
+
+        for (uint32_t source = 0u; source < QueueCount; ++source)
+        {
+            if (needed[source] == 0u)
+            {
+                continue;
+            }
+            WorkId producer = neededWork[source];
+            waits[w].push_back(producer);
+            signalled[producer] = 1u;
+            ++schedule.waitCount;
+            for (uint32_t i = 0u; i < QueueCount; ++i)
+            {
+                queueClock[i] = (std::max)(queueClock[i], clocks[producer][i]);
+            }
+        }
+
+        queueClock[queue] = positions[w];
+        clocks[w] = queueClock;
+    }
+
+    // Fence values in queue order
+    std::vector<uint64_t> signalValues(workCount, 0u);
+    for (uint32_t queue = 0u; queue < QueueCount; ++queue)
+    {
+        schedule.signalCounts[queue] = 0u;
+        for (WorkId w : queueOrders[queue])
+        {
+            if (signalled[w])
+            {
+                signalValues[w] = ++schedule.signalCounts[queue];
+            }
+        }
+    }
+
+    // Barriers go on the consuming queue when it can make the transition, otherwise at the end of
+    // the last previous user
+    std::vector<ScheduledWork> scheduledWork(workCount);
+    for (WorkId w = 0u; w < workCount; ++w)
+    {
+        scheduledWork[w].work = w;
+    }
+    schedule.barrierCount = 0u;
+    for (const Transition &transition : transitions)
+    {
+        QueueType queue = schedule.queues[transition.work];
+        const Barrier &barrier = transition.barrier;
+        if (barrier.before == ResourceAccess::UnorderedAccess && barrier.after == ResourceAccess::UnorderedAccess &&
+            std::none_of(transition.previousUsers.begin(), transition.previousUsers.end(), [&](WorkId user) { return schedule.queues[user] == queue; }))
+        {
+            // UAV writes on another queue are already ordered by the fence
+            continue;
+        }
+
+        ++schedule.barrierCount;
+        if (supportsAccess(queue, barrier.before) && supportsAccess(queue, barrier.after))
+        {
+            scheduledWork[transition.work].beginBarriers.push_back(barrier);
+            continue;
+        }
+
+        WorkId lastUser = *std::max_element(transition.previousUsers.begin(), transition.previousUsers.end(),
+            [&](WorkId a, WorkId b) { return positions[a] < positions[b]; });
+        scheduledWork[lastUser].endBarriers.push_back(barrier);
+    }
+
+    // Split every queue into submissions at waits and signals
+    schedule.submissions.clear();
+    for (uint32_t queue = 0u; queue < QueueCount; ++queue)
+    {
+        Submission *submission = nullptr;
+        for (WorkId w : queueOrders[queue])
+        {
+            if (submission == nullptr || !waits[w].empty())
+            {
+                schedule.submissions.push_back(Submission{ static_cast<QueueType>(queue), {}, {}, 0u });
+                submission = &schedule.submissions.back();
+                for (WorkId producer : waits[w])
+                {
+                    submission->waits.push_back(Wait{ schedule.queues[producer], signalValues[producer] });
+                }
+            }
+            submission->work.push_back(std::move(scheduledWork[w]));
+            if (signalled[w])
+            {
+                submission->signalValue = signalValues[w];
+                submission = nullptr;
+            }
+        }
+    }
+
+    // Waits only refer to earlier work, so recording order is a safe submission order
+    std::stable_sort(schedule.submissions.begin(), schedule.submissions.end(),
+        [](const Submission &a, const Submission &b) { return a.work.front().work < b.work.front().work; });
+}
+
+void QueueScheduler::simulate(const Schedule &schedule, const Settings &settings, SimulationReport &report) const
+{
+    const uint32_t workCount = static_cast<uint32_t>(m_work.size());
+
+    report.timings.assign(workCount, WorkTiming{ 0.0f, 0.0f });
+    report.serialTime = 0.0f;
+    report.frameTime = 0.0f;
+    report.errors.clear();
+    for (float &busy : report.busyTime)
+    {
+        busy = 0.0f;
+    }
+
+    // Run every queue's submissions in order, each one starting once its waits are signalled
+    std::vector<const Submission *> queueSubmissions[QueueCount];
+    for (const Submission &submission : schedule.submissions)
+    {
+        queueSubmissions[static_cast<uint32_t>(submission.queue)].push_back(&submission);
+    }
+
+    std::vector<float> signalTimes[QueueCount];
+    size_t nextSubmission[QueueCount] = {};
+    float queueTimes[QueueCount] = {};
+    std::vector<uint8_t> executed(workCount, 0u);
+    bool progress = true;
+    while (progress)
+    {
+        progress = false;
+        for (uint32_t queue = 0u; queue < QueueCount; ++queue)
+        {
+            if (nextSubmission[queue] == queueSubmissions[queue].size())
+            {
+                continue;
+            }
+            const Submission &submission = *queueSubmissions[queue][nextSubmission[queue]];
+
+            float start = queueTimes[queue];
+            bool ready = true;
+            for (const Wait &wait : submission.waits)
+            {
+                const std::vector<float> &signals = signalTimes[static_cast<uint32_t>(wait.queue)];
+                if (wait.value == 0u || wait.value > signals.size())
+                {
+                    ready = false;
+                    break;
+                }
+                start = (std::max)(start, signals[wait.value - 1u] + settings.fenceLatency);
+            }
+            if (!ready)
+            {
+                continue;
+            }
+
+            for (const ScheduledWork &scheduled : submission.work)
+            {
+                float duration = (std::max)(m_work[scheduled.work].cost, MinimumDuration);
+                report.timings[scheduled.work] = WorkTiming{ start, start + duration };
+                report.busyTime[queue] += duration;
+                executed[scheduled.work] = 1u;
+                start += duration;
+            }
+            queueTimes[queue] = start;
+
+            if (submission.signalValue != 0u)
+            {
+                if (submission.signalValue != signalTimes[queue].size() + 1u)
+                {
+                    report.errors.push_back(std::string("Fence values on the ") + getQueueName(submission.queue) + " queue are out of order");
+                }
+                signalTimes[queue].push_back(start);
+            }
+
+            ++nextSubmission[queue];
+            progress = true;
+        }
+    }
+
+    for (uint32_t queue = 0u; queue < QueueCount; ++queue)
+    {
+        if (nextSubmission[queue] != queueSubmissions[queue].size())
+        {
+            report.errors.push_back(std::string("The ") + getQueueName(static_cast<QueueType>(queue)) + " queue waits on a fence that is never signalled");
+        }
+        report.frameTime = (std::max)(report.frameTime, queueTimes[queue]);
+    }
+    for (WorkId w = 0u; w < workCount; ++w)
+    {
+        report.serialTime += (std::max)(m_work[w].cost, MinimumDuration);
+        if (!executed[w])
+        {
+            report.errors.push_back("'" + m_work[w].name + "' is never submitted");
+        }
+    }
+    if (!report.errors.empty())
+    {
+        return;
+    }
+
+    // Every dependency has to be finished before its dependent starts
+    std::vector<std::vector<WorkId>> dependencies;
+    std::vector<Transition> transitions;
+    buildDependencies(dependencies, transitions);
+    for (WorkId w = 0u; w < workCount; ++w)
+    {
+        for (WorkId d : dependencies[w])
+        {
+            if (report.timings[d].end > report.timings[w].start)
+            {
+                report.errors.push_back("'" + m_work[w].name + "' starts before '" + m_work[d].name + "' finishes");
+            }
+        }
+    }
+
+    // Replay the barriers in time order and check every access sees the state it expects
+    struct Event
+    {
+        float time;
+        bool begin;
+        WorkId work;
+    };
+    std::vector<Event> events;
+    std::vector<const ScheduledWork *> scheduledWork(workCount, nullptr);
+    for (const Submission &submission : schedule.submissions)
+    {
+        for (const ScheduledWork &scheduled : submission.work)
+        {
+            scheduledWork[scheduled.work] = &scheduled;
+            events.push_back(Event{ report.timings[scheduled.work].start, true, scheduled.work });
+            events.push_back(Event{ report.timings[scheduled.work].end, false, scheduled.work });
+        }
+    }
+    std::sort(events.begin(), events.end(), [](const Event &a, const Event &b)
+    {
+        if (a.time != b.time)
+        {
+            return a.time < b.time;
+        }
+        return !a.begin && b.begin;
+    });
+
+    std::vector<ResourceAccess> states(m_resourceNames.size(), ResourceAccess::Common);
+    auto applyBarriers = [&](const std::vector<Barrier> &barriers, WorkId work)
+    {
+        for (const Barrier &barrier : barriers)
+        {
+            QueueType queue = schedule.queues[work];
+            if (!supportsAccess(queue, barrier.before) || !supportsAccess(queue, barrier.after))
+            {
+                report.errors.push_back(std::string("The ") + getQueueName(queue) + " queue cannot move '" + m_resourceNames[barrier.resource] + "' from " +
+                    getAccessName(barrier.before) + " to " + getAccessName(barrier.after));
+            }
+            if (states[barrier.resource] != barrier.before)
+            {
+                report.errors.push_back("Barrier on '" + m_resourceNames[barrier.resource] + "' at '" + m_work[work].name + "' expects " +
+                    getAccessName(barrier.before) + " but the resource is in " + getAccessName(states[barrier.resource]));
+            }
+            states[barrier.resource] = barrier.after;
+        }
+    };
+
+    for (const Event &event : events)
+    {
+        const ScheduledWork &scheduled = *scheduledWork[event.work];
+        if (!event.begin)
+        {
+            applyBarriers(scheduled.endBarriers, event.work);
+            continue;
+        }
+
+        applyBarriers(scheduled.beginBarriers, event.work);
+        for (const Access &access : m_work[event.work].accesses)
+        {
+            if (states[access.resource] != access.access)
+            {
+                report.errors.push_back("'" + m_work[event.work].name + "' uses '" + m_resourceNames[access.resource] + "' as " +
+                    getAccessName(access.access) + " while it is in " + getAccessName(states[access.resource]));
+            }
+        }
+    }
+
+    // Work that overlaps in time must not write a resource the other one touches
+    for (WorkId a = 0u; a < workCount; ++a)
+    {
+        for (WorkId b = a + 1u; b < workCount; ++b)
+        {
+            if (report.timings[a].end <= report.timings[b].start || report.timings[b].end <= report.timings[a].start)
+            {
+                continue;
+            }
+            for (const Access &accessA : m_work[a].accesses)
+            {
+                for (const Access &accessB : m_work[b].accesses)
+                {
+                    if (accessA.resource == accessB.resource && (isWrite(accessA.access) || isWrite(accessB.access)))
+                    {
+                        report.errors.push_back("'" + m_work[a].name + "' and '" + m_work[b].name + "' overlap on '" + m_resourceNames[accessA.resource] + "'");
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,162 @@
+#pragma once
+
+// Scheduling of GPU work over the direct, compute and copy queues.
+// Work is added in recording order with the queue it would like to run on, the resources it
+// touches and any extra dependencies. compile() derives the hazards between items from their
+// resource accesses, places every item on its queue, or on a more capable one when it would
+// otherwise wait there longer than it runs in a simulated timeline, and emits the fewest fence waits that cover every cross queue dependency: a wait is
+// left out when the queue already knows the producer has finished through an earlier wait, its
+// own or one made by another queue. Only items something waits on get a signal. State
+// transitions go on a queue that supports both states, which is how D3D12 hands resources from
+// one queue type to another.
+// simulate() replays a schedule from its fences alone, checks that every dependency and resource
+// state holds, and reports how much work the queues overlapped.
+// This file is platform independent so it can be built and profiled off Windows.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class QueueType : uint8_t
+{
+    Direct,
+    Compute,
+    Copy
+};
+
+enum class ResourceAccess : uint8_t
+{
+    Common,          // Initial state of every resource
+    CopySource,
+    CopyDest,
+    ComputeRead,     // Read by compute or non pixel shaders
+    GraphicsRead,    // Read by any shader stage, direct queue only
+    UnorderedAccess,
+    RenderTarget,
+    DepthWrite
+};
+
+class QueueScheduler
+{
+public:
+    typedef uint32_t WorkId;
+    typedef uint32_t ResourceId;
+
+    static const uint32_t QueueCount = 3u;
+
+    struct Settings
+    {
+        float fenceLatency = 0.02f;   // Cost of a cross queue wait in the same unit as the work cost
+        bool allowQueueMoves = true;  // Let unpinned work run on a more capable queue when that is sooner
+    };
+
+    // A transition, or a UAV barrier when both states are UnorderedAccess
+    struct Barrier
+    {
+        ResourceId resource;
+        ResourceAccess before;
+        ResourceAccess after;
+    };
+
+    struct ScheduledWork
+    {
+        WorkId work;
+        std::vector<Barrier> beginBarriers; // Record before the work
+        std::vector<Barrier> endBarriers;   // Record after it, handing resources to another queue
+    };
+
+    // Fence values count from one per queue and per schedule, the submitter adds its own base
+    struct Wait
+    {
+        QueueType queue;
+        uint64_t value;
+    };
+
+    // One ExecuteCommandLists call, preceded by its waits and followed by an optional signal
+    struct Submission
+    {
+        QueueType queue;
+        std::vector<Wait> waits;
+        std::vector<ScheduledWork> work;
+        uint64_t signalValue; // Zero when nothing waits on this submission
+    };
+
+    struct Schedule
+    {
+        std::vector<Submission> submissions; // In an order that is safe to submit from one thread
+        std::vector<QueueType> queues;       // Queue of every work item
+        uint32_t signalCounts[QueueCount];   // Highest fence value signalled on each queue
+        uint32_t crossQueueDependencies;     // Before minimization
+        uint32_t waitCount;
+        uint32_t barrierCount;
+    };
+
+    struct WorkTiming
+    {
+        float start;
+        float end;
+    };
+
+    struct SimulationReport
+    {
+        std::vector<WorkTiming> timings;
+        float serialTime;             // Everything back to back on one queue
+        float frameTime;              // Until the last queue finishes
+        float busyTime[QueueCount];
+        std::vector<std::string> errors; // Broken dependencies, wrong resource states or deadlocks
+    };
+
+    QueueScheduler();
+
+    // cost is an estimate in any unit, used to pick queues and by simulate(). Pinned work never
+    // leaves the queue given.
+    WorkId addWork(const char *name, QueueType queue, float cost, bool pinned = false);
+    ResourceId addResource(const char *name);
+
+    // One access per resource and work item
+    void addAccess(WorkId work, ResourceId resource, ResourceAccess access);
+
+    // For ordering that does not come from a shared resource, before must be added first
+    void addDependency(WorkId before, WorkId after);
+
+    void clear();
+
+    const std::string &getWorkName(WorkId work) const { return m_work[work].name; }
+    const std::string &getResourceName(ResourceId resource) const { return m_resourceNames[resource]; }
+    uint32_t getWorkCount() const { return static_cast<uint32_t>(m_work.size()); }
+
+    void compile(const Settings &settings, Schedule &schedule) const;
+    void simulate(const Schedule &schedule, const Settings &settings, SimulationReport &report) const;
+
+    static bool supportsAccess(QueueType queue, ResourceAccess access);
+
+private:
+    struct Access
+    {
+        ResourceId resource;
+        ResourceAccess access;
+    };
+
+    struct Work
+    {
+        std::string name;
+        QueueType queue;
+        float cost;
+        bool pinned;
+        std::vector<Access> accesses;
+        std::vector<WorkId> dependencies;
+    };
+
+    // A state change of a resource and the work that used it in the previous state
+    struct Transition
+    {
+        WorkId work;
+        Barrier barrier;
+        std::vector<WorkId> previousUsers;
+    };
+
+    void buildDependencies(std::vector<std::vector<WorkId>> &dependencies, std::vector<Transition> &transitions) const;
+
+    std::vector<Work> m_work;
+    std::vector<std::string> m_resourceNames;
+};
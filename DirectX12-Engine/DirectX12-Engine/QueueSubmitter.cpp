@@ -0,0 +1,146 @@
+#include "pch.h"
+#include "QueueSubmitter.h"
+
+QueueSubmitter::QueueSubmitter(ID3D12Device *device, ID3D12CommandQueue *directQueue, std::initializer_list<QueueType> queues)
+    : m_fenceBases{}
+    , m_fenceEvent(nullptr)
+{
+    m_queues[static_cast<uint32_t>(QueueType::Direct)].copy_from(directQueue);
+
+    const D3D12_COMMAND_LIST_TYPE types[] = { D3D12_COMMAND_LIST_TYPE_DIRECT, D3D12_COMMAND_LIST_TYPE_COMPUTE, D3D12_COMMAND_LIST_TYPE_COPY };
+    for (QueueType type : queues)
+    {
+        uint32_t queue = static_cast<uint32_t>(type);
+        if (!m_queues[queue])
+        {
+            D3D12_COMMAND_QUEUE_DESC commandQueueDesc = {};
+            commandQueueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+            commandQueueDesc.Type = types[queue];
+            winrt::check_hresult(device->CreateCommandQueue(&commandQueueDesc, __uuidof(m_queues[queue]), m_queues[queue].put_void()));
+        }
+    }
+
+    for (uint32_t queue = 0u; queue < QueueScheduler::QueueCount; ++queue)
+    {
+        if (m_queues[queue])
+        {
+            winrt::check_hresult(device->CreateFence(0, D3D12_FENCE_FLAG_NONE, __uuidof(m_fences[queue]), m_fences[queue].put_void()));
+        }
+    }
+
+    m_fenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    if (m_fenceEvent == nullptr)
+    {
+        winrt::check_hresult(HRESULT_FROM_WIN32(GetLastError()));
+    }
+}
+
+QueueSubmitter::~QueueSubmitter()
+{
+    waitIdle();
+    CloseHandle(m_fenceEvent);
+}
+
+void QueueSubmitter::execute(const QueueScheduler::Schedule &schedule, ID3D12CommandList *const *commandLists)
+{
+    execute(schedule, [commandLists](QueueScheduler::WorkId work) { return commandLists[work]; });
+}
+
+void QueueSubmitter::execute(const QueueScheduler::Schedule &schedule, const std::function<ID3D12CommandList *(QueueScheduler::WorkId work)> &record)
+{
+    std::vector<ID3D12CommandList *> submissionLists;
+    for (const QueueScheduler::Submission &submission : schedule.submissions)
+    {
+        uint32_t queue = static_cast<uint32_t>(submission.queue);
+        for (const QueueScheduler::Wait &wait : submission.waits)
+        {
+            uint32_t source = static_cast<uint32_t>(wait.queue);
+            winrt::check_hresult(m_queues[queue]->Wait(m_fences[source].get(), m_fenceBases[source] + wait.value));
+        }
+
+        submissionLists.clear();
+        for (const QueueScheduler::ScheduledWork &work : submission.work)
+        {
+            submissionLists.push_back(record(work.work));
+        }
+        m_queues[queue]->ExecuteCommandLists(static_cast<UINT>(submissionLists.size()), submissionLists.data());
+
+        if (submission.signalValue != 0u)
+        {
+            winrt::check_hresult(m_queues[queue]->Signal(m_fences[queue].get(), m_fenceBases[queue] + submission.signalValue));
+        }
+    }
+
+    for (uint32_t queue = 0u; queue < QueueScheduler::QueueCount; ++queue)
+    {
+        m_fenceBases[queue] += schedule.signalCounts[queue];
+    }
+}
+
+void QueueSubmitter::recordBarriers(ID3D12GraphicsCommandList *commandList, const std::vector<QueueScheduler::Barrier> &barriers, ID3D12Resource *const *resources)
+{
+    if (barriers.empty())
+    {
+        return;
+    }
+
+    std::vector<D3D12_RESOURCE_BARRIER> resourceBarriers(barriers.size());
+    for (size_t i = 0u; i < barriers.size(); ++i)
+    {
+        const QueueScheduler::Barrier &barrier = barriers[i];
+        D3D12_RESOURCE_BARRIER &resourceBarrier = resourceBarriers[i];
+        resourceBarrier = {};
+        if (barrier.before == ResourceAccess::UnorderedAccess && barrier.after == ResourceAccess::UnorderedAccess)
+        {
+            resourceBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
+            resourceBarrier.UAV.pResource = resources[barrier.resource];
+            continue;
+        }
+        resourceBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+        resourceBarrier.Transition.pResource = resources[barrier.resource];
+        resourceBarrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+        resourceBarrier.Transition.StateBefore = getResourceState(barrier.before);
+        resourceBarrier.Transition.StateAfter = getResourceState(barrier.after);
+    }
+    commandList->ResourceBarrier(static_cast<UINT>(resourceBarriers.size()), resourceBarriers.data());
+}
+
+D3D12_RESOURCE_STATES QueueSubmitter::getResourceState(ResourceAccess access)
+{
+    switch (access)
+    {
+    case ResourceAccess::CopySource:
+        return D3D12_RESOURCE_STATE_COPY_SOURCE;
+    case ResourceAccess::CopyDest:
+        return D3D12_RESOURCE_STATE_COPY_DEST;
+    case ResourceAccess::ComputeRead:
+        return D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+    case ResourceAccess::GraphicsRead:
+        return D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
+    case ResourceAccess::UnorderedAccess:
+        return D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+    case ResourceAccess::RenderTarget:
+        return D3D12_RESOURCE_STATE_RENDER_TARGET;
+    case ResourceAccess::DepthWrite:
+        return D3D12_RESOURCE_STATE_DEPTH_WRITE;
+    default:
+        return D3D12_RESOURCE_STATE_COMMON;
+    }
+}
+
+void QueueSubmitter::waitIdle()
+{
+    for (uint32_t queue = 0u; queue < QueueScheduler::QueueCount; ++queue)
+    {
+        if (!m_queues[queue])
+        {
+            continue;
+        }
+
+        // Schedule a Signal command in the queue and wait until it has been processed
+        ++m_fenceBases[queue];
+        winrt::check_hresult(m_queues[queue]->Signal(m_fences[queue].get(), m_fenceBases[queue]));
+        winrt::check_hresult(m_fences[queue]->SetEventOnCompletion(m_fenceBases[queue], m_fenceEvent));
+        WaitForSingleObjectEx(m_fenceEvent, INFINITE, FALSE);
+    }
+}
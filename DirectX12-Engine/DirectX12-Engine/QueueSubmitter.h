@@ -0,0 +1,46 @@
+#pragma once
+
+// Submits a QueueScheduler schedule to the device's direct, compute and copy queues.
+// Every queue owns one fence. The fence values in a schedule count from one, so the submitter
+// keeps a base per queue and moves it past the values a schedule used once it is submitted.
+
+#include "pch.h"
+#include "QueueScheduler.h"
+
+#include <functional>
+#include <initializer_list>
+
+class QueueSubmitter
+{
+public:
+    // The direct queue is shared with the caller, the other queues listed in queues are created here.
+    // Schedules must only use the queues the submitter has.
+    QueueSubmitter(ID3D12Device *device, ID3D12CommandQueue *directQueue, std::initializer_list<QueueType> queues);
+
+    ~QueueSubmitter();
+
+    // Null for a queue that was not created
+    ID3D12CommandQueue *getQueue(QueueType queue) const { return m_queues[static_cast<uint32_t>(queue)].get(); }
+
+    // commandLists holds the closed list of every work item, recorded on a list of the type its
+    // queue in schedule.queues needs and with its barriers from recordBarriers
+    void execute(const QueueScheduler::Schedule &schedule, ID3D12CommandList *const *commandLists);
+
+    // Same, but record is called for every work item right before its submission and returns its closed list.
+    // Work submitted earlier has been executed by then, so a later item may reset and reuse its list.
+    void execute(const QueueScheduler::Schedule &schedule, const std::function<ID3D12CommandList *(QueueScheduler::WorkId work)> &record);
+
+    // resources maps scheduler resource ids to the D3D12 resources
+    static void recordBarriers(ID3D12GraphicsCommandList *commandList, const std::vector<QueueScheduler::Barrier> &barriers, ID3D12Resource *const *resources);
+
+    static D3D12_RESOURCE_STATES getResourceState(ResourceAccess access);
+
+    // Blocks until every queue has finished its submitted work
+    void waitIdle();
+
+private:
+    winrt::com_ptr<ID3D12CommandQueue> m_queues[QueueScheduler::QueueCount];
+    winrt::com_ptr<ID3D12Fence> m_fences[QueueScheduler::QueueCount];
+    UINT64 m_fenceBases[QueueScheduler::QueueCount]; // Last value signalled before the current schedule
+    HANDLE m_fenceEvent;
+};
@@ -0,0 +1,75 @@
+#include "ReadbackRing.h"
+
+#include <algorithm>
+#include <cassert>
+
+ReadbackRing::ReadbackRing(uint32_t slotCount)
+    : m_slotCount((std::max)(slotCount, 1u))
+    , m_states(new std::atomic<uint32_t>[m_slotCount])
+    , m_fenceValues(m_slotCount, 0u)
+    , m_inFlight(m_slotCount, 0u)
+    , m_inFlightHead(0u)
+    , m_inFlightCount(0u)
+    , m_nextSlot(0u)
+    , m_lastFenceValue(0u)
+{
+    for (uint32_t slot = 0u; slot < m_slotCount; ++slot)
+    {
+        m_states[slot].store(Free, std::memory_order_relaxed);
+    }
+}
+
+ReadbackRing::Slot ReadbackRing::acquire()
+{
+    for (uint32_t i = 0u; i < m_slotCount; ++i)
+    {
+        const Slot slot = (m_nextSlot + i) % m_slotCount;
+
+        // Pairs with the release in release() so the reader is done with the memory before the
+        // next copy is recorded into it
+        if (m_states[slot].load(std::memory_order_acquire) == Free)
+        {
+            m_states[slot].store(Recording, std::memory_order_relaxed);
+            m_nextSlot = (slot + 1u) % m_slotCount;
+            return slot;
+        }
+    }
+    return NoSlot;
+}
+
+void ReadbackRing::cancel(Slot slot)
+{
+    assert(slot < m_slotCount && m_states[slot].load(std::memory_order_relaxed) == Recording);
+    m_states[slot].store(Free, std::memory_order_relaxed);
+}
+
+void ReadbackRing::submit(Slot slot, uint64_t fenceValue)
+{
+    assert(slot < m_slotCount && m_states[slot].load(std::memory_order_relaxed) == Recording);
+    assert(fenceValue >= m_lastFenceValue);
+
+    m_fenceValues[slot] = fenceValue;
+    m_lastFenceValue = fenceValue;
+    m_states[slot].store(InFlight, std::memory_order_relaxed);
+    m_inFlight[(m_inFlightHead + m_inFlightCount) % m_slotCount] = slot;
+    ++m_inFlightCount;
+}
+
+void ReadbackRing::poll(uint64_t completedFenceValue, std::vector<Slot> &completed)
+{
+    // Fence values only grow along the ring, so the first slot still in flight ends the search
+    while (m_inFlightCount > 0u && m_fenceValues[m_inFlight[m_inFlightHead]] <= completedFenceValue)
+    {
+        const Slot slot = m_inFlight[m_inFlightHead];
+        m_states[slot].store(Reading, std::memory_order_relaxed);
+        completed.push_back(slot);
+        m_inFlightHead = (m_inFlightHead + 1u) % m_slotCount;
+        --m_inFlightCount;
+    }
+}
+
+void ReadbackRing::release(Slot slot)
+{
+    assert(slot < m_slotCount && m_states[slot].load(std::memory_order_relaxed) == Reading);
+    m_states[slot].store(Free, std::memory_order_release);
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+// Bookkeeping of a ring of GPU readback buffers.
+// Every frame the render thread takes a free slot, records a copy into its buffer and submits it
+// with the fence value that signals the end of the frame. poll() compares the slots in flight
+// against the fence's completed value and hands the finished ones over, oldest first, without
+// ever waiting on the GPU. A finished slot stays reserved until whoever reads its data releases
+// it, which may happen on any thread. When no slot is free the frame is simply not copied, so a
+// reader that falls behind costs captured frames instead of frame time.
+// This file is platform independent so it can be built and profiled off Windows.
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class ReadbackRing
+{
+public:
+    typedef uint32_t Slot;
+    static const Slot NoSlot = ~0u;
+
+    explicit ReadbackRing(uint32_t slotCount);
+
+    ReadbackRing(const ReadbackRing &) = delete;
+    ReadbackRing &operator=(const ReadbackRing &) = delete;
+
+    uint32_t getSlotCount() const { return m_slotCount; }
+
+    // Render thread. A free slot to copy into, NoSlot when every slot is waiting for the GPU or
+    // still being read.
+    Slot acquire();
+
+    // Render thread. Gives back an acquired slot whose copy was never submitted.
+    void cancel(Slot slot);
+
+    // Render thread. The copy into the slot is done once the fence reaches fenceValue. Fence
+    // values must not decrease from one submission to the next.
+    void submit(Slot slot, uint64_t fenceValue);
+
+    // Render thread, never blocks. Appends the slots whose fence value has been reached in the
+    // order they were submitted. They belong to the caller until released.
+    void poll(uint64_t completedFenceValue, std::vector<Slot> &completed);
+
+    // Any thread. The slot's data has been consumed and the slot can be copied into again.
+    void release(Slot slot);
+
+    // Render thread. Slots submitted and not yet returned by poll.
+    uint32_t getInFlightCount() const { return m_inFlightCount; }
+
+private:
+    enum State : uint32_t
+    {
+        Free,
+        Recording, // Acquired, the copy is being recorded
+        InFlight,  // Submitted, waiting for the fence
+        Reading    // Returned by poll, waiting for release
+    };
+
+    uint32_t m_slotCount;
+    std::unique_ptr<std::atomic<uint32_t>[]> m_states;
+
+    // Owned by the render thread
+    std::vector<uint64_t> m_fenceValues;
+    std::vector<Slot> m_inFlight;  // Ring of submitted slots, oldest at m_inFlightHead
+    uint32_t m_inFlightHead;
+    uint32_t m_inFlightCount;
+    uint32_t m_nextSlot;           // Where acquire starts looking, so slots are used in turn
+    uint64_t m_lastFenceValue;
+};
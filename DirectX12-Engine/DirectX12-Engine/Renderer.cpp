@@ -1,16 +1,303 @@
 #include "pch.h"
 #include "Renderer.h"
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 
+#include "AsyncFileReader.h"
 #include "BasicReaderWriter.h"
+#include "OcclusionCuller.h"
+#include "QueueSubmitter.h"
+#include "ShaderManifest.h"
+#include "StartupGraph.h"
+#include "TerrainStreamer.h"
+#include "TerrainTileCache.h"
+#include "WorkerPool.h"
+
+namespace
+{
+    const float SceneClearColor[] = { 0.2f, 0.2f, 0.2f, 1.0f };
+
+    // Particles advance a fixed step per frame so runs can be replayed through ParticleSimulation
+    const float ParticleStepTime = 1.0f / 60.0f;
+    const float ParticleWorldToClip = 0.25f;
+    const float ParticleBillboardSize = 0.012f; // Half the billboard height in clip space
+
+    // Work items of m_frameSchedules. The scene pass and the particle simulation overlap, the compose pass
+    // draws the particles into the scene and presents.
+    enum FrameWork : QueueScheduler::WorkId
+    {
+        SceneWork,
+        ParticleWork,
+        ComposeWork
+    };
+
+    // The scene is lit as if it were a plane facing the camera at this view space depth, with the
+    // lights orbiting around it
+    const float LightStepTime = 1.0f / 60.0f;
+    const float ScenePlaneDepth = 4.0f;
+    const float LightFieldOfView = 1.04719755f; // 60 degrees vertically
+    const float PiTimesTwo = 6.28318531f;
+
+    // Root constants of the scene's pixel shader, matches LightingConstants in PixelShader.hlsl
+    struct LightingConstants
+    {
+        float invSceneSize[2];
+        float invProjectionScale[2];
+        float surfaceDepth;
+        float sliceScale;
+        float sliceBias;
+        uint32_t tilesX;
+        uint32_t tilesY;
+        uint32_t slices;
+    };
+
+    // The terrain camera circles the middle of the terrain above its highest point, looking inwards
+    const float TerrainStepTime = 1.0f / 60.0f;
+    const float TerrainFieldOfView = 1.04719755f; // 60 degrees vertically
+    const float TerrainThresholdPixels = 2.0f;
+    const float TerrainNearDistance = 1.0f;
+
+    // Root constants of the terrain's vertex shader, matches TerrainConstants in TerrainVertexShader.hlsl
+    struct TerrainConstants
+    {
+        Mat4 viewProjection;
+        float heightScale;
+        uint32_t tileSamples;
+        uint32_t slotStride;
+        uint32_t padding;
+    };
+
+    // Maps an integer to [0, 1) so every light's orbit follows from its index alone
+    float lightHash(uint32_t value)
+    {
+        value ^= value >> 16;
+        value *= 0x7feb352du;
+        value ^= value >> 15;
+        value *= 0x846ca68bu;
+        value ^= value >> 16;
+        return static_cast<float>(value >> 8) * (1.0f / 16777216.0f);
+    }
+
+    // The built in sprite images are white with an alpha mask so the sprite color tints them.
+    // They are listed in image id order, see Renderer.h.
+    enum class SpriteShape
+    {
+        Solid,
+        Disc,
+        Ring,
+        Diamond
+    };
+
+    struct SpriteImageDesc
+    {
+        SpriteShape shape;
+        uint32_t size;
+    };
+
+    const SpriteImageDesc BuiltInSpriteImages[] =
+    {
+        { SpriteShape::Solid, 4u },
+        { SpriteShape::Disc, 128u },
+        { SpriteShape::Ring, 128u },
+        { SpriteShape::Diamond, 96u }
+    };
+
+    // Alpha of the texel centred at x, y in [-1, 1], faded over one texel at the edge of the shape
+    float spriteCoverage(SpriteShape shape, uint32_t size, float x, float y)
+    {
+        const float halfSize = 0.5f * static_cast<float>(size);
+        const float radius = std::sqrt(x * x + y * y);
+
+        float inside = 1.0f; // Distance to the edge in texels, negative outside
+        switch (shape)
+        {
+        case SpriteShape::Solid:
+            return 1.0f;
+        case SpriteShape::Disc:
+            inside = (1.0f - radius) * halfSize;
+            break;
+        case SpriteShape::Ring:
+            inside = (std::min)(radius - 0.6f, 1.0f - radius) * halfSize;
+            break;
+        case SpriteShape::Diamond:
+            inside = (1.0f - std::fabs(x) - std::fabs(y)) * halfSize * 0.70710678f;
+            break;
+        }
+        return (std::max)(0.0f, (std::min)(1.0f, inside + 0.5f));
+    }
+
+    // Every shader the renderer loads, each one is read into m_shaderBytecode by its own startup task
+    enum ShaderId : uint32_t
+    {
+        SceneVertexShader,
+        ScenePixelShader,
+        UpscaleVertexShader,
+        UpscalePixelShader,
+        SpriteVertexShader,
+        SpritePixelShader,
+        ParticlePassShader, // The first of the particle passes, in the order they run
+        ParticleVertexShader = ParticlePassShader + 4,
+        ParticlePixelShader,
+        TerrainVertexShader,
+        TerrainPixelShader,
+        ShaderCount
+    };
+
+    const char *const ShaderNames[ShaderCount] =
+    {
+        "VertexShader",
+        "PixelShader",
+        "UpscaleVertexShader",
+        "UpscalePixelShader",
+        "SpriteVertexShader",
+        "SpritePixelShader",
+        "ParticlePrepare",
+        "ParticleEmit",
+        "ParticleSimulate",
+        "ParticleFinish",
+        "ParticleVertexShader",
+        "ParticlePixelShader",
+        "TerrainVertexShader",
+        "TerrainPixelShader"
+    };
+
+    // Linear clamped sampling for the pixel shader at s0, the upscale and sprite passes share it
+    D3D12_STATIC_SAMPLER_DESC createLinearSamplerDesc()
+    {
+        D3D12_STATIC_SAMPLER_DESC linearSampler = {};
+        linearSampler.Filter = D3D12_FILTER_MIN_MAG_MIP_LINEAR;
+        linearSampler.AddressU = D3D12_TEXTURE_ADDRESS_MODE_CLAMP;
+        linearSampler.AddressV = D3D12_TEXTURE_ADDRESS_MODE_CLAMP;
+        linearSampler.AddressW = D3D12_TEXTURE_ADDRESS_MODE_CLAMP;
+        linearSampler.ComparisonFunc = D3D12_COMPARISON_FUNC_NEVER;
+        linearSampler.BorderColor = D3D12_STATIC_BORDER_COLOR_TRANSPARENT_BLACK;
+        linearSampler.MaxLOD = D3D12_FLOAT32_MAX;
+        linearSampler.ShaderRegister = 0;
+        linearSampler.RegisterSpace = 0;
+        linearSampler.ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
+        return linearSampler;
+    }
+
+    // Raster, blend and output state every graphics pipeline starts from
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC createBasePipelineDesc()
+    {
+        D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc = {};
+
+        D3D12_RASTERIZER_DESC rasterDesc;
+        rasterDesc.FillMode = D3D12_FILL_MODE_SOLID;
+        rasterDesc.CullMode = D3D12_CULL_MODE_NONE;
+        rasterDesc.FrontCounterClockwise = FALSE;
+        rasterDesc.DepthBias = D3D12_DEFAULT_DEPTH_BIAS;
+        rasterDesc.DepthBiasClamp = D3D12_DEFAULT_DEPTH_BIAS_CLAMP;
+        rasterDesc.SlopeScaledDepthBias = D3D12_DEFAULT_SLOPE_SCALED_DEPTH_BIAS;
+        rasterDesc.DepthClipEnable = TRUE;
+        rasterDesc.MultisampleEnable = FALSE;
+        rasterDesc.AntialiasedLineEnable = FALSE;
+        rasterDesc.ForcedSampleCount = 0;
+        rasterDesc.ConservativeRaster = D3D12_CONSERVATIVE_RASTERIZATION_MODE_OFF;
+
+        psoDesc.RasterizerState = rasterDesc;
+
+        D3D12_BLEND_DESC blendDesc;
+        blendDesc.AlphaToCoverageEnable = FALSE;
+        blendDesc.IndependentBlendEnable = FALSE;
+        const D3D12_RENDER_TARGET_BLEND_DESC defaultRenderTargetBlendDesc = {
+            FALSE,
+            FALSE,
+            D3D12_BLEND_ONE,
+            D3D12_BLEND_ZERO,
+            D3D12_BLEND_OP_ADD,
+            D3D12_BLEND_ONE,
+            D3D12_BLEND_ZERO,
+            D3D12_BLEND_OP_ADD,
+            D3D12_LOGIC_OP_NOOP,
+            D3D12_COLOR_WRITE_ENABLE_ALL,
+        };
+        for (UINT i = 0; i < D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT; ++i)
+            blendDesc.RenderTarget[i] = defaultRenderTargetBlendDesc;
+
+        psoDesc.BlendState = blendDesc;
+        psoDesc.DepthStencilState.DepthEnable = FALSE;
+        psoDesc.DepthStencilState.StencilEnable = FALSE;
+        psoDesc.SampleMask = UINT_MAX;
+        psoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+        psoDesc.NumRenderTargets = 1;
+        psoDesc.RTVFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM;
+        psoDesc.SampleDesc.Count = 1;
+
+        return psoDesc;
+    }
+
+    // Private data of every tracked resource. The resource releases it when it is destroyed, which
+    // takes the resource out of the registry no matter which reference went last.
+    class ResourceReleaseNotifier : public IUnknown
+    {
+    public:
+        explicit ResourceReleaseNotifier(GpuResourceRegistry::ResourceId id)
+            : m_referenceCount(1u)
+            , m_id(id)
+        {
+        }
+
+        HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void **object) override
+        {
+            if (riid != __uuidof(IUnknown))
+            {
+                *object = nullptr;
+                return E_NOINTERFACE;
+            }
+            AddRef();
+            *object = static_cast<IUnknown *>(this);
+            return S_OK;
+        }
+
+        ULONG STDMETHODCALLTYPE AddRef() override
+        {
+            return ++m_referenceCount;
+        }
+
+        ULONG STDMETHODCALLTYPE Release() override
+        {
+            const ULONG count = --m_referenceCount;
+            if (count == 0u)
+            {
+                getGpuResourceRegistry().remove(m_id);
+                delete this;
+            }
+            return count;
+        }
+
+    private:
+        std::atomic<ULONG> m_referenceCount;
+        GpuResourceRegistry::ResourceId m_id;
+    };
+
+    // {8E3C5A71-2F4B-4D19-9A6E-53B07C1D28F4}
+    const GUID ResourceReleaseNotifierGuid = { 0x8e3c5a71, 0x2f4b, 0x4d19, { 0x9a, 0x6e, 0x53, 0xb0, 0x7c, 0x1d, 0x28, 0xf4 } };
+}
 
 Renderer::Renderer()
+    : m_spriteAtlasPacker(SpriteAtlasSize, SpriteAtlasSize)
+    , m_spriteBatch(MaxSprites)
+    , m_captureSource(CaptureSource::BackBuffer)
+    , m_captureSlot(ReadbackRing::NoSlot)
+    , m_captureFrameNumber(0u)
+    , m_particlesReady(false)
+    , m_terrainReady(false)
 {
-    initializeCoreApi();
-    initializeResources();
+    m_startupGraph = std::make_unique<StartupGraph>();
+    buildStartupGraph();
+    m_startupGraph->run();
+
+    // The fence starts at zero, so the first frame signals one
+    m_fenceValues[m_frameIndex] = 1u;
 }
 
 Renderer::~Renderer()
@@ -19,25 +306,44 @@ Renderer::~Renderer()
 
 void Renderer::cleanUp()
 {
+    // Deferred startup tasks that have not started are dropped
+    m_startupGraph.reset();
+    endCapture();
     waitForGpu();
+    m_queueSubmitter->waitIdle();
     CloseHandle(m_fenceEvent);
 }
 
-void Renderer::render()
+void Renderer::render(const SceneState &scene, const std::vector<Sprite> &sprites)
 {
-    // Records the commands that are to be called per frame
-    populateCommandList();
+    applyCaptureRequest();
+    updateDeferredStartup();
+    updateSceneConstants(scene);
+    updateLights();
+    if (m_terrainReady)
+    {
+        updateTerrain();
+    }
 
-    // Execute the command list.
-    ID3D12CommandList *ppGraphicsCommandLists[] = { m_graphicsCommandList.get() };
-    m_commandQueue->ExecuteCommandLists(_countof(ppGraphicsCommandLists), ppGraphicsCommandLists);
+    // Records the commands that are to be called per frame and executes them
+    executeFrame(sprites);
 
     // Present the frame.
     winrt::check_hresult(m_swapChain->Present(1, 0));
 
+    // The first frame is out, so the rest of startup can run in the background
+    if (m_startupGraph != nullptr)
+    {
+        m_startupGraph->startDeferred();
+    }
+
     // Schedule a Signal command in the queue.
     const UINT64 currentFenceValue = m_fenceValues[m_frameIndex];
     winrt::check_hresult(m_commandQueue->Signal(m_fence.get(), currentFenceValue));
+    if (m_captureSlot != ReadbackRing::NoSlot)
+    {
+        m_frameCapture->submitFrame(m_captureSlot, currentFenceValue);
+    }
 
     // Update the frame index.
     m_frameIndex = m_swapChain->GetCurrentBackBufferIndex();
@@ -49,10 +355,67 @@ void Renderer::render()
         WaitForSingleObjectEx(m_fenceEvent, INFINITE, FALSE);
     }
 
+    // The frame that last used this index has finished, so its GPU time can drive the next render scale
+    // and its per frame memory can be reused
+    updateRenderScale();
+    m_frameArenas[m_frameIndex]->reset();
+    getGpuResourceRegistry().endFrame();
+
+    // Hand the copies that have landed to the capture encoders, the newest one may still be in flight
+    if (m_frameCapture != nullptr)
+    {
+        m_frameCapture->poll(m_fence->GetCompletedValue());
+    }
+
     // Set the fence value for the next frame.
     m_fenceValues[m_frameIndex] = currentFenceValue + 1;
 }
 
+// Picks up the deferred startup tasks once they are all done, without ever waiting for them
+void Renderer::updateDeferredStartup()
+{
+    if (m_startupGraph == nullptr || !m_startupGraph->isDeferredDone())
+    {
+        return;
+    }
+
+    // Rethrows the error of a failed task
+    m_startupGraph->waitDeferred();
+
+    std::ostringstream report;
+    m_startupGraph->writeReport(report);
+    OutputDebugStringA(report.str().c_str());
+
+    m_startupGraph.reset();
+    m_shaderBytecode.clear();
+    m_shaderBytecode.shrink_to_fit();
+    m_particlesReady = true;
+    m_terrainReady = m_terrainStreamer != nullptr;
+}
+
+// Queue a copy for the start of the next frame's command list, the upload buffer is kept until that frame is done.
+// Safe to call from any thread.
+void Renderer::queueUpload(winrt::com_ptr<ID3D12Resource> uploadBuffer, std::function<void(ID3D12GraphicsCommandList *commandList)> record)
+{
+    std::lock_guard<std::mutex> lock(m_pendingUploadMutex);
+    m_pendingUploads.push_back(PendingUpload{ std::move(uploadBuffer), std::move(record) });
+}
+
+void Renderer::recordPendingUploads()
+{
+    // The frame that last used this index has finished, so the copies it made are done
+    m_recordedUploads[m_frameIndex].clear();
+
+    std::lock_guard<std::mutex> lock(m_pendingUploadMutex);
+    for (PendingUpload &upload : m_pendingUploads)
+    {
+        upload.record(m_graphicsCommandList.get());
+        upload.record = nullptr;
+        m_recordedUploads[m_frameIndex].push_back(std::move(upload));
+    }
+    m_pendingUploads.clear();
+}
+
 void Renderer::resize(UINT width, UINT height)
 {
     // TODO
@@ -67,7 +430,76 @@ struct
     virtual HRESULT STDMETHODCALLTYPE put_MessageHandled(unsigned char value) = 0;
 };
 
-void Renderer::initializeCoreApi()
+// Lay out startup as a graph of tasks, see StartupGraph. D3D12 device calls are free threaded, so only the swap
+// chain stays on the main thread, which owns the window. Nothing waits for the GPU: uploads are queued and
+// recorded into the first frame's command list. Particles and the terrain are left for after the first frame.
+void Renderer::buildStartupGraph()
+{
+    typedef StartupGraph::TaskId TaskId;
+    StartupGraph &graph = *m_startupGraph;
+
+    // Shader files do not need the device, so reading them overlaps its creation
+    const TaskId shaderManifest = graph.add("read shader manifest", [this]() { loadShaderManifest(); }, {});
+    m_shaderBytecode.resize(ShaderCount);
+    TaskId shaders[ShaderCount];
+    for (uint32_t shader = 0u; shader < ShaderCount; ++shader)
+    {
+        const std::string name = std::string("read ") + ShaderNames[shader];
+        auto read = [this, shader]() { m_shaderBytecode[shader] = loadShaderBytecode(ShaderNames[shader]); };
+        shaders[shader] = shader < ParticlePassShader ?
+            graph.add(name.c_str(), read, { shaderManifest }) :
+            graph.addDeferred(name.c_str(), read, { shaderManifest });
+    }
+
+    const TaskId device = graph.add("create device", [this]() { createDevice(); }, {});
+    const TaskId queues = graph.add("create queues", [this]() { createQueues(); }, { device });
+    const TaskId swapChain = graph.add("create swap chain", [this]()
+    {
+        // TODO: refactor this to support window resizing
+        setupSwapchain(winrt::Windows::UI::Core::CoreWindow::GetForCurrentThread().Bounds().Width, winrt::Windows::UI::Core::CoreWindow::GetForCurrentThread().Bounds().Height);
+    }, { queues }, StartupGraph::Affinity::MainThread);
+    const TaskId frameResources = graph.add("create frame resources", [this]() { createFrameResources(); }, { swapChain });
+    const TaskId descriptorHeap = graph.add("create descriptor heap", [this]() { createDescriptorHeap(); }, { device });
+
+    const TaskId sceneRootSignature = graph.add("scene root signature", [this]() { createSceneRootSignature(); }, { device });
+    const TaskId scenePipeline = graph.add("scene pipeline", [this]() { createScenePipeline(); },
+        { sceneRootSignature, shaders[SceneVertexShader], shaders[ScenePixelShader] });
+    const TaskId upscaleRootSignature = graph.add("upscale root signature", [this]() { createUpscaleRootSignature(); }, { device });
+    graph.add("upscale pipeline", [this]() { createUpscalePipeline(); },
+        { upscaleRootSignature, shaders[UpscaleVertexShader], shaders[UpscalePixelShader] });
+    const TaskId spriteRootSignature = graph.add("sprite root signature", [this]() { createSpriteRootSignature(); }, { device });
+    graph.add("sprite pipeline", [this]() { createSpritePipeline(); },
+        { spriteRootSignature, shaders[SpriteVertexShader], shaders[SpritePixelShader] });
+
+    graph.add("create command list", [this]() { createCommandList(); }, { frameResources, scenePipeline });
+    graph.add("create constant buffers", [this]() { createConstantBuffers(); }, { descriptorHeap, swapChain });
+    graph.add("create geometry", [this]() { createGeometry(); }, { device });
+    graph.add("occlusion culling", [this]() { initializeOcclusionCulling(); }, { swapChain });
+    graph.add("dynamic resolution", [this]() { initializeDynamicResolution(); }, { frameResources, descriptorHeap });
+    graph.add("sprites", [this]() { initializeSprites(); }, { descriptorHeap });
+    graph.add("lights", [this]() { initializeLights(); }, { swapChain });
+
+    // Particles only need to be there a few frames in, and their pipelines are the slowest to compile
+    const TaskId particleRootSignature = graph.addDeferred("particle root signature", [this]() { createParticleRootSignature(); }, { device });
+    const char *particlePassNames[ParticlePassCount] = { "particle prepare pipeline", "particle emit pipeline", "particle simulate pipeline", "particle finish pipeline" };
+    for (UINT pass = 0; pass < ParticlePassCount; ++pass)
+    {
+        graph.addDeferred(particlePassNames[pass], [this, pass]() { createParticlePassPipeline(pass); },
+            { particleRootSignature, shaders[ParticlePassShader + pass] });
+    }
+    graph.addDeferred("particle draw pipeline", [this]() { createParticleDrawPipeline(); },
+        { particleRootSignature, shaders[ParticleVertexShader], shaders[ParticlePixelShader] });
+    graph.addDeferred("particle buffers", [this]() { initializeParticles(); }, { device });
+    graph.addDeferred("particle command list", [this]() { createParticleCommandList(); }, { queues });
+
+    // The terrain streams in over its first frames anyway, and reading its pinned tiles waits on the disk
+    const TaskId terrainRootSignature = graph.addDeferred("terrain root signature", [this]() { createTerrainRootSignature(); }, { device });
+    graph.addDeferred("terrain pipeline", [this]() { createTerrainPipeline(); },
+        { terrainRootSignature, shaders[TerrainVertexShader], shaders[TerrainPixelShader] });
+    graph.addDeferred("terrain", [this]() { initializeTerrain(); }, { shaderManifest, swapChain });
+}
+
+void Renderer::createDevice()
 {
     UINT dxgiFactoryFlags = 0;
 
@@ -104,7 +536,10 @@ void Renderer::initializeCoreApi()
 #if defined(_DEBUG)
     winrt::check_hresult(m_device->QueryInterface(m_debugDevice.put()));
 #endif
+}
 
+void Renderer::createQueues()
+{
     // Create command queue
     D3D12_COMMAND_QUEUE_DESC commandQueueDesc = {};
     commandQueueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
@@ -114,13 +549,29 @@ void Renderer::initializeCoreApi()
     // Create fence
     winrt::check_hresult(m_device->CreateFence(0, D3D12_FENCE_FLAG_NONE, __uuidof(m_fence), m_fence.put_void()));
 
-    // Setup swapchain
-    // TODO: refactor this to support window resizing
-    setupSwapchain(winrt::Windows::UI::Core::CoreWindow::GetForCurrentThread().Bounds().Width, winrt::Windows::UI::Core::CoreWindow::GetForCurrentThread().Bounds().Height);
+    // Create the compute queue the particles are simulated on
+    m_queueSubmitter = std::make_unique<QueueSubmitter>(m_device.get(), m_commandQueue.get(), std::initializer_list<QueueType>{ QueueType::Compute });
+
+    // Initialize fence values and the per frame memory they guard
+    for (UINT i = 0; i < FrameCount; ++i)
+    {
+        m_fenceValues[i] = 0u;
+        m_frameArenas[i] = std::make_unique<LinearArena>(FrameArenaCapacity, MemoryTag::FrameArena);
+    }
+
+    // Create an event handle to use for frame synchronization.
+    m_fenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    if (m_fenceEvent == nullptr)
+    {
+        winrt::check_hresult(HRESULT_FROM_WIN32(GetLastError()));
+    }
+}
 
+void Renderer::createFrameResources()
+{
     // Create render target view descriptor heap
     D3D12_DESCRIPTOR_HEAP_DESC rtvDescriptorHeapDesc = {};
-    rtvDescriptorHeapDesc.NumDescriptors = FrameCount;
+    rtvDescriptorHeapDesc.NumDescriptors = FrameCount + 1; // One per back buffer plus the dynamic resolution scene target
     rtvDescriptorHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
     rtvDescriptorHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
     winrt::check_hresult(m_device->CreateDescriptorHeap(&rtvDescriptorHeapDesc, __uuidof(m_rtvHeap), m_rtvHeap.put_void()));
@@ -133,6 +584,7 @@ void Renderer::initializeCoreApi()
     {
         // Create a RTV for each frame
         winrt::check_hresult(m_swapChain->GetBuffer(i, __uuidof(m_renderTargets[i]), m_renderTargets[i].put_void()));
+        trackResource(m_renderTargets[i].get(), i == 0u ? "back buffer 0" : "back buffer 1", GpuResourceCategory::RenderTargets, GPU_RESOURCE_SOURCE);
         m_device->CreateRenderTargetView(m_renderTargets[i].get(), nullptr, rtvHandle);
         rtvHandle.ptr += m_rtvDescriptorSize;
 
@@ -141,19 +593,22 @@ void Renderer::initializeCoreApi()
     }
 }
 
-void Renderer::initializeResources()
+void Renderer::createDescriptorHeap()
 {
-    // Create the root signature
-    D3D12_FEATURE_DATA_ROOT_SIGNATURE featureDataRootSignature = {};
-    featureDataRootSignature.HighestVersion = D3D_ROOT_SIGNATURE_VERSION_1_1;
-    winrt::check_hresult(m_device->CheckFeatureSupport(D3D12_FEATURE_ROOT_SIGNATURE, &featureDataRootSignature, sizeof(featureDataRootSignature)));
-
     // Create the descriptor heap
     D3D12_DESCRIPTOR_HEAP_DESC cbvSrvUavheapDesc = {};
-    cbvSrvUavheapDesc.NumDescriptors = 2; // This value should be updated whenever a new descriptor for this heap is added
+    cbvSrvUavheapDesc.NumDescriptors = 4; // This value should be updated whenever a new descriptor for this heap is added
     cbvSrvUavheapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
     cbvSrvUavheapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
     winrt::check_hresult(m_device->CreateDescriptorHeap(&cbvSrvUavheapDesc, __uuidof(m_cbvSrvUavHeap), m_cbvSrvUavHeap.put_void()));
+}
+
+void Renderer::createSceneRootSignature()
+{
+    // Create the root signature
+    D3D12_FEATURE_DATA_ROOT_SIGNATURE featureDataRootSignature = {};
+    featureDataRootSignature.HighestVersion = D3D_ROOT_SIGNATURE_VERSION_1_1;
+    winrt::check_hresult(m_device->CheckFeatureSupport(D3D12_FEATURE_ROOT_SIGNATURE, &featureDataRootSignature, sizeof(featureDataRootSignature)));
 
     // Descriptors
     std::array<D3D12_DESCRIPTOR_RANGE1, 2> descriptorRanges;
@@ -172,12 +627,35 @@ void Renderer::initializeResources()
     descriptorRanges[1].OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND;
 
     // Groups of GPU Resources
-    std::array<D3D12_ROOT_PARAMETER1, 1> rootParameters;
+    std::array<D3D12_ROOT_PARAMETER1, 6> rootParameters;
     rootParameters[0].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
     rootParameters[0].ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
     rootParameters[0].DescriptorTable.NumDescriptorRanges = descriptorRanges.size();
     rootParameters[0].DescriptorTable.pDescriptorRanges = descriptorRanges.data();
 
+    // The scene transform changes every frame so it is passed as root constants
+    rootParameters[1].ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS;
+    rootParameters[1].ShaderVisibility = D3D12_SHADER_VISIBILITY_VERTEX;
+    rootParameters[1].Constants.ShaderRegister = 1;
+    rootParameters[1].Constants.RegisterSpace = 0;
+    rootParameters[1].Constants.Num32BitValues = _countof(m_sceneConstants);
+
+    // Lights, cluster ranges and the light index list, rewritten every frame in an upload buffer
+    for (UINT i = 0; i < 3; ++i)
+    {
+        rootParameters[2 + i].ParameterType = D3D12_ROOT_PARAMETER_TYPE_SRV;
+        rootParameters[2 + i].ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
+        rootParameters[2 + i].Descriptor.ShaderRegister = i;
+        rootParameters[2 + i].Descriptor.RegisterSpace = 0;
+        rootParameters[2 + i].Descriptor.Flags = D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE;
+    }
+
+    rootParameters[5].ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS;
+    rootParameters[5].ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
+    rootParameters[5].Constants.ShaderRegister = 2;
+    rootParameters[5].Constants.RegisterSpace = 0;
+    rootParameters[5].Constants.Num32BitValues = sizeof(LightingConstants) / sizeof(uint32_t);
+
     // Allow input layout and deny uneccessary access to hull, domain and geometry shaders
     D3D12_ROOT_SIGNATURE_FLAGS rootSignatureFlags =
         D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT |
@@ -208,20 +686,18 @@ void Renderer::initializeResources()
         std::cout << errStr << std::endl;
         throw e;
     }
+}
 
-    // Load Shaders
-    //// Get current working directory
-    //char pBuf[1024];
-    //_getcwd(pBuf, 1024);
-    //OutputDebugString(L"test\n");
-    // TODO: dynamically get compile path
-    std::wstring baseCompilePathW = L"C:\\Users\\adi_1\\Documents\\Github\\DirectX12-Engine\\DirectX12-Engine\\x64\\Debug\\AppX";
-
-    std::wstring vertCompiledPathW = baseCompilePathW + L"\\VertexShader.cso";
-    std::wstring pixelCompiledPathW = baseCompilePathW + L"\\PixelShader.cso";
-    BasicReaderWriter m_basicReaderWriter;
-    std::vector<byte> vertexShaderBytecode{ m_basicReaderWriter.ReadData(vertCompiledPathW.c_str()) };
-    std::vector<byte> pixelShaderBytecode{ m_basicReaderWriter.ReadData(pixelCompiledPathW.c_str()) };
+void Renderer::createScenePipeline()
+{
+    // Shaders were read by their own startup tasks
+    const std::vector<byte> &vertexShaderBytecode = m_shaderBytecode[SceneVertexShader];
+    const std::vector<byte> &pixelShaderBytecode = m_shaderBytecode[ScenePixelShader];
+    checkShaderBinding(ShaderNames[SceneVertexShader], "SceneConstants", "cb1", _countof(m_sceneConstants));
+    checkShaderBinding(ShaderNames[ScenePixelShader], "lights", "t0");
+    checkShaderBinding(ShaderNames[ScenePixelShader], "clusters", "t1");
+    checkShaderBinding(ShaderNames[ScenePixelShader], "lightIndices", "t2");
+    checkShaderBinding(ShaderNames[ScenePixelShader], "LightingConstants", "cb2", sizeof(LightingConstants) / sizeof(uint32_t));
 
     D3D12_SHADER_BYTECODE vsBytecode;
     D3D12_SHADER_BYTECODE psBytecode;
@@ -238,61 +714,384 @@ void Renderer::initializeResources()
     };
 
     // Describe and create the graphics pipeline state object (PSO).
-    D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc = {};
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc = createBasePipelineDesc();
     psoDesc.InputLayout = { inputElementDescs, _countof(inputElementDescs) };
     psoDesc.pRootSignature = m_rootSignature.get();
     psoDesc.VS = vsBytecode;
     psoDesc.PS = psBytecode;
 
-    D3D12_RASTERIZER_DESC rasterDesc;
-    rasterDesc.FillMode = D3D12_FILL_MODE_SOLID;
-    rasterDesc.CullMode = D3D12_CULL_MODE_NONE;
-    rasterDesc.FrontCounterClockwise = FALSE;
-    rasterDesc.DepthBias = D3D12_DEFAULT_DEPTH_BIAS;
-    rasterDesc.DepthBiasClamp = D3D12_DEFAULT_DEPTH_BIAS_CLAMP;
-    rasterDesc.SlopeScaledDepthBias = D3D12_DEFAULT_SLOPE_SCALED_DEPTH_BIAS;
-    rasterDesc.DepthClipEnable = TRUE;
-    rasterDesc.MultisampleEnable = FALSE;
-    rasterDesc.AntialiasedLineEnable = FALSE;
-    rasterDesc.ForcedSampleCount = 0;
-    rasterDesc.ConservativeRaster = D3D12_CONSERVATIVE_RASTERIZATION_MODE_OFF;
-
-    psoDesc.RasterizerState = rasterDesc;
-
-    D3D12_BLEND_DESC blendDesc;
-    blendDesc.AlphaToCoverageEnable = FALSE;
-    blendDesc.IndependentBlendEnable = FALSE;
-    const D3D12_RENDER_TARGET_BLEND_DESC defaultRenderTargetBlendDesc = {
-        FALSE,
-        FALSE,
-        D3D12_BLEND_ONE,
-        D3D12_BLEND_ZERO,
-        D3D12_BLEND_OP_ADD,
-        D3D12_BLEND_ONE,
-        D3D12_BLEND_ZERO,
-        D3D12_BLEND_OP_ADD,
-        D3D12_LOGIC_OP_NOOP,
-        D3D12_COLOR_WRITE_ENABLE_ALL,
+    winrt::check_hresult(m_device->CreateGraphicsPipelineState(&psoDesc, __uuidof(m_pipelineState), m_pipelineState.put_void()));
+}
+
+void Renderer::createUpscaleRootSignature()
+{
+    // Create the upscale root signature, the scene texture is sampled through a static linear sampler
+    D3D12_DESCRIPTOR_RANGE1 sceneTextureRange;
+    sceneTextureRange.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SRV;
+    sceneTextureRange.NumDescriptors = 1;
+    sceneTextureRange.BaseShaderRegister = 0;
+    sceneTextureRange.RegisterSpace = 0;
+    sceneTextureRange.Flags = D3D12_DESCRIPTOR_RANGE_FLAG_NONE;
+    sceneTextureRange.OffsetInDescriptorsFromTableStart = 0;
+
+    std::array<D3D12_ROOT_PARAMETER1, 2> upscaleRootParameters;
+    upscaleRootParameters[0].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
+    upscaleRootParameters[0].ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
+    upscaleRootParameters[0].DescriptorTable.NumDescriptorRanges = 1;
+    upscaleRootParameters[0].DescriptorTable.pDescriptorRanges = &sceneTextureRange;
+
+    upscaleRootParameters[1].ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS;
+    upscaleRootParameters[1].ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
+    upscaleRootParameters[1].Constants.ShaderRegister = 0;
+    upscaleRootParameters[1].Constants.RegisterSpace = 0;
+    upscaleRootParameters[1].Constants.Num32BitValues = 4; // uvScale and uvClamp
+
+    const D3D12_STATIC_SAMPLER_DESC linearSampler = createLinearSamplerDesc();
+
+    // The fullscreen triangle is generated in the vertex shader so no input layout is needed
+    D3D12_VERSIONED_ROOT_SIGNATURE_DESC upscaleRootSignatureDesc;
+    upscaleRootSignatureDesc.Version = D3D_ROOT_SIGNATURE_VERSION_1_1;
+    upscaleRootSignatureDesc.Desc_1_1.Flags =
+        D3D12_ROOT_SIGNATURE_FLAG_DENY_HULL_SHADER_ROOT_ACCESS |
+        D3D12_ROOT_SIGNATURE_FLAG_DENY_DOMAIN_SHADER_ROOT_ACCESS |
+        D3D12_ROOT_SIGNATURE_FLAG_DENY_GEOMETRY_SHADER_ROOT_ACCESS;
+    upscaleRootSignatureDesc.Desc_1_1.NumParameters = upscaleRootParameters.size();
+    upscaleRootSignatureDesc.Desc_1_1.pParameters = upscaleRootParameters.data();
+    upscaleRootSignatureDesc.Desc_1_1.NumStaticSamplers = 1;
+    upscaleRootSignatureDesc.Desc_1_1.pStaticSamplers = &linearSampler;
+
+    winrt::com_ptr<ID3DBlob> upscaleSignature;
+    winrt::com_ptr<ID3DBlob> upscaleError;
+
+    try
+    {
+        winrt::check_hresult(D3D12SerializeVersionedRootSignature(&upscaleRootSignatureDesc, upscaleSignature.put(), upscaleError.put()));
+        winrt::check_hresult(m_device->CreateRootSignature(0, upscaleSignature->GetBufferPointer(), upscaleSignature->GetBufferSize(), __uuidof(m_upscaleRootSignature), m_upscaleRootSignature.put_void()));
+    }
+    catch (std::exception e)
+    {
+        const char *errStr = (const char *)upscaleError->GetBufferPointer();
+        std::cout << errStr << std::endl;
+        throw e;
+    }
+}
+
+void Renderer::createUpscalePipeline()
+{
+    // Create the upscale pipeline, it has the raster and blend state of the scene pipeline
+    const std::vector<byte> &upscaleVertexShaderBytecode = m_shaderBytecode[UpscaleVertexShader];
+    const std::vector<byte> &upscalePixelShaderBytecode = m_shaderBytecode[UpscalePixelShader];
+    checkShaderBinding(ShaderNames[UpscalePixelShader], "UpscaleConstants", "cb0", 4u);
+
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC upscalePsoDesc = createBasePipelineDesc();
+    upscalePsoDesc.InputLayout = { nullptr, 0 };
+    upscalePsoDesc.pRootSignature = m_upscaleRootSignature.get();
+    upscalePsoDesc.VS.pShaderBytecode = upscaleVertexShaderBytecode.data();
+    upscalePsoDesc.VS.BytecodeLength = upscaleVertexShaderBytecode.size();
+    upscalePsoDesc.PS.pShaderBytecode = upscalePixelShaderBytecode.data();
+    upscalePsoDesc.PS.BytecodeLength = upscalePixelShaderBytecode.size();
+
+    winrt::check_hresult(m_device->CreateGraphicsPipelineState(&upscalePsoDesc, __uuidof(m_upscalePipelineState), m_upscalePipelineState.put_void()));
+}
+
+void Renderer::createSpriteRootSignature()
+{
+    // Create the sprite root signature, the atlas uses the same static linear sampler as the upscale pass
+    D3D12_DESCRIPTOR_RANGE1 spriteAtlasRange;
+    spriteAtlasRange.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SRV;
+    spriteAtlasRange.NumDescriptors = 1;
+    spriteAtlasRange.BaseShaderRegister = 0;
+    spriteAtlasRange.RegisterSpace = 0;
+    spriteAtlasRange.Flags = D3D12_DESCRIPTOR_RANGE_FLAG_NONE;
+    spriteAtlasRange.OffsetInDescriptorsFromTableStart = 0;
+
+    std::array<D3D12_ROOT_PARAMETER1, 2> spriteRootParameters;
+    spriteRootParameters[0].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
+    spriteRootParameters[0].ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
+    spriteRootParameters[0].DescriptorTable.NumDescriptorRanges = 1;
+    spriteRootParameters[0].DescriptorTable.pDescriptorRanges = &spriteAtlasRange;
+
+    spriteRootParameters[1].ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS;
+    spriteRootParameters[1].ShaderVisibility = D3D12_SHADER_VISIBILITY_VERTEX;
+    spriteRootParameters[1].Constants.ShaderRegister = 0;
+    spriteRootParameters[1].Constants.RegisterSpace = 0;
+    spriteRootParameters[1].Constants.Num32BitValues = 2; // invTargetSize
+
+    const D3D12_STATIC_SAMPLER_DESC linearSampler = createLinearSamplerDesc();
+
+    // Sprites read their instances through the input assembler like the scene reads its vertices
+    D3D12_VERSIONED_ROOT_SIGNATURE_DESC spriteRootSignatureDesc;
+    spriteRootSignatureDesc.Version = D3D_ROOT_SIGNATURE_VERSION_1_1;
+    spriteRootSignatureDesc.Desc_1_1.Flags =
+        D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT |
+        D3D12_ROOT_SIGNATURE_FLAG_DENY_HULL_SHADER_ROOT_ACCESS |
+        D3D12_ROOT_SIGNATURE_FLAG_DENY_DOMAIN_SHADER_ROOT_ACCESS |
+        D3D12_ROOT_SIGNATURE_FLAG_DENY_GEOMETRY_SHADER_ROOT_ACCESS;
+    spriteRootSignatureDesc.Desc_1_1.NumParameters = spriteRootParameters.size();
+    spriteRootSignatureDesc.Desc_1_1.pParameters = spriteRootParameters.data();
+    spriteRootSignatureDesc.Desc_1_1.NumStaticSamplers = 1;
+    spriteRootSignatureDesc.Desc_1_1.pStaticSamplers = &linearSampler;
+
+    winrt::com_ptr<ID3DBlob> spriteSignature;
+    winrt::com_ptr<ID3DBlob> spriteError;
+
+    try
+    {
+        winrt::check_hresult(D3D12SerializeVersionedRootSignature(&spriteRootSignatureDesc, spriteSignature.put(), spriteError.put()));
+        winrt::check_hresult(m_device->CreateRootSignature(0, spriteSignature->GetBufferPointer(), spriteSignature->GetBufferSize(), __uuidof(m_spriteRootSignature), m_spriteRootSignature.put_void()));
+    }
+    catch (std::exception e)
+    {
+        const char *errStr = (const char *)spriteError->GetBufferPointer();
+        std::cout << errStr << std::endl;
+        throw e;
+    }
+}
+
+void Renderer::createSpritePipeline()
+{
+    // Create the sprite pipeline, every element comes from the instance buffer and the quad corners from the vertex id
+    const std::vector<byte> &spriteVertexShaderBytecode = m_shaderBytecode[SpriteVertexShader];
+    const std::vector<byte> &spritePixelShaderBytecode = m_shaderBytecode[SpritePixelShader];
+    checkShaderBinding(ShaderNames[SpriteVertexShader], "SpriteConstants", "cb0", 2u);
+
+    D3D12_INPUT_ELEMENT_DESC spriteInputElementDescs[] =
+    {
+        {"POSITION", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1},
+        {"SIZE", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 8, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1},
+        {"TEXCOORD", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 16, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1},
+        {"COLOR", 0, DXGI_FORMAT_R8G8B8A8_UNORM, 0, 32, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1}
     };
-    for (UINT i = 0; i < D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT; ++i)
-        blendDesc.RenderTarget[i] = defaultRenderTargetBlendDesc;
-
-    psoDesc.BlendState = blendDesc;
-    psoDesc.DepthStencilState.DepthEnable = FALSE;
-    psoDesc.DepthStencilState.StencilEnable = FALSE;
-    psoDesc.SampleMask = UINT_MAX;
-    psoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
-    psoDesc.NumRenderTargets = 1;
-    psoDesc.RTVFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM;
-    psoDesc.SampleDesc.Count = 1;
 
-    winrt::check_hresult(m_device->CreateGraphicsPipelineState(&psoDesc, __uuidof(m_pipelineState), m_pipelineState.put_void()));
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC spritePsoDesc = createBasePipelineDesc();
+    spritePsoDesc.InputLayout = { spriteInputElementDescs, _countof(spriteInputElementDescs) };
+    spritePsoDesc.pRootSignature = m_spriteRootSignature.get();
+    spritePsoDesc.VS.pShaderBytecode = spriteVertexShaderBytecode.data();
+    spritePsoDesc.VS.BytecodeLength = spriteVertexShaderBytecode.size();
+    spritePsoDesc.PS.pShaderBytecode = spritePixelShaderBytecode.data();
+    spritePsoDesc.PS.BytecodeLength = spritePixelShaderBytecode.size();
+
+    // Sprites are alpha blended over the scene
+    spritePsoDesc.BlendState.RenderTarget[0].BlendEnable = TRUE;
+    spritePsoDesc.BlendState.RenderTarget[0].SrcBlend = D3D12_BLEND_SRC_ALPHA;
+    spritePsoDesc.BlendState.RenderTarget[0].DestBlend = D3D12_BLEND_INV_SRC_ALPHA;
+    spritePsoDesc.BlendState.RenderTarget[0].SrcBlendAlpha = D3D12_BLEND_ONE;
+    spritePsoDesc.BlendState.RenderTarget[0].DestBlendAlpha = D3D12_BLEND_INV_SRC_ALPHA;
+
+    winrt::check_hresult(m_device->CreateGraphicsPipelineState(&spritePsoDesc, __uuidof(m_spritePipelineState), m_spritePipelineState.put_void()));
+}
+
+void Renderer::createParticleRootSignature()
+{
+    // Create the particle root signature, shared by the compute passes and the billboard draw.
+    // Every buffer is bound as a root descriptor so no descriptors are needed.
+    std::array<D3D12_ROOT_PARAMETER1, 10> particleRootParameters;
+    particleRootParameters[0].ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS;
+    particleRootParameters[0].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
+    particleRootParameters[0].Constants.ShaderRegister = 0;
+    particleRootParameters[0].Constants.RegisterSpace = 0;
+    particleRootParameters[0].Constants.Num32BitValues = sizeof(ParticleFrameConstants) / sizeof(uint32_t);
+
+    // Particles, current alive list, next alive list, dead list, counters and indirect arguments
+    for (UINT i = 0; i < 6; ++i)
+    {
+        particleRootParameters[1 + i].ParameterType = D3D12_ROOT_PARAMETER_TYPE_UAV;
+        particleRootParameters[1 + i].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
+        particleRootParameters[1 + i].Descriptor.ShaderRegister = i;
+        particleRootParameters[1 + i].Descriptor.RegisterSpace = 0;
+        particleRootParameters[1 + i].Descriptor.Flags = D3D12_ROOT_DESCRIPTOR_FLAG_DATA_VOLATILE;
+    }
+
+    // Particles and the alive list for the billboards
+    for (UINT i = 0; i < 2; ++i)
+    {
+        particleRootParameters[7 + i].ParameterType = D3D12_ROOT_PARAMETER_TYPE_SRV;
+        particleRootParameters[7 + i].ShaderVisibility = D3D12_SHADER_VISIBILITY_VERTEX;
+        particleRootParameters[7 + i].Descriptor.ShaderRegister = i;
+        particleRootParameters[7 + i].Descriptor.RegisterSpace = 0;
+        particleRootParameters[7 + i].Descriptor.Flags = D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE;
+    }
+
+    particleRootParameters[9].ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS;
+    particleRootParameters[9].ShaderVisibility = D3D12_SHADER_VISIBILITY_VERTEX;
+    particleRootParameters[9].Constants.ShaderRegister = 1;
+    particleRootParameters[9].Constants.RegisterSpace = 0;
+    particleRootParameters[9].Constants.Num32BitValues = 6; // worldToClipScale, worldToClipOffset and billboardSize
+
+    // Billboards are generated from the vertex and instance ids so no input layout is needed
+    D3D12_VERSIONED_ROOT_SIGNATURE_DESC particleRootSignatureDesc;
+    particleRootSignatureDesc.Version = D3D_ROOT_SIGNATURE_VERSION_1_1;
+    particleRootSignatureDesc.Desc_1_1.Flags =
+        D3D12_ROOT_SIGNATURE_FLAG_DENY_HULL_SHADER_ROOT_ACCESS |
+        D3D12_ROOT_SIGNATURE_FLAG_DENY_DOMAIN_SHADER_ROOT_ACCESS |
+        D3D12_ROOT_SIGNATURE_FLAG_DENY_GEOMETRY_SHADER_ROOT_ACCESS;
+    particleRootSignatureDesc.Desc_1_1.NumParameters = particleRootParameters.size();
+    particleRootSignatureDesc.Desc_1_1.pParameters = particleRootParameters.data();
+    particleRootSignatureDesc.Desc_1_1.NumStaticSamplers = 0;
+    particleRootSignatureDesc.Desc_1_1.pStaticSamplers = nullptr;
+
+    winrt::com_ptr<ID3DBlob> particleSignature;
+    winrt::com_ptr<ID3DBlob> particleError;
+
+    try
+    {
+        winrt::check_hresult(D3D12SerializeVersionedRootSignature(&particleRootSignatureDesc, particleSignature.put(), particleError.put()));
+        winrt::check_hresult(m_device->CreateRootSignature(0, particleSignature->GetBufferPointer(), particleSignature->GetBufferSize(), __uuidof(m_particleRootSignature), m_particleRootSignature.put_void()));
+    }
+    catch (std::exception e)
+    {
+        const char *errStr = (const char *)particleError->GetBufferPointer();
+        std::cout << errStr << std::endl;
+        throw e;
+    }
+
+    // The simulation dispatch and the billboard draw read their sizes from the argument buffer
+    D3D12_INDIRECT_ARGUMENT_DESC particleDispatchArgument = {};
+    particleDispatchArgument.Type = D3D12_INDIRECT_ARGUMENT_TYPE_DISPATCH;
+
+    D3D12_COMMAND_SIGNATURE_DESC particleDispatchSignatureDesc = {};
+    particleDispatchSignatureDesc.ByteStride = sizeof(D3D12_DISPATCH_ARGUMENTS);
+    particleDispatchSignatureDesc.NumArgumentDescs = 1;
+    particleDispatchSignatureDesc.pArgumentDescs = &particleDispatchArgument;
+    winrt::check_hresult(m_device->CreateCommandSignature(&particleDispatchSignatureDesc, nullptr, __uuidof(m_particleDispatchSignature), m_particleDispatchSignature.put_void()));
+
+    D3D12_INDIRECT_ARGUMENT_DESC particleDrawArgument = {};
+    particleDrawArgument.Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW;
+
+    D3D12_COMMAND_SIGNATURE_DESC particleDrawSignatureDesc = {};
+    particleDrawSignatureDesc.ByteStride = sizeof(D3D12_DRAW_ARGUMENTS);
+    particleDrawSignatureDesc.NumArgumentDescs = 1;
+    particleDrawSignatureDesc.pArgumentDescs = &particleDrawArgument;
+    winrt::check_hresult(m_device->CreateCommandSignature(&particleDrawSignatureDesc, nullptr, __uuidof(m_particleDrawSignature), m_particleDrawSignature.put_void()));
+}
+
+// Create the compute pipeline of one particle pass, in the order the passes run
+void Renderer::createParticlePassPipeline(UINT pass)
+{
+    static_assert(ParticleVertexShader - ParticlePassShader == ParticlePassCount, "Every particle pass needs its shader");
+
+    const std::vector<byte> &particlePassBytecode = m_shaderBytecode[ParticlePassShader + pass];
+
+    D3D12_COMPUTE_PIPELINE_STATE_DESC particlePassPsoDesc = {};
+    particlePassPsoDesc.pRootSignature = m_particleRootSignature.get();
+    particlePassPsoDesc.CS.pShaderBytecode = particlePassBytecode.data();
+    particlePassPsoDesc.CS.BytecodeLength = particlePassBytecode.size();
+
+    winrt::check_hresult(m_device->CreateComputePipelineState(&particlePassPsoDesc, __uuidof(m_particlePassPipelineStates[pass]), m_particlePassPipelineStates[pass].put_void()));
+}
+
+void Renderer::createParticleDrawPipeline()
+{
+    // Create the billboard pipeline, particles are additively blended so they need no sorting
+    const std::vector<byte> &particleVertexShaderBytecode = m_shaderBytecode[ParticleVertexShader];
+    const std::vector<byte> &particlePixelShaderBytecode = m_shaderBytecode[ParticlePixelShader];
+    checkShaderBinding(ShaderNames[ParticleVertexShader], "ParticleDrawConstants", "cb1", 6u);
+
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC particlePsoDesc = createBasePipelineDesc();
+    particlePsoDesc.InputLayout = { nullptr, 0 };
+    particlePsoDesc.pRootSignature = m_particleRootSignature.get();
+    particlePsoDesc.VS.pShaderBytecode = particleVertexShaderBytecode.data();
+    particlePsoDesc.VS.BytecodeLength = particleVertexShaderBytecode.size();
+    particlePsoDesc.PS.pShaderBytecode = particlePixelShaderBytecode.data();
+    particlePsoDesc.PS.BytecodeLength = particlePixelShaderBytecode.size();
+    particlePsoDesc.BlendState.RenderTarget[0].BlendEnable = TRUE;
+    particlePsoDesc.BlendState.RenderTarget[0].SrcBlend = D3D12_BLEND_SRC_ALPHA;
+    particlePsoDesc.BlendState.RenderTarget[0].DestBlend = D3D12_BLEND_ONE;
+    particlePsoDesc.BlendState.RenderTarget[0].SrcBlendAlpha = D3D12_BLEND_ZERO;
+    particlePsoDesc.BlendState.RenderTarget[0].DestBlendAlpha = D3D12_BLEND_ONE;
+
+    winrt::check_hresult(m_device->CreateGraphicsPipelineState(&particlePsoDesc, __uuidof(m_particleDrawPipelineState), m_particleDrawPipelineState.put_void()));
+}
+
+void Renderer::createTerrainRootSignature()
+{
+    // Create the terrain root signature, the heights of every cache slot are one raw buffer bound as a root SRV
+    std::array<D3D12_ROOT_PARAMETER1, 2> terrainRootParameters;
+    terrainRootParameters[0].ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS;
+    terrainRootParameters[0].ShaderVisibility = D3D12_SHADER_VISIBILITY_VERTEX;
+    terrainRootParameters[0].Constants.ShaderRegister = 0;
+    terrainRootParameters[0].Constants.RegisterSpace = 0;
+    terrainRootParameters[0].Constants.Num32BitValues = sizeof(TerrainConstants) / sizeof(uint32_t);
+
+    terrainRootParameters[1].ParameterType = D3D12_ROOT_PARAMETER_TYPE_SRV;
+    terrainRootParameters[1].ShaderVisibility = D3D12_SHADER_VISIBILITY_VERTEX;
+    terrainRootParameters[1].Descriptor.ShaderRegister = 0;
+    terrainRootParameters[1].Descriptor.RegisterSpace = 0;
+    terrainRootParameters[1].Descriptor.Flags = D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE;
+
+    // The grid comes through the input assembler per vertex and the patches per instance
+    D3D12_VERSIONED_ROOT_SIGNATURE_DESC terrainRootSignatureDesc;
+    terrainRootSignatureDesc.Version = D3D_ROOT_SIGNATURE_VERSION_1_1;
+    terrainRootSignatureDesc.Desc_1_1.Flags =
+        D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT |
+        D3D12_ROOT_SIGNATURE_FLAG_DENY_HULL_SHADER_ROOT_ACCESS |
+        D3D12_ROOT_SIGNATURE_FLAG_DENY_DOMAIN_SHADER_ROOT_ACCESS |
+        D3D12_ROOT_SIGNATURE_FLAG_DENY_GEOMETRY_SHADER_ROOT_ACCESS;
+    terrainRootSignatureDesc.Desc_1_1.NumParameters = terrainRootParameters.size();
+    terrainRootSignatureDesc.Desc_1_1.pParameters = terrainRootParameters.data();
+    terrainRootSignatureDesc.Desc_1_1.NumStaticSamplers = 0;
+    terrainRootSignatureDesc.Desc_1_1.pStaticSamplers = nullptr;
+
+    winrt::com_ptr<ID3DBlob> terrainSignature;
+    winrt::com_ptr<ID3DBlob> terrainError;
+
+    try
+    {
+        winrt::check_hresult(D3D12SerializeVersionedRootSignature(&terrainRootSignatureDesc, terrainSignature.put(), terrainError.put()));
+        winrt::check_hresult(m_device->CreateRootSignature(0, terrainSignature->GetBufferPointer(), terrainSignature->GetBufferSize(), __uuidof(m_terrainRootSignature), m_terrainRootSignature.put_void()));
+    }
+    catch (std::exception e)
+    {
+        const char *errStr = (const char *)terrainError->GetBufferPointer();
+        std::cout << errStr << std::endl;
+        throw e;
+    }
+}
+
+void Renderer::createTerrainPipeline()
+{
+    // Create the terrain pipeline, the instance elements follow TerrainPatch
+    const std::vector<byte> &terrainVertexShaderBytecode = m_shaderBytecode[TerrainVertexShader];
+    const std::vector<byte> &terrainPixelShaderBytecode = m_shaderBytecode[TerrainPixelShader];
+    checkShaderBinding(ShaderNames[TerrainVertexShader], "TerrainConstants", "cb0", sizeof(TerrainConstants) / sizeof(uint32_t));
+    checkShaderBinding(ShaderNames[TerrainVertexShader], "heights", "t0");
+
+    D3D12_INPUT_ELEMENT_DESC terrainInputElementDescs[] =
+    {
+        {"GRID", 0, DXGI_FORMAT_R16G16_UINT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0},
+        {"ORIGIN", 0, DXGI_FORMAT_R32G32_FLOAT, 1, 0, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1},
+        {"SIZE", 0, DXGI_FORMAT_R32_FLOAT, 1, 8, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1},
+        {"SLOT", 0, DXGI_FORMAT_R32_UINT, 1, 12, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1},
+        {"STITCH", 0, DXGI_FORMAT_R32_UINT, 1, 16, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1}
+    };
 
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC terrainPsoDesc = createBasePipelineDesc();
+    terrainPsoDesc.InputLayout = { terrainInputElementDescs, _countof(terrainInputElementDescs) };
+    terrainPsoDesc.pRootSignature = m_terrainRootSignature.get();
+    terrainPsoDesc.VS.pShaderBytecode = terrainVertexShaderBytecode.data();
+    terrainPsoDesc.VS.BytecodeLength = terrainVertexShaderBytecode.size();
+    terrainPsoDesc.PS.pShaderBytecode = terrainPixelShaderBytecode.data();
+    terrainPsoDesc.PS.BytecodeLength = terrainPixelShaderBytecode.size();
+
+    // The terrain is the only depth tested geometry, everything drawn after it goes on top
+    terrainPsoDesc.DepthStencilState.DepthEnable = TRUE;
+    terrainPsoDesc.DepthStencilState.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ALL;
+    terrainPsoDesc.DepthStencilState.DepthFunc = D3D12_COMPARISON_FUNC_LESS;
+    terrainPsoDesc.DSVFormat = DXGI_FORMAT_D32_FLOAT;
+
+    winrt::check_hresult(m_device->CreateGraphicsPipelineState(&terrainPsoDesc, __uuidof(m_terrainPipelineState), m_terrainPipelineState.put_void()));
+}
 
+void Renderer::createCommandList()
+{
     // Create the command list.
     winrt::check_hresult(m_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, m_commandAllocators[m_frameIndex].get(), m_pipelineState.get(), __uuidof(m_graphicsCommandList), m_graphicsCommandList.put_void()));
     winrt::check_hresult(m_graphicsCommandList->Close());
+    m_commandListState.attach(m_graphicsCommandList.get());
+}
 
+void Renderer::createConstantBuffers()
+{
     // Create the Constant buffer
     m_uniformBufferData.resize(64); // TODO CHANGE THIS
     std::fill(m_uniformBufferData.begin(), m_uniformBufferData.end(), 0.5f);
@@ -323,6 +1122,7 @@ void Renderer::initializeResources()
         &constantBufferHeapProps, D3D12_HEAP_FLAG_NONE, &uboResourceDesc,
         D3D12_RESOURCE_STATE_GENERIC_READ, nullptr,
         __uuidof(m_uniformBuffer), m_uniformBuffer.put_void()));
+    trackResource(m_uniformBuffer.get(), "uniform buffer", GpuResourceCategory::Constants, GPU_RESOURCE_SOURCE);
 
     std::array<D3D12_CONSTANT_BUFFER_VIEW_DESC, 1> cbvDesc;
     cbvDesc[0].BufferLocation = m_uniformBuffer->GetGPUVirtualAddress();
@@ -346,8 +1146,8 @@ void Renderer::initializeResources()
     {
         D3D12_RESOURCE_DESC texDesc = {};
         texDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
-        texDesc.Width = winrt::Windows::UI::Core::CoreWindow::GetForCurrentThread().Bounds().Width;
-        texDesc.Height = winrt::Windows::UI::Core::CoreWindow::GetForCurrentThread().Bounds().Height;
+        texDesc.Width = static_cast<UINT64>(m_surfaceSize.right); // The window's size, the window itself belongs to the main thread
+        texDesc.Height = static_cast<UINT>(m_surfaceSize.bottom);
         texDesc.DepthOrArraySize = 1;
         texDesc.MipLevels = 1;
         texDesc.Format = DXGI_FORMAT_R32_FLOAT; // Note that R32__FLOAT, R32_UINT and R32_SINT are the only guarenteed supported formats for uavs, otherwise you have to query for support (see https://logins.github.io/graphics/2020/10/31/D3D12ComputeShaders.html)
@@ -366,6 +1166,7 @@ void Renderer::initializeResources()
             &uavHeapProps, D3D12_HEAP_FLAG_NONE, &texDesc,
             D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr,
             __uuidof(m_uavBuffer), m_uavBuffer.put_void()));
+        trackResource(m_uavBuffer.get(), "uav buffer", GpuResourceCategory::UnorderedAccess, GPU_RESOURCE_SOURCE);
 
         std::array<D3D12_UNORDERED_ACCESS_VIEW_DESC, 1> uavDesc;
         uavDesc[0].ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
@@ -440,7 +1241,10 @@ void Renderer::initializeResources()
         m_commandQueue->ExecuteCommandLists(_countof(ppGraphicsCommandLists), ppGraphicsCommandLists);
         */
     }
+}
 
+void Renderer::createGeometry()
+{
     // Create the vertex buffer.
     const UINT vertexBufferSize = sizeof(mVertexBufferData);
 
@@ -474,6 +1278,7 @@ void Renderer::initializeResources()
         D3D12_RESOURCE_STATE_GENERIC_READ, nullptr,
         __uuidof(m_vertexBuffer), m_vertexBuffer.put_void())
     );
+    trackResource(m_vertexBuffer.get(), "vertex buffer", GpuResourceCategory::Geometry, GPU_RESOURCE_SOURCE);
 
     // Copy the triangle data to the vertex buffer.
     UINT8 *pVertexDataBegin;
@@ -524,6 +1329,7 @@ void Renderer::initializeResources()
         &indexHeapProps, D3D12_HEAP_FLAG_NONE, &indexBufferResourceDesc,
         D3D12_RESOURCE_STATE_GENERIC_READ, nullptr,
         __uuidof(m_indexBuffer), m_indexBuffer.put_void()));
+    trackResource(m_indexBuffer.get(), "index buffer", GpuResourceCategory::Geometry, GPU_RESOURCE_SOURCE);
 
     UINT8 *pIndexDataBegin;
 
@@ -540,21 +1346,964 @@ void Renderer::initializeResources()
     m_indexBufferView.BufferLocation = m_indexBuffer->GetGPUVirtualAddress();
     m_indexBufferView.Format = DXGI_FORMAT_R32_UINT;
     m_indexBufferView.SizeInBytes = indexBufferSize;
+}
 
-    // Initialize fence values
-    for (UINT i = 0; i < FrameCount; ++i)
-    {
-        m_fenceValues[i] = 0u;
-    }
+void Renderer::initializeOcclusionCulling()
+{
+    m_workerPool = std::make_unique<WorkerPool>();
 
-    // Create an event handle to use for frame synchronization.
-    m_fenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
-    if (m_fenceEvent == nullptr)
+    // The depth buffer only needs to be coarse, a quarter of the surface resolution is plenty
+    const UINT cullWidth = (std::max)(static_cast<UINT>(m_surfaceSize.right) / 4u, 1u);
+    const UINT cullHeight = (std::max)(static_cast<UINT>(m_surfaceSize.bottom) / 4u, 1u);
+    m_occlusionCuller = std::make_unique<OcclusionCuller>(cullWidth, cullHeight, m_workerPool.get());
+
+    updateSceneConstants(createInitialSceneState());
+}
+
+// Build the triangle transform for this frame and the clip space bounds its view test uses.
+void Renderer::updateSceneConstants(const SceneState &scene)
+{
+    // Rotate in a space with square pixels so the triangle does not shear on wide windows
+    const float aspect = m_viewport.Width / m_viewport.Height;
+    const float c = std::cos(scene.triangleRotation) * scene.triangleScale;
+    const float s = std::sin(scene.triangleRotation) * scene.triangleScale;
+
+    m_sceneConstants[0] = c;
+    m_sceneConstants[1] = -s / aspect;
+    m_sceneConstants[2] = s * aspect;
+    m_sceneConstants[3] = c;
+    m_sceneConstants[4] = scene.triangleOffset[0];
+    m_sceneConstants[5] = scene.triangleOffset[1];
+
+    // The vertex shader only applies this transform, so the result is in clip space with w = 1
+    float minBounds[3] = {};
+    float maxBounds[3] = {};
+    for (UINT i = 0; i < _countof(mVertexBufferData); ++i)
     {
-        winrt::check_hresult(HRESULT_FROM_WIN32(GetLastError()));
+        const float *position = mVertexBufferData[i].position;
+        const float transformed[3] =
+        {
+            m_sceneConstants[0] * position[0] + m_sceneConstants[1] * position[1] + m_sceneConstants[4],
+            m_sceneConstants[2] * position[0] + m_sceneConstants[3] * position[1] + m_sceneConstants[5],
+            position[2]
+        };
+
+        for (UINT axis = 0; axis < 3; ++axis)
+        {
+            minBounds[axis] = i == 0 ? transformed[axis] : (std::min)(minBounds[axis], transformed[axis]);
+            maxBounds[axis] = i == 0 ? transformed[axis] : (std::max)(maxBounds[axis], transformed[axis]);
+        }
     }
 
-    waitForGpu();
+    for (UINT corner = 0; corner < 8; ++corner)
+    {
+        m_triangleClipBounds[corner][0] = (corner & 1) ? maxBounds[0] : minBounds[0];
+        m_triangleClipBounds[corner][1] = (corner & 2) ? maxBounds[1] : minBounds[1];
+        m_triangleClipBounds[corner][2] = (corner & 4) ? maxBounds[2] : minBounds[2];
+        m_triangleClipBounds[corner][3] = 1.0f;
+    }
+}
+
+void Renderer::initializeDynamicResolution()
+{
+    m_renderScale = m_resolutionScaleController.getScale();
+
+    // Create the scene target at the full surface size, lower resolutions only use part of it
+    D3D12_RESOURCE_DESC sceneTargetDesc = {};
+    sceneTargetDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+    sceneTargetDesc.Width = static_cast<UINT64>(m_surfaceSize.right);
+    sceneTargetDesc.Height = static_cast<UINT>(m_surfaceSize.bottom);
+    sceneTargetDesc.DepthOrArraySize = 1;
+    sceneTargetDesc.MipLevels = 1;
+    sceneTargetDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+    sceneTargetDesc.SampleDesc.Count = 1;
+    sceneTargetDesc.SampleDesc.Quality = 0;
+    sceneTargetDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+    sceneTargetDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET;
+
+    D3D12_CLEAR_VALUE sceneClearValue = {};
+    sceneClearValue.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+    std::copy(std::begin(SceneClearColor), std::end(SceneClearColor), sceneClearValue.Color);
+
+    D3D12_HEAP_PROPERTIES sceneTargetHeapProps = {};
+    sceneTargetHeapProps.Type = D3D12_HEAP_TYPE_DEFAULT;
+    sceneTargetHeapProps.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+    sceneTargetHeapProps.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+    sceneTargetHeapProps.CreationNodeMask = 1;
+    sceneTargetHeapProps.VisibleNodeMask = 1;
+
+    winrt::check_hresult(m_device->CreateCommittedResource(
+        &sceneTargetHeapProps, D3D12_HEAP_FLAG_NONE, &sceneTargetDesc,
+        D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, &sceneClearValue,
+        __uuidof(m_sceneTarget), m_sceneTarget.put_void()));
+    trackResource(m_sceneTarget.get(), "scene target", GpuResourceCategory::RenderTargets, GPU_RESOURCE_SOURCE);
+
+    // The scene target's RTV follows the back buffer RTVs
+    D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle(m_rtvHeap->GetCPUDescriptorHandleForHeapStart());
+    rtvHandle.ptr += FrameCount * m_rtvDescriptorSize;
+    m_device->CreateRenderTargetView(m_sceneTarget.get(), nullptr, rtvHandle);
+
+    // The SRV goes after the CBV and UAV in the shader visible heap
+    D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+    srvDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+    srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+    srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+    srvDesc.Texture2D.MipLevels = 1;
+
+    D3D12_CPU_DESCRIPTOR_HANDLE srvHandle(m_cbvSrvUavHeap->GetCPUDescriptorHandleForHeapStart());
+    srvHandle.ptr += 2 * m_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+    m_device->CreateShaderResourceView(m_sceneTarget.get(), &srvDesc, srvHandle);
+
+    // Create the timestamp queries, a begin and end timestamp for every frame in flight
+    D3D12_QUERY_HEAP_DESC queryHeapDesc = {};
+    queryHeapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+    queryHeapDesc.Count = 2 * FrameCount;
+    queryHeapDesc.NodeMask = 0;
+    winrt::check_hresult(m_device->CreateQueryHeap(&queryHeapDesc, __uuidof(m_timestampQueryHeap), m_timestampQueryHeap.put_void()));
+
+    D3D12_HEAP_PROPERTIES readbackHeapProps = {};
+    readbackHeapProps.Type = D3D12_HEAP_TYPE_READBACK;
+    readbackHeapProps.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+    readbackHeapProps.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+    readbackHeapProps.CreationNodeMask = 1;
+    readbackHeapProps.VisibleNodeMask = 1;
+
+    D3D12_RESOURCE_DESC readbackDesc = {};
+    readbackDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+    readbackDesc.Alignment = 0;
+    readbackDesc.Width = 2 * FrameCount * sizeof(UINT64);
+    readbackDesc.Height = 1;
+    readbackDesc.DepthOrArraySize = 1;
+    readbackDesc.MipLevels = 1;
+    readbackDesc.Format = DXGI_FORMAT_UNKNOWN;
+    readbackDesc.SampleDesc.Count = 1;
+    readbackDesc.SampleDesc.Quality = 0;
+    readbackDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+    readbackDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+
+    winrt::check_hresult(m_device->CreateCommittedResource(
+        &readbackHeapProps, D3D12_HEAP_FLAG_NONE, &readbackDesc,
+        D3D12_RESOURCE_STATE_COPY_DEST, nullptr,
+        __uuidof(m_timestampReadbackBuffer), m_timestampReadbackBuffer.put_void()));
+    trackResource(m_timestampReadbackBuffer.get(), "timestamp readback", GpuResourceCategory::Readback, GPU_RESOURCE_SOURCE);
+
+    winrt::check_hresult(m_commandQueue->GetTimestampFrequency(&m_timestampFrequency));
+
+    for (UINT i = 0; i < FrameCount; ++i)
+    {
+        m_timestampsPending[i] = false;
+        m_timestampScales[i] = m_renderScale;
+    }
+#if defined(_DEBUG)
+    m_resolutionTraceFrames = 0u;
+#endif
+}
+
+void Renderer::initializeSprites()
+{
+    // Create the instance buffer, each frame in flight writes its own region
+    const UINT64 spriteInstanceBufferSize = static_cast<UINT64>(FrameCount) * MaxSprites * sizeof(SpriteBatch::Instance);
+
+    D3D12_HEAP_PROPERTIES uploadHeapProps = {};
+    uploadHeapProps.Type = D3D12_HEAP_TYPE_UPLOAD;
+    uploadHeapProps.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+    uploadHeapProps.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+    uploadHeapProps.CreationNodeMask = 1;
+    uploadHeapProps.VisibleNodeMask = 1;
+
+    D3D12_RESOURCE_DESC instanceBufferDesc = {};
+    instanceBufferDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+    instanceBufferDesc.Alignment = 0;
+    instanceBufferDesc.Width = spriteInstanceBufferSize;
+    instanceBufferDesc.Height = 1;
+    instanceBufferDesc.DepthOrArraySize = 1;
+    instanceBufferDesc.MipLevels = 1;
+    instanceBufferDesc.Format = DXGI_FORMAT_UNKNOWN;
+    instanceBufferDesc.SampleDesc.Count = 1;
+    instanceBufferDesc.SampleDesc.Quality = 0;
+    instanceBufferDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+    instanceBufferDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+
+    winrt::check_hresult(m_device->CreateCommittedResource(
+        &uploadHeapProps, D3D12_HEAP_FLAG_NONE, &instanceBufferDesc,
+        D3D12_RESOURCE_STATE_GENERIC_READ, nullptr,
+        __uuidof(m_spriteInstanceBuffer), m_spriteInstanceBuffer.put_void()));
+    trackResource(m_spriteInstanceBuffer.get(), "sprite instances", GpuResourceCategory::Geometry, GPU_RESOURCE_SOURCE);
+
+    // Keep it mapped for the lifetime of the renderer, we never read from it on the CPU
+    D3D12_RANGE instanceBufferReadRange;
+    instanceBufferReadRange.Begin = 0;
+    instanceBufferReadRange.End = 0;
+    winrt::check_hresult(m_spriteInstanceBuffer->Map(0, &instanceBufferReadRange, reinterpret_cast<void **>(&m_mappedSpriteInstances)));
+
+    // Pack the built in images together, the packer orders them to waste the least space
+    static_assert(_countof(BuiltInSpriteImages) == SpriteImageCount, "Every built in image needs an id");
+    uint32_t imageWidths[SpriteImageCount];
+    uint32_t imageHeights[SpriteImageCount];
+    for (uint32_t image = 0u; image < SpriteImageCount; ++image)
+    {
+        imageWidths[image] = BuiltInSpriteImages[image].size;
+        imageHeights[image] = BuiltInSpriteImages[image].size;
+    }
+
+    AtlasPacker::Region imageRegions[SpriteImageCount];
+    if (!m_spriteAtlasPacker.packAll(imageWidths, imageHeights, SpriteImageCount, imageRegions) || m_spriteAtlasPacker.getPageCount() != 1u)
+    {
+        throw winrt::hresult_error(E_FAIL, L"The built in sprite images do not fit in one atlas page");
+    }
+
+    std::vector<uint32_t> atlasPixels(static_cast<size_t>(SpriteAtlasSize) * SpriteAtlasSize, 0u);
+    const float invAtlasSize = 1.0f / static_cast<float>(SpriteAtlasSize);
+    for (uint32_t image = 0u; image < SpriteImageCount; ++image)
+    {
+        const SpriteImageDesc &desc = BuiltInSpriteImages[image];
+        const AtlasPacker::Region &region = imageRegions[image];
+        const float texelToUnit = 2.0f / static_cast<float>(desc.size);
+        for (UINT y = 0; y < region.height; ++y)
+        {
+            for (UINT x = 0; x < region.width; ++x)
+            {
+                const float alpha = spriteCoverage(desc.shape, desc.size, (x + 0.5f) * texelToUnit - 1.0f, (y + 0.5f) * texelToUnit - 1.0f);
+                atlasPixels[(region.y + y) * SpriteAtlasSize + region.x + x] = (static_cast<uint32_t>(alpha * 255.0f + 0.5f) << 24) | 0x00FFFFFFu;
+            }
+        }
+
+        // Sample between the outer texel centres so filtering never reaches the padding
+        const float uvRect[4] =
+        {
+            (region.x + 0.5f) * invAtlasSize,
+            (region.y + 0.5f) * invAtlasSize,
+            (region.x + region.width - 0.5f) * invAtlasSize,
+            (region.y + region.height - 0.5f) * invAtlasSize
+        };
+        m_spriteBatch.addImage(region.page, uvRect);
+    }
+
+    // Create the atlas texture
+    D3D12_RESOURCE_DESC atlasDesc = {};
+    atlasDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+    atlasDesc.Width = SpriteAtlasSize;
+    atlasDesc.Height = SpriteAtlasSize;
+    atlasDesc.DepthOrArraySize = 1;
+    atlasDesc.MipLevels = 1;
+    atlasDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+    atlasDesc.SampleDesc.Count = 1;
+    atlasDesc.SampleDesc.Quality = 0;
+    atlasDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+    atlasDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+
+    D3D12_HEAP_PROPERTIES atlasHeapProps = {};
+    atlasHeapProps.Type = D3D12_HEAP_TYPE_DEFAULT;
+    atlasHeapProps.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+    atlasHeapProps.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+    atlasHeapProps.CreationNodeMask = 1;
+    atlasHeapProps.VisibleNodeMask = 1;
+
+    winrt::check_hresult(m_device->CreateCommittedResource(
+        &atlasHeapProps, D3D12_HEAP_FLAG_NONE, &atlasDesc,
+        D3D12_RESOURCE_STATE_COPY_DEST, nullptr,
+        __uuidof(m_spriteAtlas), m_spriteAtlas.put_void()));
+    trackResource(m_spriteAtlas.get(), "sprite atlas", GpuResourceCategory::Textures, GPU_RESOURCE_SOURCE);
+
+    // Stage the pixels with the row pitch the copy expects
+    D3D12_PLACED_SUBRESOURCE_FOOTPRINT atlasFootprint;
+    UINT64 atlasUploadSize;
+    m_device->GetCopyableFootprints(&atlasDesc, 0, 1, 0, &atlasFootprint, nullptr, nullptr, &atlasUploadSize);
+
+    D3D12_RESOURCE_DESC atlasUploadDesc = instanceBufferDesc;
+    atlasUploadDesc.Width = atlasUploadSize;
+
+    winrt::com_ptr<ID3D12Resource> atlasUploadBuffer;
+    winrt::check_hresult(m_device->CreateCommittedResource(
+        &uploadHeapProps, D3D12_HEAP_FLAG_NONE, &atlasUploadDesc,
+        D3D12_RESOURCE_STATE_GENERIC_READ, nullptr,
+        __uuidof(atlasUploadBuffer), atlasUploadBuffer.put_void()));
+    trackResource(atlasUploadBuffer.get(), "sprite atlas upload", GpuResourceCategory::Staging, GPU_RESOURCE_SOURCE);
+
+    UINT8 *pAtlasUploadData;
+    winrt::check_hresult(atlasUploadBuffer->Map(0, &instanceBufferReadRange, reinterpret_cast<void **>(&pAtlasUploadData)));
+    for (UINT y = 0; y < SpriteAtlasSize; ++y)
+    {
+        memcpy(pAtlasUploadData + atlasFootprint.Offset + y * atlasFootprint.Footprint.RowPitch, atlasPixels.data() + y * SpriteAtlasSize, SpriteAtlasSize * sizeof(uint32_t));
+    }
+    atlasUploadBuffer->Unmap(0, nullptr);
+
+    // The copy goes out with the first frame instead of stalling startup on the GPU
+    ID3D12Resource *spriteAtlas = m_spriteAtlas.get();
+    ID3D12Resource *atlasUpload = atlasUploadBuffer.get();
+    queueUpload(std::move(atlasUploadBuffer), [spriteAtlas, atlasUpload, atlasFootprint](ID3D12GraphicsCommandList *commandList)
+    {
+        D3D12_TEXTURE_COPY_LOCATION srcLoc = {};
+        srcLoc.pResource = atlasUpload;
+        srcLoc.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+        srcLoc.PlacedFootprint = atlasFootprint;
+
+        D3D12_TEXTURE_COPY_LOCATION dstLoc = {};
+        dstLoc.pResource = spriteAtlas;
+        dstLoc.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+        dstLoc.SubresourceIndex = 0;
+
+        commandList->CopyTextureRegion(&dstLoc, 0, 0, 0, &srcLoc, nullptr);
+
+        D3D12_RESOURCE_BARRIER atlasBarrier;
+        atlasBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+        atlasBarrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+        atlasBarrier.Transition.pResource = spriteAtlas;
+        atlasBarrier.Transition.StateBefore = D3D12_RESOURCE_STATE_COPY_DEST;
+        atlasBarrier.Transition.StateAfter = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
+        atlasBarrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+        commandList->ResourceBarrier(1, &atlasBarrier);
+    });
+
+    // The atlas SRV follows the scene SRV in the shader visible heap
+    D3D12_SHADER_RESOURCE_VIEW_DESC atlasSrvDesc = {};
+    atlasSrvDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+    atlasSrvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+    atlasSrvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+    atlasSrvDesc.Texture2D.MipLevels = 1;
+
+    D3D12_CPU_DESCRIPTOR_HANDLE atlasSrvHandle(m_cbvSrvUavHeap->GetCPUDescriptorHandleForHeapStart());
+    atlasSrvHandle.ptr += 3 * m_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+    m_device->CreateShaderResourceView(m_spriteAtlas.get(), &atlasSrvDesc, atlasSrvHandle);
+}
+
+void Renderer::initializeParticles()
+{
+    m_particleAliveIndex = 0u;
+    m_particleEmitCarry = 0.0f;
+
+    D3D12_HEAP_PROPERTIES defaultHeapProps = {};
+    defaultHeapProps.Type = D3D12_HEAP_TYPE_DEFAULT;
+    defaultHeapProps.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+    defaultHeapProps.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+    defaultHeapProps.CreationNodeMask = 1;
+    defaultHeapProps.VisibleNodeMask = 1;
+
+    D3D12_RESOURCE_DESC bufferDesc = {};
+    bufferDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+    bufferDesc.Alignment = 0;
+    bufferDesc.Height = 1;
+    bufferDesc.DepthOrArraySize = 1;
+    bufferDesc.MipLevels = 1;
+    bufferDesc.Format = DXGI_FORMAT_UNKNOWN;
+    bufferDesc.SampleDesc.Count = 1;
+    bufferDesc.SampleDesc.Quality = 0;
+    bufferDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+    bufferDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
+
+    auto createBuffer = [&](UINT64 size, D3D12_RESOURCE_STATES initialState, winrt::com_ptr<ID3D12Resource> &buffer)
+    {
+        bufferDesc.Width = size;
+        winrt::check_hresult(m_device->CreateCommittedResource(
+            &defaultHeapProps, D3D12_HEAP_FLAG_NONE, &bufferDesc,
+            initialState, nullptr,
+            __uuidof(buffer), buffer.put_void()));
+    };
+
+    // The dead list and the counters start out with every particle dead, so they are uploaded
+    const UINT64 particleIndicesSize = static_cast<UINT64>(MaxParticles) * sizeof(uint32_t);
+    createBuffer(static_cast<UINT64>(MaxParticles) * sizeof(ParticleState), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, m_particleBuffer);
+    trackResource(m_particleBuffer.get(), "particles", GpuResourceCategory::UnorderedAccess, GPU_RESOURCE_SOURCE);
+    createBuffer(particleIndicesSize, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, m_particleAliveLists[0]);
+    trackResource(m_particleAliveLists[0].get(), "particle alive list 0", GpuResourceCategory::UnorderedAccess, GPU_RESOURCE_SOURCE);
+    createBuffer(particleIndicesSize, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, m_particleAliveLists[1]);
+    trackResource(m_particleAliveLists[1].get(), "particle alive list 1", GpuResourceCategory::UnorderedAccess, GPU_RESOURCE_SOURCE);
+    createBuffer(particleIndicesSize, D3D12_RESOURCE_STATE_COPY_DEST, m_particleDeadList);
+    trackResource(m_particleDeadList.get(), "particle dead list", GpuResourceCategory::UnorderedAccess, GPU_RESOURCE_SOURCE);
+    createBuffer(ParticleCountersSize, D3D12_RESOURCE_STATE_COPY_DEST, m_particleCounters);
+    trackResource(m_particleCounters.get(), "particle counters", GpuResourceCategory::UnorderedAccess, GPU_RESOURCE_SOURCE);
+    createBuffer(ParticleArgumentsSize, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, m_particleArguments);
+    trackResource(m_particleArguments.get(), "particle arguments", GpuResourceCategory::UnorderedAccess, GPU_RESOURCE_SOURCE);
+
+    D3D12_HEAP_PROPERTIES uploadHeapProps = defaultHeapProps;
+    uploadHeapProps.Type = D3D12_HEAP_TYPE_UPLOAD;
+
+    D3D12_RESOURCE_DESC uploadDesc = bufferDesc;
+    uploadDesc.Width = particleIndicesSize + ParticleCountersSize;
+    uploadDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+
+    winrt::com_ptr<ID3D12Resource> particleUploadBuffer;
+    winrt::check_hresult(m_device->CreateCommittedResource(
+        &uploadHeapProps, D3D12_HEAP_FLAG_NONE, &uploadDesc,
+        D3D12_RESOURCE_STATE_GENERIC_READ, nullptr,
+        __uuidof(particleUploadBuffer), particleUploadBuffer.put_void()));
+    trackResource(particleUploadBuffer.get(), "particle upload", GpuResourceCategory::Staging, GPU_RESOURCE_SOURCE);
+
+    D3D12_RANGE uploadReadRange;
+    uploadReadRange.Begin = 0;
+    uploadReadRange.End = 0;
+    UINT8 *pUploadData;
+    winrt::check_hresult(particleUploadBuffer->Map(0, &uploadReadRange, reinterpret_cast<void **>(&pUploadData)));
+    uint32_t *deadList = reinterpret_cast<uint32_t *>(pUploadData);
+    for (UINT i = 0; i < MaxParticles; ++i)
+    {
+        deadList[i] = i;
+    }
+    // Alive count, dead count and the per step counters, see ParticleCommon.hlsli
+    uint32_t counters[ParticleCountersSize / sizeof(uint32_t)] = {};
+    counters[1] = MaxParticles;
+    memcpy(pUploadData + particleIndicesSize, counters, sizeof(counters));
+    particleUploadBuffer->Unmap(0, nullptr);
+
+    // Recorded ahead of the frame that first simulates the particles, see updateDeferredStartup()
+    ID3D12Resource *particleDeadList = m_particleDeadList.get();
+    ID3D12Resource *particleCounters = m_particleCounters.get();
+    ID3D12Resource *particleUpload = particleUploadBuffer.get();
+    queueUpload(std::move(particleUploadBuffer), [particleDeadList, particleCounters, particleUpload, particleIndicesSize](ID3D12GraphicsCommandList *commandList)
+    {
+        commandList->CopyBufferRegion(particleDeadList, 0, particleUpload, 0, particleIndicesSize);
+        commandList->CopyBufferRegion(particleCounters, 0, particleUpload, particleIndicesSize, ParticleCountersSize);
+
+        std::array<D3D12_RESOURCE_BARRIER, 2> uploadBarriers;
+        for (UINT i = 0; i < uploadBarriers.size(); ++i)
+        {
+            uploadBarriers[i].Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+            uploadBarriers[i].Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+            uploadBarriers[i].Transition.StateBefore = D3D12_RESOURCE_STATE_COPY_DEST;
+            uploadBarriers[i].Transition.StateAfter = D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+            uploadBarriers[i].Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+        }
+        uploadBarriers[0].Transition.pResource = particleDeadList;
+        uploadBarriers[1].Transition.pResource = particleCounters;
+        commandList->ResourceBarrier(uploadBarriers.size(), uploadBarriers.data());
+    });
+}
+
+// The particle passes make their own transitions, so the schedules only carry the ordering
+void Renderer::createParticleCommandList()
+{
+    for (UINT i = 0; i < FrameCount; ++i)
+    {
+        winrt::check_hresult(m_device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COMPUTE, __uuidof(m_particleCommandAllocators[i]), m_particleCommandAllocators[i].put_void()));
+    }
+    winrt::check_hresult(m_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COMPUTE, m_particleCommandAllocators[0].get(), nullptr, __uuidof(m_particleCommandList), m_particleCommandList.put_void()));
+    winrt::check_hresult(m_particleCommandList->Close());
+    m_particleListState.attach(m_particleCommandList.get());
+
+    for (UINT schedule = 0; schedule < _countof(m_frameSchedules); ++schedule)
+    {
+        QueueScheduler scheduler;
+        scheduler.addWork("scene", QueueType::Direct, 1.0f, true);
+        scheduler.addWork("particles", QueueType::Compute, 0.25f, true);
+        scheduler.addWork("compose", QueueType::Direct, 1.0f, true);
+        scheduler.addDependency(ParticleWork, ComposeWork);
+        if (schedule == 1)
+        {
+            scheduler.addDependency(SceneWork, ParticleWork);
+        }
+        scheduler.compile(QueueScheduler::Settings(), m_frameSchedules[schedule]);
+    }
+}
+
+void Renderer::initializeLights()
+{
+    m_lightTime = 0.0f;
+    m_lights.resize(MaxLights);
+
+    // The grid uses the projection of the scene viewport, which keeps the window's aspect ratio at any render scale
+    const Mat4 projection = perspectiveMatrix(LightFieldOfView, m_viewport.Width / m_viewport.Height, 0.1f, 100.0f);
+    LightClusterConfig clusterConfig;
+    clusterConfig.nearZ = 0.1f;
+    clusterConfig.farZ = 100.0f;
+    clusterConfig.projectionScaleX = projection.r[0].x;
+    clusterConfig.projectionScaleY = projection.r[1].y;
+    clusterConfig.maxLightIndices = MaxLightIndices;
+    m_lightClusterGrid = std::make_unique<LightClusterGrid>(clusterConfig);
+
+    // Each frame in flight gets the lights, one range per cluster and the light index list
+    const UINT64 alignment = D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT;
+    auto alignUp = [alignment](UINT64 size) { return (size + alignment - 1u) & ~(alignment - 1u); };
+    m_lightClustersOffset = alignUp(static_cast<UINT64>(MaxLights) * sizeof(ClusterLight));
+    m_lightIndicesOffset = m_lightClustersOffset + alignUp(static_cast<UINT64>(m_lightClusterGrid->getClusterCount()) * sizeof(LightClusterRange));
+    m_lightFrameSize = m_lightIndicesOffset + alignUp(static_cast<UINT64>(MaxLightIndices) * sizeof(uint32_t));
+
+    D3D12_HEAP_PROPERTIES uploadHeapProps = {};
+    uploadHeapProps.Type = D3D12_HEAP_TYPE_UPLOAD;
+    uploadHeapProps.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+    uploadHeapProps.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+    uploadHeapProps.CreationNodeMask = 1;
+    uploadHeapProps.VisibleNodeMask = 1;
+
+    D3D12_RESOURCE_DESC lightBufferDesc = {};
+    lightBufferDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+    lightBufferDesc.Alignment = 0;
+    lightBufferDesc.Width = FrameCount * m_lightFrameSize;
+    lightBufferDesc.Height = 1;
+    lightBufferDesc.DepthOrArraySize = 1;
+    lightBufferDesc.MipLevels = 1;
+    lightBufferDesc.Format = DXGI_FORMAT_UNKNOWN;
+    lightBufferDesc.SampleDesc.Count = 1;
+    lightBufferDesc.SampleDesc.Quality = 0;
+    lightBufferDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+    lightBufferDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+
+    winrt::check_hresult(m_device->CreateCommittedResource(
+        &uploadHeapProps, D3D12_HEAP_FLAG_NONE, &lightBufferDesc,
+        D3D12_RESOURCE_STATE_GENERIC_READ, nullptr,
+        __uuidof(m_lightBuffer), m_lightBuffer.put_void()));
+    trackResource(m_lightBuffer.get(), "light clusters", GpuResourceCategory::Constants, GPU_RESOURCE_SOURCE);
+
+    // Keep it mapped for the lifetime of the renderer, we never read from it on the CPU
+    D3D12_RANGE lightBufferReadRange;
+    lightBufferReadRange.Begin = 0;
+    lightBufferReadRange.End = 0;
+    winrt::check_hresult(m_lightBuffer->Map(0, &lightBufferReadRange, reinterpret_cast<void **>(&m_mappedLightBuffer)));
+}
+
+// Move the lights along their orbits, bin them and write this frame's region of the light buffer.
+// The region was last read by the frame that used the same index, which has completed.
+void Renderer::updateLights()
+{
+    m_lightTime += LightStepTime;
+
+    // Orbits are spread a little past the visible part of the plane so lights also come in from the edges
+    const LightClusterConfig &clusterConfig = m_lightClusterGrid->getConfig();
+    const float halfWidth = ScenePlaneDepth / clusterConfig.projectionScaleX;
+    const float halfHeight = ScenePlaneDepth / clusterConfig.projectionScaleY;
+    for (UINT i = 0; i < MaxLights; ++i)
+    {
+        const float centerX = (lightHash(i * 10u + 0u) * 2.4f - 1.2f) * halfWidth;
+        const float centerY = (lightHash(i * 10u + 1u) * 2.4f - 1.2f) * halfHeight;
+        const float orbitRadius = 0.1f + lightHash(i * 10u + 2u) * 0.4f;
+        const float angle = lightHash(i * 10u + 3u) * PiTimesTwo + m_lightTime * (0.3f + lightHash(i * 10u + 4u));
+
+        ClusterLight &light = m_lights[i];
+        light.position = Vec3{ centerX + std::cos(angle) * orbitRadius, centerY + std::sin(angle) * orbitRadius, ScenePlaneDepth - 0.2f - lightHash(i * 10u + 5u) * 0.4f };
+        light.radius = 0.3f + lightHash(i * 10u + 6u) * 0.5f;
+        light.color = Vec3{ lightHash(i * 10u + 7u), lightHash(i * 10u + 8u), lightHash(i * 10u + 9u) } * 0.6f;
+        light.padding = 0.0f;
+    }
+
+    m_lightClusterGrid->build(m_lights.data(), MaxLights, m_workerPool.get());
+
+    UINT8 *pLightFrame = m_mappedLightBuffer + m_frameIndex * m_lightFrameSize;
+    const std::vector<LightClusterRange> &clusters = m_lightClusterGrid->getClusters();
+    const std::vector<uint32_t> &lightIndices = m_lightClusterGrid->getLightIndices();
+    memcpy(pLightFrame, m_lights.data(), m_lights.size() * sizeof(ClusterLight));
+    memcpy(pLightFrame + m_lightClustersOffset, clusters.data(), clusters.size() * sizeof(LightClusterRange));
+    memcpy(pLightFrame + m_lightIndicesOffset, lightIndices.data(), lightIndices.size() * sizeof(uint32_t));
+}
+
+// Load the cooked terrain, read its pinned levels and create the buffers it is drawn from. The terrain is
+// left out when the file is missing or broken.
+void Renderer::initializeTerrain()
+{
+    m_terrainPatchCount = 0u;
+    m_terrainFrame = 0u;
+    m_terrainTime = 0.0f;
+
+    const std::filesystem::path terrainPath = m_shaderBasePath + L"\\Terrain.dtrn";
+    std::unique_ptr<TerrainTileSet> terrainTiles = std::make_unique<TerrainTileSet>();
+    std::string error;
+    if (!terrainTiles->load(terrainPath, error))
+    {
+        OutputDebugStringA(("No terrain: " + error + "\n").c_str());
+        return;
+    }
+    m_terrainTiles = std::move(terrainTiles);
+
+    m_terrainReader = std::make_unique<AsyncFileReader>();
+    m_terrainCache = std::make_unique<TerrainTileCache>(m_terrainTiles->getTileCount(), TerrainCacheSlots);
+    m_terrainQuadtree = std::make_unique<TerrainQuadtree>(*m_terrainTiles);
+    m_terrainQuadtree->setProjection(TerrainFieldOfView, m_viewport.Height, TerrainThresholdPixels, TerrainNearDistance);
+
+    TerrainStreamer::Settings streamerSettings;
+    streamerSettings.maxUploadsPerFrame = MaxTerrainUploads;
+    std::unique_ptr<TerrainStreamer> terrainStreamer = std::make_unique<TerrainStreamer>(*m_terrainReader, terrainPath, *m_terrainTiles, *m_terrainCache, streamerSettings);
+    std::vector<TerrainTileUpload> pinnedUploads;
+    if (!terrainStreamer->loadPinnedLevels(TerrainPinnedLevels, pinnedUploads))
+    {
+        OutputDebugStringA("No terrain: the pinned tiles could not be read\n");
+        return;
+    }
+
+    const uint32_t tileSamples = m_terrainTiles->getTileSamples();
+    const UINT64 tileDataSize = m_terrainTiles->getTileDataSize();
+    m_terrainSlotStride = (tileDataSize + 3u) & ~static_cast<UINT64>(3u);
+
+    D3D12_HEAP_PROPERTIES defaultHeapProps = {};
+    defaultHeapProps.Type = D3D12_HEAP_TYPE_DEFAULT;
+    defaultHeapProps.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+    defaultHeapProps.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+    defaultHeapProps.CreationNodeMask = 1;
+    defaultHeapProps.VisibleNodeMask = 1;
+
+    D3D12_HEAP_PROPERTIES uploadHeapProps = defaultHeapProps;
+    uploadHeapProps.Type = D3D12_HEAP_TYPE_UPLOAD;
+
+    D3D12_RESOURCE_DESC bufferDesc = {};
+    bufferDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+    bufferDesc.Alignment = 0;
+    bufferDesc.Height = 1;
+    bufferDesc.DepthOrArraySize = 1;
+    bufferDesc.MipLevels = 1;
+    bufferDesc.Format = DXGI_FORMAT_UNKNOWN;
+    bufferDesc.SampleDesc.Count = 1;
+    bufferDesc.SampleDesc.Quality = 0;
+    bufferDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+    bufferDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+
+    auto createBuffer = [&](const D3D12_HEAP_PROPERTIES &heapProps, UINT64 size, D3D12_RESOURCE_STATES initialState, winrt::com_ptr<ID3D12Resource> &buffer)
+    {
+        bufferDesc.Width = size;
+        winrt::check_hresult(m_device->CreateCommittedResource(
+            &heapProps, D3D12_HEAP_FLAG_NONE, &bufferDesc,
+            initialState, nullptr,
+            __uuidof(buffer), buffer.put_void()));
+    };
+
+    // We never read these back on the CPU
+    D3D12_RANGE uploadReadRange;
+    uploadReadRange.Begin = 0;
+    uploadReadRange.End = 0;
+
+    // Heights of every cache slot, left in the copy state for the pinned tiles
+    createBuffer(defaultHeapProps, TerrainCacheSlots * m_terrainSlotStride, D3D12_RESOURCE_STATE_COPY_DEST, m_terrainHeights);
+    trackResource(m_terrainHeights.get(), "terrain heights", GpuResourceCategory::Geometry, GPU_RESOURCE_SOURCE);
+
+    winrt::com_ptr<ID3D12Resource> pinnedUploadBuffer;
+    createBuffer(uploadHeapProps, pinnedUploads.size() * m_terrainSlotStride, D3D12_RESOURCE_STATE_GENERIC_READ, pinnedUploadBuffer);
+    trackResource(pinnedUploadBuffer.get(), "terrain pinned upload", GpuResourceCategory::Staging, GPU_RESOURCE_SOURCE);
+
+    UINT8 *pPinnedData;
+    std::vector<uint32_t> pinnedSlots;
+    winrt::check_hresult(pinnedUploadBuffer->Map(0, &uploadReadRange, reinterpret_cast<void **>(&pPinnedData)));
+    for (const TerrainTileUpload &upload : pinnedUploads)
+    {
+        memcpy(pPinnedData + pinnedSlots.size() * m_terrainSlotStride, upload.samples.data(), upload.samples.size());
+        pinnedSlots.push_back(upload.slot);
+    }
+    pinnedUploadBuffer->Unmap(0, nullptr);
+
+    // Recorded ahead of the first frame that draws the terrain, see updateDeferredStartup()
+    ID3D12Resource *terrainHeights = m_terrainHeights.get();
+    ID3D12Resource *pinnedUpload = pinnedUploadBuffer.get();
+    const UINT64 slotStride = m_terrainSlotStride;
+    queueUpload(std::move(pinnedUploadBuffer), [terrainHeights, pinnedUpload, pinnedSlots, slotStride, tileDataSize](ID3D12GraphicsCommandList *commandList)
+    {
+        for (size_t i = 0; i < pinnedSlots.size(); ++i)
+        {
+            commandList->CopyBufferRegion(terrainHeights, pinnedSlots[i] * slotStride, pinnedUpload, i * slotStride, tileDataSize);
+        }
+
+        D3D12_RESOURCE_BARRIER heightsBarrier;
+        heightsBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+        heightsBarrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+        heightsBarrier.Transition.pResource = terrainHeights;
+        heightsBarrier.Transition.StateBefore = D3D12_RESOURCE_STATE_COPY_DEST;
+        heightsBarrier.Transition.StateAfter = D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+        heightsBarrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+        commandList->ResourceBarrier(1, &heightsBarrier);
+    });
+
+    // Streamed tiles and patches, each frame in flight uses its own region. Keep them mapped for the lifetime of the renderer.
+    createBuffer(uploadHeapProps, FrameCount * MaxTerrainUploads * m_terrainSlotStride, D3D12_RESOURCE_STATE_GENERIC_READ, m_terrainUploadBuffer);
+    trackResource(m_terrainUploadBuffer.get(), "terrain uploads", GpuResourceCategory::Staging, GPU_RESOURCE_SOURCE);
+    winrt::check_hresult(m_terrainUploadBuffer->Map(0, &uploadReadRange, reinterpret_cast<void **>(&m_mappedTerrainUploads)));
+
+    createBuffer(uploadHeapProps, static_cast<UINT64>(FrameCount) * MaxTerrainPatches * sizeof(TerrainPatch), D3D12_RESOURCE_STATE_GENERIC_READ, m_terrainInstanceBuffer);
+    trackResource(m_terrainInstanceBuffer.get(), "terrain patches", GpuResourceCategory::Geometry, GPU_RESOURCE_SOURCE);
+    winrt::check_hresult(m_terrainInstanceBuffer->Map(0, &uploadReadRange, reinterpret_cast<void **>(&m_mappedTerrainPatches)));
+
+    // The grid every patch is drawn with, cells are split along the diagonal the tile errors were measured with
+    std::vector<uint16_t> gridVertices;
+    for (uint32_t j = 0u; j < tileSamples; ++j)
+    {
+        for (uint32_t i = 0u; i < tileSamples; ++i)
+        {
+            gridVertices.push_back(static_cast<uint16_t>(i));
+            gridVertices.push_back(static_cast<uint16_t>(j));
+        }
+    }
+    std::vector<uint32_t> gridIndices;
+    for (uint32_t j = 0u; j + 1u < tileSamples; ++j)
+    {
+        for (uint32_t i = 0u; i + 1u < tileSamples; ++i)
+        {
+            const uint32_t corner = j * tileSamples + i;
+            const uint32_t cell[6] = { corner, corner + 1u, corner + tileSamples + 1u, corner, corner + tileSamples + 1u, corner + tileSamples };
+            gridIndices.insert(gridIndices.end(), std::begin(cell), std::end(cell));
+        }
+    }
+    m_terrainGridIndexCount = static_cast<UINT>(gridIndices.size());
+
+    // Static, so it stays in the upload heap like the scene's geometry
+    const UINT gridVertexBufferSize = static_cast<UINT>(gridVertices.size() * sizeof(uint16_t));
+    const UINT gridIndexBufferSize = static_cast<UINT>(gridIndices.size() * sizeof(uint32_t));
+    createBuffer(uploadHeapProps, gridVertexBufferSize, D3D12_RESOURCE_STATE_GENERIC_READ, m_terrainGridVertices);
+    trackResource(m_terrainGridVertices.get(), "terrain grid vertices", GpuResourceCategory::Geometry, GPU_RESOURCE_SOURCE);
+    createBuffer(uploadHeapProps, gridIndexBufferSize, D3D12_RESOURCE_STATE_GENERIC_READ, m_terrainGridIndices);
+    trackResource(m_terrainGridIndices.get(), "terrain grid indices", GpuResourceCategory::Geometry, GPU_RESOURCE_SOURCE);
+
+    UINT8 *pGridData;
+    winrt::check_hresult(m_terrainGridVertices->Map(0, &uploadReadRange, reinterpret_cast<void **>(&pGridData)));
+    memcpy(pGridData, gridVertices.data(), gridVertexBufferSize);
+    m_terrainGridVertices->Unmap(0, nullptr);
+    winrt::check_hresult(m_terrainGridIndices->Map(0, &uploadReadRange, reinterpret_cast<void **>(&pGridData)));
+    memcpy(pGridData, gridIndices.data(), gridIndexBufferSize);
+    m_terrainGridIndices->Unmap(0, nullptr);
+
+    m_terrainGridVertexView.BufferLocation = m_terrainGridVertices->GetGPUVirtualAddress();
+    m_terrainGridVertexView.StrideInBytes = 2 * sizeof(uint16_t);
+    m_terrainGridVertexView.SizeInBytes = gridVertexBufferSize;
+    m_terrainGridIndexView.BufferLocation = m_terrainGridIndices->GetGPUVirtualAddress();
+    m_terrainGridIndexView.Format = DXGI_FORMAT_R32_UINT;
+    m_terrainGridIndexView.SizeInBytes = gridIndexBufferSize;
+
+    // Depth at the full surface size like the scene target, lower render scales only use part of it
+    D3D12_DESCRIPTOR_HEAP_DESC dsvHeapDesc = {};
+    dsvHeapDesc.NumDescriptors = 1;
+    dsvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_DSV;
+    dsvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+    winrt::check_hresult(m_device->CreateDescriptorHeap(&dsvHeapDesc, __uuidof(m_dsvHeap), m_dsvHeap.put_void()));
+
+    D3D12_RESOURCE_DESC depthDesc = {};
+    depthDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+    depthDesc.Width = static_cast<UINT64>(m_surfaceSize.right);
+    depthDesc.Height = static_cast<UINT>(m_surfaceSize.bottom);
+    depthDesc.DepthOrArraySize = 1;
+    depthDesc.MipLevels = 1;
+    depthDesc.Format = DXGI_FORMAT_D32_FLOAT;
+    depthDesc.SampleDesc.Count = 1;
+    depthDesc.SampleDesc.Quality = 0;
+    depthDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+    depthDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL;
+
+    D3D12_CLEAR_VALUE depthClearValue = {};
+    depthClearValue.Format = DXGI_FORMAT_D32_FLOAT;
+    depthClearValue.DepthStencil.Depth = 1.0f;
+
+    winrt::check_hresult(m_device->CreateCommittedResource(
+        &defaultHeapProps, D3D12_HEAP_FLAG_NONE, &depthDesc,
+        D3D12_RESOURCE_STATE_DEPTH_WRITE, &depthClearValue,
+        __uuidof(m_depthBuffer), m_depthBuffer.put_void()));
+    trackResource(m_depthBuffer.get(), "terrain depth", GpuResourceCategory::RenderTargets, GPU_RESOURCE_SOURCE);
+    m_device->CreateDepthStencilView(m_depthBuffer.get(), nullptr, m_dsvHeap->GetCPUDescriptorHandleForHeapStart());
+
+    m_terrainStreamer = std::move(terrainStreamer);
+}
+
+// Move the camera, pick this frame's patches and stream the tiles they ask for. Arrived tiles are staged in
+// this frame's region of the upload buffer and the patches written into its region of the instance buffer,
+// both were last read by the frame that used the same index, which has completed.
+void Renderer::updateTerrain()
+{
+    m_terrainTime += TerrainStepTime;
+    ++m_terrainFrame;
+
+    const TerrainTileHeader &header = m_terrainTiles->getHeader();
+    const float center = header.worldSize * 0.5f;
+    const float angle = m_terrainTime * 0.05f;
+    const Vec3 eye{ center + std::cos(angle) * header.worldSize * 0.3f, header.heightScale * 1.1f, center + std::sin(angle) * header.worldSize * 0.3f };
+    const Vec3 target{ center, header.heightScale * 0.3f, center };
+    const Mat4 view = lookAtMatrix(eye, target, Vec3{ 0.0f, 1.0f, 0.0f });
+    const Mat4 projection = perspectiveMatrix(TerrainFieldOfView, m_viewport.Width / m_viewport.Height, TerrainNearDistance, header.worldSize * 1.5f);
+    m_terrainViewProjection = multiply(view, projection);
+
+    m_terrainQuadtree->select(eye, extractFrustum(m_terrainViewProjection), *m_terrainCache, m_terrainFrame, m_terrainSelection);
+
+    std::vector<TerrainTileUpload> uploads;
+    m_terrainStreamer->update(m_terrainFrame, m_terrainSelection.requests, uploads);
+
+    UINT8 *pUploadFrame = m_mappedTerrainUploads + m_frameIndex * MaxTerrainUploads * m_terrainSlotStride;
+    m_terrainUploadSlots.clear();
+    for (const TerrainTileUpload &upload : uploads)
+    {
+        memcpy(pUploadFrame + m_terrainUploadSlots.size() * m_terrainSlotStride, upload.samples.data(), upload.samples.size());
+        m_terrainUploadSlots.push_back(upload.slot);
+    }
+
+    // Patches hidden behind nearer terrain are left out, as are those past the instance buffer's room
+    renderTerrainOccluders();
+    TerrainPatch *pPatchFrame = m_mappedTerrainPatches + m_frameIndex * MaxTerrainPatches;
+    m_terrainPatchCount = 0u;
+    for (const TerrainPatch &patch : m_terrainSelection.patches)
+    {
+        if (m_terrainPatchCount == MaxTerrainPatches)
+        {
+            break;
+        }
+
+        const Aabb bounds = m_terrainTiles->getTileBounds(patch.tile);
+        Vec4 clipCorners[8];
+        for (uint32_t corner = 0u; corner < 8u; ++corner)
+        {
+            const Vec4 position{ (corner & 1u) ? bounds.max.x : bounds.min.x, (corner & 2u) ? bounds.max.y : bounds.min.y, (corner & 4u) ? bounds.max.z : bounds.min.z, 1.0f };
+            clipCorners[corner] = transform(position, m_terrainViewProjection);
+        }
+        if (m_occlusionCuller->testAabb(&clipCorners[0].x))
+        {
+            pPatchFrame[m_terrainPatchCount++] = patch;
+        }
+    }
+}
+
+// Fill the occlusion culler's depth buffer for the terrain's view. The footprint of a patch at the lowest height of
+// its tile lies in the ground under the surface, so every ray through it has already hit the terrain and it hides
+// whatever is behind it. Nothing else is tested against the buffer, the scene's triangle only needs a bounds check.
+// The footprints only live for this frame, so they come from the frame arena.
+void Renderer::renderTerrainOccluders()
+{
+    m_occlusionCuller->clear();
+
+    const size_t patchCount = m_terrainSelection.patches.size();
+    if (patchCount == 0u)
+    {
+        return;
+    }
+
+    LinearArena &frameArena = getFrameArena();
+    Vec4 *vertices = frameArena.allocateArray<Vec4>(patchCount * 4u);
+    uint32_t *indices = frameArena.allocateArray<uint32_t>(patchCount * 6u);
+
+    for (size_t i = 0; i < patchCount; ++i)
+    {
+        const Aabb bounds = m_terrainTiles->getTileBounds(m_terrainSelection.patches[i].tile);
+        const uint32_t base = static_cast<uint32_t>(i * 4u);
+        for (uint32_t corner = 0u; corner < 4u; ++corner)
+        {
+            const Vec4 position{ (corner & 1u) ? bounds.max.x : bounds.min.x, bounds.min.y, (corner & 2u) ? bounds.max.z : bounds.min.z, 1.0f };
+            vertices[base + corner] = transform(position, m_terrainViewProjection);
+        }
+
+        const uint32_t quad[6] = { base, base + 1u, base + 3u, base, base + 3u, base + 2u };
+        std::copy(std::begin(quad), std::end(quad), indices + i * 6u);
+    }
+
+    m_occlusionCuller->renderOccluders(&vertices[0].x, indices, static_cast<uint32_t>(patchCount * 2u));
+}
+
+// Read back the GPU time of the frame that last used the current frame index and pick the next render scale.
+// Must only be called once that frame's fence has completed.
+void Renderer::updateRenderScale()
+{
+    if (!m_timestampsPending[m_frameIndex])
+    {
+        return;
+    }
+    m_timestampsPending[m_frameIndex] = false;
+
+    D3D12_RANGE timestampReadRange;
+    timestampReadRange.Begin = 2 * m_frameIndex * sizeof(UINT64);
+    timestampReadRange.End = timestampReadRange.Begin + 2 * sizeof(UINT64);
+
+    UINT8 *pTimestampData;
+    winrt::check_hresult(m_timestampReadbackBuffer->Map(0, &timestampReadRange, reinterpret_cast<void **>(&pTimestampData)));
+    UINT64 timestamps[2];
+    memcpy(timestamps, pTimestampData + timestampReadRange.Begin, sizeof(timestamps));
+
+    // We did not write anything
+    D3D12_RANGE timestampWriteRange;
+    timestampWriteRange.Begin = 0;
+    timestampWriteRange.End = 0;
+    m_timestampReadbackBuffer->Unmap(0, &timestampWriteRange);
+
+    if (timestamps[1] > timestamps[0] && m_timestampFrequency != 0)
+    {
+        const float gpuFrameTimeMs = static_cast<float>(static_cast<double>(timestamps[1] - timestamps[0]) * 1000.0 / static_cast<double>(m_timestampFrequency));
+        m_renderScale = m_resolutionScaleController.update(gpuFrameTimeMs, m_timestampScales[m_frameIndex]);
+
+#if defined(_DEBUG)
+        char traceLine[48];
+        snprintf(traceLine, sizeof(traceLine), "drs %.4f %.4f\n", gpuFrameTimeMs, m_timestampScales[m_frameIndex]);
+        m_resolutionTrace += traceLine;
+        if (++m_resolutionTraceFrames == ResolutionTraceBlock)
+        {
+            OutputDebugStringA(m_resolutionTrace.c_str());
+            m_resolutionTrace.clear();
+            m_resolutionTraceFrames = 0u;
+        }
+#endif
+    }
+}
+
+void Renderer::loadShaderManifest()
+{
+    //// Get current working directory
+    //char pBuf[1024];
+    //_getcwd(pBuf, 1024);
+    //OutputDebugString(L"test\n");
+    // TODO: dynamically get compile path
+    m_shaderBasePath = L"C:\\Users\\adi_1\\Documents\\Github\\DirectX12-Engine\\DirectX12-Engine\\x64\\Debug\\AppX";
+
+    // Prefer the bytecode built by the ShaderBuilder tool when its manifest is deployed with the app
+    try
+    {
+        BasicReaderWriter basicReaderWriter;
+        std::vector<byte> manifestData{ basicReaderWriter.ReadData((m_shaderBasePath + L"\\Shaders\\ShaderManifest.txt").c_str()) };
+
+        m_shaderManifest = std::make_unique<ShaderManifest>();
+        if (!m_shaderManifest->parse(std::string(manifestData.begin(), manifestData.end())))
+        {
+            m_shaderManifest.reset();
+        }
+    }
+    catch (winrt::hresult_error const &)
+    {
+        // No manifest, fall back to the FxCompile output
+        m_shaderManifest.reset();
+    }
+}
+
+std::vector<byte> Renderer::loadShaderBytecode(const std::string &name)
+{
+    std::wstring compiledPathW = m_shaderBasePath + L"\\" + std::wstring(winrt::to_hstring(name)) + L".cso";
+
+    const ShaderRecord *shaderRecord = m_shaderManifest ? m_shaderManifest->find(name) : nullptr;
+    if (shaderRecord)
+    {
+        compiledPathW = m_shaderBasePath + L"\\Shaders\\" + std::wstring(winrt::to_hstring(shaderRecord->file));
+    }
+
+    BasicReaderWriter basicReaderWriter;
+    return basicReaderWriter.ReadData(compiledPathW.c_str());
+}
+
+// Bytecode built by ShaderBuilder comes with its reflection in the manifest. Throws when the shader expects the
+// binding at another register than the root signature puts it, or reads more root constants than it provides.
+// Bindings the compiler removed and bytecode from FxCompile, which has no reflection, pass unchecked.
+void Renderer::checkShaderBinding(const char *shaderName, const char *bindingName, const char *bindPoint, UINT rootConstantCount) const
+{
+    const ShaderRecord *shaderRecord = m_shaderManifest ? m_shaderManifest->find(shaderName) : nullptr;
+    const ShaderBinding *binding = shaderRecord ? shaderRecord->findBinding(bindingName) : nullptr;
+    if (!binding)
+    {
+        return;
+    }
+
+    // Constant buffers are laid out in 16 byte rows
+    const ShaderConstantBuffer *constantBuffer = shaderRecord->findConstantBuffer(bindingName);
+    const UINT rootConstantSize = (rootConstantCount * sizeof(uint32_t) + 15u) & ~15u;
+    if (binding->bindPoint != bindPoint || (rootConstantCount > 0u && constantBuffer && constantBuffer->size > rootConstantSize))
+    {
+        const std::string message = std::string(shaderName) + ": " + bindingName + " does not match the root signature, rebuild the shaders";
+        OutputDebugStringA((message + "\n").c_str());
+        throw winrt::hresult_error(E_INVALIDARG, winrt::to_hstring(message));
+    }
+}
+
+void Renderer::trackResource(ID3D12Resource *resource, const char *name, GpuResourceCategory category, const GpuResourceSource &source)
+{
+    winrt::check_hresult(resource->SetName(winrt::to_hstring(name).c_str()));
+
+    // Swap chain buffers have no heap properties, they live in video memory like default heaps
+    GpuHeapType heap = GpuHeapType::Default;
+    D3D12_HEAP_PROPERTIES heapProperties;
+    if (SUCCEEDED(resource->GetHeapProperties(&heapProperties, nullptr)))
+    {
+        heap = heapProperties.Type == D3D12_HEAP_TYPE_UPLOAD ? GpuHeapType::Upload :
+            heapProperties.Type == D3D12_HEAP_TYPE_READBACK ? GpuHeapType::Readback : GpuHeapType::Default;
+    }
+
+    // The size the allocation really takes, including alignment and texture layout padding
+    const D3D12_RESOURCE_DESC resourceDesc = resource->GetDesc();
+    const D3D12_RESOURCE_ALLOCATION_INFO allocationInfo = m_device->GetResourceAllocationInfo(0, 1, &resourceDesc);
+
+    const GpuResourceRegistry::ResourceId id = getGpuResourceRegistry().add(name, category, heap, allocationInfo.SizeInBytes, source);
+    ResourceReleaseNotifier *notifier = new ResourceReleaseNotifier(id);
+    const HRESULT result = resource->SetPrivateDataInterface(ResourceReleaseNotifierGuid, notifier);
+    notifier->Release();
+    winrt::check_hresult(result);
 }
 
 // Wait for pending GPU work to complete.
@@ -571,7 +2320,382 @@ void Renderer::waitForGpu()
     m_fenceValues[m_frameIndex]++;
 }
 
-void Renderer::populateCommandList()
+// Batch the sprites into this frame's region of the instance buffer and draw them into the scene target.
+// The fence wait at the end of render() guarantees the GPU has finished reading that region.
+void Renderer::drawSprites(const std::vector<Sprite> &sprites)
+{
+    if (sprites.empty())
+    {
+        return;
+    }
+
+    SpriteBatch::Instance *instances = m_mappedSpriteInstances + m_frameIndex * MaxSprites;
+    const std::vector<SpriteBatch::Draw> &draws = m_spriteBatch.build(sprites.data(), static_cast<uint32_t>(sprites.size()), instances);
+
+    m_commandListState.SetPipelineState(m_spritePipelineState.get());
+    m_commandListState.SetGraphicsRootSignature(m_spriteRootSignature.get());
+    m_commandListState.IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+
+    // Sprites are positioned in full resolution pixels, the scaled viewport takes care of the render scale
+    const float spriteConstants[2] = { 1.0f / m_viewport.Width, 1.0f / m_viewport.Height };
+    m_commandListState.SetGraphicsRoot32BitConstants(1, 2, spriteConstants, 0);
+
+    D3D12_VERTEX_BUFFER_VIEW instanceBufferView;
+    instanceBufferView.BufferLocation = m_spriteInstanceBuffer->GetGPUVirtualAddress() + m_frameIndex * MaxSprites * sizeof(SpriteBatch::Instance);
+    instanceBufferView.StrideInBytes = sizeof(SpriteBatch::Instance);
+    instanceBufferView.SizeInBytes = MaxSprites * sizeof(SpriteBatch::Instance);
+    m_commandListState.IASetVertexBuffers(0, 1, &instanceBufferView);
+
+    // There is one atlas page so every draw uses the same SRV, later pages would follow it in the heap
+    D3D12_GPU_DESCRIPTOR_HANDLE atlasHandle(m_cbvSrvUavHeap->GetGPUDescriptorHandleForHeapStart());
+    atlasHandle.ptr += 3 * m_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+
+    for (const SpriteBatch::Draw &draw : draws)
+    {
+        D3D12_GPU_DESCRIPTOR_HANDLE pageHandle = atlasHandle;
+        pageHandle.ptr += draw.page * m_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+        m_commandListState.SetGraphicsRootDescriptorTable(0, pageHandle);
+        m_graphicsCommandList->DrawInstanced(4, draw.instanceCount, 0, draw.firstInstance);
+    }
+}
+
+// Advance the particles by one step on the compute command list. The passes emit into and integrate the
+// current alive list, append the survivors to the other one and leave the billboard draw in m_particleArguments.
+void Renderer::simulateParticles()
+{
+    const ParticleFrameConstants constants = makeParticleFrameConstants(m_particleEmitter, ParticleStepTime, MaxParticles, m_particleEmitCarry);
+
+    ID3D12Resource *pAliveList = m_particleAliveLists[m_particleAliveIndex].get();
+    ID3D12Resource *pAliveNextList = m_particleAliveLists[1u - m_particleAliveIndex].get();
+    ID3D12Resource *pParticleBuffers[] = { m_particleBuffer.get(), pAliveList, pAliveNextList, m_particleDeadList.get(), m_particleCounters.get(), m_particleArguments.get() };
+
+    m_particleListState.SetComputeRootSignature(m_particleRootSignature.get());
+    m_particleListState.SetComputeRoot32BitConstants(0, sizeof(constants) / sizeof(uint32_t), &constants, 0);
+    for (UINT i = 0; i < _countof(pParticleBuffers); ++i)
+    {
+        m_particleListState.SetComputeRootUnorderedAccessView(1 + i, pParticleBuffers[i]->GetGPUVirtualAddress());
+    }
+
+    // Every pass reads what the previous one wrote
+    D3D12_RESOURCE_BARRIER passBarrier;
+    passBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
+    passBarrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+    passBarrier.UAV.pResource = nullptr;
+
+    D3D12_RESOURCE_BARRIER argumentsBarrier;
+    argumentsBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+    argumentsBarrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+    argumentsBarrier.Transition.pResource = m_particleArguments.get();
+    argumentsBarrier.Transition.StateBefore = D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+    argumentsBarrier.Transition.StateAfter = D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT;
+    argumentsBarrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+
+    // Clamp the emission and size the simulation dispatch
+    m_particleListState.SetPipelineState(m_particlePassPipelineStates[0].get());
+    m_particleCommandList->Dispatch(1, 1, 1);
+
+    std::array<D3D12_RESOURCE_BARRIER, 2> prepareBarriers = { passBarrier, argumentsBarrier };
+    m_particleCommandList->ResourceBarrier(prepareBarriers.size(), prepareBarriers.data());
+
+    // Emission is dispatched for the requested count, threads past the clamped count return at once
+    m_particleListState.SetPipelineState(m_particlePassPipelineStates[1].get());
+    m_particleCommandList->Dispatch((constants.emitCount + ParticleGroupSize - 1u) / ParticleGroupSize, 1, 1);
+    m_particleCommandList->ResourceBarrier(1, &passBarrier);
+
+    m_particleListState.SetPipelineState(m_particlePassPipelineStates[2].get());
+    m_particleCommandList->ExecuteIndirect(m_particleDispatchSignature.get(), 1, m_particleArguments.get(), 0, nullptr, 0);
+
+    std::array<D3D12_RESOURCE_BARRIER, 2> simulateBarriers = { passBarrier, argumentsBarrier };
+    std::swap(simulateBarriers[1].Transition.StateBefore, simulateBarriers[1].Transition.StateAfter);
+    m_particleCommandList->ResourceBarrier(simulateBarriers.size(), simulateBarriers.data());
+
+    // Swap the alive lists and write the draw arguments
+    m_particleListState.SetPipelineState(m_particlePassPipelineStates[3].get());
+    m_particleCommandList->Dispatch(1, 1, 1);
+
+    // The billboards read the particles and the new alive list in the vertex shader
+    std::array<D3D12_RESOURCE_BARRIER, 3> drawBarriers = { argumentsBarrier, argumentsBarrier, argumentsBarrier };
+    drawBarriers[1].Transition.pResource = m_particleBuffer.get();
+    drawBarriers[1].Transition.StateAfter = D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+    drawBarriers[2].Transition.pResource = pAliveNextList;
+    drawBarriers[2].Transition.StateAfter = D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+    m_particleCommandList->ResourceBarrier(drawBarriers.size(), drawBarriers.data());
+
+    m_particleAliveIndex = 1u - m_particleAliveIndex;
+}
+
+// Draw every alive particle as a billboard into the scene target, the instance count comes from
+// the argument buffer the simulation wrote. Leaves the particle buffers ready for the next step.
+void Renderer::drawParticles()
+{
+    ID3D12Resource *pAliveList = m_particleAliveLists[m_particleAliveIndex].get();
+
+    m_commandListState.SetPipelineState(m_particleDrawPipelineState.get());
+    m_commandListState.SetGraphicsRootSignature(m_particleRootSignature.get());
+    m_commandListState.IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+    m_commandListState.SetGraphicsRootShaderResourceView(7, m_particleBuffer->GetGPUVirtualAddress());
+    m_commandListState.SetGraphicsRootShaderResourceView(8, pAliveList->GetGPUVirtualAddress());
+
+    // The emitter stands near the bottom of the view, world units are kept square on wide windows
+    const float aspectCorrection = m_viewport.Height / m_viewport.Width;
+    const float drawConstants[6] =
+    {
+        ParticleWorldToClip * aspectCorrection, ParticleWorldToClip,
+        0.0f, -0.8f,
+        ParticleBillboardSize * aspectCorrection, ParticleBillboardSize
+    };
+    m_commandListState.SetGraphicsRoot32BitConstants(9, _countof(drawConstants), drawConstants, 0);
+
+    m_graphicsCommandList->ExecuteIndirect(m_particleDrawSignature.get(), 1, m_particleArguments.get(), sizeof(D3D12_DISPATCH_ARGUMENTS), nullptr, 0);
+
+    std::array<D3D12_RESOURCE_BARRIER, 3> simulateBarriers;
+    for (UINT i = 0; i < simulateBarriers.size(); ++i)
+    {
+        simulateBarriers[i].Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+        simulateBarriers[i].Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+        simulateBarriers[i].Transition.StateBefore = D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+        simulateBarriers[i].Transition.StateAfter = D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+        simulateBarriers[i].Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+    }
+    simulateBarriers[0].Transition.pResource = m_particleArguments.get();
+    simulateBarriers[0].Transition.StateBefore = D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT;
+    simulateBarriers[1].Transition.pResource = m_particleBuffer.get();
+    simulateBarriers[2].Transition.pResource = pAliveList;
+    m_graphicsCommandList->ResourceBarrier(simulateBarriers.size(), simulateBarriers.data());
+}
+
+// Copy the tiles staged this frame into their cache slots and draw every patch as an instance of the grid,
+// with depth. The scene target stays bound without depth afterwards.
+void Renderer::drawTerrain(D3D12_CPU_DESCRIPTOR_HANDLE sceneRtvHandle)
+{
+    if (!m_terrainUploadSlots.empty())
+    {
+        D3D12_RESOURCE_BARRIER heightsBarrier;
+        heightsBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+        heightsBarrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+        heightsBarrier.Transition.pResource = m_terrainHeights.get();
+        heightsBarrier.Transition.StateBefore = D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+        heightsBarrier.Transition.StateAfter = D3D12_RESOURCE_STATE_COPY_DEST;
+        heightsBarrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+        m_graphicsCommandList->ResourceBarrier(1, &heightsBarrier);
+
+        const UINT64 uploadFrameOffset = m_frameIndex * MaxTerrainUploads * m_terrainSlotStride;
+        for (size_t i = 0; i < m_terrainUploadSlots.size(); ++i)
+        {
+            m_graphicsCommandList->CopyBufferRegion(m_terrainHeights.get(), m_terrainUploadSlots[i] * m_terrainSlotStride,
+                m_terrainUploadBuffer.get(), uploadFrameOffset + i * m_terrainSlotStride, m_terrainTiles->getTileDataSize());
+        }
+
+        std::swap(heightsBarrier.Transition.StateBefore, heightsBarrier.Transition.StateAfter);
+        m_graphicsCommandList->ResourceBarrier(1, &heightsBarrier);
+    }
+
+    D3D12_CPU_DESCRIPTOR_HANDLE dsvHandle(m_dsvHeap->GetCPUDescriptorHandleForHeapStart());
+    m_graphicsCommandList->ClearDepthStencilView(dsvHandle, D3D12_CLEAR_FLAG_DEPTH, 1.0f, 0, 1, &m_sceneScissorRect);
+    m_graphicsCommandList->OMSetRenderTargets(1, &sceneRtvHandle, FALSE, &dsvHandle);
+
+    m_commandListState.SetPipelineState(m_terrainPipelineState.get());
+    m_commandListState.SetGraphicsRootSignature(m_terrainRootSignature.get());
+    m_commandListState.IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+    TerrainConstants constants = {};
+    constants.viewProjection = m_terrainViewProjection;
+    constants.heightScale = m_terrainTiles->getHeader().heightScale;
+    constants.tileSamples = m_terrainTiles->getTileSamples();
+    constants.slotStride = static_cast<uint32_t>(m_terrainSlotStride);
+    m_commandListState.SetGraphicsRoot32BitConstants(0, sizeof(constants) / sizeof(uint32_t), &constants, 0);
+    m_commandListState.SetGraphicsRootShaderResourceView(1, m_terrainHeights->GetGPUVirtualAddress());
+
+    std::array<D3D12_VERTEX_BUFFER_VIEW, 2> terrainBufferViews;
+    terrainBufferViews[0] = m_terrainGridVertexView;
+    terrainBufferViews[1].BufferLocation = m_terrainInstanceBuffer->GetGPUVirtualAddress() + m_frameIndex * MaxTerrainPatches * sizeof(TerrainPatch);
+    terrainBufferViews[1].StrideInBytes = sizeof(TerrainPatch);
+    terrainBufferViews[1].SizeInBytes = MaxTerrainPatches * sizeof(TerrainPatch);
+    m_commandListState.IASetVertexBuffers(0, static_cast<uint32_t>(terrainBufferViews.size()), terrainBufferViews.data());
+    m_commandListState.IASetIndexBuffer(&m_terrainGridIndexView);
+
+    if (m_terrainPatchCount > 0u)
+    {
+        m_graphicsCommandList->DrawIndexedInstanced(m_terrainGridIndexCount, m_terrainPatchCount, 0, 0, 0);
+    }
+
+    m_graphicsCommandList->OMSetRenderTargets(1, &sceneRtvHandle, FALSE, nullptr);
+}
+
+void Renderer::startCapture(CaptureSource source, std::unique_ptr<CaptureSink> sink, uint32_t encoderThreads)
+{
+    std::unique_ptr<CaptureRequest> request = std::make_unique<CaptureRequest>();
+    request->source = source;
+    request->sink = std::move(sink);
+    request->settings.encoderThreads = (std::max)(encoderThreads, 1u);
+
+    std::lock_guard<std::mutex> lock(m_captureRequestMutex);
+    m_captureRequest = std::move(request);
+}
+
+void Renderer::stopCapture()
+{
+    std::unique_ptr<CaptureRequest> request = std::make_unique<CaptureRequest>();
+    request->source = CaptureSource::BackBuffer;
+
+    std::lock_guard<std::mutex> lock(m_captureRequestMutex);
+    m_captureRequest = std::move(request);
+}
+
+// Runs between frames on the render thread, so nothing is recording into the capture buffers
+void Renderer::applyCaptureRequest()
+{
+    std::unique_ptr<CaptureRequest> request;
+    {
+        std::lock_guard<std::mutex> lock(m_captureRequestMutex);
+        request = std::move(m_captureRequest);
+    }
+
+    if (request == nullptr)
+    {
+        return;
+    }
+
+    endCapture();
+    if (request->sink != nullptr)
+    {
+        beginCapture(request->source, std::move(request->sink), request->settings);
+    }
+}
+
+void Renderer::beginCapture(CaptureSource source, std::unique_ptr<CaptureSink> sink, const FrameCapture::Settings &settings)
+{
+    ID3D12Resource *sourceResource = source == CaptureSource::BackBuffer ? m_renderTargets[m_frameIndex].get() : m_uavBuffer.get();
+    const D3D12_RESOURCE_DESC sourceDesc = sourceResource->GetDesc();
+    UINT64 captureBufferSize = 0u;
+    m_device->GetCopyableFootprints(&sourceDesc, 0, 1, 0, &m_captureFootprint, nullptr, nullptr, &captureBufferSize);
+
+    D3D12_HEAP_PROPERTIES readbackHeapProps = {};
+    readbackHeapProps.Type = D3D12_HEAP_TYPE_READBACK;
+    readbackHeapProps.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+    readbackHeapProps.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+    readbackHeapProps.CreationNodeMask = 1;
+    readbackHeapProps.VisibleNodeMask = 1;
+
+    D3D12_RESOURCE_DESC readbackDesc = {};
+    readbackDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+    readbackDesc.Alignment = 0;
+    readbackDesc.Width = captureBufferSize;
+    readbackDesc.Height = 1;
+    readbackDesc.DepthOrArraySize = 1;
+    readbackDesc.MipLevels = 1;
+    readbackDesc.Format = DXGI_FORMAT_UNKNOWN;
+    readbackDesc.SampleDesc.Count = 1;
+    readbackDesc.SampleDesc.Quality = 0;
+    readbackDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+    readbackDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+
+    // Readback buffers stay mapped for the whole capture, the ring makes sure the CPU only reads a slot
+    // after the fence of its copy has passed and the GPU only writes it after the encoder is done
+    static const char *const CaptureBufferNames[CaptureSlotCount] = { "capture readback 0", "capture readback 1", "capture readback 2", "capture readback 3" };
+    std::vector<const uint8_t *> slots(CaptureSlotCount);
+    for (UINT i = 0; i < CaptureSlotCount; ++i)
+    {
+        winrt::check_hresult(m_device->CreateCommittedResource(
+            &readbackHeapProps, D3D12_HEAP_FLAG_NONE, &readbackDesc,
+            D3D12_RESOURCE_STATE_COPY_DEST, nullptr,
+            __uuidof(m_captureBuffers[i]), m_captureBuffers[i].put_void()));
+        trackResource(m_captureBuffers[i].get(), CaptureBufferNames[i], GpuResourceCategory::Readback, GPU_RESOURCE_SOURCE);
+
+        void *pCaptureData = nullptr;
+        winrt::check_hresult(m_captureBuffers[i]->Map(0, nullptr, &pCaptureData));
+        slots[i] = static_cast<const uint8_t *>(pCaptureData) + m_captureFootprint.Offset;
+    }
+
+    CaptureLayout layout;
+    layout.width = static_cast<uint32_t>(sourceDesc.Width);
+    layout.height = sourceDesc.Height;
+    layout.rowPitch = m_captureFootprint.Footprint.RowPitch;
+    layout.format = source == CaptureSource::BackBuffer ? CaptureFormat::Rgba8 : CaptureFormat::R32Float;
+
+    m_frameCapture = std::make_unique<FrameCapture>(layout, slots, std::move(sink), settings);
+    m_captureSource = source;
+    m_captureFrameNumber = 0u;
+}
+
+void Renderer::endCapture()
+{
+    if (m_frameCapture == nullptr)
+    {
+        return;
+    }
+
+    // Every copy is done once the GPU is idle, the encoders write them before the capture goes away
+    waitForGpu();
+    m_frameCapture->poll(m_fence->GetCompletedValue());
+    m_frameCapture.reset();
+
+    // We did not write to the buffers on the CPU
+    D3D12_RANGE captureWriteRange;
+    captureWriteRange.Begin = 0;
+    captureWriteRange.End = 0;
+    for (UINT i = 0; i < CaptureSlotCount; ++i)
+    {
+        m_captureBuffers[i]->Unmap(0, &captureWriteRange);
+        m_captureBuffers[i] = nullptr;
+    }
+}
+
+// Copy the capture source into a free readback slot, a frame is skipped when every slot is still being encoded.
+// Returns the state the back buffer is left in.
+D3D12_RESOURCE_STATES Renderer::recordCapture()
+{
+    m_captureSlot = ReadbackRing::NoSlot;
+    if (m_frameCapture == nullptr)
+    {
+        return D3D12_RESOURCE_STATE_RENDER_TARGET;
+    }
+
+    m_captureSlot = m_frameCapture->beginFrame(m_captureFrameNumber++);
+    if (m_captureSlot == ReadbackRing::NoSlot)
+    {
+        return D3D12_RESOURCE_STATE_RENDER_TARGET;
+    }
+
+    const bool backBuffer = m_captureSource == CaptureSource::BackBuffer;
+    const D3D12_RESOURCE_STATES sourceState = backBuffer ? D3D12_RESOURCE_STATE_RENDER_TARGET : D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+
+    D3D12_RESOURCE_BARRIER copyBarrier;
+    copyBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+    copyBarrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+    copyBarrier.Transition.pResource = backBuffer ? m_renderTargets[m_frameIndex].get() : m_uavBuffer.get();
+    copyBarrier.Transition.StateBefore = sourceState;
+    copyBarrier.Transition.StateAfter = D3D12_RESOURCE_STATE_COPY_SOURCE;
+    copyBarrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+    m_graphicsCommandList->ResourceBarrier(1, &copyBarrier);
+
+    D3D12_TEXTURE_COPY_LOCATION srcLoc = {};
+    srcLoc.pResource = copyBarrier.Transition.pResource;
+    srcLoc.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+    srcLoc.SubresourceIndex = 0;
+
+    D3D12_TEXTURE_COPY_LOCATION dstLoc = {};
+    dstLoc.pResource = m_captureBuffers[m_captureSlot].get();
+    dstLoc.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+    dstLoc.PlacedFootprint = m_captureFootprint;
+
+    m_graphicsCommandList->CopyTextureRegion(&dstLoc, 0, 0, 0, &srcLoc, nullptr);
+
+    if (backBuffer)
+    {
+        return D3D12_RESOURCE_STATE_COPY_SOURCE;
+    }
+
+    copyBarrier.Transition.StateBefore = D3D12_RESOURCE_STATE_COPY_SOURCE;
+    copyBarrier.Transition.StateAfter = sourceState;
+    m_graphicsCommandList->ResourceBarrier(1, &copyBarrier);
+    return D3D12_RESOURCE_STATE_RENDER_TARGET;
+}
+
+// Record and execute the frame. Until the particles are ready it is one direct command list. Then the
+// particle simulation runs on the compute queue next to the scene pass, and the compose pass that draws
+// the particles waits for it, as m_frameSchedules lays out.
+void Renderer::executeFrame(const std::vector<Sprite> &sprites)
 {
     // Command list allocators can only be reset when the associated
     // command lists have finished execution on the GPU; apps should use
@@ -581,53 +2705,227 @@ void Renderer::populateCommandList()
     // However, when ExecuteCommandList() is called on a particular command
     // list, that command list can then be reset at any time and must be before
     // re-recording.
-    winrt::check_hresult(m_graphicsCommandList->Reset(m_commandAllocators[m_frameIndex].get(), m_pipelineState.get()));
+    // State calls go through m_commandListState so redundant ones are dropped before reaching the driver.
+    if (!m_particlesReady)
+    {
+        winrt::check_hresult(m_commandListState.Reset(m_commandAllocators[m_frameIndex].get(), m_pipelineState.get()));
+        recordScenePass();
+        recordComposePass(sprites);
+
+        ID3D12CommandList *ppGraphicsCommandLists[] = { m_graphicsCommandList.get() };
+        m_commandQueue->ExecuteCommandLists(_countof(ppGraphicsCommandLists), ppGraphicsCommandLists);
+        return;
+    }
+
+    // The first startup uploads fill the particle buffers, so the simulation waits for a scene pass that records any
+    bool uploadsPending = false;
+    {
+        std::lock_guard<std::mutex> lock(m_pendingUploadMutex);
+        uploadsPending = !m_pendingUploads.empty();
+    }
+
+    // The previous frame drew the particles and handed their buffers back to the simulation. The schedule
+    // only orders the work of this frame, so the compute queue waits for the previous frame's fence first.
+    winrt::check_hresult(m_queueSubmitter->getQueue(QueueType::Compute)->Wait(m_fence.get(), m_fenceValues[m_frameIndex] - 1u));
+
+    // Both direct passes record into m_graphicsCommandList, the scene pass is submitted before the compose pass resets it
+    m_queueSubmitter->execute(m_frameSchedules[uploadsPending ? 1 : 0], [this, &sprites](QueueScheduler::WorkId work) -> ID3D12CommandList *
+    {
+        switch (work)
+        {
+        case SceneWork:
+            winrt::check_hresult(m_commandListState.Reset(m_commandAllocators[m_frameIndex].get(), m_pipelineState.get()));
+            recordScenePass();
+            winrt::check_hresult(m_graphicsCommandList->Close());
+            return m_graphicsCommandList.get();
+        case ParticleWork:
+            // The compose pass waited for the simulation, so the frame fence also covers this allocator
+            winrt::check_hresult(m_particleCommandAllocators[m_frameIndex]->Reset());
+            winrt::check_hresult(m_particleListState.Reset(m_particleCommandAllocators[m_frameIndex].get(), m_particlePassPipelineStates[0].get()));
+            simulateParticles();
+            winrt::check_hresult(m_particleCommandList->Close());
+            return m_particleCommandList.get();
+        default:
+            winrt::check_hresult(m_commandListState.Reset(m_commandAllocators[m_frameIndex].get(), m_pipelineState.get()));
+            bindSceneTarget();
+            recordComposePass(sprites);
+            return m_graphicsCommandList.get();
+        }
+    });
+}
+
+// Everything drawn into the scene target before the particles. Leaves the scene target bound.
+void Renderer::recordScenePass()
+{
+    // Startup uploads go ahead of the frame's timestamps so they do not count towards its GPU time
+    recordPendingUploads();
+
+    // Time the whole frame on the GPU to drive the dynamic resolution
+    m_graphicsCommandList->EndQuery(m_timestampQueryHeap.get(), D3D12_QUERY_TYPE_TIMESTAMP, 2 * m_frameIndex);
+
+    // The scene is drawn into the top left corner of the scene target at the current render scale
+    const UINT sceneWidth = (std::max)(static_cast<UINT>(m_viewport.Width * m_renderScale + 0.5f), 1u);
+    const UINT sceneHeight = (std::max)(static_cast<UINT>(m_viewport.Height * m_renderScale + 0.5f), 1u);
+
+    m_sceneViewport = m_viewport;
+    m_sceneViewport.Width = static_cast<float>(sceneWidth);
+    m_sceneViewport.Height = static_cast<float>(sceneHeight);
+
+    m_sceneScissorRect.left = 0l;
+    m_sceneScissorRect.top = 0l;
+    m_sceneScissorRect.right = static_cast<LONG>(sceneWidth);
+    m_sceneScissorRect.bottom = static_cast<LONG>(sceneHeight);
+
+    // Indicate that the scene target will be used as a render target.
+    D3D12_RESOURCE_BARRIER sceneTargetBarrier;
+    sceneTargetBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+    sceneTargetBarrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+    sceneTargetBarrier.Transition.pResource = m_sceneTarget.get();
+    sceneTargetBarrier.Transition.StateBefore = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
+    sceneTargetBarrier.Transition.StateAfter = D3D12_RESOURCE_STATE_RENDER_TARGET;
+    sceneTargetBarrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+
+    m_graphicsCommandList->ResourceBarrier(1, &sceneTargetBarrier);
 
     // Set necessary state.
-    m_graphicsCommandList->SetGraphicsRootSignature(m_rootSignature.get());
-    m_graphicsCommandList->RSSetViewports(1, &m_viewport);
-    m_graphicsCommandList->RSSetScissorRects(1, &m_surfaceSize);
+    const D3D12_CPU_DESCRIPTOR_HANDLE sceneRtvHandle = bindSceneTarget();
+
+    // Record commands.
+    m_graphicsCommandList->ClearRenderTargetView(sceneRtvHandle, SceneClearColor, 1, &m_sceneScissorRect);
+
+    // The terrain goes first with its own root signature and depth, the scene's root arguments are bound after it
+    if (m_terrainReady)
+    {
+        drawTerrain(sceneRtvHandle);
+    }
+
+    m_commandListState.SetPipelineState(m_pipelineState.get());
+    m_commandListState.SetGraphicsRootSignature(m_rootSignature.get());
 
-    std::array<ID3D12DescriptorHeap *, 1> pDescriptorHeaps { m_cbvSrvUavHeap.get()};
-    m_graphicsCommandList->SetDescriptorHeaps(pDescriptorHeaps.size(), pDescriptorHeaps.data());
     D3D12_GPU_DESCRIPTOR_HANDLE srvHandle(m_cbvSrvUavHeap->GetGPUDescriptorHandleForHeapStart());
-    m_graphicsCommandList->SetGraphicsRootDescriptorTable(0, srvHandle);
+    m_commandListState.SetGraphicsRootDescriptorTable(0, srvHandle);
+    m_commandListState.SetGraphicsRoot32BitConstants(1, _countof(m_sceneConstants), m_sceneConstants, 0);
+
+    // Light clusters of this frame, the pixel shader finds its cluster from its pixel position
+    const D3D12_GPU_VIRTUAL_ADDRESS lightFrameAddress = m_lightBuffer->GetGPUVirtualAddress() + m_frameIndex * m_lightFrameSize;
+    m_commandListState.SetGraphicsRootShaderResourceView(2, lightFrameAddress);
+    m_commandListState.SetGraphicsRootShaderResourceView(3, lightFrameAddress + m_lightClustersOffset);
+    m_commandListState.SetGraphicsRootShaderResourceView(4, lightFrameAddress + m_lightIndicesOffset);
+
+    const LightClusterConfig &clusterConfig = m_lightClusterGrid->getConfig();
+    LightingConstants lightingConstants;
+    lightingConstants.invSceneSize[0] = 1.0f / m_sceneViewport.Width;
+    lightingConstants.invSceneSize[1] = 1.0f / m_sceneViewport.Height;
+    lightingConstants.invProjectionScale[0] = 1.0f / clusterConfig.projectionScaleX;
+    lightingConstants.invProjectionScale[1] = 1.0f / clusterConfig.projectionScaleY;
+    lightingConstants.surfaceDepth = ScenePlaneDepth;
+    lightingConstants.sliceScale = m_lightClusterGrid->getSliceScale();
+    lightingConstants.sliceBias = m_lightClusterGrid->getSliceBias();
+    lightingConstants.tilesX = clusterConfig.tilesX;
+    lightingConstants.tilesY = clusterConfig.tilesY;
+    lightingConstants.slices = clusterConfig.slices;
+    m_commandListState.SetGraphicsRoot32BitConstants(5, sizeof(lightingConstants) / sizeof(uint32_t), &lightingConstants, 0);
+
+    m_commandListState.IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    m_commandListState.IASetVertexBuffers(0, 1, &m_vertexBufferView);
+    m_commandListState.IASetIndexBuffer(&m_indexBufferView);
+
+    // The triangle is drawn over the terrain without depth and nothing in its view covers it, so it is only
+    // skipped once its bounds leave the view. The occlusion buffer holds the terrain's view at this point.
+    const float *minCorner = m_triangleClipBounds[0];
+    const float *maxCorner = m_triangleClipBounds[7];
+    if (maxCorner[0] >= -1.0f && minCorner[0] <= 1.0f && maxCorner[1] >= -1.0f && minCorner[1] <= 1.0f && maxCorner[2] >= 0.0f && minCorner[2] <= 1.0f)
+    {
+        m_graphicsCommandList->DrawIndexedInstanced(3, 1, 0, 0, 0);
+    }
+}
+
+// Set the scene viewport, the descriptor heap and the scene target, which a new command list has to do again
+D3D12_CPU_DESCRIPTOR_HANDLE Renderer::bindSceneTarget()
+{
+    m_commandListState.RSSetViewports(1, &m_sceneViewport);
+    m_commandListState.RSSetScissorRects(1, &m_sceneScissorRect);
+
+    std::array<ID3D12DescriptorHeap *, 1> pDescriptorHeaps { m_cbvSrvUavHeap.get()};
+    m_commandListState.SetDescriptorHeaps(pDescriptorHeaps.size(), pDescriptorHeaps.data());
 
-    // Indicate that the back buffer will be used as a render target.
-    D3D12_RESOURCE_BARRIER renderTargetBarrier;
-    renderTargetBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-    renderTargetBarrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-    renderTargetBarrier.Transition.pResource = m_renderTargets[m_frameIndex].get();
-    renderTargetBarrier.Transition.StateBefore = D3D12_RESOURCE_STATE_PRESENT;
-    renderTargetBarrier.Transition.StateAfter = D3D12_RESOURCE_STATE_RENDER_TARGET;
-    renderTargetBarrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+    D3D12_CPU_DESCRIPTOR_HANDLE sceneRtvHandle(m_rtvHeap->GetCPUDescriptorHandleForHeapStart());
+    sceneRtvHandle.ptr = sceneRtvHandle.ptr + (FrameCount * m_rtvDescriptorSize);
+    m_graphicsCommandList->OMSetRenderTargets(1, &sceneRtvHandle, FALSE, nullptr);
+    return sceneRtvHandle;
+}
 
-    m_graphicsCommandList->ResourceBarrier(1, &renderTargetBarrier);
+// Particles, sprites, the upscale into the back buffer and the frame capture. Closes the command list.
+void Renderer::recordComposePass(const std::vector<Sprite> &sprites)
+{
+    if (m_particlesReady)
+    {
+        drawParticles();
+    }
+    drawSprites(sprites);
+
+    // Indicate that the scene will be sampled and the back buffer will be used as a render target.
+    std::array<D3D12_RESOURCE_BARRIER, 2> upscaleBarriers;
+    upscaleBarriers[0].Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+    upscaleBarriers[0].Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+    upscaleBarriers[0].Transition.pResource = m_sceneTarget.get();
+    upscaleBarriers[0].Transition.StateBefore = D3D12_RESOURCE_STATE_RENDER_TARGET;
+    upscaleBarriers[0].Transition.StateAfter = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
+    upscaleBarriers[0].Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+
+    upscaleBarriers[1].Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+    upscaleBarriers[1].Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+    upscaleBarriers[1].Transition.pResource = m_renderTargets[m_frameIndex].get();
+    upscaleBarriers[1].Transition.StateBefore = D3D12_RESOURCE_STATE_PRESENT;
+    upscaleBarriers[1].Transition.StateAfter = D3D12_RESOURCE_STATE_RENDER_TARGET;
+    upscaleBarriers[1].Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+
+    m_graphicsCommandList->ResourceBarrier(upscaleBarriers.size(), upscaleBarriers.data());
 
     D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle(m_rtvHeap->GetCPUDescriptorHandleForHeapStart());
     rtvHandle.ptr = rtvHandle.ptr + (m_frameIndex * m_rtvDescriptorSize);
     m_graphicsCommandList->OMSetRenderTargets(1, &rtvHandle, FALSE, nullptr);
 
-    // Record commands.
-    const float clearColor[] = { 0.2f, 0.2f, 0.2f, 1.0f };
-    m_graphicsCommandList->ClearRenderTargetView(rtvHandle, clearColor, 0, nullptr);
-    m_graphicsCommandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-    m_graphicsCommandList->IASetVertexBuffers(0, 1, &m_vertexBufferView);
-    m_graphicsCommandList->IASetIndexBuffer(&m_indexBufferView);
+    // Upscale the scene to the back buffer with a fullscreen triangle
+    m_commandListState.SetGraphicsRootSignature(m_upscaleRootSignature.get());
+    m_commandListState.SetPipelineState(m_upscalePipelineState.get());
+    m_commandListState.IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    m_commandListState.RSSetViewports(1, &m_viewport);
+    m_commandListState.RSSetScissorRects(1, &m_surfaceSize);
 
-    m_graphicsCommandList->DrawIndexedInstanced(3, 1, 0, 0, 0);
+    D3D12_GPU_DESCRIPTOR_HANDLE sceneSrvHandle(m_cbvSrvUavHeap->GetGPUDescriptorHandleForHeapStart());
+    sceneSrvHandle.ptr += 2 * m_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+    m_commandListState.SetGraphicsRootDescriptorTable(0, sceneSrvHandle);
+
+    // Clamp half a texel inside the rendered area so bilinear filtering never reads stale texels
+    const float upscaleConstants[4] =
+    {
+        m_sceneViewport.Width / m_viewport.Width,
+        m_sceneViewport.Height / m_viewport.Height,
+        (m_sceneViewport.Width - 0.5f) / m_viewport.Width,
+        (m_sceneViewport.Height - 0.5f) / m_viewport.Height
+    };
+    m_commandListState.SetGraphicsRoot32BitConstants(1, 4, upscaleConstants, 0);
+    m_graphicsCommandList->DrawInstanced(3, 1, 0, 0);
+
+    const D3D12_RESOURCE_STATES backBufferState = recordCapture();
 
     // Indicate that the back buffer will now be used to present.
     D3D12_RESOURCE_BARRIER presentBarrier;
     presentBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
     presentBarrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
     presentBarrier.Transition.pResource = m_renderTargets[m_frameIndex].get();
-    presentBarrier.Transition.StateBefore = D3D12_RESOURCE_STATE_RENDER_TARGET;
+    presentBarrier.Transition.StateBefore = backBufferState;
     presentBarrier.Transition.StateAfter = D3D12_RESOURCE_STATE_PRESENT;
     presentBarrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
 
     m_graphicsCommandList->ResourceBarrier(1, &presentBarrier);
 
+    m_graphicsCommandList->EndQuery(m_timestampQueryHeap.get(), D3D12_QUERY_TYPE_TIMESTAMP, 2 * m_frameIndex + 1);
+    m_graphicsCommandList->ResolveQueryData(m_timestampQueryHeap.get(), D3D12_QUERY_TYPE_TIMESTAMP, 2 * m_frameIndex, 2, m_timestampReadbackBuffer.get(), 2 * m_frameIndex * sizeof(UINT64));
+    m_timestampsPending[m_frameIndex] = true;
+    m_timestampScales[m_frameIndex] = m_renderScale;
+
     winrt::check_hresult(m_graphicsCommandList->Close());
 }
 
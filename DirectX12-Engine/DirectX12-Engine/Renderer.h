@@ -1,5 +1,33 @@
 #pragma once
 
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "AtlasPacker.h"
+#include "CommandListStateCache.h"
+#include "FrameCapture.h"
+#include "GpuResourceRegistry.h"
+#include "LightClusterGrid.h"
+#include "LinearArena.h"
+#include "ParticleSimulation.h"
+#include "QueueScheduler.h"
+#include "ResolutionScaleController.h"
+#include "SceneSimulation.h"
+#include "SpriteBatch.h"
+#include "StartupGraph.h"
+#include "TerrainQuadtree.h"
+
+class AsyncFileReader;
+class OcclusionCuller;
+class QueueSubmitter;
+class ShaderManifest;
+class TerrainStreamer;
+class TerrainTileCache;
+class WorkerPool;
+
 class Renderer
 {
 public:
@@ -9,13 +37,43 @@ public:
 
     void cleanUp();
 
-    // Render onto the render target
-    void render();
+    // Image ids of the built in sprites, white shapes to tint through the sprite color
+    static const uint32_t SolidSpriteImage = 0u;
+    static const uint32_t DiscSpriteImage = 1u;
+    static const uint32_t RingSpriteImage = 2u;
+    static const uint32_t DiamondSpriteImage = 3u;
+    static const uint32_t SpriteImageCount = 4u;
+
+    // Render the given scene state and sprites onto the render target, sprites are drawn in order on top of the scene
+    void render(const SceneState &scene, const std::vector<Sprite> &sprites);
 
     // Resize the window and internal data structures
     void resize(UINT width, UINT height);
     void setupSwapchain(UINT width, UINT height);
 
+    // Memory for per frame data such as draw lists, valid until the GPU has finished the frame being recorded.
+    // Allocation is thread safe, the arena is reset once the fence for its frame retires.
+    LinearArena &getFrameArena() { return *m_frameArenas[m_frameIndex]; }
+
+    enum class CaptureSource
+    {
+        BackBuffer, // The presented frame, RGBA8
+        UavBuffer   // The R32 float UAV texture
+    };
+
+    // Copy the source into sink every frame until stopCapture(). Copies are read back through a ring of
+    // readback buffers and encoded on encoderThreads worker threads, so the render thread never waits for
+    // them. Frames are dropped when the encoders fall behind, CaptureBench measures how many a sink needs
+    // to keep up. The capture keeps the size the source had when it started.
+    // Any thread, the request replaces any capture running at the start of the next render().
+    void startCapture(CaptureSource source, std::unique_ptr<CaptureSink> sink, uint32_t encoderThreads);
+
+    // Any thread. The next render() waits for the GPU and writes every copy already made.
+    void stopCapture();
+
+    // Render thread, null when no capture is running
+    const FrameCapture *getFrameCapture() const { return m_frameCapture.get(); }
+
 private:
     // We use this value as both the maximum number of frames queued in the GPU and the number of backbuffers in the swapchain
     static const UINT FrameCount = 2u;
@@ -31,6 +89,7 @@ private:
     winrt::com_ptr<ID3D12CommandQueue> m_commandQueue;
     winrt::com_ptr<ID3D12CommandAllocator> m_commandAllocators[FrameCount];
     winrt::com_ptr<ID3D12GraphicsCommandList> m_graphicsCommandList;
+    CommandListStateCache<ID3D12GraphicsCommandList> m_commandListState; // Filters redundant state calls on m_graphicsCommandList
     winrt::com_ptr<IDXGISwapChain3> m_swapChain;
 
     // Resources
@@ -54,9 +113,20 @@ private:
     winrt::com_ptr<ID3D12Fence> m_fence;
     UINT64 m_fenceValues[FrameCount];
 
+    // Adds a compute queue next to m_commandQueue for the particle simulation, see m_frameSchedules
+    std::unique_ptr<QueueSubmitter> m_queueSubmitter;
+
+    // One per frame in flight, see getFrameArena
+    static const size_t FrameArenaCapacity = 4u << 20;
+    std::unique_ptr<LinearArena> m_frameArenas[FrameCount];
+
     winrt::com_ptr<ID3D12RootSignature> m_rootSignature;
     winrt::com_ptr<ID3D12PipelineState> m_pipelineState;
 
+    // Shaders
+    std::wstring m_shaderBasePath;
+    std::unique_ptr<ShaderManifest> m_shaderManifest;
+
     struct Vertex
     {
         float position[3];
@@ -84,9 +154,225 @@ private:
     winrt::com_ptr<ID3D12Resource> m_stagingBuffer;
     UINT8 *m_mappedStagingBuffer;
 
-    void initializeCoreApi();
-    void initializeResources();
-    void populateCommandList();
+    // CPU culling
+    std::unique_ptr<WorkerPool> m_workerPool;
+    std::unique_ptr<OcclusionCuller> m_occlusionCuller;
+    float m_triangleClipBounds[8][4]; // Clip space corners of the triangle's bounding box
+
+    // Per frame transform of the triangle, a row major 2x2 matrix followed by the offset
+    float m_sceneConstants[6];
+
+    // Dynamic resolution
+    // The scene is drawn into m_sceneTarget with a viewport scaled by m_renderScale and then upscaled to the back buffer.
+    // The target is allocated at the full surface size so changing the scale never reallocates.
+    winrt::com_ptr<ID3D12Resource> m_sceneTarget;
+    winrt::com_ptr<ID3D12RootSignature> m_upscaleRootSignature;
+    winrt::com_ptr<ID3D12PipelineState> m_upscalePipelineState;
+    ResolutionScaleController m_resolutionScaleController;
+    float m_renderScale;
+    D3D12_VIEWPORT m_sceneViewport;
+    D3D12_RECT m_sceneScissorRect;
+
+    // Sprites
+    // Instances are written into a persistently mapped upload buffer with one region per frame in flight,
+    // then drawn with one instanced quad draw per atlas page.
+    static const UINT MaxSprites = 65536u;
+    static const UINT SpriteAtlasSize = 1024u;
+    winrt::com_ptr<ID3D12RootSignature> m_spriteRootSignature;
+    winrt::com_ptr<ID3D12PipelineState> m_spritePipelineState;
+    winrt::com_ptr<ID3D12Resource> m_spriteInstanceBuffer;
+    SpriteBatch::Instance *m_mappedSpriteInstances;
+    winrt::com_ptr<ID3D12Resource> m_spriteAtlas;
+    AtlasPacker m_spriteAtlasPacker;
+    SpriteBatch m_spriteBatch;
+
+    // Particles
+    // Emission, integration and compaction run in compute passes over a fixed pool, with a dead list
+    // stack and two alive lists that swap every step. The passes count particles in m_particleCounters
+    // and write the simulation dispatch and the billboard draw into m_particleArguments for
+    // ExecuteIndirect. ParticleSimulation is the CPU reference of the same math.
+    static const UINT MaxParticles = 65536u;
+    static const UINT ParticlePassCount = 4u;   // Prepare, emit, simulate and finish
+    static const UINT ParticleGroupSize = 64u;  // Threads per group of the emit and simulate passes
+    static const UINT64 ParticleCountersSize = 32u;
+    static const UINT64 ParticleArgumentsSize = 32u; // Dispatch then draw arguments
+    winrt::com_ptr<ID3D12RootSignature> m_particleRootSignature;
+    winrt::com_ptr<ID3D12PipelineState> m_particlePassPipelineStates[ParticlePassCount];
+    winrt::com_ptr<ID3D12PipelineState> m_particleDrawPipelineState;
+    winrt::com_ptr<ID3D12CommandSignature> m_particleDispatchSignature;
+    winrt::com_ptr<ID3D12CommandSignature> m_particleDrawSignature;
+    winrt::com_ptr<ID3D12Resource> m_particleBuffer;
+    winrt::com_ptr<ID3D12Resource> m_particleAliveLists[2];
+    winrt::com_ptr<ID3D12Resource> m_particleDeadList;
+    winrt::com_ptr<ID3D12Resource> m_particleCounters;
+    winrt::com_ptr<ID3D12Resource> m_particleArguments;
+    UINT m_particleAliveIndex; // The alive list the next step reads
+    ParticleEmitterSettings m_particleEmitter;
+    float m_particleEmitCarry;
+
+    // The simulation is recorded on its own compute list and overlaps the scene pass on the compute queue.
+    // The second schedule orders it after the scene pass for frames that record startup uploads.
+    winrt::com_ptr<ID3D12CommandAllocator> m_particleCommandAllocators[FrameCount];
+    winrt::com_ptr<ID3D12GraphicsCommandList> m_particleCommandList;
+    CommandListStateCache<ID3D12GraphicsCommandList> m_particleListState;
+    QueueScheduler::Schedule m_frameSchedules[2];
+
+    // Lights
+    // Point lights are binned into a clustered grid on the CPU every frame, then the lights, the
+    // grid and its light index list are written into a persistently mapped upload buffer with one
+    // region per frame in flight. The scene's pixel shader only walks its own cluster's lights.
+    static const UINT MaxLights = 256u;
+    static const UINT MaxLightIndices = 65536u;
+    winrt::com_ptr<ID3D12Resource> m_lightBuffer;
+    UINT8 *m_mappedLightBuffer;
+    UINT64 m_lightClustersOffset; // Where the grid and the light index list start in a frame's region
+    UINT64 m_lightIndicesOffset;
+    UINT64 m_lightFrameSize;
+    std::unique_ptr<LightClusterGrid> m_lightClusterGrid;
+    std::vector<ClusterLight> m_lights; // View space, as of the current frame
+    float m_lightTime;
+
+    // Terrain
+    // A heightmap cooked into a tile pyramid by Tools/TerrainBench, streamed from disk into the cache slots
+    // of m_terrainHeights. Every frame the quadtree picks one patch per tile to draw and the whole terrain is
+    // one instanced draw of the shared grid, the only one in the scene with depth. Streamed tiles are staged
+    // in a persistently mapped upload buffer with one region per frame in flight. The terrain is left out
+    // when no Terrain.dtrn is deployed next to the shaders.
+    static const UINT TerrainCacheSlots = 512u;
+    static const UINT TerrainPinnedLevels = 3u; // Always resident, so there is always something to draw
+    static const UINT MaxTerrainPatches = 4096u;
+    static const UINT MaxTerrainUploads = 8u;   // Tiles per frame
+    winrt::com_ptr<ID3D12RootSignature> m_terrainRootSignature;
+    winrt::com_ptr<ID3D12PipelineState> m_terrainPipelineState;
+    winrt::com_ptr<ID3D12Resource> m_terrainHeights;
+    winrt::com_ptr<ID3D12Resource> m_terrainUploadBuffer;
+    UINT8 *m_mappedTerrainUploads;
+    winrt::com_ptr<ID3D12Resource> m_terrainInstanceBuffer;
+    TerrainPatch *m_mappedTerrainPatches;
+    winrt::com_ptr<ID3D12Resource> m_terrainGridVertices;
+    winrt::com_ptr<ID3D12Resource> m_terrainGridIndices;
+    D3D12_VERTEX_BUFFER_VIEW m_terrainGridVertexView;
+    D3D12_INDEX_BUFFER_VIEW m_terrainGridIndexView;
+    UINT m_terrainGridIndexCount;
+    UINT64 m_terrainSlotStride; // Bytes per cache slot, a tile's samples rounded up to whole 32 bit words
+    winrt::com_ptr<ID3D12DescriptorHeap> m_dsvHeap;
+    winrt::com_ptr<ID3D12Resource> m_depthBuffer;
+    std::unique_ptr<AsyncFileReader> m_terrainReader;
+    std::unique_ptr<TerrainTileSet> m_terrainTiles;
+    std::unique_ptr<TerrainTileCache> m_terrainCache;
+    std::unique_ptr<TerrainQuadtree> m_terrainQuadtree;
+    std::unique_ptr<TerrainStreamer> m_terrainStreamer; // After what it uses, so it is destroyed first
+    TerrainSelection m_terrainSelection;
+    std::vector<uint32_t> m_terrainUploadSlots; // Slots this frame's region of the upload buffer fills, in order
+    Mat4 m_terrainViewProjection;
+    UINT m_terrainPatchCount;                    // Drawn this frame, after occlusion culling
+    uint64_t m_terrainFrame;
+    float m_terrainTime;
+
+    // GPU timing, two timestamps per frame that feed the resolution controller
+    winrt::com_ptr<ID3D12QueryHeap> m_timestampQueryHeap;
+    winrt::com_ptr<ID3D12Resource> m_timestampReadbackBuffer;
+    UINT64 m_timestampFrequency;
+    bool m_timestampsPending[FrameCount];
+    float m_timestampScales[FrameCount];      // Render scale of the timed frame
+#if defined(_DEBUG)
+    // GPU time and scale of every frame, written to the debug output in blocks for ResolutionScaleBench to replay
+    static const UINT ResolutionTraceBlock = 600u;
+    std::string m_resolutionTrace;
+    UINT m_resolutionTraceFrames;
+#endif
+
+    // Frame capture
+    // Each frame the capture source is copied into a free slot of a ring of persistently mapped readback
+    // buffers. The copy is handed to FrameCapture once the fence of its frame has passed, polled without waiting.
+    // Start and stop requests are only applied by the render thread, which owns everything below them.
+    struct CaptureRequest
+    {
+        CaptureSource source;
+        std::unique_ptr<CaptureSink> sink; // Null to stop
+        FrameCapture::Settings settings;
+    };
+    std::mutex m_captureRequestMutex;
+    std::unique_ptr<CaptureRequest> m_captureRequest; // The latest request not applied yet
+    static const UINT CaptureSlotCount = 4u;
+    winrt::com_ptr<ID3D12Resource> m_captureBuffers[CaptureSlotCount];
+    D3D12_PLACED_SUBRESOURCE_FOOTPRINT m_captureFootprint;
+    CaptureSource m_captureSource;
+    std::unique_ptr<FrameCapture> m_frameCapture;
+    ReadbackRing::Slot m_captureSlot; // The slot the frame being recorded copies into
+    uint64_t m_captureFrameNumber;
+
+    // Startup
+    // The shader bytecode is only kept until the deferred pipelines have been created. Uploads made during
+    // startup are recorded at the start of the next frame and their upload buffers kept until it is done.
+    struct PendingUpload
+    {
+        winrt::com_ptr<ID3D12Resource> uploadBuffer;
+        std::function<void(ID3D12GraphicsCommandList *commandList)> record;
+    };
+    std::vector<std::vector<byte>> m_shaderBytecode;
+    bool m_particlesReady; // Set once the deferred startup tasks are done
+    bool m_terrainReady;   // Same, when the terrain could be loaded
+    std::mutex m_pendingUploadMutex;
+    std::vector<PendingUpload> m_pendingUploads;
+    std::vector<PendingUpload> m_recordedUploads[FrameCount];
+
+    // Last so its worker threads are joined before anything a task may be touching is destroyed
+    std::unique_ptr<StartupGraph> m_startupGraph;
+
+    void buildStartupGraph();
+    void createDevice();
+    void createQueues();
+    void createFrameResources();
+    void createDescriptorHeap();
+    void createSceneRootSignature();
+    void createScenePipeline();
+    void createUpscaleRootSignature();
+    void createUpscalePipeline();
+    void createSpriteRootSignature();
+    void createSpritePipeline();
+    void createParticleRootSignature();
+    void createParticlePassPipeline(UINT pass);
+    void createParticleDrawPipeline();
+    void createTerrainRootSignature();
+    void createTerrainPipeline();
+    void createCommandList();
+    void createConstantBuffers();
+    void createGeometry();
+    void updateDeferredStartup();
+    void queueUpload(winrt::com_ptr<ID3D12Resource> uploadBuffer, std::function<void(ID3D12GraphicsCommandList *commandList)> record);
+    void recordPendingUploads();
+    void executeFrame(const std::vector<Sprite> &sprites);
+    void recordScenePass();
+    D3D12_CPU_DESCRIPTOR_HANDLE bindSceneTarget();
+    void recordComposePass(const std::vector<Sprite> &sprites);
+    void initializeOcclusionCulling();
+    void initializeDynamicResolution();
+    void updateRenderScale();
+    void updateSceneConstants(const SceneState &scene);
+    void initializeSprites();
+    void drawSprites(const std::vector<Sprite> &sprites);
+    void initializeParticles();
+    void createParticleCommandList();
+    void simulateParticles();
+    void drawParticles();
+    void initializeLights();
+    void updateLights();
+    void initializeTerrain();
+    void updateTerrain();
+    void renderTerrainOccluders();
+    void drawTerrain(D3D12_CPU_DESCRIPTOR_HANDLE sceneRtvHandle);
+    void applyCaptureRequest();
+    void beginCapture(CaptureSource source, std::unique_ptr<CaptureSink> sink, const FrameCapture::Settings &settings);
+    void endCapture();
+    D3D12_RESOURCE_STATES recordCapture();
+
+    void loadShaderManifest();
+    std::vector<byte> loadShaderBytecode(const std::string &name);
+    void checkShaderBinding(const char *shaderName, const char *bindingName, const char *bindPoint, UINT rootConstantCount = 0u) const;
+
+    // Names the resource and registers it with getGpuResourceRegistry() until the resource is destroyed
+    void trackResource(ID3D12Resource *resource, const char *name, GpuResourceCategory category, const GpuResourceSource &source);
 
     void waitForGpu();
 };
\ No newline at end of file
@@ -0,0 +1,100 @@
+#include "ResolutionScaleController.h"
+
+#include <algorithm>
+#include <cmath>
+
+ResolutionScaleController::ResolutionScaleController()
+    : ResolutionScaleController(Settings())
+{
+}
+
+ResolutionScaleController::ResolutionScaleController(const Settings &settings)
+    : m_settings(settings)
+{
+    m_settings.historyLength = std::max(m_settings.historyLength, 1u);
+    m_history.resize(m_settings.historyLength);
+    reset();
+}
+
+void ResolutionScaleController::reset()
+{
+    m_stats = {};
+    m_scale = m_settings.maxScale;
+    m_integral = 0.0f;
+    m_previousError = 0.0f;
+    m_hasPreviousError = false;
+    m_historyIndex = 0u;
+    m_historyCount = 0u;
+}
+
+float ResolutionScaleController::update(float gpuFrameTimeMs, float frameScale)
+{
+    ++m_stats.frames;
+    if (gpuFrameTimeMs > m_settings.targetFrameTimeMs)
+    {
+        ++m_stats.missedFrames;
+    }
+
+    const float costMs = gpuFrameTimeMs / std::max(frameScale * frameScale, 1e-4f);
+    m_history[m_historyIndex] = costMs;
+    m_historyIndex = (m_historyIndex + 1u) % m_settings.historyLength;
+    m_historyCount = std::min(m_historyCount + 1u, m_settings.historyLength);
+
+    float averageCostMs = 0.0f;
+    float maxCostMs = 0.0f;
+    for (uint32_t i = 0u; i < m_historyCount; ++i)
+    {
+        averageCostMs += m_history[i];
+        maxCostMs = std::max(maxCostMs, m_history[i]);
+    }
+    averageCostMs /= static_cast<float>(m_historyCount);
+
+    // What the frames would take at the current scale. React to a single bad frame straight away,
+    // recovering can wait for the average.
+    const float currentArea = m_scale * m_scale;
+    const float measuredMs = std::max(averageCostMs, gpuFrameTimeMs > m_settings.targetFrameTimeMs ? costMs : 0.0f) * currentArea;
+
+    // Positive error means there is time to spare
+    const float goalMs = m_settings.targetFrameTimeMs * m_settings.headroom;
+    float error = (goalMs - measuredMs) / goalMs;
+
+    // Only grow if every frame in the history would fit, an average that hides slow frames is not enough
+    if (error > 0.0f)
+    {
+        error = std::min(error, (goalMs - maxCostMs * currentArea) / goalMs);
+    }
+    if (std::fabs(error) < m_settings.deadBand)
+    {
+        error = 0.0f;
+    }
+
+    const float derivative = m_hasPreviousError ? error - m_previousError : 0.0f;
+    m_previousError = error;
+    m_hasPreviousError = true;
+
+    // Work in pixel count space where cost is roughly linear, then convert back to a scale
+    const float integral = std::clamp(m_integral + error, -1.0f, 1.0f);
+    const float output = m_settings.proportionalGain * error + m_settings.integralGain * integral + m_settings.derivativeGain * derivative;
+    const float desiredArea = std::max(currentArea * (1.0f + output), 0.0f);
+
+    float step = std::sqrt(desiredArea) - m_scale;
+    step = std::clamp(step, -m_settings.maxScaleStep, m_settings.maxScaleStep);
+
+    const float newScale = std::clamp(m_scale + step, m_settings.minScale, m_settings.maxScale);
+
+    // Anti windup, stop integrating while pinned against a limit
+    const bool saturated = (newScale <= m_settings.minScale && error < 0.0f) || (newScale >= m_settings.maxScale && error > 0.0f);
+    if (!saturated)
+    {
+        m_integral = integral;
+    }
+
+    if (std::fabs(newScale - m_scale) >= m_settings.minScaleStep ||
+        (newScale != m_scale && (newScale == m_settings.minScale || newScale == m_settings.maxScale)))
+    {
+        m_scale = newScale;
+        ++m_stats.scaleChanges;
+    }
+
+    return m_scale;
+}
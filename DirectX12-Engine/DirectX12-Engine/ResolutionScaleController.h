@@ -0,0 +1,64 @@
+#pragma once
+
+// Picks the render resolution scale for dynamic resolution from measured GPU frame times.
+// GPU cost is treated as proportional to the pixel count (scale squared), and a PID controller
+// drives the smoothed frame time towards a fraction of the frame budget. A dead band around the
+// target and a minimum scale step provide hysteresis so the scale does not oscillate every frame.
+// Frame times arrive a few frames late, so each one is rescaled from the scale its frame was
+// rendered at to the current one; reacting to the raw times makes the scale cycle.
+// This file is platform independent so the controller can be tuned against recorded traces.
+
+#include <cstdint>
+#include <vector>
+
+class ResolutionScaleController
+{
+public:
+    struct Settings
+    {
+        float targetFrameTimeMs = 1000.0f / 60.0f;
+        float headroom = 0.9f;          // Aim for this fraction of the budget to leave room for spikes
+        float minScale = 0.5f;
+        float maxScale = 1.0f;
+        float proportionalGain = 0.6f;
+        float integralGain = 0.05f;
+        float derivativeGain = 0.1f;
+        float deadBand = 0.05f;         // Relative error that is ignored
+        float minScaleStep = 1.0f / 64.0f; // Smaller changes are not applied
+        float maxScaleStep = 0.1f;      // Largest change per frame
+        uint32_t historyLength = 4u;    // Frames averaged before feeding the controller
+    };
+
+    struct Stats
+    {
+        uint64_t frames;
+        uint64_t missedFrames; // Frames over the budget
+        uint64_t scaleChanges;
+    };
+
+    ResolutionScaleController();
+    explicit ResolutionScaleController(const Settings &settings);
+
+    // Feed the GPU time of a completed frame and the scale it was rendered at, return the scale to
+    // render the next frame with
+    float update(float gpuFrameTimeMs, float frameScale);
+
+    float getScale() const { return m_scale; }
+    const Stats &getStats() const { return m_stats; }
+    const Settings &getSettings() const { return m_settings; }
+
+    void reset();
+
+private:
+    Settings m_settings;
+    Stats m_stats;
+
+    float m_scale;
+    float m_integral;
+    float m_previousError;
+    bool m_hasPreviousError;
+
+    std::vector<float> m_history; // Full resolution cost of the last frames
+    uint32_t m_historyIndex;
+    uint32_t m_historyCount;
+};
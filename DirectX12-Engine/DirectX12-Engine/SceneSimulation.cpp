@@ -0,0 +1,76 @@
+#include "SceneSimulation.h"
+
+#include <cmath>
+
+namespace
+{
+    const float Pi = 3.14159265358979f;
+    const float RotationSpeed = 0.5f;   // Radians per second
+    const float FollowRate = 8.0f;      // How quickly the triangle eases towards the pointer, per second
+    const float PressedScale = 0.8f;
+}
+
+SceneState createInitialSceneState()
+{
+    SceneState state = {};
+    state.triangleScale = 1.0f;
+    return state;
+}
+
+void applySceneInput(SceneState &state, const InputEvent &event)
+{
+    switch (event.type)
+    {
+    case InputEvent::Type::PointerPressed:
+        state.pointerDown = true;
+        state.targetOffset[0] = event.x;
+        state.targetOffset[1] = event.y;
+        break;
+    case InputEvent::Type::PointerMoved:
+        if (state.pointerDown)
+        {
+            state.targetOffset[0] = event.x;
+            state.targetOffset[1] = event.y;
+        }
+        break;
+    case InputEvent::Type::PointerReleased:
+        state.pointerDown = false;
+        break;
+    }
+}
+
+void stepScene(SceneState &state, float deltaSeconds)
+{
+    state.triangleRotation = std::fmod(state.triangleRotation + RotationSpeed * deltaSeconds, 2.0f * Pi);
+
+    // Frame rate independent exponential ease towards the target
+    const float follow = 1.0f - std::exp(-FollowRate * deltaSeconds);
+    state.triangleOffset[0] += (state.targetOffset[0] - state.triangleOffset[0]) * follow;
+    state.triangleOffset[1] += (state.targetOffset[1] - state.triangleOffset[1]) * follow;
+
+    const float targetScale = state.pointerDown ? PressedScale : 1.0f;
+    state.triangleScale += (targetScale - state.triangleScale) * follow;
+}
+
+SceneState interpolateScene(const SceneState &previous, const SceneState &current, float alpha)
+{
+    SceneState state = current;
+
+    state.triangleOffset[0] = previous.triangleOffset[0] + (current.triangleOffset[0] - previous.triangleOffset[0]) * alpha;
+    state.triangleOffset[1] = previous.triangleOffset[1] + (current.triangleOffset[1] - previous.triangleOffset[1]) * alpha;
+    state.triangleScale = previous.triangleScale + (current.triangleScale - previous.triangleScale) * alpha;
+
+    // Take the short way around when the rotation wraps
+    float rotationDelta = current.triangleRotation - previous.triangleRotation;
+    if (rotationDelta > Pi)
+    {
+        rotationDelta -= 2.0f * Pi;
+    }
+    else if (rotationDelta < -Pi)
+    {
+        rotationDelta += 2.0f * Pi;
+    }
+    state.triangleRotation = previous.triangleRotation + rotationDelta * alpha;
+
+    return state;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+// The game side state of the scene and the fixed timestep update that advances it.
+// States are plain values so the simulation thread can publish copies to the render thread,
+// which blends the two most recent ones to stay smooth when the two rates differ.
+
+#include <chrono>
+#include <cstdint>
+
+struct InputEvent
+{
+    enum class Type : uint32_t
+    {
+        PointerPressed,
+        PointerMoved,
+        PointerReleased
+    };
+
+    Type type;
+    float x; // Normalized device coordinates
+    float y;
+    std::chrono::steady_clock::time_point timestamp;
+};
+
+struct SceneState
+{
+    float triangleOffset[2];
+    float triangleRotation; // Radians
+    float triangleScale;
+
+    // Not interpolated
+    float targetOffset[2];
+    bool pointerDown;
+};
+
+SceneState createInitialSceneState();
+
+// Apply one input event to the state
+void applySceneInput(SceneState &state, const InputEvent &event);
+
+// Advance the state by one fixed timestep
+void stepScene(SceneState &state, float deltaSeconds);
+
+// Blend two consecutive states, alpha = 0 gives previous and alpha = 1 gives current
+SceneState interpolateScene(const SceneState &previous, const SceneState &current, float alpha);
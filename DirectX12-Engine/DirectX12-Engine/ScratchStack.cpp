@@ -0,0 +1,82 @@
+#include "ScratchStack.h"
+
+#include <algorithm>
+#include <new>
+
+namespace
+{
+    const size_t ThreadScratchCapacity = 1u << 20;
+}
+
+ScratchStack::ScratchStack(size_t capacity, bool guardPages)
+    : m_base(nullptr)
+    , m_capacity(roundUpToPages(capacity))
+    , m_offset(0u)
+    , m_highWater(0u)
+    , m_guardPages(guardPages)
+{
+    m_base = static_cast<uint8_t *>(allocatePages(m_capacity, m_guardPages, MemoryTag::Scratch));
+    if (m_base == nullptr)
+    {
+        m_capacity = 0u;
+    }
+}
+
+ScratchStack::~ScratchStack()
+{
+    rewind(Marker{ 0u, 0u });
+    freePages(m_base, m_capacity, m_guardPages, MemoryTag::Scratch);
+}
+
+void *ScratchStack::allocate(size_t size, size_t alignment)
+{
+    const uintptr_t base = reinterpret_cast<uintptr_t>(m_base);
+    const size_t alignedOffset = static_cast<size_t>(((base + m_offset + alignment - 1u) & ~static_cast<uintptr_t>(alignment - 1u)) - base);
+
+    if (alignedOffset + size <= m_capacity && alignedOffset + size >= alignedOffset)
+    {
+        m_offset = alignedOffset + size;
+        m_highWater = std::max(m_highWater, m_offset);
+        return m_base + alignedOffset;
+    }
+
+    alignment = std::max(alignment, alignof(std::max_align_t));
+    void *pointer = ::operator new(size, std::align_val_t(alignment));
+    recordAllocation(MemoryTag::Scratch, size);
+    m_overflowBlocks.push_back({ pointer, size, alignment });
+    return pointer;
+}
+
+ScratchStack::Marker ScratchStack::getMarker() const
+{
+    return Marker{ m_offset, m_overflowBlocks.size() };
+}
+
+void ScratchStack::rewind(const Marker &marker)
+{
+    while (m_overflowBlocks.size() > marker.overflowCount)
+    {
+        const OverflowBlock &block = m_overflowBlocks.back();
+        ::operator delete(block.pointer, std::align_val_t(block.alignment));
+        recordFree(MemoryTag::Scratch, block.size);
+        m_overflowBlocks.pop_back();
+    }
+    m_offset = marker.offset;
+}
+
+ScratchStack &getThreadScratchStack()
+{
+    static thread_local ScratchStack stack(ThreadScratchCapacity);
+    return stack;
+}
+
+ScratchScope::ScratchScope()
+    : m_stack(getThreadScratchStack())
+    , m_marker(m_stack.getMarker())
+{
+}
+
+ScratchScope::~ScratchScope()
+{
+    m_stack.rewind(m_marker);
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+// Per thread stack allocator for temporaries that do not outlive the function that made them.
+// Open a ScratchScope, allocate from it and everything is released when the scope closes,
+// which makes it a cheap replacement for short lived std::vectors in hot loops. Each thread
+// gets its own stack on first use so there is no locking. Requests that do not fit go to the
+// heap and are released with the scope as well.
+// This file is platform independent so it can be built and profiled off Windows.
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "MemoryTracker.h"
+
+class ScratchStack
+{
+public:
+    // Position to rewind to
+    struct Marker
+    {
+        size_t offset;
+        size_t overflowCount;
+    };
+
+    // The capacity is rounded up to whole pages
+    explicit ScratchStack(size_t capacity, bool guardPages = DefaultGuardPages);
+
+    ~ScratchStack();
+
+    ScratchStack(const ScratchStack &) = delete;
+    ScratchStack &operator=(const ScratchStack &) = delete;
+
+    // The alignment must be a power of two. Never returns nullptr.
+    void *allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+    Marker getMarker() const;
+
+    // Release everything allocated after the marker was taken
+    void rewind(const Marker &marker);
+
+    size_t getCapacity() const { return m_capacity; }
+    size_t getHighWater() const { return m_highWater; }
+
+private:
+    uint8_t *m_base;
+    size_t m_capacity;
+    size_t m_offset;
+    size_t m_highWater;
+    bool m_guardPages;
+
+    struct OverflowBlock
+    {
+        void *pointer;
+        size_t size;
+        size_t alignment;
+    };
+
+    std::vector<OverflowBlock> m_overflowBlocks;
+};
+
+// The calling thread's scratch stack
+ScratchStack &getThreadScratchStack();
+
+// Rewinds the calling thread's scratch stack to where it was when the scope was opened
+class ScratchScope
+{
+public:
+    ScratchScope();
+    ~ScratchScope();
+
+    ScratchScope(const ScratchScope &) = delete;
+    ScratchScope &operator=(const ScratchScope &) = delete;
+
+    void *allocate(size_t size, size_t alignment = alignof(std::max_align_t)) { return m_stack.allocate(size, alignment); }
+
+    template <typename T>
+    T *allocateArray(size_t count)
+    {
+        return static_cast<T *>(m_stack.allocate(sizeof(T) * count, alignof(T)));
+    }
+
+private:
+    ScratchStack &m_stack;
+    ScratchStack::Marker m_marker;
+};
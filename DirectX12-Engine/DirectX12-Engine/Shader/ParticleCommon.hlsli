@@ -0,0 +1,107 @@
+// Shared by the particle passes. emitParticle and simulateParticle mirror the functions of the
+// same name in ParticleSimulation.h operation for operation, and every result is precise so the
+// compiler cannot fuse or reorder them, which lets the CPU reference reproduce them bit for bit.
+// Change both together.
+
+cbuffer ParticleConstants : register(b0)
+{
+	float3 emitterPosition;
+	float minLifetime;
+	float3 emitterExtent;
+	float lifetimeRange;
+	float3 emitVelocity;
+	float deltaTime;
+	float3 velocitySpread;
+	float dragFactor;
+	float3 gravityStep;
+	float floorHeight;
+	float bounceFactor;
+	uint requestedEmitCount; // Fewer are emitted when there are not enough dead particles
+	uint seed;
+	uint capacity;
+};
+
+struct Particle
+{
+	float3 position;
+	float age;
+	float3 velocity;
+	float lifetime;
+	uint id;
+	uint3 padding;
+};
+
+// Byte offsets of the counters, the dead list is a stack and the alive lists are filled from the front
+static const uint AliveCountOffset = 0;     // Particles in the current alive list
+static const uint DeadCountOffset = 4;      // Indices on the dead list stack
+static const uint EmitCountOffset = 8;      // Emitted this step
+static const uint AliveNextCountOffset = 12; // Survivors appended to the next alive list
+static const uint DeadAppendedOffset = 16;  // Particles that died this step
+static const uint EmittedTotalOffset = 20;  // Id of the next particle
+
+// Byte offsets of the indirect arguments
+static const uint SimulateDispatchOffset = 0; // D3D12_DISPATCH_ARGUMENTS
+static const uint DrawArgumentsOffset = 12;   // D3D12_DRAW_ARGUMENTS
+
+static const uint ParticleGroupSize = 64;
+
+uint hashParticle(uint value)
+{
+	// PCG output permutation
+	uint state = value * 747796405u + 2891336453u;
+	uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
+// A float in [0, 1) from the top 24 bits, the conversion is exact
+float getParticleRandom(inout uint state)
+{
+	state = hashParticle(state);
+	return float(state >> 8u) * (1.0f / 16777216.0f);
+}
+
+Particle emitParticle(uint id)
+{
+	uint random = id ^ hashParticle(seed);
+
+	// Draw the random numbers in the order the CPU does
+	float3 positionRandom;
+	positionRandom.x = getParticleRandom(random);
+	positionRandom.y = getParticleRandom(random);
+	positionRandom.z = getParticleRandom(random);
+	float3 velocityRandom;
+	velocityRandom.x = getParticleRandom(random);
+	velocityRandom.y = getParticleRandom(random);
+	velocityRandom.z = getParticleRandom(random);
+	float lifetimeRandom = getParticleRandom(random);
+
+	precise float3 position = emitterPosition + (positionRandom - 0.5f) * emitterExtent;
+	precise float3 velocity = emitVelocity + (velocityRandom - 0.5f) * velocitySpread;
+	precise float lifetime = minLifetime + lifetimeRandom * lifetimeRange;
+
+	Particle particle = (Particle)0;
+	particle.position = position;
+	particle.velocity = velocity;
+	particle.age = 0.0f;
+	particle.lifetime = lifetime;
+	particle.id = id;
+	return particle;
+}
+
+// One step, returns false once the particle has died
+bool simulateParticle(inout Particle particle)
+{
+	precise float3 velocity = particle.velocity * dragFactor + gravityStep;
+	precise float3 position = particle.position + velocity * deltaTime;
+	if (position.y < floorHeight)
+	{
+		position.y = floorHeight;
+		velocity.y = velocity.y * bounceFactor;
+	}
+	precise float age = particle.age + deltaTime;
+
+	particle.position = position;
+	particle.velocity = velocity;
+	particle.age = age;
+	return age < particle.lifetime;
+}
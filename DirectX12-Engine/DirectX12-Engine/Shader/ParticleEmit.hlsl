@@ -0,0 +1,22 @@
+#include "ParticleCommon.hlsli"
+
+RWStructuredBuffer<Particle> particles : register(u0);
+RWStructuredBuffer<uint> aliveList : register(u1);
+RWStructuredBuffer<uint> deadList : register(u3);
+RWByteAddressBuffer counters : register(u4);
+
+// Pop a dead particle per thread, spawn it and append it to the current alive list so this
+// step's simulation moves it like the CPU reference does
+[numthreads(ParticleGroupSize, 1, 1)]
+void main(uint3 dispatchThreadId : SV_DispatchThreadID)
+{
+	uint i = dispatchThreadId.x;
+	if (i >= counters.Load(EmitCountOffset))
+	{
+		return;
+	}
+
+	uint index = deadList[counters.Load(DeadCountOffset) - 1 - i];
+	particles[index] = emitParticle(counters.Load(EmittedTotalOffset) + i);
+	aliveList[counters.Load(AliveCountOffset) + i] = index;
+}
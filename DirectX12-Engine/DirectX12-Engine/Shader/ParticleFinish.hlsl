@@ -0,0 +1,20 @@
+#include "ParticleCommon.hlsli"
+
+RWByteAddressBuffer counters : register(u4);
+RWByteAddressBuffer arguments : register(u5);
+
+// Make the next alive list current, reset the step counters and write the billboard draw
+[numthreads(1, 1, 1)]
+void main()
+{
+	uint aliveCount = counters.Load(AliveNextCountOffset);
+	uint emitCount = counters.Load(EmitCountOffset);
+
+	counters.Store(AliveCountOffset, aliveCount);
+	counters.Store(DeadCountOffset, counters.Load(DeadCountOffset) - emitCount + counters.Load(DeadAppendedOffset));
+	counters.Store(EmittedTotalOffset, counters.Load(EmittedTotalOffset) + emitCount);
+	counters.Store3(EmitCountOffset, uint3(0, 0, 0));
+
+	// Four vertices of a strip per alive particle
+	arguments.Store4(DrawArgumentsOffset, uint4(4, aliveCount, 0, 0));
+}
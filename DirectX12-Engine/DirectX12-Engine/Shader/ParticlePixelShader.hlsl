@@ -0,0 +1,6 @@
+// Round soft billboards
+float4 main(float4 color : Color, float2 corner : TexCoord, float4 position : SV_Position) : SV_TARGET
+{
+	float falloff = saturate(1.0f - dot(corner, corner));
+	return float4(color.rgb, color.a * falloff);
+}
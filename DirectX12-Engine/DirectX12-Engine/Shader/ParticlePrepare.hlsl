@@ -0,0 +1,16 @@
+#include "ParticleCommon.hlsli"
+
+RWByteAddressBuffer counters : register(u4);
+RWByteAddressBuffer arguments : register(u5);
+
+// Clamp the emission to the dead particles there are and size the simulation dispatch
+[numthreads(1, 1, 1)]
+void main()
+{
+	uint aliveCount = counters.Load(AliveCountOffset);
+	uint emitCount = min(requestedEmitCount, counters.Load(DeadCountOffset));
+	counters.Store(EmitCountOffset, emitCount);
+
+	uint simulateCount = aliveCount + emitCount;
+	arguments.Store3(SimulateDispatchOffset, uint3((simulateCount + ParticleGroupSize - 1) / ParticleGroupSize, 1, 1));
+}
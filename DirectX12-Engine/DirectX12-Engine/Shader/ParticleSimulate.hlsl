@@ -0,0 +1,37 @@
+#include "ParticleCommon.hlsli"
+
+RWStructuredBuffer<Particle> particles : register(u0);
+RWStructuredBuffer<uint> aliveList : register(u1);
+RWStructuredBuffer<uint> aliveNextList : register(u2);
+RWStructuredBuffer<uint> deadList : register(u3);
+RWByteAddressBuffer counters : register(u4);
+
+// Advance every alive particle, survivors are appended to the next alive list and the dead are
+// pushed back above the entries the emission consumed
+[numthreads(ParticleGroupSize, 1, 1)]
+void main(uint3 dispatchThreadId : SV_DispatchThreadID)
+{
+	uint i = dispatchThreadId.x;
+	uint emitCount = counters.Load(EmitCountOffset);
+	if (i >= counters.Load(AliveCountOffset) + emitCount)
+	{
+		return;
+	}
+
+	uint index = aliveList[i];
+	Particle particle = particles[index];
+	bool alive = simulateParticle(particle);
+	particles[index] = particle;
+
+	uint slot;
+	if (alive)
+	{
+		counters.InterlockedAdd(AliveNextCountOffset, 1, slot);
+		aliveNextList[slot] = index;
+	}
+	else
+	{
+		counters.InterlockedAdd(DeadAppendedOffset, 1, slot);
+		deadList[counters.Load(DeadCountOffset) - emitCount + slot] = index;
+	}
+}
@@ -0,0 +1,36 @@
+#include "ParticleCommon.hlsli"
+
+StructuredBuffer<Particle> particles : register(t0);
+StructuredBuffer<uint> aliveList : register(t1);
+
+cbuffer ParticleDrawConstants : register(b1)
+{
+	float2 worldToClipScale;
+	float2 worldToClipOffset;
+	float2 billboardSize; // In clip space
+};
+
+struct VSOut
+{
+	float4 color : Color;
+	float2 corner : TexCoord;
+	float4 position : SV_Position;
+};
+
+// One instance per alive particle, the four corners of the billboard come from the vertex id
+VSOut main(uint vertexId : SV_VertexID, uint instanceId : SV_InstanceID)
+{
+	Particle particle = particles[aliveList[instanceId]];
+	float life = saturate(particle.age / particle.lifetime);
+	float2 corner = float2(vertexId & 1, vertexId >> 1) * 2.0f - 1.0f;
+
+	// Hot and large when spawned, fading out as it dies
+	float2 center = particle.position.xy * worldToClipScale + worldToClipOffset;
+	float2 size = billboardSize * lerp(1.0f, 0.4f, life);
+
+	VSOut vso;
+	vso.color = lerp(float4(1.0f, 0.85f, 0.4f, 1.0f), float4(0.9f, 0.2f, 0.05f, 0.0f), life);
+	vso.corner = corner;
+	vso.position = float4(center + corner * size, 0.0f, 1.0f);
+	return vso;
+}
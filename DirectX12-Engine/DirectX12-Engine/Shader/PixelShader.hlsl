@@ -6,13 +6,51 @@ cbuffer ConstantBuffer : register(b0)
 // u0 is the render target
 RWTexture2D<float> myTexture : register(u1);
 
+// Matches ClusterLight in LightClusterGrid.h, positions are in view space
+struct ClusterLight
+{
+	float3 position;
+	float radius;
+	float3 color;
+	float padding;
+};
+
+// The light grid the renderer bins on the CPU every frame, see LightClusterGrid
+StructuredBuffer<ClusterLight> lights : register(t0);
+StructuredBuffer<uint2> clusters : register(t1); // Offset and count into lightIndices
+StructuredBuffer<uint> lightIndices : register(t2);
+
+cbuffer LightingConstants : register(b2)
+{
+	float2 invSceneSize;
+	float2 invProjectionScale;
+	float surfaceDepth; // The scene is lit as a plane at this view space depth
+	float sliceScale;
+	float sliceBias;
+	uint tilesX;
+	uint tilesY;
+	uint slices;
+};
+
+static const float3 AmbientLight = float3(0.35f, 0.35f, 0.35f);
+
 float4 main(float4 color : Color, float4 position : SV_Position) : SV_TARGET
 {
-	//color.x = cb[0];
-	//color.y = cb[0];
-	//color.z = cb[0];
-	//color.x = myTexture[uint2(0, 0)];
-	//color.y = myTexture[uint2(0, 0)];
-	//color.z = myTexture[uint2(0, 0)];
-	return color;
-}
\ No newline at end of file
+	// Back from the pixel to view space, tiles count from the top left like SV_Position
+	float2 uv = position.xy * invSceneSize;
+	float2 ndc = uv * float2(2.0f, -2.0f) + float2(-1.0f, 1.0f);
+	float3 viewPosition = float3(ndc * invProjectionScale * surfaceDepth, surfaceDepth);
+
+	uint2 tile = min(uint2(uv * float2(tilesX, tilesY)), uint2(tilesX - 1, tilesY - 1));
+	uint slice = (uint)clamp((int)floor(log2(viewPosition.z) * sliceScale + sliceBias), 0, (int)slices - 1);
+	uint2 cluster = clusters[(slice * tilesY + tile.y) * tilesX + tile.x];
+
+	float3 lighting = AmbientLight;
+	for (uint i = 0; i < cluster.y; ++i)
+	{
+		ClusterLight light = lights[lightIndices[cluster.x + i]];
+		float falloff = saturate(1.0f - distance(light.position, viewPosition) / light.radius);
+		lighting += light.color * (falloff * falloff);
+	}
+	return float4(color.rgb * lighting, color.a);
+}
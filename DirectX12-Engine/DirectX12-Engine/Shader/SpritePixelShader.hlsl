@@ -0,0 +1,7 @@
+Texture2D atlasTexture : register(t0);
+SamplerState linearSampler : register(s0);
+
+float4 main(float4 color : Color, float2 uv : TexCoord, float4 position : SV_Position) : SV_TARGET
+{
+	return atlasTexture.Sample(linearSampler, uv) * color;
+}
\ No newline at end of file
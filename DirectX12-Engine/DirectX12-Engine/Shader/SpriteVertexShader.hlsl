@@ -0,0 +1,24 @@
+cbuffer SpriteConstants : register(b0)
+{
+	float2 invTargetSize; // One over the full resolution size in pixels
+};
+
+struct VSOut
+{
+	float4 color : Color;
+	float2 uv : TexCoord;
+	float4 position : SV_Position;
+};
+
+// One instance per sprite, the four corners of the quad come from the vertex id
+VSOut main(float2 spritePosition : POSITION, float2 size : SIZE, float4 uvRect : TEXCOORD, float4 color : Color, uint vertexId : SV_VertexID)
+{
+	float2 corner = float2(vertexId & 1, vertexId >> 1);
+	float2 pixel = spritePosition + corner * size;
+
+	VSOut vso;
+	vso.color = color;
+	vso.uv = lerp(uvRect.xy, uvRect.zw, corner);
+	vso.position = float4(pixel * invTargetSize * float2(2.0f, -2.0f) + float2(-1.0f, 1.0f), 0.0f, 1.0f);
+	return vso;
+}
\ No newline at end of file
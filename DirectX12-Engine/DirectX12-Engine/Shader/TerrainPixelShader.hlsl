@@ -0,0 +1,17 @@
+static const float3 SunDirection = float3(0.48f, 0.78f, 0.4f);
+static const float3 SkyLight = float3(0.25f, 0.28f, 0.34f);
+
+// Grass in the valleys, rock on steep slopes and snow on the peaks
+float4 main(float3 normal : Normal, float height : Height) : SV_TARGET
+{
+	float3 n = normalize(normal);
+	float3 grass = float3(0.24f, 0.36f, 0.15f);
+	float3 rock = float3(0.42f, 0.38f, 0.34f);
+	float3 snow = float3(0.92f, 0.93f, 0.96f);
+
+	float3 albedo = lerp(grass, rock, smoothstep(0.75f, 0.6f, n.y));
+	albedo = lerp(albedo, snow, smoothstep(0.7f, 0.8f, height) * smoothstep(0.55f, 0.75f, n.y));
+
+	float3 light = saturate(dot(n, normalize(SunDirection))) + SkyLight;
+	return float4(albedo * light, 1.0f);
+}
@@ -0,0 +1,62 @@
+// Heights of every terrain cache slot, each slot holds one tile of 16 bit samples, see TerrainTileCache
+ByteAddressBuffer heights : register(t0);
+
+cbuffer TerrainConstants : register(b0)
+{
+	row_major float4x4 viewProjection;
+	float heightScale; // World height of the largest sample
+	uint tileSamples;  // Along a tile side
+	uint slotStride;   // Bytes between slots in heights
+	uint padding;
+};
+
+struct VSOut
+{
+	float3 normal : Normal;
+	float height : Height; // 0 to 1
+	float4 position : SV_Position;
+};
+
+float loadHeight(uint slot, uint i, uint j)
+{
+	// Two samples per 32 bit word, the slot stride keeps every slot word aligned
+	uint sampleIndex = j * tileSamples + i;
+	uint packed = heights.Load(slot * slotStride + (sampleIndex & ~1u) * 2u);
+	return ((sampleIndex & 1u) != 0u ? packed >> 16 : packed & 0xffffu) / 65535.0f;
+}
+
+// One instance per patch of the LOD selection, see TerrainPatch in TerrainQuadtree.h. The vertices are the
+// shared grid of tileSamples x tileSamples.
+VSOut main(uint2 grid : GRID, float2 origin : ORIGIN, float size : SIZE, uint slot : SLOT, uint stitch : STITCH)
+{
+	// Snap the vertices on edges next to coarser patches onto their grid, same as stitchTerrainVertex
+	uint lastSample = tileSamples - 1u;
+	uint i = grid.x;
+	uint j = grid.y;
+	if (grid.x == 0u || grid.x == lastSample)
+	{
+		j &= ~((1u << ((stitch >> (grid.x == 0u ? 0u : 4u)) & 15u)) - 1u);
+	}
+	if (grid.y == 0u || grid.y == lastSample)
+	{
+		i &= ~((1u << ((stitch >> (grid.y == 0u ? 8u : 12u)) & 15u)) - 1u);
+	}
+
+	float spacing = size / lastSample;
+	float height = loadHeight(slot, i, j);
+	float3 world = float3(origin.x + i * spacing, height * heightScale, origin.y + j * spacing);
+
+	// Slopes from the neighbouring samples inside the tile
+	uint left = i > 0u ? i - 1u : i;
+	uint right = i < lastSample ? i + 1u : i;
+	uint down = j > 0u ? j - 1u : j;
+	uint up = j < lastSample ? j + 1u : j;
+	float slopeX = (loadHeight(slot, right, j) - loadHeight(slot, left, j)) * heightScale / ((right - left) * spacing);
+	float slopeZ = (loadHeight(slot, i, up) - loadHeight(slot, i, down)) * heightScale / ((up - down) * spacing);
+
+	VSOut vso;
+	vso.normal = float3(-slopeX, 1.0f, -slopeZ);
+	vso.height = height;
+	vso.position = mul(float4(world, 1.0f), viewProjection);
+	return vso;
+}
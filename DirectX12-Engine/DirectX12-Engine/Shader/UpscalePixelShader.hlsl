@@ -0,0 +1,13 @@
+cbuffer UpscaleConstants : register(b0)
+{
+	float2 uvScale; // Fraction of the scene target covered by the scaled viewport
+	float2 uvClamp; // Half a texel inside that fraction
+};
+
+Texture2D sceneTexture : register(t0);
+SamplerState linearSampler : register(s0);
+
+float4 main(float2 uv : TexCoord, float4 position : SV_Position) : SV_TARGET
+{
+	return sceneTexture.Sample(linearSampler, min(uv * uvScale, uvClamp));
+}
\ No newline at end of file
@@ -0,0 +1,14 @@
+struct VSOut
+{
+	float2 uv : TexCoord;
+	float4 position : SV_Position;
+};
+
+// Fullscreen triangle generated from the vertex id, no vertex buffer is bound
+VSOut main(uint vertexId : SV_VertexID)
+{
+	VSOut vso;
+	vso.uv = float2((vertexId << 1) & 2, vertexId & 2);
+	vso.position = float4(vso.uv * float2(2.0f, -2.0f) + float2(-1.0f, 1.0f), 0.0f, 1.0f);
+	return vso;
+}
\ No newline at end of file
@@ -1,3 +1,10 @@
+// Per frame transform of the triangle, set as root constants
+cbuffer SceneConstants : register(b1)
+{
+	float4 transform; // Row major 2x2 matrix
+	float2 offset;
+};
+
 struct VSOut
 {
 	float4 color : Color;
@@ -7,7 +14,8 @@ struct VSOut
 VSOut main(float3 pos : POSITION, float4 color : Color)
 {
 	VSOut vso;
-	vso.position = float4(pos, 1.0f);
+	float2 xy = float2(dot(transform.xy, pos.xy), dot(transform.zw, pos.xy)) + offset;
+	vso.position = float4(xy, pos.z, 1.0f);
 	vso.color = color;
 	return vso;
 }
\ No newline at end of file
@@ -0,0 +1,162 @@
+#include "ShaderManifest.h"
+
+#include <algorithm>
+#include <charconv>
+#include <sstream>
+
+namespace
+{
+    std::vector<std::string> splitTabs(const std::string &line)
+    {
+        std::vector<std::string> fields;
+        size_t begin = 0u;
+        while (true)
+        {
+            const size_t end = line.find('\t', begin);
+            fields.push_back(line.substr(begin, end == std::string::npos ? std::string::npos : end - begin));
+            if (end == std::string::npos)
+            {
+                return fields;
+            }
+            begin = end + 1u;
+        }
+    }
+
+    // The whole field must be a decimal number that fits
+    bool parseUint(const std::string &field, uint32_t &value)
+    {
+        const char *end = field.data() + field.size();
+        const std::from_chars_result result = std::from_chars(field.data(), end, value);
+        return !field.empty() && result.ec == std::errc() && result.ptr == end;
+    }
+}
+
+const ShaderConstantBuffer *ShaderRecord::findConstantBuffer(const std::string &constantBufferName) const
+{
+    const auto found = std::find_if(constantBuffers.begin(), constantBuffers.end(),
+        [&constantBufferName](const ShaderConstantBuffer &constantBuffer) { return constantBuffer.name == constantBufferName; });
+    return found != constantBuffers.end() ? &*found : nullptr;
+}
+
+const ShaderBinding *ShaderRecord::findBinding(const std::string &bindingName) const
+{
+    const auto found = std::find_if(bindings.begin(), bindings.end(), [&bindingName](const ShaderBinding &binding) { return binding.name == bindingName; });
+    return found != bindings.end() ? &*found : nullptr;
+}
+
+bool ShaderManifest::parse(const std::string &text)
+{
+    m_records.clear();
+
+    std::istringstream stream(text);
+    std::string line;
+    ShaderRecord *current = nullptr;
+    uint32_t number = 0u;
+
+    while (std::getline(stream, line))
+    {
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.pop_back();
+        }
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+
+        const std::vector<std::string> fields = splitTabs(line);
+        const std::string &tag = fields[0];
+
+        if (tag == "shader" && fields.size() == 6u && current == nullptr)
+        {
+            m_records.emplace_back();
+            current = &m_records.back();
+            current->name = fields[1];
+            current->entryPoint = fields[2];
+            current->profile = fields[3];
+            current->hash = fields[4];
+            current->file = fields[5];
+        }
+        else if (current == nullptr)
+        {
+            return false;
+        }
+        else if (tag == "define" && fields.size() == 2u)
+        {
+            current->defines.push_back(fields[1]);
+        }
+        else if (tag == "cbuffer" && fields.size() == 3u && parseUint(fields[2], number))
+        {
+            current->constantBuffers.push_back({ fields[1], number, {} });
+        }
+        else if (tag == "member" && fields.size() == 3u && !current->constantBuffers.empty() && parseUint(fields[1], number))
+        {
+            current->constantBuffers.back().members.push_back({ number, fields[2] });
+        }
+        else if (tag == "binding" && fields.size() == 5u && parseUint(fields[4], number))
+        {
+            current->bindings.push_back({ fields[1], fields[2], fields[3], number });
+        }
+        else if (tag == "end")
+        {
+            std::sort(current->defines.begin(), current->defines.end());
+            current = nullptr;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    return current == nullptr;
+}
+
+std::string ShaderManifest::serialize() const
+{
+    std::ostringstream stream;
+    stream << "# Generated by ShaderBuilder, do not edit\n";
+
+    for (const ShaderRecord &record : m_records)
+    {
+        stream << "shader\t" << record.name << '\t' << record.entryPoint << '\t' << record.profile << '\t' << record.hash << '\t' << record.file << '\n';
+        for (const std::string &define : record.defines)
+        {
+            stream << "define\t" << define << '\n';
+        }
+        for (const ShaderConstantBuffer &constantBuffer : record.constantBuffers)
+        {
+            stream << "cbuffer\t" << constantBuffer.name << '\t' << constantBuffer.size << '\n';
+            for (const ShaderConstantMember &member : constantBuffer.members)
+            {
+                stream << "member\t" << member.offset << '\t' << member.declaration << '\n';
+            }
+        }
+        for (const ShaderBinding &binding : record.bindings)
+        {
+            stream << "binding\t" << binding.name << '\t' << binding.type << '\t' << binding.bindPoint << '\t' << binding.count << '\n';
+        }
+        stream << "end\n";
+    }
+
+    return stream.str();
+}
+
+const ShaderRecord *ShaderManifest::find(const std::string &name, std::vector<std::string> defines) const
+{
+    std::sort(defines.begin(), defines.end());
+
+    for (const ShaderRecord &record : m_records)
+    {
+        if (record.name == name && record.defines == defines)
+        {
+            return &record;
+        }
+    }
+    return nullptr;
+}
+
+void ShaderManifest::addRecord(ShaderRecord record)
+{
+    std::sort(record.defines.begin(), record.defines.end());
+    m_records.push_back(std::move(record));
+}
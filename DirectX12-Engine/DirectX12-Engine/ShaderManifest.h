@@ -0,0 +1,74 @@
+#pragma once
+
+// The shader manifest produced by the offline ShaderBuilder tool.
+// Every compiled permutation is listed with the defines it was built with, the content hash
+// used to name its bytecode file and the reflection data (constant buffer layouts and resource
+// bindings) so the runtime does not need to reflect shaders itself.
+//
+// The manifest is a tab separated text file:
+//   shader  <name> <entry point> <profile> <hash> <bytecode file>
+//   define  <NAME=VALUE>
+//   cbuffer <name> <size>
+//   member  <offset> <declaration>
+//   binding <name> <type> <bind point> <count>
+//   end
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct ShaderConstantMember
+{
+    uint32_t offset;
+    std::string declaration;
+};
+
+struct ShaderConstantBuffer
+{
+    std::string name;
+    uint32_t size;
+    std::vector<ShaderConstantMember> members;
+};
+
+struct ShaderBinding
+{
+    std::string name;
+    std::string type;      // cbuffer, texture, UAV, sampler...
+    std::string bindPoint; // Register as written in HLSL, e.g. "u1" or "t0,space1"
+    uint32_t count;
+};
+
+struct ShaderRecord
+{
+    std::string name;
+    std::string entryPoint;
+    std::string profile;
+    std::vector<std::string> defines; // Sorted NAME=VALUE pairs
+    std::string hash;
+    std::string file;
+    std::vector<ShaderConstantBuffer> constantBuffers;
+    std::vector<ShaderBinding> bindings;
+
+    // Null when the shader has none of that name, e.g. because the compiler removed it as unused
+    const ShaderConstantBuffer *findConstantBuffer(const std::string &constantBufferName) const;
+    const ShaderBinding *findBinding(const std::string &bindingName) const;
+};
+
+class ShaderManifest
+{
+public:
+    // Returns false if the text is not a valid manifest, including numbers that do not parse or overflow
+    bool parse(const std::string &text);
+
+    std::string serialize() const;
+
+    // Find the permutation of a shader built with exactly the given defines (in any order)
+    const ShaderRecord *find(const std::string &name, std::vector<std::string> defines = {}) const;
+
+    void addRecord(ShaderRecord record);
+
+    const std::vector<ShaderRecord> &getRecords() const { return m_records; }
+
+private:
+    std::vector<ShaderRecord> m_records;
+};
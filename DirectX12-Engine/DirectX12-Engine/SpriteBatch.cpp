@@ -0,0 +1,88 @@
+#include "SpriteBatch.h"
+
+#include <algorithm>
+
+namespace
+{
+    static_assert(sizeof(SpriteBatch::Instance) == 36, "The instance layout must match the sprite input layout");
+
+    void writeInstance(SpriteBatch::Instance &instance, const Sprite &sprite, const float uvRect[4])
+    {
+        instance.position[0] = sprite.position[0];
+        instance.position[1] = sprite.position[1];
+        instance.size[0] = sprite.size[0];
+        instance.size[1] = sprite.size[1];
+        instance.uvRect[0] = uvRect[0];
+        instance.uvRect[1] = uvRect[1];
+        instance.uvRect[2] = uvRect[2];
+        instance.uvRect[3] = uvRect[3];
+        instance.color = sprite.color;
+    }
+}
+
+SpriteBatch::SpriteBatch(uint32_t maxInstances)
+    : m_maxInstances(maxInstances)
+    , m_pageCount(0u)
+    , m_stats()
+{
+}
+
+uint32_t SpriteBatch::addImage(uint32_t page, const float uvRect[4])
+{
+    Image image;
+    image.page = page;
+    std::copy(uvRect, uvRect + 4, image.uvRect);
+    m_images.push_back(image);
+
+    m_pageCount = std::max(m_pageCount, page + 1u);
+    return static_cast<uint32_t>(m_images.size() - 1u);
+}
+
+const std::vector<SpriteBatch::Draw> &SpriteBatch::build(const Sprite *sprites, uint32_t count, Instance *instances)
+{
+    m_draws.clear();
+    m_stats.submittedSprites += count;
+
+    const uint32_t imageCount = static_cast<uint32_t>(m_images.size());
+
+    // Count the sprites on each page, anything past the instance limit is dropped
+    m_pageOffsets.assign(m_pageCount + 1u, 0u);
+    uint32_t accepted = 0u;
+    for (uint32_t i = 0u; i < count && accepted < m_maxInstances; ++i)
+    {
+        if (sprites[i].image < imageCount)
+        {
+            ++m_pageOffsets[m_images[sprites[i].image].page + 1u];
+            ++accepted;
+        }
+    }
+    m_stats.droppedSprites += count - accepted;
+
+    for (uint32_t page = 0u; page < m_pageCount; ++page)
+    {
+        if (m_pageOffsets[page + 1u] > 0u)
+        {
+            Draw draw;
+            draw.page = page;
+            draw.firstInstance = m_pageOffsets[page];
+            draw.instanceCount = m_pageOffsets[page + 1u];
+            m_draws.push_back(draw);
+        }
+        m_pageOffsets[page + 1u] += m_pageOffsets[page];
+    }
+    m_stats.draws += m_draws.size();
+
+    // Scatter the sprites into their page's range, the offsets become write cursors
+    uint32_t written = 0u;
+    for (uint32_t i = 0u; i < count && written < accepted; ++i)
+    {
+        if (sprites[i].image < imageCount)
+        {
+            const Image &image = m_images[sprites[i].image];
+            writeInstance(instances[m_pageOffsets[image.page]++], sprites[i], image.uvRect);
+            ++written;
+        }
+    }
+
+    return m_draws;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+// Turns a list of sprites into per instance quad data and one instanced draw per atlas page.
+// Sprites are grouped by page with a counting sort, which keeps their submission order within a page,
+// and written straight into the mapped instance buffer so there is no intermediate copy.
+// This file is platform independent so batching can be profiled off Windows.
+
+#include <cstdint>
+#include <vector>
+
+struct Sprite
+{
+    float position[2]; // Top left corner in pixels
+    float size[2];
+    uint32_t color;    // RGBA8, multiplied with the atlas texel
+    uint32_t image;    // Id returned by SpriteBatch::addImage
+};
+
+class SpriteBatch
+{
+public:
+    // Layout of one element of the instance buffer, see SpriteVertexShader.hlsl
+    struct Instance
+    {
+        float position[2];
+        float size[2];
+        float uvRect[4]; // Min u, min v, max u, max v
+        uint32_t color;
+    };
+
+    struct Draw
+    {
+        uint32_t page;
+        uint32_t firstInstance;
+        uint32_t instanceCount;
+    };
+
+    struct Stats
+    {
+        uint64_t submittedSprites;
+        uint64_t droppedSprites; // Over the instance limit or with an unknown image
+        uint64_t draws;
+    };
+
+    explicit SpriteBatch(uint32_t maxInstances);
+
+    // Register an atlas region and return the image id sprites use to refer to it
+    uint32_t addImage(uint32_t page, const float uvRect[4]);
+
+    // Write the instances for the sprites and return the draws needed to render them.
+    // instances must have room for getMaxInstances() elements.
+    const std::vector<Draw> &build(const Sprite *sprites, uint32_t count, Instance *instances);
+
+    uint32_t getMaxInstances() const { return m_maxInstances; }
+
+    const Stats &getStats() const { return m_stats; }
+    void resetStats() { m_stats = {}; }
+
+private:
+    struct Image
+    {
+        uint32_t page;
+        float uvRect[4];
+    };
+
+    uint32_t m_maxInstances;
+    uint32_t m_pageCount;
+    std::vector<Image> m_images;
+
+    std::vector<uint32_t> m_pageOffsets; // Scratch for the counting sort
+    std::vector<Draw> m_draws;
+    Stats m_stats;
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+// Bounded lock-free queue for exactly one producer thread and one consumer thread.
+// Used to hand input events from the UI thread to the simulation thread without locking.
+
+#include <atomic>
+#include <cstddef>
+
+template <typename T, size_t Capacity>
+class SpscQueue
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    SpscQueue()
+        : m_head(0u)
+        , m_tail(0u)
+    {
+    }
+
+    // Producer only. Returns false if the queue is full.
+    bool push(const T &item)
+    {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) == Capacity)
+        {
+            return false;
+        }
+
+        m_items[tail & (Capacity - 1)] = item;
+        m_tail.store(tail + 1u, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only. Returns false if the queue is empty.
+    bool pop(T &item)
+    {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+
+        item = m_items[head & (Capacity - 1)];
+        m_head.store(head + 1u, std::memory_order_release);
+        return true;
+    }
+
+private:
+    // Keep the indices on separate cache lines so the two threads do not false share
+    alignas(64) std::atomic<size_t> m_head;
+    alignas(64) std::atomic<size_t> m_tail;
+    T m_items[Capacity];
+};
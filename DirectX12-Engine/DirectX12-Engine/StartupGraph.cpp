@@ -0,0 +1,405 @@
+#include "StartupGraph.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iomanip>
+
+StartupGraph::StartupGraph(uint32_t workerThreads)
+    : m_startupMs(0.0)
+    , m_deferredStartMs(0.0)
+    , m_startupRemaining(0u)
+    , m_deferredRemaining(0u)
+    , m_running(0u)
+    , m_deferredStarted(false)
+    , m_quit(false)
+    , m_deferredDone(false)
+{
+    // Keep at least one worker so deferred tasks never need the main thread
+    if (workerThreads == 0u)
+    {
+        workerThreads = (std::max)(std::thread::hardware_concurrency(), 2u) - 1u;
+    }
+
+    for (uint32_t i = 0u; i < workerThreads; ++i)
+    {
+        m_workers.emplace_back(&StartupGraph::workerLoop, this, i + 1u);
+    }
+}
+
+StartupGraph::~StartupGraph()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_condition.notify_all();
+    for (std::thread &worker : m_workers)
+    {
+        worker.join();
+    }
+}
+
+StartupGraph::TaskId StartupGraph::add(const char *name, std::function<void()> work, const std::vector<TaskId> &dependencies, Affinity affinity)
+{
+    return addTask(name, std::move(work), dependencies, affinity, false);
+}
+
+StartupGraph::TaskId StartupGraph::addDeferred(const char *name, std::function<void()> work, const std::vector<TaskId> &dependencies)
+{
+    return addTask(name, std::move(work), dependencies, Affinity::AnyThread, true);
+}
+
+StartupGraph::TaskId StartupGraph::addTask(const char *name, std::function<void()> &&work, const std::vector<TaskId> &dependencies, Affinity affinity, bool deferred)
+{
+    const TaskId id = static_cast<TaskId>(m_tasks.size());
+
+    Task task;
+    task.name = name;
+    task.work = std::move(work);
+    task.dependencies = dependencies;
+    task.affinity = affinity;
+    task.deferred = deferred;
+    task.pending = static_cast<uint32_t>(task.dependencies.size());
+    task.chainLength = 1u;
+    task.completed = false;
+    task.thread = 0u;
+    task.startMs = 0.0;
+    task.endMs = 0.0;
+
+    for (TaskId dependency : task.dependencies)
+    {
+        assert(dependency < id);
+        assert(deferred || !m_tasks[dependency].deferred);
+        m_tasks[dependency].dependents.push_back(id);
+    }
+    m_tasks.push_back(std::move(task));
+    return id;
+}
+
+void StartupGraph::run()
+{
+    // Dependents always come later, so one backwards pass finds every chain
+    for (TaskId id = static_cast<TaskId>(m_tasks.size()); id-- > 0u;)
+    {
+        for (TaskId dependent : m_tasks[id].dependents)
+        {
+            m_tasks[id].chainLength = (std::max)(m_tasks[id].chainLength, m_tasks[dependent].chainLength + 1u);
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_start = Clock::now();
+    for (TaskId id = 0u; id < m_tasks.size(); ++id)
+    {
+        if (m_tasks[id].deferred)
+        {
+            ++m_deferredRemaining;
+        }
+        else
+        {
+            ++m_startupRemaining;
+        }
+
+        if (m_tasks[id].pending == 0u)
+        {
+            makeReady(id);
+        }
+    }
+    m_condition.notify_all();
+
+    // Run our own tasks first, they are the ones no other thread can take
+    while (m_startupRemaining > 0u && !m_error)
+    {
+        TaskId id;
+        if (takeReady(m_mainReady, id) || takeReady(m_ready, id))
+        {
+            execute(id, 0u, lock);
+        }
+        else
+        {
+            m_condition.wait(lock);
+        }
+    }
+
+    m_condition.wait(lock, [this]() { return m_running == 0u; });
+    m_startupMs = std::chrono::duration<double, std::milli>(Clock::now() - m_start).count();
+    if (m_error)
+    {
+        m_deferredDone.store(true, std::memory_order_release);
+        std::rethrow_exception(m_error);
+    }
+}
+
+void StartupGraph::startDeferred()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_deferredStarted)
+    {
+        return;
+    }
+
+    m_deferredStarted = true;
+    m_deferredStartMs = std::chrono::duration<double, std::milli>(Clock::now() - m_start).count();
+    m_ready.insert(m_ready.end(), m_parkedDeferred.begin(), m_parkedDeferred.end());
+    m_parkedDeferred.clear();
+    if (m_deferredRemaining == 0u || m_error)
+    {
+        m_deferredDone.store(true, std::memory_order_release);
+    }
+    m_condition.notify_all();
+}
+
+void StartupGraph::waitDeferred()
+{
+    startDeferred();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_condition.wait(lock, [this]() { return m_deferredDone.load(std::memory_order_relaxed); });
+    if (m_error)
+    {
+        std::rethrow_exception(m_error);
+    }
+}
+
+StartupGraph::Report StartupGraph::getReport() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    Report report;
+    report.threadCount = getThreadCount();
+    report.startupMs = m_startupMs;
+    report.criticalPathMs = 0.0;
+    report.serialMs = 0.0;
+    report.deferredMs = 0.0;
+
+    // The longest chain of startup tasks by the time they really took
+    std::vector<double> chainEndMs(m_tasks.size(), 0.0);
+    std::vector<TaskId> chainPrevious(m_tasks.size(), static_cast<TaskId>(m_tasks.size()));
+    TaskId chainEnd = static_cast<TaskId>(m_tasks.size());
+    for (TaskId id = 0u; id < m_tasks.size(); ++id)
+    {
+        const Task &task = m_tasks[id];
+        TaskTiming timing = { task.name, task.deferred, false, task.completed, task.thread, task.startMs, task.endMs };
+        report.tasks.push_back(timing);
+        if (!task.completed)
+        {
+            continue;
+        }
+
+        const double durationMs = task.endMs - task.startMs;
+        if (task.deferred)
+        {
+            report.deferredMs = (std::max)(report.deferredMs, task.endMs - m_deferredStartMs);
+            continue;
+        }
+
+        report.serialMs += durationMs;
+        for (TaskId dependency : task.dependencies)
+        {
+            if (chainEndMs[dependency] > chainEndMs[id])
+            {
+                chainEndMs[id] = chainEndMs[dependency];
+                chainPrevious[id] = dependency;
+            }
+        }
+        chainEndMs[id] += durationMs;
+        if (chainEnd == m_tasks.size() || chainEndMs[id] > chainEndMs[chainEnd])
+        {
+            chainEnd = id;
+        }
+    }
+
+    for (TaskId id = chainEnd; id < m_tasks.size(); id = chainPrevious[id])
+    {
+        report.criticalPath.push_back(id);
+        report.tasks[id].critical = true;
+    }
+    std::reverse(report.criticalPath.begin(), report.criticalPath.end());
+    report.criticalPathMs = chainEnd < m_tasks.size() ? chainEndMs[chainEnd] : 0.0;
+    return report;
+}
+
+void StartupGraph::writeReport(std::ostream &stream) const
+{
+    const Report report = getReport();
+
+    const std::ios::fmtflags flags = stream.flags();
+    const std::streamsize precision = stream.precision();
+    stream << std::fixed << std::right << std::setprecision(2);
+
+    // Each phase is listed in the order its tasks started, tasks that never ran go last
+    auto writeTasks = [&](bool deferred)
+    {
+        std::vector<TaskId> order;
+        for (TaskId id = 0u; id < report.tasks.size(); ++id)
+        {
+            if (report.tasks[id].deferred == deferred)
+            {
+                order.push_back(id);
+            }
+        }
+        std::stable_sort(order.begin(), order.end(), [&](TaskId a, TaskId b)
+        {
+            const TaskTiming &timingA = report.tasks[a];
+            const TaskTiming &timingB = report.tasks[b];
+            if (timingA.completed != timingB.completed)
+            {
+                return timingA.completed;
+            }
+            return timingA.completed && timingA.startMs < timingB.startMs;
+        });
+
+        stream << "     start      time  thread    task\n";
+        for (TaskId id : order)
+        {
+            const TaskTiming &timing = report.tasks[id];
+            if (!timing.completed)
+            {
+                stream << "         -         -       -    " << timing.name << " (not run)\n";
+                continue;
+            }
+
+            const std::string thread = timing.thread == 0u ? std::string("main") : "w" + std::to_string(timing.thread);
+            stream << std::setw(10) << timing.startMs << std::setw(10) << timing.endMs - timing.startMs
+                   << std::setw(8) << thread << (timing.critical ? "  * " : "    ") << timing.name << "\n";
+        }
+    };
+
+    stream << "Startup took " << report.startupMs << " ms on " << report.threadCount << " threads, "
+           << report.serialMs << " ms of work with a critical path of " << report.criticalPathMs << " ms\n";
+    writeTasks(false);
+
+    stream << "Critical path (*):";
+    for (size_t i = 0u; i < report.criticalPath.size(); ++i)
+    {
+        stream << (i == 0u ? " " : " > ") << report.tasks[report.criticalPath[i]].name;
+    }
+    stream << "\n";
+
+    const bool anyDeferred = std::any_of(report.tasks.begin(), report.tasks.end(), [](const TaskTiming &timing) { return timing.deferred; });
+    if (anyDeferred)
+    {
+        stream << "Deferred tasks took " << report.deferredMs << " ms once started\n";
+        writeTasks(true);
+    }
+
+    stream.flags(flags);
+    stream.precision(precision);
+}
+
+void StartupGraph::makeReady(TaskId id)
+{
+    const Task &task = m_tasks[id];
+    if (task.deferred && !m_deferredStarted)
+    {
+        m_parkedDeferred.push_back(id);
+    }
+    else if (task.affinity == Affinity::MainThread)
+    {
+        m_mainReady.push_back(id);
+    }
+    else
+    {
+        m_ready.push_back(id);
+    }
+}
+
+bool StartupGraph::takeReady(std::vector<TaskId> &ready, TaskId &id)
+{
+    if (ready.empty())
+    {
+        return false;
+    }
+
+    // Longest chain first, then the order the tasks were added in
+    size_t best = 0u;
+    for (size_t i = 1u; i < ready.size(); ++i)
+    {
+        const Task &candidate = m_tasks[ready[i]];
+        const Task &current = m_tasks[ready[best]];
+        if (candidate.chainLength > current.chainLength ||
+            (candidate.chainLength == current.chainLength && ready[i] < ready[best]))
+        {
+            best = i;
+        }
+    }
+
+    id = ready[best];
+    ready[best] = ready.back();
+    ready.pop_back();
+    return true;
+}
+
+void StartupGraph::execute(TaskId id, uint32_t thread, std::unique_lock<std::mutex> &lock)
+{
+    Task &task = m_tasks[id];
+    task.thread = thread;
+    task.startMs = std::chrono::duration<double, std::milli>(Clock::now() - m_start).count();
+    ++m_running;
+    lock.unlock();
+
+    std::exception_ptr error;
+    try
+    {
+        task.work();
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+    }
+    const double endMs = std::chrono::duration<double, std::milli>(Clock::now() - m_start).count();
+
+    lock.lock();
+    --m_running;
+    task.endMs = endMs;
+    task.work = nullptr; // Let go of whatever the task captured
+    if (error)
+    {
+        if (!m_error)
+        {
+            m_error = error;
+        }
+    }
+    else
+    {
+        task.completed = true;
+        for (TaskId dependent : task.dependents)
+        {
+            if (--m_tasks[dependent].pending == 0u)
+            {
+                makeReady(dependent);
+            }
+        }
+        if (task.deferred)
+        {
+            --m_deferredRemaining;
+        }
+        else
+        {
+            --m_startupRemaining;
+        }
+    }
+
+    if (m_deferredStarted && (m_deferredRemaining == 0u || (m_error && m_running == 0u)))
+    {
+        m_deferredDone.store(true, std::memory_order_release);
+    }
+    m_condition.notify_all();
+}
+
+void StartupGraph::workerLoop(uint32_t thread)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        m_condition.wait(lock, [this]() { return m_quit || (!m_error && !m_ready.empty()); });
+        if (m_quit)
+        {
+            return;
+        }
+
+        TaskId id;
+        takeReady(m_ready, id);
+        execute(id, thread, lock);
+    }
+}
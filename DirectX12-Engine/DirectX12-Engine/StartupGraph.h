@@ -0,0 +1,135 @@
+#pragma once
+
+// Dependency graph of the work that runs once at startup.
+// Tasks are added with the tasks they depend on, which must already be in the graph, so ids are
+// always in a valid order. run() hands every startup task to a few worker threads as soon as its
+// dependencies have finished, taking the ones with the longest chain of work behind them first,
+// while the calling thread runs the tasks that have to stay on it and helps with the rest.
+// Deferred tasks wait for startDeferred(), usually called once the first frame is out, and then
+// run in the background. Every task is timed so writeReport() can break startup down per task
+// and show the critical path, the longest chain of dependent tasks that no number of threads can
+// shorten.
+// This file is platform independent so it can be built and profiled off Windows.
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+class StartupGraph
+{
+public:
+    typedef uint32_t TaskId;
+
+    enum class Affinity : uint8_t
+    {
+        AnyThread,
+        MainThread // The thread that calls run(), for window and other thread bound work
+    };
+
+    struct TaskTiming
+    {
+        std::string name;
+        bool deferred;
+        bool critical;   // On the critical path of the startup tasks
+        bool completed;  // False when the task never ran because another one failed
+        uint32_t thread; // 0 is the main thread, workers count from 1
+        double startMs;  // From the start of run()
+        double endMs;
+    };
+
+    struct Report
+    {
+        std::vector<TaskTiming> tasks; // In the order they were added
+        std::vector<TaskId> criticalPath;
+        uint32_t threadCount;          // Workers and the main thread
+        double startupMs;              // Wall time of run()
+        double criticalPathMs;         // Sum of the durations along the critical path
+        double serialMs;               // Sum of every startup task's duration
+        double deferredMs;             // From startDeferred() to the last deferred task ending
+    };
+
+    // A worker count of zero uses one worker per hardware thread besides the main thread
+    explicit StartupGraph(uint32_t workerThreads = 0u);
+
+    // Deferred tasks that have not started yet are dropped, running ones are waited for
+    ~StartupGraph();
+
+    StartupGraph(const StartupGraph &) = delete;
+    StartupGraph &operator=(const StartupGraph &) = delete;
+
+    uint32_t getThreadCount() const { return static_cast<uint32_t>(m_workers.size()) + 1u; }
+
+    // Only before run(). Startup tasks may not depend on deferred ones.
+    TaskId add(const char *name, std::function<void()> work, const std::vector<TaskId> &dependencies, Affinity affinity = Affinity::AnyThread);
+    TaskId addDeferred(const char *name, std::function<void()> work, const std::vector<TaskId> &dependencies);
+
+    // Runs every startup task and returns once they have all finished. When a task throws, no
+    // further task is started and the first exception is rethrown once the running ones are done.
+    void run();
+
+    // Lets the deferred tasks run on the workers, never blocks
+    void startDeferred();
+
+    // True once every deferred task has finished, or failed
+    bool isDeferredDone() const { return m_deferredDone.load(std::memory_order_acquire); }
+
+    // Blocks until the deferred tasks are done and rethrows the first exception one of them threw
+    void waitDeferred();
+
+    Report getReport() const;
+    void writeReport(std::ostream &stream) const;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Task
+    {
+        std::string name;
+        std::function<void()> work;
+        std::vector<TaskId> dependencies;
+        std::vector<TaskId> dependents;
+        Affinity affinity;
+        bool deferred;
+        uint32_t pending;     // Dependencies that have not finished yet
+        uint32_t chainLength; // Tasks in the longest chain starting here, ready tasks with longer ones go first
+        bool completed;
+        uint32_t thread;
+        double startMs;
+        double endMs;
+    };
+
+    TaskId addTask(const char *name, std::function<void()> &&work, const std::vector<TaskId> &dependencies, Affinity affinity, bool deferred);
+    void makeReady(TaskId id);
+    bool takeReady(std::vector<TaskId> &ready, TaskId &id);
+    void execute(TaskId id, uint32_t thread, std::unique_lock<std::mutex> &lock);
+    void workerLoop(uint32_t thread);
+
+    std::vector<Task> m_tasks;
+    std::vector<std::thread> m_workers;
+    Clock::time_point m_start;
+    double m_startupMs;
+    double m_deferredStartMs;
+
+    // Scheduling state, guarded by m_mutex
+    mutable std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::vector<TaskId> m_ready;           // Tasks any thread may run
+    std::vector<TaskId> m_mainReady;       // Tasks for the main thread
+    std::vector<TaskId> m_parkedDeferred;  // Deferred tasks that are ready but not started
+    uint32_t m_startupRemaining;
+    uint32_t m_deferredRemaining;
+    uint32_t m_running;
+    bool m_deferredStarted;
+    bool m_quit;
+    std::exception_ptr m_error; // The first exception a task threw
+
+    std::atomic<bool> m_deferredDone;
+};
@@ -0,0 +1,189 @@
+#include "TerrainQuadtree.h"
+
+#include <algorithm>
+
+#include "TerrainTileCache.h"
+
+namespace
+{
+    float distanceToBox(const Vec3 &point, const Aabb &box)
+    {
+        const Vec3 outside = maximum(maximum(box.min - point, point - box.max), Vec3{ 0.0f, 0.0f, 0.0f });
+        return length(outside);
+    }
+}
+
+TerrainQuadtree::TerrainQuadtree(const TerrainTileSet &tiles)
+    : m_tiles(tiles)
+    , m_thresholdPixels(1.0f)
+    , m_prefetchRatio(0.5f)
+    , m_maxStitchLevels(0u)
+    , m_leafMarks(tiles.getTileCount(), 0u)
+    , m_selectionMark(0u)
+    , m_cameraPosition{ 0.0f, 0.0f, 0.0f }
+    , m_frustum(nullptr)
+    , m_cache(nullptr)
+    , m_frame(0u)
+    , m_selection(nullptr)
+{
+    while ((2u << m_maxStitchLevels) <= tiles.getTileSamples() - 1u)
+    {
+        ++m_maxStitchLevels;
+    }
+}
+
+void TerrainQuadtree::setProjection(float verticalFov, float viewportHeight, float thresholdPixels, float nearDistance)
+{
+    m_lodSelector.setProjection(verticalFov, viewportHeight, thresholdPixels, nearDistance);
+    m_thresholdPixels = thresholdPixels;
+}
+
+float TerrainQuadtree::getScreenSpaceError(uint32_t tile, const Vec3 &cameraPosition) const
+{
+    return m_tiles.getInfo(tile).error * m_lodSelector.getPixelsPerUnit(distanceToBox(cameraPosition, m_tiles.getTileBounds(tile)));
+}
+
+void TerrainQuadtree::select(const Vec3 &cameraPosition, const Frustum &frustum, TerrainTileCache &cache, uint64_t frame, TerrainSelection &selection)
+{
+    // Marks of older selections stay behind, restart them all when the counter wraps
+    if (++m_selectionMark == 0u)
+    {
+        std::fill(m_leafMarks.begin(), m_leafMarks.end(), 0u);
+        m_selectionMark = 1u;
+    }
+
+    selection.patches.clear();
+    selection.requests.clear();
+    selection.visitedNodes = 0u;
+    selection.triangles = 0u;
+
+    m_cameraPosition = cameraPosition;
+    m_frustum = &frustum;
+    m_cache = &cache;
+    m_frame = frame;
+    m_selection = &selection;
+
+    if (intersects(frustum, m_tiles.getTileBounds(0u)))
+    {
+        const uint32_t rootSlot = cache.acquire(0u, frame);
+        if (rootSlot != TerrainTileCache::NoSlot)
+        {
+            visit(0u, 0u, 0u, rootSlot);
+        }
+        else
+        {
+            selection.requests.push_back(TerrainTileRequest{ 0u, 1.0f });
+        }
+    }
+
+    // Every leaf is marked, so the patch across each edge can be found by walking up from its neighbour
+    for (TerrainPatch &patch : selection.patches)
+    {
+        const TerrainTileKey key = getTerrainTileKey(patch.tile);
+        patch.stitch =
+            getStitchLevels(key.level, key.x, key.z, -1, 0) |
+            getStitchLevels(key.level, key.x, key.z, 1, 0) << 4 |
+            getStitchLevels(key.level, key.x, key.z, 0, -1) << 8 |
+            getStitchLevels(key.level, key.x, key.z, 0, 1) << 12;
+    }
+    selection.triangles = static_cast<uint64_t>(selection.patches.size()) * getTrianglesPerPatch();
+
+    m_frustum = nullptr;
+    m_cache = nullptr;
+    m_selection = nullptr;
+}
+
+// The node is visible and its tile resident in slot
+void TerrainQuadtree::visit(uint32_t level, uint32_t x, uint32_t z, uint32_t slot)
+{
+    ++m_selection->visitedNodes;
+    const uint32_t tile = getTerrainTileIndex(level, x, z);
+
+    const float error = getScreenSpaceError(tile, m_cameraPosition);
+    if (level + 1u < m_tiles.getLevelCount() && error > m_thresholdPixels * m_prefetchRatio)
+    {
+        // Children outside the frustum are neither drawn nor needed
+        uint32_t childTiles[4];
+        bool childVisible[4];
+        for (uint32_t child = 0u; child < 4u; ++child)
+        {
+            childTiles[child] = getTerrainTileIndex(level + 1u, x * 2u + (child & 1u), z * 2u + (child >> 1));
+            childVisible[child] = intersects(*m_frustum, m_tiles.getTileBounds(childTiles[child]));
+        }
+
+        const float priority = error / m_thresholdPixels;
+        if (error > m_thresholdPixels)
+        {
+            uint32_t childSlots[4];
+            bool resident = true;
+            for (uint32_t child = 0u; child < 4u; ++child)
+            {
+                childSlots[child] = childVisible[child] ? m_cache->acquire(childTiles[child], m_frame) : TerrainTileCache::NoSlot;
+                if (childVisible[child] && childSlots[child] == TerrainTileCache::NoSlot)
+                {
+                    m_selection->requests.push_back(TerrainTileRequest{ childTiles[child], priority });
+                    resident = false;
+                }
+            }
+
+            if (resident)
+            {
+                for (uint32_t child = 0u; child < 4u; ++child)
+                {
+                    if (childVisible[child])
+                    {
+                        visit(level + 1u, x * 2u + (child & 1u), z * 2u + (child >> 1), childSlots[child]);
+                    }
+                    else
+                    {
+                        markLeaf(childTiles[child]);
+                    }
+                }
+                return;
+            }
+        }
+        else
+        {
+            for (uint32_t child = 0u; child < 4u; ++child)
+            {
+                if (childVisible[child] && !m_cache->contains(childTiles[child]))
+                {
+                    m_selection->requests.push_back(TerrainTileRequest{ childTiles[child], priority });
+                }
+            }
+        }
+    }
+
+    const float size = m_tiles.getTileSize(level);
+    m_selection->patches.push_back(TerrainPatch{ static_cast<float>(x) * size, static_cast<float>(z) * size, size, slot, 0u, tile });
+    markLeaf(tile);
+}
+
+// Levels between the patch and the coarser leaf across the edge towards (dx, dz), zero when the leaf there
+// is as fine or finer, or there is none
+uint32_t TerrainQuadtree::getStitchLevels(uint32_t level, uint32_t x, uint32_t z, int32_t dx, int32_t dz) const
+{
+    const int64_t neighbourX = static_cast<int64_t>(x) + dx;
+    const int64_t neighbourZ = static_cast<int64_t>(z) + dz;
+    const int64_t tilesPerSide = static_cast<int64_t>(1u) << level;
+    if (neighbourX < 0 || neighbourZ < 0 || neighbourX >= tilesPerSide || neighbourZ >= tilesPerSide)
+    {
+        return 0u;
+    }
+
+    uint32_t nodeX = static_cast<uint32_t>(neighbourX);
+    uint32_t nodeZ = static_cast<uint32_t>(neighbourZ);
+    for (uint32_t nodeLevel = level;; --nodeLevel)
+    {
+        if (m_leafMarks[getTerrainTileIndex(nodeLevel, nodeX, nodeZ)] == m_selectionMark)
+        {
+            return (std::min)(level - nodeLevel, m_maxStitchLevels);
+        }
+        if (nodeLevel == 0u)
+        {
+            return 0u;
+        }
+        nodeX >>= 1;
+        nodeZ >>= 1;
+    }
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+// LOD selection for the streamed terrain.
+// The quadtree is the tile pyramid of a TerrainTileSet, every node is one tile and is drawn as one
+// patch of the shared grid mesh. Starting at the root, a node whose error projected to the screen
+// is above the pixel threshold is split into its four children, as long as they are all in the
+// TerrainTileCache. A node whose children are not all resident is drawn itself and the missing
+// ones are requested, and nodes that will soon need splitting request theirs ahead of time.
+// Nodes outside the view frustum are dropped together with their subtree.
+//
+// Neighbouring patches can end up several levels apart. Each patch records, per edge, how many
+// levels coarser the patch across it is, and the vertex shader snaps the vertices on that edge
+// onto the coarser patch's grid (stitchTerrainVertex below). Tiles keep every other sample of the
+// level below, so the snapped vertices land exactly on the coarse patch's vertices and no cracks
+// open along the seam.
+// This file is platform independent so it can be built and profiled off Windows.
+
+#include <cstdint>
+#include <vector>
+
+#include "LodSelector.h"
+#include "TerrainTiles.h"
+#include "VectorMath.h"
+
+class TerrainTileCache;
+
+// One patch as the vertex shader reads it, see TerrainVertexShader.hlsl
+struct TerrainPatch
+{
+    float originX;
+    float originZ;
+    float size;      // World length of a side
+    uint32_t slot;   // Cache slot holding the tile's samples
+    uint32_t stitch; // Levels to the coarser patch across each edge, four bits each: -x, +x, -z, +z
+    uint32_t tile;   // Not read by the shader
+};
+
+static_assert(sizeof(TerrainPatch) == 24u, "The patch must match the instance layout of the terrain pipeline");
+
+// A tile the selection wanted but did not find in the cache. Priority is the parent's screen space
+// error over the threshold, one or more when the tile is needed now and less for a prefetch.
+struct TerrainTileRequest
+{
+    uint32_t tile;
+    float priority;
+};
+
+struct TerrainSelection
+{
+    std::vector<TerrainPatch> patches;
+    std::vector<TerrainTileRequest> requests;
+    uint32_t visitedNodes;
+    uint64_t triangles; // Of every patch, counting the ones stitching collapses
+};
+
+// Grid position of vertex (i, j) of a patch after stitching, both run from 0 to lastSample. Vertices on
+// an edge next to a coarser patch move down to the nearest multiple of 2^levels, the corners never move.
+inline void stitchTerrainVertex(uint32_t stitch, uint32_t lastSample, uint32_t &i, uint32_t &j)
+{
+    const uint32_t vertexI = i;
+    const uint32_t vertexJ = j;
+    if (vertexI == 0u || vertexI == lastSample)
+    {
+        j &= ~((1u << ((stitch >> (vertexI == 0u ? 0u : 4u)) & 15u)) - 1u);
+    }
+    if (vertexJ == 0u || vertexJ == lastSample)
+    {
+        i &= ~((1u << ((stitch >> (vertexJ == 0u ? 8u : 12u)) & 15u)) - 1u);
+    }
+}
+
+class TerrainQuadtree
+{
+public:
+    explicit TerrainQuadtree(const TerrainTileSet &tiles);
+
+    // verticalFov in radians. Nodes are split while their error covers more than thresholdPixels.
+    void setProjection(float verticalFov, float viewportHeight, float thresholdPixels, float nearDistance);
+
+    // Children of nodes whose error is above this fraction of the threshold are requested ahead of time
+    void setPrefetchRatio(float ratio) { m_prefetchRatio = ratio; }
+
+    // Pick the patches to draw from the view and the resident tiles. Every tile looked at is marked as used
+    // in frame, which keeps the cache from giving it up while the frame may draw it.
+    void select(const Vec3 &cameraPosition, const Frustum &frustum, TerrainTileCache &cache, uint64_t frame, TerrainSelection &selection);
+
+    // Pixels the tile's error covers as seen from the camera
+    float getScreenSpaceError(uint32_t tile, const Vec3 &cameraPosition) const;
+
+    uint32_t getTrianglesPerPatch() const { return 2u * (m_tiles.getTileSamples() - 1u) * (m_tiles.getTileSamples() - 1u); }
+
+private:
+    void visit(uint32_t level, uint32_t x, uint32_t z, uint32_t slot);
+    void markLeaf(uint32_t tile) { m_leafMarks[tile] = m_selectionMark; }
+    uint32_t getStitchLevels(uint32_t level, uint32_t x, uint32_t z, int32_t dx, int32_t dz) const;
+
+    const TerrainTileSet &m_tiles;
+    LodSelector m_lodSelector;
+    float m_thresholdPixels;
+    float m_prefetchRatio;
+    uint32_t m_maxStitchLevels; // log2 of the cells along a patch side
+
+    // Tiles where the last selection stopped, drawn or culled, marked with m_selectionMark
+    std::vector<uint32_t> m_leafMarks;
+    uint32_t m_selectionMark;
+
+    // State of the selection being made
+    Vec3 m_cameraPosition;
+    const Frustum *m_frustum;
+    TerrainTileCache *m_cache;
+    uint64_t m_frame;
+    TerrainSelection *m_selection;
+};
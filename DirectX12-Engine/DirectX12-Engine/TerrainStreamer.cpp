@@ -0,0 +1,206 @@
+#include "TerrainStreamer.h"
+
+#include <algorithm>
+
+#include "TerrainTileCache.h"
+
+TerrainStreamer::TerrainStreamer(AsyncFileReader &reader, const std::filesystem::path &path, const TerrainTileSet &tiles, TerrainTileCache &cache, const Settings &settings)
+    : m_reader(reader)
+    , m_path(path)
+    , m_tiles(tiles)
+    , m_cache(cache)
+    , m_settings(settings)
+    , m_stats()
+    , m_failed(tiles.getTileCount(), 0u)
+    , m_pendingCallbacks(0u)
+{
+}
+
+TerrainStreamer::~TerrainStreamer()
+{
+    for (const std::pair<const uint32_t, InFlight> &entry : m_inFlight)
+    {
+        if (!entry.second.cancelled)
+        {
+            m_reader.cancel(entry.second.id);
+        }
+    }
+
+    // Reads that could not be cancelled still call back into this object
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_callbacksDone.wait(lock, [this]() { return m_pendingCallbacks == 0u; });
+}
+
+AsyncFileReader::Request TerrainStreamer::makeRequest(uint32_t tile, AsyncFileReader::Priority priority)
+{
+    AsyncFileReader::Request request;
+    request.path = m_path;
+    request.offset = m_tiles.getTileOffset(tile);
+    request.size = m_tiles.getTileDataSize();
+    request.priority = priority;
+    request.onComplete = [this, tile](AsyncFileReader::RequestId, AsyncFileReader::Status status, std::vector<uint8_t> &data)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_completed.push_back(Arrival{ tile, status, std::move(data) });
+        if (--m_pendingCallbacks == 0u)
+        {
+            m_callbacksDone.notify_all();
+        }
+    };
+    return request;
+}
+
+bool TerrainStreamer::loadPinnedLevels(uint32_t levelCount, std::vector<TerrainTileUpload> &uploads)
+{
+    // Pinned tiles must leave room for streaming, and nothing else may be in flight while we wait
+    const uint32_t tileCount = getTerrainTileCount((std::min)(levelCount, m_tiles.getLevelCount()));
+    if (tileCount >= m_cache.getSlotCount() || !m_inFlight.empty())
+    {
+        return false;
+    }
+
+    m_batch.clear();
+    for (uint32_t tile = 0u; tile < tileCount; ++tile)
+    {
+        if (!m_cache.contains(tile))
+        {
+            m_batch.push_back(makeRequest(tile, AsyncFileReader::Priority::Critical));
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pendingCallbacks += static_cast<uint32_t>(m_batch.size());
+    }
+    m_reader.submit(std::move(m_batch));
+    m_batch.clear();
+    m_stats.requestedTiles += tileCount;
+
+    std::vector<Arrival> arrivals;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_callbacksDone.wait(lock, [this]() { return m_pendingCallbacks == 0u; });
+        arrivals.swap(m_completed);
+    }
+
+    bool loaded = true;
+    for (Arrival &arrival : arrivals)
+    {
+        if (arrival.status != AsyncFileReader::Status::Completed || arrival.samples.size() != m_tiles.getTileDataSize())
+        {
+            ++m_stats.failedTiles;
+            m_failed[arrival.tile] = 1u;
+            loaded = false;
+            continue;
+        }
+        m_stats.bytesRead += arrival.samples.size();
+
+        const uint32_t slot = m_cache.insert(arrival.tile, 0u, true);
+        uploads.push_back(TerrainTileUpload{ arrival.tile, slot, std::move(arrival.samples) });
+        ++m_stats.loadedTiles;
+    }
+    return loaded;
+}
+
+void TerrainStreamer::update(uint64_t frame, const std::vector<TerrainTileRequest> &requests, std::vector<TerrainTileUpload> &uploads)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (Arrival &arrival : m_completed)
+        {
+            m_arrived.push_back(std::move(arrival));
+        }
+        m_completed.clear();
+    }
+
+    // Hand out what has arrived, tiles that find no room in this frame's uploads wait for the next one
+    uint32_t uploadCount = 0u;
+    while (!m_arrived.empty() && uploadCount < m_settings.maxUploadsPerFrame)
+    {
+        Arrival arrival = std::move(m_arrived.front());
+        m_arrived.pop_front();
+        m_inFlight.erase(arrival.tile);
+
+        if (arrival.status == AsyncFileReader::Status::Cancelled)
+        {
+            ++m_stats.cancelledTiles;
+            continue;
+        }
+        if (arrival.status == AsyncFileReader::Status::Failed || arrival.samples.size() != m_tiles.getTileDataSize())
+        {
+            ++m_stats.failedTiles;
+            m_failed[arrival.tile] = 1u;
+            continue;
+        }
+        m_stats.bytesRead += arrival.samples.size();
+
+        const uint32_t slot = m_cache.insert(arrival.tile, frame);
+        if (slot == TerrainTileCache::NoSlot)
+        {
+            ++m_stats.droppedTiles;
+            continue;
+        }
+        uploads.push_back(TerrainTileUpload{ arrival.tile, slot, std::move(arrival.samples) });
+        ++m_stats.loadedTiles;
+        ++uploadCount;
+    }
+
+    // Reads the selection has stopped asking for are cancelled once they have been unwanted for long enough
+    for (const TerrainTileRequest &request : requests)
+    {
+        const auto found = m_inFlight.find(request.tile);
+        if (found != m_inFlight.end())
+        {
+            found->second.lastRequested = frame;
+        }
+    }
+    for (std::pair<const uint32_t, InFlight> &entry : m_inFlight)
+    {
+        InFlight &inFlight = entry.second;
+        if (!inFlight.cancelled && inFlight.lastRequested + m_settings.cancelAfterFrames < frame && m_reader.cancel(inFlight.id))
+        {
+            inFlight.cancelled = true;
+        }
+    }
+
+    // Most urgent first
+    if (m_inFlight.size() >= m_settings.maxRequestsInFlight || requests.empty())
+    {
+        return;
+    }
+    m_sortedRequests.assign(requests.begin(), requests.end());
+    std::sort(m_sortedRequests.begin(), m_sortedRequests.end(), [](const TerrainTileRequest &a, const TerrainTileRequest &b) { return a.priority > b.priority; });
+
+    m_batch.clear();
+    m_batchTiles.clear();
+    for (const TerrainTileRequest &request : m_sortedRequests)
+    {
+        if (m_inFlight.size() >= m_settings.maxRequestsInFlight)
+        {
+            break;
+        }
+        if (m_cache.contains(request.tile) || m_failed[request.tile] != 0u || m_inFlight.count(request.tile) != 0u)
+        {
+            continue;
+        }
+        m_batch.push_back(makeRequest(request.tile, request.priority >= 1.0f ? AsyncFileReader::Priority::High : AsyncFileReader::Priority::Low));
+        m_batchTiles.push_back(request.tile);
+        m_inFlight[request.tile] = InFlight{ AsyncFileReader::InvalidRequest, frame, false };
+    }
+    if (m_batch.empty())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pendingCallbacks += static_cast<uint32_t>(m_batch.size());
+    }
+    const std::vector<AsyncFileReader::RequestId> ids = m_reader.submit(std::move(m_batch));
+    m_batch.clear();
+    for (size_t i = 0u; i < ids.size(); ++i)
+    {
+        m_inFlight[m_batchTiles[i]].id = ids[i];
+    }
+    m_stats.requestedTiles += ids.size();
+    m_stats.maxInFlight = (std::max)(m_stats.maxInFlight, static_cast<uint32_t>(m_inFlight.size()));
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+// Streams terrain tiles from a cooked terrain file into a TerrainTileCache.
+// Once a frame, after the LOD selection, update() takes the tiles whose reads have finished, gives
+// each one a cache slot and hands its samples back for upload. It then cancels the reads nobody has
+// asked for in a while, and issues new ones from the selection's requests, most urgent first, up to a
+// fixed number in flight. Reads go through AsyncFileReader: tiles the selection needs now are read at
+// high priority and prefetches at low priority, so the reader serves them in that order too.
+// Only update() and loadPinnedLevels() touch the cache, both on the caller's thread.
+// This file is platform independent so it can be built and profiled off Windows.
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "AsyncFileReader.h"
+#include "TerrainQuadtree.h"
+#include "TerrainTiles.h"
+
+class TerrainTileCache;
+
+// Samples of a tile that has just been given a slot, to be copied into that slot of the height buffer
+struct TerrainTileUpload
+{
+    uint32_t tile;
+    uint32_t slot;
+    std::vector<uint8_t> samples;
+};
+
+class TerrainStreamer
+{
+public:
+    struct Settings
+    {
+        uint32_t maxRequestsInFlight = 16u; // Includes tiles read but not handed out yet
+        uint32_t maxUploadsPerFrame = 8u;
+        uint32_t cancelAfterFrames = 30u;   // Reads not requested again for this long are cancelled
+    };
+
+    struct Stats
+    {
+        uint64_t requestedTiles;
+        uint64_t loadedTiles;    // Given a slot and handed out
+        uint64_t cancelledTiles;
+        uint64_t failedTiles;    // Read errors, never requested again
+        uint64_t droppedTiles;   // Read but no slot was free, requested again when still needed
+        uint64_t bytesRead;
+        uint32_t maxInFlight;
+    };
+
+    // The reader, tile set and cache must outlive the streamer
+    TerrainStreamer(AsyncFileReader &reader, const std::filesystem::path &path, const TerrainTileSet &tiles, TerrainTileCache &cache, const Settings &settings);
+
+    // Cancels the reads in flight and waits for their callbacks
+    ~TerrainStreamer();
+
+    TerrainStreamer(const TerrainStreamer &) = delete;
+    TerrainStreamer &operator=(const TerrainStreamer &) = delete;
+
+    // Read every tile of the first levelCount levels and pin them, so the selection always has something to
+    // draw. Blocks until the reads are done, returns false if one fails or the cache is too small.
+    bool loadPinnedLevels(uint32_t levelCount, std::vector<TerrainTileUpload> &uploads);
+
+    // Call once per frame after the selection, with the frame it used. Appends the tiles that were given a
+    // slot to uploads, at most maxUploadsPerFrame.
+    void update(uint64_t frame, const std::vector<TerrainTileRequest> &requests, std::vector<TerrainTileUpload> &uploads);
+
+    uint32_t getRequestsInFlight() const { return static_cast<uint32_t>(m_inFlight.size()); }
+    const Stats &getStats() const { return m_stats; }
+
+private:
+    struct InFlight
+    {
+        AsyncFileReader::RequestId id;
+        uint64_t lastRequested; // Frame
+        bool cancelled;
+    };
+
+    struct Arrival
+    {
+        uint32_t tile;
+        AsyncFileReader::Status status;
+        std::vector<uint8_t> samples;
+    };
+
+    AsyncFileReader::Request makeRequest(uint32_t tile, AsyncFileReader::Priority priority);
+
+    AsyncFileReader &m_reader;
+    std::filesystem::path m_path;
+    const TerrainTileSet &m_tiles;
+    TerrainTileCache &m_cache;
+    Settings m_settings;
+    Stats m_stats;
+
+    // Only touched by the caller's thread
+    std::unordered_map<uint32_t, InFlight> m_inFlight; // By tile
+    std::deque<Arrival> m_arrived;                     // Waiting for a frame with room for their upload
+    std::vector<uint8_t> m_failed;                     // Per tile
+    std::vector<TerrainTileRequest> m_sortedRequests;
+    std::vector<AsyncFileReader::Request> m_batch;
+    std::vector<uint32_t> m_batchTiles;
+
+    // Filled by the reader's worker threads
+    std::mutex m_mutex;
+    std::condition_variable m_callbacksDone;
+    std::vector<Arrival> m_completed;
+    uint32_t m_pendingCallbacks;
+};
@@ -0,0 +1,109 @@
+#include "TerrainTileCache.h"
+
+TerrainTileCache::TerrainTileCache(uint32_t tileCount, uint32_t slotCount)
+    : m_slots(slotCount)
+    , m_tileSlots(tileCount, NoSlot)
+    , m_head(NoSlot)
+    , m_tail(NoSlot)
+    , m_residentCount(0u)
+    , m_stats()
+{
+    // Every slot starts free, free slots are always the least recently used
+    for (uint32_t slot = 0u; slot < slotCount; ++slot)
+    {
+        m_slots[slot] = Slot{ NoTile, NoSlot, NoSlot, false, 0u };
+        pushFront(slot);
+    }
+}
+
+uint32_t TerrainTileCache::acquire(uint32_t tile, uint64_t frame)
+{
+    ++m_stats.lookups;
+    const uint32_t slot = m_tileSlots[tile];
+    if (slot == NoSlot)
+    {
+        return NoSlot;
+    }
+    ++m_stats.hits;
+
+    Slot &entry = m_slots[slot];
+    entry.lastUsed = frame;
+    if (!entry.pinned && slot != m_head)
+    {
+        unlink(slot);
+        pushFront(slot);
+    }
+    return slot;
+}
+
+uint32_t TerrainTileCache::insert(uint32_t tile, uint64_t frame, bool pinned)
+{
+    // The tail is the least recently used slot, if it was used this frame every other one was too
+    const uint32_t slot = m_tail;
+    if (slot == NoSlot || (m_slots[slot].tile != NoTile && m_slots[slot].lastUsed >= frame && frame != 0u))
+    {
+        return NoSlot;
+    }
+
+    Slot &entry = m_slots[slot];
+    if (entry.tile != NoTile)
+    {
+        m_tileSlots[entry.tile] = NoSlot;
+        ++m_stats.evictions;
+    }
+    else
+    {
+        ++m_residentCount;
+    }
+
+    unlink(slot);
+    entry.tile = tile;
+    entry.lastUsed = frame;
+    entry.pinned = pinned;
+    if (!pinned)
+    {
+        pushFront(slot);
+    }
+    m_tileSlots[tile] = slot;
+    ++m_stats.insertions;
+    return slot;
+}
+
+void TerrainTileCache::unlink(uint32_t slot)
+{
+    Slot &entry = m_slots[slot];
+    if (entry.previous != NoSlot)
+    {
+        m_slots[entry.previous].next = entry.next;
+    }
+    else
+    {
+        m_head = entry.next;
+    }
+    if (entry.next != NoSlot)
+    {
+        m_slots[entry.next].previous = entry.previous;
+    }
+    else
+    {
+        m_tail = entry.previous;
+    }
+    entry.previous = NoSlot;
+    entry.next = NoSlot;
+}
+
+void TerrainTileCache::pushFront(uint32_t slot)
+{
+    Slot &entry = m_slots[slot];
+    entry.previous = NoSlot;
+    entry.next = m_head;
+    if (m_head != NoSlot)
+    {
+        m_slots[m_head].previous = slot;
+    }
+    else
+    {
+        m_tail = slot;
+    }
+    m_head = slot;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+// Which terrain tiles are resident, and where.
+// The cache has a fixed number of slots, one per tile in the renderer's height buffer. Slots that
+// are not pinned are kept in a list from the most to the least recently used tile, so finding the
+// slot to reuse for a tile that has just arrived is constant time. A tile used in the current
+// frame is never given up, a patch drawn this frame may still be reading it. The lookups the LOD
+// selection makes are counted to give the hit rate.
+// Frames count from 1, a frame of 0 never protects anything.
+// This file is platform independent so it can be built and profiled off Windows.
+
+#include <cstdint>
+#include <vector>
+
+class TerrainTileCache
+{
+public:
+    static constexpr uint32_t NoSlot = 0xffffffffu;
+    static constexpr uint32_t NoTile = 0xffffffffu;
+
+    struct Stats
+    {
+        uint64_t lookups;
+        uint64_t hits;
+        uint64_t insertions;
+        uint64_t evictions;
+    };
+
+    TerrainTileCache(uint32_t tileCount, uint32_t slotCount);
+
+    uint32_t getSlotCount() const { return static_cast<uint32_t>(m_slots.size()); }
+    uint32_t getResidentCount() const { return m_residentCount; }
+
+    // Slot of a resident tile or NoSlot, without counting a lookup or changing its age
+    uint32_t find(uint32_t tile) const { return m_tileSlots[tile]; }
+    bool contains(uint32_t tile) const { return m_tileSlots[tile] != NoSlot; }
+
+    // Tile held by a slot, NoTile for a free one
+    uint32_t getTile(uint32_t slot) const { return m_slots[slot].tile; }
+
+    // Slot of the tile or NoSlot, counted as a hit or a miss. A resident tile becomes the most recently used one.
+    uint32_t acquire(uint32_t tile, uint64_t frame);
+
+    // Give the tile a slot, a free one if there is one and otherwise the least recently used tile's.
+    // Returns NoSlot when every slot holds a pinned tile or one used in this frame. Pinned tiles stay
+    // until the cache is destroyed. The tile must not be resident already.
+    uint32_t insert(uint32_t tile, uint64_t frame, bool pinned = false);
+
+    const Stats &getStats() const { return m_stats; }
+    void resetStats() { m_stats = Stats(); }
+
+private:
+    struct Slot
+    {
+        uint32_t tile;
+        uint32_t previous; // Towards the most recently used end, NoSlot at the head
+        uint32_t next;     // Towards the least recently used end, NoSlot at the tail
+        bool pinned;
+        uint64_t lastUsed;
+    };
+
+    void unlink(uint32_t slot);
+    void pushFront(uint32_t slot);
+
+    std::vector<Slot> m_slots;
+    std::vector<uint32_t> m_tileSlots; // Per tile
+    uint32_t m_head;
+    uint32_t m_tail;
+    uint32_t m_residentCount;
+    Stats m_stats;
+};
@@ -0,0 +1,252 @@
+#include "TerrainTiles.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+    bool isTileSampleCount(uint32_t samples)
+    {
+        // Stitching stores a level difference of up to log2(samples - 1) in four bits
+        const uint32_t cells = samples - 1u;
+        return samples >= 3u && samples <= 257u && (cells & (cells - 1u)) == 0u;
+    }
+
+    uint64_t alignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1u) & ~(alignment - 1u);
+    }
+
+    // The tile's surface at a fine sample inside one of its cells, each cell is split along the
+    // diagonal from its first to its last corner the way the grid mesh is
+    float interpolateCell(float h00, float h10, float h01, float h11, float u, float v)
+    {
+        return u >= v ? h00 + u * (h10 - h00) + v * (h11 - h10) : h00 + v * (h01 - h00) + u * (h11 - h01);
+    }
+}
+
+TerrainTileKey getTerrainTileKey(uint32_t index)
+{
+    uint32_t level = 0u;
+    while (index >= getTerrainTileCount(level + 1u))
+    {
+        ++level;
+    }
+    const uint32_t local = index - getTerrainTileCount(level);
+    return TerrainTileKey{ level, local & ((1u << level) - 1u), local >> level };
+}
+
+TerrainTileSet::TerrainTileSet()
+    : m_header()
+{
+}
+
+bool TerrainTileSet::load(const std::filesystem::path &path, std::string &error)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        error = "cannot open " + path.string();
+        return false;
+    }
+
+    // The header says how long the tile table is
+    std::vector<uint8_t> data(sizeof(TerrainTileHeader));
+    if (!file.read(reinterpret_cast<char *>(data.data()), static_cast<std::streamsize>(data.size())))
+    {
+        error = "file too small";
+        return false;
+    }
+    TerrainTileHeader header;
+    memcpy(&header, data.data(), sizeof(header));
+    if (header.magic == TerrainTileMagic && header.levelCount >= 1u && header.levelCount <= TerrainMaxLevels)
+    {
+        data.resize(sizeof(TerrainTileHeader) + static_cast<size_t>(getTerrainTileCount(header.levelCount)) * sizeof(TerrainTileInfo));
+        if (!file.read(reinterpret_cast<char *>(data.data() + sizeof(TerrainTileHeader)), static_cast<std::streamsize>(data.size() - sizeof(TerrainTileHeader))))
+        {
+            error = "tile table cut short";
+            return false;
+        }
+    }
+    return parse(data.data(), data.size(), error);
+}
+
+bool TerrainTileSet::parse(const uint8_t *data, size_t size, std::string &error)
+{
+    m_header = TerrainTileHeader();
+    m_infos.clear();
+
+    if (size < sizeof(TerrainTileHeader))
+    {
+        error = "file too small";
+        return false;
+    }
+    TerrainTileHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != TerrainTileMagic || header.version != TerrainTileVersion)
+    {
+        error = "not a cooked terrain of version " + std::to_string(TerrainTileVersion);
+        return false;
+    }
+    if (header.levelCount < 1u || header.levelCount > TerrainMaxLevels || !isTileSampleCount(header.tileSamples) ||
+        header.tileCount != getTerrainTileCount(header.levelCount))
+    {
+        error = "bad level count or tile size";
+        return false;
+    }
+    if (!(header.worldSize > 0.0f) || !std::isfinite(header.worldSize) || !(header.heightScale >= 0.0f) || !std::isfinite(header.heightScale))
+    {
+        error = "bad world size or height scale";
+        return false;
+    }
+
+    const uint64_t tableEnd = sizeof(TerrainTileHeader) + static_cast<uint64_t>(header.tileCount) * sizeof(TerrainTileInfo);
+    if (header.tileStride < getTerrainTileDataSize(header.tileSamples) || header.tileStride % TerrainTileAlignment != 0u ||
+        header.dataOffset < tableEnd || header.dataOffset % TerrainTileAlignment != 0u)
+    {
+        error = "bad tile layout";
+        return false;
+    }
+    if (size < tableEnd)
+    {
+        error = "tile table cut short";
+        return false;
+    }
+
+    m_header = header;
+    m_infos.resize(header.tileCount);
+    memcpy(m_infos.data(), data + sizeof(TerrainTileHeader), m_infos.size() * sizeof(TerrainTileInfo));
+    return true;
+}
+
+Aabb TerrainTileSet::getTileBounds(uint32_t tile) const
+{
+    const TerrainTileKey key = getTerrainTileKey(tile);
+    const float size = getTileSize(key.level);
+    const TerrainTileInfo &info = m_infos[tile];
+    return Aabb{
+        Vec3{ static_cast<float>(key.x) * size, info.minHeight, static_cast<float>(key.z) * size },
+        Vec3{ static_cast<float>(key.x + 1u) * size, info.maxHeight, static_cast<float>(key.z + 1u) * size } };
+}
+
+bool cookTerrain(const uint16_t *heights, uint32_t size, uint32_t tileSamples, float worldSize, float heightScale, std::vector<uint8_t> &file, std::string &error)
+{
+    if (!isTileSampleCount(tileSamples))
+    {
+        error = "tile samples must be a power of two plus one between 3 and 257";
+        return false;
+    }
+    const uint32_t cells = tileSamples - 1u;
+    uint32_t levelCount = 1u;
+    while (levelCount <= TerrainMaxLevels && (cells << (levelCount - 1u)) + 1u < size)
+    {
+        ++levelCount;
+    }
+    if (levelCount > TerrainMaxLevels || (cells << (levelCount - 1u)) + 1u != size)
+    {
+        error = "the heightmap size must be (tile samples - 1) * 2^n + 1 with at most " + std::to_string(TerrainMaxLevels) + " levels";
+        return false;
+    }
+    if (!(worldSize > 0.0f) || !(heightScale >= 0.0f))
+    {
+        error = "bad world size or height scale";
+        return false;
+    }
+
+    TerrainTileHeader header;
+    header.magic = TerrainTileMagic;
+    header.version = TerrainTileVersion;
+    header.levelCount = levelCount;
+    header.tileSamples = tileSamples;
+    header.worldSize = worldSize;
+    header.heightScale = heightScale;
+    header.tileCount = getTerrainTileCount(levelCount);
+    header.tileStride = static_cast<uint32_t>(alignUp(getTerrainTileDataSize(tileSamples), TerrainTileAlignment));
+    header.dataOffset = alignUp(sizeof(TerrainTileHeader) + static_cast<uint64_t>(header.tileCount) * sizeof(TerrainTileInfo), TerrainTileAlignment);
+
+    file.assign(static_cast<size_t>(header.dataOffset + static_cast<uint64_t>(header.tileCount) * header.tileStride), 0u);
+    memcpy(file.data(), &header, sizeof(header));
+
+    const float toWorld = heightScale / 65535.0f;
+    std::vector<TerrainTileInfo> infos(header.tileCount);
+
+    // Finest level first, coarser tiles take their bounds and the lower limit of their error from their children
+    const uint32_t lastLevel = levelCount - 1u;
+    for (uint32_t level = levelCount; level-- > 0u;)
+    {
+        const uint32_t step = 1u << (lastLevel - level); // Full resolution samples between two of the tile's samples
+        const uint32_t tilesPerSide = 1u << level;
+        for (uint32_t tileZ = 0u; tileZ < tilesPerSide; ++tileZ)
+        {
+            for (uint32_t tileX = 0u; tileX < tilesPerSide; ++tileX)
+            {
+                const uint32_t tile = getTerrainTileIndex(level, tileX, tileZ);
+                const size_t originX = static_cast<size_t>(tileX) * cells * step;
+                const size_t originZ = static_cast<size_t>(tileZ) * cells * step;
+                auto sample = [&](uint32_t i, uint32_t j) { return heights[(originZ + static_cast<size_t>(j) * step) * size + originX + static_cast<size_t>(i) * step]; };
+
+                uint16_t *samples = reinterpret_cast<uint16_t *>(file.data() + header.dataOffset + static_cast<uint64_t>(tile) * header.tileStride);
+                for (uint32_t j = 0u; j < tileSamples; ++j)
+                {
+                    for (uint32_t i = 0u; i < tileSamples; ++i)
+                    {
+                        samples[j * tileSamples + i] = sample(i, j);
+                    }
+                }
+
+                TerrainTileInfo &info = infos[tile];
+                info.padding = 0u;
+                if (level == lastLevel)
+                {
+                    const auto range = std::minmax_element(samples, samples + tileSamples * tileSamples);
+                    info.minHeight = *range.first * toWorld;
+                    info.maxHeight = *range.second * toWorld;
+                    info.error = 0.0f;
+                    continue;
+                }
+
+                info.minHeight = 3.4e38f;
+                info.maxHeight = 0.0f;
+                info.error = 0.0f;
+                for (uint32_t child = 0u; child < 4u; ++child)
+                {
+                    const TerrainTileInfo &childInfo = infos[getTerrainTileIndex(level + 1u, tileX * 2u + (child & 1u), tileZ * 2u + (child >> 1))];
+                    info.minHeight = (std::min)(info.minHeight, childInfo.minHeight);
+                    info.maxHeight = (std::max)(info.maxHeight, childInfo.maxHeight);
+                    info.error = (std::max)(info.error, childInfo.error);
+                }
+
+                // Compare the tile's cells against every full resolution sample they span, borders included
+                const float invStep = 1.0f / static_cast<float>(step);
+                float geometricError = 0.0f;
+                for (uint32_t j = 0u; j < cells; ++j)
+                {
+                    for (uint32_t i = 0u; i < cells; ++i)
+                    {
+                        const float h00 = sample(i, j);
+                        const float h10 = sample(i + 1u, j);
+                        const float h01 = sample(i, j + 1u);
+                        const float h11 = sample(i + 1u, j + 1u);
+                        const size_t cellX = originX + static_cast<size_t>(i) * step;
+                        const size_t cellZ = originZ + static_cast<size_t>(j) * step;
+                        for (uint32_t b = 0u; b <= step; ++b)
+                        {
+                            const uint16_t *row = heights + (cellZ + b) * size + cellX;
+                            for (uint32_t a = 0u; a <= step; ++a)
+                            {
+                                const float surface = interpolateCell(h00, h10, h01, h11, a * invStep, b * invStep);
+                                geometricError = (std::max)(geometricError, std::fabs(surface - static_cast<float>(row[a])));
+                            }
+                        }
+                    }
+                }
+                info.error = (std::max)(info.error, geometricError * toWorld);
+            }
+        }
+    }
+
+    memcpy(file.data() + sizeof(TerrainTileHeader), infos.data(), infos.size() * sizeof(TerrainTileInfo));
+    return true;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+// The cooked terrain heightmap, written by cookTerrain() and streamed in by TerrainStreamer.
+// The heightmap is cut into a quadtree of square tiles: level 0 is one tile covering the whole
+// terrain and every level below splits each tile of the level above into four, down to the full
+// resolution at the last level. Every tile has the same number of samples along a side, a power
+// of two plus one so neighbouring tiles share their edge samples, and a coarse tile keeps every
+// other sample of the level below. The samples of a coarse tile are therefore samples of the finer
+// tiles under it too, which is what lets patches of different levels be stitched without cracks.
+// The header and one TerrainTileInfo per tile come first and are small enough to keep in memory.
+// The samples of each tile follow at a fixed, aligned stride so any tile is one aligned read.
+// This file is platform independent so it can be built and profiled off Windows.
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "VectorMath.h"
+
+const uint32_t TerrainTileMagic = 0x4e525444u; // "DTRN"
+const uint32_t TerrainTileVersion = 1u;
+const uint32_t TerrainTileAlignment = 4096u;   // Tile data starts and strides on this, so reads can bypass the file cache
+const uint32_t TerrainMaxLevels = 12u;
+
+struct TerrainTileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t levelCount;
+    uint32_t tileSamples;  // Along each side, a power of two plus one
+    float worldSize;       // Length of the terrain along x and along z, it starts at the origin
+    float heightScale;     // World height of the largest sample value
+    uint32_t tileCount;
+    uint32_t tileStride;   // Bytes between tiles in the data block
+    uint64_t dataOffset;   // From the start of the file
+};
+
+// Bounds and error of one tile, in world units. The heights cover the full resolution surface under
+// the tile, so they bound every finer tile below it as well.
+struct TerrainTileInfo
+{
+    float minHeight;
+    float maxHeight;
+    float error;     // Largest height difference between the tile's surface and the full resolution one, never below its children's
+    uint32_t padding;
+};
+
+struct TerrainTileKey
+{
+    uint32_t level;
+    uint32_t x;
+    uint32_t z;
+};
+
+// Tiles are numbered level by level, each level in rows along x
+constexpr uint32_t getTerrainTileCount(uint32_t levelCount) { return ((1u << (2u * levelCount)) - 1u) / 3u; }
+constexpr uint32_t getTerrainTileIndex(uint32_t level, uint32_t x, uint32_t z) { return getTerrainTileCount(level) + (z << level) + x; }
+TerrainTileKey getTerrainTileKey(uint32_t index);
+
+// Bytes of samples in a tile, 16 bit heights in rows along x
+constexpr uint32_t getTerrainTileDataSize(uint32_t tileSamples) { return tileSamples * tileSamples * static_cast<uint32_t>(sizeof(uint16_t)); }
+
+// The header and tile table of a cooked terrain, everything but the samples
+class TerrainTileSet
+{
+public:
+    TerrainTileSet();
+
+    // Reads the header and tile table, false with a description of the problem when the file is not a cooked terrain
+    bool load(const std::filesystem::path &path, std::string &error);
+
+    // Same as load() for the start of a file already in memory, size may stop anywhere past the tile table
+    bool parse(const uint8_t *data, size_t size, std::string &error);
+
+    const TerrainTileHeader &getHeader() const { return m_header; }
+    uint32_t getLevelCount() const { return m_header.levelCount; }
+    uint32_t getTileSamples() const { return m_header.tileSamples; }
+    uint32_t getTileCount() const { return m_header.tileCount; }
+    const TerrainTileInfo &getInfo(uint32_t tile) const { return m_infos[tile]; }
+
+    // World length of a tile's side at the level
+    float getTileSize(uint32_t level) const { return m_header.worldSize / static_cast<float>(1u << level); }
+    Aabb getTileBounds(uint32_t tile) const;
+
+    // Where the tile's samples are in the file
+    uint64_t getTileOffset(uint32_t tile) const { return m_header.dataOffset + static_cast<uint64_t>(tile) * m_header.tileStride; }
+    uint32_t getTileDataSize() const { return getTerrainTileDataSize(m_header.tileSamples); }
+
+private:
+    TerrainTileHeader m_header;
+    std::vector<TerrainTileInfo> m_infos;
+};
+
+// Build a cooked terrain from a square heightmap of size x size 16 bit samples in rows along x. The size
+// must be (tileSamples - 1) * 2^n + 1, which gives n + 1 levels. Returns false with a description when
+// the sizes do not fit together.
+bool cookTerrain(const uint16_t *heights, uint32_t size, uint32_t tileSamples, float worldSize, float heightScale, std::vector<uint8_t> &file, std::string &error);
@@ -0,0 +1,58 @@
+#pragma once
+
+// Lock-free triple buffer for handing immutable snapshots from one writer thread to one reader thread.
+// The writer always has a private slot to fill, the reader always has a private slot to read, and the
+// third slot holds the most recently published value. Neither side ever waits for the other.
+
+#include <atomic>
+#include <cstdint>
+
+template <typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer()
+        : m_writeIndex(0u)
+        , m_readIndex(1u)
+        , m_shared(2u)
+    {
+    }
+
+    // Writer only. The returned slot is private to the writer until publish() is called.
+    T &beginWrite()
+    {
+        return m_slots[m_writeIndex];
+    }
+
+    // Writer only. Makes the slot from beginWrite() the latest value.
+    void publish()
+    {
+        const uint32_t previous = m_shared.exchange(m_writeIndex | FreshBit, std::memory_order_acq_rel);
+        m_writeIndex = previous & IndexMask;
+    }
+
+    // Reader only. Returns the latest published value, or nullptr if nothing has been published yet.
+    // The value stays valid and unchanged until the next call.
+    const T *acquireLatest()
+    {
+        if ((m_shared.load(std::memory_order_relaxed) & FreshBit) != 0u)
+        {
+            const uint32_t previous = m_shared.exchange(m_readIndex, std::memory_order_acq_rel);
+            m_readIndex = previous & IndexMask;
+            m_hasValue = true;
+        }
+        return m_hasValue ? &m_slots[m_readIndex] : nullptr;
+    }
+
+private:
+    static const uint32_t IndexMask = 3u;
+    static const uint32_t FreshBit = 4u;
+
+    T m_slots[3];
+    uint32_t m_writeIndex;
+    uint32_t m_readIndex;
+    bool m_hasValue = false;
+
+    // Index of the shared slot plus FreshBit when it holds a value the reader has not taken yet
+    std::atomic<uint32_t> m_shared;
+};
@@ -0,0 +1,568 @@
+#pragma once
+
+// Vector, quaternion and matrix math shared by the renderer and the CPU side systems.
+// Everything is header only. Small operations are constexpr scalar code the compiler
+// vectorizes well enough on its own; the hot paths (matrix products, vector transforms and
+// the batched structure of arrays kernels) have AVX2 / SSE2 / NEON versions with a scalar
+// fallback, and each of them has a constexpr scalar twin that gives the reference result.
+//
+// Conventions follow DirectXMath and D3D: row vectors multiplied on the left (v * M), the
+// translation lives in row 3, a left handed view space and clip space depth in [0, 1].
+// Mat4 is 16 floats in row order, the memory layout of an HLSL row_major float4x4, so it can
+// be copied into a constant buffer as is and used with mul(v, M). Vec3 matches float3 and Vec4
+// and Quat match float4; remember HLSL packing will not let a float3 straddle a 16 byte row.
+// This file is platform independent so the systems built on it can be profiled off Windows.
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define VECTOR_MATH_AVX2
+#define VECTOR_MATH_SSE
+#elif defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define VECTOR_MATH_SSE
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define VECTOR_MATH_NEON
+#endif
+
+struct Vec3
+{
+    float x, y, z;
+};
+
+struct alignas(16) Vec4
+{
+    float x, y, z, w;
+};
+
+// Unit quaternion, w is the scalar part
+struct alignas(16) Quat
+{
+    float x, y, z, w;
+};
+
+struct alignas(16) Mat4
+{
+    Vec4 r[4];
+};
+
+struct Aabb
+{
+    Vec3 min;
+    Vec3 max;
+};
+
+struct Sphere
+{
+    Vec3 center;
+    float radius;
+};
+
+// Planes are (a, b, c, d) with normals pointing inwards, a point is inside when a*x + b*y + c*z + d >= 0.
+// Order is left, right, bottom, top, near, far.
+struct Frustum
+{
+    Vec4 planes[6];
+};
+
+// Vec3
+
+constexpr Vec3 operator+(const Vec3 &a, const Vec3 &b) { return Vec3{ a.x + b.x, a.y + b.y, a.z + b.z }; }
+constexpr Vec3 operator-(const Vec3 &a, const Vec3 &b) { return Vec3{ a.x - b.x, a.y - b.y, a.z - b.z }; }
+constexpr Vec3 operator-(const Vec3 &a) { return Vec3{ -a.x, -a.y, -a.z }; }
+constexpr Vec3 operator*(const Vec3 &a, float s) { return Vec3{ a.x * s, a.y * s, a.z * s }; }
+constexpr Vec3 operator*(float s, const Vec3 &a) { return a * s; }
+constexpr Vec3 operator*(const Vec3 &a, const Vec3 &b) { return Vec3{ a.x * b.x, a.y * b.y, a.z * b.z }; }
+
+constexpr float dot(const Vec3 &a, const Vec3 &b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+constexpr Vec3 cross(const Vec3 &a, const Vec3 &b) { return Vec3{ a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+constexpr float lengthSquared(const Vec3 &a) { return dot(a, a); }
+constexpr Vec3 lerp(const Vec3 &a, const Vec3 &b, float t) { return a + (b - a) * t; }
+constexpr Vec3 minimum(const Vec3 &a, const Vec3 &b) { return Vec3{ a.x < b.x ? a.x : b.x, a.y < b.y ? a.y : b.y, a.z < b.z ? a.z : b.z }; }
+constexpr Vec3 maximum(const Vec3 &a, const Vec3 &b) { return Vec3{ a.x > b.x ? a.x : b.x, a.y > b.y ? a.y : b.y, a.z > b.z ? a.z : b.z }; }
+
+inline float length(const Vec3 &a) { return std::sqrt(lengthSquared(a)); }
+
+// Returns the zero vector unchanged
+inline Vec3 normalize(const Vec3 &a)
+{
+    const float lengthSq = lengthSquared(a);
+    return lengthSq > 0.0f ? a * (1.0f / std::sqrt(lengthSq)) : a;
+}
+
+// Vec4
+
+constexpr Vec4 operator+(const Vec4 &a, const Vec4 &b) { return Vec4{ a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w }; }
+constexpr Vec4 operator-(const Vec4 &a, const Vec4 &b) { return Vec4{ a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w }; }
+constexpr Vec4 operator*(const Vec4 &a, float s) { return Vec4{ a.x * s, a.y * s, a.z * s, a.w * s }; }
+constexpr Vec4 operator*(float s, const Vec4 &a) { return a * s; }
+
+constexpr float dot(const Vec4 &a, const Vec4 &b) { return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w; }
+constexpr Vec4 toVec4(const Vec3 &a, float w) { return Vec4{ a.x, a.y, a.z, w }; }
+constexpr Vec3 toVec3(const Vec4 &a) { return Vec3{ a.x, a.y, a.z }; }
+
+// Quat
+
+constexpr Quat identityQuat() { return Quat{ 0.0f, 0.0f, 0.0f, 1.0f }; }
+constexpr Quat conjugate(const Quat &q) { return Quat{ -q.x, -q.y, -q.z, q.w }; }
+constexpr float dot(const Quat &a, const Quat &b) { return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w; }
+
+// Hamilton product, the result rotates by b first and then by a
+constexpr Quat operator*(const Quat &a, const Quat &b)
+{
+    return Quat{
+        a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+        a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+        a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+        a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z };
+}
+
+constexpr Vec3 rotate(const Quat &q, const Vec3 &v)
+{
+    // v + 2w(u x v) + 2u x (u x v), with u the vector part
+    const Vec3 u{ q.x, q.y, q.z };
+    const Vec3 t = cross(u, v) * 2.0f;
+    return v + t * q.w + cross(u, t);
+}
+
+inline Quat normalize(const Quat &q)
+{
+    const float lengthSq = dot(q, q);
+    const float scale = lengthSq > 0.0f ? 1.0f / std::sqrt(lengthSq) : 0.0f;
+    return Quat{ q.x * scale, q.y * scale, q.z * scale, q.w * scale };
+}
+
+// Axis must be normalized, the angle is in radians
+inline Quat quatFromAxisAngle(const Vec3 &axis, float angle)
+{
+    const float s = std::sin(angle * 0.5f);
+    return Quat{ axis.x * s, axis.y * s, axis.z * s, std::cos(angle * 0.5f) };
+}
+
+// Normalized linear interpolation along the shorter arc, close enough to slerp for animation blending
+inline Quat nlerp(const Quat &a, const Quat &b, float t)
+{
+    const float sign = dot(a, b) < 0.0f ? -1.0f : 1.0f;
+    const float s = 1.0f - t;
+    return normalize(Quat{ a.x * s + b.x * t * sign, a.y * s + b.y * t * sign, a.z * s + b.z * t * sign, a.w * s + b.w * t * sign });
+}
+
+// Mat4, constexpr scalar versions
+
+constexpr Mat4 identityMatrix()
+{
+    return Mat4{ { { 1.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 1.0f } } };
+}
+
+constexpr Mat4 translationMatrix(const Vec3 &t)
+{
+    return Mat4{ { { 1.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f, 0.0f }, { t.x, t.y, t.z, 1.0f } } };
+}
+
+constexpr Mat4 scalingMatrix(const Vec3 &s)
+{
+    return Mat4{ { { s.x, 0.0f, 0.0f, 0.0f }, { 0.0f, s.y, 0.0f, 0.0f }, { 0.0f, 0.0f, s.z, 0.0f }, { 0.0f, 0.0f, 0.0f, 1.0f } } };
+}
+
+constexpr Mat4 rotationMatrix(const Quat &q)
+{
+    const float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+    const float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+    const float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+    return Mat4{ {
+        { 1.0f - 2.0f * (yy + zz), 2.0f * (xy + wz), 2.0f * (xz - wy), 0.0f },
+        { 2.0f * (xy - wz), 1.0f - 2.0f * (xx + zz), 2.0f * (yz + wx), 0.0f },
+        { 2.0f * (xz + wy), 2.0f * (yz - wx), 1.0f - 2.0f * (xx + yy), 0.0f },
+        { 0.0f, 0.0f, 0.0f, 1.0f } } };
+}
+
+// Scale, then rotate, then translate
+constexpr Mat4 affineMatrix(const Vec3 &scale, const Quat &rotation, const Vec3 &translation)
+{
+    Mat4 m = rotationMatrix(rotation);
+    m.r[0] = m.r[0] * scale.x;
+    m.r[1] = m.r[1] * scale.y;
+    m.r[2] = m.r[2] * scale.z;
+    m.r[3] = toVec4(translation, 1.0f);
+    return m;
+}
+
+constexpr Mat4 transpose(const Mat4 &m)
+{
+    return Mat4{ {
+        { m.r[0].x, m.r[1].x, m.r[2].x, m.r[3].x },
+        { m.r[0].y, m.r[1].y, m.r[2].y, m.r[3].y },
+        { m.r[0].z, m.r[1].z, m.r[2].z, m.r[3].z },
+        { m.r[0].w, m.r[1].w, m.r[2].w, m.r[3].w } } };
+}
+
+constexpr Vec4 transformScalar(const Vec4 &v, const Mat4 &m)
+{
+    return m.r[0] * v.x + m.r[1] * v.y + m.r[2] * v.z + m.r[3] * v.w;
+}
+
+// a * b applies a first, then b
+constexpr Mat4 multiplyScalar(const Mat4 &a, const Mat4 &b)
+{
+    return Mat4{ { transformScalar(a.r[0], b), transformScalar(a.r[1], b), transformScalar(a.r[2], b), transformScalar(a.r[3], b) } };
+}
+
+constexpr Vec3 transformPoint(const Vec3 &p, const Mat4 &m)
+{
+    return toVec3(m.r[0] * p.x + m.r[1] * p.y + m.r[2] * p.z + m.r[3]);
+}
+
+// Ignores the translation
+constexpr Vec3 transformDirection(const Vec3 &d, const Mat4 &m)
+{
+    return toVec3(m.r[0] * d.x + m.r[1] * d.y + m.r[2] * d.z);
+}
+
+constexpr float determinant(const Mat4 &m)
+{
+    const float s0 = m.r[0].x * m.r[1].y - m.r[1].x * m.r[0].y;
+    const float s1 = m.r[0].x * m.r[1].z - m.r[1].x * m.r[0].z;
+    const float s2 = m.r[0].x * m.r[1].w - m.r[1].x * m.r[0].w;
+    const float s3 = m.r[0].y * m.r[1].z - m.r[1].y * m.r[0].z;
+    const float s4 = m.r[0].y * m.r[1].w - m.r[1].y * m.r[0].w;
+    const float s5 = m.r[0].z * m.r[1].w - m.r[1].z * m.r[0].w;
+    const float c5 = m.r[2].z * m.r[3].w - m.r[3].z * m.r[2].w;
+    const float c4 = m.r[2].y * m.r[3].w - m.r[3].y * m.r[2].w;
+    const float c3 = m.r[2].y * m.r[3].z - m.r[3].y * m.r[2].z;
+    const float c2 = m.r[2].x * m.r[3].w - m.r[3].x * m.r[2].w;
+    const float c1 = m.r[2].x * m.r[3].z - m.r[3].x * m.r[2].z;
+    const float c0 = m.r[2].x * m.r[3].y - m.r[3].x * m.r[2].y;
+    return s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+}
+
+// General inverse by cofactors, a singular matrix returns all zeros
+constexpr Mat4 inverse(const Mat4 &m)
+{
+    const float s0 = m.r[0].x * m.r[1].y - m.r[1].x * m.r[0].y;
+    const float s1 = m.r[0].x * m.r[1].z - m.r[1].x * m.r[0].z;
+    const float s2 = m.r[0].x * m.r[1].w - m.r[1].x * m.r[0].w;
+    const float s3 = m.r[0].y * m.r[1].z - m.r[1].y * m.r[0].z;
+    const float s4 = m.r[0].y * m.r[1].w - m.r[1].y * m.r[0].w;
+    const float s5 = m.r[0].z * m.r[1].w - m.r[1].z * m.r[0].w;
+    const float c5 = m.r[2].z * m.r[3].w - m.r[3].z * m.r[2].w;
+    const float c4 = m.r[2].y * m.r[3].w - m.r[3].y * m.r[2].w;
+    const float c3 = m.r[2].y * m.r[3].z - m.r[3].y * m.r[2].z;
+    const float c2 = m.r[2].x * m.r[3].w - m.r[3].x * m.r[2].w;
+    const float c1 = m.r[2].x * m.r[3].z - m.r[3].x * m.r[2].z;
+    const float c0 = m.r[2].x * m.r[3].y - m.r[3].x * m.r[2].y;
+
+    const float det = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+    if (det == 0.0f)
+    {
+        return Mat4{};
+    }
+    const float d = 1.0f / det;
+
+    return Mat4{ {
+        { ( m.r[1].y * c5 - m.r[1].z * c4 + m.r[1].w * c3) * d,
+          (-m.r[0].y * c5 + m.r[0].z * c4 - m.r[0].w * c3) * d,
+          ( m.r[3].y * s5 - m.r[3].z * s4 + m.r[3].w * s3) * d,
+          (-m.r[2].y * s5 + m.r[2].z * s4 - m.r[2].w * s3) * d },
+        { (-m.r[1].x * c5 + m.r[1].z * c2 - m.r[1].w * c1) * d,
+          ( m.r[0].x * c5 - m.r[0].z * c2 + m.r[0].w * c1) * d,
+          (-m.r[3].x * s5 + m.r[3].z * s2 - m.r[3].w * s1) * d,
+          ( m.r[2].x * s5 - m.r[2].z * s2 + m.r[2].w * s1) * d },
+        { ( m.r[1].x * c4 - m.r[1].y * c2 + m.r[1].w * c0) * d,
+          (-m.r[0].x * c4 + m.r[0].y * c2 - m.r[0].w * c0) * d,
+          ( m.r[3].x * s4 - m.r[3].y * s2 + m.r[3].w * s0) * d,
+          (-m.r[2].x * s4 + m.r[2].y * s2 - m.r[2].w * s0) * d },
+        { (-m.r[1].x * c3 + m.r[1].y * c1 - m.r[1].z * c0) * d,
+          ( m.r[0].x * c3 - m.r[0].y * c1 + m.r[0].z * c0) * d,
+          (-m.r[3].x * s3 + m.r[3].y * s1 - m.r[3].z * s0) * d,
+          ( m.r[2].x * s3 - m.r[2].y * s1 + m.r[2].z * s0) * d } } };
+}
+
+// Left handed perspective projection with depth in [0, 1], the vertical field of view is in radians
+inline Mat4 perspectiveMatrix(float fovY, float aspect, float nearZ, float farZ)
+{
+    const float h = 1.0f / std::tan(fovY * 0.5f);
+    const float w = h / aspect;
+    const float range = farZ / (farZ - nearZ);
+    return Mat4{ { { w, 0.0f, 0.0f, 0.0f }, { 0.0f, h, 0.0f, 0.0f }, { 0.0f, 0.0f, range, 1.0f }, { 0.0f, 0.0f, -range * nearZ, 0.0f } } };
+}
+
+// Left handed view matrix looking from eye towards target
+inline Mat4 lookAtMatrix(const Vec3 &eye, const Vec3 &target, const Vec3 &up)
+{
+    const Vec3 z = normalize(target - eye);
+    const Vec3 x = normalize(cross(up, z));
+    const Vec3 y = cross(z, x);
+    return Mat4{ {
+        { x.x, y.x, z.x, 0.0f },
+        { x.y, y.y, z.y, 0.0f },
+        { x.z, y.z, z.z, 0.0f },
+        { -dot(x, eye), -dot(y, eye), -dot(z, eye), 1.0f } } };
+}
+
+// Mat4, SIMD versions of the hot paths
+
+inline Vec4 transform(const Vec4 &v, const Mat4 &m)
+{
+#if defined(VECTOR_MATH_SSE)
+    __m128 result = _mm_mul_ps(_mm_set1_ps(v.x), _mm_load_ps(&m.r[0].x));
+    result = _mm_add_ps(result, _mm_mul_ps(_mm_set1_ps(v.y), _mm_load_ps(&m.r[1].x)));
+    result = _mm_add_ps(result, _mm_mul_ps(_mm_set1_ps(v.z), _mm_load_ps(&m.r[2].x)));
+    result = _mm_add_ps(result, _mm_mul_ps(_mm_set1_ps(v.w), _mm_load_ps(&m.r[3].x)));
+    Vec4 out;
+    _mm_store_ps(&out.x, result);
+    return out;
+#elif defined(VECTOR_MATH_NEON)
+    float32x4_t result = vmulq_n_f32(vld1q_f32(&m.r[0].x), v.x);
+    result = vmlaq_n_f32(result, vld1q_f32(&m.r[1].x), v.y);
+    result = vmlaq_n_f32(result, vld1q_f32(&m.r[2].x), v.z);
+    result = vmlaq_n_f32(result, vld1q_f32(&m.r[3].x), v.w);
+    Vec4 out;
+    vst1q_f32(&out.x, result);
+    return out;
+#else
+    return transformScalar(v, m);
+#endif
+}
+
+// a * b applies a first, then b
+inline Mat4 multiply(const Mat4 &a, const Mat4 &b)
+{
+#if defined(VECTOR_MATH_AVX2)
+    // Two result rows per register, each half splats one row of a against the broadcast rows of b
+    const __m256 b0 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(&b.r[0]));
+    const __m256 b1 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(&b.r[1]));
+    const __m256 b2 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(&b.r[2]));
+    const __m256 b3 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(&b.r[3]));
+
+    Mat4 out;
+    for (int i = 0; i < 4; i += 2)
+    {
+        const __m256 rows = _mm256_loadu_ps(&a.r[i].x);
+        __m256 result = _mm256_mul_ps(_mm256_shuffle_ps(rows, rows, 0x00), b0);
+        result = _mm256_add_ps(result, _mm256_mul_ps(_mm256_shuffle_ps(rows, rows, 0x55), b1));
+        result = _mm256_add_ps(result, _mm256_mul_ps(_mm256_shuffle_ps(rows, rows, 0xAA), b2));
+        result = _mm256_add_ps(result, _mm256_mul_ps(_mm256_shuffle_ps(rows, rows, 0xFF), b3));
+        _mm256_storeu_ps(&out.r[i].x, result);
+    }
+    return out;
+#elif defined(VECTOR_MATH_SSE) || defined(VECTOR_MATH_NEON)
+    Mat4 out;
+    out.r[0] = transform(a.r[0], b);
+    out.r[1] = transform(a.r[1], b);
+    out.r[2] = transform(a.r[2], b);
+    out.r[3] = transform(a.r[3], b);
+    return out;
+#else
+    return multiplyScalar(a, b);
+#endif
+}
+
+// Batched kernels
+
+// out[i] = a[i] * b[i]. The output may alias either input.
+inline void multiplyMatrices(const Mat4 *a, const Mat4 *b, Mat4 *out, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        out[i] = multiply(a[i], b[i]);
+    }
+}
+
+// Transform points held as structure of arrays, (x, y, z, 1) * m. outW may be null when the
+// matrix is affine; pass it for projections and divide afterwards.
+inline void transformPoints(const Mat4 &m, const float *x, const float *y, const float *z, float *outX, float *outY, float *outZ, float *outW, size_t count)
+{
+    size_t i = 0;
+
+#if defined(VECTOR_MATH_AVX2)
+    const __m256 m00 = _mm256_set1_ps(m.r[0].x), m01 = _mm256_set1_ps(m.r[0].y), m02 = _mm256_set1_ps(m.r[0].z), m03 = _mm256_set1_ps(m.r[0].w);
+    const __m256 m10 = _mm256_set1_ps(m.r[1].x), m11 = _mm256_set1_ps(m.r[1].y), m12 = _mm256_set1_ps(m.r[1].z), m13 = _mm256_set1_ps(m.r[1].w);
+    const __m256 m20 = _mm256_set1_ps(m.r[2].x), m21 = _mm256_set1_ps(m.r[2].y), m22 = _mm256_set1_ps(m.r[2].z), m23 = _mm256_set1_ps(m.r[2].w);
+    const __m256 m30 = _mm256_set1_ps(m.r[3].x), m31 = _mm256_set1_ps(m.r[3].y), m32 = _mm256_set1_ps(m.r[3].z), m33 = _mm256_set1_ps(m.r[3].w);
+
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m256 px = _mm256_loadu_ps(x + i);
+        const __m256 py = _mm256_loadu_ps(y + i);
+        const __m256 pz = _mm256_loadu_ps(z + i);
+        _mm256_storeu_ps(outX + i, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px, m00), _mm256_mul_ps(py, m10)), _mm256_add_ps(_mm256_mul_ps(pz, m20), m30)));
+        _mm256_storeu_ps(outY + i, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px, m01), _mm256_mul_ps(py, m11)), _mm256_add_ps(_mm256_mul_ps(pz, m21), m31)));
+        _mm256_storeu_ps(outZ + i, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px, m02), _mm256_mul_ps(py, m12)), _mm256_add_ps(_mm256_mul_ps(pz, m22), m32)));
+        if (outW)
+        {
+            _mm256_storeu_ps(outW + i, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px, m03), _mm256_mul_ps(py, m13)), _mm256_add_ps(_mm256_mul_ps(pz, m23), m33)));
+        }
+    }
+#elif defined(VECTOR_MATH_SSE)
+    const __m128 m00 = _mm_set1_ps(m.r[0].x), m01 = _mm_set1_ps(m.r[0].y), m02 = _mm_set1_ps(m.r[0].z), m03 = _mm_set1_ps(m.r[0].w);
+    const __m128 m10 = _mm_set1_ps(m.r[1].x), m11 = _mm_set1_ps(m.r[1].y), m12 = _mm_set1_ps(m.r[1].z), m13 = _mm_set1_ps(m.r[1].w);
+    const __m128 m20 = _mm_set1_ps(m.r[2].x), m21 = _mm_set1_ps(m.r[2].y), m22 = _mm_set1_ps(m.r[2].z), m23 = _mm_set1_ps(m.r[2].w);
+    const __m128 m30 = _mm_set1_ps(m.r[3].x), m31 = _mm_set1_ps(m.r[3].y), m32 = _mm_set1_ps(m.r[3].z), m33 = _mm_set1_ps(m.r[3].w);
+
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m128 px = _mm_loadu_ps(x + i);
+        const __m128 py = _mm_loadu_ps(y + i);
+        const __m128 pz = _mm_loadu_ps(z + i);
+        _mm_storeu_ps(outX + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, m00), _mm_mul_ps(py, m10)), _mm_add_ps(_mm_mul_ps(pz, m20), m30)));
+        _mm_storeu_ps(outY + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, m01), _mm_mul_ps(py, m11)), _mm_add_ps(_mm_mul_ps(pz, m21), m31)));
+        _mm_storeu_ps(outZ + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, m02), _mm_mul_ps(py, m12)), _mm_add_ps(_mm_mul_ps(pz, m22), m32)));
+        if (outW)
+        {
+            _mm_storeu_ps(outW + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, m03), _mm_mul_ps(py, m13)), _mm_add_ps(_mm_mul_ps(pz, m23), m33)));
+        }
+    }
+#elif defined(VECTOR_MATH_NEON)
+    for (; i + 4 <= count; i += 4)
+    {
+        const float32x4_t px = vld1q_f32(x + i);
+        const float32x4_t py = vld1q_f32(y + i);
+        const float32x4_t pz = vld1q_f32(z + i);
+        vst1q_f32(outX + i, vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(vdupq_n_f32(m.r[3].x), px, m.r[0].x), py, m.r[1].x), pz, m.r[2].x));
+        vst1q_f32(outY + i, vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(vdupq_n_f32(m.r[3].y), px, m.r[0].y), py, m.r[1].y), pz, m.r[2].y));
+        vst1q_f32(outZ + i, vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(vdupq_n_f32(m.r[3].z), px, m.r[0].z), py, m.r[1].z), pz, m.r[2].z));
+        if (outW)
+        {
+            vst1q_f32(outW + i, vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(vdupq_n_f32(m.r[3].w), px, m.r[0].w), py, m.r[1].w), pz, m.r[2].w));
+        }
+    }
+#endif
+
+    for (; i < count; ++i)
+    {
+        outX[i] = x[i] * m.r[0].x + y[i] * m.r[1].x + (z[i] * m.r[2].x + m.r[3].x);
+        outY[i] = x[i] * m.r[0].y + y[i] * m.r[1].y + (z[i] * m.r[2].y + m.r[3].y);
+        outZ[i] = x[i] * m.r[0].z + y[i] * m.r[1].z + (z[i] * m.r[2].z + m.r[3].z);
+        if (outW)
+        {
+            outW[i] = x[i] * m.r[0].w + y[i] * m.r[1].w + (z[i] * m.r[2].w + m.r[3].w);
+        }
+    }
+}
+
+// Bounds
+
+// Box around the transformed box, from the transformed center and the absolute matrix applied to the extent
+constexpr Aabb transformAabb(const Aabb &box, const Mat4 &m)
+{
+    const Vec3 center = (box.min + box.max) * 0.5f;
+    const Vec3 extent = (box.max - box.min) * 0.5f;
+    const Vec3 newCenter = transformPoint(center, m);
+    const Vec3 newExtent{
+        extent.x * (m.r[0].x < 0.0f ? -m.r[0].x : m.r[0].x) + extent.y * (m.r[1].x < 0.0f ? -m.r[1].x : m.r[1].x) + extent.z * (m.r[2].x < 0.0f ? -m.r[2].x : m.r[2].x),
+        extent.x * (m.r[0].y < 0.0f ? -m.r[0].y : m.r[0].y) + extent.y * (m.r[1].y < 0.0f ? -m.r[1].y : m.r[1].y) + extent.z * (m.r[2].y < 0.0f ? -m.r[2].y : m.r[2].y),
+        extent.x * (m.r[0].z < 0.0f ? -m.r[0].z : m.r[0].z) + extent.y * (m.r[1].z < 0.0f ? -m.r[1].z : m.r[1].z) + extent.z * (m.r[2].z < 0.0f ? -m.r[2].z : m.r[2].z) };
+    return Aabb{ newCenter - newExtent, newCenter + newExtent };
+}
+
+constexpr Aabb mergeAabb(const Aabb &a, const Aabb &b)
+{
+    return Aabb{ minimum(a.min, b.min), maximum(a.max, b.max) };
+}
+
+// Planes of the clip volume -w <= x <= w, -w <= y <= w, 0 <= z <= w in the space the matrix maps from
+inline Frustum extractFrustum(const Mat4 &viewProjection)
+{
+    const Mat4 columns = transpose(viewProjection);
+
+    Frustum frustum;
+    frustum.planes[0] = columns.r[3] + columns.r[0];
+    frustum.planes[1] = columns.r[3] - columns.r[0];
+    frustum.planes[2] = columns.r[3] + columns.r[1];
+    frustum.planes[3] = columns.r[3] - columns.r[1];
+    frustum.planes[4] = columns.r[2];
+    frustum.planes[5] = columns.r[3] - columns.r[2];
+
+    // Normalized planes give true distances, which the sphere tests need
+    for (Vec4 &plane : frustum.planes)
+    {
+        plane = plane * (1.0f / length(toVec3(plane)));
+    }
+    return frustum;
+}
+
+// Conservative, boxes near a frustum corner can pass while being outside
+constexpr bool intersects(const Frustum &frustum, const Aabb &box)
+{
+    for (const Vec4 &plane : frustum.planes)
+    {
+        // The corner furthest along the plane normal
+        const Vec3 corner{ plane.x >= 0.0f ? box.max.x : box.min.x, plane.y >= 0.0f ? box.max.y : box.min.y, plane.z >= 0.0f ? box.max.z : box.min.z };
+        if (dot(toVec3(plane), corner) + plane.w < 0.0f)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+constexpr bool intersects(const Frustum &frustum, const Sphere &sphere)
+{
+    for (const Vec4 &plane : frustum.planes)
+    {
+        if (dot(toVec3(plane), sphere.center) + plane.w < -sphere.radius)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Test spheres held as structure of arrays, visible[i] is set to 1 or 0
+inline void cullSpheres(const Frustum &frustum, const float *x, const float *y, const float *z, const float *radius, uint8_t *visible, size_t count)
+{
+    size_t i = 0;
+
+#if defined(VECTOR_MATH_SSE)
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m128 px = _mm_loadu_ps(x + i);
+        const __m128 py = _mm_loadu_ps(y + i);
+        const __m128 pz = _mm_loadu_ps(z + i);
+        const __m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(radius + i));
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (const Vec4 &plane : frustum.planes)
+        {
+            __m128 distance = _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(plane.x)), _mm_mul_ps(py, _mm_set1_ps(plane.y)));
+            distance = _mm_add_ps(distance, _mm_add_ps(_mm_mul_ps(pz, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+        }
+
+        const int mask = _mm_movemask_ps(inside);
+        visible[i + 0] = static_cast<uint8_t>(mask & 1);
+        visible[i + 1] = static_cast<uint8_t>((mask >> 1) & 1);
+        visible[i + 2] = static_cast<uint8_t>((mask >> 2) & 1);
+        visible[i + 3] = static_cast<uint8_t>((mask >> 3) & 1);
+    }
+#elif defined(VECTOR_MATH_NEON)
+    for (; i + 4 <= count; i += 4)
+    {
+        const float32x4_t px = vld1q_f32(x + i);
+        const float32x4_t py = vld1q_f32(y + i);
+        const float32x4_t pz = vld1q_f32(z + i);
+        const float32x4_t negativeRadius = vnegq_f32(vld1q_f32(radius + i));
+
+        uint32x4_t inside = vdupq_n_u32(0xFFFFFFFFu);
+        for (const Vec4 &plane : frustum.planes)
+        {
+            const float32x4_t distance = vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(vdupq_n_f32(plane.w), px, plane.x), py, plane.y), pz, plane.z);
+            inside = vandq_u32(inside, vcgeq_f32(distance, negativeRadius));
+        }
+
+        visible[i + 0] = static_cast<uint8_t>(vgetq_lane_u32(inside, 0) & 1u);
+        visible[i + 1] = static_cast<uint8_t>(vgetq_lane_u32(inside, 1) & 1u);
+        visible[i + 2] = static_cast<uint8_t>(vgetq_lane_u32(inside, 2) & 1u);
+        visible[i + 3] = static_cast<uint8_t>(vgetq_lane_u32(inside, 3) & 1u);
+    }
+#endif
+
+    for (; i < count; ++i)
+    {
+        visible[i] = intersects(frustum, Sphere{ Vec3{ x[i], y[i], z[i] }, radius[i] }) ? 1u : 0u;
+    }
+}
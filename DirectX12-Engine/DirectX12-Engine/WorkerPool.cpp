@@ -0,0 +1,121 @@
+#include "WorkerPool.h"
+
+WorkerPool::WorkerPool(uint32_t threadCount)
+    : m_func(nullptr)
+    , m_nextIndex(0u)
+    , m_count(0u)
+    , m_pending(0u)
+    , m_generation(0u)
+    , m_quit(false)
+{
+    if (threadCount == 0u)
+    {
+        threadCount = std::thread::hardware_concurrency();
+    }
+
+    // The calling thread always participates so we spawn one less worker
+    for (uint32_t i = 1u; i < threadCount; ++i)
+    {
+        m_threads.emplace_back(&WorkerPool::workerLoop, this);
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_wakeCondition.notify_all();
+
+    for (std::thread &thread : m_threads)
+    {
+        thread.join();
+    }
+}
+
+void WorkerPool::parallelFor(uint32_t count, const std::function<void(uint32_t)> &func)
+{
+    if (count == 0u)
+    {
+        return;
+    }
+
+    if (m_threads.empty() || count == 1u)
+    {
+        for (uint32_t i = 0u; i < count; ++i)
+        {
+            func(i);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_func = &func;
+        m_nextIndex = 0u;
+        m_count = count;
+        m_pending = count;
+        ++m_generation;
+    }
+    m_wakeCondition.notify_all();
+
+    while (runOne())
+    {
+    }
+
+    // Wait for the indices picked up by the workers to finish
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_doneCondition.wait(lock, [this] { return m_pending == 0u; });
+    m_func = nullptr;
+}
+
+bool WorkerPool::runOne()
+{
+    const std::function<void(uint32_t)> *func;
+    uint32_t index;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_func == nullptr || m_nextIndex >= m_count)
+        {
+            return false;
+        }
+        func = m_func;
+        index = m_nextIndex++;
+    }
+
+    (*func)(index);
+
+    bool finished;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        finished = --m_pending == 0u;
+    }
+    if (finished)
+    {
+        m_doneCondition.notify_all();
+    }
+    return true;
+}
+
+void WorkerPool::workerLoop()
+{
+    uint64_t seenGeneration = 0u;
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wakeCondition.wait(lock, [&] { return m_quit || (m_generation != seenGeneration && m_func != nullptr); });
+            if (m_quit)
+            {
+                return;
+            }
+            seenGeneration = m_generation;
+        }
+
+        while (runOne())
+        {
+        }
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+// A small persistent pool of worker threads used by the CPU side systems
+// (occlusion rasterization, culling, baking tools) to split work into ranges.
+// This file is platform independent so it can be built and profiled off Windows.
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkerPool
+{
+public:
+    // A thread count of zero uses one worker per hardware thread
+    explicit WorkerPool(uint32_t threadCount = 0u);
+
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    uint32_t getThreadCount() const { return static_cast<uint32_t>(m_threads.size()) + 1u; }
+
+    // Invoke func(index) for every index in [0, count) and block until all have run.
+    // The calling thread takes part in the work, so a pool with no workers runs everything inline.
+    // Only one batch may be in flight at a time.
+    void parallelFor(uint32_t count, const std::function<void(uint32_t)> &func);
+
+private:
+    void workerLoop();
+    bool runOne();
+
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wakeCondition;
+    std::condition_variable m_doneCondition;
+
+    // State of the batch currently being executed, guarded by m_mutex
+    const std::function<void(uint32_t)> *m_func;
+    uint32_t m_nextIndex;
+    uint32_t m_count;
+    uint32_t m_pending;
+    uint64_t m_generation;
+    bool m_quit;
+};
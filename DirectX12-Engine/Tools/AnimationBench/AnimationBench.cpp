@@ -0,0 +1,501 @@
+// Skeletal animation check and benchmark.
+//
+// Builds a random skeleton with procedural walk and run clips, then checks that:
+//  - clip sampling, pose blending and skinning matrices match their reference paths bit for bit
+//  - the threaded AnimationSystem matches updateReference frame after frame
+//  - the polynomial slerp stays close to an exact slerp, and how far nlerp drifts from it
+//  - compressed clips stay within their tolerance of the raw clip at every frame
+// Then reports the compression ratio against the error over a range of tolerances, and how many
+// characters the reference, SIMD on one thread and SIMD on the pool evaluate per millisecond.
+//
+// Usage:
+//   AnimationBench [--characters <n>] [--joints <n>] [--jobs <n>] [--seed <n>]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "AnimationSystem.h"
+#include "WorkerPool.h"
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    double millisecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    struct Options
+    {
+        uint32_t characters = 1000u;
+        uint32_t joints = 64u;
+        uint32_t jobs = 0u;
+        uint32_t seed = 1u;
+    };
+
+    const float PiTimesTwo = 6.28318531f;
+    const float StepTime = 1.0f / 60.0f;
+
+    Vec3 randomDirection(std::mt19937 &random)
+    {
+        std::uniform_real_distribution<float> signedUnit(-1.0f, 1.0f);
+        Vec3 direction;
+        do
+        {
+            direction = Vec3{ signedUnit(random), signedUnit(random), signedUnit(random) };
+        } while (lengthSquared(direction) > 1.0f || lengthSquared(direction) < 1e-4f);
+        return normalize(direction);
+    }
+
+    // Mostly chains, like spines and limbs, with some branching. Bones are 5 to 25 cm long.
+    struct TestRig
+    {
+        Skeleton skeleton;
+        std::vector<JointTransform> bindPose;
+    };
+
+    TestRig makeRig(uint32_t jointCount, std::mt19937 &random)
+    {
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        TestRig rig;
+        rig.skeleton.parents.resize(jointCount);
+        rig.bindPose.resize(jointCount);
+        std::vector<Mat4> bindModel(jointCount);
+        for (uint32_t joint = 0u; joint < jointCount; ++joint)
+        {
+            const int32_t parent = joint == 0u ? -1 : unit(random) < 0.75f ? static_cast<int32_t>(joint) - 1 : static_cast<int32_t>(unit(random) * joint);
+            rig.skeleton.parents[joint] = parent;
+
+            JointTransform &bind = rig.bindPose[joint];
+            bind.rotation = quatFromAxisAngle(randomDirection(random), unit(random) * 0.5f);
+            bind.translation = joint == 0u ? Vec3{ 0.0f, 1.0f, 0.0f } : randomDirection(random) * (0.05f + unit(random) * 0.2f);
+            bind.scale = Vec3{ 1.0f, 1.0f, 1.0f };
+
+            const Mat4 local = affineMatrix(bind.scale, bind.rotation, bind.translation);
+            bindModel[joint] = parent < 0 ? local : multiply(local, bindModel[parent]);
+            rig.skeleton.inverseBindMatrices.push_back(inverse(bindModel[joint]));
+        }
+        return rig;
+    }
+
+    // Every joint swings around its bind rotation at a multiple of the cycle frequency, mostly by
+    // small angles as fingers and spines do. A fifth of the joints never move, the root travels
+    // and bobs and a few joints squash and stretch.
+    RawAnimationClip makeClip(const TestRig &rig, float cycleFrequency, float amplitude, float duration, std::mt19937 &random)
+    {
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        const uint32_t jointCount = static_cast<uint32_t>(rig.bindPose.size());
+
+        RawAnimationClip clip;
+        clip.sampleRate = 30.0f;
+        clip.frameCount = static_cast<uint32_t>(duration * clip.sampleRate) + 1u;
+        clip.jointCount = jointCount;
+        clip.frames.resize(static_cast<size_t>(clip.frameCount) * jointCount);
+
+        for (uint32_t joint = 0u; joint < jointCount; ++joint)
+        {
+            const Vec3 axis = randomDirection(random);
+            const float spread = unit(random);
+            const float jointAmplitude = unit(random) < 0.2f ? 0.0f : amplitude * spread * spread;
+            const float harmonic = static_cast<float>(1u + static_cast<uint32_t>(unit(random) * 2.0f));
+            const float phase = unit(random) * PiTimesTwo;
+            const bool stretches = unit(random) < 0.05f;
+
+            for (uint32_t frame = 0u; frame < clip.frameCount; ++frame)
+            {
+                const float time = static_cast<float>(frame) / clip.sampleRate;
+                const float wave = std::sin(PiTimesTwo * cycleFrequency * harmonic * time + phase);
+                JointTransform transform = rig.bindPose[joint];
+                transform.rotation = normalize(transform.rotation * quatFromAxisAngle(axis, jointAmplitude * wave));
+                if (joint == 0u)
+                {
+                    transform.translation = transform.translation + Vec3{ 0.0f, 0.05f * wave, 1.5f * time };
+                }
+                if (stretches)
+                {
+                    const float stretch = 1.0f + 0.1f * wave;
+                    transform.scale = Vec3{ 1.0f / std::sqrt(stretch), stretch, 1.0f / std::sqrt(stretch) };
+                }
+                clip.frames[static_cast<size_t>(frame) * jointCount + joint] = transform;
+            }
+        }
+        return clip;
+    }
+
+    // Model space joint positions from local transforms
+    void computeJointPositions(const Skeleton &skeleton, const JointTransform *locals, std::vector<Vec3> &positions)
+    {
+        std::vector<Mat4> model(skeleton.parents.size());
+        positions.resize(skeleton.parents.size());
+        for (size_t joint = 0u; joint < skeleton.parents.size(); ++joint)
+        {
+            const Mat4 local = affineMatrix(locals[joint].scale, locals[joint].rotation, locals[joint].translation);
+            model[joint] = skeleton.parents[joint] < 0 ? local : multiply(local, model[skeleton.parents[joint]]);
+            positions[joint] = toVec3(model[joint].r[3]);
+        }
+    }
+
+    bool samePose(const AnimationPose &a, const AnimationPose &b)
+    {
+        for (uint32_t stream = 0u; stream < AnimationPose::StreamCount; ++stream)
+        {
+            const AnimationPose::Stream s = static_cast<AnimationPose::Stream>(stream);
+            if (std::memcmp(a.getStream(s), b.getStream(s), a.getJointCount() * sizeof(float)) != 0)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    float rotationAngle(const Quat &a, const Quat &b)
+    {
+        const Quat delta = conjugate(normalize(b)) * normalize(a);
+        return 2.0f * std::atan2(std::sqrt(delta.x * delta.x + delta.y * delta.y + delta.z * delta.z), std::fabs(delta.w));
+    }
+
+    // Largest local rotation and translation error and model space position error over every frame
+    struct ClipError
+    {
+        float rotation = 0.0f;
+        float translation = 0.0f;
+        float scale = 0.0f;
+        float position = 0.0f;
+    };
+
+    ClipError measureClipError(const TestRig &rig, const RawAnimationClip &raw, const AnimationClip &clip)
+    {
+        const uint32_t jointCount = raw.jointCount;
+        std::vector<float> storage(AnimationPose::getStorageSize(jointCount));
+        AnimationPose pose(storage.data(), jointCount);
+        std::vector<JointTransform> sampled(jointCount);
+        std::vector<Vec3> expectedPositions;
+        std::vector<Vec3> positions;
+
+        ClipError error;
+        for (uint32_t frame = 0u; frame < raw.frameCount; ++frame)
+        {
+            clip.sample(static_cast<float>(frame) / raw.sampleRate, pose);
+            const JointTransform *expected = &raw.frames[static_cast<size_t>(frame) * jointCount];
+            for (uint32_t joint = 0u; joint < jointCount; ++joint)
+            {
+                sampled[joint] = pose.getJoint(joint);
+                error.rotation = (std::max)(error.rotation, rotationAngle(sampled[joint].rotation, expected[joint].rotation));
+                error.translation = (std::max)(error.translation, length(sampled[joint].translation - expected[joint].translation));
+                error.scale = (std::max)(error.scale, length(sampled[joint].scale - expected[joint].scale));
+            }
+
+            computeJointPositions(rig.skeleton, expected, expectedPositions);
+            computeJointPositions(rig.skeleton, sampled.data(), positions);
+            for (uint32_t joint = 0u; joint < jointCount; ++joint)
+            {
+                error.position = (std::max)(error.position, length(positions[joint] - expectedPositions[joint]));
+            }
+        }
+        return error;
+    }
+
+    // Slerp in double precision from the angle
+    Quat exactSlerp(const Quat &a, const Quat &b, float t)
+    {
+        double cosine = static_cast<double>(dot(a, b));
+        const double sign = cosine < 0.0 ? -1.0 : 1.0;
+        cosine = (std::min)(cosine * sign, 1.0);
+        const double angle = std::acos(cosine);
+        const double sine = std::sin(angle);
+        const double aFactor = sine > 1e-12 ? std::sin((1.0 - t) * angle) / sine : 1.0 - t;
+        const double bFactor = (sine > 1e-12 ? std::sin(t * angle) / sine : t) * sign;
+        return Quat{ static_cast<float>(a.x * aFactor + b.x * bFactor), static_cast<float>(a.y * aFactor + b.y * bFactor),
+            static_cast<float>(a.z * aFactor + b.z * bFactor), static_cast<float>(a.w * aFactor + b.w * bFactor) };
+    }
+
+    struct TestScene
+    {
+        TestRig rig;
+        RawAnimationClip rawClips[2];
+        AnimationClip clips[2];
+    };
+
+    void addCharacters(const TestScene &scene, uint32_t count, QuatBlend mode, uint32_t seed, AnimationSystem &system)
+    {
+        std::mt19937 random(seed);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        for (uint32_t i = 0u; i < count; ++i)
+        {
+            AnimationCharacter character;
+            character.skeleton = &scene.rig.skeleton;
+            character.clips[0] = &scene.clips[0];
+            character.clips[1] = &scene.clips[1];
+            character.times[0] = unit(random) * scene.clips[0].getDuration();
+            character.times[1] = unit(random) * scene.clips[1].getDuration();
+            character.speeds[0] = 0.8f + unit(random) * 0.4f;
+            character.speeds[1] = 0.8f + unit(random) * 0.4f;
+            character.blendWeight = unit(random);
+            character.blendMode = mode;
+            system.addCharacter(character);
+        }
+    }
+
+    bool check(const Options &options, const TestScene &scene, WorkerPool &workerPool)
+    {
+        bool passed = true;
+        auto report = [&passed](bool condition, const std::string &what)
+        {
+            std::cout << std::left << std::setw(56) << what << (condition ? "ok" : "FAILED") << "\n";
+            passed = passed && condition;
+        };
+
+        const uint32_t jointCount = options.joints;
+        std::mt19937 random(options.seed + 1u);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+        std::vector<float> storage[4];
+        for (std::vector<float> &poseStorage : storage)
+        {
+            poseStorage.resize(AnimationPose::getStorageSize(jointCount));
+        }
+        AnimationPose a(storage[0].data(), jointCount);
+        AnimationPose b(storage[1].data(), jointCount);
+        AnimationPose expected(storage[2].data(), jointCount);
+        AnimationPose actual(storage[3].data(), jointCount);
+
+        bool sampleMatches = true;
+        bool blendMatches = true;
+        bool skinningMatches = true;
+        std::vector<Mat4> expectedMatrices(jointCount);
+        std::vector<Mat4> actualMatrices(jointCount);
+        for (uint32_t i = 0u; i < 500u; ++i)
+        {
+            const float timeA = unit(random) * 1.2f * scene.clips[0].getDuration() - 0.1f;
+            const float timeB = unit(random) * scene.clips[1].getDuration();
+            scene.clips[0].sampleReference(timeA, expected);
+            scene.clips[0].sample(timeA, actual);
+            sampleMatches = sampleMatches && samePose(expected, actual);
+
+            scene.clips[0].sample(timeA, a);
+            scene.clips[1].sample(timeB, b);
+            const float weight = unit(random);
+            const QuatBlend mode = (i & 1u) != 0u ? QuatBlend::Slerp : QuatBlend::Nlerp;
+            blendPosesReference(a, b, weight, mode, expected);
+            blendPoses(a, b, weight, mode, actual);
+            blendMatches = blendMatches && samePose(expected, actual);
+
+            computeSkinningMatricesReference(scene.rig.skeleton, actual, expectedMatrices.data());
+            computeSkinningMatrices(scene.rig.skeleton, actual, actualMatrices.data());
+            skinningMatches = skinningMatches && std::memcmp(expectedMatrices.data(), actualMatrices.data(), jointCount * sizeof(Mat4)) == 0;
+        }
+        report(sampleMatches, "clip sampling matches the reference");
+        report(blendMatches, "nlerp and slerp blending match the reference");
+        report(skinningMatches, "skinning matrices match the reference");
+
+        // A blend that aliases its input
+        {
+            scene.clips[0].sample(0.3f, a);
+            scene.clips[1].sample(0.7f, b);
+            blendPoses(a, b, 0.4f, QuatBlend::Slerp, expected);
+            blendPoses(a, b, 0.4f, QuatBlend::Slerp, a);
+            report(samePose(expected, a), "blending in place matches");
+        }
+
+        {
+            AnimationSystem reference;
+            AnimationSystem threaded;
+            addCharacters(scene, 97u, QuatBlend::Nlerp, options.seed, reference);
+            addCharacters(scene, 97u, QuatBlend::Slerp, options.seed + 1u, reference);
+            addCharacters(scene, 97u, QuatBlend::Nlerp, options.seed, threaded);
+            addCharacters(scene, 97u, QuatBlend::Slerp, options.seed + 1u, threaded);
+            bool matches = true;
+            for (uint32_t frame = 0u; frame < 60u; ++frame)
+            {
+                reference.updateReference(StepTime);
+                threaded.update(StepTime, &workerPool);
+                matches = matches && std::memcmp(reference.getSkinningMatrices().data(), threaded.getSkinningMatrices().data(),
+                    reference.getSkinningMatrices().size() * sizeof(Mat4)) == 0;
+            }
+            report(matches, "threaded characters match the reference");
+        }
+
+        // Slerp against the exact one over every angle, nlerp for comparison
+        {
+            float slerpError = 0.0f;
+            float nlerpError = 0.0f;
+            std::vector<float> pairStorage[3];
+            for (std::vector<float> &poseStorage : pairStorage)
+            {
+                poseStorage.resize(AnimationPose::getStorageSize(1024u));
+            }
+            AnimationPose from(pairStorage[0].data(), 1024u);
+            AnimationPose to(pairStorage[1].data(), 1024u);
+            AnimationPose blended(pairStorage[2].data(), 1024u);
+            std::vector<Quat> fromRotations(1024u);
+            std::vector<Quat> toRotations(1024u);
+            for (uint32_t i = 0u; i < 1024u; ++i)
+            {
+                fromRotations[i] = quatFromAxisAngle(randomDirection(random), unit(random) * PiTimesTwo);
+                toRotations[i] = quatFromAxisAngle(randomDirection(random), unit(random) * PiTimesTwo);
+                from.setJoint(i, JointTransform{ fromRotations[i], Vec3{}, Vec3{ 1.0f, 1.0f, 1.0f } });
+                to.setJoint(i, JointTransform{ toRotations[i], Vec3{}, Vec3{ 1.0f, 1.0f, 1.0f } });
+            }
+            for (uint32_t step = 0u; step <= 16u; ++step)
+            {
+                const float t = static_cast<float>(step) / 16.0f;
+                blendPoses(from, to, t, QuatBlend::Slerp, blended);
+                for (uint32_t i = 0u; i < 1024u; ++i)
+                {
+                    slerpError = (std::max)(slerpError, rotationAngle(blended.getJoint(i).rotation, exactSlerp(fromRotations[i], toRotations[i], t)));
+                }
+                blendPoses(from, to, t, QuatBlend::Nlerp, blended);
+                for (uint32_t i = 0u; i < 1024u; ++i)
+                {
+                    nlerpError = (std::max)(nlerpError, rotationAngle(blended.getJoint(i).rotation, exactSlerp(fromRotations[i], toRotations[i], t)));
+                }
+            }
+            report(slerpError < 1e-3f, "slerp within 1e-3 rad of exact (" + std::to_string(slerpError) + ")");
+            std::cout << "  nlerp is up to " << nlerpError << " rad from exact slerp\n";
+        }
+
+        // The default tolerances hold at every frame, allowing for quantization and float rounding
+        {
+            const AnimationCompressionSettings settings;
+            bool withinTolerance = true;
+            for (uint32_t i = 0u; i < 2u; ++i)
+            {
+                const ClipError error = measureClipError(scene.rig, scene.rawClips[i], scene.clips[i]);
+                withinTolerance = withinTolerance && error.rotation <= settings.rotationTolerance * 1.01f + 1e-4f &&
+                    error.translation <= settings.translationTolerance * 1.01f + 1e-4f && error.scale <= settings.scaleTolerance * 1.01f + 1e-4f;
+            }
+            report(withinTolerance, "compressed clips within tolerance at every frame");
+        }
+
+        std::cout << "\n";
+        return passed;
+    }
+
+    void reportCompression(const TestScene &scene)
+    {
+        const size_t rawSize = scene.rawClips[0].frames.size() * sizeof(JointTransform);
+        std::cout << "Compression of a " << scene.rawClips[0].frameCount << " frame clip, " << rawSize / 1024u << " KiB raw\n";
+        std::cout << std::left << std::setw(12) << "Tolerance" << std::right << std::setw(8) << "Keys" << std::setw(12) << "Bytes" << std::setw(9) << "Ratio"
+                  << std::setw(16) << "Rotation rad" << std::setw(16) << "Translation" << std::setw(18) << "Joint position" << "\n";
+
+        const float tolerances[] = { 0.0001f, 0.0005f, 0.001f, 0.002f, 0.005f, 0.01f };
+        for (float tolerance : tolerances)
+        {
+            AnimationCompressionSettings settings;
+            settings.rotationTolerance = tolerance;
+            settings.translationTolerance = tolerance;
+            settings.scaleTolerance = tolerance;
+            const AnimationClip clip(scene.rawClips[0], settings);
+            const ClipError error = measureClipError(scene.rig, scene.rawClips[0], clip);
+
+            std::cout << std::left << std::setw(12) << tolerance << std::right << std::setw(8) << clip.getKeyCount() << std::setw(12) << clip.getCompressedSize()
+                      << std::fixed << std::setprecision(1) << std::setw(8) << static_cast<double>(rawSize) / clip.getCompressedSize() << "x"
+                      << std::scientific << std::setprecision(2) << std::setw(16) << error.rotation << std::setw(16) << error.translation
+                      << std::setw(18) << error.position << "\n";
+            std::cout << std::defaultfloat;
+        }
+        std::cout << "\n";
+    }
+
+    // Characters evaluated per millisecond
+    template<typename Update>
+    double measure(const TestScene &scene, const Options &options, QuatBlend mode, Update update)
+    {
+        AnimationSystem system;
+        addCharacters(scene, options.characters, mode, options.seed, system);
+        update(system);
+
+        uint64_t evaluated = 0u;
+        const Clock::time_point start = Clock::now();
+        do
+        {
+            update(system);
+            evaluated += system.getCharacterCount();
+        } while (millisecondsSince(start) < 200.0);
+        return static_cast<double>(evaluated) / millisecondsSince(start);
+    }
+
+    void benchmark(const TestScene &scene, const Options &options, WorkerPool &workerPool)
+    {
+        std::cout << options.characters << " characters of " << options.joints << " joints, two clips blended\n";
+        std::cout << std::left << std::setw(8) << "Blend" << std::right << std::setw(14) << "Reference" << std::setw(14) << "SIMD"
+                  << std::setw(14) << "Threaded" << std::setw(10) << "Speedup" << "   characters/ms\n";
+        std::cout << std::fixed << std::setprecision(0);
+        const QuatBlend modes[] = { QuatBlend::Nlerp, QuatBlend::Slerp };
+        for (QuatBlend mode : modes)
+        {
+            const double reference = measure(scene, options, mode, [](AnimationSystem &system) { system.updateReference(StepTime); });
+            const double simd = measure(scene, options, mode, [](AnimationSystem &system) { system.update(StepTime, nullptr); });
+            const double threaded = measure(scene, options, mode, [&workerPool](AnimationSystem &system) { system.update(StepTime, &workerPool); });
+            std::cout << std::left << std::setw(8) << (mode == QuatBlend::Nlerp ? "nlerp" : "slerp") << std::right << std::setw(14) << reference
+                      << std::setw(14) << simd << std::setw(14) << threaded << std::setprecision(1) << std::setw(9) << threaded / reference << "x\n"
+                      << std::setprecision(0);
+        }
+        std::cout << std::flush;
+    }
+
+    bool parseArguments(int argc, char **argv, Options &options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string argument = argv[i];
+            const bool hasValue = i + 1 < argc;
+
+            if (argument == "--characters" && hasValue)
+            {
+                options.characters = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (argument == "--joints" && hasValue)
+            {
+                options.joints = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (argument == "--jobs" && hasValue)
+            {
+                options.jobs = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (argument == "--seed" && hasValue)
+            {
+                options.seed = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else
+            {
+                return false;
+            }
+        }
+        return options.characters > 0u && options.joints > 0u;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseArguments(argc, argv, options))
+    {
+        std::cerr << "Usage: AnimationBench [--characters <n>] [--joints <n>] [--jobs <n>] [--seed <n>]" << std::endl;
+        return 1;
+    }
+
+    WorkerPool workerPool(options.jobs);
+    std::cout << "Threads: " << workerPool.getThreadCount() << "\n\n";
+
+    std::mt19937 random(options.seed);
+    TestScene scene;
+    scene.rig = makeRig(options.joints, random);
+    scene.rawClips[0] = makeClip(scene.rig, 1.0f, 0.4f, 4.0f, random);  // Walk
+    scene.rawClips[1] = makeClip(scene.rig, 1.6f, 0.8f, 2.5f, random);  // Run
+    scene.clips[0] = AnimationClip(scene.rawClips[0], AnimationCompressionSettings());
+    scene.clips[1] = AnimationClip(scene.rawClips[1], AnimationCompressionSettings());
+
+    const bool passed = check(options, scene, workerPool);
+    reportCompression(scene);
+    benchmark(scene, options, workerPool);
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,440 @@
+// AsyncFileReader check and benchmark.
+//
+// Writes a file whose every byte is a function of its offset and checks that:
+//  - random ranges come back intact, whether they were split into several reads or shared one,
+//    and a size of zero reads to the end of the file
+//  - ranges past the end and missing files fail, and the decompression step runs on the data and
+//    fails the request when it returns false
+//  - critical requests overtake low priority ones already queued, and a queued request can be
+//    cancelled and still gets its callback
+//  - the stats account for every request once
+// Then sweeps the queue depth for small random, larger random and sequential requests and reports
+// the throughput with the median and 99th percentile latency from submission to callback. The file
+// is in the page cache after it is written, point --dir at another drive or drop the cache between
+// runs to see the device instead.
+//
+// Usage:
+//   AsyncFileReaderBench [--depth <n>...] [--file-mb <n>] [--seed <n>] [--dir <path>]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "AsyncFileReader.h"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    double millisecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    struct Options
+    {
+        std::vector<uint32_t> depths;
+        uint32_t fileMegabytes = 64u;
+        uint32_t seed = 1u;
+        fs::path directory;
+    };
+
+    uint8_t patternByte(uint64_t offset)
+    {
+        return static_cast<uint8_t>((offset * 2654435761u) >> 13);
+    }
+
+    bool matchesPattern(const std::vector<uint8_t> &data, uint64_t offset)
+    {
+        for (size_t i = 0; i < data.size(); ++i)
+        {
+            if (data[i] != patternByte(offset + i))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool writeTestFile(const fs::path &path, uint64_t size)
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        std::vector<uint8_t> block(1u << 20);
+        for (uint64_t offset = 0u; offset < size; offset += block.size())
+        {
+            const size_t count = static_cast<size_t>((std::min)(static_cast<uint64_t>(block.size()), size - offset));
+            for (size_t i = 0; i < count; ++i)
+            {
+                block[i] = patternByte(offset + i);
+            }
+            file.write(reinterpret_cast<const char *>(block.data()), static_cast<std::streamsize>(count));
+        }
+        return static_cast<bool>(file);
+    }
+
+    // Collects what the callbacks report, in the order they ran
+    struct Results
+    {
+        struct Result
+        {
+            AsyncFileReader::RequestId id;
+            AsyncFileReader::Status status;
+            bool intact;
+        };
+
+        std::mutex mutex;
+        std::vector<Result> results;
+        std::vector<uint64_t> offsets; // Indexed by request id, where the data should have come from
+
+        AsyncFileReader::CompletionFunction callback()
+        {
+            return [this](AsyncFileReader::RequestId id, AsyncFileReader::Status status, std::vector<uint8_t> &data)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                const bool intact = status == AsyncFileReader::Status::Completed && id < offsets.size() && matchesPattern(data, offsets[id]);
+                results.push_back({ id, status, intact });
+            };
+        }
+
+        const Result *find(AsyncFileReader::RequestId id) const
+        {
+            for (const Result &result : results)
+            {
+                if (result.id == id)
+                {
+                    return &result;
+                }
+            }
+            return nullptr;
+        }
+    };
+
+    // The ids are only known once submit returns, holding the lock keeps the callbacks waiting until
+    // the offsets they check against are in place
+    std::vector<AsyncFileReader::RequestId> submit(AsyncFileReader &reader, std::vector<AsyncFileReader::Request> batch, const std::vector<uint64_t> &offsets, Results &results)
+    {
+        std::lock_guard<std::mutex> lock(results.mutex);
+        const std::vector<AsyncFileReader::RequestId> ids = reader.submit(std::move(batch));
+        for (size_t i = 0; i < ids.size(); ++i)
+        {
+            results.offsets.resize((std::max)(results.offsets.size(), static_cast<size_t>(ids[i] + 1u)));
+            results.offsets[ids[i]] = offsets[i];
+        }
+        return ids;
+    }
+
+    AsyncFileReader::Request makeRequest(const fs::path &path, uint64_t offset, uint64_t size, Results &results)
+    {
+        AsyncFileReader::Request request;
+        request.path = path;
+        request.offset = offset;
+        request.size = size;
+        request.onComplete = results.callback();
+        return request;
+    }
+
+    bool check(const fs::path &path, uint64_t fileSize, uint32_t seed)
+    {
+        bool passed = true;
+        auto report = [&passed](bool condition, const std::string &what)
+        {
+            std::cout << std::left << std::setw(64) << what << (condition ? "ok" : "FAILED") << "\n";
+            passed = passed && condition;
+        };
+
+        std::mt19937 random(seed);
+
+        // Small reads so the larger requests are split, neighbours close enough to share reads
+        {
+            AsyncFileReader::Settings settings;
+            settings.queueDepth = 8u;
+            settings.maxReadSize = 64u << 10;
+            AsyncFileReader reader(settings);
+            Results results;
+
+            std::vector<AsyncFileReader::Request> batch;
+            std::vector<uint64_t> offsets;
+            for (uint32_t i = 0; i < 200u; ++i)
+            {
+                const uint64_t size = std::uniform_int_distribution<uint64_t>(1u, 300u << 10)(random);
+                const uint64_t offset = std::uniform_int_distribution<uint64_t>(0u, fileSize - size)(random);
+                batch.push_back(makeRequest(path, offset, size, results));
+                offsets.push_back(offset);
+            }
+            for (uint32_t i = 0; i < 16u; ++i)
+            {
+                batch.push_back(makeRequest(path, fileSize / 2u + i * 4096u, 4096u, results));
+                offsets.push_back(fileSize / 2u + i * 4096u);
+            }
+            batch.push_back(makeRequest(path, fileSize - 1000u, 0u, results));
+            offsets.push_back(fileSize - 1000u);
+
+            const std::vector<AsyncFileReader::RequestId> ids = submit(reader, std::move(batch), offsets, results);
+            reader.waitIdle();
+
+            const bool allIntact = results.results.size() == ids.size()
+                && std::all_of(results.results.begin(), results.results.end(), [](const Results::Result &result) { return result.intact; });
+            const AsyncFileReader::Stats stats = reader.getStats();
+            report(allIntact, std::to_string(ids.size()) + " random ranges come back intact");
+            report(stats.coalescedRequests > 0u && stats.maxReadsInFlight > 1u && stats.maxReadsInFlight <= settings.queueDepth,
+                "reads were shared and split, at most " + std::to_string(stats.maxReadsInFlight) + " in flight");
+            const Results::Result *tail = results.find(ids.back());
+            report(tail != nullptr && tail->intact, "a size of zero reads to the end of the file");
+        }
+
+        // Failures and the decompression step
+        {
+            AsyncFileReader reader;
+            Results results;
+            const AsyncFileReader::RequestId pastEnd = reader.submit(makeRequest(path, fileSize - 10u, 100u, results));
+            const AsyncFileReader::RequestId missing = reader.submit(makeRequest(path.string() + ".missing", 0u, 16u, results));
+
+            std::atomic<uint32_t> decompressed(0u);
+            AsyncFileReader::Request inverted = makeRequest(path, 4096u, 4096u, results);
+            inverted.decompress = [&decompressed](std::vector<uint8_t> &data)
+            {
+                for (uint8_t &value : data)
+                {
+                    value = static_cast<uint8_t>(~value);
+                }
+                data.push_back(0u);
+                ++decompressed;
+                return true;
+            };
+            std::vector<uint8_t> invertedData;
+            inverted.onComplete = [&invertedData](AsyncFileReader::RequestId, AsyncFileReader::Status status, std::vector<uint8_t> &data)
+            {
+                if (status == AsyncFileReader::Status::Completed)
+                {
+                    invertedData = std::move(data);
+                }
+            };
+            reader.submit(std::move(inverted));
+
+            AsyncFileReader::Request corrupt = makeRequest(path, 8192u, 4096u, results);
+            corrupt.decompress = [](std::vector<uint8_t> &) { return false; };
+            const AsyncFileReader::RequestId corruptId = reader.submit(std::move(corrupt));
+            reader.waitIdle();
+
+            auto failed = [&results](AsyncFileReader::RequestId id)
+            {
+                const Results::Result *result = results.find(id);
+                return result != nullptr && result->status == AsyncFileReader::Status::Failed;
+            };
+            report(failed(pastEnd) && failed(missing), "ranges past the end and missing files fail");
+
+            bool inverts = invertedData.size() == 4097u && invertedData.back() == 0u;
+            for (size_t i = 0; inverts && i < 4096u; ++i)
+            {
+                inverts = invertedData[i] == static_cast<uint8_t>(~patternByte(4096u + i));
+            }
+            report(inverts && decompressed.load() == 1u, "decompression runs once on the data before the callback");
+            report(failed(corruptId), "a failed decompression fails the request");
+        }
+
+        // One read at a time and no shared reads, so the queue order is what decides. The I/O thread
+        // is already reading the low requests while the critical ones are submitted.
+        {
+            const uint32_t lowCount = 256u;
+            AsyncFileReader::Settings settings;
+            settings.queueDepth = 1u;
+            settings.coalesceGap = 0u;
+            settings.workerThreads = 1u;
+            AsyncFileReader reader(settings);
+            Results results;
+
+            const uint64_t spacing = fileSize / (lowCount + 4u);
+            std::vector<AsyncFileReader::Request> low;
+            std::vector<uint64_t> lowOffsets;
+            for (uint32_t i = 0; i < lowCount; ++i)
+            {
+                low.push_back(makeRequest(path, i * spacing, 4096u, results));
+                low.back().priority = AsyncFileReader::Priority::Low;
+                lowOffsets.push_back(i * spacing);
+            }
+            std::vector<AsyncFileReader::Request> critical;
+            std::vector<uint64_t> criticalOffsets;
+            for (uint32_t i = 0; i < 4u; ++i)
+            {
+                critical.push_back(makeRequest(path, (lowCount + i) * spacing, 4096u, results));
+                critical.back().priority = AsyncFileReader::Priority::Critical;
+                criticalOffsets.push_back((lowCount + i) * spacing);
+            }
+
+            const std::vector<AsyncFileReader::RequestId> lowIds = submit(reader, std::move(low), lowOffsets, results);
+            const std::vector<AsyncFileReader::RequestId> criticalIds = submit(reader, std::move(critical), criticalOffsets, results);
+            const bool cancelled = reader.cancel(lowIds.back());
+            reader.waitIdle();
+
+            size_t lastCritical = 0u;
+            for (size_t i = 0; i < results.results.size(); ++i)
+            {
+                if (std::find(criticalIds.begin(), criticalIds.end(), results.results[i].id) != criticalIds.end())
+                {
+                    lastCritical = i;
+                }
+            }
+            report(lastCritical < lowCount / 4u, "critical requests overtake queued low ones, last at " + std::to_string(lastCritical));
+
+            const Results::Result *cancelledResult = results.find(lowIds.back());
+            report(cancelled && cancelledResult != nullptr && cancelledResult->status == AsyncFileReader::Status::Cancelled,
+                "a cancelled request still gets its callback");
+
+            const AsyncFileReader::Stats stats = reader.getStats();
+            report(stats.submittedRequests == lowCount + 4u && stats.completedRequests == lowCount + 3u && stats.cancelledRequests == 1u
+                && stats.failedRequests == 0u && results.results.size() == lowCount + 4u, "the stats count every request once");
+        }
+
+        std::cout << "\n";
+        return passed;
+    }
+
+    struct Workload
+    {
+        const char *name;
+        uint64_t requestSize;
+        bool sequential;
+    };
+
+    // Requests submitted at once. Small random ones stay far enough apart that few share a read.
+    const uint32_t BatchSize = 128u;
+
+    void benchmark(const Options &options, const fs::path &path, uint64_t fileSize)
+    {
+        const Workload workloads[] =
+        {
+            { "Random 4 KB", 4u << 10, false },
+            { "Random 64 KB", 64u << 10, false },
+            { "Sequential 1 MB", 1u << 20, true },
+        };
+
+        std::cout << std::left << std::setw(20) << "Workload" << std::right << std::setw(8) << "Depth" << std::setw(12) << "MB/s"
+                  << std::setw(14) << "Reads/req" << std::setw(12) << "p50 ms" << std::setw(12) << "p99 ms" << "\n";
+        std::cout << std::fixed;
+
+        for (const Workload &workload : workloads)
+        {
+            for (const uint32_t depth : options.depths)
+            {
+                AsyncFileReader::Settings settings;
+                settings.queueDepth = depth;
+                AsyncFileReader reader(settings);
+                std::mt19937 random(options.seed);
+
+                uint64_t requestedBytes = 0u;
+                uint64_t sequentialOffset = 0u;
+                const Clock::time_point start = Clock::now();
+                do
+                {
+                    std::vector<AsyncFileReader::Request> batch(BatchSize);
+                    for (AsyncFileReader::Request &request : batch)
+                    {
+                        request.path = path;
+                        request.size = workload.requestSize;
+                        if (workload.sequential)
+                        {
+                            sequentialOffset = sequentialOffset + workload.requestSize > fileSize ? 0u : sequentialOffset;
+                            request.offset = sequentialOffset;
+                            sequentialOffset += workload.requestSize;
+                        }
+                        else
+                        {
+                            request.offset = std::uniform_int_distribution<uint64_t>(0u, (fileSize - workload.requestSize) / 4096u)(random) * 4096u;
+                        }
+                        request.onComplete = [](AsyncFileReader::RequestId, AsyncFileReader::Status, std::vector<uint8_t> &) {};
+                        requestedBytes += workload.requestSize;
+                    }
+                    reader.submit(std::move(batch));
+                    reader.waitIdle();
+                } while (millisecondsSince(start) < 300.0);
+                const double seconds = millisecondsSince(start) / 1000.0;
+
+                const AsyncFileReader::Stats stats = reader.getStats();
+                std::cout << std::left << std::setw(20) << workload.name << std::right << std::setw(8) << depth
+                          << std::setprecision(0) << std::setw(12) << requestedBytes / (1024.0 * 1024.0) / seconds
+                          << std::setprecision(2) << std::setw(14) << static_cast<double>(stats.reads) / (std::max)(stats.completedRequests, uint64_t(1u))
+                          << std::setprecision(3) << std::setw(12) << stats.medianLatencyMs << std::setw(12) << stats.p99LatencyMs << "\n";
+            }
+        }
+        std::cout << std::flush;
+    }
+
+    bool parseArguments(int argc, char **argv, Options &options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string argument = argv[i];
+            const bool hasValue = i + 1 < argc;
+
+            if (argument == "--depth" && hasValue)
+            {
+                options.depths.push_back(static_cast<uint32_t>(std::stoul(argv[++i])));
+            }
+            else if (argument == "--file-mb" && hasValue)
+            {
+                options.fileMegabytes = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (argument == "--seed" && hasValue)
+            {
+                options.seed = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (argument == "--dir" && hasValue)
+            {
+                options.directory = argv[++i];
+            }
+            else
+            {
+                return false;
+            }
+        }
+
+        if (options.depths.empty())
+        {
+            options.depths = { 1u, 2u, 4u, 8u, 16u, 32u, 64u };
+        }
+        return options.fileMegabytes >= 4u && std::all_of(options.depths.begin(), options.depths.end(), [](uint32_t depth) { return depth > 0u; });
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseArguments(argc, argv, options))
+    {
+        std::cerr << "Usage: AsyncFileReaderBench [--depth <n>...] [--file-mb <n>] [--seed <n>] [--dir <path>]" << std::endl;
+        return 1;
+    }
+
+    const fs::path directory = options.directory.empty() ? fs::temp_directory_path() / "AsyncFileReaderBench" : options.directory;
+    std::error_code errorCode;
+    fs::create_directories(directory, errorCode);
+
+    const fs::path path = directory / "pattern.bin";
+    const uint64_t fileSize = static_cast<uint64_t>(options.fileMegabytes) << 20;
+    if (!writeTestFile(path, fileSize))
+    {
+        std::cerr << "Could not write " << path.string() << std::endl;
+        return 1;
+    }
+
+    {
+        AsyncFileReader reader;
+        std::cout << "Backend: " << reader.getBackendName() << ", file: " << options.fileMegabytes << " MB in " << directory.string() << "\n\n";
+    }
+
+    const bool passed = check(path, fileSize, options.seed);
+    benchmark(options, path, fileSize);
+
+    fs::remove(path, errorCode);
+    return passed ? 0 : 1;
+}
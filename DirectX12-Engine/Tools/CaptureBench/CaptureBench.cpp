@@ -0,0 +1,917 @@
+// Frame capture check and benchmark.
+//
+// Runs ReadbackRing and FrameCapture against a simulated GPU: a thread that plays back the
+// copies the render loop submits, each after a random delay, writes a pattern unique to the
+// frame into the slot's memory and then advances a fence value, as CopyTextureRegion into a
+// readback heap followed by a Signal would. Checks that:
+//  - the ring hands out, completes and recycles slots exactly like a simple model of it does
+//  - every captured frame reaches the sink once, intact and in order, also while the encoders
+//    are too slow to keep up and frames are dropped
+//  - the PNG sink's files decode back to the captured pixels, the Y4M and raw sinks write
+//    what they should
+// Then reports how fast each sink encodes a frame, and what capturing every frame costs the
+// render thread while it keeps a steady frame rate.
+//
+// Usage:
+//   CaptureBench [--width <n>] [--height <n>] [--encoders <n>] [--fps <n>] [--seconds <n>]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FrameCapture.h"
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    double millisecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    struct Options
+    {
+        uint32_t width = 1920u;
+        uint32_t height = 1080u;
+        uint32_t encoders = 2u;
+        uint32_t framesPerSecond = 60u;
+        float seconds = 2.0f;
+    };
+
+    const uint32_t SlotCount = 4u;
+
+    uint32_t alignRowPitch(uint32_t rowSize)
+    {
+        return (rowSize + 255u) & ~255u; // D3D12_TEXTURE_DATA_PITCH_ALIGNMENT
+    }
+
+    // What the copy of a frame leaves in its slot. Row padding is filled with garbage the sinks
+    // must skip.
+    void fillFrame(const CaptureLayout &layout, uint64_t frameNumber, uint8_t *memory)
+    {
+        const uint32_t rowSize = layout.width * getCaptureBytesPerPixel(layout.format);
+        for (uint32_t y = 0u; y < layout.height; ++y)
+        {
+            uint8_t *row = memory + static_cast<size_t>(y) * layout.rowPitch;
+            if (layout.format == CaptureFormat::Rgba8)
+            {
+                for (uint32_t x = 0u; x < layout.width; ++x)
+                {
+                    row[x * 4u] = static_cast<uint8_t>(x + frameNumber);
+                    row[x * 4u + 1u] = static_cast<uint8_t>(y + frameNumber * 3u);
+                    row[x * 4u + 2u] = static_cast<uint8_t>((x / 16u) ^ (y / 16u));
+                    row[x * 4u + 3u] = 255u;
+                }
+            }
+            else
+            {
+                for (uint32_t x = 0u; x < layout.width; ++x)
+                {
+                    const float value = static_cast<float>((x + y + frameNumber) % 300u) / 256.0f - 0.1f;
+                    memcpy(row + x * sizeof(float), &value, sizeof(float));
+                }
+            }
+            memset(row + rowSize, 0xcd, layout.rowPitch - rowSize);
+        }
+    }
+
+    bool frameMatches(const CaptureFrame &frame, uint64_t frameNumber, std::vector<uint8_t> &expected)
+    {
+        const CaptureLayout layout = { frame.width, frame.height, frame.rowPitch, frame.format };
+        expected.resize(static_cast<size_t>(frame.rowPitch) * frame.height);
+        fillFrame(layout, frameNumber, expected.data());
+        return memcmp(expected.data(), frame.data, expected.size()) == 0;
+    }
+
+    // Plays back submitted copies one after another on its own thread, like a GPU queue
+    class SimulatedGpu
+    {
+    public:
+        SimulatedGpu(const CaptureLayout &layout, double minDelayMs, double maxDelayMs)
+            : m_layout(layout)
+            , m_minDelayMs(minDelayMs)
+            , m_maxDelayMs(maxDelayMs)
+            , m_completedValue(0u)
+            , m_quit(false)
+            , m_thread(&SimulatedGpu::run, this)
+        {
+        }
+
+        ~SimulatedGpu()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_quit = true;
+            }
+            m_condition.notify_one();
+            m_thread.join();
+        }
+
+        // A frame's work, with or without a copy into memory, signalling fenceValue at its end
+        void submit(uint64_t fenceValue, uint64_t frameNumber, uint8_t *memory)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_work.push_back(Work{ fenceValue, frameNumber, memory });
+            }
+            m_condition.notify_one();
+        }
+
+        // Like ID3D12Fence::GetCompletedValue
+        uint64_t getCompletedValue() const { return m_completedValue.load(std::memory_order_acquire); }
+
+        void waitFor(uint64_t fenceValue) const
+        {
+            while (getCompletedValue() < fenceValue)
+            {
+                std::this_thread::yield();
+            }
+        }
+
+    private:
+        struct Work
+        {
+            uint64_t fenceValue;
+            uint64_t frameNumber;
+            uint8_t *memory;
+        };
+
+        void run()
+        {
+            std::mt19937 random(7u);
+            std::uniform_real_distribution<double> delay(m_minDelayMs, m_maxDelayMs);
+            while (true)
+            {
+                Work work;
+                {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    m_condition.wait(lock, [this]() { return m_quit || !m_work.empty(); });
+                    if (m_work.empty())
+                    {
+                        return;
+                    }
+                    work = m_work.front();
+                    m_work.pop_front();
+                }
+
+                const Clock::time_point start = Clock::now();
+                if (work.memory != nullptr)
+                {
+                    fillFrame(m_layout, work.frameNumber, work.memory);
+                }
+                const double remaining = delay(random) - millisecondsSince(start);
+                if (remaining > 0.0)
+                {
+                    std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(remaining));
+                }
+                m_completedValue.store(work.fenceValue, std::memory_order_release);
+            }
+        }
+
+        CaptureLayout m_layout;
+        double m_minDelayMs;
+        double m_maxDelayMs;
+        std::atomic<uint64_t> m_completedValue;
+        std::mutex m_mutex;
+        std::condition_variable m_condition;
+        std::deque<Work> m_work;
+        bool m_quit;
+        std::thread m_thread;
+    };
+
+    // Checks every frame against the pattern and records the order frames are written in
+    class VerifyingSink : public CaptureSink
+    {
+    public:
+        VerifyingSink(double encodeDelayMs, std::atomic<uint32_t> &corruptFrames, std::vector<uint64_t> &written)
+            : m_encodeDelayMs(encodeDelayMs)
+            , m_corruptFrames(corruptFrames)
+            , m_written(written)
+        {
+        }
+
+        void encode(const CaptureFrame &frame, std::vector<uint8_t> &encoded) override
+        {
+            thread_local std::vector<uint8_t> expected;
+            if (!frameMatches(frame, frame.frameNumber, expected))
+            {
+                ++m_corruptFrames;
+            }
+            encoded.resize(sizeof(uint64_t));
+            memcpy(encoded.data(), &frame.frameNumber, sizeof(uint64_t));
+            if (m_encodeDelayMs > 0.0)
+            {
+                std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(m_encodeDelayMs));
+            }
+        }
+
+        void write(const CaptureFrame &frame, const std::vector<uint8_t> &encoded) override
+        {
+            uint64_t encodedNumber;
+            memcpy(&encodedNumber, encoded.data(), sizeof(uint64_t));
+            if (encodedNumber != frame.frameNumber || frame.data != nullptr)
+            {
+                ++m_corruptFrames;
+            }
+            m_written.push_back(frame.frameNumber);
+        }
+
+    private:
+        double m_encodeDelayMs;
+        std::atomic<uint32_t> &m_corruptFrames;
+        std::vector<uint64_t> &m_written;
+    };
+
+    // Encodes with another sink and throws the result away, so disks do not skew the timing
+    class DiscardingSink : public CaptureSink
+    {
+    public:
+        explicit DiscardingSink(CaptureSink &encoder)
+            : m_encoder(encoder)
+        {
+        }
+
+        void encode(const CaptureFrame &frame, std::vector<uint8_t> &encoded) override { m_encoder.encode(frame, encoded); }
+        void write(const CaptureFrame &, const std::vector<uint8_t> &) override {}
+
+    private:
+        CaptureSink &m_encoder;
+    };
+
+    // Readback buffers for the simulated GPU
+    struct SlotMemory
+    {
+        std::vector<std::vector<uint8_t>> buffers;
+        std::vector<const uint8_t *> pointers;
+
+        explicit SlotMemory(const CaptureLayout &layout)
+            : buffers(SlotCount, std::vector<uint8_t>(static_cast<size_t>(layout.rowPitch) * layout.height))
+        {
+            for (const std::vector<uint8_t> &buffer : buffers)
+            {
+                pointers.push_back(buffer.data());
+            }
+        }
+    };
+
+    struct RunResult
+    {
+        FrameCapture::Stats stats;
+        double loopMs;          // Wall time of the render loop
+        double medianCaptureUs; // Render thread time spent in FrameCapture per frame
+        double p99CaptureUs;
+        double maxCaptureUs;
+    };
+
+    // A render loop that captures every frame at framesPerSecond, or as fast as the GPU allows at 0
+    RunResult runCapture(const CaptureLayout &layout, uint32_t frames, uint32_t framesPerSecond, double gpuMinMs, double gpuMaxMs,
+        std::unique_ptr<CaptureSink> sink, uint32_t encoders)
+    {
+        SlotMemory memory(layout);
+        SimulatedGpu gpu(layout, gpuMinMs, gpuMaxMs);
+        FrameCapture::Settings settings;
+        settings.encoderThreads = encoders;
+        FrameCapture capture(layout, memory.pointers, std::move(sink), settings);
+
+        // Two frames in flight like the renderer, fenceValues[i] is the value that retires frame i
+        const uint32_t framesInFlight = 2u;
+        std::vector<uint64_t> fenceValues(frames + 1u, 0u);
+        std::vector<double> captureTimes;
+        captureTimes.reserve(frames);
+
+        const Clock::time_point start = Clock::now();
+        for (uint32_t frame = 0u; frame < frames; ++frame)
+        {
+            if (frame >= framesInFlight)
+            {
+                gpu.waitFor(fenceValues[frame - framesInFlight]);
+            }
+
+            const Clock::time_point captureStart = Clock::now();
+            const ReadbackRing::Slot slot = capture.beginFrame(frame);
+            uint8_t *destination = slot == ReadbackRing::NoSlot ? nullptr : const_cast<uint8_t *>(memory.pointers[slot]);
+            fenceValues[frame] = frame + 1u;
+            gpu.submit(fenceValues[frame], frame, destination);
+            if (slot != ReadbackRing::NoSlot)
+            {
+                capture.submitFrame(slot, fenceValues[frame]);
+            }
+            capture.poll(gpu.getCompletedValue());
+            captureTimes.push_back(std::chrono::duration<double, std::micro>(Clock::now() - captureStart).count());
+
+            if (framesPerSecond > 0u)
+            {
+                std::this_thread::sleep_until(start + std::chrono::duration<double>(static_cast<double>(frame + 1u) / framesPerSecond));
+            }
+        }
+
+        const double loopMs = millisecondsSince(start);
+        gpu.waitFor(fenceValues[frames - 1u]);
+        capture.poll(gpu.getCompletedValue());
+        capture.waitIdle();
+
+        RunResult result;
+        result.stats = capture.getStats();
+        result.loopMs = loopMs;
+        std::sort(captureTimes.begin(), captureTimes.end());
+        result.medianCaptureUs = captureTimes[captureTimes.size() / 2u];
+        result.p99CaptureUs = captureTimes[(captureTimes.size() * 99u) / 100u];
+        result.maxCaptureUs = captureTimes.back();
+        return result;
+    }
+
+    // Inflates the fixed Huffman blocks PngCaptureSink writes, enough to read its files back
+    class FixedInflater
+    {
+    public:
+        FixedInflater(const uint8_t *data, size_t size)
+            : m_data(data)
+            , m_size(size)
+            , m_bit(0u)
+        {
+        }
+
+        bool inflate(std::vector<uint8_t> &out)
+        {
+            static const uint16_t LengthBases[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+            static const uint8_t LengthExtraBits[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+            static const uint16_t DistanceBases[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+            static const uint8_t DistanceExtraBits[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+            bool last = false;
+            while (!last)
+            {
+                last = readBits(1u) != 0u;
+                if (readBits(2u) != 1u)
+                {
+                    return false;
+                }
+                while (true)
+                {
+                    const uint32_t symbol = readLiteralSymbol();
+                    if (symbol < 256u)
+                    {
+                        out.push_back(static_cast<uint8_t>(symbol));
+                        continue;
+                    }
+                    if (symbol == 256u)
+                    {
+                        break;
+                    }
+                    if (symbol > 285u || m_bit > m_size * 8u)
+                    {
+                        return false;
+                    }
+                    const uint32_t length = LengthBases[symbol - 257u] + readBits(LengthExtraBits[symbol - 257u]);
+                    const uint32_t distanceSymbol = readHuffman(5u);
+                    if (distanceSymbol >= 30u)
+                    {
+                        return false;
+                    }
+                    const uint32_t distance = DistanceBases[distanceSymbol] + readBits(DistanceExtraBits[distanceSymbol]);
+                    if (distance > out.size())
+                    {
+                        return false;
+                    }
+                    for (uint32_t i = 0u; i < length; ++i)
+                    {
+                        out.push_back(out[out.size() - distance]);
+                    }
+                }
+            }
+            return m_bit <= m_size * 8u;
+        }
+
+    private:
+        uint32_t readBits(uint32_t count)
+        {
+            uint32_t value = 0u;
+            for (uint32_t i = 0u; i < count; ++i, ++m_bit)
+            {
+                const uint32_t bit = m_bit < m_size * 8u ? (m_data[m_bit / 8u] >> (m_bit % 8u)) & 1u : 0u;
+                value |= bit << i;
+            }
+            return value;
+        }
+
+        // Huffman codes are packed from their most significant bit
+        uint32_t readHuffman(uint32_t count)
+        {
+            uint32_t code = 0u;
+            for (uint32_t i = 0u; i < count; ++i)
+            {
+                code = (code << 1) | readBits(1u);
+            }
+            return code;
+        }
+
+        uint32_t readLiteralSymbol()
+        {
+            uint32_t code = readHuffman(7u);
+            if (code <= 0x17u)
+            {
+                return 256u + code;
+            }
+            code = (code << 1) | readBits(1u);
+            if (code >= 0x30u && code <= 0xbfu)
+            {
+                return code - 0x30u;
+            }
+            if (code >= 0xc0u && code <= 0xc7u)
+            {
+                return 280u + code - 0xc0u;
+            }
+            code = (code << 1) | readBits(1u);
+            return 144u + code - 0x190u;
+        }
+
+        const uint8_t *m_data;
+        size_t m_size;
+        size_t m_bit;
+    };
+
+    uint32_t readBigEndian(const uint8_t *data)
+    {
+        return (static_cast<uint32_t>(data[0]) << 24) | (static_cast<uint32_t>(data[1]) << 16) | (static_cast<uint32_t>(data[2]) << 8) | data[3];
+    }
+
+    uint32_t crc32(const uint8_t *data, size_t size)
+    {
+        uint32_t crc = ~0u;
+        for (size_t i = 0u; i < size; ++i)
+        {
+            crc ^= data[i];
+            for (uint32_t bit = 0u; bit < 8u; ++bit)
+            {
+                crc = (crc & 1u) != 0u ? 0xedb88320u ^ (crc >> 1) : crc >> 1;
+            }
+        }
+        return ~crc;
+    }
+
+    // Decodes a PNG written by PngCaptureSink into its rows of samples, false if anything is off
+    bool decodePng(const std::vector<uint8_t> &png, uint32_t &width, uint32_t &height, uint32_t &channels, std::vector<uint8_t> &samples)
+    {
+        static const uint8_t Signature[8] = { 0x89u, 'P', 'N', 'G', 0x0du, 0x0au, 0x1au, 0x0au };
+        if (png.size() < 8u || memcmp(png.data(), Signature, 8u) != 0)
+        {
+            return false;
+        }
+
+        std::vector<uint8_t> zlib;
+        bool ended = false;
+        size_t offset = 8u;
+        while (offset + 12u <= png.size() && !ended)
+        {
+            const uint32_t size = readBigEndian(&png[offset]);
+            if (offset + 12u + size > png.size() || crc32(&png[offset + 4u], size + 4u) != readBigEndian(&png[offset + 8u + size]))
+            {
+                return false;
+            }
+            const std::string type(reinterpret_cast<const char *>(&png[offset + 4u]), 4u);
+            const uint8_t *data = &png[offset + 8u];
+            if (type == "IHDR")
+            {
+                width = readBigEndian(data);
+                height = readBigEndian(data + 4u);
+                channels = data[9] == 2u ? 3u : 1u;
+            }
+            else if (type == "IDAT")
+            {
+                zlib.insert(zlib.end(), data, data + size);
+            }
+            ended = type == "IEND";
+            offset += 12u + size;
+        }
+        if (!ended || zlib.size() < 6u || ((zlib[0] << 8) | zlib[1]) % 31u != 0u)
+        {
+            return false;
+        }
+
+        std::vector<uint8_t> filtered;
+        FixedInflater inflater(zlib.data() + 2u, zlib.size() - 6u);
+        if (!inflater.inflate(filtered))
+        {
+            return false;
+        }
+        uint32_t a = 1u;
+        uint32_t b = 0u;
+        for (uint8_t value : filtered)
+        {
+            a = (a + value) % 65521u;
+            b = (b + a) % 65521u;
+        }
+        const size_t rowSize = static_cast<size_t>(width) * channels;
+        if (((b << 16) | a) != readBigEndian(&zlib[zlib.size() - 4u]) || filtered.size() != (rowSize + 1u) * height)
+        {
+            return false;
+        }
+
+        samples.assign(rowSize * height, 0u);
+        for (uint32_t y = 0u; y < height; ++y)
+        {
+            const uint8_t filter = filtered[y * (rowSize + 1u)];
+            const uint8_t *in = &filtered[y * (rowSize + 1u) + 1u];
+            uint8_t *row = &samples[y * rowSize];
+            const uint8_t *previous = y > 0u ? row - rowSize : nullptr;
+            for (size_t i = 0u; i < rowSize; ++i)
+            {
+                const int32_t left = i >= channels ? row[i - channels] : 0;
+                const int32_t up = previous != nullptr ? previous[i] : 0;
+                const int32_t upLeft = previous != nullptr && i >= channels ? previous[i - channels] : 0;
+                int32_t prediction = 0;
+                switch (filter)
+                {
+                case 0u:
+                    break;
+                case 1u:
+                    prediction = left;
+                    break;
+                case 2u:
+                    prediction = up;
+                    break;
+                case 3u:
+                    prediction = (left + up) / 2;
+                    break;
+                case 4u:
+                {
+                    const int32_t estimate = left + up - upLeft;
+                    const int32_t toLeft = std::abs(estimate - left);
+                    const int32_t toUp = std::abs(estimate - up);
+                    const int32_t toUpLeft = std::abs(estimate - upLeft);
+                    prediction = toLeft <= toUp && toLeft <= toUpLeft ? left : toUp <= toUpLeft ? up : upLeft;
+                    break;
+                }
+                default:
+                    return false;
+                }
+                row[i] = static_cast<uint8_t>(in[i] + prediction);
+            }
+        }
+        return true;
+    }
+
+    std::vector<uint8_t> readFile(const std::filesystem::path &path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        return std::vector<uint8_t>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    }
+
+    bool check(const Options &options)
+    {
+        bool passed = true;
+        auto report = [&passed](bool condition, const std::string &what)
+        {
+            std::cout << std::left << std::setw(64) << what << (condition ? "ok" : "FAILED") << "\n";
+            passed = passed && condition;
+        };
+
+        // Slots come out in turn, run out, complete in submission order and come back on release
+        {
+            ReadbackRing ring(3u);
+            std::vector<ReadbackRing::Slot> completed;
+            const ReadbackRing::Slot a = ring.acquire();
+            const ReadbackRing::Slot b = ring.acquire();
+            const ReadbackRing::Slot c = ring.acquire();
+            bool ok = a == 0u && b == 1u && c == 2u && ring.acquire() == ReadbackRing::NoSlot;
+            ring.cancel(b);
+            ring.submit(a, 5u);
+            ring.submit(c, 7u);
+            ring.poll(4u, completed);
+            ok = ok && completed.empty() && ring.getInFlightCount() == 2u;
+            ring.poll(6u, completed);
+            ok = ok && completed == std::vector<ReadbackRing::Slot>{ a };
+            const ReadbackRing::Slot again = ring.acquire();
+            ok = ok && again == b && ring.acquire() == ReadbackRing::NoSlot;
+            ring.release(a);
+            ok = ok && ring.acquire() == a;
+            ring.submit(again, 7u);
+            completed.clear();
+            ring.poll(100u, completed);
+            ok = ok && completed == std::vector<ReadbackRing::Slot>{ c, again } && ring.getInFlightCount() == 0u;
+            report(ok, "ring hands out, completes and recycles slots");
+        }
+
+        // Random use against a model of what every slot is doing
+        {
+            enum ModelState { Free, Recording, InFlight, Reading };
+            const uint32_t slotCount = 5u;
+            ReadbackRing ring(slotCount);
+            std::vector<ModelState> model(slotCount, Free);
+            std::vector<uint64_t> fences(slotCount, 0u);
+            std::deque<ReadbackRing::Slot> submitted;
+            std::vector<ReadbackRing::Slot> reading;
+            std::vector<ReadbackRing::Slot> completed;
+            std::mt19937 random(3u);
+            uint64_t fence = 0u;
+            uint64_t completedFence = 0u;
+            bool ok = true;
+            for (uint32_t step = 0u; step < 200000u && ok; ++step)
+            {
+                switch (random() % 4u)
+                {
+                case 0u:
+                {
+                    const ReadbackRing::Slot slot = ring.acquire();
+                    const bool anyFree = std::find(model.begin(), model.end(), Free) != model.end();
+                    if (slot == ReadbackRing::NoSlot)
+                    {
+                        ok = !anyFree;
+                        break;
+                    }
+                    ok = slot < slotCount && model[slot] == Free;
+                    model[slot] = Recording;
+                    if (random() % 8u == 0u)
+                    {
+                        ring.cancel(slot);
+                        model[slot] = Free;
+                    }
+                    else
+                    {
+                        fence += random() % 3u;
+                        ring.submit(slot, fence);
+                        fences[slot] = fence;
+                        model[slot] = InFlight;
+                        submitted.push_back(slot);
+                    }
+                    break;
+                }
+                case 1u:
+                    completedFence = (std::min)(fence, completedFence + random() % 3u);
+                    break;
+                case 2u:
+                {
+                    completed.clear();
+                    ring.poll(completedFence, completed);
+                    std::vector<ReadbackRing::Slot> expected;
+                    while (!submitted.empty() && fences[submitted.front()] <= completedFence)
+                    {
+                        expected.push_back(submitted.front());
+                        model[submitted.front()] = Reading;
+                        reading.push_back(submitted.front());
+                        submitted.pop_front();
+                    }
+                    ok = completed == expected;
+                    break;
+                }
+                case 3u:
+                    if (!reading.empty())
+                    {
+                        const size_t index = random() % reading.size();
+                        ring.release(reading[index]);
+                        model[reading[index]] = Free;
+                        reading.erase(reading.begin() + index);
+                    }
+                    break;
+                }
+            }
+            report(ok, "ring matches a model over 200000 random steps");
+        }
+
+        // Every frame captured arrives once, intact and in order
+        const uint32_t testWidth = 67u;
+        const uint32_t testHeight = 41u;
+        const CaptureFormat formats[] = { CaptureFormat::Rgba8, CaptureFormat::R32Float };
+        for (CaptureFormat format : formats)
+        {
+            const CaptureLayout layout = { testWidth, testHeight, alignRowPitch(testWidth * getCaptureBytesPerPixel(format)), format };
+            const char *formatName = format == CaptureFormat::Rgba8 ? "rgba8" : "r32 float";
+
+            std::atomic<uint32_t> corrupt(0u);
+            std::vector<uint64_t> written;
+            const uint32_t frames = 600u;
+            const RunResult fast = runCapture(layout, frames, 0u, 0.0, 0.3, std::make_unique<VerifyingSink>(0.0, corrupt, written), options.encoders);
+            bool inOrder = written.size() == fast.stats.capturedFrames && std::is_sorted(written.begin(), written.end()) &&
+                std::adjacent_find(written.begin(), written.end()) == written.end();
+            report(corrupt == 0u && inOrder && fast.stats.writtenFrames == fast.stats.capturedFrames &&
+                fast.stats.capturedFrames + fast.stats.droppedFrames == frames,
+                std::string(formatName) + " frames intact and in order (" + std::to_string(fast.stats.droppedFrames) + " dropped)");
+
+            // Encoders three frames behind at 200 frames a second, frames must be dropped
+            // rather than waited for. Waiting would stretch the second the loop takes to three.
+            written.clear();
+            const RunResult slow = runCapture(layout, 200u, 200u, 0.5, 2.0, std::make_unique<VerifyingSink>(15.0, corrupt, written), 1u);
+            inOrder = written.size() == slow.stats.capturedFrames && std::is_sorted(written.begin(), written.end()) &&
+                std::adjacent_find(written.begin(), written.end()) == written.end();
+            report(corrupt == 0u && inOrder && slow.stats.droppedFrames > 0u && slow.stats.capturedFrames + slow.stats.droppedFrames == 200u &&
+                slow.loopMs < 1500.0,
+                std::string(formatName) + " slow encoders drop instead of blocking (" + std::to_string(slow.stats.droppedFrames) + " dropped)");
+        }
+
+        // Sinks write what they should
+        const std::filesystem::path directory = std::filesystem::temp_directory_path() / "CaptureBench";
+        std::filesystem::remove_all(directory);
+        for (CaptureFormat format : formats)
+        {
+            const CaptureLayout layout = { testWidth, testHeight, alignRowPitch(testWidth * getCaptureBytesPerPixel(format)), format };
+            std::vector<uint8_t> memory(static_cast<size_t>(layout.rowPitch) * layout.height);
+            fillFrame(layout, 11u, memory.data());
+            const CaptureFrame frame = { 11u, layout.width, layout.height, layout.rowPitch, layout.format, memory.data() };
+            const CaptureFrame written = { 11u, layout.width, layout.height, layout.rowPitch, layout.format, nullptr };
+            const char *formatName = format == CaptureFormat::Rgba8 ? "rgba8" : "r32 float";
+
+            std::vector<uint8_t> encoded;
+            PngCaptureSink pngSink(directory);
+            pngSink.encode(frame, encoded);
+            pngSink.write(written, encoded);
+            uint32_t width = 0u;
+            uint32_t height = 0u;
+            uint32_t channels = 0u;
+            std::vector<uint8_t> samples;
+            bool pngOk = decodePng(readFile(directory / "frame_000011.png"), width, height, channels, samples) && width == layout.width && height == layout.height;
+            for (uint32_t y = 0u; y < height && pngOk; ++y)
+            {
+                for (uint32_t x = 0u; x < width && pngOk; ++x)
+                {
+                    const uint8_t *pixel = &memory[static_cast<size_t>(y) * layout.rowPitch + x * 4u];
+                    const uint8_t *sample = &samples[(static_cast<size_t>(y) * width + x) * channels];
+                    if (format == CaptureFormat::Rgba8)
+                    {
+                        pngOk = channels == 3u && sample[0] == pixel[0] && sample[1] == pixel[1] && sample[2] == pixel[2];
+                    }
+                    else
+                    {
+                        float value;
+                        memcpy(&value, pixel, sizeof(float));
+                        const float clamped = (std::min)((std::max)(value, 0.0f), 1.0f);
+                        pngOk = channels == 1u && std::abs(static_cast<float>(sample[0]) - clamped * 255.0f) <= 0.5f;
+                    }
+                }
+            }
+            report(pngOk, std::string(formatName) + " png decodes back to the frame");
+
+            RawCaptureSink rawSink(directory);
+            rawSink.encode(frame, encoded);
+            rawSink.write(written, encoded);
+            const std::vector<uint8_t> raw = readFile(directory / (std::string("frame_000011_67x41_") + (format == CaptureFormat::Rgba8 ? "rgba8" : "r32f") + ".raw"));
+            bool rawOk = raw.size() == static_cast<size_t>(layout.width) * 4u * layout.height;
+            for (uint32_t y = 0u; y < layout.height && rawOk; ++y)
+            {
+                rawOk = memcmp(&raw[static_cast<size_t>(y) * layout.width * 4u], &memory[static_cast<size_t>(y) * layout.rowPitch], layout.width * 4u) == 0;
+            }
+            report(rawOk, std::string(formatName) + " raw file holds the packed rows");
+        }
+        {
+            // Black and white squares and a grey float frame, in a stream of three frames
+            const CaptureLayout layout = { 5u, 3u, 256u, CaptureFormat::Rgba8 };
+            std::vector<uint8_t> memory(static_cast<size_t>(layout.rowPitch) * layout.height, 0u);
+            for (uint32_t y = 0u; y < layout.height; ++y)
+            {
+                for (uint32_t x = 0u; x < layout.width; ++x)
+                {
+                    memset(&memory[y * layout.rowPitch + x * 4u], x < 2u ? 255 : 0, 4u);
+                }
+            }
+            std::vector<uint8_t> encoded;
+            const std::filesystem::path path = directory / "capture.y4m";
+            {
+                Y4mCaptureSink sink(path, 60u);
+                for (uint64_t frameNumber = 0u; frameNumber < 3u; ++frameNumber)
+                {
+                    const CaptureFrame frame = { frameNumber, layout.width, layout.height, layout.rowPitch, layout.format, memory.data() };
+                    sink.encode(frame, encoded);
+                    sink.write(CaptureFrame{ frameNumber, layout.width, layout.height, layout.rowPitch, layout.format, nullptr }, encoded);
+                }
+            }
+            const std::vector<uint8_t> stream = readFile(path);
+            const std::string header = "YUV4MPEG2 W5 H3 F60:1 Ip A1:1 C420jpeg\n";
+            const size_t frameSize = 6u + 5u * 3u + 2u * 3u * 2u;
+            bool ok = stream.size() == header.size() + 3u * frameSize && memcmp(stream.data(), header.data(), header.size()) == 0;
+            const uint8_t *planes = stream.data() + header.size() + 6u;
+            ok = ok && planes[0] == 235u && planes[4] == 16u && planes[15] == 128u && planes[17] == 128u && planes[18] == 128u;
+
+            float grey = 0.5f;
+            const CaptureFrame greyFrame = { 0u, 1u, 1u, 4u, CaptureFormat::R32Float, reinterpret_cast<const uint8_t *>(&grey) };
+            Y4mCaptureSink::convertToYuv420(greyFrame, encoded);
+            ok = ok && encoded.size() == 3u && encoded[0] == 126u && encoded[1] == 128u && encoded[2] == 128u;
+            report(ok, "y4m stream holds its header and 4:2:0 frames");
+        }
+        std::filesystem::remove_all(directory);
+
+        std::cout << "\n";
+        return passed;
+    }
+
+    void benchmark(const Options &options)
+    {
+        const CaptureLayout layout = { options.width, options.height, alignRowPitch(options.width * 4u), CaptureFormat::Rgba8 };
+        std::vector<uint8_t> memory(static_cast<size_t>(layout.rowPitch) * layout.height);
+        fillFrame(layout, 1u, memory.data());
+        const CaptureFrame frame = { 1u, layout.width, layout.height, layout.rowPitch, layout.format, memory.data() };
+        const double frameMegabytes = static_cast<double>(layout.width) * layout.height * 4u / (1024.0 * 1024.0);
+
+        const std::filesystem::path directory = std::filesystem::temp_directory_path() / "CaptureBench";
+        RawCaptureSink rawSink(directory);
+        PngCaptureSink pngSink(directory);
+        Y4mCaptureSink y4mSink(directory / "capture.y4m", options.framesPerSecond);
+        CaptureSink *sinks[] = { &rawSink, &pngSink, &y4mSink };
+        const char *sinkNames[] = { "raw", "png", "y4m" };
+
+        std::cout << "Encoding one " << options.width << "x" << options.height << " frame on one thread\n";
+        std::cout << std::left << std::setw(8) << "Sink" << std::right << std::setw(12) << "ms/frame" << std::setw(12) << "MB/s" << std::setw(14) << "Output MB" << "\n";
+        std::vector<uint8_t> encoded;
+        double pngMs = 0.0;
+        for (uint32_t i = 0u; i < 3u; ++i)
+        {
+            uint32_t runs = 0u;
+            const Clock::time_point start = Clock::now();
+            do
+            {
+                sinks[i]->encode(frame, encoded);
+                ++runs;
+            } while (millisecondsSince(start) < 200.0);
+            const double milliseconds = millisecondsSince(start) / runs;
+            pngMs = i == 1u ? milliseconds : pngMs;
+            std::cout << std::left << std::setw(8) << sinkNames[i] << std::right << std::fixed << std::setprecision(2) << std::setw(12) << milliseconds
+                      << std::setprecision(0) << std::setw(12) << frameMegabytes / (milliseconds / 1000.0)
+                      << std::setprecision(2) << std::setw(14) << static_cast<double>(encoded.size()) / (1024.0 * 1024.0) << "\n";
+        }
+        std::filesystem::remove_all(directory);
+
+        // Every frame at a steady rate, the GPU taking most of a frame, encoded to PNG and thrown away
+        const uint32_t frames = static_cast<uint32_t>(options.seconds * options.framesPerSecond);
+        const double framePeriodMs = 1000.0 / options.framesPerSecond;
+        std::cout << "\nCapturing every frame to png at " << options.framesPerSecond << " fps for " << frames << " frames, "
+                  << SlotCount << " slots\n";
+        std::cout << std::left << std::setw(10) << "Encoders" << std::right << std::setw(10) << "Written" << std::setw(10) << "Dropped"
+                  << std::setw(14) << "Median us" << std::setw(10) << "p99 us" << std::setw(10) << "Max us" << std::setw(14) << "Latency ms" << "\n";
+        std::vector<uint32_t> encoderCounts = { 1u };
+        if (options.encoders > 1u)
+        {
+            encoderCounts.push_back(options.encoders);
+        }
+        for (uint32_t encoders : encoderCounts)
+        {
+            const RunResult result = runCapture(layout, frames, options.framesPerSecond, framePeriodMs * 0.5, framePeriodMs * 0.9,
+                std::make_unique<DiscardingSink>(pngSink), encoders);
+            std::cout << std::left << std::setw(10) << encoders << std::right << std::setw(10) << result.stats.writtenFrames << std::setw(10) << result.stats.droppedFrames
+                      << std::setprecision(1) << std::setw(14) << result.medianCaptureUs << std::setw(10) << result.p99CaptureUs << std::setw(10) << result.maxCaptureUs
+                      << std::setw(14) << result.stats.averageLatencyMs << "\n";
+        }
+        std::cout << "Render thread time is beginFrame, submitFrame and poll together. Keeping up takes about "
+                  << static_cast<uint32_t>(pngMs / framePeriodMs + 0.999) << " png encoders on free cores." << std::endl;
+    }
+
+    bool parseArguments(int argc, char **argv, Options &options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string argument = argv[i];
+            const bool hasValue = i + 1 < argc;
+
+            if (argument == "--width" && hasValue)
+            {
+                options.width = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (argument == "--height" && hasValue)
+            {
+                options.height = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (argument == "--encoders" && hasValue)
+            {
+                options.encoders = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (argument == "--fps" && hasValue)
+            {
+                options.framesPerSecond = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (argument == "--seconds" && hasValue)
+            {
+                options.seconds = std::stof(argv[++i]);
+            }
+            else
+            {
+                return false;
+            }
+        }
+        return options.width > 0u && options.height > 0u && options.encoders > 0u && options.framesPerSecond > 0u && options.seconds > 0.0f;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseArguments(argc, argv, options))
+    {
+        std::cerr << "Usage: CaptureBench [--width <n>] [--height <n>] [--encoders <n>] [--fps <n>] [--seconds <n>]" << std::endl;
+        return 1;
+    }
+
+    const bool passed = check(options);
+    benchmark(options);
+    return passed ? 0 : 1;
+}
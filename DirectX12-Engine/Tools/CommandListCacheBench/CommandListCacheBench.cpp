@@ -0,0 +1,784 @@
+// CommandListStateCache check and benchmark.
+//
+// Drives the cache in front of a recording command list that models the D3D12 binding state,
+// and checks that:
+//  - redundant state calls are filtered and every call is counted as issued or filtered
+//  - a root signature change invalidates the root arguments bound through it, and only those
+//  - a descriptor heap change invalidates the descriptor tables of both and nothing else
+//  - Reset clears all state except the initial pipeline state
+//  - root constants are compared per value, past the cached range they are always forwarded
+//  - random call streams reach every draw with the same state with and without the cache
+// Then frames of sorted, unsorted and all distinct draws are recorded through the cache into a
+// list that only counts, for the share of calls filtered and the cache's cost per call.
+//
+// Usage:
+//   CommandListCacheBench [--draws <n>] [--seed <n>]
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "CommandListStateCache.h"
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    double millisecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    struct Options
+    {
+        uint32_t draws = 4096u;
+        uint32_t seed = 1u;
+    };
+
+    // Stand-ins for the D3D12 objects and argument structs, laid out like the real ones
+    struct PipelineState { uint32_t id; };
+    struct RootSignature { uint32_t id; };
+    struct DescriptorHeap { uint32_t id; };
+    struct CommandAllocator { uint32_t id; };
+    struct GpuDescriptorHandle { uint64_t ptr; };
+    struct Viewport { float topLeftX, topLeftY, width, height, minDepth, maxDepth; };
+    struct Rect { int32_t left, top, right, bottom; };
+    struct VertexBufferView { uint64_t bufferLocation; uint32_t sizeInBytes; uint32_t strideInBytes; };
+    struct IndexBufferView { uint64_t bufferLocation; uint32_t sizeInBytes; uint32_t format; };
+    enum PrimitiveTopology { TopologyTriangleList = 4, TopologyTriangleStrip = 5 };
+
+    const uint32_t ModelRootParameters = 8u;
+    const uint32_t ModelRootConstants = 64u;
+    const uint32_t ModelVertexBuffers = 4u;
+
+    // Tracks the state a draw would see the way the D3D12 runtime binds it
+    class RecordingCommandList
+    {
+    public:
+        RecordingCommandList()
+        {
+            clear();
+        }
+
+        uint64_t getCalls() const { return m_calls; }
+        const std::vector<std::string> &getDrawStates() const { return m_drawStates; }
+
+        int Reset(CommandAllocator *, PipelineState *initialState)
+        {
+            ++m_calls;
+            clear();
+            m_pipelineState = initialState;
+            return 0;
+        }
+
+        void SetPipelineState(PipelineState *pipelineState)
+        {
+            ++m_calls;
+            m_pipelineState = pipelineState;
+        }
+
+        void SetGraphicsRootSignature(RootSignature *rootSignature)
+        {
+            setRootSignature(m_graphics, rootSignature);
+        }
+
+        void SetComputeRootSignature(RootSignature *rootSignature)
+        {
+            setRootSignature(m_compute, rootSignature);
+        }
+
+        void SetDescriptorHeaps(uint32_t count, DescriptorHeap *const *descriptorHeaps)
+        {
+            ++m_calls;
+            const std::vector<DescriptorHeap *> heaps(descriptorHeaps, descriptorHeaps + count);
+            if (heaps != m_descriptorHeaps)
+            {
+                for (Bindings *bindings : { &m_graphics, &m_compute })
+                {
+                    for (RootArgument &argument : bindings->arguments)
+                    {
+                        argument.kind = argument.kind == ArgumentTable ? ArgumentNone : argument.kind;
+                    }
+                }
+            }
+            m_descriptorHeaps = heaps;
+        }
+
+        void SetGraphicsRootDescriptorTable(uint32_t index, GpuDescriptorHandle handle) { setArgument(m_graphics, index, ArgumentTable, handle.ptr); }
+        void SetGraphicsRootConstantBufferView(uint32_t index, uint64_t location) { setArgument(m_graphics, index, ArgumentConstantBufferView, location); }
+        void SetGraphicsRootShaderResourceView(uint32_t index, uint64_t location) { setArgument(m_graphics, index, ArgumentShaderResourceView, location); }
+        void SetGraphicsRootUnorderedAccessView(uint32_t index, uint64_t location) { setArgument(m_graphics, index, ArgumentUnorderedAccessView, location); }
+        void SetGraphicsRoot32BitConstant(uint32_t index, uint32_t value, uint32_t offset) { setConstants(m_graphics, index, 1u, &value, offset); }
+        void SetGraphicsRoot32BitConstants(uint32_t index, uint32_t count, const void *data, uint32_t offset) { setConstants(m_graphics, index, count, data, offset); }
+
+        void SetComputeRootDescriptorTable(uint32_t index, GpuDescriptorHandle handle) { setArgument(m_compute, index, ArgumentTable, handle.ptr); }
+        void SetComputeRootConstantBufferView(uint32_t index, uint64_t location) { setArgument(m_compute, index, ArgumentConstantBufferView, location); }
+        void SetComputeRootShaderResourceView(uint32_t index, uint64_t location) { setArgument(m_compute, index, ArgumentShaderResourceView, location); }
+        void SetComputeRootUnorderedAccessView(uint32_t index, uint64_t location) { setArgument(m_compute, index, ArgumentUnorderedAccessView, location); }
+        void SetComputeRoot32BitConstant(uint32_t index, uint32_t value, uint32_t offset) { setConstants(m_compute, index, 1u, &value, offset); }
+        void SetComputeRoot32BitConstants(uint32_t index, uint32_t count, const void *data, uint32_t offset) { setConstants(m_compute, index, count, data, offset); }
+
+        void RSSetViewports(uint32_t count, const Viewport *viewports)
+        {
+            ++m_calls;
+            m_viewports.assign(reinterpret_cast<const unsigned char *>(viewports), reinterpret_cast<const unsigned char *>(viewports + count));
+        }
+
+        void RSSetScissorRects(uint32_t count, const Rect *rects)
+        {
+            ++m_calls;
+            m_scissorRects.assign(reinterpret_cast<const unsigned char *>(rects), reinterpret_cast<const unsigned char *>(rects + count));
+        }
+
+        void IASetPrimitiveTopology(PrimitiveTopology primitiveTopology)
+        {
+            ++m_calls;
+            m_primitiveTopology = primitiveTopology;
+        }
+
+        void IASetVertexBuffers(uint32_t startSlot, uint32_t count, const VertexBufferView *views)
+        {
+            ++m_calls;
+            for (uint32_t i = 0u; i < count && startSlot + i < ModelVertexBuffers; ++i)
+            {
+                m_vertexBufferBound[startSlot + i] = views != nullptr;
+                if (views)
+                {
+                    m_vertexBuffers[startSlot + i] = views[i];
+                }
+            }
+        }
+
+        void IASetIndexBuffer(const IndexBufferView *view)
+        {
+            ++m_calls;
+            m_indexBufferBound = view != nullptr;
+            if (view)
+            {
+                m_indexBuffer = *view;
+            }
+        }
+
+        // Snapshot everything bound, unbound state prints as such so a stale binding shows
+        void Draw()
+        {
+            std::ostringstream state;
+            state << "pso " << (m_pipelineState ? static_cast<int64_t>(m_pipelineState->id) : -1) << " heaps";
+            for (const DescriptorHeap *heap : m_descriptorHeaps)
+            {
+                state << " " << heap->id;
+            }
+            for (const Bindings *bindings : { &m_graphics, &m_compute })
+            {
+                state << " | rs " << (bindings->rootSignature ? static_cast<int64_t>(bindings->rootSignature->id) : -1);
+                for (uint32_t i = 0u; i < ModelRootParameters; ++i)
+                {
+                    const RootArgument &argument = bindings->arguments[i];
+                    state << " " << i << ":" << argument.kind;
+                    if (argument.kind == ArgumentConstants)
+                    {
+                        for (uint32_t c = 0u; c < ModelRootConstants; ++c)
+                        {
+                            if (argument.constantValid[c])
+                            {
+                                state << "," << c << "=" << argument.constants[c];
+                            }
+                        }
+                    }
+                    else if (argument.kind != ArgumentNone)
+                    {
+                        state << "=" << argument.value;
+                    }
+                }
+            }
+            state << " | vp " << m_viewports.size() << " " << hashBytes(m_viewports) << " sr " << m_scissorRects.size() << " " << hashBytes(m_scissorRects)
+                  << " topology " << m_primitiveTopology << " vb";
+            for (uint32_t i = 0u; i < ModelVertexBuffers; ++i)
+            {
+                state << " " << (m_vertexBufferBound[i] ? static_cast<int64_t>(m_vertexBuffers[i].bufferLocation) : -1);
+            }
+            state << " ib " << (m_indexBufferBound ? static_cast<int64_t>(m_indexBuffer.bufferLocation) : -1);
+            m_drawStates.push_back(state.str());
+        }
+
+    private:
+        enum ArgumentKind { ArgumentNone, ArgumentTable, ArgumentConstantBufferView, ArgumentShaderResourceView, ArgumentUnorderedAccessView, ArgumentConstants };
+
+        struct RootArgument
+        {
+            ArgumentKind kind;
+            uint64_t value;
+            bool constantValid[ModelRootConstants];
+            uint32_t constants[ModelRootConstants];
+        };
+
+        struct Bindings
+        {
+            RootSignature *rootSignature;
+            RootArgument arguments[ModelRootParameters];
+        };
+
+        static uint64_t hashBytes(const std::vector<unsigned char> &bytes)
+        {
+            uint64_t hash = 14695981039346656037ull;
+            for (const unsigned char c : bytes)
+            {
+                hash = (hash ^ c) * 1099511628211ull;
+            }
+            return hash;
+        }
+
+        static void clearBindings(Bindings &bindings)
+        {
+            bindings.rootSignature = nullptr;
+            for (RootArgument &argument : bindings.arguments)
+            {
+                argument.kind = ArgumentNone;
+            }
+        }
+
+        void clear()
+        {
+            m_pipelineState = nullptr;
+            m_descriptorHeaps.clear();
+            clearBindings(m_graphics);
+            clearBindings(m_compute);
+            m_viewports.clear();
+            m_scissorRects.clear();
+            m_primitiveTopology = -1;
+            std::fill(std::begin(m_vertexBufferBound), std::end(m_vertexBufferBound), false);
+            m_indexBufferBound = false;
+        }
+
+        void setRootSignature(Bindings &bindings, RootSignature *rootSignature)
+        {
+            ++m_calls;
+            if (bindings.rootSignature != rootSignature)
+            {
+                clearBindings(bindings);
+                bindings.rootSignature = rootSignature;
+            }
+        }
+
+        void setArgument(Bindings &bindings, uint32_t index, ArgumentKind kind, uint64_t value)
+        {
+            ++m_calls;
+            bindings.arguments[index].kind = kind;
+            bindings.arguments[index].value = value;
+        }
+
+        void setConstants(Bindings &bindings, uint32_t index, uint32_t count, const void *data, uint32_t offset)
+        {
+            ++m_calls;
+            RootArgument &argument = bindings.arguments[index];
+            if (argument.kind != ArgumentConstants)
+            {
+                argument.kind = ArgumentConstants;
+                std::fill(std::begin(argument.constantValid), std::end(argument.constantValid), false);
+            }
+            std::memcpy(&argument.constants[offset], data, count * sizeof(uint32_t));
+            std::fill(argument.constantValid + offset, argument.constantValid + offset + count, true);
+        }
+
+        uint64_t m_calls = 0u;
+        std::vector<std::string> m_drawStates;
+
+        PipelineState *m_pipelineState;
+        std::vector<DescriptorHeap *> m_descriptorHeaps;
+        Bindings m_graphics;
+        Bindings m_compute;
+        std::vector<unsigned char> m_viewports;
+        std::vector<unsigned char> m_scissorRects;
+        int m_primitiveTopology;
+        bool m_vertexBufferBound[ModelVertexBuffers];
+        VertexBufferView m_vertexBuffers[ModelVertexBuffers];
+        bool m_indexBufferBound;
+        IndexBufferView m_indexBuffer;
+    };
+
+    // Only counts, so the benchmark times the cache rather than the model. A real command list
+    // call costs far more than this one, so only the cache's own cost is reported.
+    struct CountingCommandList
+    {
+        uint64_t calls = 0u;
+
+        int Reset(CommandAllocator *, PipelineState *) { ++calls; return 0; }
+        void SetPipelineState(PipelineState *) { ++calls; }
+        void SetGraphicsRootSignature(RootSignature *) { ++calls; }
+        void SetDescriptorHeaps(uint32_t, DescriptorHeap *const *) { ++calls; }
+        void SetGraphicsRootDescriptorTable(uint32_t, GpuDescriptorHandle) { ++calls; }
+        void SetGraphicsRootConstantBufferView(uint32_t, uint64_t) { ++calls; }
+        void SetGraphicsRoot32BitConstants(uint32_t, uint32_t, const void *, uint32_t) { ++calls; }
+        void RSSetViewports(uint32_t, const Viewport *) { ++calls; }
+        void RSSetScissorRects(uint32_t, const Rect *) { ++calls; }
+        void IASetPrimitiveTopology(PrimitiveTopology) { ++calls; }
+        void IASetVertexBuffers(uint32_t, uint32_t, const VertexBufferView *) { ++calls; }
+        void IASetIndexBuffer(const IndexBufferView *) { ++calls; }
+    };
+
+    // The objects the calls refer to
+    struct Objects
+    {
+        PipelineState pipelineStates[4] = { { 0u }, { 1u }, { 2u }, { 3u } };
+        RootSignature rootSignatures[3] = { { 0u }, { 1u }, { 2u } };
+        DescriptorHeap descriptorHeaps[3] = { { 0u }, { 1u }, { 2u } };
+        CommandAllocator allocator = { 0u };
+    };
+
+    // Issues the same random call on the cached and the direct list, values come from small pools
+    // so most calls repeat the bound state
+    class RandomCallStream
+    {
+    public:
+        RandomCallStream(Objects &objects, uint32_t seed)
+            : m_objects(objects)
+            , m_random(seed)
+        {
+        }
+
+        template <typename Target>
+        void issue(Target &target, uint32_t call, std::mt19937 &random)
+        {
+            auto pick = [&random](uint32_t count) { return static_cast<uint32_t>(random() % count); };
+            switch (call)
+            {
+            case 0: target.Reset(&m_objects.allocator, pick(2u) ? &m_objects.pipelineStates[pick(4u)] : nullptr); break;
+            case 1: target.SetPipelineState(&m_objects.pipelineStates[pick(4u)]); break;
+            case 2: target.SetGraphicsRootSignature(&m_objects.rootSignatures[pick(3u)]); break;
+            case 3: target.SetComputeRootSignature(&m_objects.rootSignatures[pick(3u)]); break;
+            case 4:
+            {
+                DescriptorHeap *heaps[] = { &m_objects.descriptorHeaps[pick(3u)], &m_objects.descriptorHeaps[pick(3u)] };
+                target.SetDescriptorHeaps(1u + pick(2u), heaps);
+                break;
+            }
+            case 5: target.SetGraphicsRootDescriptorTable(pick(ModelRootParameters), GpuDescriptorHandle{ 0x1000u + pick(3u) * 64u }); break;
+            case 6: target.SetGraphicsRootConstantBufferView(pick(ModelRootParameters), 0x2000u + pick(3u) * 256u); break;
+            case 7: target.SetGraphicsRootShaderResourceView(pick(ModelRootParameters), 0x3000u + pick(2u) * 256u); break;
+            case 8: target.SetGraphicsRootUnorderedAccessView(pick(ModelRootParameters), 0x4000u + pick(2u) * 256u); break;
+            case 9: target.SetGraphicsRoot32BitConstant(pick(ModelRootParameters), pick(2u), pick(4u)); break;
+            case 10:
+            {
+                // Now and then past the cached range
+                const uint32_t count = 1u + pick(8u);
+                const uint32_t offset = pick(8u) == 0u ? 28u + pick(8u) : pick(8u);
+                uint32_t values[8];
+                for (uint32_t &value : values)
+                {
+                    value = pick(2u);
+                }
+                target.SetGraphicsRoot32BitConstants(pick(ModelRootParameters), count, values, offset);
+                break;
+            }
+            case 11: target.SetComputeRootDescriptorTable(pick(ModelRootParameters), GpuDescriptorHandle{ 0x1000u + pick(3u) * 64u }); break;
+            case 12: target.SetComputeRootUnorderedAccessView(pick(ModelRootParameters), 0x4000u + pick(2u) * 256u); break;
+            case 13: target.SetComputeRootShaderResourceView(pick(ModelRootParameters), 0x3000u + pick(2u) * 256u); break;
+            case 14: target.SetComputeRootConstantBufferView(pick(ModelRootParameters), 0x2000u + pick(3u) * 256u); break;
+            case 15:
+            {
+                uint32_t values[4] = { pick(2u), pick(2u), pick(2u), pick(2u) };
+                target.SetComputeRoot32BitConstants(pick(ModelRootParameters), 1u + pick(4u), values, pick(4u));
+                break;
+            }
+            case 16: target.SetComputeRoot32BitConstant(pick(ModelRootParameters), pick(2u), pick(4u)); break;
+            case 17:
+            {
+                const Viewport viewports[] = { { 0.0f, 0.0f, 1280.0f, 720.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, 640.0f, 360.0f, 0.0f, 1.0f } };
+                const uint32_t first = pick(2u);
+                target.RSSetViewports(1u + pick(2u - first), viewports + first);
+                break;
+            }
+            case 18:
+            {
+                const Rect rects[] = { { 0, 0, 1280, 720 }, { 0, 0, 640, 360 } };
+                target.RSSetScissorRects(1u, rects + pick(2u));
+                break;
+            }
+            case 19: target.IASetPrimitiveTopology(pick(2u) ? TopologyTriangleList : TopologyTriangleStrip); break;
+            case 20:
+            {
+                const VertexBufferView views[] = { { 0x5000u + pick(2u) * 256u, 256u, 16u }, { 0x6000u + pick(2u) * 256u, 256u, 32u } };
+                target.IASetVertexBuffers(pick(3u), 1u + pick(2u), pick(8u) == 0u ? nullptr : views);
+                break;
+            }
+            case 21:
+            {
+                const IndexBufferView view = { 0x7000u + pick(2u) * 256u, 256u, 42u };
+                target.IASetIndexBuffer(pick(8u) == 0u ? nullptr : &view);
+                break;
+            }
+            }
+        }
+
+        // Returns the number of state calls made
+        template <typename Cache>
+        uint64_t run(Cache &cache, RecordingCommandList &direct, uint32_t callCount)
+        {
+            uint64_t stateCalls = 0u;
+            for (uint32_t i = 0u; i < callCount; ++i)
+            {
+                // Draws often, resets rarely
+                const uint32_t roll = static_cast<uint32_t>(m_random() % 100u);
+                if (roll < 20u)
+                {
+                    cache.get()->Draw();
+                    direct.Draw();
+                    continue;
+                }
+                const uint32_t call = roll < 21u ? 0u : 1u + roll % 21u;
+                const uint32_t seed = static_cast<uint32_t>(m_random());
+                std::mt19937 cachedRandom(seed);
+                std::mt19937 directRandom(seed);
+                issue(cache, call, cachedRandom);
+                issue(direct, call, directRandom);
+                ++stateCalls;
+            }
+            return stateCalls;
+        }
+
+    private:
+        Objects &m_objects;
+        std::mt19937 m_random;
+    };
+
+    using RecordingCache = CommandListStateCache<RecordingCommandList>;
+
+    bool check(const Options &options)
+    {
+        bool passed = true;
+        auto report = [&passed](bool condition, const std::string &what)
+        {
+            std::cout << std::left << std::setw(64) << what << (condition ? "ok" : "FAILED") << "\n";
+            passed = passed && condition;
+        };
+
+        Objects objects;
+        const GpuDescriptorHandle table = { 0x1000u };
+        const uint32_t constants[] = { 1u, 2u, 3u, 4u };
+
+        // Redundant calls and the counters
+        {
+            RecordingCommandList list;
+            RecordingCache cache;
+            cache.attach(&list);
+            for (uint32_t i = 0u; i < 3u; ++i)
+            {
+                cache.SetPipelineState(&objects.pipelineStates[0]);
+                cache.SetGraphicsRootSignature(&objects.rootSignatures[0]);
+                cache.IASetPrimitiveTopology(TopologyTriangleList);
+                cache.SetGraphicsRootConstantBufferView(1u, 0x2000u);
+            }
+            report(list.getCalls() == 4u, "repeated state is forwarded once");
+            report(cache.getStats().issuedCalls == 4u && cache.getStats().filteredCalls == 8u, "stats count the forwarded and the filtered calls");
+
+            cache.IASetPrimitiveTopology(TopologyTriangleStrip);
+            cache.SetPipelineState(&objects.pipelineStates[1]);
+            report(list.getCalls() == 6u, "changed state is forwarded");
+        }
+
+        // Root signature changes
+        {
+            RecordingCommandList list;
+            RecordingCache cache;
+            cache.attach(&list);
+            cache.SetGraphicsRootSignature(&objects.rootSignatures[0]);
+            cache.SetComputeRootSignature(&objects.rootSignatures[0]);
+            cache.SetGraphicsRootDescriptorTable(0u, table);
+            cache.SetGraphicsRoot32BitConstants(1u, 4u, constants, 0u);
+            cache.SetComputeRootUnorderedAccessView(0u, 0x4000u);
+            cache.SetComputeRoot32BitConstants(1u, 4u, constants, 0u);
+            const uint64_t bound = list.getCalls();
+
+            cache.SetGraphicsRootSignature(&objects.rootSignatures[0]);
+            cache.SetGraphicsRootDescriptorTable(0u, table);
+            cache.SetGraphicsRoot32BitConstants(1u, 4u, constants, 0u);
+            report(list.getCalls() == bound, "the same root signature keeps the root arguments");
+
+            cache.SetGraphicsRootSignature(&objects.rootSignatures[1]);
+            cache.SetGraphicsRootDescriptorTable(0u, table);
+            cache.SetGraphicsRoot32BitConstants(1u, 4u, constants, 0u);
+            report(list.getCalls() == bound + 3u, "a new graphics root signature invalidates its arguments");
+
+            cache.SetComputeRootUnorderedAccessView(0u, 0x4000u);
+            cache.SetComputeRoot32BitConstants(1u, 4u, constants, 0u);
+            report(list.getCalls() == bound + 3u, "the compute arguments survive a graphics signature change");
+
+            cache.SetComputeRootSignature(&objects.rootSignatures[2]);
+            cache.SetComputeRootUnorderedAccessView(0u, 0x4000u);
+            cache.SetGraphicsRootDescriptorTable(0u, table);
+            report(list.getCalls() == bound + 5u, "a new compute root signature invalidates only compute");
+        }
+
+        // Descriptor heap changes
+        {
+            RecordingCommandList list;
+            RecordingCache cache;
+            cache.attach(&list);
+            DescriptorHeap *heaps[] = { &objects.descriptorHeaps[0], &objects.descriptorHeaps[1] };
+            DescriptorHeap *otherHeaps[] = { &objects.descriptorHeaps[2], &objects.descriptorHeaps[1] };
+            cache.SetDescriptorHeaps(2u, heaps);
+            cache.SetGraphicsRootDescriptorTable(0u, table);
+            cache.SetComputeRootDescriptorTable(0u, table);
+            cache.SetGraphicsRootConstantBufferView(1u, 0x2000u);
+            cache.SetComputeRoot32BitConstants(1u, 4u, constants, 0u);
+            const uint64_t bound = list.getCalls();
+
+            cache.SetDescriptorHeaps(2u, heaps);
+            cache.SetGraphicsRootDescriptorTable(0u, table);
+            cache.SetComputeRootDescriptorTable(0u, table);
+            report(list.getCalls() == bound, "the same descriptor heaps keep the tables");
+
+            cache.SetDescriptorHeaps(2u, otherHeaps);
+            cache.SetGraphicsRootDescriptorTable(0u, table);
+            cache.SetComputeRootDescriptorTable(0u, table);
+            report(list.getCalls() == bound + 3u, "new descriptor heaps invalidate graphics and compute tables");
+
+            cache.SetGraphicsRootConstantBufferView(1u, 0x2000u);
+            cache.SetComputeRoot32BitConstants(1u, 4u, constants, 0u);
+            report(list.getCalls() == bound + 3u, "new descriptor heaps keep the other root arguments");
+        }
+
+        // Reset
+        {
+            RecordingCommandList list;
+            RecordingCache cache;
+            cache.attach(&list);
+            const Viewport viewport = { 0.0f, 0.0f, 1280.0f, 720.0f, 0.0f, 1.0f };
+            const VertexBufferView vertexBuffer = { 0x5000u, 256u, 16u };
+            DescriptorHeap *heaps[] = { &objects.descriptorHeaps[0] };
+            auto bindAll = [&]()
+            {
+                cache.SetPipelineState(&objects.pipelineStates[0]);
+                cache.SetGraphicsRootSignature(&objects.rootSignatures[0]);
+                cache.SetComputeRootSignature(&objects.rootSignatures[0]);
+                cache.SetDescriptorHeaps(1u, heaps);
+                cache.SetGraphicsRootDescriptorTable(0u, table);
+                cache.SetComputeRoot32BitConstants(1u, 4u, constants, 0u);
+                cache.RSSetViewports(1u, &viewport);
+                cache.IASetPrimitiveTopology(TopologyTriangleList);
+                cache.IASetVertexBuffers(0u, 1u, &vertexBuffer);
+            };
+            bindAll();
+            const uint64_t bound = list.getCalls();
+            cache.Reset(&objects.allocator, &objects.pipelineStates[0]);
+            bindAll();
+            report(list.getCalls() == bound * 2u, "Reset forwards every later call but the initial pipeline");
+        }
+
+        // Root constants
+        {
+            RecordingCommandList list;
+            RecordingCache cache;
+            cache.attach(&list);
+            const uint32_t changed[] = { 2u, 9u };
+            cache.SetGraphicsRoot32BitConstants(0u, 4u, constants, 0u);
+            cache.SetGraphicsRoot32BitConstants(0u, 2u, constants + 1, 1u);
+            cache.SetGraphicsRoot32BitConstant(0u, 4u, 3u);
+            report(list.getCalls() == 1u, "constants inside a bound range are filtered");
+            cache.SetGraphicsRoot32BitConstants(0u, 2u, changed, 1u);
+            cache.SetGraphicsRoot32BitConstants(0u, 2u, constants, 4u);
+            report(list.getCalls() == 3u, "changed or unset constants are forwarded");
+
+            const uint32_t past = RecordingCache::MaxRootConstants - 1u;
+            cache.SetGraphicsRoot32BitConstants(0u, 2u, constants, past);
+            cache.SetGraphicsRoot32BitConstants(0u, 2u, constants, past);
+            report(list.getCalls() == 5u, "constants past the cached range are always forwarded");
+        }
+
+        // Vertex and index buffers
+        {
+            RecordingCommandList list;
+            RecordingCache cache;
+            cache.attach(&list);
+            const VertexBufferView vertexBuffers[] = { { 0x5000u, 256u, 16u }, { 0x6000u, 256u, 32u } };
+            const IndexBufferView indexBuffer = { 0x7000u, 256u, 42u };
+            cache.IASetVertexBuffers(0u, 2u, vertexBuffers);
+            cache.IASetVertexBuffers(1u, 1u, vertexBuffers + 1);
+            cache.IASetIndexBuffer(&indexBuffer);
+            cache.IASetIndexBuffer(&indexBuffer);
+            report(list.getCalls() == 2u, "bound vertex and index buffers are filtered");
+            cache.IASetVertexBuffers(1u, 1u, static_cast<const VertexBufferView *>(nullptr));
+            cache.IASetVertexBuffers(1u, 1u, vertexBuffers + 1);
+            cache.IASetIndexBuffer(static_cast<const IndexBufferView *>(nullptr));
+            cache.IASetIndexBuffer(&indexBuffer);
+            report(list.getCalls() == 6u, "unbinding forces the next bind through");
+        }
+
+        // Random streams against the model
+        {
+            RandomCallStream stream(objects, options.seed);
+            bool sameStates = true;
+            bool countsAdd = true;
+            uint64_t draws = 0u;
+            uint64_t filtered = 0u;
+            uint64_t stateCalls = 0u;
+            for (uint32_t run = 0u; run < 64u; ++run)
+            {
+                RecordingCommandList cachedList;
+                RecordingCommandList directList;
+                RecordingCache cache;
+                cache.attach(&cachedList);
+                const uint64_t calls = stream.run(cache, directList, options.draws * 5u);
+
+                sameStates = sameStates && cachedList.getDrawStates() == directList.getDrawStates();
+                countsAdd = countsAdd && cache.getStats().issuedCalls + cache.getStats().filteredCalls == calls &&
+                    cache.getStats().issuedCalls == cachedList.getCalls() && directList.getCalls() == calls;
+                draws += directList.getDrawStates().size();
+                filtered += cache.getStats().filteredCalls;
+                stateCalls += calls;
+            }
+            report(sameStates, "random streams: " + std::to_string(draws) + " draws see the same state");
+            report(countsAdd, "random streams: every call is issued or filtered");
+            report(filtered > 0u && filtered < stateCalls, "random streams: " + std::to_string(filtered * 100u / stateCalls) + "% of the calls filtered");
+        }
+
+        std::cout << "\n";
+        return passed;
+    }
+
+    template<typename Work>
+    double measure(Work work)
+    {
+        uint32_t runs = 0u;
+        const Clock::time_point start = Clock::now();
+        do
+        {
+            work();
+            ++runs;
+        } while (millisecondsSince(start) < 200.0);
+        return millisecondsSince(start) / runs;
+    }
+
+    // One material, mesh and object constant set per draw
+    struct DrawItem
+    {
+        uint32_t pipeline;
+        uint32_t material;
+        uint32_t mesh;
+        uint32_t object;
+    };
+
+    // A frame the way Renderer records one: a root signature and heaps up front, then per draw
+    // the pipeline, material table, per object constants, topology and buffers
+    template <typename Target>
+    void recordFrame(Target &target, Objects &objects, const std::vector<DrawItem> &items)
+    {
+        DescriptorHeap *heaps[] = { &objects.descriptorHeaps[0] };
+        const Viewport viewport = { 0.0f, 0.0f, 1280.0f, 720.0f, 0.0f, 1.0f };
+        const Rect scissor = { 0, 0, 1280, 720 };
+        target.Reset(&objects.allocator, static_cast<PipelineState *>(nullptr));
+        target.SetGraphicsRootSignature(&objects.rootSignatures[0]);
+        target.SetDescriptorHeaps(1u, heaps);
+        for (const DrawItem &item : items)
+        {
+            const uint32_t objectConstants[4] = { item.object, item.object * 3u, 0u, 1u };
+            const VertexBufferView vertexBuffer = { 0x100000u + item.mesh * 4096u, 4096u, 32u };
+            const IndexBufferView indexBuffer = { 0x200000u + item.mesh * 1024u, 1024u, 42u };
+            target.SetPipelineState(&objects.pipelineStates[item.pipeline]);
+            target.RSSetViewports(1u, &viewport);
+            target.RSSetScissorRects(1u, &scissor);
+            target.SetGraphicsRootDescriptorTable(0u, GpuDescriptorHandle{ 0x1000u + item.material * 64u });
+            target.SetGraphicsRootConstantBufferView(1u, 0x2000u);
+            target.SetGraphicsRoot32BitConstants(2u, 4u, objectConstants, 0u);
+            target.IASetPrimitiveTopology(TopologyTriangleList);
+            target.IASetVertexBuffers(0u, 1u, &vertexBuffer);
+            target.IASetIndexBuffer(&indexBuffer);
+        }
+    }
+
+    void benchmark(const Options &options)
+    {
+        Objects objects;
+        std::mt19937 random(options.seed);
+
+        struct Workload
+        {
+            const char *name;
+            std::vector<DrawItem> items;
+        };
+        std::vector<Workload> workloads(3u);
+        workloads[0].name = "sorted";
+        workloads[1].name = "unsorted";
+        workloads[2].name = "all distinct";
+        for (uint32_t i = 0u; i < options.draws; ++i)
+        {
+            const DrawItem item = { static_cast<uint32_t>(random() % 4u), static_cast<uint32_t>(random() % 16u), static_cast<uint32_t>(random() % 8u), i / 4u };
+            workloads[0].items.push_back(item);
+            workloads[1].items.push_back(item);
+            workloads[2].items.push_back({ i % 4u, i, i, i });
+        }
+        std::sort(workloads[0].items.begin(), workloads[0].items.end(), [](const DrawItem &a, const DrawItem &b)
+        {
+            return a.pipeline != b.pipeline ? a.pipeline < b.pipeline : a.material != b.material ? a.material < b.material : a.mesh < b.mesh;
+        });
+
+        std::cout << std::left << std::setw(14) << "Workload" << std::right << std::setw(10) << "Draws" << std::setw(10) << "Calls"
+                  << std::setw(12) << "Forwarded" << std::setw(11) << "Filtered" << std::setw(12) << "Frame ms" << std::setw(14) << "ns/call" << "\n";
+        std::cout << std::fixed;
+        for (const Workload &workload : workloads)
+        {
+            CountingCommandList directList;
+            CountingCommandList cachedList;
+            CommandListStateCache<CountingCommandList> cache;
+            cache.attach(&cachedList);
+
+            recordFrame(directList, objects, workload.items);
+            cache.resetStats();
+            recordFrame(cache, objects, workload.items);
+            const uint64_t calls = directList.calls;
+            const uint64_t forwarded = cache.getStats().issuedCalls;
+
+            const double cached = measure([&]() { recordFrame(cache, objects, workload.items); });
+
+            std::cout << std::left << std::setw(14) << workload.name << std::right << std::setw(10) << workload.items.size() << std::setw(10) << calls
+                      << std::setw(12) << forwarded << std::setprecision(1) << std::setw(10) << 100.0 * (calls - forwarded) / calls << "%"
+                      << std::setprecision(3) << std::setw(12) << cached << std::setprecision(2) << std::setw(14) << cached * 1e6 / calls << "\n";
+        }
+        std::cout << std::flush;
+    }
+
+    bool parseArguments(int argc, char **argv, Options &options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string argument = argv[i];
+            const bool hasValue = i + 1 < argc;
+
+            if (argument == "--draws" && hasValue)
+            {
+                options.draws = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (argument == "--seed" && hasValue)
+            {
+                options.seed = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else
+            {
+                return false;
+            }
+        }
+        return options.draws > 0u;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseArguments(argc, argv, options))
+    {
+        std::cerr << "Usage: CommandListCacheBench [--draws <n>] [--seed <n>]" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Draws per frame: " << options.draws << ", cached root constants: " << CommandListStateCache<CountingCommandList>::MaxRootConstants << "\n\n";
+
+    const bool passed = check(options);
+    benchmark(options);
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,364 @@
+// EngineLoop, TripleBuffer and SpscQueue check and benchmark.
+//
+// Runs the two lock-free hand-offs between real threads under contention and checks that:
+//  - SpscQueue delivers every item once, in order and untorn, also while it runs full
+//  - TripleBuffer hands the reader untorn snapshots in publish order, each one unchanged until
+//    the next acquire, and the last one published once the writer stops
+//  - EngineLoop keeps its tick rate while frames take longer than a tick, loses no input and
+//    shows every input within a tick and two frames
+// Then the hand-off latency of both primitives and the input to display latency of EngineLoop
+// at several frame times are measured. Build it with -fsanitize=thread off Windows to have the
+// checks also run under ThreadSanitizer, the timings are meaningless then.
+//
+// Usage:
+//   EngineLoopBench [--items <n>] [--seconds <s>]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "EngineLoop.h"
+#include "SpscQueue.h"
+#include "TripleBuffer.h"
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    double millisecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    uint64_t nowNanoseconds()
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count());
+    }
+
+    struct Options
+    {
+        uint32_t items = 1000000u;
+        double seconds = 1.0;
+    };
+
+    // Every word holds the sequence number, so a torn copy shows as a mismatch
+    struct QueueItem
+    {
+        uint64_t sequence;
+        uint64_t pushNanoseconds;
+        uint64_t words[6];
+    };
+
+    struct Snapshot
+    {
+        uint64_t sequence;
+        uint64_t publishNanoseconds;
+        uint64_t words[30];
+    };
+
+    template <typename T>
+    bool untorn(const T &value)
+    {
+        return std::all_of(std::begin(value.words), std::end(value.words), [&value](uint64_t word) { return word == value.sequence; });
+    }
+
+    double percentile(std::vector<double> values, double fraction)
+    {
+        if (values.empty())
+        {
+            return 0.0;
+        }
+        const size_t index = (std::min)(static_cast<size_t>(fraction * values.size()), values.size() - 1u);
+        std::nth_element(values.begin(), values.begin() + index, values.end());
+        return values[index];
+    }
+
+    struct QueueRun
+    {
+        bool inOrder = true;
+        bool untornItems = true;
+        uint64_t received = 0u;
+        uint64_t fullPushes = 0u;
+        double milliseconds = 0.0;
+        std::vector<double> latencyMicroseconds;
+    };
+
+    // The producer retries while the queue is full, the consumer pops as fast as it can but stalls
+    // now and then so the queue also fills up where both threads have their own core
+    QueueRun runQueue(uint32_t items)
+    {
+        static SpscQueue<QueueItem, 256> queue;
+        QueueRun run;
+        run.latencyMicroseconds.reserve(items);
+
+        const Clock::time_point start = Clock::now();
+        std::thread producer([&run, items]()
+        {
+            for (uint64_t sequence = 0u; sequence < items; ++sequence)
+            {
+                QueueItem item;
+                item.sequence = sequence;
+                std::fill(std::begin(item.words), std::end(item.words), sequence);
+                item.pushNanoseconds = nowNanoseconds();
+                while (!queue.push(item))
+                {
+                    ++run.fullPushes;
+                    std::this_thread::yield();
+                }
+            }
+        });
+
+        QueueItem item;
+        while (run.received < items)
+        {
+            if (!queue.pop(item))
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            run.latencyMicroseconds.push_back((nowNanoseconds() - item.pushNanoseconds) / 1000.0);
+            run.inOrder = run.inOrder && item.sequence == run.received;
+            run.untornItems = run.untornItems && untorn(item);
+            if ((++run.received & 0xffffu) == 0u)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+        producer.join();
+        run.milliseconds = millisecondsSince(start);
+        run.inOrder = run.inOrder && !queue.pop(item);
+        return run;
+    }
+
+    struct TripleBufferRun
+    {
+        bool untornSnapshots = true;
+        bool inOrder = true;
+        bool stable = true;
+        bool lastSeen = false;
+        uint64_t acquires = 0u;
+        uint64_t distinct = 0u;
+        double milliseconds = 0.0;
+        std::vector<double> latencyMicroseconds;
+    };
+
+    TripleBufferRun runTripleBuffer(uint32_t publishes)
+    {
+        TripleBuffer<Snapshot> buffer;
+        TripleBufferRun run;
+        std::atomic<bool> done(false);
+
+        const bool emptyAtFirst = buffer.acquireLatest() == nullptr;
+
+        const Clock::time_point start = Clock::now();
+        std::thread writer([&buffer, &done, publishes]()
+        {
+            for (uint64_t sequence = 1u; sequence <= publishes; ++sequence)
+            {
+                Snapshot &snapshot = buffer.beginWrite();
+                snapshot.sequence = sequence;
+                std::fill(std::begin(snapshot.words), std::end(snapshot.words), sequence);
+                snapshot.publishNanoseconds = nowNanoseconds();
+                buffer.publish();
+                if ((sequence & 63u) == 0u)
+                {
+                    std::this_thread::yield();
+                }
+            }
+            done.store(true, std::memory_order_release);
+        });
+
+        uint64_t lastSequence = 0u;
+        while (true)
+        {
+            const bool writerDone = done.load(std::memory_order_acquire);
+            const Snapshot *snapshot = buffer.acquireLatest();
+            ++run.acquires;
+            if (snapshot != nullptr)
+            {
+                const uint64_t sequence = snapshot->sequence;
+                run.untornSnapshots = run.untornSnapshots && untorn(*snapshot);
+                run.inOrder = run.inOrder && sequence >= lastSequence;
+                if (sequence != lastSequence)
+                {
+                    run.latencyMicroseconds.push_back((nowNanoseconds() - snapshot->publishNanoseconds) / 1000.0);
+                    ++run.distinct;
+                }
+                lastSequence = sequence;
+
+                // The writer keeps publishing meanwhile, the slot must not change under the reader
+                std::this_thread::yield();
+                run.stable = run.stable && snapshot->sequence == sequence && untorn(*snapshot);
+            }
+            if (writerDone)
+            {
+                run.lastSeen = lastSequence == publishes;
+                break;
+            }
+        }
+        writer.join();
+        run.milliseconds = millisecondsSince(start);
+        run.inOrder = run.inOrder && emptyAtFirst;
+        return run;
+    }
+
+    struct LoopRun
+    {
+        EngineLoop::Stats stats;
+        uint64_t pushedEvents = 0u;
+        double seconds = 0.0;
+    };
+
+    // Renders take frameMilliseconds, input arrives every millisecond from its own thread
+    LoopRun runLoop(double frameMilliseconds, double seconds)
+    {
+        LoopRun run;
+        EngineLoop loop([frameMilliseconds](const SceneState &)
+        {
+            std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(frameMilliseconds));
+        });
+
+        const Clock::time_point start = Clock::now();
+        loop.start();
+        std::thread input([&loop, &run, start, seconds]()
+        {
+            Clock::time_point next = start;
+            while (millisecondsSince(start) < seconds * 1000.0)
+            {
+                InputEvent event;
+                event.type = InputEvent::Type::PointerMoved;
+                event.x = static_cast<float>(run.pushedEvents % 100u) * 0.01f;
+                event.y = 0.0f;
+                event.timestamp = Clock::now();
+                loop.pushInput(event);
+                ++run.pushedEvents;
+                next += std::chrono::milliseconds(1);
+                std::this_thread::sleep_until(next);
+            }
+        });
+        input.join();
+
+        // Let the last input reach the screen
+        std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(50.0 + 2.0 * frameMilliseconds));
+        loop.stop();
+        run.seconds = millisecondsSince(start) / 1000.0;
+        run.stats = loop.getStats();
+        return run;
+    }
+
+    bool check(const Options &options)
+    {
+        bool passed = true;
+        auto report = [&passed](bool condition, const std::string &what)
+        {
+            std::cout << std::left << std::setw(64) << what << (condition ? "ok" : "FAILED") << "\n";
+            passed = passed && condition;
+        };
+
+        {
+            const QueueRun run = runQueue(options.items);
+            report(run.received == options.items && run.inOrder, "queue delivers " + std::to_string(run.received) + " items once and in order");
+            report(run.untornItems, "queue items arrive untorn");
+            report(run.fullPushes > 0u, "queue ran full " + std::to_string(run.fullPushes) + " times and recovered");
+        }
+
+        {
+            const TripleBufferRun run = runTripleBuffer(options.items);
+            report(run.inOrder, "triple buffer is empty first, then moves forward only");
+            report(run.untornSnapshots && run.stable, "snapshots are untorn and stable until the next acquire");
+            report(run.lastSeen, "the last published snapshot is the one left");
+            report(run.distinct > 1u && run.distinct < options.items, "reader skipped to the newest " + std::to_string(run.distinct) + " times");
+        }
+
+        {
+            const EngineLoop::Settings settings;
+            const double stepMilliseconds = 1000.0 / settings.simulationRate;
+            const double frameMilliseconds = 25.0;
+            const LoopRun run = runLoop(frameMilliseconds, options.seconds);
+            const double tickRate = run.stats.simulationTicks / run.seconds;
+            report(tickRate > settings.simulationRate * 0.9 && tickRate < settings.simulationRate * 1.1,
+                "ticks stay at the simulation rate with 25 ms frames");
+            report(run.stats.droppedInputEvents == 0u && run.stats.latencySamples > 0u, "no input dropped at 1 kHz");
+            report(run.stats.maxInputLatencyMs < stepMilliseconds + 2.0 * frameMilliseconds + 10.0,
+                "input shows within a tick and two frames");
+        }
+
+        std::cout << "\n";
+        return passed;
+    }
+
+    void benchmark(const Options &options)
+    {
+        std::cout << std::fixed << std::setprecision(1);
+        {
+            const QueueRun queueRun = runQueue(options.items);
+            const TripleBufferRun bufferRun = runTripleBuffer(options.items);
+            std::cout << std::left << std::setw(16) << "Hand-off" << std::right << std::setw(12) << "Items/ms" << std::setw(12) << "Delivered"
+                      << std::setw(12) << "p50 us" << std::setw(12) << "p99 us" << "\n";
+            std::cout << std::left << std::setw(16) << "SpscQueue" << std::right << std::setw(12) << options.items / queueRun.milliseconds
+                      << std::setw(12) << queueRun.received << std::setw(12) << percentile(queueRun.latencyMicroseconds, 0.5)
+                      << std::setw(12) << percentile(queueRun.latencyMicroseconds, 0.99) << "\n";
+            std::cout << std::left << std::setw(16) << "TripleBuffer" << std::right << std::setw(12) << options.items / bufferRun.milliseconds
+                      << std::setw(12) << bufferRun.distinct << std::setw(12) << percentile(bufferRun.latencyMicroseconds, 0.5)
+                      << std::setw(12) << percentile(bufferRun.latencyMicroseconds, 0.99) << "\n\n";
+        }
+
+        std::cout << std::left << std::setw(16) << "Frame ms" << std::right << std::setw(10) << "FPS" << std::setw(10) << "Ticks/s"
+                  << std::setw(10) << "Stale" << std::setw(12) << "Dropped" << std::setw(16) << "Input avg ms" << std::setw(16) << "Input max ms" << "\n";
+        for (const double frameMilliseconds : { 2.0, 8.0, 16.0, 33.0 })
+        {
+            const LoopRun run = runLoop(frameMilliseconds, options.seconds);
+            const EngineLoop::Stats &stats = run.stats;
+            std::cout << std::left << std::setw(16) << frameMilliseconds << std::right << std::setw(10) << stats.renderedFrames / run.seconds
+                      << std::setw(10) << stats.simulationTicks / run.seconds
+                      << std::setw(9) << 100.0 * stats.staleFrames / (std::max)(stats.renderedFrames, uint64_t(1u)) << "%"
+                      << std::setw(12) << stats.droppedInputEvents << std::setw(16) << stats.averageInputLatencyMs << std::setw(16) << stats.maxInputLatencyMs << "\n";
+        }
+        std::cout << std::flush;
+    }
+
+    bool parseArguments(int argc, char **argv, Options &options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string argument = argv[i];
+            const bool hasValue = i + 1 < argc;
+
+            if (argument == "--items" && hasValue)
+            {
+                options.items = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (argument == "--seconds" && hasValue)
+            {
+                options.seconds = std::stod(argv[++i]);
+            }
+            else
+            {
+                return false;
+            }
+        }
+        return options.items > 1u && options.seconds > 0.0;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseArguments(argc, argv, options))
+    {
+        std::cerr << "Usage: EngineLoopBench [--items <n>] [--seconds <s>]" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Items: " << options.items << ", seconds per loop run: " << options.seconds
+              << ", hardware threads: " << std::thread::hardware_concurrency() << "\n\n";
+
+    const bool passed = check(options);
+    benchmark(options);
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,264 @@
+// GPU memory snapshot diff tool.
+//
+// Compares two snapshots written by writeGpuMemorySnapshot and prints how the live bytes of
+// every heap type and category changed, followed by the resources that were added, removed or
+// resized in between. Resources are matched by name, category, heap and source, so snapshots
+// from two runs of the engine compare as well as two taken in one run.
+//
+// --report replays a synthetic session through GpuResourceRegistry: the renderer's start up
+// resources, a resize that recreates the size dependent targets and a slow leak of upload
+// buffers. It prints the registry's cost per resource, checks that snapshots survive a round trip
+// through the text format, and that the diff and leak report find exactly what was leaked.
+//
+// Usage:
+//   GpuMemoryDiff <before.txt> <after.txt>
+//   GpuMemoryDiff --report [--resources <n>] [--jobs <n>]
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "GpuResourceRegistry.h"
+#include "WorkerPool.h"
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    double millisecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    struct Options
+    {
+        std::string beforePath;
+        std::string afterPath;
+        bool report = false;
+        uint32_t resources = 100000u;
+        uint32_t jobs = 0u;
+    };
+
+    bool loadSnapshot(const std::string &path, GpuMemorySnapshot &snapshot)
+    {
+        std::ifstream file(path);
+        if (!file || !readGpuMemorySnapshot(file, snapshot))
+        {
+            std::cerr << "Could not read snapshot " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool sameRecords(const GpuMemorySnapshot &a, const GpuMemorySnapshot &b)
+    {
+        return a.frame == b.frame && std::equal(a.resources.begin(), a.resources.end(), b.resources.begin(), b.resources.end(),
+            [](const GpuResourceRecord &x, const GpuResourceRecord &y)
+            {
+                return x.id == y.id && x.name == y.name && x.category == y.category && x.heap == y.heap && x.size == y.size &&
+                    x.createdFrame == y.createdFrame && x.source == y.source;
+            });
+    }
+
+    // The renderer's long lived resources at a given surface size
+    void addSurfaceResources(GpuResourceRegistry &registry, uint32_t width, uint32_t height, std::vector<GpuResourceRegistry::ResourceId> &ids)
+    {
+        uint64_t pixels = static_cast<uint64_t>(width) * height;
+        ids.push_back(registry.add("uav buffer", GpuResourceCategory::UnorderedAccess, GpuHeapType::Default, pixels * 4u, GPU_RESOURCE_SOURCE));
+        ids.push_back(registry.add("scene target", GpuResourceCategory::RenderTargets, GpuHeapType::Default, pixels * 4u, GPU_RESOURCE_SOURCE));
+        ids.push_back(registry.add("back buffer 0", GpuResourceCategory::RenderTargets, GpuHeapType::Default, pixels * 4u, GPU_RESOURCE_SOURCE));
+        ids.push_back(registry.add("back buffer 1", GpuResourceCategory::RenderTargets, GpuHeapType::Default, pixels * 4u, GPU_RESOURCE_SOURCE));
+    }
+
+    bool report(const Options &options, WorkerPool &workerPool)
+    {
+        bool passed = true;
+        auto check = [&passed](bool condition, const char *what)
+        {
+            std::cout << std::left << std::setw(56) << what << (condition ? "ok" : "FAILED") << "\n";
+            passed = passed && condition;
+        };
+
+        std::cout << std::fixed << std::setprecision(1);
+        std::cout << "Threads: " << workerPool.getThreadCount() << "\n\n";
+
+        // Registration cost, every thread adding and removing its share
+        {
+            GpuResourceRegistry registry;
+            const uint32_t batchCount = workerPool.getThreadCount() * 4u;
+            const uint32_t perBatch = (std::max)(options.resources / batchCount, 1u);
+            uint32_t runs = 0u;
+            const Clock::time_point start = Clock::now();
+            do
+            {
+                workerPool.parallelFor(batchCount, [&](uint32_t)
+                {
+                    std::vector<GpuResourceRegistry::ResourceId> ids(perBatch);
+                    for (uint32_t i = 0u; i < perBatch; ++i)
+                    {
+                        ids[i] = registry.add("transient", static_cast<GpuResourceCategory>(i % GpuResourceCategoryCount),
+                            static_cast<GpuHeapType>(i % GpuHeapTypeCount), 65536u, GPU_RESOURCE_SOURCE);
+                    }
+                    for (GpuResourceRegistry::ResourceId id : ids)
+                    {
+                        registry.remove(id);
+                    }
+                });
+                ++runs;
+            } while (millisecondsSince(start) < 200.0);
+            const double nanoseconds = millisecondsSince(start) * 1e6 / (static_cast<double>(runs) * batchCount * perBatch);
+
+            std::cout << "Add and remove: " << nanoseconds << " ns per resource\n\n";
+            check(registry.getLiveCount() == 0u && registry.getHeapBytes(GpuHeapType::Default) == 0u, "registry empty after concurrent churn");
+            check(registry.getPeakHeapBytes(GpuHeapType::Default) > 0u, "peak bytes kept");
+        }
+
+        // A session: start up, a resize and upload buffers that are never released
+        GpuResourceRegistry registry(64u);
+        std::vector<GpuResourceRegistry::ResourceId> startup;
+        startup.push_back(registry.add("vertex buffer", GpuResourceCategory::Geometry, GpuHeapType::Upload, 65536u, GPU_RESOURCE_SOURCE));
+        startup.push_back(registry.add("index buffer", GpuResourceCategory::Geometry, GpuHeapType::Upload, 65536u, GPU_RESOURCE_SOURCE));
+        startup.push_back(registry.add("uniform buffer", GpuResourceCategory::Constants, GpuHeapType::Upload, 65536u, GPU_RESOURCE_SOURCE));
+        startup.push_back(registry.add("sprite atlas", GpuResourceCategory::Textures, GpuHeapType::Default, 4096u * 4096u, GPU_RESOURCE_SOURCE));
+        startup.push_back(registry.add("timestamp readback", GpuResourceCategory::Readback, GpuHeapType::Readback, 65536u, GPU_RESOURCE_SOURCE));
+        std::vector<GpuResourceRegistry::ResourceId> surface;
+        addSurfaceResources(registry, 1920u, 1080u, surface);
+
+        GpuMemorySnapshot first;
+        std::vector<GpuResourceRegistry::ResourceId> leaked;
+        const uint32_t frameCount = 200u;
+        for (uint32_t frame = 0u; frame < frameCount; ++frame)
+        {
+            if (frame == 10u)
+            {
+                registry.captureSnapshot(first);
+            }
+            if (frame == 100u)
+            {
+                for (GpuResourceRegistry::ResourceId id : surface)
+                {
+                    registry.remove(id);
+                }
+                surface.clear();
+                addSurfaceResources(registry, 2560u, 1440u, surface);
+            }
+            if (frame % 50u == 25u)
+            {
+                leaked.push_back(registry.add("sprite instances", GpuResourceCategory::Staging, GpuHeapType::Upload, 1u << 20, GPU_RESOURCE_SOURCE));
+            }
+            registry.endFrame();
+        }
+
+        GpuMemorySnapshot last;
+        registry.captureSnapshot(last);
+
+        std::stringstream text;
+        GpuMemorySnapshot reread;
+        check(writeGpuMemorySnapshot(last, text) && readGpuMemorySnapshot(text, reread) && sameRecords(last, reread), "snapshot text round trip");
+
+        GpuMemoryDiff diff;
+        diffGpuMemorySnapshots(first, reread, diff);
+        std::cout << "\nFrame " << first.frame << " to " << last.frame << "\n";
+        writeGpuMemoryDiff(diff, std::cout);
+        std::cout << "\n";
+        check(diff.added.size() == leaked.size() && diff.removed.empty() && diff.resized.size() == surface.size(),
+            "diff finds the new buffers and the resized targets");
+        check(diff.heapDeltas[static_cast<uint32_t>(GpuHeapType::Upload)] == static_cast<int64_t>(diff.added.size()) << 20,
+            "diff heap delta matches the added bytes");
+
+        std::vector<GpuMemorySample> history;
+        registry.getHistory(history);
+        check(history.size() == 64u && history.front().frame == frameCount - 64u && history.back().frame == frameCount - 1u, "history keeps the latest frames");
+
+        // Shutdown releases everything the renderer owns, the leaked buffers remain
+        for (GpuResourceRegistry::ResourceId id : startup)
+        {
+            registry.remove(id);
+        }
+        for (GpuResourceRegistry::ResourceId id : surface)
+        {
+            registry.remove(id);
+        }
+        std::ostringstream leaks;
+        uint32_t leakCount = registry.writeLeakReport(leaks);
+        std::cout << "\n" << leaks.str() << "\n";
+        check(leakCount == leaked.size(), "leak report lists every leaked buffer");
+
+        std::cout << std::flush;
+        return passed;
+    }
+
+    bool parseArguments(int argc, char **argv, Options &options)
+    {
+        std::vector<std::string> paths;
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string argument = argv[i];
+            const bool hasValue = i + 1 < argc;
+
+            if (argument == "--report")
+            {
+                options.report = true;
+            }
+            else if (argument == "--resources" && hasValue)
+            {
+                options.resources = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (argument == "--jobs" && hasValue)
+            {
+                options.jobs = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (argument.compare(0u, 2u, "--") != 0)
+            {
+                paths.push_back(argument);
+            }
+            else
+            {
+                return false;
+            }
+        }
+
+        if (paths.size() == 2u)
+        {
+            options.beforePath = paths[0];
+            options.afterPath = paths[1];
+        }
+        return options.report ? paths.empty() : paths.size() == 2u;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseArguments(argc, argv, options))
+    {
+        std::cerr << "Usage: GpuMemoryDiff <before.txt> <after.txt>\n"
+                  << "       GpuMemoryDiff --report [--resources <n>] [--jobs <n>]" << std::endl;
+        return 1;
+    }
+
+    if (options.report)
+    {
+        WorkerPool workerPool(options.jobs);
+        return report(options, workerPool) ? 0 : 1;
+    }
+
+    GpuMemorySnapshot before;
+    GpuMemorySnapshot after;
+    if (!loadSnapshot(options.beforePath, before) || !loadSnapshot(options.afterPath, after))
+    {
+        return 1;
+    }
+
+    GpuMemoryDiff diff;
+    diffGpuMemorySnapshots(before, after, diff);
+    std::cout << "Frame " << before.frame << " to " << after.frame << "\n";
+    writeGpuMemoryDiff(diff, std::cout);
+    std::cout << std::flush;
+    return 0;
+}
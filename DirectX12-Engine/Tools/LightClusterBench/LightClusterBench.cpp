@@ -0,0 +1,323 @@
+// Clustered light binning check and benchmark.
+//
+// Bins random lights spread through the view frustum with LightClusterGrid, plus lights that
+// cross the near plane, sit behind the camera or beyond the far plane, and checks that:
+//  - build() matches buildReference() exactly, on one thread and on the worker pool
+//  - binning is conservative: points sampled inside every light land, the way the pixel shader
+//    finds its cluster, in a cluster that lists the light
+//  - a full light index list drops the farthest clusters' lights and still matches the reference
+//  - the shader's log2 slice formula agrees with the binning slices away from the boundaries
+// Then every light count is timed with the reference, SIMD on one thread and SIMD on the pool.
+//
+// Usage:
+//   LightClusterBench [--lights <n>...] [--jobs <n>] [--seed <n>]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "LightClusterGrid.h"
+#include "WorkerPool.h"
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    double millisecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    struct Options
+    {
+        std::vector<uint32_t> lightCounts;
+        uint32_t jobs = 0u;
+        uint32_t seed = 1u;
+    };
+
+    // A 16:9 view with a 60 degree vertical field of view
+    LightClusterConfig makeConfig()
+    {
+        const Mat4 projection = perspectiveMatrix(60.0f * 3.14159265f / 180.0f, 16.0f / 9.0f, 0.1f, 100.0f);
+
+        LightClusterConfig config;
+        config.nearZ = 0.1f;
+        config.farZ = 100.0f;
+        config.projectionScaleX = projection.r[0].x;
+        config.projectionScaleY = projection.r[1].y;
+        config.maxLightIndices = 1u << 24; // Room for the largest light count, the limit is checked on its own
+        return config;
+    }
+
+    // Lights fill the frustum out to half the far plane and a little past its sides, the first few
+    // are the awkward cases
+    std::vector<ClusterLight> makeLights(const LightClusterConfig &config, uint32_t count, std::mt19937 &random)
+    {
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        std::vector<ClusterLight> lights(count);
+        for (ClusterLight &light : lights)
+        {
+            const float z = 0.5f + unit(random) * 49.5f;
+            light.position = Vec3{ (unit(random) * 2.4f - 1.2f) * z / config.projectionScaleX, (unit(random) * 2.4f - 1.2f) * z / config.projectionScaleY, z };
+            light.radius = 0.25f + unit(random) * 1.75f;
+            light.color = Vec3{ unit(random), unit(random), unit(random) };
+            light.padding = 0.0f;
+        }
+
+        // The first lights are replaced by black ones in awkward places
+        auto placeAwkward = [&lights](uint32_t index, const Vec3 &position, float radius)
+        {
+            if (index < lights.size())
+            {
+                ClusterLight light{};
+                light.position = position;
+                light.radius = radius;
+                lights[index] = light;
+            }
+        };
+        placeAwkward(0u, Vec3{ 0.0f, 0.0f, 0.0f }, 1.0f);       // Around the eye
+        placeAwkward(1u, Vec3{ 0.5f, -0.3f, 0.4f }, 0.5f);      // Crossing the near plane
+        placeAwkward(2u, Vec3{ 0.0f, 0.0f, -5.0f }, 1.0f);      // Behind the camera
+        placeAwkward(3u, Vec3{ 0.0f, 0.0f, 0.05f }, 0.04f);     // Wholly in front of the near plane
+        placeAwkward(4u, Vec3{ 0.0f, 0.0f, 150.0f }, 10.0f);    // Beyond the far plane
+        placeAwkward(5u, Vec3{ 0.0f, 0.0f, 99.5f }, 2.0f);      // Crossing the far plane
+        placeAwkward(6u, Vec3{ 40.0f, 0.0f, 5.0f }, 1.0f);      // Off to the side
+        placeAwkward(7u, Vec3{ 0.0f, 0.0f, 20.0f }, 30.0f);     // Everywhere
+        return lights;
+    }
+
+    bool sameGrid(const LightClusterGrid &a, const LightClusterGrid &b)
+    {
+        return a.getDroppedCount() == b.getDroppedCount() && a.getLightIndices() == b.getLightIndices() &&
+            std::equal(a.getClusters().begin(), a.getClusters().end(), b.getClusters().begin(), b.getClusters().end(),
+                [](const LightClusterRange &x, const LightClusterRange &y) { return x.offset == y.offset && x.count == y.count; });
+    }
+
+    // Samples every light's volume and looks each sample's cluster up the way the pixel shader
+    // does, returns the number of samples whose cluster misses the light
+    uint32_t countMissedSamples(const LightClusterGrid &grid, const std::vector<ClusterLight> &lights, std::mt19937 &random, uint32_t &testedSamples)
+    {
+        const LightClusterConfig &config = grid.getConfig();
+        std::uniform_real_distribution<float> signedUnit(-1.0f, 1.0f);
+
+        uint32_t missed = 0u;
+        testedSamples = 0u;
+        const uint32_t step = (std::max)(static_cast<uint32_t>(lights.size()) / 4096u, 1u);
+        for (uint32_t i = 0u; i < lights.size(); i += step)
+        {
+            const ClusterLight &light = lights[i];
+            for (uint32_t sample = 0u; sample < 64u; ++sample)
+            {
+                // Points just inside the sphere, so rounding cannot push them out
+                Vec3 direction;
+                do
+                {
+                    direction = Vec3{ signedUnit(random), signedUnit(random), signedUnit(random) };
+                } while (lengthSquared(direction) > 1.0f || lengthSquared(direction) < 1e-6f);
+                const float distance = sample < 32u ? light.radius * 0.999f : light.radius * 0.999f * std::sqrt(signedUnit(random) * 0.5f + 0.5f);
+                const Vec3 point = light.position + normalize(direction) * distance;
+
+                if (point.z < config.nearZ || point.z >= config.farZ)
+                {
+                    continue;
+                }
+                const float ndcX = point.x * config.projectionScaleX / point.z;
+                const float ndcY = point.y * config.projectionScaleY / point.z;
+                if (ndcX < -1.0f || ndcX >= 1.0f || ndcY <= -1.0f || ndcY > 1.0f)
+                {
+                    continue;
+                }
+
+                const uint32_t x = (std::min)(static_cast<uint32_t>((ndcX * 0.5f + 0.5f) * config.tilesX), config.tilesX - 1u);
+                const uint32_t y = (std::min)(static_cast<uint32_t>((0.5f - ndcY * 0.5f) * config.tilesY), config.tilesY - 1u);
+                const LightClusterRange &cluster = grid.getClusters()[grid.getClusterIndex(x, y, grid.getSlice(point.z))];
+                const uint32_t *begin = grid.getLightIndices().data() + cluster.offset;
+                ++testedSamples;
+                missed += std::binary_search(begin, begin + cluster.count, i) ? 0u : 1u;
+            }
+        }
+        return missed;
+    }
+
+    bool check(const Options &options, WorkerPool &workerPool)
+    {
+        bool passed = true;
+        auto report = [&passed](bool condition, const std::string &what)
+        {
+            std::cout << std::left << std::setw(64) << what << (condition ? "ok" : "FAILED") << "\n";
+            passed = passed && condition;
+        };
+
+        const LightClusterConfig config = makeConfig();
+        std::mt19937 random(options.seed);
+
+        for (uint32_t count : options.lightCounts)
+        {
+            const std::vector<ClusterLight> lights = makeLights(config, count, random);
+            LightClusterGrid reference(config);
+            LightClusterGrid single(config);
+            LightClusterGrid threaded(config);
+            reference.buildReference(lights.data(), count);
+            single.build(lights.data(), count, nullptr);
+            threaded.build(lights.data(), count, &workerPool);
+
+            const std::string name = std::to_string(count) + " lights: ";
+            report(sameGrid(reference, single) && sameGrid(reference, threaded), name + "build matches the reference");
+
+            uint32_t samples = 0u;
+            const uint32_t missed = countMissedSamples(threaded, lights, random, samples);
+            report(missed == 0u && samples > 0u, name + "conservative over " + std::to_string(samples) + " samples");
+        }
+
+        // Too small an index list
+        {
+            const uint32_t count = options.lightCounts.back();
+            const std::vector<ClusterLight> lights = makeLights(config, count, random);
+            LightClusterGrid unlimited(config);
+            unlimited.build(lights.data(), count, &workerPool);
+            const uint32_t needed = static_cast<uint32_t>(unlimited.getLightIndices().size());
+
+            LightClusterConfig limitedConfig = config;
+            limitedConfig.maxLightIndices = needed / 2u;
+            LightClusterGrid reference(limitedConfig);
+            LightClusterGrid limited(limitedConfig);
+            reference.buildReference(lights.data(), count);
+            limited.build(lights.data(), count, &workerPool);
+            report(sameGrid(reference, limited) && limited.getLightIndices().size() == limitedConfig.maxLightIndices &&
+                limited.getDroppedCount() == needed - limitedConfig.maxLightIndices, "full index list drops the excess like the reference");
+
+            bool nearKept = true;
+            for (uint32_t i = 0u; i < limited.getClusterCount() && unlimited.getClusters()[i].offset + unlimited.getClusters()[i].count <= limitedConfig.maxLightIndices; ++i)
+            {
+                nearKept = nearKept && limited.getClusters()[i].count == unlimited.getClusters()[i].count;
+            }
+            report(nearKept, "near clusters keep all their lights");
+        }
+
+        // The shader's slice against the binning slice, away from the boundaries
+        {
+            LightClusterGrid grid(config);
+            const float scale = grid.getSliceScale();
+            const float bias = grid.getSliceBias();
+            uint32_t disagreements = 0u;
+            const uint32_t samples = 100000u;
+            for (uint32_t i = 0u; i < samples; ++i)
+            {
+                const float depth = config.nearZ * std::pow(config.farZ / config.nearZ, (i + 0.5f) / samples);
+                const uint32_t slice = grid.getSlice(depth);
+                const float margin = 1e-4f * depth;
+                if (depth - grid.getSliceDepth(slice) < margin || grid.getSliceDepth(slice + 1u) - depth < margin)
+                {
+                    continue;
+                }
+                const int32_t shaderSlice = (std::min)((std::max)(static_cast<int32_t>(std::floor(std::log2(depth) * scale + bias)), 0), static_cast<int32_t>(config.slices) - 1);
+                disagreements += shaderSlice == static_cast<int32_t>(slice) ? 0u : 1u;
+            }
+            report(disagreements == 0u, "shader slice formula matches the binning slices");
+        }
+
+        std::cout << "\n";
+        return passed;
+    }
+
+    template<typename Build>
+    double measure(Build build)
+    {
+        uint32_t runs = 0u;
+        const Clock::time_point start = Clock::now();
+        do
+        {
+            build();
+            ++runs;
+        } while (millisecondsSince(start) < 200.0);
+        return millisecondsSince(start) / runs;
+    }
+
+    void benchmark(const Options &options, WorkerPool &workerPool)
+    {
+        const LightClusterConfig config = makeConfig();
+        std::mt19937 random(options.seed);
+
+        std::cout << std::left << std::setw(10) << "Lights" << std::right << std::setw(12) << "Indices" << std::setw(14) << "Max/cluster"
+                  << std::setw(14) << "Reference ms" << std::setw(12) << "SIMD ms" << std::setw(16) << "Threaded ms" << std::setw(10) << "Speedup" << "\n";
+        std::cout << std::fixed;
+        for (uint32_t count : options.lightCounts)
+        {
+            const std::vector<ClusterLight> lights = makeLights(config, count, random);
+            LightClusterGrid grid(config);
+
+            const double reference = measure([&]() { grid.buildReference(lights.data(), count); });
+            const double simd = measure([&]() { grid.build(lights.data(), count, nullptr); });
+            const double threaded = measure([&]() { grid.build(lights.data(), count, &workerPool); });
+
+            uint32_t maxCount = 0u;
+            for (const LightClusterRange &cluster : grid.getClusters())
+            {
+                maxCount = (std::max)(maxCount, cluster.count);
+            }
+
+            std::cout << std::left << std::setw(10) << count << std::right << std::setw(12) << grid.getLightIndices().size() << std::setw(14) << maxCount
+                      << std::setprecision(3) << std::setw(14) << reference << std::setw(12) << simd << std::setw(16) << threaded
+                      << std::setprecision(1) << std::setw(9) << reference / threaded << "x\n";
+        }
+        std::cout << std::flush;
+    }
+
+    bool parseArguments(int argc, char **argv, Options &options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string argument = argv[i];
+            const bool hasValue = i + 1 < argc;
+
+            if (argument == "--lights" && hasValue)
+            {
+                while (i + 1 < argc && std::string(argv[i + 1]).compare(0u, 2u, "--") != 0)
+                {
+                    options.lightCounts.push_back(static_cast<uint32_t>(std::stoul(argv[++i])));
+                }
+            }
+            else if (argument == "--jobs" && hasValue)
+            {
+                options.jobs = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (argument == "--seed" && hasValue)
+            {
+                options.seed = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else
+            {
+                return false;
+            }
+        }
+
+        if (options.lightCounts.empty())
+        {
+            options.lightCounts = { 1024u, 4096u, 16384u, 65536u };
+        }
+        return std::all_of(options.lightCounts.begin(), options.lightCounts.end(), [](uint32_t count) { return count > 0u; });
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseArguments(argc, argv, options))
+    {
+        std::cerr << "Usage: LightClusterBench [--lights <n>...] [--jobs <n>] [--seed <n>]" << std::endl;
+        return 1;
+    }
+
+    WorkerPool workerPool(options.jobs);
+    const LightClusterConfig config = makeConfig();
+    std::cout << "Grid: " << config.tilesX << " x " << config.tilesY << " x " << config.slices << ", threads: " << workerPool.getThreadCount() << "\n\n";
+
+    const bool passed = check(options, workerPool);
+    benchmark(options, workerPool);
+    return passed ? 0 : 1;
+}
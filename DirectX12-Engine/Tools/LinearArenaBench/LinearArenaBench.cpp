@@ -0,0 +1,391 @@
+// LinearArena check and benchmark.
+//
+// Fills an arena the way a frame does, from several threads at once with a mix of small and
+// medium requests, and checks that:
+//  - every allocation honours its alignment and no two threads are handed overlapping memory
+//  - the stats count allocations, used bytes and the requests that spilled to the heap, and a
+//    reset clears them, frees the spilled blocks and keeps the high water mark
+//  - with guard pages a write one byte past either end of the arena faults, the last byte does not
+// Then frames of allocations are timed on growing thread counts against malloc and free, with
+// the mean and the 99th percentile cost per allocation.
+//
+// Usage:
+//   LinearArenaBench [--threads <n>...] [--allocations <n>] [--seed <n>]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "LinearArena.h"
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    double millisecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    struct Options
+    {
+        std::vector<uint32_t> threadCounts;
+        uint32_t allocations = 4096u; // Per thread and frame
+        uint32_t seed = 1u;
+    };
+
+    // Mostly draw list entries and constants, now and then a larger array
+    std::vector<uint32_t> makeSizes(uint32_t count, std::mt19937 &random)
+    {
+        std::vector<uint32_t> sizes(count);
+        for (uint32_t &size : sizes)
+        {
+            const uint32_t kind = random() % 100u;
+            const uint32_t low = kind < 70u ? 16u : kind < 95u ? 64u : 512u;
+            const uint32_t high = kind < 70u ? 64u : kind < 95u ? 512u : 4096u;
+            size = std::uniform_int_distribution<uint32_t>(low, high)(random);
+        }
+        return sizes;
+    }
+
+    uint64_t totalBytes(const std::vector<uint32_t> &sizes)
+    {
+        uint64_t total = 0u;
+        for (const uint32_t size : sizes)
+        {
+            total += size;
+        }
+        return total;
+    }
+
+    // True if writing the byte faults. Off Windows the write happens in a child process.
+#if defined(_WIN32)
+    bool writeFaults(volatile uint8_t *byte)
+    {
+        __try
+        {
+            *byte = 1u;
+        }
+        __except (GetExceptionCode() == EXCEPTION_ACCESS_VIOLATION ? EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH)
+        {
+            return true;
+        }
+        return false;
+    }
+#else
+    bool writeFaults(volatile uint8_t *byte)
+    {
+        std::cout << std::flush;
+        const pid_t child = fork();
+        if (child == 0)
+        {
+            *byte = 1u;
+            _exit(0);
+        }
+
+        int status = 0;
+        waitpid(child, &status, 0);
+        return !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+    }
+#endif
+
+    bool check(const Options &options)
+    {
+        bool passed = true;
+        auto report = [&passed](bool condition, const std::string &what)
+        {
+            std::cout << std::left << std::setw(64) << what << (condition ? "ok" : "FAILED") << "\n";
+            passed = passed && condition;
+        };
+
+        std::mt19937 random(options.seed);
+        const uint32_t threadCount = 4u;
+        std::vector<std::vector<uint32_t>> sizes;
+        uint64_t requested = 0u;
+        for (uint32_t t = 0; t < threadCount; ++t)
+        {
+            sizes.push_back(makeSizes(options.allocations, random));
+            requested += totalBytes(sizes.back());
+        }
+
+        // Every thread stamps its allocations with its own byte and reads them back once all are done
+        {
+            LinearArena arena(static_cast<size_t>(requested * 2u), MemoryTag::FrameArena);
+            std::vector<std::vector<uint8_t *>> pointers(threadCount);
+            std::atomic<bool> aligned(true);
+
+            std::vector<std::thread> threads;
+            for (uint32_t t = 0; t < threadCount; ++t)
+            {
+                threads.emplace_back([&arena, &sizes, &pointers, &aligned, t]()
+                {
+                    for (size_t i = 0; i < sizes[t].size(); ++i)
+                    {
+                        const size_t alignment = size_t(1u) << (i % 9u);
+                        uint8_t *pointer = static_cast<uint8_t *>(arena.allocate(sizes[t][i], alignment));
+                        if (reinterpret_cast<uintptr_t>(pointer) % alignment != 0u)
+                        {
+                            aligned.store(false);
+                        }
+                        std::memset(pointer, static_cast<int>(t + 1u), sizes[t][i]);
+                        pointers[t].push_back(pointer);
+                    }
+                });
+            }
+            for (std::thread &thread : threads)
+            {
+                thread.join();
+            }
+
+            bool intact = true;
+            for (uint32_t t = 0; t < threadCount; ++t)
+            {
+                for (size_t i = 0; i < pointers[t].size(); ++i)
+                {
+                    const uint8_t *pointer = pointers[t][i];
+                    intact = intact && std::all_of(pointer, pointer + sizes[t][i], [t](uint8_t value) { return value == t + 1u; });
+                }
+            }
+
+            const LinearArena::Stats stats = arena.getStats();
+            report(aligned.load(), "allocations are aligned from 1 to 256 bytes");
+            report(intact, "4 threads get disjoint memory");
+            report(stats.allocations == threadCount * options.allocations && stats.usedBytes >= requested && stats.overflowAllocations == 0u,
+                "stats count " + std::to_string(stats.allocations) + " allocations, " + std::to_string(stats.usedBytes / 1024u) + " KB");
+        }
+
+        // A small arena spills to the heap and gives it back at reset
+        {
+            const uint64_t heapBefore = getMemoryTagStats(MemoryTag::FrameArena).currentBytes;
+            LinearArena arena(64u * 1024u, MemoryTag::FrameArena);
+            const uint64_t arenaBytes = getMemoryTagStats(MemoryTag::FrameArena).currentBytes - heapBefore;
+
+            for (const uint32_t size : sizes[0])
+            {
+                uint8_t *pointer = static_cast<uint8_t *>(arena.allocate(size));
+                std::memset(pointer, 0xAB, size);
+            }
+            const LinearArena::Stats full = arena.getStats();
+            const bool tracked = getMemoryTagStats(MemoryTag::FrameArena).currentBytes == heapBefore + arenaBytes + full.overflowBytes;
+
+            arena.reset();
+            const LinearArena::Stats empty = arena.getStats();
+            report(full.overflowAllocations > 0u && full.usedBytes <= arena.getCapacity() && tracked,
+                "a full arena spills " + std::to_string(full.overflowAllocations) + " requests to the heap");
+            report(empty.allocations == 0u && empty.usedBytes == 0u && empty.overflowAllocations == 0u && empty.overflowBytes == 0u,
+                "reset clears the stats");
+            report(getMemoryTagStats(MemoryTag::FrameArena).currentBytes == heapBefore + arenaBytes, "reset frees the spilled blocks");
+            report(empty.highWaterBytes >= full.usedBytes + full.overflowBytes, "the high water mark survives the reset");
+        }
+
+        // Asking for the whole capacity at alignment 1 returns the start of the arena
+        {
+            LinearArena arena(64u * 1024u, MemoryTag::FrameArena, true);
+            uint8_t *base = static_cast<uint8_t *>(arena.allocate(arena.getCapacity(), 1u));
+            uint8_t *end = base + arena.getCapacity();
+            report(arena.getStats().overflowAllocations == 0u && !writeFaults(end - 1), "the last byte of a guarded arena is writable");
+            report(writeFaults(end), "writing one byte past the end faults");
+            report(writeFaults(base - 1), "writing one byte before the start faults");
+        }
+
+        std::cout << "\n";
+        return passed;
+    }
+
+    struct Timing
+    {
+        double meanNanoseconds = 0.0;
+        double p99Nanoseconds = 0.0;
+    };
+
+    // Allocations are timed in batches, which keeps the clock out of the result and still shows the slow ones
+    const uint32_t BatchSize = 64u;
+
+    Timing summarize(std::vector<double> &batchNanoseconds, double totalNanoseconds, uint64_t allocations)
+    {
+        Timing timing;
+        timing.meanNanoseconds = totalNanoseconds / allocations;
+        if (!batchNanoseconds.empty())
+        {
+            const size_t index = (std::min)(batchNanoseconds.size() * 99u / 100u, batchNanoseconds.size() - 1u);
+            std::nth_element(batchNanoseconds.begin(), batchNanoseconds.begin() + index, batchNanoseconds.end());
+            timing.p99Nanoseconds = batchNanoseconds[index] / BatchSize;
+        }
+        return timing;
+    }
+
+    // Runs frames of allocations on every thread for 200 ms. The arena is reset between frames,
+    // the heap blocks are freed at the end of each frame and the frees are counted with them.
+    template <typename Frame>
+    Timing measure(uint32_t threadCount, uint32_t allocations, Frame frame)
+    {
+        std::vector<std::vector<double>> batches(threadCount);
+        std::vector<double> totals(threadCount, 0.0);
+        uint64_t frames = 0u;
+
+        const Clock::time_point start = Clock::now();
+        do
+        {
+            std::vector<std::thread> threads;
+            for (uint32_t t = 0; t < threadCount; ++t)
+            {
+                threads.emplace_back([&frame, &batches, &totals, t]() { totals[t] += frame(t, batches[t]); });
+            }
+            for (std::thread &thread : threads)
+            {
+                thread.join();
+            }
+            ++frames;
+        } while (millisecondsSince(start) < 200.0);
+
+        std::vector<double> allBatches;
+        double total = 0.0;
+        for (uint32_t t = 0; t < threadCount; ++t)
+        {
+            allBatches.insert(allBatches.end(), batches[t].begin(), batches[t].end());
+            total += totals[t];
+        }
+        return summarize(allBatches, total, frames * threadCount * allocations);
+    }
+
+    void benchmark(const Options &options)
+    {
+        std::cout << std::left << std::setw(10) << "Threads" << std::right << std::setw(14) << "Allocs/frame" << std::setw(12) << "KB/frame"
+                  << std::setw(12) << "Arena ns" << std::setw(12) << "Arena p99" << std::setw(12) << "malloc ns" << std::setw(12) << "malloc p99"
+                  << std::setw(10) << "Speedup" << "\n";
+        std::cout << std::fixed;
+
+        const uint32_t allocations = options.allocations / BatchSize * BatchSize;
+        for (const uint32_t threadCount : options.threadCounts)
+        {
+            std::mt19937 random(options.seed);
+            std::vector<std::vector<uint32_t>> sizes;
+            uint64_t frameBytes = 0u;
+            for (uint32_t t = 0; t < threadCount; ++t)
+            {
+                sizes.push_back(makeSizes(allocations, random));
+                frameBytes += totalBytes(sizes.back());
+            }
+
+            // Room for a frame with the alignment padding, as the renderer sizes its arenas
+            LinearArena arena(static_cast<size_t>(frameBytes * 2u), MemoryTag::FrameArena, false);
+            std::atomic<uint32_t> finished(0u);
+
+            const Timing arenaTiming = measure(threadCount, allocations, [&](uint32_t t, std::vector<double> &batches)
+            {
+                const Clock::time_point frameStart = Clock::now();
+                for (uint32_t i = 0; i < allocations; i += BatchSize)
+                {
+                    const Clock::time_point batchStart = Clock::now();
+                    for (uint32_t j = i; j < i + BatchSize; ++j)
+                    {
+                        static_cast<uint8_t *>(arena.allocate(sizes[t][j]))[0] = 1u;
+                    }
+                    batches.push_back(std::chrono::duration<double, std::nano>(Clock::now() - batchStart).count());
+                }
+
+                // The last thread out stands in for the fence retiring
+                if (finished.fetch_add(1u) + 1u == threadCount)
+                {
+                    arena.reset();
+                    finished.store(0u);
+                }
+                return std::chrono::duration<double, std::nano>(Clock::now() - frameStart).count();
+            });
+            const LinearArena::Stats arenaStats = arena.getStats();
+
+            std::vector<std::vector<void *>> blocks(threadCount, std::vector<void *>(allocations));
+            const Timing mallocTiming = measure(threadCount, allocations, [&](uint32_t t, std::vector<double> &batches)
+            {
+                const Clock::time_point frameStart = Clock::now();
+                for (uint32_t i = 0; i < allocations; i += BatchSize)
+                {
+                    const Clock::time_point batchStart = Clock::now();
+                    for (uint32_t j = i; j < i + BatchSize; ++j)
+                    {
+                        blocks[t][j] = std::malloc(sizes[t][j]);
+                        static_cast<uint8_t *>(blocks[t][j])[0] = 1u;
+                    }
+                    batches.push_back(std::chrono::duration<double, std::nano>(Clock::now() - batchStart).count());
+                }
+                for (void *block : blocks[t])
+                {
+                    std::free(block);
+                }
+                return std::chrono::duration<double, std::nano>(Clock::now() - frameStart).count();
+            });
+
+            std::cout << std::left << std::setw(10) << threadCount << std::right << std::setw(14) << allocations * threadCount
+                      << std::setw(12) << frameBytes / 1024u << std::setprecision(1)
+                      << std::setw(12) << arenaTiming.meanNanoseconds << std::setw(12) << arenaTiming.p99Nanoseconds
+                      << std::setw(12) << mallocTiming.meanNanoseconds << std::setw(12) << mallocTiming.p99Nanoseconds
+                      << std::setw(9) << mallocTiming.meanNanoseconds / arenaTiming.meanNanoseconds << "x"
+                      << (arenaStats.overflowAllocations != 0u ? "  (arena spilled)" : "") << "\n";
+        }
+        std::cout << std::flush;
+    }
+
+    bool parseArguments(int argc, char **argv, Options &options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string argument = argv[i];
+            const bool hasValue = i + 1 < argc;
+
+            if (argument == "--threads" && hasValue)
+            {
+                options.threadCounts.push_back(static_cast<uint32_t>(std::stoul(argv[++i])));
+            }
+            else if (argument == "--allocations" && hasValue)
+            {
+                options.allocations = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (argument == "--seed" && hasValue)
+            {
+                options.seed = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else
+            {
+                return false;
+            }
+        }
+
+        if (options.threadCounts.empty())
+        {
+            options.threadCounts = { 1u, 2u, 4u, 8u };
+        }
+        return options.allocations >= BatchSize && std::all_of(options.threadCounts.begin(), options.threadCounts.end(), [](uint32_t count) { return count > 0u; });
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseArguments(argc, argv, options))
+    {
+        std::cerr << "Usage: LinearArenaBench [--threads <n>...] [--allocations <n>] [--seed <n>]" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Allocations per thread and frame: " << options.allocations << ", page size: " << getPageSize()
+              << ", hardware threads: " << std::thread::hardware_concurrency() << "\n\n";
+
+    const bool passed = check(options);
+    benchmark(options);
+    return passed ? 0 : 1;
+}
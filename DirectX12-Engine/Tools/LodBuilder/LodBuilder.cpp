@@ -0,0 +1,634 @@
+// Offline LOD chain builder.
+//
+// Loads a Wavefront OBJ, welds it into one vertex buffer (position, texture coordinate and
+// normal) and simplifies it into a chain of index buffers with MeshSimplifier. The chain is
+// written back as an OBJ with one object per level, all sharing the same vertex list, plus the
+// error of every level that LodSelector compares against its pixel threshold.
+//
+// --report simplifies every given mesh, or a set of generated ones when none are given, and
+// prints the triangle reduction, the error the simplifier estimated, the error measured as the
+// largest distance from the source vertices to the simplified surface, and the simplification
+// rate, for comparing simplifier changes on a reference mesh set.
+//
+// Usage:
+//   LodBuilder --in <mesh.obj> --out <lods.obj> [--levels <n>] [--reduction <r>] [--error <e>] [--jobs <n>]
+//   LodBuilder --report [<mesh.obj>...] [--levels <n>] [--reduction <r>] [--error <e>] [--jobs <n>]
+
+#include <algorithm>
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "MeshSimplifier.h"
+#include "WorkerPool.h"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    struct Options
+    {
+        fs::path inputPath;
+        fs::path outputPath;
+        std::vector<fs::path> reportPaths;
+        bool report = false;
+        LodChainSettings settings;
+        uint32_t jobs = 0u;
+    };
+
+    struct Vertex
+    {
+        float position[3];
+        float uv[2];
+        float normal[3];
+    };
+
+    struct Mesh
+    {
+        std::string name;
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+    };
+
+    using Clock = std::chrono::steady_clock;
+
+    const float Pi = 3.14159265358979f;
+
+    double millisecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    SimplifyMesh getSimplifyMesh(const Mesh &mesh)
+    {
+        SimplifyMesh view;
+        view.positions = mesh.vertices.empty() ? nullptr : mesh.vertices[0].position;
+        view.vertexStride = sizeof(Vertex);
+        view.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+        view.indices = mesh.indices.data();
+        view.indexCount = static_cast<uint32_t>(mesh.indices.size());
+        return view;
+    }
+
+    // Resolve a 1 based or negative OBJ index, zero when absent
+    int resolveIndex(const std::string &token, size_t count)
+    {
+        if (token.empty())
+        {
+            return 0;
+        }
+        int index = std::stoi(token);
+        return index < 0 ? static_cast<int>(count) + index + 1 : index;
+    }
+
+    bool loadObj(const fs::path &path, Mesh &mesh)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            std::cerr << "Unable to open " << path << std::endl;
+            return false;
+        }
+
+        std::vector<float> positions;
+        std::vector<float> uvs;
+        std::vector<float> normals;
+        std::map<std::tuple<int, int, int>, uint32_t> welded;
+
+        mesh.name = path.filename().string();
+        std::string line;
+        while (std::getline(file, line))
+        {
+            std::istringstream stream(line);
+            std::string keyword;
+            stream >> keyword;
+
+            if (keyword == "v" || keyword == "vn" || keyword == "vt")
+            {
+                std::vector<float> &values = keyword == "v" ? positions : keyword == "vn" ? normals : uvs;
+                uint32_t componentCount = keyword == "vt" ? 2u : 3u;
+                for (uint32_t i = 0u; i < componentCount; ++i)
+                {
+                    float value = 0.0f;
+                    stream >> value;
+                    values.push_back(value);
+                }
+            }
+            else if (keyword == "f")
+            {
+                // Faces are triangulated as fans
+                std::vector<uint32_t> face;
+                std::string corner;
+                while (stream >> corner)
+                {
+                    std::string parts[3];
+                    size_t part = 0u;
+                    for (char c : corner)
+                    {
+                        if (c == '/')
+                        {
+                            part = (std::min)(part + 1u, size_t(2u));
+                        }
+                        else
+                        {
+                            parts[part] += c;
+                        }
+                    }
+
+                    int p = resolveIndex(parts[0], positions.size() / 3u);
+                    int t = resolveIndex(parts[1], uvs.size() / 2u);
+                    int n = resolveIndex(parts[2], normals.size() / 3u);
+                    if (p <= 0 || size_t(p) * 3u > positions.size() || size_t(t) * 2u > uvs.size() || size_t(n) * 3u > normals.size())
+                    {
+                        std::cerr << "Invalid face in " << path << ": " << line << std::endl;
+                        return false;
+                    }
+
+                    auto inserted = welded.emplace(std::make_tuple(p, t, n), static_cast<uint32_t>(mesh.vertices.size()));
+                    if (inserted.second)
+                    {
+                        Vertex vertex = {};
+                        memcpy(vertex.position, &positions[(p - 1) * 3], sizeof(vertex.position));
+                        if (t > 0)
+                        {
+                            memcpy(vertex.uv, &uvs[(t - 1) * 2], sizeof(vertex.uv));
+                        }
+                        if (n > 0)
+                        {
+                            memcpy(vertex.normal, &normals[(n - 1) * 3], sizeof(vertex.normal));
+                        }
+                        mesh.vertices.push_back(vertex);
+                    }
+                    face.push_back(inserted.first->second);
+                }
+
+                for (size_t i = 2u; i < face.size(); ++i)
+                {
+                    mesh.indices.push_back(face[0]);
+                    mesh.indices.push_back(face[i - 1u]);
+                    mesh.indices.push_back(face[i]);
+                }
+            }
+        }
+
+        if (mesh.indices.empty())
+        {
+            std::cerr << "No triangles in " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool writeObj(const fs::path &path, const Mesh &mesh, const LodChain &chain)
+    {
+        std::ofstream file(path);
+        if (!file)
+        {
+            return false;
+        }
+
+        file << "# " << chain.levels.size() << " LOD levels over " << mesh.vertices.size() << " vertices\n";
+        for (size_t i = 0u; i < chain.levels.size(); ++i)
+        {
+            file << "# lod" << i << " triangles " << chain.levels[i].indexCount / 3u << " error " << chain.levels[i].error << "\n";
+        }
+
+        for (const Vertex &vertex : mesh.vertices)
+        {
+            file << "v " << vertex.position[0] << " " << vertex.position[1] << " " << vertex.position[2] << "\n";
+        }
+        for (const Vertex &vertex : mesh.vertices)
+        {
+            file << "vt " << vertex.uv[0] << " " << vertex.uv[1] << "\n";
+        }
+        for (const Vertex &vertex : mesh.vertices)
+        {
+            file << "vn " << vertex.normal[0] << " " << vertex.normal[1] << " " << vertex.normal[2] << "\n";
+        }
+
+        for (size_t i = 0u; i < chain.levels.size(); ++i)
+        {
+            const LodLevel &level = chain.levels[i];
+            file << "o lod" << i << "\n";
+            for (uint32_t j = 0u; j < level.indexCount; j += 3u)
+            {
+                file << "f";
+                for (uint32_t k = 0u; k < 3u; ++k)
+                {
+                    uint32_t index = chain.indices[level.firstIndex + j + k] + 1u;
+                    file << " " << index << "/" << index << "/" << index;
+                }
+                file << "\n";
+            }
+        }
+        return static_cast<bool>(file);
+    }
+
+    // Grid of u x v vertices over a parametric surface. The last column and row repeat the first
+    // ones with their own texture coordinates, which leaves a seam wherever the surface wraps.
+    template <typename Surface>
+    Mesh generateMesh(const char *name, uint32_t columns, uint32_t rows, Surface surface)
+    {
+        Mesh mesh;
+        mesh.name = name;
+        for (uint32_t y = 0u; y <= rows; ++y)
+        {
+            for (uint32_t x = 0u; x <= columns; ++x)
+            {
+                Vertex vertex = {};
+                vertex.uv[0] = static_cast<float>(x) / columns;
+                vertex.uv[1] = static_cast<float>(y) / rows;
+                surface(vertex.uv[0], vertex.uv[1], vertex.position, vertex.normal);
+                mesh.vertices.push_back(vertex);
+            }
+        }
+        for (uint32_t y = 0u; y < rows; ++y)
+        {
+            for (uint32_t x = 0u; x < columns; ++x)
+            {
+                uint32_t i0 = y * (columns + 1u) + x;
+                uint32_t i1 = i0 + 1u;
+                uint32_t i2 = i0 + columns + 1u;
+                uint32_t i3 = i2 + 1u;
+                uint32_t triangles[6] = { i0, i2, i1, i1, i2, i3 };
+                mesh.indices.insert(mesh.indices.end(), triangles, triangles + 6);
+            }
+        }
+        return mesh;
+    }
+
+    std::vector<Mesh> generateTestMeshes()
+    {
+        std::vector<Mesh> meshes;
+
+        // Closed with a texture seam and poles where a whole row of vertices meets
+        meshes.push_back(generateMesh("sphere", 256u, 128u, [](float u, float v, float *position, float *normal)
+        {
+            float theta = u * 2.0f * Pi;
+            float phi = v * Pi;
+            normal[0] = std::sin(phi) * std::cos(theta);
+            normal[1] = std::cos(phi);
+            normal[2] = std::sin(phi) * std::sin(theta);
+            memcpy(position, normal, sizeof(float) * 3u);
+        }));
+
+        // Seams in both directions
+        meshes.push_back(generateMesh("torus", 384u, 96u, [](float u, float v, float *position, float *normal)
+        {
+            float theta = u * 2.0f * Pi;
+            float phi = v * 2.0f * Pi;
+            normal[0] = std::cos(phi) * std::cos(theta);
+            normal[1] = std::sin(phi);
+            normal[2] = std::cos(phi) * std::sin(theta);
+            position[0] = (1.0f + 0.3f * std::cos(phi)) * std::cos(theta);
+            position[1] = 0.3f * std::sin(phi);
+            position[2] = (1.0f + 0.3f * std::cos(phi)) * std::sin(theta);
+        }));
+
+        // Open border and bumps of several sizes
+        meshes.push_back(generateMesh("terrain", 256u, 256u, [](float u, float v, float *position, float *normal)
+        {
+            float height = 0.1f * std::sin(u * 6.0f) * std::cos(v * 5.0f) + 0.02f * std::sin(u * 40.0f + v * 13.0f);
+            position[0] = u * 2.0f - 1.0f;
+            position[1] = height;
+            position[2] = v * 2.0f - 1.0f;
+            normal[1] = 1.0f;
+        }));
+
+        return meshes;
+    }
+
+    float distanceToTriangle(const float *p, const float *a, const float *b, const float *c)
+    {
+        // Closest point on a triangle, from Real-Time Collision Detection 5.1.5
+        float ab[3], ac[3], ap[3];
+        for (int i = 0; i < 3; ++i)
+        {
+            ab[i] = b[i] - a[i];
+            ac[i] = c[i] - a[i];
+            ap[i] = p[i] - a[i];
+        }
+        auto dot3 = [](const float *x, const float *y) { return x[0] * y[0] + x[1] * y[1] + x[2] * y[2]; };
+        auto distanceTo = [&](float s, float t)
+        {
+            float d[3];
+            for (int i = 0; i < 3; ++i)
+            {
+                d[i] = a[i] + ab[i] * s + ac[i] * t - p[i];
+            }
+            return std::sqrt(dot3(d, d));
+        };
+
+        float d1 = dot3(ab, ap);
+        float d2 = dot3(ac, ap);
+        if (d1 <= 0.0f && d2 <= 0.0f)
+        {
+            return distanceTo(0.0f, 0.0f);
+        }
+
+        float bp[3] = { p[0] - b[0], p[1] - b[1], p[2] - b[2] };
+        float d3 = dot3(ab, bp);
+        float d4 = dot3(ac, bp);
+        if (d3 >= 0.0f && d4 <= d3)
+        {
+            return distanceTo(1.0f, 0.0f);
+        }
+
+        float vc = d1 * d4 - d3 * d2;
+        if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+        {
+            return distanceTo(d1 / (d1 - d3), 0.0f);
+        }
+
+        float cp[3] = { p[0] - c[0], p[1] - c[1], p[2] - c[2] };
+        float d5 = dot3(ab, cp);
+        float d6 = dot3(ac, cp);
+        if (d6 >= 0.0f && d5 <= d6)
+        {
+            return distanceTo(0.0f, 1.0f);
+        }
+
+        float vb = d5 * d2 - d1 * d6;
+        if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+        {
+            return distanceTo(0.0f, d2 / (d2 - d6));
+        }
+
+        float va = d3 * d6 - d5 * d4;
+        if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+        {
+            float w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+            return distanceTo(1.0f - w, w);
+        }
+
+        float denominator = 1.0f / (va + vb + vc);
+        return distanceTo(vb * denominator, vc * denominator);
+    }
+
+    // Largest distance from a vertex of the source mesh to the simplified surface. Triangles are
+    // bucketed in a uniform grid and cells are searched in growing shells around each vertex.
+    float measureError(const Mesh &mesh, const uint32_t *indices, uint32_t indexCount, WorkerPool &workerPool)
+    {
+        float minimum[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+        float maximum[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+        for (const Vertex &vertex : mesh.vertices)
+        {
+            for (int i = 0; i < 3; ++i)
+            {
+                minimum[i] = (std::min)(minimum[i], vertex.position[i]);
+                maximum[i] = (std::max)(maximum[i], vertex.position[i]);
+            }
+        }
+
+        uint32_t triangleCount = indexCount / 3u;
+        float extent = (std::max)({ maximum[0] - minimum[0], maximum[1] - minimum[1], maximum[2] - minimum[2], 1e-6f });
+        int resolution = (std::max)(1, (std::min)(128, static_cast<int>(std::cbrt(static_cast<float>(triangleCount)))));
+        float cellSize = extent / resolution;
+
+        auto cellOf = [&](float value, int axis)
+        {
+            return (std::min)(resolution - 1, (std::max)(0, static_cast<int>((value - minimum[axis]) / cellSize)));
+        };
+
+        std::vector<std::vector<uint32_t>> cells(static_cast<size_t>(resolution) * resolution * resolution);
+        for (uint32_t t = 0u; t < triangleCount; ++t)
+        {
+            int low[3];
+            int high[3];
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                float lowValue = FLT_MAX;
+                float highValue = -FLT_MAX;
+                for (uint32_t c = 0u; c < 3u; ++c)
+                {
+                    float value = mesh.vertices[indices[t * 3u + c]].position[axis];
+                    lowValue = (std::min)(lowValue, value);
+                    highValue = (std::max)(highValue, value);
+                }
+                low[axis] = cellOf(lowValue, axis);
+                high[axis] = cellOf(highValue, axis);
+            }
+            for (int z = low[2]; z <= high[2]; ++z)
+            {
+                for (int y = low[1]; y <= high[1]; ++y)
+                {
+                    for (int x = low[0]; x <= high[0]; ++x)
+                    {
+                        cells[(static_cast<size_t>(z) * resolution + y) * resolution + x].push_back(t);
+                    }
+                }
+            }
+        }
+
+        const uint32_t batchSize = 256u;
+        uint32_t vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+        std::vector<float> batchErrors((vertexCount + batchSize - 1u) / batchSize, 0.0f);
+        workerPool.parallelFor(static_cast<uint32_t>(batchErrors.size()), [&](uint32_t batch)
+        {
+            float batchError = 0.0f;
+            for (uint32_t v = batch * batchSize; v < (std::min)(vertexCount, (batch + 1u) * batchSize); ++v)
+            {
+                const float *p = mesh.vertices[v].position;
+                int center[3] = { cellOf(p[0], 0), cellOf(p[1], 1), cellOf(p[2], 2) };
+
+                float best = FLT_MAX;
+                for (int shell = 0; shell < resolution; ++shell)
+                {
+                    // Everything past this shell is at least this far away
+                    if (best <= (shell - 1) * cellSize)
+                    {
+                        break;
+                    }
+                    for (int z = center[2] - shell; z <= center[2] + shell; ++z)
+                    {
+                        for (int y = center[1] - shell; y <= center[1] + shell; ++y)
+                        {
+                            for (int x = center[0] - shell; x <= center[0] + shell; ++x)
+                            {
+                                bool onShell = std::abs(x - center[0]) == shell || std::abs(y - center[1]) == shell || std::abs(z - center[2]) == shell;
+                                if (!onShell || x < 0 || y < 0 || z < 0 || x >= resolution || y >= resolution || z >= resolution)
+                                {
+                                    continue;
+                                }
+                                for (uint32_t t : cells[(static_cast<size_t>(z) * resolution + y) * resolution + x])
+                                {
+                                    best = (std::min)(best, distanceToTriangle(p,
+                                        mesh.vertices[indices[t * 3u]].position,
+                                        mesh.vertices[indices[t * 3u + 1u]].position,
+                                        mesh.vertices[indices[t * 3u + 2u]].position));
+                                }
+                            }
+                        }
+                    }
+                }
+                if (best != FLT_MAX)
+                {
+                    batchError = (std::max)(batchError, best);
+                }
+            }
+            batchErrors[batch] = batchError;
+        });
+
+        return batchErrors.empty() ? 0.0f : *std::max_element(batchErrors.begin(), batchErrors.end());
+    }
+
+    void report(const std::vector<Mesh> &meshes, const Options &options, WorkerPool &workerPool)
+    {
+        std::cout << std::fixed;
+        std::cout << "Threads: " << workerPool.getThreadCount() << "\n\n";
+        std::cout << std::left << std::setw(24) << "Mesh" << std::setw(6) << "LOD" << std::right
+                  << std::setw(12) << "Triangles" << std::setw(11) << "Reduction" << std::setw(12) << "Estimated"
+                  << std::setw(12) << "Measured" << "\n";
+
+        for (const Mesh &mesh : meshes)
+        {
+            SimplifyMesh view = getSimplifyMesh(mesh);
+            float radius = getMeshRadius(view);
+
+            // Repeat small meshes so the timing is not dominated by thread wake up
+            LodChain chain;
+            uint32_t runs = 0u;
+            const Clock::time_point start = Clock::now();
+            do
+            {
+                buildLodChain(view, options.settings, &workerPool, chain);
+                ++runs;
+            } while (millisecondsSince(start) < 200.0);
+            const double milliseconds = millisecondsSince(start) / runs;
+
+            for (size_t i = 0u; i < chain.levels.size(); ++i)
+            {
+                const LodLevel &level = chain.levels[i];
+                float measured = i == 0u ? 0.0f : measureError(mesh, &chain.indices[level.firstIndex], level.indexCount, workerPool);
+
+                // Errors are relative to the mesh radius
+                std::cout << std::left << std::setw(24) << mesh.name << std::setw(6) << i << std::right
+                          << std::setw(12) << level.indexCount / 3u
+                          << std::setw(10) << std::setprecision(1) << 100.0 * (1.0 - static_cast<double>(level.indexCount) / mesh.indices.size()) << "%"
+                          << std::setw(12) << std::setprecision(5) << level.error / radius
+                          << std::setw(12) << measured / radius << "\n";
+            }
+            std::cout << std::left << std::setw(24) << mesh.name << std::setw(6) << "all" << std::right << std::setprecision(2)
+                      << std::setw(12) << milliseconds << " ms, "
+                      << (mesh.indices.size() / 3u) * (chain.levels.size() - 1u) / (milliseconds * 1000.0) << " M source triangles/s\n\n";
+        }
+        std::cout << std::flush;
+    }
+
+    bool parseArguments(int argc, char **argv, Options &options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string argument = argv[i];
+            const bool hasValue = i + 1 < argc;
+
+            if (argument == "--in" && hasValue)
+            {
+                options.inputPath = argv[++i];
+            }
+            else if (argument == "--out" && hasValue)
+            {
+                options.outputPath = argv[++i];
+            }
+            else if (argument == "--levels" && hasValue)
+            {
+                options.settings.maxLevels = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (argument == "--reduction" && hasValue)
+            {
+                options.settings.reduction = std::stof(argv[++i]);
+            }
+            else if (argument == "--error" && hasValue)
+            {
+                options.settings.maxError = std::stof(argv[++i]);
+            }
+            else if (argument == "--jobs" && hasValue)
+            {
+                options.jobs = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (argument == "--report")
+            {
+                options.report = true;
+                while (i + 1 < argc && std::strncmp(argv[i + 1], "--", 2) != 0)
+                {
+                    options.reportPaths.push_back(argv[++i]);
+                }
+            }
+            else
+            {
+                return false;
+            }
+        }
+        return options.report || (!options.inputPath.empty() && !options.outputPath.empty());
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseArguments(argc, argv, options))
+    {
+        std::cerr << "Usage: LodBuilder --in <mesh.obj> --out <lods.obj> [--levels <n>] [--reduction <r>] [--error <e>] [--jobs <n>]\n"
+                  << "       LodBuilder --report [<mesh.obj>...] [--levels <n>] [--reduction <r>] [--error <e>] [--jobs <n>]" << std::endl;
+        return 1;
+    }
+
+    WorkerPool workerPool(options.jobs);
+
+    if (options.report)
+    {
+        std::vector<Mesh> meshes;
+        for (const fs::path &path : options.reportPaths)
+        {
+            Mesh mesh;
+            if (loadObj(path, mesh))
+            {
+                meshes.push_back(std::move(mesh));
+            }
+        }
+        if (options.reportPaths.empty())
+        {
+            meshes = generateTestMeshes();
+        }
+        report(meshes, options, workerPool);
+        return 0;
+    }
+
+    const Clock::time_point start = Clock::now();
+
+    Mesh mesh;
+    if (!loadObj(options.inputPath, mesh))
+    {
+        return 1;
+    }
+
+    LodChain chain;
+    buildLodChain(getSimplifyMesh(mesh), options.settings, &workerPool, chain);
+
+    if (!writeObj(options.outputPath, mesh, chain))
+    {
+        std::cerr << "Unable to write " << options.outputPath << std::endl;
+        return 1;
+    }
+
+    std::cout << "Vertices:   " << mesh.vertices.size() << "\n";
+    for (size_t i = 0u; i < chain.levels.size(); ++i)
+    {
+        std::cout << "LOD " << i << ":      " << chain.levels[i].indexCount / 3u << " triangles, error " << chain.levels[i].error << "\n";
+    }
+    std::cout << "Threads:    " << workerPool.getThreadCount() << "\n"
+              << "Total time: " << millisecondsSince(start) << " ms" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,607 @@
+// Occlusion culling check and benchmark.
+//
+// Rasterizes reference scenes with OcclusionCuller and checks that:
+//  - an empty buffer only rejects boxes that are off screen
+//  - a wall hides the boxes behind it, and keeps those in front of it, crossing it or seen through a hole
+//  - occluders crossing the near plane are skipped instead of covering the screen
+//  - the two triangles of a quad cover the pixel centres on their shared diagonal, once, so the tiles
+//    under it stay culled
+//  - the SIMD rasterizer matches a scalar reference rasterizer away from triangle edges
+//  - rasterizing on the worker pool gives the same depth as on one thread
+//  - no box the reference depth shows is culled, in every benchmark scene
+// Then every scene is timed: occluder triangles per millisecond on one thread and on the pool, box
+// tests per millisecond, and the share of boxes culled next to the share the reference depth could cull.
+//
+// Usage:
+//   OcclusionBench [--width <n>] [--height <n>] [--objects <n>] [--jobs <n>] [--seed <n>]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "OcclusionCuller.h"
+#include "VectorMath.h"
+#include "WorkerPool.h"
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    double millisecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    struct Options
+    {
+        uint32_t width = 480u;  // A quarter of 1080p, as the renderer uses
+        uint32_t height = 270u;
+        uint32_t objects = 20000u;
+        uint32_t jobs = 0u;
+        uint32_t seed = 1u;
+    };
+
+    // Occluder triangles and the boxes tested against them, all in clip space
+    struct Scene
+    {
+        std::string name;
+        std::vector<Vec4> vertices;
+        std::vector<uint32_t> indices;
+        std::vector<Vec4> boxCorners; // Eight per box
+    };
+
+    uint32_t getTriangleCount(const Scene &scene)
+    {
+        return static_cast<uint32_t>(scene.indices.size() / 3u);
+    }
+
+    uint32_t getBoxCount(const Scene &scene)
+    {
+        return static_cast<uint32_t>(scene.boxCorners.size() / 8u);
+    }
+
+    void addQuad(Scene &scene, const Vec4 &a, const Vec4 &b, const Vec4 &c, const Vec4 &d)
+    {
+        const uint32_t base = static_cast<uint32_t>(scene.vertices.size());
+        scene.vertices.insert(scene.vertices.end(), { a, b, c, d });
+        scene.indices.insert(scene.indices.end(), { base, base + 1u, base + 2u, base, base + 2u, base + 3u });
+    }
+
+    // A screen aligned rectangle in normalized device coordinates at one depth
+    void addScreenQuad(Scene &scene, float minX, float minY, float maxX, float maxY, float depth)
+    {
+        addQuad(scene, Vec4{ minX, minY, depth, 1.0f }, Vec4{ maxX, minY, depth, 1.0f }, Vec4{ maxX, maxY, depth, 1.0f }, Vec4{ minX, maxY, depth, 1.0f });
+    }
+
+    void addScreenBox(Scene &scene, float minX, float minY, float maxX, float maxY, float minDepth, float maxDepth)
+    {
+        for (uint32_t corner = 0u; corner < 8u; ++corner)
+        {
+            scene.boxCorners.push_back(Vec4{ (corner & 1u) ? maxX : minX, (corner & 2u) ? maxY : minY, (corner & 4u) ? maxDepth : minDepth, 1.0f });
+        }
+    }
+
+    void addWorldBox(Scene &scene, const Aabb &box, const Mat4 &viewProjection, bool occluder)
+    {
+        Vec4 corners[8];
+        for (uint32_t corner = 0u; corner < 8u; ++corner)
+        {
+            const Vec4 position{ (corner & 1u) ? box.max.x : box.min.x, (corner & 2u) ? box.max.y : box.min.y, (corner & 4u) ? box.max.z : box.min.z, 1.0f };
+            corners[corner] = transform(position, viewProjection);
+        }
+
+        if (!occluder)
+        {
+            scene.boxCorners.insert(scene.boxCorners.end(), std::begin(corners), std::end(corners));
+            return;
+        }
+
+        // Every face, occluders are double sided
+        static const uint32_t faces[6][4] = { { 0, 1, 3, 2 }, { 4, 5, 7, 6 }, { 0, 1, 5, 4 }, { 2, 3, 7, 6 }, { 0, 2, 6, 4 }, { 1, 3, 7, 5 } };
+        for (const uint32_t *face : faces)
+        {
+            addQuad(scene, corners[face[0]], corners[face[1]], corners[face[2]], corners[face[3]]);
+        }
+    }
+
+    // The rasterizer's own setup, pixel centres strictly inside every edge, in double precision. The fill rule
+    // for centres on an edge has its own check.
+    // Pixels closer to an edge of any triangle than a thousandth of a pixel, or than the rounding of the single
+    // precision edge equation, are marked ambiguous. Each pixel also gets
+    // the error the single precision plane equations of the triangles covering it can make, steep slivers have
+    // large depth gradients and so large errors.
+    void rasterizeReference(const Scene &scene, uint32_t width, uint32_t height, std::vector<float> &depth, std::vector<uint8_t> &ambiguous, std::vector<float> &tolerance)
+    {
+        depth.assign(static_cast<size_t>(width) * height, 1.0f);
+        ambiguous.assign(depth.size(), 0u);
+        tolerance.assign(depth.size(), 1e-5f);
+
+        for (size_t t = 0u; t + 2u < scene.indices.size(); t += 3u)
+        {
+            double x[3];
+            double y[3];
+            double z[3];
+            bool clipped = false;
+            for (uint32_t v = 0u; v < 3u; ++v)
+            {
+                const Vec4 &vertex = scene.vertices[scene.indices[t + v]];
+                if (vertex.w < 1e-5f || vertex.z / vertex.w < 0.0f)
+                {
+                    clipped = true;
+                    break;
+                }
+                x[v] = (vertex.x / vertex.w + 1.0) * 0.5 * width;
+                y[v] = (1.0 - vertex.y / vertex.w) * 0.5 * height;
+                z[v] = vertex.z / vertex.w;
+            }
+            const double area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+            if (clipped || std::fabs(area) < 1e-6)
+            {
+                continue;
+            }
+
+            const double orientation = area > 0.0 ? 1.0 : -1.0;
+            double edgeA[3];
+            double edgeB[3];
+            double edgeC[3];
+            double edgeMargin[3];
+            for (int i = 0; i < 3; ++i)
+            {
+                const int a = (i + 1) % 3;
+                const int b = (i + 2) % 3;
+                edgeA[i] = orientation * (y[a] - y[b]);
+                edgeB[i] = orientation * (x[b] - x[a]);
+                edgeC[i] = orientation * (x[a] * y[b] - y[a] * x[b]);
+                edgeMargin[i] = 1e-3 * std::sqrt(edgeA[i] * edgeA[i] + edgeB[i] * edgeB[i]) +
+                    1e-6 * (std::fabs(x[a] * y[b]) + std::fabs(y[a] * x[b]) + std::fabs(edgeA[i]) * width + std::fabs(edgeB[i]) * height);
+            }
+            const double depthA = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) / area;
+            const double depthB = ((z[2] - z[0]) * (x[1] - x[0]) - (z[1] - z[0]) * (x[2] - x[0])) / area;
+            const double depthC = z[0] - depthA * x[0] - depthB * y[0];
+            const double maxDepth = (std::max)(z[0], (std::max)(z[1], z[2]));
+            const float depthTolerance = static_cast<float>(1e-5 + 1e-6 * (std::fabs(depthA) * width + std::fabs(depthB) * height));
+
+            const int minX = (std::max)(static_cast<int>(std::floor((std::min)(x[0], (std::min)(x[1], x[2])))) - 1, 0);
+            const int maxX = (std::min)(static_cast<int>(std::ceil((std::max)(x[0], (std::max)(x[1], x[2])))) + 1, static_cast<int>(width) - 1);
+            const int minY = (std::max)(static_cast<int>(std::floor((std::min)(y[0], (std::min)(y[1], y[2])))) - 1, 0);
+            const int maxY = (std::min)(static_cast<int>(std::ceil((std::max)(y[0], (std::max)(y[1], y[2])))) + 1, static_cast<int>(height) - 1);
+            for (int py = minY; py <= maxY; ++py)
+            {
+                for (int px = minX; px <= maxX; ++px)
+                {
+                    const double cx = px + 0.5;
+                    const double cy = py + 0.5;
+                    bool inside = true;
+                    bool nearEdge = false;
+                    for (int i = 0; i < 3; ++i)
+                    {
+                        const double e = edgeA[i] * cx + edgeB[i] * cy + edgeC[i];
+                        inside = inside && e > 0.0;
+                        nearEdge = nearEdge || std::fabs(e) < edgeMargin[i];
+                    }
+
+                    const size_t pixel = static_cast<size_t>(py) * width + px;
+                    if (nearEdge)
+                    {
+                        ambiguous[pixel] = 1u;
+                    }
+                    if (inside)
+                    {
+                        tolerance[pixel] = (std::max)(tolerance[pixel], depthTolerance);
+                        const double d = (std::min)(depthA * cx + depthB * cy + depthC, maxDepth);
+                        depth[pixel] = (std::min)(depth[pixel], static_cast<float>(d));
+                    }
+                }
+            }
+        }
+    }
+
+    // Visible when the reference depth of any pixel the box's screen rectangle touches is behind its nearest point
+    bool isVisibleReference(const float *corners, uint32_t width, uint32_t height, const std::vector<float> &depth)
+    {
+        float minX = 0.0f;
+        float minY = 0.0f;
+        float maxX = 0.0f;
+        float maxY = 0.0f;
+        float minZ = 0.0f;
+        for (uint32_t i = 0u; i < 8u; ++i)
+        {
+            const float *corner = corners + 4u * i;
+            if (corner[3] < 1e-5f)
+            {
+                return true;
+            }
+            const float x = (corner[0] / corner[3] + 1.0f) * 0.5f * width;
+            const float y = (1.0f - corner[1] / corner[3]) * 0.5f * height;
+            const float z = corner[2] / corner[3];
+            minX = i == 0u ? x : (std::min)(minX, x);
+            maxX = i == 0u ? x : (std::max)(maxX, x);
+            minY = i == 0u ? y : (std::min)(minY, y);
+            maxY = i == 0u ? y : (std::max)(maxY, y);
+            minZ = i == 0u ? z : (std::min)(minZ, z);
+        }
+
+        if (maxX < 0.0f || maxY < 0.0f || minX >= width || minY >= height)
+        {
+            return false;
+        }
+        if (minZ <= 0.0f)
+        {
+            return true;
+        }
+
+        const int left = (std::max)(static_cast<int>(std::floor(minX)), 0);
+        const int right = (std::min)(static_cast<int>(std::floor(maxX)), static_cast<int>(width) - 1);
+        const int top = (std::max)(static_cast<int>(std::floor(minY)), 0);
+        const int bottom = (std::min)(static_cast<int>(std::floor(maxY)), static_cast<int>(height) - 1);
+        for (int y = top; y <= bottom; ++y)
+        {
+            for (int x = left; x <= right; ++x)
+            {
+                if (depth[static_cast<size_t>(y) * width + x] > minZ)
+                {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    void render(OcclusionCuller &culler, const Scene &scene)
+    {
+        culler.clear();
+        if (!scene.indices.empty())
+        {
+            culler.renderOccluders(&scene.vertices[0].x, scene.indices.data(), getTriangleCount(scene));
+        }
+    }
+
+    std::vector<uint8_t> testBoxes(OcclusionCuller &culler, const Scene &scene)
+    {
+        std::vector<uint8_t> visible(getBoxCount(scene));
+        for (uint32_t box = 0u; box < visible.size(); ++box)
+        {
+            visible[box] = culler.testAabb(&scene.boxCorners[8u * box].x) ? 1u : 0u;
+        }
+        return visible;
+    }
+
+    // A few large walls across the view, the intended use: few triangles, much covered
+    Scene makeWallScene(const Options &options, std::mt19937 &random)
+    {
+        Scene scene;
+        scene.name = "walls";
+
+        const float aspect = static_cast<float>(options.width) / static_cast<float>(options.height);
+        const Mat4 viewProjection = multiply(lookAtMatrix(Vec3{ 0.0f, 2.0f, 0.0f }, Vec3{ 0.0f, 2.0f, 1.0f }, Vec3{ 0.0f, 1.0f, 0.0f }),
+            perspectiveMatrix(1.0471976f, aspect, 0.1f, 500.0f));
+
+        const Aabb walls[] =
+        {
+            { Vec3{ -30.0f, 0.0f, 20.0f }, Vec3{ -2.0f, 12.0f, 21.0f } },
+            { Vec3{ 4.0f, 0.0f, 35.0f }, Vec3{ 40.0f, 20.0f, 36.0f } },
+            { Vec3{ -8.0f, 0.0f, 60.0f }, Vec3{ 10.0f, 30.0f, 61.0f } },
+            { Vec3{ -200.0f, 0.0f, 150.0f }, Vec3{ 200.0f, 60.0f, 151.0f } },
+            { Vec3{ -200.0f, -1.0f, 0.0f }, Vec3{ 200.0f, 0.0f, 400.0f } } // Ground
+        };
+        for (const Aabb &wall : walls)
+        {
+            addWorldBox(scene, wall, viewProjection, true);
+        }
+
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        for (uint32_t i = 0u; i < options.objects; ++i)
+        {
+            const float z = 5.0f + unit(random) * 295.0f;
+            const Vec3 center{ (unit(random) * 2.0f - 1.0f) * z * 0.8f, unit(random) * 10.0f, z };
+            const Vec3 extent{ 0.5f + unit(random) * 2.0f, 0.5f + unit(random) * 2.0f, 0.5f + unit(random) * 2.0f };
+            addWorldBox(scene, Aabb{ center - extent, center + extent }, viewProjection, false);
+        }
+        return scene;
+    }
+
+    // Blocks of buildings seen from the street, props scattered between and behind them
+    Scene makeCityScene(const Options &options, std::mt19937 &random)
+    {
+        Scene scene;
+        scene.name = "city";
+
+        const float aspect = static_cast<float>(options.width) / static_cast<float>(options.height);
+        const Mat4 viewProjection = multiply(lookAtMatrix(Vec3{ 3.0f, 1.7f, -10.0f }, Vec3{ 20.0f, 3.0f, 100.0f }, Vec3{ 0.0f, 1.0f, 0.0f }),
+            perspectiveMatrix(1.0471976f, aspect, 0.1f, 500.0f));
+
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        const float blockSize = 14.0f;
+        const float street = 6.0f;
+        for (int z = 0; z < 16; ++z)
+        {
+            for (int x = -8; x < 8; ++x)
+            {
+                const Vec3 min{ x * blockSize + street * 0.5f, 0.0f, z * blockSize + street * 0.5f };
+                const Vec3 max{ min.x + blockSize - street, 6.0f + unit(random) * 34.0f, min.z + blockSize - street };
+                addWorldBox(scene, Aabb{ min, max }, viewProjection, true);
+            }
+        }
+
+        for (uint32_t i = 0u; i < options.objects; ++i)
+        {
+            const Vec3 center{ (unit(random) * 2.0f - 1.0f) * 8.0f * blockSize, unit(random) * 3.0f, unit(random) * 16.0f * blockSize };
+            const Vec3 extent{ 0.3f + unit(random) * 1.2f, 0.3f + unit(random) * 1.2f, 0.3f + unit(random) * 1.2f };
+            addWorldBox(scene, Aabb{ center - extent, center + extent }, viewProjection, false);
+        }
+        return scene;
+    }
+
+    // Many small triangles at random depths, a worst case for setup cost
+    Scene makeRubbleScene(const Options &options, std::mt19937 &random)
+    {
+        Scene scene;
+        scene.name = "rubble";
+
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        for (uint32_t i = 0u; i < 20000u; ++i)
+        {
+            const float x = unit(random) * 2.2f - 1.1f;
+            const float y = unit(random) * 2.2f - 1.1f;
+            const float z = 0.05f + unit(random) * 0.9f;
+            const uint32_t base = static_cast<uint32_t>(scene.vertices.size());
+            for (uint32_t v = 0u; v < 3u; ++v)
+            {
+                scene.vertices.push_back(Vec4{ x + (unit(random) - 0.5f) * 0.1f, y + (unit(random) - 0.5f) * 0.1f, z + (unit(random) - 0.5f) * 0.02f, 1.0f });
+            }
+            scene.indices.insert(scene.indices.end(), { base, base + 1u, base + 2u });
+        }
+
+        for (uint32_t i = 0u; i < options.objects; ++i)
+        {
+            const float x = unit(random) * 2.2f - 1.1f;
+            const float y = unit(random) * 2.2f - 1.1f;
+            const float z = unit(random);
+            const float size = 0.005f + unit(random) * 0.05f;
+            addScreenBox(scene, x, y, x + size, y + size, z, (std::min)(z + 0.01f, 1.0f));
+        }
+        return scene;
+    }
+
+    bool check(const Options &options, WorkerPool &workerPool)
+    {
+        bool passed = true;
+        auto report = [&passed](bool condition, const std::string &what)
+        {
+            std::cout << std::left << std::setw(64) << what << (condition ? "ok" : "FAILED") << "\n";
+            passed = passed && condition;
+        };
+
+        OcclusionCuller culler(options.width, options.height);
+        OcclusionCuller pooledCuller(options.width, options.height, &workerPool);
+
+        // Nothing drawn
+        {
+            Scene scene;
+            addScreenBox(scene, -0.2f, -0.2f, 0.2f, 0.2f, 0.9f, 0.95f);
+            addScreenBox(scene, 1.5f, -0.2f, 1.8f, 0.2f, 0.5f, 0.6f);
+            addScreenBox(scene, -0.2f, -1.9f, 0.2f, -1.2f, 0.5f, 0.6f);
+            render(culler, scene);
+            const std::vector<uint8_t> visible = testBoxes(culler, scene);
+            report(visible[0] == 1u && visible[1] == 0u && visible[2] == 0u, "empty buffer only rejects boxes off screen");
+        }
+
+        // A wall over the whole screen at half depth, with a hole in the middle
+        {
+            Scene scene;
+            addScreenQuad(scene, -1.5f, -1.5f, 1.5f, -0.25f, 0.5f);
+            addScreenQuad(scene, -1.5f, 0.25f, 1.5f, 1.5f, 0.5f);
+            addScreenQuad(scene, -1.5f, -0.25f, -0.25f, 0.25f, 0.5f);
+            addScreenQuad(scene, 0.25f, -0.25f, 1.5f, 0.25f, 0.5f);
+            addScreenBox(scene, -0.9f, 0.5f, -0.6f, 0.8f, 0.6f, 0.7f);   // Behind
+            addScreenBox(scene, -0.9f, 0.5f, -0.6f, 0.8f, 0.3f, 0.4f);   // In front
+            addScreenBox(scene, -0.9f, 0.5f, -0.6f, 0.8f, 0.4f, 0.7f);   // Crossing
+            addScreenBox(scene, -0.1f, -0.1f, 0.1f, 0.1f, 0.8f, 0.9f);   // Behind the hole
+            addScreenBox(scene, -0.4f, -0.1f, -0.3f, 0.1f, 0.8f, 0.9f);  // Behind the wall next to the hole
+            render(culler, scene);
+            const std::vector<uint8_t> visible = testBoxes(culler, scene);
+            report(visible[0] == 0u, "a wall hides the box behind it");
+            report(visible[1] == 1u && visible[2] == 1u, "boxes in front of the wall or crossing it stay visible");
+            report(visible[3] == 1u && visible[4] == 0u, "a box behind the hole stays visible");
+        }
+
+        // Behind the camera in part, it would cover the screen if it were not skipped
+        {
+            Scene scene;
+            addQuad(scene, Vec4{ -1.0f, -1.0f, 0.5f, 1.0f }, Vec4{ 1.0f, -1.0f, 0.5f, -1.0f }, Vec4{ 1.0f, 1.0f, 0.5f, -1.0f }, Vec4{ -1.0f, 1.0f, 0.5f, 1.0f });
+            addScreenBox(scene, -0.5f, -0.5f, 0.5f, 0.5f, 0.8f, 0.9f);
+            culler.resetStats();
+            render(culler, scene);
+            const std::vector<uint8_t> visible = testBoxes(culler, scene);
+            report(culler.getStats().rasterizedTriangles == 0u && visible[0] == 1u, "occluders crossing the near plane are skipped");
+        }
+
+        // A quad from pixel centre (64.5, 64.5) to (192.5, 192.5), so its diagonal and edges run through pixel
+        // centres exactly. The top-left fill rule covers pixels 64 to 191 on both axes, each by one triangle.
+        {
+            OcclusionCuller edgeCuller(256u, 256u);
+            const float halfPixel = 1.0f / 256.0f;
+            Scene scene;
+            addScreenQuad(scene, -0.5f + halfPixel, -0.5f - halfPixel, 0.5f + halfPixel, 0.5f - halfPixel, 0.5f);
+            addScreenBox(scene, -0.3f, -0.3f, 0.3f, 0.3f, 0.8f, 0.9f);
+            render(edgeCuller, scene);
+
+            uint32_t wrongPixels = 0u;
+            for (uint32_t y = 0u; y < edgeCuller.getHeight(); ++y)
+            {
+                for (uint32_t x = 0u; x < edgeCuller.getWidth(); ++x)
+                {
+                    const bool covered = x >= 64u && x < 192u && y >= 64u && y < 192u;
+                    wrongPixels += edgeCuller.getDepthBuffer()[y * edgeCuller.getWidth() + x] == (covered ? 0.5f : 1.0f) ? 0u : 1u;
+                }
+            }
+            const std::vector<uint8_t> visible = testBoxes(edgeCuller, scene);
+            report(wrongPixels == 0u, "triangles sharing an edge cover its pixels by the top-left rule");
+            report(visible[0] == 0u, "a box behind the shared edge is culled");
+        }
+
+        std::mt19937 random(options.seed);
+        const Scene scenes[] = { makeWallScene(options, random), makeCityScene(options, random), makeRubbleScene(options, random) };
+        for (const Scene &scene : scenes)
+        {
+            culler.resetStats();
+            render(culler, scene);
+            render(pooledCuller, scene);
+
+            std::vector<float> referenceDepth;
+            std::vector<uint8_t> ambiguous;
+            std::vector<float> tolerance;
+            rasterizeReference(scene, culler.getWidth(), culler.getHeight(), referenceDepth, ambiguous, tolerance);
+
+            uint32_t compared = 0u;
+            uint32_t mismatches = 0u;
+            for (size_t pixel = 0u; pixel < referenceDepth.size(); ++pixel)
+            {
+                if (ambiguous[pixel] == 0u)
+                {
+                    ++compared;
+                    mismatches += std::fabs(culler.getDepthBuffer()[pixel] - referenceDepth[pixel]) <= tolerance[pixel] ? 0u : 1u;
+                }
+            }
+            report(mismatches == 0u && compared > referenceDepth.size() / 2u, scene.name + ": depth matches the reference over " + std::to_string(compared) + " pixels");
+            report(std::equal(culler.getDepthBuffer(), culler.getDepthBuffer() + referenceDepth.size(), pooledCuller.getDepthBuffer()),
+                scene.name + ": pooled rasterization matches one thread");
+
+            const std::vector<uint8_t> visible = testBoxes(culler, scene);
+            uint32_t wronglyCulled = 0u;
+            for (uint32_t box = 0u; box < visible.size(); ++box)
+            {
+                if (visible[box] == 0u && isVisibleReference(&scene.boxCorners[8u * box].x, culler.getWidth(), culler.getHeight(), referenceDepth))
+                {
+                    ++wronglyCulled;
+                }
+            }
+            report(wronglyCulled == 0u, scene.name + ": no box the reference shows is culled");
+        }
+
+        std::cout << "\n";
+        return passed;
+    }
+
+    template<typename Run>
+    double measure(Run run)
+    {
+        uint32_t runs = 0u;
+        const Clock::time_point start = Clock::now();
+        do
+        {
+            run();
+            ++runs;
+        } while (millisecondsSince(start) < 200.0);
+        return millisecondsSince(start) / runs;
+    }
+
+    void benchmark(const Options &options, WorkerPool &workerPool)
+    {
+        std::mt19937 random(options.seed);
+        const Scene scenes[] = { makeWallScene(options, random), makeCityScene(options, random), makeRubbleScene(options, random) };
+
+        std::cout << std::left << std::setw(10) << "Scene" << std::right << std::setw(11) << "Occluders" << std::setw(12) << "Rasterized"
+                  << std::setw(12) << "Tris/ms" << std::setw(16) << "Tris/ms pool" << std::setw(10) << "Boxes" << std::setw(12) << "Tests/ms"
+                  << std::setw(10) << "Culled" << std::setw(10) << "Ideal" << "\n";
+        std::cout << std::fixed;
+        for (const Scene &scene : scenes)
+        {
+            OcclusionCuller culler(options.width, options.height);
+            OcclusionCuller pooledCuller(options.width, options.height, &workerPool);
+
+            const double single = measure([&]() { render(culler, scene); });
+            const double pooled = measure([&]() { render(pooledCuller, scene); });
+
+            culler.resetStats();
+            render(culler, scene);
+            const uint64_t rasterized = culler.getStats().rasterizedTriangles;
+
+            std::vector<uint8_t> visible;
+            const double testing = measure([&]() { visible = testBoxes(culler, scene); });
+            const uint32_t boxCount = getBoxCount(scene);
+            const uint32_t culled = boxCount - static_cast<uint32_t>(std::count(visible.begin(), visible.end(), 1u));
+
+            std::vector<float> referenceDepth;
+            std::vector<uint8_t> ambiguous;
+            std::vector<float> tolerance;
+            rasterizeReference(scene, culler.getWidth(), culler.getHeight(), referenceDepth, ambiguous, tolerance);
+            uint32_t idealCulled = 0u;
+            for (uint32_t box = 0u; box < boxCount; ++box)
+            {
+                idealCulled += isVisibleReference(&scene.boxCorners[8u * box].x, culler.getWidth(), culler.getHeight(), referenceDepth) ? 0u : 1u;
+            }
+
+            const uint32_t triangles = getTriangleCount(scene);
+            std::cout << std::left << std::setw(10) << scene.name << std::right << std::setw(11) << triangles << std::setw(12) << rasterized
+                      << std::setprecision(0) << std::setw(12) << triangles / single << std::setw(16) << triangles / pooled
+                      << std::setw(10) << boxCount << std::setw(12) << boxCount / testing
+                      << std::setprecision(1) << std::setw(9) << 100.0 * culled / boxCount << "%" << std::setw(9) << 100.0 * idealCulled / boxCount << "%\n";
+        }
+        std::cout << std::flush;
+    }
+
+    bool parseArguments(int argc, char **argv, Options &options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string argument = argv[i];
+            const bool hasValue = i + 1 < argc;
+
+            if (argument == "--width" && hasValue)
+            {
+                options.width = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (argument == "--height" && hasValue)
+            {
+                options.height = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (argument == "--objects" && hasValue)
+            {
+                options.objects = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (argument == "--jobs" && hasValue)
+            {
+                options.jobs = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (argument == "--seed" && hasValue)
+            {
+                options.seed = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else
+            {
+                return false;
+            }
+        }
+        return options.width > 0u && options.height > 0u && options.objects > 0u;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseArguments(argc, argv, options))
+    {
+        std::cerr << "Usage: OcclusionBench [--width <n>] [--height <n>] [--objects <n>] [--jobs <n>] [--seed <n>]" << std::endl;
+        return 1;
+    }
+
+    WorkerPool workerPool(options.jobs);
+#if defined(__AVX2__)
+    const char *rasterizer = "AVX2";
+#elif defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+    const char *rasterizer = "SSE2";
+#else
+    const char *rasterizer = "scalar";
+#endif
+    std::cout << "Depth buffer: " << options.width << " x " << options.height << ", rasterizer: " << rasterizer << ", threads: " << workerPool.getThreadCount() << "\n\n";
+
+    const bool passed = check(options, workerPool);
+    benchmark(options, workerPool);
+    return passed ? 0 : 1;
+}
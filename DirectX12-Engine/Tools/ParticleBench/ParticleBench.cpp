@@ -0,0 +1,163 @@
+// Particle simulation check and benchmark.
+//
+// Runs the CPU reference of the GPU particle passes three ways: one particle at a time through
+// simulateParticle, with SIMD on one thread, and with SIMD across the worker pool. The three
+// must agree bit for bit after every step, which is checked for the whole run, then each is timed
+// on a full pool of particles and reported in particles simulated per millisecond.
+//
+// Usage:
+//   ParticleBench [--particles <n>] [--frames <n>] [--jobs <n>]
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "ParticleSimulation.h"
+#include "WorkerPool.h"
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    double millisecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    struct Options
+    {
+        uint32_t particles = 1u << 20;
+        uint32_t frames = 600u;
+        uint32_t jobs = 0u;
+    };
+
+    const float StepTime = 1.0f / 60.0f;
+
+    // Emits enough to keep the pool about full with the default lifetimes
+    ParticleEmitterSettings makeSettings(uint32_t particles)
+    {
+        ParticleEmitterSettings settings;
+        settings.emitRate = static_cast<float>(particles) / (settings.minLifetime + settings.lifetimeRange);
+        return settings;
+    }
+
+    bool check(const Options &options, WorkerPool &workerPool)
+    {
+        ParticleEmitterSettings settings = makeSettings(options.particles);
+        ParticleSimulation scalar(options.particles);
+        ParticleSimulation simd(options.particles);
+        ParticleSimulation threaded(options.particles);
+        float emitCarry = 0.0f;
+
+        std::vector<ParticleState> expected;
+        std::vector<ParticleState> actual;
+        uint32_t differences = 0u;
+        for (uint32_t frame = 0u; frame < options.frames; ++frame)
+        {
+            const ParticleFrameConstants constants = makeParticleFrameConstants(settings, StepTime, options.particles, emitCarry);
+            scalar.updateScalar(constants);
+            simd.update(constants, nullptr);
+            threaded.update(constants, &workerPool);
+
+            scalar.getParticles(expected);
+            simd.getParticles(actual);
+            differences += compareParticles(expected.data(), static_cast<uint32_t>(expected.size()), actual.data(), static_cast<uint32_t>(actual.size()));
+            threaded.getParticles(actual);
+            differences += compareParticles(expected.data(), static_cast<uint32_t>(expected.size()), actual.data(), static_cast<uint32_t>(actual.size()));
+        }
+
+        std::cout << "Checked " << options.frames << " frames, " << scalar.getEmittedCount() << " particles emitted, "
+                  << scalar.getAliveCount() << " alive at the end: ";
+        std::cout << (differences == 0u ? "bit exact" : std::to_string(differences) + " differences") << "\n\n";
+        return differences == 0u;
+    }
+
+    // Particles per millisecond, the pool is filled first and kept full by emission
+    template<typename Step>
+    double measure(const Options &options, Step step)
+    {
+        ParticleEmitterSettings settings = makeSettings(options.particles);
+        ParticleSimulation simulation(options.particles);
+        float emitCarry = 0.0f;
+        for (uint32_t frame = 0u; frame < 120u; ++frame)
+        {
+            step(simulation, makeParticleFrameConstants(settings, StepTime, options.particles, emitCarry));
+        }
+
+        uint64_t simulated = 0u;
+        const Clock::time_point start = Clock::now();
+        do
+        {
+            const ParticleFrameConstants constants = makeParticleFrameConstants(settings, StepTime, options.particles, emitCarry);
+            simulated += simulation.getAliveCount() + constants.emitCount;
+            step(simulation, constants);
+        } while (millisecondsSince(start) < 200.0);
+        return static_cast<double>(simulated) / millisecondsSince(start);
+    }
+
+    bool parseArguments(int argc, char **argv, Options &options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string argument = argv[i];
+            const bool hasValue = i + 1 < argc;
+
+            if (argument == "--particles" && hasValue)
+            {
+                options.particles = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (argument == "--frames" && hasValue)
+            {
+                options.frames = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (argument == "--jobs" && hasValue)
+            {
+                options.jobs = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else
+            {
+                return false;
+            }
+        }
+        return options.particles > 0u;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseArguments(argc, argv, options))
+    {
+        std::cerr << "Usage: ParticleBench [--particles <n>] [--frames <n>] [--jobs <n>]" << std::endl;
+        return 1;
+    }
+
+    WorkerPool workerPool(options.jobs);
+    std::cout << "Particles: " << options.particles << ", threads: " << workerPool.getThreadCount() << "\n\n";
+
+    const bool passed = check(options, workerPool);
+
+    const double scalar = measure(options, [](ParticleSimulation &simulation, const ParticleFrameConstants &constants)
+    {
+        simulation.updateScalar(constants);
+    });
+    const double simd = measure(options, [](ParticleSimulation &simulation, const ParticleFrameConstants &constants)
+    {
+        simulation.update(constants, nullptr);
+    });
+    const double threaded = measure(options, [&workerPool](ParticleSimulation &simulation, const ParticleFrameConstants &constants)
+    {
+        simulation.update(constants, &workerPool);
+    });
+
+    std::cout << std::fixed << std::setprecision(0);
+    std::cout << std::left << std::setw(16) << "Scalar" << std::right << std::setw(12) << scalar << " particles/ms\n";
+    std::cout << std::left << std::setw(16) << "SIMD" << std::right << std::setw(12) << simd << " particles/ms  "
+              << std::setprecision(1) << simd / scalar << "x\n" << std::setprecision(0);
+    std::cout << std::left << std::setw(16) << "SIMD threaded" << std::right << std::setw(12) << threaded << " particles/ms  "
+              << std::setprecision(1) << threaded / scalar << "x\n";
+    std::cout << std::flush;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,383 @@
+// PickingIndex check and benchmark.
+//
+// Moves a crowd of rectangles around a square world every frame, with a few of them brought to
+// the front, removed and added again, and checks that:
+//  - pickTopmost() finds the same rectangle as testing every one in stacking order
+//  - queryRect() returns exactly the overlapping rectangles, topmost first
+//  - the tree stays balanced and small moves mostly stay inside the padded bounds
+// Then every count is timed moving all rectangles, picking points and querying areas, next to
+// the brute force pick the index replaced.
+//
+// Usage:
+//   PickingIndexBench [--count <n>...] [--frames <n>] [--seed <n>]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "PickingIndex.h"
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    double millisecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    struct Options
+    {
+        std::vector<uint32_t> counts;
+        uint32_t frames = 20u;
+        uint32_t seed = 1u;
+    };
+
+    const float WorldSize = 4096.0f;
+
+    // The harness' own copy of every rectangle, stacking order and velocity
+    struct Mover
+    {
+        PickingIndex::Rect rect;
+        float velocityX;
+        float velocityY;
+        uint64_t order;
+        uint32_t id;
+    };
+
+    class Crowd
+    {
+    public:
+        Crowd(uint32_t count, std::mt19937 &random)
+            : m_random(random)
+            , m_nextOrder(0u)
+        {
+            m_movers.resize(count);
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                Mover &mover = m_movers[i];
+                const float width = size();
+                const float height = size();
+                std::uniform_real_distribution<float> x(0.0f, WorldSize - width);
+                std::uniform_real_distribution<float> y(0.0f, WorldSize - height);
+                mover.rect = { x(m_random), y(m_random), 0.0f, 0.0f };
+                mover.rect.maxX = mover.rect.minX + width;
+                mover.rect.maxY = mover.rect.minY + height;
+
+                // Up to a few pixels a frame, like a dragged or animated visual
+                std::uniform_real_distribution<float> velocity(-4.0f, 4.0f);
+                mover.velocityX = velocity(m_random);
+                mover.velocityY = velocity(m_random);
+
+                mover.id = m_index.insert(mover.rect, i);
+                mover.order = ++m_nextOrder;
+            }
+        }
+
+        // Moves every rectangle, bouncing off the world edges
+        void step()
+        {
+            for (Mover &mover : m_movers)
+            {
+                if (mover.rect.minX + mover.velocityX < 0.0f || mover.rect.maxX + mover.velocityX > WorldSize)
+                {
+                    mover.velocityX = -mover.velocityX;
+                }
+                if (mover.rect.minY + mover.velocityY < 0.0f || mover.rect.maxY + mover.velocityY > WorldSize)
+                {
+                    mover.velocityY = -mover.velocityY;
+                }
+                mover.rect.minX += mover.velocityX;
+                mover.rect.maxX += mover.velocityX;
+                mover.rect.minY += mover.velocityY;
+                mover.rect.maxY += mover.velocityY;
+                m_index.move(mover.id, mover.rect);
+            }
+        }
+
+        // Brings some rectangles to the front and replaces some, as clicks would
+        void shuffle(uint32_t count)
+        {
+            std::uniform_int_distribution<size_t> pick(0u, m_movers.size() - 1u);
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                Mover &front = m_movers[pick(m_random)];
+                m_index.bringToFront(front.id);
+                front.order = ++m_nextOrder;
+
+                const size_t replaced = pick(m_random);
+                Mover &mover = m_movers[replaced];
+                m_index.remove(mover.id);
+                mover.id = m_index.insert(mover.rect, static_cast<uint32_t>(replaced));
+                mover.order = ++m_nextOrder;
+            }
+        }
+
+        // The topmost rectangle under the point by testing all of them, InvalidId if none
+        uint32_t bruteForcePick(float x, float y) const
+        {
+            uint32_t best = PickingIndex::InvalidId;
+            uint64_t bestOrder = 0u;
+            for (const Mover &mover : m_movers)
+            {
+                const PickingIndex::Rect &rect = mover.rect;
+                if (x >= rect.minX && x < rect.maxX && y >= rect.minY && y < rect.maxY && mover.order > bestOrder)
+                {
+                    best = mover.id;
+                    bestOrder = mover.order;
+                }
+            }
+            return best;
+        }
+
+        void bruteForceQuery(const PickingIndex::Rect &area, std::vector<uint32_t> &ids) const
+        {
+            std::vector<const Mover *> hits;
+            for (const Mover &mover : m_movers)
+            {
+                const PickingIndex::Rect &rect = mover.rect;
+                if (rect.minX <= area.maxX && rect.maxX >= area.minX && rect.minY <= area.maxY && rect.maxY >= area.minY)
+                {
+                    hits.push_back(&mover);
+                }
+            }
+            std::sort(hits.begin(), hits.end(), [](const Mover *a, const Mover *b) { return a->order > b->order; });
+
+            ids.clear();
+            for (const Mover *mover : hits)
+            {
+                ids.push_back(mover->id);
+            }
+        }
+
+        PickingIndex::Rect randomArea()
+        {
+            std::uniform_real_distribution<float> position(0.0f, WorldSize - 256.0f);
+            std::uniform_real_distribution<float> extent(16.0f, 256.0f);
+            PickingIndex::Rect area = { position(m_random), position(m_random), 0.0f, 0.0f };
+            area.maxX = area.minX + extent(m_random);
+            area.maxY = area.minY + extent(m_random);
+            return area;
+        }
+
+        float randomCoordinate()
+        {
+            return std::uniform_real_distribution<float>(0.0f, WorldSize)(m_random);
+        }
+
+        PickingIndex &index() { return m_index; }
+
+    private:
+        float size()
+        {
+            return std::uniform_real_distribution<float>(4.0f, 64.0f)(m_random);
+        }
+
+        std::mt19937 &m_random;
+        PickingIndex m_index;
+        std::vector<Mover> m_movers;
+        uint64_t m_nextOrder;
+    };
+
+    // An AVL balanced tree of n leaves is at most about 1.44 log2(n) high
+    uint32_t heightLimit(uint32_t count)
+    {
+        return static_cast<uint32_t>(std::ceil(1.45 * std::log2(static_cast<double>(count) + 2.0))) + 1u;
+    }
+
+    bool check(const Options &options)
+    {
+        bool passed = true;
+        auto report = [&passed](bool condition, const std::string &what)
+        {
+            std::cout << std::left << std::setw(64) << what << (condition ? "ok" : "FAILED") << "\n";
+            passed = passed && condition;
+        };
+
+        std::mt19937 random(options.seed);
+        const uint32_t count = options.counts.back();
+        Crowd crowd(count, random);
+
+        bool picksMatch = true;
+        bool queriesMatch = true;
+        bool balanced = true;
+        uint32_t hits = 0u;
+        uint32_t maxHeight = 0u;
+        std::vector<uint32_t> ids;
+        std::vector<uint32_t> expected;
+
+        crowd.index().resetStats();
+        for (uint32_t frame = 0; frame < options.frames; ++frame)
+        {
+            crowd.step();
+            crowd.shuffle(count / 1000u + 1u);
+
+            for (uint32_t i = 0; i < 200u; ++i)
+            {
+                const float x = crowd.randomCoordinate();
+                const float y = crowd.randomCoordinate();
+                const uint32_t id = crowd.index().pickTopmost(x, y);
+                picksMatch = picksMatch && id == crowd.bruteForcePick(x, y);
+                hits += id != PickingIndex::InvalidId ? 1u : 0u;
+            }
+
+            for (uint32_t i = 0; i < 20u; ++i)
+            {
+                const PickingIndex::Rect area = crowd.randomArea();
+                crowd.index().queryRect(area, ids);
+                crowd.bruteForceQuery(area, expected);
+                queriesMatch = queriesMatch && ids == expected;
+            }
+
+            maxHeight = (std::max)(maxHeight, crowd.index().getHeight());
+            balanced = balanced && crowd.index().getCount() == count && crowd.index().getHeight() <= heightLimit(count);
+        }
+
+        const PickingIndex::Stats &stats = crowd.index().getStats();
+        const double reinsertRate = static_cast<double>(stats.reinsertions) / (std::max)(stats.moves, uint64_t(1u));
+
+        const std::string label = std::to_string(count) + " moving rectangles";
+        report(picksMatch && hits > 0u, label + ": picks match brute force");
+        report(queriesMatch, label + ": area queries match, topmost first");
+        report(balanced, label + ": height " + std::to_string(maxHeight) + " of at most " + std::to_string(heightLimit(count)));
+        report(reinsertRate < 0.5, label + ": moves leaving the margin under half");
+
+        std::cout << "\n";
+        return passed;
+    }
+
+    void benchmark(const Options &options)
+    {
+        std::cout << std::left << std::setw(12) << "Count" << std::right << std::setw(10) << "Height" << std::setw(14) << "Move ms"
+                  << std::setw(12) << "Reinsert" << std::setw(12) << "Pick ns" << std::setw(14) << "Visited" << std::setw(14) << "Query us"
+                  << std::setw(16) << "Brute pick ns" << "\n";
+
+        std::cout << std::fixed;
+        for (const uint32_t count : options.counts)
+        {
+            std::mt19937 random(options.seed);
+            Crowd crowd(count, random);
+
+            std::vector<float> points(2048u);
+            for (float &point : points)
+            {
+                point = crowd.randomCoordinate();
+            }
+            std::vector<PickingIndex::Rect> areas(256u);
+            for (PickingIndex::Rect &area : areas)
+            {
+                area = crowd.randomArea();
+            }
+
+            crowd.index().resetStats();
+            Clock::time_point start = Clock::now();
+            uint32_t frames = 0u;
+            do
+            {
+                crowd.step();
+                ++frames;
+            } while (millisecondsSince(start) < 200.0);
+            const double moveMilliseconds = millisecondsSince(start) / frames;
+            const PickingIndex::Stats moveStats = crowd.index().getStats();
+
+            crowd.index().resetStats();
+            uint64_t picks = 0u;
+            uint32_t found = 0u;
+            start = Clock::now();
+            do
+            {
+                for (size_t i = 0; i < points.size(); i += 2u)
+                {
+                    found += crowd.index().pickTopmost(points[i], points[i + 1u]) != PickingIndex::InvalidId ? 1u : 0u;
+                }
+                picks += points.size() / 2u;
+            } while (millisecondsSince(start) < 200.0);
+            const double pickNanoseconds = millisecondsSince(start) * 1e6 / picks;
+            const double visited = static_cast<double>(crowd.index().getStats().nodesVisited) / picks;
+
+            std::vector<uint32_t> ids;
+            uint64_t queries = 0u;
+            start = Clock::now();
+            do
+            {
+                for (const PickingIndex::Rect &area : areas)
+                {
+                    crowd.index().queryRect(area, ids);
+                    found += static_cast<uint32_t>(ids.size());
+                }
+                queries += areas.size();
+            } while (millisecondsSince(start) < 200.0);
+            const double queryMicroseconds = millisecondsSince(start) * 1e3 / queries;
+
+            uint64_t brutePicks = 0u;
+            start = Clock::now();
+            do
+            {
+                const size_t i = brutePicks * 2u % points.size();
+                found += crowd.bruteForcePick(points[i], points[i + 1u]) != PickingIndex::InvalidId ? 1u : 0u;
+                ++brutePicks;
+            } while (millisecondsSince(start) < 200.0);
+            const double bruteNanoseconds = millisecondsSince(start) * 1e6 / brutePicks;
+
+            std::cout << std::left << std::setw(12) << count << std::right << std::setw(10) << crowd.index().getHeight()
+                      << std::setprecision(3) << std::setw(14) << moveMilliseconds
+                      << std::setprecision(1) << std::setw(11) << 100.0 * moveStats.reinsertions / (std::max)(moveStats.moves, uint64_t(1u)) << "%"
+                      << std::setw(12) << pickNanoseconds << std::setw(14) << visited << std::setw(14) << queryMicroseconds
+                      << std::setprecision(0) << std::setw(16) << bruteNanoseconds << (found == 0u ? " (nothing found)" : "") << "\n";
+        }
+        std::cout << std::flush;
+    }
+
+    bool parseArguments(int argc, char **argv, Options &options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string argument = argv[i];
+            const bool hasValue = i + 1 < argc;
+
+            if (argument == "--count" && hasValue)
+            {
+                options.counts.push_back(static_cast<uint32_t>(std::stoul(argv[++i])));
+            }
+            else if (argument == "--frames" && hasValue)
+            {
+                options.frames = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (argument == "--seed" && hasValue)
+            {
+                options.seed = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else
+            {
+                return false;
+            }
+        }
+
+        if (options.counts.empty())
+        {
+            options.counts = { 1000u, 10000u, 100000u };
+        }
+        return std::all_of(options.counts.begin(), options.counts.end(), [](uint32_t count) { return count > 0u; });
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseArguments(argc, argv, options))
+    {
+        std::cerr << "Usage: PickingIndexBench [--count <n>...] [--frames <n>] [--seed <n>]" << std::endl;
+        return 1;
+    }
+
+    std::cout << "World: " << WorldSize << "x" << WorldSize << ", frames checked: " << options.frames << ", seed: " << options.seed << "\n\n";
+
+    const bool passed = check(options);
+    benchmark(options);
+    return passed ? 0 : 1;
+}
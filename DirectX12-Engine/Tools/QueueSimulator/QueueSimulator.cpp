@@ -0,0 +1,333 @@
+// Multi queue schedule simulator.
+//
+// Builds frame graphs with QueueScheduler, compiles them and replays the result on a simulated
+// timeline of the direct, compute and copy queues. For every graph it prints the queue each item
+// landed on, the fences and barriers the schedule needs, how much the queues overlapped compared
+// to running everything on the direct queue, and any dependency or resource state the fences
+// failed to protect.
+//
+// The built in graphs are the engine's own frame and a set of random graphs that exercise queue
+// moves, shared readers and hand overs between queue types. --timeline draws the engine frame
+// as text, one row per queue.
+//
+// Usage:
+//   QueueSimulator [--random <count>] [--latency <cost>] [--pinned] [--timeline]
+
+#include <algorithm>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "QueueScheduler.h"
+
+namespace
+{
+    struct Options
+    {
+        uint32_t randomGraphs = 200u;
+        float fenceLatency = 0.02f;
+        bool pinned = false;
+        bool timeline = false;
+    };
+
+    const char *QueueNames[] = { "direct", "compute", "copy" };
+
+    // The renderer's frame with the compute work it moves off the direct queue. Costs are in
+    // milliseconds, roughly what a mid range GPU spends at 1080p. Constants are only read by
+    // non pixel stages so every pass shares one read state for them, the particle simulation
+    // takes its own as root constants.
+    void buildEngineFrame(QueueScheduler &scheduler, bool pinned)
+    {
+        QueueScheduler::ResourceId uniforms = scheduler.addResource("uniform buffer");
+        QueueScheduler::ResourceId uav = scheduler.addResource("uav buffer");
+        QueueScheduler::ResourceId spriteInstances = scheduler.addResource("sprite instances");
+        QueueScheduler::ResourceId particles = scheduler.addResource("particles");
+        QueueScheduler::ResourceId lightGrid = scheduler.addResource("light grid");
+        QueueScheduler::ResourceId depth = scheduler.addResource("depth");
+        QueueScheduler::ResourceId sceneTarget = scheduler.addResource("scene target");
+        QueueScheduler::ResourceId histogram = scheduler.addResource("luminance histogram");
+        QueueScheduler::ResourceId backBuffer = scheduler.addResource("back buffer");
+        QueueScheduler::ResourceId readback = scheduler.addResource("readback");
+
+        QueueScheduler::WorkId upload = scheduler.addWork("upload constants", QueueType::Copy, 0.05f, pinned);
+        scheduler.addAccess(upload, uniforms, ResourceAccess::CopyDest);
+        QueueScheduler::WorkId spriteUpload = scheduler.addWork("upload sprites", QueueType::Copy, 0.15f, pinned);
+        scheduler.addAccess(spriteUpload, spriteInstances, ResourceAccess::CopyDest);
+
+        QueueScheduler::WorkId simulate = scheduler.addWork("simulate particles", QueueType::Compute, 0.6f, pinned);
+        scheduler.addAccess(simulate, particles, ResourceAccess::UnorderedAccess);
+
+        QueueScheduler::WorkId depthPrepass = scheduler.addWork("depth prepass", QueueType::Direct, 0.8f, true);
+        scheduler.addAccess(depthPrepass, uniforms, ResourceAccess::ComputeRead);
+        scheduler.addAccess(depthPrepass, depth, ResourceAccess::DepthWrite);
+
+        QueueScheduler::WorkId cullLights = scheduler.addWork("cull lights", QueueType::Compute, 0.5f, pinned);
+        scheduler.addAccess(cullLights, depth, ResourceAccess::ComputeRead);
+        scheduler.addAccess(cullLights, lightGrid, ResourceAccess::UnorderedAccess);
+
+        QueueScheduler::WorkId updateUav = scheduler.addWork("update uav", QueueType::Compute, 0.3f, pinned);
+        scheduler.addAccess(updateUav, uav, ResourceAccess::UnorderedAccess);
+
+        QueueScheduler::WorkId shadows = scheduler.addWork("shadow maps", QueueType::Direct, 1.2f, true);
+        scheduler.addAccess(shadows, uniforms, ResourceAccess::ComputeRead);
+
+        QueueScheduler::WorkId scene = scheduler.addWork("scene", QueueType::Direct, 2.5f, true);
+        scheduler.addAccess(scene, uniforms, ResourceAccess::ComputeRead);
+        scheduler.addAccess(scene, uav, ResourceAccess::UnorderedAccess);
+        scheduler.addAccess(scene, lightGrid, ResourceAccess::GraphicsRead);
+        scheduler.addAccess(scene, depth, ResourceAccess::GraphicsRead);
+        scheduler.addAccess(scene, sceneTarget, ResourceAccess::RenderTarget);
+        scheduler.addDependency(shadows, scene);
+
+        QueueScheduler::WorkId drawParticles = scheduler.addWork("draw particles", QueueType::Direct, 0.4f, true);
+        scheduler.addAccess(drawParticles, particles, ResourceAccess::GraphicsRead);
+        scheduler.addAccess(drawParticles, sceneTarget, ResourceAccess::RenderTarget);
+
+        QueueScheduler::WorkId luminance = scheduler.addWork("luminance histogram", QueueType::Compute, 0.3f, pinned);
+        scheduler.addAccess(luminance, sceneTarget, ResourceAccess::ComputeRead);
+        scheduler.addAccess(luminance, histogram, ResourceAccess::UnorderedAccess);
+
+        QueueScheduler::WorkId upscale = scheduler.addWork("upscale", QueueType::Direct, 0.5f, true);
+        scheduler.addAccess(upscale, sceneTarget, ResourceAccess::ComputeRead);
+        scheduler.addAccess(upscale, histogram, ResourceAccess::ComputeRead);
+        scheduler.addAccess(upscale, backBuffer, ResourceAccess::RenderTarget);
+
+        QueueScheduler::WorkId sprites = scheduler.addWork("sprites", QueueType::Direct, 0.3f, true);
+        scheduler.addAccess(sprites, spriteInstances, ResourceAccess::GraphicsRead);
+        scheduler.addAccess(sprites, backBuffer, ResourceAccess::RenderTarget);
+
+        QueueScheduler::WorkId copyBack = scheduler.addWork("copy histogram", QueueType::Copy, 0.05f, pinned);
+        scheduler.addAccess(copyBack, histogram, ResourceAccess::CopySource);
+        scheduler.addAccess(copyBack, readback, ResourceAccess::CopyDest);
+    }
+
+    void buildRandomGraph(QueueScheduler &scheduler, std::mt19937 &random, bool pinned)
+    {
+        static const ResourceAccess accesses[] =
+        {
+            ResourceAccess::CopySource, ResourceAccess::CopyDest, ResourceAccess::ComputeRead, ResourceAccess::GraphicsRead,
+            ResourceAccess::UnorderedAccess, ResourceAccess::RenderTarget, ResourceAccess::DepthWrite
+        };
+
+        uint32_t resourceCount = 2u + random() % 10u;
+        for (uint32_t r = 0u; r < resourceCount; ++r)
+        {
+            scheduler.addResource(("resource " + std::to_string(r)).c_str());
+        }
+
+        uint32_t workCount = 4u + random() % 40u;
+        std::uniform_real_distribution<float> cost(0.05f, 2.0f);
+        for (uint32_t w = 0u; w < workCount; ++w)
+        {
+            QueueType queue = static_cast<QueueType>(random() % 3u);
+            QueueScheduler::WorkId work = scheduler.addWork(("work " + std::to_string(w)).c_str(), queue, cost(random), pinned || random() % 4u == 0u);
+
+            // Accesses the queue can make, on distinct resources
+            uint32_t accessCount = random() % 4u;
+            std::vector<uint32_t> used;
+            for (uint32_t a = 0u; a < accessCount; ++a)
+            {
+                uint32_t resource = random() % resourceCount;
+                ResourceAccess access = accesses[random() % 7u];
+                if (std::find(used.begin(), used.end(), resource) != used.end() || !QueueScheduler::supportsAccess(queue, access))
+                {
+                    continue;
+                }
+                used.push_back(resource);
+                scheduler.addAccess(work, resource, access);
+            }
+
+            if (w > 0u && random() % 5u == 0u)
+            {
+                scheduler.addDependency(random() % w, work);
+            }
+        }
+    }
+
+    void printTimeline(const QueueScheduler &scheduler, const QueueScheduler::Schedule &schedule, const QueueScheduler::SimulationReport &report)
+    {
+        const uint32_t columns = 100u;
+        float scale = columns / report.frameTime;
+        std::cout << "\n";
+        for (uint32_t queue = 0u; queue < QueueScheduler::QueueCount; ++queue)
+        {
+            std::string row(columns, '.');
+            char label = 'a';
+            std::string legend;
+            for (uint32_t w = 0u; w < scheduler.getWorkCount(); ++w)
+            {
+                if (static_cast<uint32_t>(schedule.queues[w]) != queue)
+                {
+                    continue;
+                }
+                uint32_t begin = static_cast<uint32_t>(report.timings[w].start * scale);
+                uint32_t end = (std::max)(begin + 1u, static_cast<uint32_t>(report.timings[w].end * scale));
+                for (uint32_t c = begin; c < (std::min)(end, columns); ++c)
+                {
+                    row[c] = label;
+                }
+                legend += std::string(" ") + label + "=" + scheduler.getWorkName(w);
+                label = label == 'z' ? 'a' : static_cast<char>(label + 1);
+            }
+            std::cout << std::left << std::setw(8) << QueueNames[queue] << row << "\n" << std::setw(8) << "" << legend << "\n";
+        }
+    }
+
+    void printSchedule(const QueueScheduler &scheduler, const QueueScheduler::Schedule &schedule)
+    {
+        for (const QueueScheduler::Submission &submission : schedule.submissions)
+        {
+            std::cout << std::left << std::setw(8) << QueueNames[static_cast<uint32_t>(submission.queue)];
+            for (const QueueScheduler::Wait &wait : submission.waits)
+            {
+                std::cout << " wait(" << QueueNames[static_cast<uint32_t>(wait.queue)] << " " << wait.value << ")";
+            }
+            for (const QueueScheduler::ScheduledWork &work : submission.work)
+            {
+                std::cout << " [";
+                for (const QueueScheduler::Barrier &barrier : work.beginBarriers)
+                {
+                    std::cout << "barrier " << scheduler.getResourceName(barrier.resource) << ", ";
+                }
+                std::cout << scheduler.getWorkName(work.work);
+                for (const QueueScheduler::Barrier &barrier : work.endBarriers)
+                {
+                    std::cout << ", release " << scheduler.getResourceName(barrier.resource);
+                }
+                std::cout << "]";
+            }
+            if (submission.signalValue != 0u)
+            {
+                std::cout << " signal " << submission.signalValue;
+            }
+            std::cout << "\n";
+        }
+    }
+
+    void printSummaryHeader()
+    {
+        std::cout << std::left << std::setw(14) << "Graph" << std::right << std::setw(7) << "Work" << std::setw(10) << "X-deps"
+                  << std::setw(8) << "Waits" << std::setw(9) << "Signals" << std::setw(10) << "Barriers" << std::setw(10) << "Serial"
+                  << std::setw(10) << "Frame" << std::setw(10) << "Overlap" << std::setw(8) << "Errors" << "\n";
+    }
+
+    void printSummary(const std::string &name, const QueueScheduler &scheduler, const QueueScheduler::Schedule &schedule, const QueueScheduler::SimulationReport &report)
+    {
+        uint32_t signals = schedule.signalCounts[0] + schedule.signalCounts[1] + schedule.signalCounts[2];
+        std::cout << std::left << std::setw(14) << name << std::right << std::setw(7) << scheduler.getWorkCount()
+                  << std::setw(10) << schedule.crossQueueDependencies << std::setw(8) << schedule.waitCount << std::setw(9) << signals
+                  << std::setw(10) << schedule.barrierCount << std::setw(10) << report.serialTime << std::setw(10) << report.frameTime
+                  << std::setw(9) << 100.0f * (1.0f - report.frameTime / report.serialTime) << "%" << std::setw(8) << report.errors.size() << "\n";
+    }
+
+    bool parseArguments(int argc, char **argv, Options &options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string argument = argv[i];
+            const bool hasValue = i + 1 < argc;
+
+            if (argument == "--random" && hasValue)
+            {
+                options.randomGraphs = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (argument == "--latency" && hasValue)
+            {
+                options.fenceLatency = std::stof(argv[++i]);
+            }
+            else if (argument == "--pinned")
+            {
+                options.pinned = true;
+            }
+            else if (argument == "--timeline")
+            {
+                options.timeline = true;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseArguments(argc, argv, options))
+    {
+        std::cerr << "Usage: QueueSimulator [--random <count>] [--latency <cost>] [--pinned] [--timeline]" << std::endl;
+        return 1;
+    }
+
+    QueueScheduler::Settings settings;
+    settings.fenceLatency = options.fenceLatency;
+
+    std::cout << std::fixed << std::setprecision(2);
+
+    QueueScheduler scheduler;
+    QueueScheduler::Schedule schedule;
+    QueueScheduler::SimulationReport report;
+
+    // The engine frame, serial time is what it costs on the direct queue alone
+    buildEngineFrame(scheduler, options.pinned);
+    scheduler.compile(settings, schedule);
+    scheduler.simulate(schedule, settings, report);
+
+    printSchedule(scheduler, schedule);
+    if (options.timeline)
+    {
+        printTimeline(scheduler, schedule, report);
+    }
+    std::cout << "\n";
+    printSummaryHeader();
+    printSummary("engine frame", scheduler, schedule, report);
+    for (const std::string &error : report.errors)
+    {
+        std::cout << "  " << error << "\n";
+    }
+
+    // Random graphs, every one has to come out without errors
+    std::mt19937 random(1234u);
+    uint32_t failedGraphs = 0u;
+    uint64_t crossQueueDependencies = 0u;
+    uint64_t waits = 0u;
+    float serialTime = 0.0f;
+    float frameTime = 0.0f;
+    for (uint32_t graph = 0u; graph < options.randomGraphs; ++graph)
+    {
+        scheduler.clear();
+        buildRandomGraph(scheduler, random, options.pinned);
+        scheduler.compile(settings, schedule);
+        scheduler.simulate(schedule, settings, report);
+
+        crossQueueDependencies += schedule.crossQueueDependencies;
+        waits += schedule.waitCount;
+        serialTime += report.serialTime;
+        frameTime += report.frameTime;
+        if (!report.errors.empty())
+        {
+            ++failedGraphs;
+            printSummary("random " + std::to_string(graph), scheduler, schedule, report);
+            for (const std::string &error : report.errors)
+            {
+                std::cout << "  " << error << "\n";
+            }
+        }
+    }
+
+    if (options.randomGraphs > 0u)
+    {
+        std::cout << std::left << std::setw(14) << "random" << std::right << std::setw(7) << options.randomGraphs
+                  << std::setw(10) << crossQueueDependencies << std::setw(8) << waits << std::setw(9) << "-"
+                  << std::setw(10) << "-" << std::setw(10) << serialTime << std::setw(10) << frameTime
+                  << std::setw(9) << 100.0f * (1.0f - frameTime / serialTime) << "%" << std::setw(8) << failedGraphs << "\n";
+    }
+    std::cout << std::flush;
+
+    return failedGraphs == 0u ? 0 : 1;
+}
@@ -0,0 +1,363 @@
+// ResolutionScaleController trace replay.
+//
+// Replays GPU load traces through the controller the way Renderer drives it: each frame renders
+// at the scale the controller picked from the frame FrameLatency frames back, and costs its
+// full resolution time times the scale squared. Synthetic traces check that:
+//  - a steady load settles without a limit cycle, at a scale that meets the budget
+//  - load changes that keep the error inside the dead band change nothing, ones just outside do
+//  - small frame noise is ignored, large noise moves the scale little and rarely misses the budget
+//  - after a load that pins the scale at its minimum the scale recovers as fast as with no
+//    integral term at all, so the integral did not wind up while pinned
+//  - the budget is missed less often than at full resolution
+// Recorded traces are replayed the same way. Debug builds of the renderer write one
+// "drs <GPU ms> <scale>" line per frame to the debug output, and any file holding such lines
+// (a saved debug log will do) can be passed with --trace.
+//
+// Usage:
+//   ResolutionScaleBench [--trace <file>...] [--seed <n>]
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "ResolutionScaleController.h"
+
+namespace
+{
+    const uint32_t FrameLatency = 2u; // Renderer::FrameCount
+
+    struct Options
+    {
+        std::vector<std::string> tracePaths;
+        uint32_t seed = 1u;
+    };
+
+    struct Trace
+    {
+        std::string name;
+        std::vector<float> costMs; // GPU time of each frame at full resolution
+        uint32_t eventFrame = 0u;  // Frame the last load change ends, recovery is counted from there
+    };
+
+    struct Replay
+    {
+        std::vector<float> scales;
+        std::vector<float> frameMs;
+        uint32_t missed = 0u;
+        uint32_t changes = 0u;
+        uint32_t reversals = 0u;
+        double meanScale = 0.0;
+    };
+
+    Replay replay(const Trace &trace, const ResolutionScaleController::Settings &settings)
+    {
+        ResolutionScaleController controller(settings);
+        Replay result;
+        float previousStep = 0.0f;
+        for (size_t frame = 0u; frame < trace.costMs.size(); ++frame)
+        {
+            const float scale = frame >= FrameLatency ? controller.update(result.frameMs[frame - FrameLatency], result.scales[frame - FrameLatency]) : controller.getScale();
+            const float frameMs = trace.costMs[frame] * scale * scale;
+
+            if (!result.scales.empty() && scale != result.scales.back())
+            {
+                const float step = scale - result.scales.back();
+                result.reversals += previousStep * step < 0.0f ? 1u : 0u;
+                previousStep = step;
+                ++result.changes;
+            }
+            result.scales.push_back(scale);
+            result.frameMs.push_back(frameMs);
+            result.missed += frameMs > settings.targetFrameTimeMs ? 1u : 0u;
+            result.meanScale += scale;
+        }
+        result.meanScale /= (std::max)(trace.costMs.size(), size_t(1u));
+        return result;
+    }
+
+    uint32_t countChanges(const Replay &result, size_t begin, size_t end)
+    {
+        uint32_t changes = 0u;
+        for (size_t frame = (std::max)(begin, size_t(1u)); frame < end && frame < result.scales.size(); ++frame)
+        {
+            changes += result.scales[frame] != result.scales[frame - 1u] ? 1u : 0u;
+        }
+        return changes;
+    }
+
+    // Frames from the trace's event until the scale is back at the maximum for good
+    uint32_t recoveryFrames(const Replay &result, const Trace &trace, float maxScale)
+    {
+        size_t frame = result.scales.size();
+        while (frame > trace.eventFrame && result.scales[frame - 1u] >= maxScale)
+        {
+            --frame;
+        }
+        return static_cast<uint32_t>(frame - trace.eventFrame);
+    }
+
+    uint32_t countFullResolutionMisses(const Trace &trace, float targetMs)
+    {
+        return static_cast<uint32_t>(std::count_if(trace.costMs.begin(), trace.costMs.end(), [targetMs](float cost) { return cost > targetMs; }));
+    }
+
+    Trace makeSteady(const std::string &name, float costMs, uint32_t frames)
+    {
+        Trace trace;
+        trace.name = name;
+        trace.costMs.assign(frames, costMs);
+        return trace;
+    }
+
+    Trace makeSegments(const std::string &name, const std::vector<std::pair<float, uint32_t>> &segments)
+    {
+        Trace trace;
+        trace.name = name;
+        for (const std::pair<float, uint32_t> &segment : segments)
+        {
+            trace.eventFrame = static_cast<uint32_t>(trace.costMs.size());
+            trace.costMs.insert(trace.costMs.end(), segment.second, segment.first);
+        }
+        return trace;
+    }
+
+    Trace makeNoisy(const std::string &name, float costMs, float noise, uint32_t frames, std::mt19937 &random)
+    {
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        Trace trace;
+        trace.name = name;
+        for (uint32_t frame = 0u; frame < frames; ++frame)
+        {
+            trace.costMs.push_back(costMs * (1.0f + noise * unit(random)));
+        }
+        return trace;
+    }
+
+    Trace makeRamp(const std::string &name, float lowMs, float highMs, uint32_t frames)
+    {
+        Trace trace;
+        trace.name = name;
+        for (uint32_t frame = 0u; frame < frames; ++frame)
+        {
+            const float t = 1.0f - std::fabs(2.0f * frame / frames - 1.0f);
+            trace.costMs.push_back(lowMs + (highMs - lowMs) * t);
+        }
+        return trace;
+    }
+
+    // Reads every "drs <GPU ms> <scale>" line, anything before "drs" on a line is ignored
+    bool readTrace(const std::string &path, Trace &trace)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            std::cerr << "Unable to open trace " << path << std::endl;
+            return false;
+        }
+
+        trace.name = path.substr(path.find_last_of("/\\") + 1u);
+        std::string line;
+        while (std::getline(file, line))
+        {
+            const size_t start = line.find("drs ");
+            if (start == std::string::npos)
+            {
+                continue;
+            }
+            std::istringstream fields(line.substr(start + 4u));
+            float frameMs = 0.0f;
+            float scale = 0.0f;
+            if (fields >> frameMs >> scale && frameMs > 0.0f && scale > 0.0f)
+            {
+                trace.costMs.push_back(frameMs / (scale * scale));
+            }
+        }
+        if (trace.costMs.empty())
+        {
+            std::cerr << "No drs lines in " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    void printReplay(const Trace &trace, const Replay &result, const ResolutionScaleController::Settings &settings)
+    {
+        const double frames = static_cast<double>(trace.costMs.size());
+        std::cout << std::left << std::setw(24) << trace.name << std::right << std::setw(8) << trace.costMs.size()
+                  << std::fixed << std::setprecision(1) << std::setw(10) << 100.0 * result.missed / frames << "%"
+                  << std::setw(11) << 100.0 * countFullResolutionMisses(trace, settings.targetFrameTimeMs) / frames << "%"
+                  << std::setw(10) << result.changes << std::setprecision(2) << std::setw(14) << 60.0 * result.reversals / frames
+                  << std::setprecision(3) << std::setw(12) << result.meanScale << "\n";
+    }
+
+    bool check(const Options &options)
+    {
+        bool passed = true;
+        auto report = [&passed](bool condition, const std::string &what)
+        {
+            std::cout << std::left << std::setw(64) << what << (condition ? "ok" : "FAILED") << "\n";
+            passed = passed && condition;
+        };
+
+        const ResolutionScaleController::Settings settings;
+        const float goalMs = settings.targetFrameTimeMs * settings.headroom;
+        std::mt19937 random(options.seed);
+
+        // Steady loads
+        {
+            const Trace light = makeSteady("light", goalMs * 0.6f, 600u);
+            const Replay lightResult = replay(light, settings);
+            report(lightResult.changes == 0u && lightResult.missed == 0u, "light load stays at full resolution");
+
+            const Trace heavy = makeSteady("heavy", goalMs * 1.6f, 1200u);
+            const Replay heavyResult = replay(heavy, settings);
+            const float settledMs = heavyResult.frameMs.back();
+            report(countChanges(heavyResult, 300u, 1200u) == 0u, "heavy load settles without a limit cycle");
+            report(std::fabs(settledMs - goalMs) <= goalMs * settings.deadBand * 1.01f && heavyResult.missed <= FrameLatency + 1u,
+                "heavy load settles inside the dead band around the goal");
+        }
+
+        // Dead band, drifts sized from where the heavy load settled
+        {
+            const float costMs = goalMs * 1.6f;
+            const Trace heavy = makeSteady("heavy", costMs, 300u);
+            const Replay settled = replay(heavy, settings);
+            const float settledMs = settled.frameMs.back();
+            const float roomMs = (std::min)(goalMs * (1.0f + settings.deadBand) - settledMs, settledMs - goalMs * (1.0f - settings.deadBand));
+
+            Trace inside = heavy;
+            Trace outside = heavy;
+            for (uint32_t frame = 0u; frame < 600u; ++frame)
+            {
+                const float wave = std::sin(frame * 0.05f);
+                inside.costMs.push_back(costMs * (1.0f + 0.9f * roomMs / settledMs * wave));
+                outside.costMs.push_back(costMs * (1.0f + 1.5f * settings.deadBand * (wave < 0.0f ? -1.0f : 1.0f)));
+            }
+            report(roomMs > 0.0f && countChanges(replay(inside, settings), 300u, 900u) == 0u, "load drifts inside the dead band change nothing");
+            report(countChanges(replay(outside, settings), 300u, 900u) > 0u, "load changes outside the dead band are followed");
+        }
+
+        // Noise, small noise is ignored and large noise only moves the scale a little
+        {
+            const Trace quiet = makeNoisy("noisy", goalMs * 1.4f, 0.05f, 3600u, random);
+            const Replay quietResult = replay(quiet, settings);
+            report(countChanges(quietResult, 300u, quiet.costMs.size()) == 0u, "5% frame noise leaves the settled scale alone");
+
+            const Trace noisy = makeNoisy("noisy", goalMs * 1.4f, 0.15f, 3600u, random);
+            const Replay result = replay(noisy, settings);
+            const auto range = std::minmax_element(result.scales.begin() + 300, result.scales.end());
+            report(*range.second - *range.first < 0.1f, "15% frame noise keeps the scale within a 0.1 range");
+            report(result.missed * 20u < noisy.costMs.size(), "15% frame noise misses under 5% of the frames");
+        }
+
+        // Anti windup, pinned at the minimum scale and then released
+        {
+            const Trace pinned = makeSegments("pinned", { { goalMs * 0.6f, 300u }, { goalMs * 8.0f, 900u }, { goalMs * 0.6f, 600u } });
+            ResolutionScaleController::Settings noIntegral = settings;
+            noIntegral.integralGain = 0.0f;
+            const Replay result = replay(pinned, settings);
+            const uint32_t recovery = recoveryFrames(result, pinned, settings.maxScale);
+            const uint32_t reference = recoveryFrames(replay(pinned, noIntegral), pinned, settings.maxScale);
+            report(result.scales[1199] == settings.minScale, "a load too heavy for any scale pins the minimum");
+            report(recovery <= reference + 2u, "recovers in " + std::to_string(recovery) + " frames, " + std::to_string(reference) + " with no integral term");
+
+            const Trace spike = makeSegments("spike", { { goalMs * 0.6f, 300u }, { goalMs * 2.5f, 30u }, { goalMs * 0.6f, 600u } });
+            const Replay spikeResult = replay(spike, settings);
+            const uint32_t spikeRecovery = recoveryFrames(spikeResult, spike, settings.maxScale);
+            report(spikeRecovery < 60u, "recovers from a 30 frame spike in " + std::to_string(spikeRecovery) + " frames");
+            report(countChanges(spikeResult, spike.eventFrame + spikeRecovery + 1u, spike.costMs.size()) == 0u && spikeResult.scales.back() == settings.maxScale,
+                "no overshoot once recovered");
+        }
+
+        std::cout << "\n";
+        return passed;
+    }
+
+    void benchmark(const Options &options, const std::vector<Trace> &recorded)
+    {
+        const ResolutionScaleController::Settings settings;
+        const float goalMs = settings.targetFrameTimeMs * settings.headroom;
+        std::mt19937 random(options.seed);
+
+        std::vector<Trace> traces =
+        {
+            makeSteady("steady light", goalMs * 0.6f, 1800u),
+            makeSteady("steady heavy", goalMs * 1.6f, 1800u),
+            makeNoisy("noisy 5%", goalMs * 1.4f, 0.05f, 3600u, random),
+            makeNoisy("noisy 15%", goalMs * 1.4f, 0.15f, 3600u, random),
+            makeNoisy("noisy 30%", goalMs * 1.4f, 0.30f, 3600u, random),
+            makeRamp("ramp", goalMs * 0.6f, goalMs * 2.5f, 3600u),
+            makeSegments("scene cuts", { { goalMs * 0.6f, 300u }, { goalMs * 1.8f, 300u }, { goalMs * 0.9f, 300u }, { goalMs * 2.4f, 300u }, { goalMs * 0.6f, 300u } }),
+            makeSegments("spike", { { goalMs * 0.6f, 300u }, { goalMs * 2.5f, 30u }, { goalMs * 0.6f, 600u } }),
+            makeSegments("pinned", { { goalMs * 0.6f, 300u }, { goalMs * 8.0f, 900u }, { goalMs * 0.6f, 600u } }),
+        };
+        traces.insert(traces.end(), recorded.begin(), recorded.end());
+
+        std::cout << std::left << std::setw(24) << "Trace" << std::right << std::setw(8) << "Frames" << std::setw(11) << "Missed"
+                  << std::setw(12) << "Full res" << std::setw(10) << "Changes" << std::setw(14) << "Reversals/s" << std::setw(12) << "Mean scale" << "\n";
+        for (const Trace &trace : traces)
+        {
+            printReplay(trace, replay(trace, settings), settings);
+        }
+        std::cout << std::flush;
+    }
+
+    bool parseArguments(int argc, char **argv, Options &options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string argument = argv[i];
+            const bool hasValue = i + 1 < argc;
+
+            if (argument == "--trace" && hasValue)
+            {
+                while (i + 1 < argc && std::string(argv[i + 1]).compare(0u, 2u, "--") != 0)
+                {
+                    options.tracePaths.push_back(argv[++i]);
+                }
+            }
+            else if (argument == "--seed" && hasValue)
+            {
+                options.seed = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseArguments(argc, argv, options))
+    {
+        std::cerr << "Usage: ResolutionScaleBench [--trace <file>...] [--seed <n>]" << std::endl;
+        return 1;
+    }
+
+    std::vector<Trace> recorded(options.tracePaths.size());
+    for (size_t i = 0u; i < options.tracePaths.size(); ++i)
+    {
+        if (!readTrace(options.tracePaths[i], recorded[i]))
+        {
+            return 1;
+        }
+    }
+
+    const ResolutionScaleController::Settings settings;
+    std::cout << "Budget: " << settings.targetFrameTimeMs << " ms, goal: " << settings.targetFrameTimeMs * settings.headroom
+              << " ms, frame latency: " << FrameLatency << "\n\n";
+
+    const bool passed = check(options);
+    benchmark(options, recorded);
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,225 @@
+#include "GltfScene.h"
+
+namespace
+{
+    const std::vector<JsonValue> &getArray(const JsonValue &object, const char *key)
+    {
+        static const std::vector<JsonValue> Empty;
+        const JsonValue *value = object.find(key);
+        return value != nullptr && value->isArray() ? value->getArray() : Empty;
+    }
+
+    std::string getString(const JsonValue &object, const char *key)
+    {
+        const JsonValue *value = object.find(key);
+        return value != nullptr && value->isString() ? value->getString() : std::string();
+    }
+
+    // An optional index into an array of count elements, false when present but not a valid index
+    bool getIndex(const JsonValue &object, const char *key, size_t count, uint32_t &index)
+    {
+        const JsonValue *value = object.find(key);
+        if (value == nullptr)
+        {
+            index = CookedSceneNone;
+            return true;
+        }
+        if (!value->isNumber() || value->getNumber() < 0.0 || value->getNumber() >= static_cast<double>(count) ||
+            value->getNumber() != static_cast<double>(static_cast<uint32_t>(value->getNumber())))
+        {
+            return false;
+        }
+        index = static_cast<uint32_t>(value->getNumber());
+        return true;
+    }
+
+    // An optional array of exactly count numbers, left alone when missing
+    bool getFloats(const JsonValue &object, const char *key, uint32_t count, float *out)
+    {
+        const JsonValue *value = object.find(key);
+        if (value == nullptr)
+        {
+            return true;
+        }
+        if (!value->isArray() || value->getArray().size() != count)
+        {
+            return false;
+        }
+        for (uint32_t i = 0u; i < count; ++i)
+        {
+            if (!value->getArray()[i].isNumber())
+            {
+                return false;
+            }
+            out[i] = static_cast<float>(value->getArray()[i].getNumber());
+        }
+        return true;
+    }
+
+    // An optional number, left alone when missing
+    bool getFloat(const JsonValue &object, const char *key, float &out)
+    {
+        const JsonValue *value = object.find(key);
+        if (value == nullptr)
+        {
+            return true;
+        }
+        if (!value->isNumber())
+        {
+            return false;
+        }
+        out = static_cast<float>(value->getNumber());
+        return true;
+    }
+
+    bool fail(std::string &error, const std::string &what, size_t index, const char *problem)
+    {
+        error = what + " " + std::to_string(index) + ": " + problem;
+        return false;
+    }
+
+    // External files keep their uri, data uris are embedded and have none
+    std::string getExternalUri(const JsonValue &object)
+    {
+        const std::string uri = getString(object, "uri");
+        return uri.compare(0u, 5u, "data:") == 0 ? std::string() : uri;
+    }
+}
+
+bool readGltfScene(const JsonValue &document, SceneDescription &scene, std::string &error)
+{
+    scene = SceneDescription();
+
+    const JsonValue *asset = document.find("asset");
+    if (asset == nullptr || getString(*asset, "version").compare(0u, 1u, "2") != 0)
+    {
+        error = "not a glTF 2.0 file";
+        return false;
+    }
+
+    const std::vector<JsonValue> &accessors = getArray(document, "accessors");
+    const std::vector<JsonValue> &bufferViews = getArray(document, "bufferViews");
+    const std::vector<JsonValue> &buffers = getArray(document, "buffers");
+    const std::vector<JsonValue> &textures = getArray(document, "textures");
+    const std::vector<JsonValue> &images = getArray(document, "images");
+
+    const std::vector<JsonValue> &materials = getArray(document, "materials");
+    scene.materials.resize(materials.size());
+    for (size_t i = 0u; i < materials.size(); ++i)
+    {
+        SceneMaterial &material = scene.materials[i];
+        material.name = getString(materials[i], "name");
+
+        const JsonValue *pbr = materials[i].find("pbrMetallicRoughness");
+        if (pbr == nullptr)
+        {
+            continue;
+        }
+        if (!getFloats(*pbr, "baseColorFactor", 4u, &material.baseColor.x) ||
+            !getFloat(*pbr, "metallicFactor", material.metallic) ||
+            !getFloat(*pbr, "roughnessFactor", material.roughness))
+        {
+            return fail(error, "material", i, "bad pbrMetallicRoughness factors");
+        }
+
+        const JsonValue *baseColorTexture = pbr->find("baseColorTexture");
+        if (baseColorTexture != nullptr)
+        {
+            uint32_t texture;
+            uint32_t image;
+            if (!getIndex(*baseColorTexture, "index", textures.size(), texture) || texture == CookedSceneNone ||
+                !getIndex(textures[texture], "source", images.size(), image))
+            {
+                return fail(error, "material", i, "bad baseColorTexture");
+            }
+            if (image != CookedSceneNone)
+            {
+                material.baseColorTexture = getExternalUri(images[image]);
+            }
+        }
+    }
+
+    const std::vector<JsonValue> &meshes = getArray(document, "meshes");
+    scene.meshes.resize(meshes.size());
+    for (size_t i = 0u; i < meshes.size(); ++i)
+    {
+        SceneMesh &mesh = scene.meshes[i];
+        mesh.name = getString(meshes[i], "name");
+
+        const std::vector<JsonValue> &primitives = getArray(meshes[i], "primitives");
+        if (primitives.empty())
+        {
+            return fail(error, "mesh", i, "no primitives");
+        }
+        if (!getIndex(primitives[0], "material", materials.size(), mesh.material))
+        {
+            return fail(error, "mesh", i, "bad material");
+        }
+
+        // glTF requires min and max on every POSITION accessor
+        for (size_t p = 0u; p < primitives.size(); ++p)
+        {
+            const JsonValue *attributes = primitives[p].find("attributes");
+            uint32_t position = CookedSceneNone;
+            if (attributes == nullptr || !getIndex(*attributes, "POSITION", accessors.size(), position) || position == CookedSceneNone)
+            {
+                return fail(error, "mesh", i, "a primitive has no POSITION");
+            }
+
+            const JsonValue &accessor = accessors[position];
+            Aabb bounds;
+            if (accessor.find("min") == nullptr || accessor.find("max") == nullptr ||
+                !getFloats(accessor, "min", 3u, &bounds.min.x) || !getFloats(accessor, "max", 3u, &bounds.max.x))
+            {
+                return fail(error, "mesh", i, "a POSITION accessor has no min and max");
+            }
+            mesh.bounds = p == 0u ? bounds : mergeAabb(mesh.bounds, bounds);
+
+            uint32_t bufferView;
+            uint32_t buffer = CookedSceneNone;
+            if (!getIndex(accessor, "bufferView", bufferViews.size(), bufferView) ||
+                (bufferView != CookedSceneNone && !getIndex(bufferViews[bufferView], "buffer", buffers.size(), buffer)))
+            {
+                return fail(error, "mesh", i, "bad bufferView");
+            }
+            if (p == 0u && bufferView != CookedSceneNone && buffer != CookedSceneNone)
+            {
+                mesh.file = getExternalUri(buffers[buffer]);
+            }
+        }
+    }
+
+    const std::vector<JsonValue> &nodes = getArray(document, "nodes");
+    scene.nodes.resize(nodes.size());
+    for (size_t i = 0u; i < nodes.size(); ++i)
+    {
+        SceneNode &node = scene.nodes[i];
+        node.name = getString(nodes[i], "name");
+        if (nodes[i].find("matrix") != nullptr)
+        {
+            return fail(error, "node", i, "matrix transforms are not supported, export translation, rotation and scale");
+        }
+        if (!getFloats(nodes[i], "translation", 3u, &node.translation.x) ||
+            !getFloats(nodes[i], "rotation", 4u, &node.rotation.x) ||
+            !getFloats(nodes[i], "scale", 3u, &node.scale.x))
+        {
+            return fail(error, "node", i, "bad transform");
+        }
+        if (!getIndex(nodes[i], "mesh", meshes.size(), node.mesh))
+        {
+            return fail(error, "node", i, "bad mesh");
+        }
+
+        const std::vector<JsonValue> &children = getArray(nodes[i], "children");
+        node.children.reserve(children.size());
+        for (const JsonValue &child : children)
+        {
+            if (!child.isNumber() || child.getNumber() < 0.0 || child.getNumber() >= static_cast<double>(nodes.size()))
+            {
+                return fail(error, "node", i, "bad child");
+            }
+            node.children.push_back(static_cast<uint32_t>(child.getNumber()));
+        }
+    }
+    return true;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+// Reads the scene graph of a glTF 2.0 (.gltf) file into a SceneDescription.
+// Only what the cooked scene keeps is read: the node hierarchy with its translation, rotation
+// and scale, every mesh with the bounds of its POSITION accessors, the buffer its vertex data is
+// in and the material of its first primitive, and the metallic roughness factors and base color
+// image of every material. Vertex data is not touched. Nodes with a matrix instead of a
+// translation, rotation and scale are rejected, re-export them with TRS.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "CookedScene.h"
+#include "JsonDocument.h"
+
+struct SceneNode
+{
+    std::string name;
+    std::vector<uint32_t> children;
+    Vec3 translation = { 0.0f, 0.0f, 0.0f };
+    Quat rotation = { 0.0f, 0.0f, 0.0f, 1.0f };
+    Vec3 scale = { 1.0f, 1.0f, 1.0f };
+    uint32_t mesh = CookedSceneNone;
+};
+
+struct SceneMesh
+{
+    std::string name;
+    std::string file; // Empty for data embedded in the glTF file
+    Aabb bounds = { { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f } };
+    uint32_t material = CookedSceneNone;
+};
+
+struct SceneMaterial
+{
+    std::string name;
+    Vec4 baseColor = { 1.0f, 1.0f, 1.0f, 1.0f };
+    float metallic = 1.0f;
+    float roughness = 1.0f;
+    std::string baseColorTexture; // Image file, empty without one
+};
+
+struct SceneDescription
+{
+    std::vector<SceneNode> nodes;
+    std::vector<SceneMesh> meshes;
+    std::vector<SceneMaterial> materials;
+};
+
+// Returns false and describes the first problem when the document is not a glTF scene we can read
+bool readGltfScene(const JsonValue &document, SceneDescription &scene, std::string &error);
@@ -0,0 +1,387 @@
+#include "JsonDocument.h"
+
+#include <cstdlib>
+#include <cstring>
+
+const JsonValue *JsonValue::find(const char *key) const
+{
+    for (const std::pair<std::string, JsonValue> &member : m_members)
+    {
+        if (member.first == key)
+        {
+            return &member.second;
+        }
+    }
+    return nullptr;
+}
+
+class JsonParser
+{
+public:
+    JsonParser(const std::string &text, std::string &error)
+        : m_text(text.c_str())
+        , m_end(text.c_str() + text.size())
+        , m_position(text.c_str())
+        , m_error(error)
+    {
+    }
+
+    bool parseDocument(JsonValue &document)
+    {
+        if (!parseValue(document, 0u))
+        {
+            return false;
+        }
+        skipWhitespace();
+        return m_position == m_end || fail("text after the document");
+    }
+
+private:
+    // Deeper documents are almost certainly broken, and recursion has to stop somewhere
+    static const uint32_t MaxDepth = 256u;
+
+    bool fail(const char *what)
+    {
+        m_error = std::string(what) + " at byte " + std::to_string(m_position - m_text);
+        return false;
+    }
+
+    void skipWhitespace()
+    {
+        while (m_position < m_end && (*m_position == ' ' || *m_position == '\t' || *m_position == '\n' || *m_position == '\r'))
+        {
+            ++m_position;
+        }
+    }
+
+    bool consume(const char *word)
+    {
+        const size_t length = strlen(word);
+        if (static_cast<size_t>(m_end - m_position) < length || memcmp(m_position, word, length) != 0)
+        {
+            return false;
+        }
+        m_position += length;
+        return true;
+    }
+
+    bool parseValue(JsonValue &value, uint32_t depth)
+    {
+        if (depth > MaxDepth)
+        {
+            return fail("nested too deep");
+        }
+
+        skipWhitespace();
+        if (m_position == m_end)
+        {
+            return fail("unexpected end");
+        }
+
+        switch (*m_position)
+        {
+        case '{':
+            return parseObject(value, depth);
+        case '[':
+            return parseArray(value, depth);
+        case '"':
+            value.m_type = JsonValue::Type::String;
+            return parseString(value.m_string);
+        case 't':
+        case 'f':
+            value.m_type = JsonValue::Type::Bool;
+            value.m_bool = *m_position == 't';
+            return consume(value.m_bool ? "true" : "false") || fail("bad literal");
+        case 'n':
+            value.m_type = JsonValue::Type::Null;
+            return consume("null") || fail("bad literal");
+        default:
+            value.m_type = JsonValue::Type::Number;
+            return parseNumber(value.m_number);
+        }
+    }
+
+    bool parseObject(JsonValue &value, uint32_t depth)
+    {
+        value.m_type = JsonValue::Type::Object;
+        ++m_position;
+        skipWhitespace();
+        if (m_position < m_end && *m_position == '}')
+        {
+            ++m_position;
+            return true;
+        }
+
+        while (true)
+        {
+            skipWhitespace();
+            if (m_position == m_end || *m_position != '"')
+            {
+                return fail("expected a key");
+            }
+            value.m_members.emplace_back();
+            if (!parseString(value.m_members.back().first))
+            {
+                return false;
+            }
+
+            skipWhitespace();
+            if (m_position == m_end || *m_position != ':')
+            {
+                return fail("expected ':'");
+            }
+            ++m_position;
+            if (!parseValue(value.m_members.back().second, depth + 1u))
+            {
+                return false;
+            }
+
+            skipWhitespace();
+            if (m_position < m_end && *m_position == ',')
+            {
+                ++m_position;
+            }
+            else if (m_position < m_end && *m_position == '}')
+            {
+                ++m_position;
+                return true;
+            }
+            else
+            {
+                return fail("expected ',' or '}'");
+            }
+        }
+    }
+
+    bool parseArray(JsonValue &value, uint32_t depth)
+    {
+        value.m_type = JsonValue::Type::Array;
+        ++m_position;
+        skipWhitespace();
+        if (m_position < m_end && *m_position == ']')
+        {
+            ++m_position;
+            return true;
+        }
+
+        while (true)
+        {
+            value.m_array.emplace_back();
+            if (!parseValue(value.m_array.back(), depth + 1u))
+            {
+                return false;
+            }
+
+            skipWhitespace();
+            if (m_position < m_end && *m_position == ',')
+            {
+                ++m_position;
+            }
+            else if (m_position < m_end && *m_position == ']')
+            {
+                ++m_position;
+                return true;
+            }
+            else
+            {
+                return fail("expected ',' or ']'");
+            }
+        }
+    }
+
+    bool parseHex4(uint32_t &codePoint)
+    {
+        if (m_end - m_position < 4)
+        {
+            return fail("bad \\u escape");
+        }
+        codePoint = 0u;
+        for (int i = 0; i < 4; ++i)
+        {
+            const char c = *m_position++;
+            const uint32_t digit = c >= '0' && c <= '9' ? static_cast<uint32_t>(c - '0') :
+                c >= 'a' && c <= 'f' ? static_cast<uint32_t>(c - 'a' + 10) :
+                c >= 'A' && c <= 'F' ? static_cast<uint32_t>(c - 'A' + 10) : 16u;
+            if (digit == 16u)
+            {
+                return fail("bad \\u escape");
+            }
+            codePoint = codePoint * 16u + digit;
+        }
+        return true;
+    }
+
+    static void appendUtf8(std::string &out, uint32_t codePoint)
+    {
+        if (codePoint < 0x80u)
+        {
+            out += static_cast<char>(codePoint);
+        }
+        else if (codePoint < 0x800u)
+        {
+            out += static_cast<char>(0xc0u | (codePoint >> 6));
+            out += static_cast<char>(0x80u | (codePoint & 0x3fu));
+        }
+        else if (codePoint < 0x10000u)
+        {
+            out += static_cast<char>(0xe0u | (codePoint >> 12));
+            out += static_cast<char>(0x80u | ((codePoint >> 6) & 0x3fu));
+            out += static_cast<char>(0x80u | (codePoint & 0x3fu));
+        }
+        else
+        {
+            out += static_cast<char>(0xf0u | (codePoint >> 18));
+            out += static_cast<char>(0x80u | ((codePoint >> 12) & 0x3fu));
+            out += static_cast<char>(0x80u | ((codePoint >> 6) & 0x3fu));
+            out += static_cast<char>(0x80u | (codePoint & 0x3fu));
+        }
+    }
+
+    bool parseString(std::string &out)
+    {
+        ++m_position;
+        while (m_position < m_end && *m_position != '"')
+        {
+            const char c = *m_position++;
+            if (static_cast<unsigned char>(c) < 0x20u)
+            {
+                return fail("control character in string");
+            }
+            if (c != '\\')
+            {
+                out += c;
+                continue;
+            }
+
+            if (m_position == m_end)
+            {
+                break;
+            }
+            const char escape = *m_position++;
+            switch (escape)
+            {
+            case '"': out += '"'; break;
+            case '\\': out += '\\'; break;
+            case '/': out += '/'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u':
+            {
+                uint32_t codePoint = 0u;
+                if (!parseHex4(codePoint))
+                {
+                    return false;
+                }
+
+                // Characters outside the basic plane come as a surrogate pair
+                if (codePoint >= 0xd800u && codePoint < 0xdc00u)
+                {
+                    uint32_t low = 0u;
+                    if (!consume("\\u") || !parseHex4(low) || low < 0xdc00u || low >= 0xe000u)
+                    {
+                        return fail("unpaired surrogate");
+                    }
+                    codePoint = 0x10000u + ((codePoint - 0xd800u) << 10) + (low - 0xdc00u);
+                }
+                else if (codePoint >= 0xdc00u && codePoint < 0xe000u)
+                {
+                    return fail("unpaired surrogate");
+                }
+                appendUtf8(out, codePoint);
+                break;
+            }
+            default:
+                return fail("bad escape");
+            }
+        }
+
+        if (m_position == m_end)
+        {
+            return fail("unterminated string");
+        }
+        ++m_position;
+        return true;
+    }
+
+    bool parseNumber(double &number)
+    {
+        // Check the JSON grammar first, strtod accepts more (hex, inf, leading '+')
+        const char *start = m_position;
+        const char *p = m_position;
+        if (p < m_end && *p == '-')
+        {
+            ++p;
+        }
+        if (p < m_end && *p == '0')
+        {
+            ++p;
+        }
+        else if (p < m_end && *p >= '1' && *p <= '9')
+        {
+            while (p < m_end && *p >= '0' && *p <= '9')
+            {
+                ++p;
+            }
+        }
+        else
+        {
+            return fail("unexpected character");
+        }
+        if (p < m_end && *p == '.')
+        {
+            ++p;
+            if (p == m_end || *p < '0' || *p > '9')
+            {
+                return fail("bad number");
+            }
+            while (p < m_end && *p >= '0' && *p <= '9')
+            {
+                ++p;
+            }
+        }
+        if (p < m_end && (*p == 'e' || *p == 'E'))
+        {
+            ++p;
+            if (p < m_end && (*p == '+' || *p == '-'))
+            {
+                ++p;
+            }
+            if (p == m_end || *p < '0' || *p > '9')
+            {
+                return fail("bad number");
+            }
+            while (p < m_end && *p >= '0' && *p <= '9')
+            {
+                ++p;
+            }
+        }
+
+        // strtod on a copy of just the number, on the text it would read "0x10" as hex
+        char digits[64];
+        const size_t length = static_cast<size_t>(p - start);
+        if (length >= sizeof(digits))
+        {
+            return fail("number too long");
+        }
+        memcpy(digits, start, length);
+        digits[length] = '\0';
+        number = strtod(digits, nullptr);
+        m_position = p;
+        return true;
+    }
+
+    const char *m_text;
+    const char *m_end;
+    const char *m_position;
+    std::string &m_error;
+};
+
+bool parseJson(const std::string &text, JsonValue &document, std::string &error)
+{
+    document = JsonValue();
+    JsonParser parser(text, error);
+    return parser.parseDocument(document);
+}
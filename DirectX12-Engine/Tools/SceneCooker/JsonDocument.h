@@ -0,0 +1,55 @@
+#pragma once
+
+// A small JSON reader for the scene cooker.
+// parseJson() builds the whole document as a tree of JsonValue, one allocation per string, array
+// and object, the way a general purpose JSON library does. That is fine for a tool and is also
+// the load path the cooked scene format is measured against.
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+class JsonValue
+{
+public:
+    enum class Type : uint8_t
+    {
+        Null,
+        Bool,
+        Number,
+        String,
+        Array,
+        Object
+    };
+
+    JsonValue() : m_type(Type::Null), m_bool(false), m_number(0.0) {}
+
+    Type getType() const { return m_type; }
+    bool isNumber() const { return m_type == Type::Number; }
+    bool isString() const { return m_type == Type::String; }
+    bool isArray() const { return m_type == Type::Array; }
+    bool isObject() const { return m_type == Type::Object; }
+
+    bool getBool() const { return m_bool; }
+    double getNumber() const { return m_number; }
+    const std::string &getString() const { return m_string; }
+    const std::vector<JsonValue> &getArray() const { return m_array; }
+    const std::vector<std::pair<std::string, JsonValue>> &getMembers() const { return m_members; }
+
+    // The member with this key, nullptr when there is none or this is not an object
+    const JsonValue *find(const char *key) const;
+
+private:
+    friend class JsonParser;
+
+    Type m_type;
+    bool m_bool;
+    double m_number;
+    std::string m_string;
+    std::vector<JsonValue> m_array;
+    std::vector<std::pair<std::string, JsonValue>> m_members; // In document order
+};
+
+// Returns false and describes the first problem with its byte offset when the text is not valid JSON
+bool parseJson(const std::string &text, JsonValue &document, std::string &error);
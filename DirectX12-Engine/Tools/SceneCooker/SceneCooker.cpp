@@ -0,0 +1,787 @@
+// Offline scene cook tool.
+//
+// Reads the scene graph of a glTF 2.0 file and writes it as a CookedScene: nodes reordered so
+// every parent comes before its children, world space bounds computed from each node's mesh,
+// names and file references gathered into one string table, and every section aligned the way
+// the loader uses it in place.
+//
+// --bench cooks a generated scene and checks that:
+//  - the JSON reader decodes and rejects what it should
+//  - the cooked file holds exactly the nodes, meshes and materials of the glTF it came from,
+//    with parents first and bounds matching the world matrices the loader computes
+//  - the loader turns down truncated, foreign, outdated and damaged files, and validate()
+//    catches bad indices the header checks cannot see
+// Then compares loading the glTF (reading it, parsing the JSON and building the scene
+// description) against loading the cooked file, in time and in peak memory.
+//
+// Usage:
+//   SceneCooker --in <scene.gltf> --out <scene.cscene>
+//   SceneCooker --bench [--nodes <n>] [--iterations <n>] [--dir <path>]
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "CookedScene.h"
+#include "GltfScene.h"
+#include "JsonDocument.h"
+#include "MemoryTracker.h"
+
+namespace fs = std::filesystem;
+
+// Every heap allocation is counted so the benchmark can report the peak memory of each load path
+namespace
+{
+    const size_t AllocationHeaderSize = 16u; // Keeps the default new alignment
+
+    std::atomic<uint64_t> g_heapBytes(0u);
+    std::atomic<uint64_t> g_heapPeakBytes(0u);
+
+    void *countedAllocate(size_t size)
+    {
+        uint8_t *block = static_cast<uint8_t *>(malloc(size + AllocationHeaderSize));
+        if (block == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+        memcpy(block, &size, sizeof(size));
+
+        const uint64_t current = g_heapBytes.fetch_add(size, std::memory_order_relaxed) + size;
+        uint64_t peak = g_heapPeakBytes.load(std::memory_order_relaxed);
+        while (current > peak && !g_heapPeakBytes.compare_exchange_weak(peak, current, std::memory_order_relaxed))
+        {
+        }
+        return block + AllocationHeaderSize;
+    }
+
+    void countedFree(void *pointer)
+    {
+        if (pointer == nullptr)
+        {
+            return;
+        }
+        uint8_t *block = static_cast<uint8_t *>(pointer) - AllocationHeaderSize;
+        size_t size;
+        memcpy(&size, block, sizeof(size));
+        g_heapBytes.fetch_sub(size, std::memory_order_relaxed);
+        free(block);
+    }
+}
+
+void *operator new(size_t size) { return countedAllocate(size); }
+void *operator new[](size_t size) { return countedAllocate(size); }
+void operator delete(void *pointer) noexcept { countedFree(pointer); }
+void operator delete[](void *pointer) noexcept { countedFree(pointer); }
+void operator delete(void *pointer, size_t) noexcept { countedFree(pointer); }
+void operator delete[](void *pointer, size_t) noexcept { countedFree(pointer); }
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    double millisecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    struct Options
+    {
+        fs::path inputPath;
+        fs::path outputPath;
+        bool bench = false;
+        uint32_t nodes = 50000u;
+        uint32_t iterations = 5u;
+        fs::path benchDirectory;
+    };
+
+    // Strings are stored once however many records use them
+    class StringTable
+    {
+    public:
+        uint32_t add(const std::string &text)
+        {
+            const auto found = m_offsets.find(text);
+            if (found != m_offsets.end())
+            {
+                return found->second;
+            }
+            const uint32_t offset = static_cast<uint32_t>(m_data.size());
+            m_data.insert(m_data.end(), text.begin(), text.end());
+            m_data.push_back('\0');
+            m_offsets.emplace(text, offset);
+            return offset;
+        }
+
+        uint32_t addOptional(const std::string &text)
+        {
+            return text.empty() ? CookedSceneNone : add(text);
+        }
+
+        // Never empty, so the section always ends with a zero
+        const std::vector<char> &getData()
+        {
+            if (m_data.empty())
+            {
+                m_data.push_back('\0');
+            }
+            return m_data;
+        }
+
+    private:
+        std::unordered_map<std::string, uint32_t> m_offsets;
+        std::vector<char> m_data;
+    };
+
+    // order receives the source index of every cooked node
+    bool cookScene(const SceneDescription &scene, std::vector<uint8_t> &file, std::vector<uint32_t> &order, std::string &error)
+    {
+        const uint32_t nodeCount = static_cast<uint32_t>(scene.nodes.size());
+
+        std::vector<uint32_t> sourceParents(nodeCount, CookedSceneNone);
+        for (uint32_t node = 0u; node < nodeCount; ++node)
+        {
+            for (uint32_t child : scene.nodes[node].children)
+            {
+                if (sourceParents[child] != CookedSceneNone || child == node)
+                {
+                    error = "node " + std::to_string(child) + " has more than one parent";
+                    return false;
+                }
+                sourceParents[child] = node;
+            }
+        }
+
+        // Depth first from every root keeps each subtree together and puts parents first
+        order.clear();
+        order.reserve(nodeCount);
+        std::vector<uint32_t> stack;
+        for (uint32_t root = 0u; root < nodeCount; ++root)
+        {
+            if (sourceParents[root] != CookedSceneNone)
+            {
+                continue;
+            }
+            stack.push_back(root);
+            while (!stack.empty())
+            {
+                const uint32_t node = stack.back();
+                stack.pop_back();
+                order.push_back(node);
+                const std::vector<uint32_t> &children = scene.nodes[node].children;
+                stack.insert(stack.end(), children.rbegin(), children.rend());
+            }
+        }
+        if (order.size() != nodeCount)
+        {
+            error = "the node hierarchy has a cycle";
+            return false;
+        }
+
+        std::vector<uint32_t> cookedIndex(nodeCount);
+        for (uint32_t node = 0u; node < nodeCount; ++node)
+        {
+            cookedIndex[order[node]] = node;
+        }
+
+        StringTable strings;
+        std::vector<Vec3> translations(nodeCount);
+        std::vector<Quat> rotations(nodeCount);
+        std::vector<Vec3> scales(nodeCount);
+        std::vector<uint32_t> parents(nodeCount);
+        std::vector<Aabb> bounds(nodeCount);
+        std::vector<uint32_t> nodeMeshes(nodeCount);
+        std::vector<uint32_t> nodeMaterials(nodeCount);
+        std::vector<uint32_t> nodeNames(nodeCount);
+        std::vector<Mat4> worldMatrices(nodeCount);
+        for (uint32_t node = 0u; node < nodeCount; ++node)
+        {
+            const SceneNode &source = scene.nodes[order[node]];
+            translations[node] = source.translation;
+            rotations[node] = source.rotation;
+            scales[node] = source.scale;
+            parents[node] = sourceParents[order[node]] == CookedSceneNone ? CookedSceneNone : cookedIndex[sourceParents[order[node]]];
+            nodeMeshes[node] = source.mesh;
+            nodeMaterials[node] = source.mesh == CookedSceneNone ? CookedSceneNone : scene.meshes[source.mesh].material;
+            nodeNames[node] = strings.add(source.name);
+
+            // The same math as CookedScene::computeWorldMatrices so the bounds match what the loader sees
+            const Mat4 local = affineMatrix(source.scale, source.rotation, source.translation);
+            worldMatrices[node] = parents[node] == CookedSceneNone ? local : multiply(local, worldMatrices[parents[node]]);
+            bounds[node] = source.mesh == CookedSceneNone ?
+                Aabb{ { FLT_MAX, FLT_MAX, FLT_MAX }, { -FLT_MAX, -FLT_MAX, -FLT_MAX } } :
+                transformAabb(scene.meshes[source.mesh].bounds, worldMatrices[node]);
+        }
+
+        std::vector<CookedSceneMesh> meshes(scene.meshes.size());
+        for (size_t mesh = 0u; mesh < meshes.size(); ++mesh)
+        {
+            meshes[mesh].bounds = scene.meshes[mesh].bounds;
+            meshes[mesh].name = strings.add(scene.meshes[mesh].name);
+            meshes[mesh].file = strings.addOptional(scene.meshes[mesh].file);
+        }
+
+        std::vector<CookedSceneMaterial> materials(scene.materials.size());
+        for (size_t material = 0u; material < materials.size(); ++material)
+        {
+            const SceneMaterial &source = scene.materials[material];
+            materials[material].baseColor = source.baseColor;
+            materials[material].metallic = source.metallic;
+            materials[material].roughness = source.roughness;
+            materials[material].name = strings.add(source.name);
+            materials[material].baseColorTexture = strings.addOptional(source.baseColorTexture);
+        }
+
+        const std::vector<char> &stringData = strings.getData();
+        const void *sectionData[static_cast<size_t>(CookedSceneSection::Count)] = {
+            translations.data(), rotations.data(), scales.data(), parents.data(), bounds.data(),
+            nodeMeshes.data(), nodeMaterials.data(), nodeNames.data(), meshes.data(), materials.data(), stringData.data()
+        };
+
+        CookedSceneHeader header = {};
+        header.magic = CookedSceneMagic;
+        header.version = CookedSceneVersion;
+        header.headerSize = sizeof(CookedSceneHeader);
+        header.sectionCount = static_cast<uint32_t>(CookedSceneSection::Count);
+        header.nodeCount = nodeCount;
+        header.meshCount = static_cast<uint32_t>(meshes.size());
+        header.materialCount = static_cast<uint32_t>(materials.size());
+
+        uint64_t offset = alignCookedScene(sizeof(CookedSceneHeader));
+        for (uint32_t i = 0u; i < static_cast<uint32_t>(CookedSceneSection::Count); ++i)
+        {
+            const CookedSceneSection section = static_cast<CookedSceneSection>(i);
+            header.sections[i].offset = offset;
+            header.sections[i].size = section == CookedSceneSection::Strings ? stringData.size() : getCookedSceneSectionSize(header, section);
+            header.fileSize = offset + header.sections[i].size;
+            offset = alignCookedScene(header.fileSize);
+        }
+
+        // Padding between sections stays zero so cooking the same scene twice gives the same bytes
+        file.assign(static_cast<size_t>(header.fileSize), 0u);
+        memcpy(file.data(), &header, sizeof(header));
+        for (uint32_t i = 0u; i < static_cast<uint32_t>(CookedSceneSection::Count); ++i)
+        {
+            if (header.sections[i].size > 0u)
+            {
+                memcpy(file.data() + header.sections[i].offset, sectionData[i], static_cast<size_t>(header.sections[i].size));
+            }
+        }
+        return true;
+    }
+
+    bool readTextFile(const fs::path &path, std::string &text)
+    {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file)
+        {
+            return false;
+        }
+        text.resize(static_cast<size_t>(file.tellg()));
+        file.seekg(0);
+        return static_cast<bool>(file.read(&text[0], static_cast<std::streamsize>(text.size())));
+    }
+
+    bool writeFile(const fs::path &path, const void *data, size_t size)
+    {
+        std::ofstream file(path, std::ios::binary);
+        return file && file.write(static_cast<const char *>(data), static_cast<std::streamsize>(size));
+    }
+
+    // The JSON load path: everything a loader without a cooked format has to do
+    bool loadGltfScene(const fs::path &path, SceneDescription &scene, std::string &error)
+    {
+        std::string text;
+        if (!readTextFile(path, text))
+        {
+            error = "could not read " + path.string();
+            return false;
+        }
+        JsonValue document;
+        return parseJson(text, document, error) && readGltfScene(document, scene, error);
+    }
+
+    int cookFile(const Options &options)
+    {
+        const Clock::time_point start = Clock::now();
+
+        SceneDescription scene;
+        std::string error;
+        std::vector<uint8_t> file;
+        std::vector<uint32_t> order;
+        if (!loadGltfScene(options.inputPath, scene, error) || !cookScene(scene, file, order, error))
+        {
+            std::cerr << options.inputPath.string() << ": " << error << std::endl;
+            return 1;
+        }
+        if (!writeFile(options.outputPath, file.data(), file.size()))
+        {
+            std::cerr << "Could not write " << options.outputPath.string() << std::endl;
+            return 1;
+        }
+
+        std::cout << options.outputPath.string() << ": " << scene.nodes.size() << " nodes, " << scene.meshes.size() << " meshes, "
+                  << scene.materials.size() << " materials, " << file.size() << " bytes in "
+                  << std::fixed << std::setprecision(1) << millisecondsSince(start) << " ms" << std::endl;
+        return 0;
+    }
+
+    // A glTF scene of nodeCount nodes in random hierarchies, every accessor, image and buffer it names included
+    std::string generateGltf(uint32_t nodeCount, uint32_t seed)
+    {
+        std::mt19937 random(seed);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        const uint32_t meshCount = (std::max)(nodeCount / 64u, 1u);
+        const uint32_t materialCount = (std::max)(meshCount / 4u, 1u);
+        const uint32_t imageCount = 8u;
+
+        std::ostringstream text;
+        text << std::setprecision(9);
+        text << "{\n\"asset\": { \"version\": \"2.0\", \"generator\": \"SceneCooker \\\"bench\\\"\" },\n";
+        text << "\"buffers\": [ { \"uri\": \"scene.bin\", \"byteLength\": " << meshCount * 36u << " } ],\n";
+
+        text << "\"images\": [";
+        for (uint32_t i = 0u; i < imageCount; ++i)
+        {
+            text << (i == 0u ? " " : ", ") << "{ \"uri\": \"textures/albedo_" << i << ".ctex\" }";
+        }
+        text << " ],\n\"textures\": [";
+        for (uint32_t i = 0u; i < imageCount; ++i)
+        {
+            text << (i == 0u ? " " : ", ") << "{ \"source\": " << i << " }";
+        }
+        text << " ],\n";
+
+        text << "\"materials\": [\n";
+        for (uint32_t i = 0u; i < materialCount; ++i)
+        {
+            text << "  { \"name\": \"material_" << i << "\", \"pbrMetallicRoughness\": { \"baseColorFactor\": [ "
+                 << unit(random) << ", " << unit(random) << ", " << unit(random) << ", 1.0 ], \"metallicFactor\": " << unit(random)
+                 << ", \"roughnessFactor\": " << unit(random);
+            if (i % 3u != 0u)
+            {
+                text << ", \"baseColorTexture\": { \"index\": " << i % imageCount << " }";
+            }
+            text << " } }" << (i + 1u < materialCount ? ",\n" : "\n");
+        }
+        text << "],\n";
+
+        text << "\"bufferViews\": [\n";
+        for (uint32_t i = 0u; i < meshCount; ++i)
+        {
+            text << "  { \"buffer\": 0, \"byteOffset\": " << i * 36u << ", \"byteLength\": 36 }" << (i + 1u < meshCount ? ",\n" : "\n");
+        }
+        text << "],\n\"accessors\": [\n";
+        for (uint32_t i = 0u; i < meshCount; ++i)
+        {
+            const float size = 0.5f + 4.0f * unit(random);
+            text << "  { \"bufferView\": " << i << ", \"componentType\": 5126, \"count\": 3, \"type\": \"VEC3\", \"min\": [ "
+                 << -size << ", " << -size * unit(random) << ", " << -size << " ], \"max\": [ " << size << ", " << size << ", " << size * unit(random) << " ] }"
+                 << (i + 1u < meshCount ? ",\n" : "\n");
+        }
+        text << "],\n\"meshes\": [\n";
+        for (uint32_t i = 0u; i < meshCount; ++i)
+        {
+            text << "  { \"name\": \"mesh_" << i << "\", \"primitives\": [ { \"attributes\": { \"POSITION\": " << i << " }, \"material\": " << i % materialCount << " } ] }"
+                 << (i + 1u < meshCount ? ",\n" : "\n");
+        }
+        text << "],\n";
+
+        // Nodes pick a random earlier node as parent, a few are roots
+        std::vector<std::vector<uint32_t>> children(nodeCount);
+        for (uint32_t node = 1u; node < nodeCount; ++node)
+        {
+            if (random() % 32u != 0u)
+            {
+                children[random() % node].push_back(node);
+            }
+        }
+
+        text << "\"nodes\": [\n";
+        for (uint32_t node = 0u; node < nodeCount; ++node)
+        {
+            const Quat rotation = normalize(Quat{ unit(random) - 0.5f, unit(random) - 0.5f, unit(random) - 0.5f, unit(random) + 0.1f });
+            text << "  { \"name\": \"node_" << node << (node % 97u == 0u ? "_\\u00e9t\\u00e9" : "") << "\", \"translation\": [ "
+                 << unit(random) * 20.0f - 10.0f << ", " << unit(random) * 4.0f << ", " << unit(random) * 20.0f - 10.0f << " ], \"rotation\": [ "
+                 << rotation.x << ", " << rotation.y << ", " << rotation.z << ", " << rotation.w << " ]";
+            if (node % 5u == 0u)
+            {
+                const float scale = 0.5f + unit(random);
+                text << ", \"scale\": [ " << scale << ", " << scale << ", " << scale << " ]";
+            }
+            if (node % 4u != 3u)
+            {
+                text << ", \"mesh\": " << random() % meshCount;
+            }
+            if (!children[node].empty())
+            {
+                text << ", \"children\": [";
+                for (size_t i = 0u; i < children[node].size(); ++i)
+                {
+                    text << (i == 0u ? " " : ", ") << children[node][i];
+                }
+                text << " ]";
+            }
+            text << " }" << (node + 1u < nodeCount ? ",\n" : "\n");
+        }
+        text << "],\n\"scenes\": [ { \"nodes\": [ 0 ] } ],\n\"scene\": 0\n}\n";
+        return text.str();
+    }
+
+    bool sameVec3(const Vec3 &a, const Vec3 &b) { return a.x == b.x && a.y == b.y && a.z == b.z; }
+    bool sameAabb(const Aabb &a, const Aabb &b) { return sameVec3(a.min, b.min) && sameVec3(a.max, b.max); }
+
+    // Cooked data in page aligned memory, as load() would leave it
+    class AlignedCopy
+    {
+    public:
+        explicit AlignedCopy(const std::vector<uint8_t> &data)
+            : m_size(data.size())
+            , m_memory(static_cast<uint8_t *>(allocatePages(data.size() + CookedSceneSectionAlignment, false, MemoryTag::Scene)))
+        {
+            memcpy(m_memory, data.data(), data.size());
+        }
+
+        ~AlignedCopy() { freePages(m_memory, m_size + CookedSceneSectionAlignment, false, MemoryTag::Scene); }
+
+        uint8_t *get() { return m_memory; }
+        CookedSceneHeader &header() { return *reinterpret_cast<CookedSceneHeader *>(m_memory); }
+        size_t size() const { return m_size; }
+
+    private:
+        size_t m_size;
+        uint8_t *m_memory;
+    };
+
+    bool check(const fs::path &directory)
+    {
+        bool passed = true;
+        auto report = [&passed](bool condition, const std::string &what)
+        {
+            std::cout << std::left << std::setw(64) << what << (condition ? "ok" : "FAILED") << "\n";
+            passed = passed && condition;
+        };
+
+        // JSON edge cases
+        {
+            JsonValue document;
+            std::string error;
+            bool ok = parseJson("{ \"a\": [ -0.5e2, 0, true, null, \"x\\u00e9\\ud83d\\ude00\\n\\\"\" ], \"b\": {} }", document, error);
+            const JsonValue *a = document.find("a");
+            ok = ok && a != nullptr && a->isArray() && a->getArray().size() == 5u &&
+                a->getArray()[0].getNumber() == -50.0 && a->getArray()[2].getBool() &&
+                a->getArray()[3].getType() == JsonValue::Type::Null &&
+                a->getArray()[4].getString() == "x\xc3\xa9\xf0\x9f\x98\x80\n\"" &&
+                document.find("b") != nullptr && document.find("b")->isObject();
+
+            const char *invalid[] = { "{ \"a\": }", "[ 1, ]", "0x10", "01", "\"\\ud800\"", "[ 1 ] 2", "{ \"a\" 1 }", "\"abc", "-", "1.", "1e+" };
+            for (const char *text : invalid)
+            {
+                ok = ok && !parseJson(text, document, error);
+            }
+            report(ok, "JSON reader decodes escapes and rejects malformed text");
+        }
+
+        // Cook a generated scene and read it back against its source
+        const fs::path gltfPath = directory / "check.gltf";
+        const fs::path cookedPath = directory / "check.cscene";
+        std::vector<uint8_t> cooked;
+        {
+            SceneDescription scene;
+            std::vector<uint32_t> order;
+            std::string error;
+            const std::string text = generateGltf(3000u, 11u);
+            const bool written = writeFile(gltfPath, text.data(), text.size());
+            const bool cookedOk = written && loadGltfScene(gltfPath, scene, error) && cookScene(scene, cooked, order, error) &&
+                writeFile(cookedPath, cooked.data(), cooked.size());
+            report(cookedOk, "generated glTF scene is read and cooked");
+
+            std::vector<uint8_t> again;
+            std::vector<uint32_t> orderAgain;
+            report(cookedOk && cookScene(scene, again, orderAgain, error) && again == cooked, "cooking is deterministic");
+
+            CookedScene loaded;
+            const CookedSceneStatus status = loaded.load(cookedPath);
+            report(status == CookedSceneStatus::Ok && loaded.validate(), "cooked scene loads and validates");
+
+            bool same = status == CookedSceneStatus::Ok && loaded.getNodeCount() == scene.nodes.size() &&
+                loaded.getMeshCount() == scene.meshes.size() && loaded.getMaterialCount() == scene.materials.size();
+            bool parentsFirst = same;
+            for (uint32_t node = 0u; same && node < loaded.getNodeCount(); ++node)
+            {
+                const SceneNode &source = scene.nodes[order[node]];
+                const Quat &rotation = loaded.getRotations()[node];
+                same = sameVec3(loaded.getTranslations()[node], source.translation) && sameVec3(loaded.getScales()[node], source.scale) &&
+                    rotation.x == source.rotation.x && rotation.y == source.rotation.y && rotation.z == source.rotation.z && rotation.w == source.rotation.w &&
+                    loaded.getNodeMeshes()[node] == source.mesh && source.name == loaded.getString(loaded.getNodeNames()[node]) &&
+                    loaded.getNodeMaterials()[node] == (source.mesh == CookedSceneNone ? CookedSceneNone : scene.meshes[source.mesh].material);
+
+                const uint32_t parent = loaded.getParents()[node];
+                parentsFirst = parentsFirst && (parent == CookedSceneNone || parent < node);
+                if (parent != CookedSceneNone)
+                {
+                    const std::vector<uint32_t> &siblings = scene.nodes[order[parent]].children;
+                    same = same && std::find(siblings.begin(), siblings.end(), order[node]) != siblings.end();
+                }
+            }
+            for (uint32_t mesh = 0u; same && mesh < loaded.getMeshCount(); ++mesh)
+            {
+                const CookedSceneMesh &cookedMesh = loaded.getMeshes()[mesh];
+                same = sameAabb(cookedMesh.bounds, scene.meshes[mesh].bounds) && scene.meshes[mesh].name == loaded.getString(cookedMesh.name) &&
+                    scene.meshes[mesh].file == loaded.getString(cookedMesh.file);
+            }
+            for (uint32_t material = 0u; same && material < loaded.getMaterialCount(); ++material)
+            {
+                const CookedSceneMaterial &cookedMaterial = loaded.getMaterials()[material];
+                const SceneMaterial &source = scene.materials[material];
+                same = cookedMaterial.baseColor.x == source.baseColor.x && cookedMaterial.baseColor.w == source.baseColor.w &&
+                    cookedMaterial.metallic == source.metallic && cookedMaterial.roughness == source.roughness &&
+                    source.name == loaded.getString(cookedMaterial.name) && source.baseColorTexture == loaded.getString(cookedMaterial.baseColorTexture);
+            }
+            report(same, "cooked nodes, meshes and materials match the glTF");
+            report(parentsFirst, "parents come before their children");
+
+            bool boundsMatch = status == CookedSceneStatus::Ok;
+            if (boundsMatch)
+            {
+                std::vector<Mat4> worldMatrices(loaded.getNodeCount());
+                loaded.computeWorldMatrices(worldMatrices.data());
+                for (uint32_t node = 0u; node < loaded.getNodeCount(); ++node)
+                {
+                    const uint32_t mesh = loaded.getNodeMeshes()[node];
+                    const Aabb &stored = loaded.getBounds()[node];
+                    boundsMatch = boundsMatch && (mesh == CookedSceneNone ? stored.min.x > stored.max.x :
+                        sameAabb(stored, transformAabb(loaded.getMeshes()[mesh].bounds, worldMatrices[node])));
+                }
+            }
+            report(boundsMatch, "world bounds match the loader's world matrices");
+        }
+
+        // Damaged files are turned down by attach(), bad indices by validate()
+        {
+            auto attachDamaged = [&cooked](void (*damage)(AlignedCopy &copy, size_t &size), bool &validates)
+            {
+                AlignedCopy copy(cooked);
+                size_t size = copy.size();
+                damage(copy, size);
+                CookedScene scene;
+                const CookedSceneStatus status = scene.attach(copy.get(), size);
+                validates = status == CookedSceneStatus::Ok && scene.validate();
+                return status;
+            };
+            bool validates;
+
+            bool ok = attachDamaged([](AlignedCopy &, size_t &) {}, validates) == CookedSceneStatus::Ok && validates;
+            ok = ok && attachDamaged([](AlignedCopy &copy, size_t &) { copy.header().magic ^= 1u; }, validates) == CookedSceneStatus::BadMagic;
+            ok = ok && attachDamaged([](AlignedCopy &copy, size_t &) { copy.header().version += 1u; }, validates) == CookedSceneStatus::BadVersion;
+            ok = ok && attachDamaged([](AlignedCopy &, size_t &size) { size -= 1u; }, validates) == CookedSceneStatus::TooSmall;
+            ok = ok && attachDamaged([](AlignedCopy &, size_t &size) { size = sizeof(CookedSceneHeader) - 1u; }, validates) == CookedSceneStatus::TooSmall;
+            ok = ok && attachDamaged([](AlignedCopy &copy, size_t &) { copy.header().headerSize += 8u; }, validates) == CookedSceneStatus::BadLayout;
+            ok = ok && attachDamaged([](AlignedCopy &copy, size_t &) { copy.header().sections[2].offset += 4u; }, validates) == CookedSceneStatus::BadLayout;
+            ok = ok && attachDamaged([](AlignedCopy &copy, size_t &) { copy.header().nodeCount += 1u; }, validates) == CookedSceneStatus::BadLayout;
+            ok = ok && attachDamaged([](AlignedCopy &copy, size_t &) { copy.header().sections[0].offset = copy.header().fileSize + 64u; }, validates) == CookedSceneStatus::BadLayout;
+            ok = ok && attachDamaged([](AlignedCopy &copy, size_t &)
+            {
+                const CookedSceneSectionRange &strings = copy.header().sections[static_cast<size_t>(CookedSceneSection::Strings)];
+                copy.get()[strings.offset + strings.size - 1u] = 'x';
+            }, validates) == CookedSceneStatus::BadLayout;
+            report(ok, "truncated, foreign, outdated and damaged files are rejected");
+
+            AlignedCopy misaligned(cooked);
+            CookedScene scene;
+            report(scene.attach(misaligned.get() + 4u, cooked.size()) == CookedSceneStatus::BadAlignment &&
+                scene.load(directory / "missing.cscene") == CookedSceneStatus::FileError, "misaligned data and missing files are rejected");
+
+            bool caught = attachDamaged([](AlignedCopy &copy, size_t &)
+            {
+                uint32_t *meshes = reinterpret_cast<uint32_t *>(copy.get() + copy.header().sections[static_cast<size_t>(CookedSceneSection::NodeMeshes)].offset);
+                meshes[0] = copy.header().meshCount;
+            }, validates) == CookedSceneStatus::Ok && !validates;
+            caught = caught && attachDamaged([](AlignedCopy &copy, size_t &)
+            {
+                uint32_t *parents = reinterpret_cast<uint32_t *>(copy.get() + copy.header().sections[static_cast<size_t>(CookedSceneSection::Parents)].offset);
+                parents[1] = 1u;
+            }, validates) == CookedSceneStatus::Ok && !validates;
+            caught = caught && attachDamaged([](AlignedCopy &copy, size_t &)
+            {
+                CookedSceneMaterial *materials = reinterpret_cast<CookedSceneMaterial *>(copy.get() + copy.header().sections[static_cast<size_t>(CookedSceneSection::Materials)].offset);
+                materials[0].name = static_cast<uint32_t>(copy.header().sections[static_cast<size_t>(CookedSceneSection::Strings)].size);
+            }, validates) == CookedSceneStatus::Ok && !validates;
+            report(caught, "validate() catches bad indices and string offsets");
+        }
+
+        // Cycles and shared children are errors of the source, not something to cook
+        {
+            SceneDescription scene;
+            scene.nodes.resize(3u);
+            scene.nodes[1].children = { 2u };
+            scene.nodes[2].children = { 1u };
+            std::vector<uint8_t> file;
+            std::vector<uint32_t> order;
+            std::string error;
+            bool ok = !cookScene(scene, file, order, error);
+            scene.nodes[0].children = { 1u, 2u };
+            scene.nodes[2].children.clear();
+            ok = ok && !cookScene(scene, file, order, error);
+            scene.nodes[0].children = { 2u };
+            scene.nodes[1].children.clear();
+            scene.nodes[2].children = { 1u };
+            ok = ok && cookScene(scene, file, order, error) && order == std::vector<uint32_t>{ 0u, 2u, 1u };
+            report(ok, "cycles and nodes with two parents are refused");
+        }
+
+        return passed;
+    }
+
+    void benchmark(const Options &options, const fs::path &directory)
+    {
+        const fs::path gltfPath = directory / "bench.gltf";
+        const fs::path cookedPath = directory / "bench.cscene";
+
+        const std::string text = generateGltf(options.nodes, 5u);
+        writeFile(gltfPath, text.data(), text.size());
+
+        const Clock::time_point cookStart = Clock::now();
+        SceneDescription scene;
+        std::vector<uint8_t> cooked;
+        std::vector<uint32_t> order;
+        std::string error;
+        if (!loadGltfScene(gltfPath, scene, error) || !cookScene(scene, cooked, order, error))
+        {
+            std::cout << "Benchmark scene failed to cook: " << error << "\n";
+            return;
+        }
+        const double cookMs = millisecondsSince(cookStart);
+        writeFile(cookedPath, cooked.data(), cooked.size());
+
+        std::cout << "\nScene of " << scene.nodes.size() << " nodes, " << scene.meshes.size() << " meshes and " << scene.materials.size() << " materials\n"
+                  << std::fixed << std::setprecision(2)
+                  << "glTF " << text.size() / (1024.0 * 1024.0) << " MB, cooked " << cooked.size() / (1024.0 * 1024.0)
+                  << " MB, cooked in " << cookMs << " ms\n";
+        scene = SceneDescription();
+
+        // The fixup alone, on a file already in memory, costs the same for any number of nodes
+        double attachUs = 0.0;
+        {
+            AlignedCopy copy(cooked);
+            CookedScene attached;
+            const uint32_t repeats = 10000u;
+            const Clock::time_point start = Clock::now();
+            for (uint32_t i = 0u; i < repeats; ++i)
+            {
+                attached.attach(copy.get(), copy.size());
+            }
+            attachUs = millisecondsSince(start) * 1000.0 / repeats;
+        }
+        std::vector<uint8_t>().swap(cooked);
+
+        // Best of a few runs from the warm file cache, peak memory above what was in use before the load
+        double gltfMs = 1e30;
+        double cookedMs = 1e30;
+        uint64_t gltfPeak = 0u;
+        uint64_t cookedPeak = 0u;
+        for (uint32_t iteration = 0u; iteration < options.iterations; ++iteration)
+        {
+            {
+                const uint64_t before = g_heapBytes.load();
+                g_heapPeakBytes.store(before);
+                const Clock::time_point start = Clock::now();
+                SceneDescription loaded;
+                loadGltfScene(gltfPath, loaded, error);
+                gltfMs = (std::min)(gltfMs, millisecondsSince(start));
+                gltfPeak = (std::max)(gltfPeak, g_heapPeakBytes.load() - before);
+            }
+            {
+                const uint64_t before = g_heapBytes.load();
+                const uint64_t pagesBefore = getMemoryTagStats(MemoryTag::Scene).currentBytes;
+                g_heapPeakBytes.store(before);
+                const Clock::time_point start = Clock::now();
+                CookedScene loaded;
+                loaded.load(cookedPath);
+                cookedMs = (std::min)(cookedMs, millisecondsSince(start));
+                cookedPeak = (std::max)(cookedPeak, g_heapPeakBytes.load() - before + getMemoryTagStats(MemoryTag::Scene).currentBytes - pagesBefore);
+            }
+        }
+
+        std::cout << std::right << std::setw(24) << "load ms" << std::setw(12) << "peak MB" << "\n"
+                  << std::left << std::setw(12) << "glTF" << std::right << std::setw(12) << gltfMs << std::setw(12) << gltfPeak / (1024.0 * 1024.0) << "\n"
+                  << std::left << std::setw(12) << "cooked" << std::right << std::setw(12) << cookedMs << std::setw(12) << cookedPeak / (1024.0 * 1024.0) << "\n"
+                  << "Fixup after the read takes " << attachUs << " us\n"
+                  << "Cooked loads " << gltfMs / (std::max)(cookedMs, 1e-6) << "x faster in " << static_cast<double>(gltfPeak) / (std::max)(cookedPeak, static_cast<uint64_t>(1u)) << "x less memory\n";
+    }
+
+    bool parseArguments(int argc, char **argv, Options &options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string argument = argv[i];
+            const bool hasValue = i + 1 < argc;
+
+            if (argument == "--in" && hasValue)
+            {
+                options.inputPath = argv[++i];
+            }
+            else if (argument == "--out" && hasValue)
+            {
+                options.outputPath = argv[++i];
+            }
+            else if (argument == "--bench")
+            {
+                options.bench = true;
+            }
+            else if (argument == "--nodes" && hasValue)
+            {
+                options.nodes = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (argument == "--iterations" && hasValue)
+            {
+                options.iterations = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (argument == "--dir" && hasValue)
+            {
+                options.benchDirectory = argv[++i];
+            }
+            else
+            {
+                return false;
+            }
+        }
+        return options.bench ? options.nodes > 0u && options.iterations > 0u : !options.inputPath.empty() && !options.outputPath.empty();
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseArguments(argc, argv, options))
+    {
+        std::cerr << "Usage: SceneCooker --in <scene.gltf> --out <scene.cscene>\n"
+                  << "       SceneCooker --bench [--nodes <n>] [--iterations <n>] [--dir <path>]" << std::endl;
+        return 1;
+    }
+
+    if (!options.bench)
+    {
+        return cookFile(options);
+    }
+
+    const fs::path directory = options.benchDirectory.empty() ? fs::temp_directory_path() / "SceneCookerBench" : options.benchDirectory;
+    std::error_code errorCode;
+    fs::create_directories(directory, errorCode);
+
+    const bool passed = check(directory);
+    benchmark(options, directory);
+    return passed ? 0 : 1;
+}
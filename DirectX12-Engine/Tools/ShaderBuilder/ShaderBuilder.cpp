@@ -0,0 +1,659 @@
+// Offline shader build tool.
+//
+// Reads a shader list, expands every permutation, preprocesses each one with DXC and hashes the
+// preprocessed source together with the compile flags. Permutations that hash the same are
+// compiled once, bytecode that already exists in the output directory is reused, and the
+// remaining compiles run in parallel. A ShaderManifest with reflection data is written last.
+//
+// Shader list format, one shader per line:
+//   <source.hlsl> <entry point> <profile> [AXIS | AXIS=value0|value1|...]...
+// A bare AXIS toggles between undefined and AXIS=1.
+//
+// --benchmark generates a synthetic shader set with a shared include and a large permutation
+// count, then times a clean build, a rebuild with nothing changed, a comment edit, and a one-line
+// edit to one shader and to the include. It fails if any step compiles more or less than the
+// edit should have invalidated.
+//
+// Usage:
+//   ShaderBuilder --list <ShaderList.txt> --out <directory> [--dxc <path>] [--jobs <n>] [--debug]
+//   ShaderBuilder --benchmark [--out <scratch directory>] [--dxc <path>] [--jobs <n>]
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "ShaderManifest.h"
+#include "WorkerPool.h"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    struct Options
+    {
+        fs::path listPath;
+        fs::path outputDirectory;
+        std::string dxcPath = "dxc";
+        uint32_t jobs = 0u;
+        bool debug = false;
+        bool benchmark = false;
+    };
+
+    struct BuildStats
+    {
+        size_t permutations = 0u;
+        size_t unique = 0u;
+        size_t cached = 0u;
+        double preprocessMilliseconds = 0.0;
+        double compileMilliseconds = 0.0;
+        double totalMilliseconds = 0.0;
+    };
+
+    struct DefineAxis
+    {
+        std::string name;
+        std::vector<std::string> values; // An empty value leaves the define out
+    };
+
+    struct Permutation
+    {
+        std::string name;
+        fs::path source;
+        std::string entryPoint;
+        std::string profile;
+        std::vector<std::string> defines;
+
+        std::string hash;
+    };
+
+    struct CompileResult
+    {
+        bool cached = false;
+        std::vector<ShaderConstantBuffer> constantBuffers;
+        std::vector<ShaderBinding> bindings;
+    };
+
+    using Clock = std::chrono::steady_clock;
+
+    double millisecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    // Whole field must be a number that fits, unlike std::stoul which throws
+    bool parseNumber(const std::string &field, uint32_t &value)
+    {
+        const char *end = field.data() + field.size();
+        const std::from_chars_result result = std::from_chars(field.data(), end, value);
+        return !field.empty() && result.ec == std::errc() && result.ptr == end;
+    }
+
+    std::string quote(const fs::path &path)
+    {
+        return "\"" + path.string() + "\"";
+    }
+
+    int runCommand(std::string command)
+    {
+#if defined(_WIN32)
+        // cmd.exe strips the outer quotes of a command line that starts with one
+        command = "\"" + command + "\"";
+#endif
+        return std::system(command.c_str());
+    }
+
+    bool readFile(const fs::path &path, std::string &contents)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+        {
+            return false;
+        }
+        std::ostringstream stream;
+        stream << file.rdbuf();
+        contents = stream.str();
+        return true;
+    }
+
+    // 64-bit FNV-1a
+    uint64_t hashBytes(const std::string &data, uint64_t hash = 14695981039346656037ull)
+    {
+        for (const char c : data)
+        {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    std::string toHex(uint64_t value)
+    {
+        char buffer[17];
+        std::snprintf(buffer, sizeof(buffer), "%016llx", static_cast<unsigned long long>(value));
+        return buffer;
+    }
+
+    std::string dxcFlags(const Permutation &permutation, const Options &options)
+    {
+        std::string flags = " -T " + permutation.profile + " -E " + permutation.entryPoint;
+        flags += options.debug ? " -Zi -Qembed_debug -Od" : " -O3";
+        for (const std::string &define : permutation.defines)
+        {
+            flags += " -D " + define;
+        }
+        flags += " -I " + quote(permutation.source.parent_path());
+        return flags;
+    }
+
+    bool parseList(const Options &options, std::vector<Permutation> &permutations)
+    {
+        std::ifstream list(options.listPath);
+        if (!list)
+        {
+            std::cerr << "Unable to open shader list " << options.listPath << std::endl;
+            return false;
+        }
+
+        const fs::path baseDirectory = options.listPath.parent_path();
+        std::string line;
+        uint32_t lineNumber = 0u;
+
+        while (std::getline(list, line))
+        {
+            ++lineNumber;
+            const size_t comment = line.find('#');
+            if (comment != std::string::npos)
+            {
+                line.erase(comment);
+            }
+
+            std::istringstream tokens(line);
+            std::string source;
+            std::string entryPoint;
+            std::string profile;
+            if (!(tokens >> source))
+            {
+                continue;
+            }
+            if (!(tokens >> entryPoint >> profile))
+            {
+                std::cerr << options.listPath.string() << "(" << lineNumber << "): expected <source> <entry point> <profile>" << std::endl;
+                return false;
+            }
+
+            std::vector<DefineAxis> axes;
+            std::string axisToken;
+            while (tokens >> axisToken)
+            {
+                DefineAxis axis;
+                const size_t equals = axisToken.find('=');
+                axis.name = axisToken.substr(0u, equals);
+                if (equals == std::string::npos)
+                {
+                    axis.values = { "", "1" };
+                }
+                else
+                {
+                    std::istringstream values(axisToken.substr(equals + 1u));
+                    std::string value;
+                    while (std::getline(values, value, '|'))
+                    {
+                        axis.values.push_back(value);
+                    }
+                }
+                axes.push_back(axis);
+            }
+
+            // Walk every combination of axis values like an odometer
+            std::vector<size_t> selection(axes.size(), 0u);
+            while (true)
+            {
+                Permutation permutation;
+                permutation.name = fs::path(source).stem().string();
+                permutation.source = baseDirectory / source;
+                permutation.entryPoint = entryPoint;
+                permutation.profile = profile;
+                for (size_t i = 0u; i < axes.size(); ++i)
+                {
+                    const std::string &value = axes[i].values[selection[i]];
+                    if (!value.empty())
+                    {
+                        permutation.defines.push_back(axes[i].name + "=" + value);
+                    }
+                }
+                std::sort(permutation.defines.begin(), permutation.defines.end());
+                permutations.push_back(permutation);
+
+                size_t axis = 0u;
+                while (axis < axes.size() && ++selection[axis] == axes[axis].values.size())
+                {
+                    selection[axis++] = 0u;
+                }
+                if (axis == axes.size())
+                {
+                    break;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    // Pull the constant buffer layouts and the resource binding table out of a DXC listing (-Fc)
+    void parseReflection(const std::string &listing, CompileResult &result)
+    {
+        static const std::regex cbufferBegin(R"(^;\s*cbuffer\s+(\w+)\s*$)");
+        static const std::regex cbufferSize(R"(^;\s*\}\s*(\w+);\s*;\s*Offset:\s*\d+\s+Size:\s*(\d+))");
+        static const std::regex memberLine(R"(^;\s+(.+?;)\s*;\s*Offset:\s*(\d+))");
+        static const std::regex bindingRow(R"(^;\s*(\S+)\s+(\S+)\s+\S+\s+\S+\s+\S+\s+(\S+)\s+(\d+)\s*$)");
+
+        std::istringstream stream(listing);
+        std::string line;
+        ShaderConstantBuffer *constantBuffer = nullptr;
+        bool inBindings = false;
+        std::smatch match;
+        uint32_t number = 0u;
+
+        while (std::getline(stream, line))
+        {
+            if (!line.empty() && line.back() == '\r')
+            {
+                line.pop_back();
+            }
+
+            if (line.find("Resource Bindings:") != std::string::npos)
+            {
+                inBindings = true;
+                continue;
+            }
+
+            if (inBindings)
+            {
+                if (line.size() <= 1u || line.find("----") != std::string::npos || line.find("HLSL Bind") != std::string::npos)
+                {
+                    if (line.size() <= 1u && !result.bindings.empty())
+                    {
+                        inBindings = false;
+                    }
+                    continue;
+                }
+                if (std::regex_match(line, match, bindingRow) && parseNumber(match[4], number))
+                {
+                    result.bindings.push_back({ match[1], match[2], match[3], number });
+                }
+                continue;
+            }
+
+            if (std::regex_match(line, match, cbufferBegin))
+            {
+                result.constantBuffers.push_back({ match[1], 0u, {} });
+                constantBuffer = &result.constantBuffers.back();
+            }
+            else if (constantBuffer && std::regex_search(line, match, cbufferSize) && match[1] == constantBuffer->name)
+            {
+                parseNumber(match[2], constantBuffer->size);
+                constantBuffer = nullptr;
+            }
+            else if (constantBuffer && line.find("struct ") == std::string::npos && std::regex_search(line, match, memberLine) && parseNumber(match[2], number))
+            {
+                constantBuffer->members.push_back({ number, match[1] });
+            }
+        }
+    }
+
+    bool preprocess(Permutation &permutation, const Options &options, const fs::path &scratch)
+    {
+        const fs::path preprocessedPath = scratch / (permutation.name + "_" + toHex(hashBytes(permutation.entryPoint + permutation.profile + dxcFlags(permutation, options))) + ".i");
+        const std::string command = quote(options.dxcPath) + " " + quote(permutation.source) + dxcFlags(permutation, options) + " -P -Fi " + quote(preprocessedPath);
+
+        std::string preprocessed;
+        if (runCommand(command) != 0 || !readFile(preprocessedPath, preprocessed))
+        {
+            std::cerr << "Preprocessing failed: " << permutation.source.string() << std::endl;
+            return false;
+        }
+        fs::remove(preprocessedPath);
+
+        // The flags are part of the key so optimization level and profile changes are not served from the cache
+        uint64_t hash = hashBytes(preprocessed);
+        hash = hashBytes(permutation.entryPoint + "|" + permutation.profile + "|" + (options.debug ? "debug" : "release"), hash);
+        permutation.hash = toHex(hash);
+        return true;
+    }
+
+    bool compile(const Permutation &permutation, const Options &options, CompileResult &result)
+    {
+        const fs::path bytecodePath = options.outputDirectory / (permutation.hash + ".cso");
+        const fs::path listingPath = options.outputDirectory / (permutation.hash + ".lst");
+
+        std::string listing;
+        if (fs::exists(bytecodePath) && readFile(listingPath, listing))
+        {
+            result.cached = true;
+        }
+        else
+        {
+            const std::string command = quote(options.dxcPath) + " " + quote(permutation.source) + dxcFlags(permutation, options) +
+                " -Fo " + quote(bytecodePath) + " -Fc " + quote(listingPath);
+            if (runCommand(command) != 0 || !readFile(listingPath, listing))
+            {
+                std::cerr << "Compilation failed: " << permutation.source.string() << std::endl;
+                return false;
+            }
+        }
+
+        parseReflection(listing, result);
+        return true;
+    }
+
+    bool parseArguments(int argc, char **argv, Options &options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string argument = argv[i];
+            const bool hasValue = i + 1 < argc;
+
+            if (argument == "--list" && hasValue)
+            {
+                options.listPath = argv[++i];
+            }
+            else if (argument == "--out" && hasValue)
+            {
+                options.outputDirectory = argv[++i];
+            }
+            else if (argument == "--dxc" && hasValue)
+            {
+                options.dxcPath = argv[++i];
+            }
+            else if (argument == "--jobs" && hasValue)
+            {
+                if (!parseNumber(argv[++i], options.jobs))
+                {
+                    return false;
+                }
+            }
+            else if (argument == "--debug")
+            {
+                options.debug = true;
+            }
+            else if (argument == "--benchmark")
+            {
+                options.benchmark = true;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        if (options.benchmark)
+        {
+            return options.listPath.empty();
+        }
+        return !options.listPath.empty() && !options.outputDirectory.empty();
+    }
+
+    bool build(const Options &options, WorkerPool &workerPool, BuildStats &stats)
+    {
+        const Clock::time_point start = Clock::now();
+        stats = BuildStats();
+
+        std::vector<Permutation> permutations;
+        if (!parseList(options, permutations))
+        {
+            return false;
+        }
+
+        const fs::path scratch = options.outputDirectory / "preprocessed";
+        fs::create_directories(scratch);
+
+        // Preprocess and hash every permutation
+        const Clock::time_point preprocessStart = Clock::now();
+        std::atomic<bool> failed(false);
+        workerPool.parallelFor(static_cast<uint32_t>(permutations.size()), [&](uint32_t index)
+        {
+            if (!preprocess(permutations[index], options, scratch))
+            {
+                failed = true;
+            }
+        });
+        stats.preprocessMilliseconds = millisecondsSince(preprocessStart);
+
+        if (failed)
+        {
+            return false;
+        }
+
+        // Permutations whose preprocessed source is identical share one compile
+        std::map<std::string, size_t> uniqueByHash;
+        for (size_t i = 0u; i < permutations.size(); ++i)
+        {
+            uniqueByHash.emplace(permutations[i].hash, i);
+        }
+
+        std::vector<size_t> uniqueIndices;
+        for (const auto &entry : uniqueByHash)
+        {
+            uniqueIndices.push_back(entry.second);
+        }
+
+        const Clock::time_point compileStart = Clock::now();
+        std::vector<CompileResult> results(uniqueIndices.size());
+        workerPool.parallelFor(static_cast<uint32_t>(uniqueIndices.size()), [&](uint32_t index)
+        {
+            if (!compile(permutations[uniqueIndices[index]], options, results[index]))
+            {
+                failed = true;
+            }
+        });
+        stats.compileMilliseconds = millisecondsSince(compileStart);
+
+        if (failed)
+        {
+            return false;
+        }
+
+        std::map<std::string, const CompileResult *> resultByHash;
+        for (size_t i = 0u; i < uniqueIndices.size(); ++i)
+        {
+            resultByHash[permutations[uniqueIndices[i]].hash] = &results[i];
+            stats.cached += results[i].cached ? 1u : 0u;
+        }
+
+        ShaderManifest manifest;
+        for (const Permutation &permutation : permutations)
+        {
+            const CompileResult &result = *resultByHash[permutation.hash];
+
+            ShaderRecord record;
+            record.name = permutation.name;
+            record.entryPoint = permutation.entryPoint;
+            record.profile = permutation.profile;
+            record.defines = permutation.defines;
+            record.hash = permutation.hash;
+            record.file = permutation.hash + ".cso";
+            record.constantBuffers = result.constantBuffers;
+            record.bindings = result.bindings;
+            manifest.addRecord(record);
+        }
+
+        std::ofstream manifestFile(options.outputDirectory / "ShaderManifest.txt", std::ios::binary);
+        manifestFile << manifest.serialize();
+        if (!manifestFile)
+        {
+            std::cerr << "Unable to write the shader manifest" << std::endl;
+            return false;
+        }
+
+        stats.permutations = permutations.size();
+        stats.unique = uniqueIndices.size();
+        stats.totalMilliseconds = millisecondsSince(start);
+        return true;
+    }
+
+    // The synthetic set: every shader includes Common.hlsli and has BenchmarkAxes toggles it reads
+    // plus one it never reads, so half the permutations dedupe to the same preprocessed source
+    const uint32_t BenchmarkShaders = 8u;
+    const uint32_t BenchmarkAxes = 6u;
+
+    bool writeFile(const fs::path &path, const std::string &contents)
+    {
+        std::ofstream file(path, std::ios::binary);
+        file << contents;
+        return static_cast<bool>(file);
+    }
+
+    std::string benchmarkInclude(const std::string &extraLine)
+    {
+        std::string include =
+            "cbuffer BenchmarkConstants : register(b0)\n"
+            "{\n"
+            "    float4 tint;\n"
+            "    float4 scale;\n"
+            "};\n"
+            "\n"
+            "float3 shade(float3 color, float amount)\n"
+            "{\n"
+            "    return lerp(color, color * tint.rgb, saturate(amount));\n"
+            "}\n";
+        return include + extraLine;
+    }
+
+    std::string benchmarkShader(uint32_t shader, const std::string &extraLine)
+    {
+        std::ostringstream source;
+        source << "#include \"Common.hlsli\"\n\n"
+               << "float4 main(float4 position : SV_POSITION, float2 uv : TEXCOORD) : SV_TARGET\n"
+               << "{\n"
+               << "    float3 color = float3(uv, " << shader << ".0 / " << BenchmarkShaders << ".0);\n";
+        for (uint32_t axis = 0u; axis < BenchmarkAxes; ++axis)
+        {
+            source << "#ifdef FEATURE" << axis << "\n"
+                   << "    color = shade(color.gbr, uv.x * " << axis + 1u << ".0 + scale.x);\n"
+                   << "#endif\n";
+        }
+        source << extraLine
+               << "    return float4(color, 1.0);\n"
+               << "}\n";
+        return source.str();
+    }
+
+    int benchmark(Options options)
+    {
+        const fs::path directory = options.outputDirectory.empty() ? fs::temp_directory_path() / "ShaderBuilderBenchmark" : options.outputDirectory;
+        const fs::path sourceDirectory = directory / "Source";
+        std::error_code error;
+        fs::remove_all(directory, error);
+        fs::create_directories(sourceDirectory);
+
+        std::ostringstream list;
+        for (uint32_t shader = 0u; shader < BenchmarkShaders; ++shader)
+        {
+            writeFile(sourceDirectory / ("Shader" + std::to_string(shader) + ".hlsl"), benchmarkShader(shader, ""));
+            list << "Shader" << shader << ".hlsl main ps_6_0";
+            for (uint32_t axis = 0u; axis < BenchmarkAxes; ++axis)
+            {
+                list << " FEATURE" << axis;
+            }
+            list << " UNUSED\n";
+        }
+        writeFile(sourceDirectory / "Common.hlsli", benchmarkInclude(""));
+        writeFile(sourceDirectory / "ShaderList.txt", list.str());
+
+        options.listPath = sourceDirectory / "ShaderList.txt";
+        options.outputDirectory = directory / "Output";
+
+        const size_t uniquePerShader = size_t(1u) << BenchmarkAxes;
+        struct Step
+        {
+            const char *name;
+            size_t expectedCompiles;
+            std::function<bool()> edit;
+        };
+        const Step steps[] =
+        {
+            { "clean build", BenchmarkShaders * uniquePerShader, []() { return true; } },
+            { "no change", 0u, []() { return true; } },
+            { "comment in include", 0u, [&]() { return writeFile(sourceDirectory / "Common.hlsli", benchmarkInclude("// Tweaked\n")); } },
+            { "line in one shader", uniquePerShader, [&]() { return writeFile(sourceDirectory / "Shader0.hlsl", benchmarkShader(0u, "    color *= 0.5;\n")); } },
+            { "line in include", BenchmarkShaders * uniquePerShader, [&]() { return writeFile(sourceDirectory / "Common.hlsli", benchmarkInclude("static const float Bias = 0.5;\n")); } },
+        };
+
+        WorkerPool workerPool(options.jobs);
+        std::cout << BenchmarkShaders << " shaders with " << BenchmarkAxes + 1u << " axes each, "
+                  << workerPool.getThreadCount() << " threads, dxc: " << options.dxcPath << "\n\n";
+        std::cout << std::left << std::setw(22) << "Step" << std::right
+                  << std::setw(14) << "Permutations" << std::setw(10) << "Unique" << std::setw(10) << "Compiled"
+                  << std::setw(10) << "Expected" << std::setw(10) << "Cached" << std::setw(16) << "Preprocess ms"
+                  << std::setw(14) << "Compile ms" << std::setw(12) << "Total ms" << "\n";
+
+        bool passed = true;
+        for (const Step &step : steps)
+        {
+            BuildStats stats;
+            if (!step.edit() || !build(options, workerPool, stats))
+            {
+                std::cerr << "Benchmark step failed: " << step.name << std::endl;
+                return 1;
+            }
+
+            const size_t compiled = stats.unique - stats.cached;
+            passed = passed && compiled == step.expectedCompiles;
+            std::cout << std::left << std::setw(22) << step.name << std::right << std::fixed << std::setprecision(1)
+                      << std::setw(14) << stats.permutations << std::setw(10) << stats.unique << std::setw(10) << compiled
+                      << std::setw(10) << step.expectedCompiles << std::setw(10) << stats.cached
+                      << std::setw(16) << stats.preprocessMilliseconds << std::setw(14) << stats.compileMilliseconds
+                      << std::setw(12) << stats.totalMilliseconds << "\n";
+        }
+
+        fs::remove_all(directory, error);
+        std::cout << "\n" << (passed ? "Rebuilds compiled exactly what the edits invalidated" : "FAILED: a rebuild compiled the wrong set") << std::endl;
+        return passed ? 0 : 1;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseArguments(argc, argv, options))
+    {
+        std::cerr << "Usage: ShaderBuilder --list <ShaderList.txt> --out <directory> [--dxc <path>] [--jobs <n>] [--debug]\n"
+                  << "       ShaderBuilder --benchmark [--out <scratch directory>] [--dxc <path>] [--jobs <n>]" << std::endl;
+        return 1;
+    }
+
+    if (options.benchmark)
+    {
+        return benchmark(options);
+    }
+
+    WorkerPool workerPool(options.jobs);
+    BuildStats stats;
+    if (!build(options, workerPool, stats))
+    {
+        return 1;
+    }
+
+    std::cout << "Permutations:    " << stats.permutations << "\n"
+              << "Unique outputs:  " << stats.unique << "\n"
+              << "Cache hits:      " << stats.cached << "\n"
+              << "Compiled:        " << stats.unique - stats.cached << "\n"
+              << "Threads:         " << workerPool.getThreadCount() << "\n"
+              << "Preprocess time: " << stats.preprocessMilliseconds << " ms\n"
+              << "Compile time:    " << stats.compileMilliseconds << " ms\n"
+              << "Total time:      " << stats.totalMilliseconds << " ms" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,463 @@
+// SpriteBatch and AtlasPacker check and benchmark.
+//
+// Batches random sprites over images spread across several atlas pages and checks that:
+//  - every page gets one draw, the draws cover the written instances in page order and each
+//    page keeps the submission order of its sprites
+//  - instances carry the sprite's position, size and color with its image's uv rectangle
+//  - sprites with an unknown image or past the instance limit are dropped and counted
+// Packs random images and checks that:
+//  - every region lies inside its page, has the requested size and keeps its padding clear of
+//    the other regions
+//  - images larger than a page are rejected without losing the rest, and the occupancy is the
+//    packed area over the area of the open pages
+// Then every count is timed through build() in sprites per millisecond, and a few image sets are
+// packed in arrival order and with packAll() to compare the pages, occupancy and efficiency they reach.
+//
+// Usage:
+//   SpriteBatchBench [--count <n>...] [--images <n>] [--page <n>] [--seed <n>]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "AtlasPacker.h"
+#include "SpriteBatch.h"
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    double millisecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    struct Options
+    {
+        std::vector<uint32_t> counts;
+        uint32_t images = 1000u;
+        uint32_t pageSize = 1024u;
+        uint32_t seed = 1u;
+    };
+
+    const uint32_t ImagesPerBatch = 64u;
+
+    struct BatchImage
+    {
+        uint32_t page;
+        float uvRect[4];
+    };
+
+    // Registers images spread over the pages, returns what the batch was given
+    std::vector<BatchImage> addImages(SpriteBatch &batch, uint32_t pages, std::mt19937 &random)
+    {
+        std::uniform_int_distribution<uint32_t> page(0u, pages - 1u);
+        std::uniform_real_distribution<float> uv(0.0f, 1.0f);
+
+        std::vector<BatchImage> images(ImagesPerBatch);
+        for (BatchImage &image : images)
+        {
+            image.page = page(random);
+            for (float &value : image.uvRect)
+            {
+                value = uv(random);
+            }
+            batch.addImage(image.page, image.uvRect);
+        }
+        return images;
+    }
+
+    // unknownImages of every 64 sprites refer to an image that was never added
+    std::vector<Sprite> makeSprites(uint32_t count, uint32_t unknownImages, std::mt19937 &random)
+    {
+        std::uniform_real_distribution<float> position(0.0f, 1920.0f);
+        std::uniform_real_distribution<float> size(4.0f, 128.0f);
+        std::uniform_int_distribution<uint32_t> image(0u, ImagesPerBatch - 1u + unknownImages);
+
+        std::vector<Sprite> sprites(count);
+        for (Sprite &sprite : sprites)
+        {
+            sprite.position[0] = position(random);
+            sprite.position[1] = position(random);
+            sprite.size[0] = size(random);
+            sprite.size[1] = size(random);
+            sprite.color = static_cast<uint32_t>(random());
+            sprite.image = image(random);
+        }
+        return sprites;
+    }
+
+    bool instanceMatches(const SpriteBatch::Instance &instance, const Sprite &sprite, const BatchImage &image)
+    {
+        return instance.position[0] == sprite.position[0] && instance.position[1] == sprite.position[1]
+            && instance.size[0] == sprite.size[0] && instance.size[1] == sprite.size[1]
+            && std::equal(image.uvRect, image.uvRect + 4, instance.uvRect) && instance.color == sprite.color;
+    }
+
+    // Builds the sprites and compares the result with a stable sort by page of the accepted sprites
+    bool buildMatches(SpriteBatch &batch, const std::vector<BatchImage> &images, const std::vector<Sprite> &sprites, uint32_t &dropped)
+    {
+        std::vector<SpriteBatch::Instance> instances(batch.getMaxInstances());
+        const std::vector<SpriteBatch::Draw> &draws = batch.build(sprites.data(), static_cast<uint32_t>(sprites.size()), instances.data());
+
+        std::vector<const Sprite *> accepted;
+        for (const Sprite &sprite : sprites)
+        {
+            if (sprite.image < images.size() && accepted.size() < batch.getMaxInstances())
+            {
+                accepted.push_back(&sprite);
+            }
+        }
+        std::stable_sort(accepted.begin(), accepted.end(), [&images](const Sprite *a, const Sprite *b)
+        {
+            return images[a->image].page < images[b->image].page;
+        });
+        dropped = static_cast<uint32_t>(sprites.size() - accepted.size());
+
+        bool matches = true;
+        uint32_t next = 0u;
+        for (const SpriteBatch::Draw &draw : draws)
+        {
+            matches = matches && draw.firstInstance == next && draw.instanceCount > 0u;
+            for (uint32_t i = draw.firstInstance; matches && i < draw.firstInstance + draw.instanceCount; ++i)
+            {
+                matches = i < accepted.size() && images[accepted[i]->image].page == draw.page
+                    && instanceMatches(instances[i], *accepted[i], images[accepted[i]->image]);
+            }
+            next = draw.firstInstance + draw.instanceCount;
+        }
+        return matches && next == accepted.size();
+    }
+
+    enum class ImageSet
+    {
+        Icons,   // 16, 32 or 64 pixel squares
+        Mixed,   // Anything from 8 to 128 pixels on a side
+        Glyphs,  // Small and taller than wide
+        Strips,  // Wide and flat
+        Count
+    };
+
+    const char *const ImageSetNames[] = { "Icons", "Mixed", "Glyphs", "Strips" };
+
+    void makeImages(ImageSet set, uint32_t count, std::mt19937 &random, std::vector<uint32_t> &widths, std::vector<uint32_t> &heights)
+    {
+        widths.resize(count);
+        heights.resize(count);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            switch (set)
+            {
+            case ImageSet::Icons:
+                widths[i] = 16u << std::uniform_int_distribution<uint32_t>(0u, 2u)(random);
+                heights[i] = widths[i];
+                break;
+            case ImageSet::Mixed:
+                widths[i] = std::uniform_int_distribution<uint32_t>(8u, 128u)(random);
+                heights[i] = std::uniform_int_distribution<uint32_t>(8u, 128u)(random);
+                break;
+            case ImageSet::Glyphs:
+                widths[i] = std::uniform_int_distribution<uint32_t>(4u, 24u)(random);
+                heights[i] = std::uniform_int_distribution<uint32_t>(12u, 32u)(random);
+                break;
+            default:
+                widths[i] = std::uniform_int_distribution<uint32_t>(64u, 256u)(random);
+                heights[i] = std::uniform_int_distribution<uint32_t>(4u, 16u)(random);
+                break;
+            }
+        }
+    }
+
+    // Marks every region with its padding on a bitmap of each page, a texel marked twice is an overlap
+    bool regionsDisjoint(const AtlasPacker &packer, uint32_t padding, const std::vector<uint32_t> &widths, const std::vector<uint32_t> &heights,
+        const std::vector<AtlasPacker::Region> &regions)
+    {
+        const uint32_t pageWidth = packer.getPageWidth();
+        const uint32_t pageHeight = packer.getPageHeight();
+        std::vector<std::vector<uint8_t>> pages(packer.getPageCount(), std::vector<uint8_t>(static_cast<size_t>(pageWidth) * pageHeight, 0u));
+
+        for (size_t i = 0; i < regions.size(); ++i)
+        {
+            const AtlasPacker::Region &region = regions[i];
+            if (region.page >= pages.size() || region.width != widths[i] || region.height != heights[i]
+                || region.x + region.width > pageWidth || region.y + region.height > pageHeight)
+            {
+                return false;
+            }
+
+            const uint32_t right = (std::min)(region.x + region.width + padding, pageWidth);
+            const uint32_t bottom = (std::min)(region.y + region.height + padding, pageHeight);
+            for (uint32_t y = region.y; y < bottom; ++y)
+            {
+                for (uint32_t x = region.x; x < right; ++x)
+                {
+                    uint8_t &texel = pages[region.page][static_cast<size_t>(y) * pageWidth + x];
+                    if (texel != 0u)
+                    {
+                        return false;
+                    }
+                    texel = 1u;
+                }
+            }
+        }
+        return true;
+    }
+
+    double packedArea(const std::vector<uint32_t> &widths, const std::vector<uint32_t> &heights)
+    {
+        double area = 0.0;
+        for (size_t i = 0; i < widths.size(); ++i)
+        {
+            area += static_cast<double>(widths[i]) * heights[i];
+        }
+        return area;
+    }
+
+    // Packed area over the area the images took up: the full pages and the last one up to its highest
+    // region. Unlike the occupancy this does not count the unused top of the last page as waste.
+    double packingEfficiency(const AtlasPacker &packer, const std::vector<uint32_t> &widths, const std::vector<uint32_t> &heights,
+        const std::vector<AtlasPacker::Region> &regions)
+    {
+        const uint32_t lastPage = packer.getPageCount() - 1u;
+        uint32_t lastPageHeight = 0u;
+        for (const AtlasPacker::Region &region : regions)
+        {
+            if (region.page == lastPage)
+            {
+                lastPageHeight = (std::max)(lastPageHeight, region.y + region.height);
+            }
+        }
+        const double usedArea = static_cast<double>(packer.getPageWidth()) * (static_cast<double>(packer.getPageHeight()) * lastPage + lastPageHeight);
+        return packedArea(widths, heights) / usedArea;
+    }
+
+    bool check(const Options &options)
+    {
+        bool passed = true;
+        auto report = [&passed](bool condition, const std::string &what)
+        {
+            std::cout << std::left << std::setw(64) << what << (condition ? "ok" : "FAILED") << "\n";
+            passed = passed && condition;
+        };
+
+        std::mt19937 random(options.seed);
+
+        // Batching
+        {
+            const uint32_t count = options.counts.back();
+            SpriteBatch batch(count);
+            const std::vector<BatchImage> images = addImages(batch, 4u, random);
+
+            const std::vector<Sprite> sprites = makeSprites(count, 0u, random);
+            uint32_t dropped = 0u;
+            const bool matches = buildMatches(batch, images, sprites, dropped);
+            const bool oneDrawPerPage = batch.getStats().draws <= 4u;
+
+            const std::vector<Sprite> withUnknown = makeSprites(count, 8u, random);
+            uint32_t droppedUnknown = 0u;
+            const bool unknownMatches = buildMatches(batch, images, withUnknown, droppedUnknown);
+
+            SpriteBatch limited(count / 2u + 1u);
+            const std::vector<BatchImage> limitedImages = addImages(limited, 4u, random);
+            uint32_t droppedLimited = 0u;
+            const bool limitedMatches = buildMatches(limited, limitedImages, withUnknown, droppedLimited);
+
+            const SpriteBatch::Stats &stats = batch.getStats();
+            const std::string label = std::to_string(count) + " sprites on 4 pages";
+            report(matches && dropped == 0u && oneDrawPerPage, label + ": one draw per page, in order");
+            report(unknownMatches && droppedUnknown > 0u, label + ": unknown images dropped");
+            report(limitedMatches && droppedLimited >= count / 2u - 1u, label + ": sprites past the limit dropped");
+            report(stats.submittedSprites == 2u * count && stats.droppedSprites == droppedUnknown, label + ": stats count every sprite");
+        }
+
+        // Packing
+        const uint32_t pageSize = (std::min)(options.pageSize, 512u);
+        const uint32_t padding = 1u;
+        for (uint32_t set = 0; set < static_cast<uint32_t>(ImageSet::Count); ++set)
+        {
+            std::vector<uint32_t> widths;
+            std::vector<uint32_t> heights;
+            makeImages(static_cast<ImageSet>(set), options.images, random, widths, heights);
+
+            AtlasPacker packer(pageSize, pageSize, padding);
+            std::vector<AtlasPacker::Region> regions(widths.size());
+            const bool packed = packer.packAll(widths.data(), heights.data(), static_cast<uint32_t>(widths.size()), regions.data());
+
+            const double expectedOccupancy = packedArea(widths, heights) / (static_cast<double>(pageSize) * pageSize * packer.getPageCount());
+            const std::string label = std::string(ImageSetNames[set]) + " on " + std::to_string(packer.getPageCount()) + " pages";
+            report(packed && regionsDisjoint(packer, padding, widths, heights, regions), label + ": regions inside, padded, disjoint");
+            report(std::abs(packer.getOccupancy() - expectedOccupancy) < 1e-4, label + ": occupancy is the packed area");
+        }
+
+        {
+            AtlasPacker packer(pageSize, pageSize);
+            std::vector<uint32_t> widths = { 16u, pageSize + 1u, 32u, pageSize };
+            std::vector<uint32_t> heights = { 16u, 8u, 32u, pageSize + 1u };
+            std::vector<AtlasPacker::Region> regions(widths.size());
+            const bool packed = packer.packAll(widths.data(), heights.data(), static_cast<uint32_t>(widths.size()), regions.data());
+
+            const bool rejected = regions[1].width == 0u && regions[3].width == 0u;
+            const std::vector<uint32_t> fitWidths = { widths[0], widths[2] };
+            const std::vector<uint32_t> fitHeights = { heights[0], heights[2] };
+            const std::vector<AtlasPacker::Region> fitRegions = { regions[0], regions[2] };
+            report(!packed && rejected && regionsDisjoint(packer, 1u, fitWidths, fitHeights, fitRegions), "Images larger than a page rejected, the others packed");
+
+            packer.reset();
+            report(packer.getPageCount() == 0u && packer.getOccupancy() == 0.0f, "Reset closes every page");
+        }
+
+        std::cout << "\n";
+        return passed;
+    }
+
+    void benchmarkBatching(const Options &options)
+    {
+        std::cout << std::left << std::setw(12) << "Sprites" << std::right << std::setw(8) << "Pages" << std::setw(8) << "Draws"
+                  << std::setw(12) << "Build us" << std::setw(12) << "ns/sprite" << std::setw(14) << "Sprites/ms" << "\n";
+
+        std::cout << std::fixed;
+        for (const uint32_t count : options.counts)
+        {
+            for (const uint32_t pages : { 1u, 4u, 16u })
+            {
+                std::mt19937 random(options.seed);
+                SpriteBatch batch(count);
+                addImages(batch, pages, random);
+                const std::vector<Sprite> sprites = makeSprites(count, 0u, random);
+                std::vector<SpriteBatch::Instance> instances(count);
+
+                size_t draws = 0u;
+                uint64_t builds = 0u;
+                const Clock::time_point start = Clock::now();
+                do
+                {
+                    draws = batch.build(sprites.data(), count, instances.data()).size();
+                    ++builds;
+                } while (millisecondsSince(start) < 200.0);
+                const double buildMilliseconds = millisecondsSince(start) / builds;
+
+                std::cout << std::left << std::setw(12) << count << std::right << std::setw(8) << pages << std::setw(8) << draws
+                          << std::setprecision(1) << std::setw(12) << buildMilliseconds * 1e3
+                          << std::setprecision(2) << std::setw(12) << buildMilliseconds * 1e6 / count
+                          << std::setprecision(0) << std::setw(14) << count / buildMilliseconds << "\n";
+            }
+        }
+        std::cout << "\n";
+    }
+
+    void benchmarkPacking(const Options &options)
+    {
+        std::cout << "Efficiency is the packed area over the area used, the last page up to its highest image\n";
+        std::cout << std::left << std::setw(10) << "Images" << std::right << std::setw(8) << "Count"
+                  << std::setw(10) << "Pages" << std::setw(14) << "Occupancy" << std::setw(14) << "Efficiency" << std::setw(12) << "us/image"
+                  << std::setw(12) << "packAll" << std::setw(14) << "Occupancy" << std::setw(14) << "Efficiency" << std::setw(12) << "us/image" << "\n";
+
+        std::cout << std::fixed;
+        for (uint32_t set = 0; set < static_cast<uint32_t>(ImageSet::Count); ++set)
+        {
+            std::mt19937 random(options.seed);
+            std::vector<uint32_t> widths;
+            std::vector<uint32_t> heights;
+            makeImages(static_cast<ImageSet>(set), options.images, random, widths, heights);
+            std::vector<AtlasPacker::Region> regions(widths.size());
+
+            // In arrival order, as images loaded one at a time would be
+            AtlasPacker packer(options.pageSize, options.pageSize);
+            uint64_t runs = 0u;
+            Clock::time_point start = Clock::now();
+            do
+            {
+                packer.reset();
+                for (size_t i = 0; i < widths.size(); ++i)
+                {
+                    packer.pack(widths[i], heights[i], regions[i]);
+                }
+                ++runs;
+            } while (millisecondsSince(start) < 200.0);
+            const double packMicroseconds = millisecondsSince(start) * 1e3 / (runs * widths.size());
+            const uint32_t packPages = packer.getPageCount();
+            const float packOccupancy = packer.getOccupancy();
+            const double packEfficiency = packingEfficiency(packer, widths, heights, regions);
+
+            runs = 0u;
+            start = Clock::now();
+            do
+            {
+                packer.reset();
+                packer.packAll(widths.data(), heights.data(), static_cast<uint32_t>(widths.size()), regions.data());
+                ++runs;
+            } while (millisecondsSince(start) < 200.0);
+            const double packAllMicroseconds = millisecondsSince(start) * 1e3 / (runs * widths.size());
+            const double packAllEfficiency = packingEfficiency(packer, widths, heights, regions);
+
+            std::cout << std::left << std::setw(10) << ImageSetNames[set] << std::right << std::setw(8) << widths.size()
+                      << std::setw(10) << packPages << std::setprecision(1) << std::setw(13) << 100.0f * packOccupancy << "%"
+                      << std::setw(13) << 100.0 * packEfficiency << "%" << std::setprecision(2) << std::setw(12) << packMicroseconds
+                      << std::setw(12) << packer.getPageCount() << std::setprecision(1) << std::setw(13) << 100.0f * packer.getOccupancy() << "%"
+                      << std::setw(13) << 100.0 * packAllEfficiency << "%" << std::setprecision(2) << std::setw(12) << packAllMicroseconds << "\n";
+        }
+        std::cout << std::flush;
+    }
+
+    bool parseArguments(int argc, char **argv, Options &options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string argument = argv[i];
+            const bool hasValue = i + 1 < argc;
+
+            if (argument == "--count" && hasValue)
+            {
+                options.counts.push_back(static_cast<uint32_t>(std::stoul(argv[++i])));
+            }
+            else if (argument == "--images" && hasValue)
+            {
+                options.images = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (argument == "--page" && hasValue)
+            {
+                options.pageSize = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (argument == "--seed" && hasValue)
+            {
+                options.seed = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else
+            {
+                return false;
+            }
+        }
+
+        if (options.counts.empty())
+        {
+            options.counts = { 1000u, 10000u, 65536u };
+        }
+
+        // The image sets need pages of at least 256 to fit their largest image
+        return options.images > 0u && options.pageSize >= 256u
+            && std::all_of(options.counts.begin(), options.counts.end(), [](uint32_t count) { return count > 1u; });
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseArguments(argc, argv, options))
+    {
+        std::cerr << "Usage: SpriteBatchBench [--count <n>...] [--images <n>] [--page <n>] [--seed <n>]" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Images per batch: " << ImagesPerBatch << ", images packed: " << options.images << ", page: "
+              << options.pageSize << "x" << options.pageSize << ", seed: " << options.seed << "\n\n";
+
+    const bool passed = check(options);
+    benchmarkBatching(options);
+    benchmarkPacking(options);
+    return passed ? 0 : 1;
+}
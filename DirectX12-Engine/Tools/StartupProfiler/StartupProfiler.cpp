@@ -0,0 +1,379 @@
+// Startup task graph check and profiler.
+//
+// Runs StartupGraph with a null device: the renderer's startup graph is rebuilt with the same
+// tasks and dependencies, each standing in for its D3D12 call by sleeping, or spinning with
+// --busy, for about as long as that call takes on a desktop GPU. Checks that:
+//  - no task starts before every task it depends on has finished, also on random graphs
+//  - main thread tasks run on the thread that called run()
+//  - deferred tasks wait for startDeferred(), and are dropped when the graph goes away first
+//  - an exception stops the graph, skips the tasks depending on the one that threw and comes
+//    out of run() or waitDeferred()
+//  - the critical path of a graph with known costs is the chain it should be
+// Then prints the startup report of the modelled renderer for a few worker counts.
+//
+// Usage:
+//   StartupProfiler [--workers <n>] [--scale <x>] [--busy] [--random <graphs>]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "StartupGraph.h"
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+    typedef StartupGraph::TaskId TaskId;
+
+    struct Options
+    {
+        uint32_t workers = 0u; // Zero profiles with 1, 3 and the default number of workers
+        float scale = 1.0f;
+        bool busy = false;
+        uint32_t randomGraphs = 200u;
+    };
+
+    // Stands in for a call that takes this long, sleeping leaves the cores to the other tasks
+    void work(double milliseconds, bool busy)
+    {
+        const Clock::time_point end = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(milliseconds));
+        if (!busy)
+        {
+            std::this_thread::sleep_until(end);
+            return;
+        }
+        while (Clock::now() < end)
+        {
+        }
+    }
+
+    // The renderer's startup graph, see Renderer::buildStartupGraph(), with rough costs in milliseconds
+    void buildRendererModel(StartupGraph &graph, const Options &options)
+    {
+        auto cost = [&options](double milliseconds) -> std::function<void()>
+        {
+            const double scaled = milliseconds * options.scale;
+            const bool busy = options.busy;
+            return [scaled, busy]() { work(scaled, busy); };
+        };
+
+        const char *shaderNames[] = {
+            "VertexShader", "PixelShader", "UpscaleVertexShader", "UpscalePixelShader", "SpriteVertexShader", "SpritePixelShader",
+            "ParticlePrepareCS", "ParticleEmitCS", "ParticleSimulateCS", "ParticleFinishCS", "ParticleVertexShader", "ParticlePixelShader"
+        };
+        const uint32_t shaderCount = sizeof(shaderNames) / sizeof(shaderNames[0]);
+        const uint32_t particleShader = 6u;
+
+        const TaskId shaderManifest = graph.add("read shader manifest", cost(1.0), {});
+        std::vector<TaskId> shaders(shaderCount);
+        for (uint32_t shader = 0u; shader < shaderCount; ++shader)
+        {
+            const std::string name = std::string("read ") + shaderNames[shader];
+            shaders[shader] = shader < particleShader ?
+                graph.add(name.c_str(), cost(2.0), { shaderManifest }) :
+                graph.addDeferred(name.c_str(), cost(2.0), { shaderManifest });
+        }
+
+        const TaskId device = graph.add("create device", cost(45.0), {});
+        const TaskId queues = graph.add("create queues", cost(3.0), { device });
+        const TaskId swapChain = graph.add("create swap chain", cost(15.0), { queues }, StartupGraph::Affinity::MainThread);
+        const TaskId frameResources = graph.add("create frame resources", cost(3.0), { swapChain });
+        const TaskId descriptorHeap = graph.add("create descriptor heap", cost(1.0), { device });
+
+        const TaskId sceneRootSignature = graph.add("scene root signature", cost(2.0), { device });
+        const TaskId scenePipeline = graph.add("scene pipeline", cost(25.0), { sceneRootSignature, shaders[0], shaders[1] });
+        const TaskId upscaleRootSignature = graph.add("upscale root signature", cost(2.0), { device });
+        graph.add("upscale pipeline", cost(20.0), { upscaleRootSignature, shaders[2], shaders[3] });
+        const TaskId spriteRootSignature = graph.add("sprite root signature", cost(2.0), { device });
+        graph.add("sprite pipeline", cost(20.0), { spriteRootSignature, shaders[4], shaders[5] });
+
+        graph.add("create command list", cost(1.0), { frameResources, scenePipeline });
+        graph.add("create constant buffers", cost(4.0), { descriptorHeap, swapChain });
+        graph.add("create geometry", cost(3.0), { device });
+        graph.add("occlusion culling", cost(2.0), { swapChain });
+        graph.add("dynamic resolution", cost(3.0), { frameResources, descriptorHeap });
+        graph.add("sprites", cost(6.0), { descriptorHeap });
+        graph.add("lights", cost(1.0), { swapChain });
+
+        const TaskId particleRootSignature = graph.addDeferred("particle root signature", cost(3.0), { device });
+        const char *particlePassNames[] = { "particle prepare pipeline", "particle emit pipeline", "particle simulate pipeline", "particle finish pipeline" };
+        for (uint32_t pass = 0u; pass < 4u; ++pass)
+        {
+            graph.addDeferred(particlePassNames[pass], cost(30.0), { particleRootSignature, shaders[particleShader + pass] });
+        }
+        graph.addDeferred("particle draw pipeline", cost(25.0), { particleRootSignature, shaders[10], shaders[11] });
+        graph.addDeferred("particle buffers", cost(5.0), { device });
+    }
+
+    bool check(const Options &options)
+    {
+        bool passed = true;
+        auto report = [&passed](bool condition, const std::string &what)
+        {
+            std::cout << std::left << std::setw(64) << what << (condition ? "ok" : "FAILED") << "\n";
+            passed = passed && condition;
+        };
+
+        const std::thread::id mainThread = std::this_thread::get_id();
+
+        // Random graphs, each task checks that its dependencies are done when it starts
+        {
+            std::mt19937 random(7u);
+            bool ordered = true;
+            bool allRan = true;
+            bool onMainThread = true;
+            for (uint32_t graphIndex = 0u; graphIndex < options.randomGraphs; ++graphIndex)
+            {
+                const uint32_t taskCount = 1u + random() % 48u;
+                std::vector<std::vector<TaskId>> dependencies(taskCount);
+                std::unique_ptr<std::atomic<bool>[]> finished(new std::atomic<bool>[taskCount]);
+                std::atomic<bool> orderKept(true);
+                std::atomic<bool> affinityKept(true);
+                std::vector<bool> deferred(taskCount, false);
+
+                StartupGraph graph(1u + random() % 4u);
+                for (TaskId id = 0u; id < taskCount; ++id)
+                {
+                    finished[id].store(false, std::memory_order_relaxed);
+                    deferred[id] = random() % 4u == 0u;
+                    for (TaskId dependency = 0u; dependency < id; ++dependency)
+                    {
+                        // Startup tasks may not depend on deferred ones
+                        if (random() % 5u == 0u && (deferred[id] || !deferred[dependency]))
+                        {
+                            dependencies[id].push_back(dependency);
+                        }
+                    }
+
+                    const bool mainOnly = !deferred[id] && random() % 5u == 0u;
+                    const uint32_t spin = random() % 2000u;
+                    auto task = [&, id, mainOnly, spin]()
+                    {
+                        for (TaskId dependency : dependencies[id])
+                        {
+                            if (!finished[dependency].load(std::memory_order_acquire))
+                            {
+                                orderKept.store(false, std::memory_order_relaxed);
+                            }
+                        }
+                        if (mainOnly && std::this_thread::get_id() != mainThread)
+                        {
+                            affinityKept.store(false, std::memory_order_relaxed);
+                        }
+
+                        // A little work so tasks overlap
+                        volatile uint32_t sink = 0u;
+                        for (uint32_t i = 0u; i < spin; ++i)
+                        {
+                            sink = sink + i;
+                        }
+                        finished[id].store(true, std::memory_order_release);
+                    };
+
+                    const std::string name = "task " + std::to_string(id);
+                    if (deferred[id])
+                    {
+                        graph.addDeferred(name.c_str(), task, dependencies[id]);
+                    }
+                    else
+                    {
+                        graph.add(name.c_str(), task, dependencies[id], mainOnly ? StartupGraph::Affinity::MainThread : StartupGraph::Affinity::AnyThread);
+                    }
+                }
+
+                graph.run();
+                for (TaskId id = 0u; id < taskCount; ++id)
+                {
+                    allRan = allRan && (deferred[id] || finished[id].load());
+                }
+                graph.waitDeferred();
+                for (TaskId id = 0u; id < taskCount; ++id)
+                {
+                    allRan = allRan && finished[id].load();
+                }
+                ordered = ordered && orderKept.load();
+                onMainThread = onMainThread && affinityKept.load();
+            }
+            report(ordered, "tasks start after their dependencies finish");
+            report(allRan, "every task runs, startup ones before run() returns");
+            report(onMainThread, "main thread tasks run on the thread calling run()");
+        }
+
+        // Deferred tasks wait for startDeferred(), even once their dependencies are done
+        {
+            std::atomic<uint32_t> deferredRan(0u);
+            StartupGraph graph(2u);
+            const TaskId first = graph.add("first", []() {}, {});
+            graph.addDeferred("deferred a", [&deferredRan]() { deferredRan.fetch_add(1u); }, { first });
+            graph.addDeferred("deferred b", [&deferredRan]() { deferredRan.fetch_add(1u); }, {});
+            graph.run();
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            bool ok = deferredRan.load() == 0u && !graph.isDeferredDone();
+            graph.startDeferred();
+            graph.waitDeferred();
+            ok = ok && deferredRan.load() == 2u && graph.isDeferredDone();
+            graph.startDeferred(); // Again does nothing
+            report(ok, "deferred tasks wait for startDeferred()");
+        }
+
+        // Dropped when the graph is destroyed before they start
+        {
+            std::atomic<uint32_t> deferredRan(0u);
+            {
+                StartupGraph graph(2u);
+                graph.add("startup", []() {}, {});
+                graph.addDeferred("deferred", [&deferredRan]() { deferredRan.fetch_add(1u); }, {});
+                graph.run();
+            }
+            report(deferredRan.load() == 0u, "unstarted deferred tasks are dropped on destruction");
+        }
+
+        // A throwing task skips its dependents and comes out of run()
+        {
+            std::atomic<bool> dependentRan(false);
+            StartupGraph graph(2u);
+            const TaskId root = graph.add("root", []() {}, {});
+            const TaskId failing = graph.add("failing", []() { throw std::runtime_error("no device"); }, { root });
+            const TaskId dependent = graph.add("dependent", [&dependentRan]() { dependentRan.store(true); }, { failing });
+            graph.addDeferred("deferred", []() {}, { root });
+
+            std::string message;
+            try
+            {
+                graph.run();
+            }
+            catch (const std::runtime_error &error)
+            {
+                message = error.what();
+            }
+            const StartupGraph::Report result = graph.getReport();
+            const bool ok = message == "no device" && !dependentRan.load() &&
+                result.tasks[root].completed && !result.tasks[failing].completed && !result.tasks[dependent].completed;
+            report(ok, "an exception stops startup and comes out of run()");
+        }
+
+        // And out of waitDeferred() for deferred tasks
+        {
+            StartupGraph graph(2u);
+            graph.add("startup", []() {}, {});
+            graph.addDeferred("failing", []() { throw std::runtime_error("no pipeline"); }, {});
+            graph.run();
+            graph.startDeferred();
+            while (!graph.isDeferredDone())
+            {
+                std::this_thread::yield();
+            }
+
+            std::string message;
+            try
+            {
+                graph.waitDeferred();
+            }
+            catch (const std::runtime_error &error)
+            {
+                message = error.what();
+            }
+            report(message == "no pipeline", "a deferred exception comes out of waitDeferred()");
+        }
+
+        // Two short branches next to a long chain, the chain is the critical path
+        {
+            StartupGraph graph(3u);
+            const TaskId a = graph.add("a", []() { work(30.0, false); }, {});
+            const TaskId b = graph.add("b", []() { work(5.0, false); }, {});
+            const TaskId c = graph.add("c", []() { work(30.0, false); }, { a });
+            graph.add("d", []() { work(5.0, false); }, { b });
+            const TaskId e = graph.add("e", []() { work(10.0, false); }, { b, c });
+            graph.run();
+
+            const StartupGraph::Report result = graph.getReport();
+            const bool ok = result.criticalPath == std::vector<TaskId>{ a, c, e } &&
+                result.criticalPathMs >= 70.0 && result.criticalPathMs <= result.startupMs + 0.001 &&
+                result.serialMs >= result.criticalPathMs + 10.0 && result.tasks[c].critical && !result.tasks[b].critical;
+            report(ok, "the critical path is the longest chain of measured work");
+        }
+
+        return passed;
+    }
+
+    void profile(const Options &options)
+    {
+        std::vector<uint32_t> workerCounts;
+        if (options.workers > 0u)
+        {
+            workerCounts.push_back(options.workers);
+        }
+        else
+        {
+            workerCounts = { 1u, 3u, 0u };
+        }
+
+        for (uint32_t workers : workerCounts)
+        {
+            StartupGraph graph(workers);
+            buildRendererModel(graph, options);
+            graph.run();
+
+            // The first frame would be rendered here
+            graph.startDeferred();
+            graph.waitDeferred();
+
+            std::cout << "\n";
+            graph.writeReport(std::cout);
+        }
+    }
+
+    bool parseArguments(int argc, char **argv, Options &options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string argument = argv[i];
+            const bool hasValue = i + 1 < argc;
+
+            if (argument == "--workers" && hasValue)
+            {
+                options.workers = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (argument == "--scale" && hasValue)
+            {
+                options.scale = std::stof(argv[++i]);
+            }
+            else if (argument == "--busy")
+            {
+                options.busy = true;
+            }
+            else if (argument == "--random" && hasValue)
+            {
+                options.randomGraphs = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else
+            {
+                return false;
+            }
+        }
+        return options.scale >= 0.0f;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseArguments(argc, argv, options))
+    {
+        std::cerr << "Usage: StartupProfiler [--workers <n>] [--scale <x>] [--busy] [--random <graphs>]" << std::endl;
+        return 1;
+    }
+
+    const bool passed = check(options);
+    profile(options);
+    return passed ? 0 : 1;
+}
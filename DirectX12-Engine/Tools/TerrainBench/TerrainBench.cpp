@@ -0,0 +1,883 @@
+// Streamed terrain check, benchmark and cook tool.
+//
+// Cooks a generated fractal heightmap with cookTerrain() and checks that:
+//  - every tile holds the full resolution samples at its positions, and the tile errors and bounds
+//    are consistent from level to level; damaged files are turned down
+//  - the tile cache gives up the least recently used tile first and never one used this frame or pinned
+//  - with every tile resident the selection covers the terrain exactly once and every patch meets
+//    the pixel threshold or is at the finest level
+//  - stitched patches are watertight along every seam, in random views, and the same patches
+//    without stitching are not
+//  - streaming from disk converges on the all resident selection with the samples of the file,
+//    and a small cache never gives up a tile a patch of the frame is drawing
+//  - every read is accounted for once cancelled, and the streamer can be destroyed with reads in flight
+// Then flies synthetic camera paths over a larger terrain at a fixed frame time, streaming its
+// tiles from disk through AsyncFileReader, and reports triangles per frame, the cache hit rate of
+// the selection's lookups and the streaming traffic.
+//
+// Usage:
+//   TerrainBench [--levels <n>] [--frames <n>] [--frame-ms <n>] [--slots <n>] [--seed <n>] [--dir <path>]
+//   TerrainBench --in <heights.r16> --size <n> --out <terrain.dtrn> [--tile <samples>] [--world <size>] [--height <scale>]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AsyncFileReader.h"
+#include "TerrainQuadtree.h"
+#include "TerrainStreamer.h"
+#include "TerrainTileCache.h"
+#include "TerrainTiles.h"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    const float FieldOfView = 1.04719755f; // 60 degrees vertically
+    const float ViewportWidth = 1920.0f;
+    const float ViewportHeight = 1080.0f;
+    const float ThresholdPixels = 2.0f;
+    const float NearDistance = 1.0f;
+
+    struct Options
+    {
+        // Cook
+        std::string inputPath;
+        std::string outputPath;
+        uint32_t size = 0u;
+        uint32_t tileSamples = 65u;
+        float worldSize = 8192.0f;
+        float heightScale = 800.0f;
+
+        // Benchmark
+        uint32_t levels = 6u;
+        uint32_t frames = 480u;
+        uint32_t frameMs = 4u;
+        uint32_t slots = 512u;
+        uint32_t seed = 1u;
+        fs::path directory;
+    };
+
+    // A cooked terrain in memory next to the heightmap it came from
+    struct TestTerrain
+    {
+        uint32_t size;
+        std::vector<uint16_t> heights;
+        std::vector<uint8_t> file;
+        TerrainTileSet tiles;
+        fs::path path;
+    };
+
+    uint32_t hash(uint32_t value)
+    {
+        value ^= value >> 16;
+        value *= 0x7feb352du;
+        value ^= value >> 15;
+        value *= 0x846ca68bu;
+        value ^= value >> 16;
+        return value;
+    }
+
+    float latticeValue(int32_t x, int32_t z, uint32_t seed)
+    {
+        return static_cast<float>(hash(static_cast<uint32_t>(x) * 0x9e3779b9u ^ hash(static_cast<uint32_t>(z) + seed)) >> 8) * (1.0f / 16777216.0f);
+    }
+
+    float valueNoise(float x, float z, uint32_t seed)
+    {
+        const float cellX = std::floor(x);
+        const float cellZ = std::floor(z);
+        const int32_t ix = static_cast<int32_t>(cellX);
+        const int32_t iz = static_cast<int32_t>(cellZ);
+        float u = x - cellX;
+        float v = z - cellZ;
+        u = u * u * (3.0f - 2.0f * u);
+        v = v * v * (3.0f - 2.0f * v);
+        const float a = latticeValue(ix, iz, seed) + (latticeValue(ix + 1, iz, seed) - latticeValue(ix, iz, seed)) * u;
+        const float b = latticeValue(ix, iz + 1, seed) + (latticeValue(ix + 1, iz + 1, seed) - latticeValue(ix, iz + 1, seed)) * u;
+        return a + (b - a) * v;
+    }
+
+    // Ridged fractal noise over the whole range of 16 bit heights
+    std::vector<uint16_t> generateHeights(uint32_t size, uint32_t seed)
+    {
+        std::vector<float> values(static_cast<size_t>(size) * size);
+        for (uint32_t z = 0u; z < size; ++z)
+        {
+            for (uint32_t x = 0u; x < size; ++x)
+            {
+                float frequency = 6.0f / static_cast<float>(size);
+                float amplitude = 1.0f;
+                float value = 0.0f;
+                for (uint32_t octave = 0u; octave < 9u; ++octave)
+                {
+                    const float noise = valueNoise(x * frequency, z * frequency, seed + octave);
+                    value += (octave < 3u ? 1.0f - std::fabs(noise * 2.0f - 1.0f) : noise) * amplitude;
+                    frequency *= 2.0f;
+                    amplitude *= 0.5f;
+                }
+                values[static_cast<size_t>(z) * size + x] = value;
+            }
+        }
+
+        const auto range = std::minmax_element(values.begin(), values.end());
+        const float scale = 65535.0f / (*range.second - *range.first);
+        std::vector<uint16_t> heights(values.size());
+        for (size_t i = 0u; i < values.size(); ++i)
+        {
+            heights[i] = static_cast<uint16_t>((values[i] - *range.first) * scale + 0.5f);
+        }
+        return heights;
+    }
+
+    bool makeTerrain(uint32_t tileSamples, uint32_t levels, float worldSize, float heightScale, uint32_t seed, const fs::path &path, TestTerrain &terrain)
+    {
+        terrain.size = ((tileSamples - 1u) << (levels - 1u)) + 1u;
+        terrain.heights = generateHeights(terrain.size, seed);
+        terrain.path = path;
+
+        std::string error;
+        if (!cookTerrain(terrain.heights.data(), terrain.size, tileSamples, worldSize, heightScale, terrain.file, error))
+        {
+            std::cout << "Terrain failed to cook: " << error << "\n";
+            return false;
+        }
+        std::ofstream file(path, std::ios::binary);
+        file.write(reinterpret_cast<const char *>(terrain.file.data()), static_cast<std::streamsize>(terrain.file.size()));
+        file.close();
+        if (!file || !terrain.tiles.load(path, error))
+        {
+            std::cout << "Terrain failed to load: " << error << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    const uint16_t *getTileSamples(const TestTerrain &terrain, uint32_t tile)
+    {
+        return reinterpret_cast<const uint16_t *>(terrain.file.data() + terrain.tiles.getTileOffset(tile));
+    }
+
+    // Ground height in world units under a point, bilinear between the full resolution samples
+    float getGroundHeight(const TestTerrain &terrain, float x, float z)
+    {
+        const TerrainTileHeader &header = terrain.tiles.getHeader();
+        const float scale = static_cast<float>(terrain.size - 1u) / header.worldSize;
+        const float sampleX = (std::min)((std::max)(x * scale, 0.0f), static_cast<float>(terrain.size - 1u) - 0.001f);
+        const float sampleZ = (std::min)((std::max)(z * scale, 0.0f), static_cast<float>(terrain.size - 1u) - 0.001f);
+        const uint32_t ix = static_cast<uint32_t>(sampleX);
+        const uint32_t iz = static_cast<uint32_t>(sampleZ);
+        const float u = sampleX - ix;
+        const float v = sampleZ - iz;
+        const uint16_t *row = terrain.heights.data() + static_cast<size_t>(iz) * terrain.size + ix;
+        const float a = row[0] + (row[1] - row[0]) * u;
+        const float b = row[terrain.size] + (row[terrain.size + 1u] - row[terrain.size]) * u;
+        return (a + (b - a) * v) * header.heightScale / 65535.0f;
+    }
+
+    Frustum makeFrustum(const Vec3 &eye, const Vec3 &target, float farDistance)
+    {
+        const Mat4 view = lookAtMatrix(eye, target, Vec3{ 0.0f, 1.0f, 0.0f });
+        const Mat4 projection = perspectiveMatrix(FieldOfView, ViewportWidth / ViewportHeight, NearDistance, farDistance);
+        return extractFrustum(multiply(view, projection));
+    }
+
+    // Every point passes every plane
+    Frustum makeOpenFrustum()
+    {
+        Frustum frustum;
+        for (Vec4 &plane : frustum.planes)
+        {
+            plane = Vec4{ 0.0f, 0.0f, 0.0f, 1.0f };
+        }
+        return frustum;
+    }
+
+    // A cache holding every tile, pinned
+    void fillCache(TerrainTileCache &cache, uint32_t tileCount)
+    {
+        for (uint32_t tile = 0u; tile < tileCount; ++tile)
+        {
+            cache.insert(tile, 0u, true);
+        }
+    }
+
+    // Finest level tiles covered by each patch, -1 where nothing is drawn. Returns false on overlaps.
+    bool buildOwnerGrid(const TerrainTileSet &tiles, const std::vector<TerrainPatch> &patches, std::vector<int32_t> &owners)
+    {
+        const uint32_t lastLevel = tiles.getLevelCount() - 1u;
+        const uint32_t side = 1u << lastLevel;
+        owners.assign(static_cast<size_t>(side) * side, -1);
+        bool overlapping = false;
+        for (size_t p = 0u; p < patches.size(); ++p)
+        {
+            const TerrainTileKey key = getTerrainTileKey(patches[p].tile);
+            const uint32_t span = 1u << (lastLevel - key.level);
+            for (uint32_t z = key.z * span; z < (key.z + 1u) * span; ++z)
+            {
+                for (uint32_t x = key.x * span; x < (key.x + 1u) * span; ++x)
+                {
+                    int32_t &owner = owners[static_cast<size_t>(z) * side + x];
+                    overlapping = overlapping || owner != -1;
+                    owner = static_cast<int32_t>(p);
+                }
+            }
+        }
+        return !overlapping;
+    }
+
+    // A vertex on a patch edge in full resolution sample units: its position along the edge and its height
+    struct EdgePoint
+    {
+        int64_t along;
+        float height;
+    };
+
+    // Stitched vertices along edge 0 (-x), 1 (+x), 2 (-z) or 3 (+z) of a patch, the way the vertex shader places them
+    std::vector<EdgePoint> getEdgePoints(const TestTerrain &terrain, const TerrainPatch &patch, uint32_t edge)
+    {
+        const uint32_t last = terrain.tiles.getTileSamples() - 1u;
+        const TerrainTileKey key = getTerrainTileKey(patch.tile);
+        const uint32_t shift = terrain.tiles.getLevelCount() - 1u - key.level;
+        const uint16_t *samples = getTileSamples(terrain, patch.tile);
+
+        std::vector<EdgePoint> points;
+        for (uint32_t t = 0u; t <= last; ++t)
+        {
+            uint32_t i = edge == 0u ? 0u : edge == 1u ? last : t;
+            uint32_t j = edge == 2u ? 0u : edge == 3u ? last : t;
+            stitchTerrainVertex(patch.stitch, last, i, j);
+            const int64_t along = edge < 2u ? (static_cast<int64_t>(key.z) * last + j) << shift : (static_cast<int64_t>(key.x) * last + i) << shift;
+            points.push_back(EdgePoint{ along, static_cast<float>(samples[j * (last + 1u) + i]) });
+        }
+        return points;
+    }
+
+    bool isOnPolyline(const std::vector<EdgePoint> &polyline, const EdgePoint &point)
+    {
+        for (size_t k = 0u; k < polyline.size(); ++k)
+        {
+            if (polyline[k].along == point.along)
+            {
+                if (std::fabs(polyline[k].height - point.height) <= 1e-3f)
+                {
+                    return true;
+                }
+            }
+            else if (k + 1u < polyline.size() && polyline[k].along < point.along && point.along < polyline[k + 1u].along)
+            {
+                const float t = static_cast<float>(point.along - polyline[k].along) / static_cast<float>(polyline[k + 1u].along - polyline[k].along);
+                return std::fabs(polyline[k].height + (polyline[k + 1u].height - polyline[k].height) * t - point.height) <= 1e-3f;
+            }
+        }
+        return false;
+    }
+
+    // Edge vertices of every patch that are not on the edge of the patch across from them, zero when the
+    // surface is watertight. Seams next to culled areas are skipped.
+    uint32_t countCracks(const TestTerrain &terrain, const std::vector<TerrainPatch> &patches)
+    {
+        std::vector<int32_t> owners;
+        buildOwnerGrid(terrain.tiles, patches, owners);
+
+        const uint32_t last = terrain.tiles.getTileSamples() - 1u;
+        const uint32_t lastLevel = terrain.tiles.getLevelCount() - 1u;
+        const int64_t side = static_cast<int64_t>(1u) << lastLevel;
+        std::vector<std::vector<EdgePoint>> polylines(patches.size() * 4u);
+        for (size_t p = 0u; p < patches.size(); ++p)
+        {
+            for (uint32_t edge = 0u; edge < 4u; ++edge)
+            {
+                polylines[p * 4u + edge] = getEdgePoints(terrain, patches[p], edge);
+            }
+        }
+
+        uint32_t cracks = 0u;
+        for (size_t p = 0u; p < patches.size(); ++p)
+        {
+            const TerrainTileKey key = getTerrainTileKey(patches[p].tile);
+            const int64_t span = static_cast<int64_t>(1u) << (lastLevel - key.level);
+            for (uint32_t edge = 0u; edge < 4u; ++edge)
+            {
+                // Finest tile column or row across the edge
+                const int64_t line = ((edge < 2u ? key.x : key.z) + (edge & 1u)) * span;
+                const int64_t across = edge & 1u ? line : line - 1;
+                if (across < 0 || across >= side)
+                {
+                    continue;
+                }
+                for (const EdgePoint &point : polylines[p * 4u + edge])
+                {
+                    // The finest tiles the vertex touches across the edge, two when it sits on their border
+                    const int64_t cell = point.along / last;
+                    const int64_t cells[2] = { cell < side ? cell : -1, point.along % last == 0 && cell > 0 ? cell - 1 : -1 };
+                    for (int64_t along : cells)
+                    {
+                        const int32_t owner = along < 0 ? -1 : edge < 2u ? owners[along * side + across] : owners[across * side + along];
+                        if (owner < 0)
+                        {
+                            continue;
+                        }
+
+                        // Past a corner of the patch the tile across may belong to a patch with no edge on this line
+                        const TerrainTileKey ownerKey = getTerrainTileKey(patches[owner].tile);
+                        const int64_t ownerSpan = static_cast<int64_t>(1u) << (lastLevel - ownerKey.level);
+                        const int64_t ownerLine = ((edge < 2u ? ownerKey.x : ownerKey.z) + (~edge & 1u)) * ownerSpan;
+                        if (ownerLine == line && !isOnPolyline(polylines[owner * 4u + (edge ^ 1u)], point))
+                        {
+                            ++cracks;
+                        }
+                    }
+                }
+            }
+        }
+        return cracks;
+    }
+
+    bool check(const fs::path &directory)
+    {
+        bool passed = true;
+        auto report = [&passed](bool condition, const std::string &what)
+        {
+            std::cout << std::left << std::setw(64) << what << (condition ? "ok" : "FAILED") << "\n";
+            passed = passed && condition;
+        };
+
+        TestTerrain terrain;
+        if (!makeTerrain(33u, 5u, 8192.0f, 50.0f, 7u, directory / "check.dtrn", terrain))
+        {
+            return false;
+        }
+        const TerrainTileSet &tiles = terrain.tiles;
+        const uint32_t tileSamples = tiles.getTileSamples();
+        const uint32_t lastLevel = tiles.getLevelCount() - 1u;
+
+        // Tiles are the full resolution samples at their positions, errors and bounds agree between levels
+        {
+            bool samplesMatch = true;
+            bool consistent = true;
+            for (uint32_t tile = 0u; tile < tiles.getTileCount(); ++tile)
+            {
+                const TerrainTileKey key = getTerrainTileKey(tile);
+                const uint32_t step = 1u << (lastLevel - key.level);
+                const uint16_t *samples = getTileSamples(terrain, tile);
+                const TerrainTileInfo &info = tiles.getInfo(tile);
+                for (uint32_t j = 0u; j < tileSamples; ++j)
+                {
+                    for (uint32_t i = 0u; i < tileSamples; ++i)
+                    {
+                        const size_t x = (static_cast<size_t>(key.x) * (tileSamples - 1u) + i) * step;
+                        const size_t z = (static_cast<size_t>(key.z) * (tileSamples - 1u) + j) * step;
+                        const uint16_t sample = samples[j * tileSamples + i];
+                        samplesMatch = samplesMatch && sample == terrain.heights[z * terrain.size + x];
+                        const float height = sample * tiles.getHeader().heightScale / 65535.0f;
+                        consistent = consistent && height >= info.minHeight && height <= info.maxHeight;
+                    }
+                }
+                if (key.level == lastLevel)
+                {
+                    consistent = consistent && info.error == 0.0f;
+                    continue;
+                }
+                for (uint32_t child = 0u; child < 4u; ++child)
+                {
+                    const TerrainTileInfo &childInfo = tiles.getInfo(getTerrainTileIndex(key.level + 1u, key.x * 2u + (child & 1u), key.z * 2u + (child >> 1)));
+                    consistent = consistent && info.error >= childInfo.error && info.minHeight <= childInfo.minHeight && info.maxHeight >= childInfo.maxHeight;
+                }
+            }
+            report(samplesMatch, "every tile holds the full resolution samples at its positions");
+            report(consistent && tiles.getInfo(0u).error > 0.0f, "tile errors never drop below their children's, bounds nest");
+
+            std::vector<uint8_t> file;
+            std::string error;
+            bool rejects = !cookTerrain(terrain.heights.data(), terrain.size - 1u, tileSamples, 1024.0f, 200.0f, file, error) &&
+                !cookTerrain(terrain.heights.data(), terrain.size, 30u, 1024.0f, 200.0f, file, error);
+
+            TerrainTileSet damaged;
+            std::vector<uint8_t> copy(terrain.file.begin(), terrain.file.begin() + tiles.getHeader().dataOffset);
+            rejects = rejects && !damaged.parse(copy.data(), sizeof(TerrainTileHeader) + 8u, error);
+            copy[0] ^= 0xffu;
+            rejects = rejects && !damaged.parse(copy.data(), copy.size(), error);
+            copy[0] ^= 0xffu;
+            TerrainTileHeader header;
+            memcpy(&header, copy.data(), sizeof(header));
+            header.tileStride = 100u;
+            memcpy(copy.data(), &header, sizeof(header));
+            rejects = rejects && !damaged.parse(copy.data(), copy.size(), error) && !damaged.load(directory / "missing.dtrn", error);
+            report(rejects, "bad sizes and damaged or missing files are turned down");
+        }
+
+        // Least recently used first, never a tile used this frame or a pinned one
+        {
+            TerrainTileCache cache(16u, 4u);
+            bool ok = cache.insert(0u, 0u, true) != TerrainTileCache::NoSlot;
+            ok = ok && cache.insert(1u, 1u) != TerrainTileCache::NoSlot && cache.insert(2u, 1u) != TerrainTileCache::NoSlot && cache.insert(3u, 2u) != TerrainTileCache::NoSlot;
+            ok = ok && cache.acquire(1u, 3u) != TerrainTileCache::NoSlot;      // Tile 2 is now the oldest
+            const uint32_t slot = cache.insert(4u, 4u);
+            ok = ok && slot != TerrainTileCache::NoSlot && cache.getTile(slot) == 4u && !cache.contains(2u) && cache.contains(0u);
+            ok = ok && cache.acquire(1u, 5u) != TerrainTileCache::NoSlot && cache.acquire(3u, 5u) != TerrainTileCache::NoSlot && cache.acquire(4u, 5u) != TerrainTileCache::NoSlot;
+            ok = ok && cache.insert(5u, 5u) == TerrainTileCache::NoSlot && cache.contains(0u);
+            ok = ok && cache.acquire(2u, 5u) == TerrainTileCache::NoSlot;
+            const TerrainTileCache::Stats &stats = cache.getStats();
+            ok = ok && stats.lookups == 5u && stats.hits == 4u && stats.insertions == 5u && stats.evictions == 1u && cache.getResidentCount() == 4u;
+            report(ok, "cache evicts least recently used, never used or pinned tiles");
+        }
+
+        // With everything resident the patches tile the terrain and meet the threshold
+        TerrainQuadtree quadtree(tiles);
+        quadtree.setProjection(FieldOfView, ViewportHeight, ThresholdPixels, NearDistance);
+        TerrainTileCache fullCache(tiles.getTileCount(), tiles.getTileCount());
+        fillCache(fullCache, tiles.getTileCount());
+
+        std::mt19937 random(11u);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        const float worldSize = tiles.getHeader().worldSize;
+        auto randomEye = [&]()
+        {
+            const float x = unit(random) * worldSize;
+            const float z = unit(random) * worldSize;
+            return Vec3{ x, getGroundHeight(terrain, x, z) + 2.0f + unit(random) * 200.0f, z };
+        };
+        {
+            bool covers = true;
+            bool meetsThreshold = true;
+            bool mixed = false;
+            TerrainSelection selection;
+            const Frustum open = makeOpenFrustum();
+            for (uint32_t view = 0u; view < 20u; ++view)
+            {
+                const Vec3 eye = randomEye();
+                quadtree.select(eye, open, fullCache, view + 1u, selection);
+
+                std::vector<int32_t> owners;
+                covers = covers && buildOwnerGrid(tiles, selection.patches, owners) && selection.requests.empty() &&
+                    std::find(owners.begin(), owners.end(), -1) == owners.end();
+                std::set<uint32_t> levels;
+                for (const TerrainPatch &patch : selection.patches)
+                {
+                    const uint32_t level = getTerrainTileKey(patch.tile).level;
+                    levels.insert(level);
+                    meetsThreshold = meetsThreshold && (level == lastLevel || quadtree.getScreenSpaceError(patch.tile, eye) <= ThresholdPixels);
+                    meetsThreshold = meetsThreshold && patch.slot == fullCache.find(patch.tile);
+                }
+                mixed = mixed || levels.size() > 2u;
+            }
+            report(covers && mixed, "resident selection covers the terrain once, at mixed levels");
+            report(meetsThreshold, "every patch meets the pixel threshold or is at the finest level");
+        }
+
+        // Stitching closes every seam, and without it the same views crack
+        {
+            uint32_t cracks = 0u;
+            uint32_t unstitchedCracks = 0u;
+            uint32_t stitchedEdges = 0u;
+            TerrainSelection selection;
+            for (uint32_t view = 0u; view < 40u; ++view)
+            {
+                const Vec3 eye = randomEye();
+                const float angle = unit(random) * 6.2831853f;
+                const Vec3 target = eye + Vec3{ std::cos(angle), -0.3f - unit(random), std::sin(angle) };
+                const Frustum frustum = view % 2u == 0u ? makeOpenFrustum() : makeFrustum(eye, target, worldSize * 2.0f);
+                quadtree.select(eye, frustum, fullCache, 100u + view, selection);
+
+                cracks += countCracks(terrain, selection.patches);
+                for (TerrainPatch &patch : selection.patches)
+                {
+                    stitchedEdges += patch.stitch != 0u ? 1u : 0u;
+                    patch.stitch = 0u;
+                }
+                unstitchedCracks += countCracks(terrain, selection.patches);
+            }
+            report(cracks == 0u && stitchedEdges > 0u, "stitched patches are watertight along every seam");
+            report(unstitchedCracks > 0u, "the same patches crack without stitching");
+        }
+
+        // Streaming from disk settles on the resident selection, with the samples of the file
+        AsyncFileReader reader;
+        {
+            TerrainTileCache cache(tiles.getTileCount(), tiles.getTileCount());
+            TerrainStreamer::Settings settings;
+            TerrainStreamer streamer(reader, terrain.path, tiles, cache, settings);
+
+            std::vector<TerrainTileUpload> uploads;
+            bool ok = streamer.loadPinnedLevels(2u, uploads) && uploads.size() == getTerrainTileCount(2u);
+
+            const Vec3 eye{ worldSize * 0.3f, getGroundHeight(terrain, worldSize * 0.3f, worldSize * 0.4f) + 5.0f, worldSize * 0.4f };
+            const Frustum frustum = makeFrustum(eye, eye + Vec3{ 1.0f, -0.4f, 0.6f }, worldSize * 2.0f);
+            TerrainSelection selection;
+            uint64_t frame = 1u;
+            for (; frame < 5000u; ++frame)
+            {
+                quadtree.select(eye, frustum, cache, frame, selection);
+                streamer.update(frame, selection.requests, uploads);
+                if (selection.requests.empty() && streamer.getRequestsInFlight() == 0u)
+                {
+                    break;
+                }
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+
+            bool samplesMatch = true;
+            for (const TerrainTileUpload &upload : uploads)
+            {
+                samplesMatch = samplesMatch && cache.getTile(upload.slot) == upload.tile &&
+                    memcmp(upload.samples.data(), getTileSamples(terrain, upload.tile), tiles.getTileDataSize()) == 0;
+            }
+
+            TerrainSelection resident;
+            quadtree.select(eye, frustum, fullCache, frame, resident);
+            std::set<uint32_t> streamedTiles;
+            std::set<uint32_t> residentTiles;
+            for (const TerrainPatch &patch : selection.patches)
+            {
+                streamedTiles.insert(patch.tile);
+            }
+            for (const TerrainPatch &patch : resident.patches)
+            {
+                residentTiles.insert(patch.tile);
+            }
+            ok = ok && frame < 5000u && streamedTiles == residentTiles && streamer.getStats().failedTiles == 0u;
+            report(ok, "streaming settles on the all resident selection");
+            report(samplesMatch && uploads.size() > getTerrainTileCount(2u), "streamed tiles hold the samples of the file");
+        }
+
+        // A cache much smaller than the terrain, teleporting around, never loses a tile being drawn
+        {
+            TerrainTileCache cache(tiles.getTileCount(), 24u);
+            TerrainStreamer::Settings settings;
+            TerrainStreamer streamer(reader, terrain.path, tiles, cache, settings);
+            std::vector<TerrainTileUpload> uploads;
+            bool ok = streamer.loadPinnedLevels(2u, uploads);
+
+            TerrainSelection selection;
+            Vec3 eye = randomEye();
+            for (uint64_t frame = 1u; frame <= 400u; ++frame)
+            {
+                if (frame % 20u == 0u)
+                {
+                    eye = randomEye();
+                }
+                const Frustum frustum = makeFrustum(eye, eye + Vec3{ 1.0f, -0.5f, 0.2f }, worldSize * 2.0f);
+                quadtree.select(eye, frustum, cache, frame, selection);
+                uploads.clear();
+                streamer.update(frame, selection.requests, uploads);
+                for (const TerrainPatch &patch : selection.patches)
+                {
+                    ok = ok && cache.getTile(patch.slot) == patch.tile;
+                }
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+            ok = ok && cache.getStats().evictions > 0u && streamer.getStats().failedTiles == 0u;
+            report(ok, "a small cache never gives up a tile drawn in the frame");
+        }
+
+        // Reads left unwanted are cancelled, or land, and each one is counted once
+        {
+            AsyncFileReader::Settings readerSettings;
+            readerSettings.queueDepth = 1u;
+            AsyncFileReader slowReader(readerSettings);
+
+            TerrainTileCache cache(tiles.getTileCount(), tiles.getTileCount());
+            TerrainStreamer::Settings settings;
+            settings.maxRequestsInFlight = 128u;
+            settings.maxUploadsPerFrame = 1024u;
+            settings.cancelAfterFrames = 2u;
+            TerrainStreamer streamer(slowReader, terrain.path, tiles, cache, settings);
+
+            std::vector<TerrainTileRequest> requests;
+            for (uint32_t tile = getTerrainTileCount(lastLevel); tile < getTerrainTileCount(lastLevel) + 128u; ++tile)
+            {
+                requests.push_back(TerrainTileRequest{ tile, 1.0f });
+            }
+            std::vector<TerrainTileUpload> uploads;
+            streamer.update(1u, requests, uploads);
+            const std::vector<TerrainTileRequest> none;
+            for (uint64_t frame = 10u; frame < 5000u && streamer.getRequestsInFlight() != 0u; ++frame)
+            {
+                streamer.update(frame, none, uploads);
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+            const TerrainStreamer::Stats &stats = streamer.getStats();
+            report(streamer.getRequestsInFlight() == 0u && stats.requestedTiles == 128u &&
+                stats.loadedTiles + stats.cancelledTiles + stats.droppedTiles + stats.failedTiles == 128u && uploads.size() == stats.loadedTiles,
+                "stale reads cancelled or landed, counted once (" + std::to_string(stats.cancelledTiles) + " cancelled)");
+
+            // Destroying the streamer right after submitting must wait for the callbacks
+            {
+                TerrainTileCache otherCache(tiles.getTileCount(), tiles.getTileCount());
+                TerrainStreamer other(slowReader, terrain.path, tiles, otherCache, settings);
+                other.update(1u, requests, uploads);
+            }
+            report(true, "the streamer can be destroyed with reads in flight");
+        }
+
+        std::cout << "\n";
+        return passed;
+    }
+
+    struct CameraPath
+    {
+        const char *name;
+        std::function<void(float t, uint32_t frame, Vec3 &eye, Vec3 &target)> place;
+    };
+
+    void benchmark(const Options &options, const fs::path &directory)
+    {
+        TestTerrain terrain;
+        if (!makeTerrain(65u, options.levels, 8192.0f, 800.0f, options.seed, directory / "bench.dtrn", terrain))
+        {
+            return;
+        }
+        const TerrainTileSet &tiles = terrain.tiles;
+        const float worldSize = tiles.getHeader().worldSize;
+        const float center = worldSize * 0.5f;
+        auto ground = [&terrain](float x, float z) { return getGroundHeight(terrain, x, z); };
+
+        std::cout << "Terrain: " << terrain.size << " x " << terrain.size << " samples, " << tiles.getLevelCount() << " levels of "
+                  << tiles.getTileSamples() << " x " << tiles.getTileSamples() << " tiles (" << tiles.getTileCount() << "), "
+                  << std::fixed << std::setprecision(1) << terrain.file.size() / 1048576.0 << " MB on disk\n"
+                  << "Cache: " << options.slots << " slots, " << options.frames << " frames per path at " << options.frameMs << " ms, "
+                  << ThresholdPixels << " px threshold at " << static_cast<uint32_t>(ViewportHeight) << "p\n\n";
+
+        std::mt19937 random(options.seed);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        std::vector<Vec3> jumps(options.frames / 60u + 1u);
+        for (Vec3 &jump : jumps)
+        {
+            jump = Vec3{ (0.1f + unit(random) * 0.8f) * worldSize, 0.0f, (0.1f + unit(random) * 0.8f) * worldSize };
+        }
+
+        const CameraPath paths[] =
+        {
+            { "low flyover", [&](float t, uint32_t, Vec3 &eye, Vec3 &target)
+                {
+                    const float x = worldSize * (0.05f + 0.9f * t);
+                    const float z = worldSize * (0.1f + 0.8f * t);
+                    eye = Vec3{ x, ground(x, z) + 30.0f, z };
+                    target = eye + Vec3{ 1.0f, -0.15f, 0.9f };
+                } },
+            { "orbit", [&](float t, uint32_t, Vec3 &eye, Vec3 &target)
+                {
+                    const float angle = t * 6.2831853f;
+                    const float x = center + std::cos(angle) * worldSize * 0.3f;
+                    const float z = center + std::sin(angle) * worldSize * 0.3f;
+                    eye = Vec3{ x, ground(x, z) + 250.0f, z };
+                    target = Vec3{ center, ground(center, center), center };
+                } },
+            { "descent", [&](float t, uint32_t, Vec3 &eye, Vec3 &target)
+                {
+                    const float x = center + worldSize * 0.2f * t;
+                    const float altitude = 4000.0f * (1.0f - t) * (1.0f - t) + 10.0f;
+                    eye = Vec3{ x, ground(x, center) + altitude, center };
+                    target = eye + Vec3{ 1.0f, -1.5f, 0.3f };
+                } },
+            { "teleport", [&](float, uint32_t frame, Vec3 &eye, Vec3 &target)
+                {
+                    const Vec3 &jump = jumps[frame / 60u];
+                    const float x = jump.x + (frame % 60u) * 4.0f;
+                    eye = Vec3{ x, ground(x, jump.z) + 40.0f, jump.z };
+                    target = eye + Vec3{ 1.0f, -0.3f, 0.5f };
+                } }
+        };
+
+        std::cout << std::left << std::setw(14) << "Path" << std::right << std::setw(14) << "Tris/frame" << std::setw(12) << "Max tris"
+                  << std::setw(10) << "Patches" << std::setw(10) << "Hit rate" << std::setw(9) << "Loaded" << std::setw(11) << "Cancelled"
+                  << std::setw(9) << "Dropped" << std::setw(8) << "Max IO" << std::setw(9) << "MB read" << std::setw(12) << "Select us" << std::setw(14) << "Max select us" << "\n";
+
+        AsyncFileReader reader;
+        for (const CameraPath &path : paths)
+        {
+            TerrainTileCache cache(tiles.getTileCount(), options.slots);
+            TerrainQuadtree quadtree(tiles);
+            quadtree.setProjection(FieldOfView, ViewportHeight, ThresholdPixels, NearDistance);
+            TerrainStreamer streamer(reader, terrain.path, tiles, cache, TerrainStreamer::Settings());
+
+            std::vector<TerrainTileUpload> uploads;
+            if (!streamer.loadPinnedLevels(3u, uploads))
+            {
+                std::cout << path.name << ": pinned levels failed to load\n";
+                continue;
+            }
+            cache.resetStats();
+
+            TerrainSelection selection;
+            uint64_t triangles = 0u;
+            uint64_t maxTriangles = 0u;
+            uint64_t patches = 0u;
+            double selectSeconds = 0.0;
+            double maxSelectSeconds = 0.0;
+            for (uint32_t frame = 0u; frame < options.frames; ++frame)
+            {
+                const Clock::time_point frameStart = Clock::now();
+
+                Vec3 eye;
+                Vec3 target;
+                path.place(static_cast<float>(frame) / static_cast<float>(options.frames), frame, eye, target);
+                const Frustum frustum = makeFrustum(eye, target, worldSize * 1.5f);
+
+                const Clock::time_point selectStart = Clock::now();
+                quadtree.select(eye, frustum, cache, frame + 1u, selection);
+                const double seconds = std::chrono::duration<double>(Clock::now() - selectStart).count();
+                selectSeconds += seconds;
+                maxSelectSeconds = (std::max)(maxSelectSeconds, seconds);
+
+                uploads.clear();
+                streamer.update(frame + 1u, selection.requests, uploads);
+
+                triangles += selection.triangles;
+                maxTriangles = (std::max)(maxTriangles, selection.triangles);
+                patches += selection.patches.size();
+                std::this_thread::sleep_until(frameStart + std::chrono::milliseconds(options.frameMs));
+            }
+
+            const TerrainTileCache::Stats &cacheStats = cache.getStats();
+            const TerrainStreamer::Stats &streamStats = streamer.getStats();
+            const double frames = static_cast<double>(options.frames);
+            std::cout << std::left << std::setw(14) << path.name << std::right << std::fixed << std::setprecision(0)
+                      << std::setw(14) << triangles / frames << std::setw(12) << maxTriangles << std::setw(10) << patches / frames
+                      << std::setprecision(1) << std::setw(9) << 100.0 * cacheStats.hits / (std::max)(cacheStats.lookups, static_cast<uint64_t>(1u)) << "%"
+                      << std::setw(9) << streamStats.loadedTiles << std::setw(11) << streamStats.cancelledTiles
+                      << std::setw(9) << streamStats.droppedTiles << std::setw(8) << streamStats.maxInFlight
+                      << std::setw(9) << streamStats.bytesRead / 1048576.0 << std::setprecision(2)
+                      << std::setw(12) << selectSeconds * 1e6 / frames << std::setw(14) << maxSelectSeconds * 1e6 << "\n";
+        }
+        std::cout << "\nReader backend: " << reader.getBackendName() << ", reads come from the page cache after cooking" << std::endl;
+    }
+
+    int cookFile(const Options &options)
+    {
+        std::ifstream input(options.inputPath, std::ios::binary);
+        std::vector<uint16_t> heights(static_cast<size_t>(options.size) * options.size);
+        if (!input.read(reinterpret_cast<char *>(heights.data()), static_cast<std::streamsize>(heights.size() * sizeof(uint16_t))))
+        {
+            std::cerr << "Cannot read " << options.size << " x " << options.size << " 16 bit samples from " << options.inputPath << std::endl;
+            return 1;
+        }
+
+        std::vector<uint8_t> file;
+        std::string error;
+        if (!cookTerrain(heights.data(), options.size, options.tileSamples, options.worldSize, options.heightScale, file, error))
+        {
+            std::cerr << options.inputPath << ": " << error << std::endl;
+            return 1;
+        }
+
+        std::ofstream output(options.outputPath, std::ios::binary);
+        output.write(reinterpret_cast<const char *>(file.data()), static_cast<std::streamsize>(file.size()));
+        if (!output)
+        {
+            std::cerr << "Cannot write " << options.outputPath << std::endl;
+            return 1;
+        }
+
+        TerrainTileHeader header;
+        memcpy(&header, file.data(), sizeof(header));
+        std::cout << options.outputPath << ": " << header.levelCount << " levels, " << header.tileCount << " tiles, "
+                  << file.size() << " bytes" << std::endl;
+        return 0;
+    }
+
+    bool parseArguments(int argc, char **argv, Options &options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string argument = argv[i];
+            const bool hasValue = i + 1 < argc;
+
+            if (argument == "--in" && hasValue)
+            {
+                options.inputPath = argv[++i];
+            }
+            else if (argument == "--out" && hasValue)
+            {
+                options.outputPath = argv[++i];
+            }
+            else if (argument == "--size" && hasValue)
+            {
+                options.size = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (argument == "--tile" && hasValue)
+            {
+                options.tileSamples = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (argument == "--world" && hasValue)
+            {
+                options.worldSize = std::stof(argv[++i]);
+            }
+            else if (argument == "--height" && hasValue)
+            {
+                options.heightScale = std::stof(argv[++i]);
+            }
+            else if (argument == "--levels" && hasValue)
+            {
+                options.levels = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (argument == "--frames" && hasValue)
+            {
+                options.frames = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (argument == "--frame-ms" && hasValue)
+            {
+                options.frameMs = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (argument == "--slots" && hasValue)
+            {
+                options.slots = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (argument == "--seed" && hasValue)
+            {
+                options.seed = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (argument == "--dir" && hasValue)
+            {
+                options.directory = argv[++i];
+            }
+            else
+            {
+                return false;
+            }
+        }
+        if (!options.inputPath.empty() || !options.outputPath.empty())
+        {
+            return !options.inputPath.empty() && !options.outputPath.empty() && options.size > 0u;
+        }
+        return options.levels >= 4u && options.levels <= 8u && options.frames > 0u && options.slots > getTerrainTileCount(3u);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseArguments(argc, argv, options))
+    {
+        std::cerr << "Usage: TerrainBench [--levels <4-8>] [--frames <n>] [--frame-ms <n>] [--slots <n>] [--seed <n>] [--dir <path>]\n"
+                  << "       TerrainBench --in <heights.r16> --size <n> --out <terrain.dtrn> [--tile <samples>] [--world <size>] [--height <scale>]" << std::endl;
+        return 1;
+    }
+
+    if (!options.inputPath.empty())
+    {
+        return cookFile(options);
+    }
+
+    const fs::path directory = options.directory.empty() ? fs::temp_directory_path() / "TerrainBench" : options.directory;
+    std::error_code errorCode;
+    fs::create_directories(directory, errorCode);
+
+    const bool passed = check(directory);
+    benchmark(options, directory);
+    return passed ? 0 : 1;
+}
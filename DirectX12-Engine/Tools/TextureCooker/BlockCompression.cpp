@@ -0,0 +1,773 @@
+#include "BlockCompression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "WorkerPool.h"
+
+namespace
+{
+    // Least squares refinement passes after the initial principal axis fit
+    const int RefinementPasses = 2;
+
+    // Direction of greatest variance of the points by power iteration
+    template <int Dimensions>
+    void principalAxis(const float points[16][Dimensions], const float mean[Dimensions], float axis[Dimensions])
+    {
+        float covariance[Dimensions][Dimensions] = {};
+        for (int i = 0; i < 16; ++i)
+        {
+            for (int a = 0; a < Dimensions; ++a)
+            {
+                for (int b = a; b < Dimensions; ++b)
+                {
+                    covariance[a][b] += (points[i][a] - mean[a]) * (points[i][b] - mean[b]);
+                }
+            }
+        }
+        for (int a = 0; a < Dimensions; ++a)
+        {
+            for (int b = 0; b < a; ++b)
+            {
+                covariance[a][b] = covariance[b][a];
+            }
+        }
+
+        for (int a = 0; a < Dimensions; ++a)
+        {
+            axis[a] = 1.0f;
+        }
+
+        for (int iteration = 0; iteration < 8; ++iteration)
+        {
+            float next[Dimensions] = {};
+            float length = 0.0f;
+            for (int a = 0; a < Dimensions; ++a)
+            {
+                for (int b = 0; b < Dimensions; ++b)
+                {
+                    next[a] += covariance[a][b] * axis[b];
+                }
+                length += next[a] * next[a];
+            }
+
+            // A flat block has no dominant direction, any axis will do
+            if (length < 1e-12f)
+            {
+                return;
+            }
+
+            length = 1.0f / std::sqrt(length);
+            for (int a = 0; a < Dimensions; ++a)
+            {
+                axis[a] = next[a] * length;
+            }
+        }
+    }
+
+    // Fit the two ends of the principal axis through the points
+    template <int Dimensions>
+    void fitEndpoints(const float points[16][Dimensions], float endpoint0[Dimensions], float endpoint1[Dimensions])
+    {
+        float mean[Dimensions] = {};
+        for (int i = 0; i < 16; ++i)
+        {
+            for (int a = 0; a < Dimensions; ++a)
+            {
+                mean[a] += points[i][a] / 16.0f;
+            }
+        }
+
+        float axis[Dimensions];
+        principalAxis<Dimensions>(points, mean, axis);
+
+        float minT = 0.0f;
+        float maxT = 0.0f;
+        for (int i = 0; i < 16; ++i)
+        {
+            float t = 0.0f;
+            for (int a = 0; a < Dimensions; ++a)
+            {
+                t += (points[i][a] - mean[a]) * axis[a];
+            }
+            minT = std::min(minT, t);
+            maxT = std::max(maxT, t);
+        }
+
+        for (int a = 0; a < Dimensions; ++a)
+        {
+            endpoint0[a] = mean[a] + axis[a] * maxT;
+            endpoint1[a] = mean[a] + axis[a] * minT;
+        }
+    }
+
+    // Solve for the endpoints that best reproduce the points given how much of endpoint0 each index uses
+    template <int Dimensions>
+    bool solveEndpoints(const float points[16][Dimensions], const float weights0[16], float endpoint0[Dimensions], float endpoint1[Dimensions])
+    {
+        float aa = 0.0f;
+        float ab = 0.0f;
+        float bb = 0.0f;
+        float ax[Dimensions] = {};
+        float bx[Dimensions] = {};
+        for (int i = 0; i < 16; ++i)
+        {
+            const float a = weights0[i];
+            const float b = 1.0f - a;
+            aa += a * a;
+            ab += a * b;
+            bb += b * b;
+            for (int c = 0; c < Dimensions; ++c)
+            {
+                ax[c] += a * points[i][c];
+                bx[c] += b * points[i][c];
+            }
+        }
+
+        const float determinant = aa * bb - ab * ab;
+        if (std::fabs(determinant) < 1e-6f)
+        {
+            return false;
+        }
+
+        const float inverse = 1.0f / determinant;
+        for (int c = 0; c < Dimensions; ++c)
+        {
+            endpoint0[c] = std::clamp((ax[c] * bb - bx[c] * ab) * inverse, 0.0f, 255.0f);
+            endpoint1[c] = std::clamp((bx[c] * aa - ax[c] * ab) * inverse, 0.0f, 255.0f);
+        }
+        return true;
+    }
+
+    // BC1 colour
+
+    uint16_t quantize565(const float color[3])
+    {
+        const uint32_t r = static_cast<uint32_t>(std::clamp(color[0] * 31.0f / 255.0f + 0.5f, 0.0f, 31.0f));
+        const uint32_t g = static_cast<uint32_t>(std::clamp(color[1] * 63.0f / 255.0f + 0.5f, 0.0f, 63.0f));
+        const uint32_t b = static_cast<uint32_t>(std::clamp(color[2] * 31.0f / 255.0f + 0.5f, 0.0f, 31.0f));
+        return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+    }
+
+    void expand565(uint16_t packed, int color[3])
+    {
+        const int r = (packed >> 11) & 31;
+        const int g = (packed >> 5) & 63;
+        const int b = packed & 31;
+        color[0] = (r << 3) | (r >> 2);
+        color[1] = (g << 2) | (g >> 4);
+        color[2] = (b << 3) | (b >> 2);
+    }
+
+    void colorPalette(uint16_t color0, uint16_t color1, bool allowThreeColor, int palette[4][4])
+    {
+        expand565(color0, palette[0]);
+        expand565(color1, palette[1]);
+        palette[0][3] = 255;
+        palette[1][3] = 255;
+
+        if (color0 > color1 || !allowThreeColor)
+        {
+            for (int c = 0; c < 3; ++c)
+            {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+            palette[2][3] = 255;
+            palette[3][3] = 255;
+        }
+        else
+        {
+            for (int c = 0; c < 3; ++c)
+            {
+                palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+                palette[3][c] = 0;
+            }
+            palette[2][3] = 255;
+            palette[3][3] = 0;
+        }
+    }
+
+    void encodeColorBlock(const uint8_t texels[64], uint8_t *block)
+    {
+        float points[16][3];
+        for (int i = 0; i < 16; ++i)
+        {
+            points[i][0] = texels[i * 4 + 0];
+            points[i][1] = texels[i * 4 + 1];
+            points[i][2] = texels[i * 4 + 2];
+        }
+
+        float endpoint0[3];
+        float endpoint1[3];
+        fitEndpoints<3>(points, endpoint0, endpoint1);
+
+        // Palette entry i takes this much of color0
+        static const float Weights0[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+
+        uint16_t bestColor0 = 0u;
+        uint16_t bestColor1 = 0u;
+        uint8_t bestIndices[16] = {};
+        int bestError = INT32_MAX;
+
+        for (int pass = 0; pass <= RefinementPasses; ++pass)
+        {
+            const uint16_t color0 = quantize565(endpoint0);
+            const uint16_t color1 = quantize565(endpoint1);
+
+            int palette[4][4];
+            colorPalette(std::max(color0, color1), std::min(color0, color1), false, palette);
+            const bool swapped = color0 < color1;
+
+            uint8_t indices[16];
+            float weights0[16];
+            int error = 0;
+            for (int i = 0; i < 16; ++i)
+            {
+                int bestDistance = INT32_MAX;
+                for (int p = 0; p < 4; ++p)
+                {
+                    const int dr = palette[p][0] - texels[i * 4 + 0];
+                    const int dg = palette[p][1] - texels[i * 4 + 1];
+                    const int db = palette[p][2] - texels[i * 4 + 2];
+                    const int distance = dr * dr + dg * dg + db * db;
+                    if (distance < bestDistance)
+                    {
+                        bestDistance = distance;
+                        indices[i] = static_cast<uint8_t>(p);
+                    }
+                }
+                error += bestDistance;
+
+                // The palette was built from the larger colour first, undo that for the solve
+                weights0[i] = swapped ? 1.0f - Weights0[indices[i]] : Weights0[indices[i]];
+            }
+
+            if (error < bestError)
+            {
+                bestError = error;
+                bestColor0 = std::max(color0, color1);
+                bestColor1 = std::min(color0, color1);
+                std::copy(indices, indices + 16, bestIndices);
+            }
+
+            if (error == 0 || !solveEndpoints<3>(points, weights0, endpoint0, endpoint1))
+            {
+                break;
+            }
+        }
+
+        // color0 > color1 selects four colour mode, equal endpoints mean every index can be zero
+        if (bestColor0 == bestColor1)
+        {
+            std::fill(bestIndices, bestIndices + 16, static_cast<uint8_t>(0u));
+        }
+
+        uint32_t indexBits = 0u;
+        for (int i = 0; i < 16; ++i)
+        {
+            indexBits |= static_cast<uint32_t>(bestIndices[i]) << (2 * i);
+        }
+
+        block[0] = static_cast<uint8_t>(bestColor0 & 0xFF);
+        block[1] = static_cast<uint8_t>(bestColor0 >> 8);
+        block[2] = static_cast<uint8_t>(bestColor1 & 0xFF);
+        block[3] = static_cast<uint8_t>(bestColor1 >> 8);
+        std::memcpy(block + 4, &indexBits, 4);
+    }
+
+    void decodeColorBlock(const uint8_t *block, bool allowThreeColor, uint8_t texels[64])
+    {
+        const uint16_t color0 = static_cast<uint16_t>(block[0] | (block[1] << 8));
+        const uint16_t color1 = static_cast<uint16_t>(block[2] | (block[3] << 8));
+        uint32_t indexBits;
+        std::memcpy(&indexBits, block + 4, 4);
+
+        int palette[4][4];
+        colorPalette(color0, color1, allowThreeColor, palette);
+
+        for (int i = 0; i < 16; ++i)
+        {
+            const int index = (indexBits >> (2 * i)) & 3;
+            texels[i * 4 + 0] = static_cast<uint8_t>(palette[index][0]);
+            texels[i * 4 + 1] = static_cast<uint8_t>(palette[index][1]);
+            texels[i * 4 + 2] = static_cast<uint8_t>(palette[index][2]);
+            texels[i * 4 + 3] = static_cast<uint8_t>(palette[index][3]);
+        }
+    }
+
+    // BC4 single channel, also used for BC3 alpha and both BC5 channels
+
+    void singleChannelPalette(int value0, int value1, int palette[8])
+    {
+        palette[0] = value0;
+        palette[1] = value1;
+        if (value0 > value1)
+        {
+            for (int i = 1; i < 7; ++i)
+            {
+                palette[i + 1] = ((7 - i) * value0 + i * value1 + 3) / 7;
+            }
+        }
+        else
+        {
+            for (int i = 1; i < 5; ++i)
+            {
+                palette[i + 1] = ((5 - i) * value0 + i * value1 + 2) / 5;
+            }
+            palette[6] = 0;
+            palette[7] = 255;
+        }
+    }
+
+    int singleChannelError(const uint8_t values[16], int value0, int value1, uint8_t indices[16])
+    {
+        int palette[8];
+        singleChannelPalette(value0, value1, palette);
+
+        int error = 0;
+        for (int i = 0; i < 16; ++i)
+        {
+            int bestDistance = INT32_MAX;
+            for (int p = 0; p < 8; ++p)
+            {
+                const int distance = (palette[p] - values[i]) * (palette[p] - values[i]);
+                if (distance < bestDistance)
+                {
+                    bestDistance = distance;
+                    indices[i] = static_cast<uint8_t>(p);
+                }
+            }
+            error += bestDistance;
+        }
+        return error;
+    }
+
+    void encodeSingleChannelBlock(const uint8_t values[16], uint8_t *block)
+    {
+        int minValue = 255;
+        int maxValue = 0;
+        int innerMin = 255;
+        int innerMax = 0;
+        for (int i = 0; i < 16; ++i)
+        {
+            minValue = std::min(minValue, static_cast<int>(values[i]));
+            maxValue = std::max(maxValue, static_cast<int>(values[i]));
+            if (values[i] != 0 && values[i] != 255)
+            {
+                innerMin = std::min(innerMin, static_cast<int>(values[i]));
+                innerMax = std::max(innerMax, static_cast<int>(values[i]));
+            }
+        }
+
+        int bestValue0 = maxValue;
+        int bestValue1 = minValue;
+        uint8_t bestIndices[16];
+        int bestError = singleChannelError(values, bestValue0, bestValue1, bestIndices);
+
+        // Eight value mode, pulling the ends in slightly often lands the interpolated values closer
+        for (int inset0 = 0; inset0 < 3 && bestError > 0; ++inset0)
+        {
+            for (int inset1 = 0; inset1 < 3; ++inset1)
+            {
+                const int value0 = maxValue - inset0;
+                const int value1 = minValue + inset1;
+                if (value0 <= value1)
+                {
+                    continue;
+                }
+
+                uint8_t indices[16];
+                const int error = singleChannelError(values, value0, value1, indices);
+                if (error < bestError)
+                {
+                    bestError = error;
+                    bestValue0 = value0;
+                    bestValue1 = value1;
+                    std::copy(indices, indices + 16, bestIndices);
+                }
+            }
+        }
+
+        // Six value mode has exact 0 and 255 so it wins when the block contains them
+        if (bestError > 0 && innerMin <= innerMax)
+        {
+            uint8_t indices[16];
+            const int error = singleChannelError(values, innerMin, innerMax, indices);
+            if (error < bestError)
+            {
+                bestError = error;
+                bestValue0 = innerMin;
+                bestValue1 = innerMax;
+                std::copy(indices, indices + 16, bestIndices);
+            }
+        }
+
+        uint64_t indexBits = 0u;
+        for (int i = 0; i < 16; ++i)
+        {
+            indexBits |= static_cast<uint64_t>(bestIndices[i]) << (3 * i);
+        }
+
+        block[0] = static_cast<uint8_t>(bestValue0);
+        block[1] = static_cast<uint8_t>(bestValue1);
+        for (int i = 0; i < 6; ++i)
+        {
+            block[2 + i] = static_cast<uint8_t>(indexBits >> (8 * i));
+        }
+    }
+
+    void decodeSingleChannelBlock(const uint8_t *block, uint8_t *texels, int channel)
+    {
+        int palette[8];
+        singleChannelPalette(block[0], block[1], palette);
+
+        uint64_t indexBits = 0u;
+        for (int i = 0; i < 6; ++i)
+        {
+            indexBits |= static_cast<uint64_t>(block[2 + i]) << (8 * i);
+        }
+
+        for (int i = 0; i < 16; ++i)
+        {
+            texels[i * 4 + channel] = static_cast<uint8_t>(palette[(indexBits >> (3 * i)) & 7]);
+        }
+    }
+
+    void encodeChannel(const uint8_t texels[64], int channel, uint8_t *block)
+    {
+        uint8_t values[16];
+        for (int i = 0; i < 16; ++i)
+        {
+            values[i] = texels[i * 4 + channel];
+        }
+        encodeSingleChannelBlock(values, block);
+    }
+
+    // BC7 mode 6
+
+    const int Bc7Weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    void writeBits(uint8_t *block, uint32_t &position, uint32_t value, uint32_t count)
+    {
+        for (uint32_t i = 0u; i < count; ++i, ++position)
+        {
+            if ((value >> i) & 1u)
+            {
+                block[position >> 3] |= static_cast<uint8_t>(1u << (position & 7u));
+            }
+        }
+    }
+
+    uint32_t readBits(const uint8_t *block, uint32_t &position, uint32_t count)
+    {
+        uint32_t value = 0u;
+        for (uint32_t i = 0u; i < count; ++i, ++position)
+        {
+            value |= static_cast<uint32_t>((block[position >> 3] >> (position & 7u)) & 1u) << i;
+        }
+        return value;
+    }
+
+    // Mode 6 endpoints are 7 bits per channel plus a parity bit shared by the channels of that endpoint
+    void quantizeBc7Endpoint(const float endpoint[4], uint32_t quantized[4], uint32_t &parity)
+    {
+        float bestError = 0.0f;
+        for (uint32_t p = 0u; p < 2u; ++p)
+        {
+            uint32_t candidate[4];
+            float error = 0.0f;
+            for (int c = 0; c < 4; ++c)
+            {
+                candidate[c] = static_cast<uint32_t>(std::clamp((endpoint[c] - p) / 2.0f + 0.5f, 0.0f, 127.0f));
+                const float difference = static_cast<float>((candidate[c] << 1) | p) - endpoint[c];
+                error += difference * difference;
+            }
+
+            if (p == 0u || error < bestError)
+            {
+                bestError = error;
+                parity = p;
+                std::copy(candidate, candidate + 4, quantized);
+            }
+        }
+    }
+
+    void bc7Palette(const uint32_t quantized0[4], uint32_t parity0, const uint32_t quantized1[4], uint32_t parity1, int palette[16][4])
+    {
+        for (int c = 0; c < 4; ++c)
+        {
+            const int value0 = static_cast<int>((quantized0[c] << 1) | parity0);
+            const int value1 = static_cast<int>((quantized1[c] << 1) | parity1);
+            for (int i = 0; i < 16; ++i)
+            {
+                palette[i][c] = ((64 - Bc7Weights4[i]) * value0 + Bc7Weights4[i] * value1 + 32) >> 6;
+            }
+        }
+    }
+
+    void encodeBc7Block(const uint8_t texels[64], uint8_t *block)
+    {
+        float points[16][4];
+        for (int i = 0; i < 16; ++i)
+        {
+            for (int c = 0; c < 4; ++c)
+            {
+                points[i][c] = texels[i * 4 + c];
+            }
+        }
+
+        float endpoint0[4];
+        float endpoint1[4];
+        fitEndpoints<4>(points, endpoint0, endpoint1);
+
+        uint32_t best0[4] = {};
+        uint32_t best1[4] = {};
+        uint32_t bestParity0 = 0u;
+        uint32_t bestParity1 = 0u;
+        uint8_t bestIndices[16] = {};
+        int bestError = INT32_MAX;
+
+        for (int pass = 0; pass <= RefinementPasses; ++pass)
+        {
+            uint32_t quantized0[4];
+            uint32_t quantized1[4];
+            uint32_t parity0;
+            uint32_t parity1;
+            quantizeBc7Endpoint(endpoint0, quantized0, parity0);
+            quantizeBc7Endpoint(endpoint1, quantized1, parity1);
+
+            int palette[16][4];
+            bc7Palette(quantized0, parity0, quantized1, parity1, palette);
+
+            uint8_t indices[16];
+            float weights0[16];
+            int error = 0;
+            for (int i = 0; i < 16; ++i)
+            {
+                int bestDistance = INT32_MAX;
+                for (int p = 0; p < 16; ++p)
+                {
+                    int distance = 0;
+                    for (int c = 0; c < 4; ++c)
+                    {
+                        const int difference = palette[p][c] - texels[i * 4 + c];
+                        distance += difference * difference;
+                    }
+                    if (distance < bestDistance)
+                    {
+                        bestDistance = distance;
+                        indices[i] = static_cast<uint8_t>(p);
+                    }
+                }
+                error += bestDistance;
+                weights0[i] = 1.0f - Bc7Weights4[indices[i]] / 64.0f;
+            }
+
+            if (error < bestError)
+            {
+                bestError = error;
+                std::copy(quantized0, quantized0 + 4, best0);
+                std::copy(quantized1, quantized1 + 4, best1);
+                bestParity0 = parity0;
+                bestParity1 = parity1;
+                std::copy(indices, indices + 16, bestIndices);
+            }
+
+            if (error == 0 || !solveEndpoints<4>(points, weights0, endpoint0, endpoint1))
+            {
+                break;
+            }
+        }
+
+        // The first index is stored with its top bit implied zero, swap the endpoints if it is set
+        if (bestIndices[0] & 8u)
+        {
+            std::swap(best0, best1);
+            std::swap(bestParity0, bestParity1);
+            for (int i = 0; i < 16; ++i)
+            {
+                bestIndices[i] = static_cast<uint8_t>(15u - bestIndices[i]);
+            }
+        }
+
+        std::memset(block, 0, 16);
+        uint32_t position = 0u;
+        writeBits(block, position, 1u << 6, 7u);
+        for (int c = 0; c < 4; ++c)
+        {
+            writeBits(block, position, best0[c], 7u);
+            writeBits(block, position, best1[c], 7u);
+        }
+        writeBits(block, position, bestParity0, 1u);
+        writeBits(block, position, bestParity1, 1u);
+        writeBits(block, position, bestIndices[0], 3u);
+        for (int i = 1; i < 16; ++i)
+        {
+            writeBits(block, position, bestIndices[i], 4u);
+        }
+    }
+
+    void decodeBc7Block(const uint8_t *block, uint8_t texels[64])
+    {
+        // Only mode 6 is written by the encoder
+        if ((block[0] & 0x7Fu) != (1u << 6))
+        {
+            std::memset(texels, 0, 64);
+            return;
+        }
+
+        uint32_t position = 7u;
+        uint32_t quantized0[4];
+        uint32_t quantized1[4];
+        for (int c = 0; c < 4; ++c)
+        {
+            quantized0[c] = readBits(block, position, 7u);
+            quantized1[c] = readBits(block, position, 7u);
+        }
+        const uint32_t parity0 = readBits(block, position, 1u);
+        const uint32_t parity1 = readBits(block, position, 1u);
+
+        int palette[16][4];
+        bc7Palette(quantized0, parity0, quantized1, parity1, palette);
+
+        for (int i = 0; i < 16; ++i)
+        {
+            const uint32_t index = readBits(block, position, i == 0 ? 3u : 4u);
+            for (int c = 0; c < 4; ++c)
+            {
+                texels[i * 4 + c] = static_cast<uint8_t>(palette[index][c]);
+            }
+        }
+    }
+}
+
+uint32_t getBlockSize(BlockFormat format)
+{
+    return format == BlockFormat::BC1 || format == BlockFormat::BC4 ? 8u : 16u;
+}
+
+uint32_t getChannelMask(BlockFormat format)
+{
+    switch (format)
+    {
+    case BlockFormat::BC1:
+        return 0x7u;
+    case BlockFormat::BC4:
+        return 0x1u;
+    case BlockFormat::BC5:
+        return 0x3u;
+    default:
+        return 0xFu;
+    }
+}
+
+void encodeBlock(BlockFormat format, const uint8_t texels[64], uint8_t *block)
+{
+    switch (format)
+    {
+    case BlockFormat::BC1:
+        encodeColorBlock(texels, block);
+        break;
+    case BlockFormat::BC3:
+        encodeChannel(texels, 3, block);
+        encodeColorBlock(texels, block + 8);
+        break;
+    case BlockFormat::BC4:
+        encodeChannel(texels, 0, block);
+        break;
+    case BlockFormat::BC5:
+        encodeChannel(texels, 0, block);
+        encodeChannel(texels, 1, block + 8);
+        break;
+    case BlockFormat::BC7:
+        encodeBc7Block(texels, block);
+        break;
+    }
+}
+
+void decodeBlock(BlockFormat format, const uint8_t *block, uint8_t texels[64])
+{
+    // Channels the format does not store decode as zero, alpha as opaque
+    for (int i = 0; i < 16; ++i)
+    {
+        texels[i * 4 + 0] = 0u;
+        texels[i * 4 + 1] = 0u;
+        texels[i * 4 + 2] = 0u;
+        texels[i * 4 + 3] = 255u;
+    }
+
+    switch (format)
+    {
+    case BlockFormat::BC1:
+        decodeColorBlock(block, true, texels);
+        break;
+    case BlockFormat::BC3:
+        decodeColorBlock(block + 8, false, texels);
+        decodeSingleChannelBlock(block, texels, 3);
+        break;
+    case BlockFormat::BC4:
+        decodeSingleChannelBlock(block, texels, 0);
+        break;
+    case BlockFormat::BC5:
+        decodeSingleChannelBlock(block, texels, 0);
+        decodeSingleChannelBlock(block + 8, texels, 1);
+        break;
+    case BlockFormat::BC7:
+        decodeBc7Block(block, texels);
+        break;
+    }
+}
+
+void compressImage(BlockFormat format, const uint8_t *rgba, uint32_t width, uint32_t height, std::vector<uint8_t> &blocks, WorkerPool &workerPool)
+{
+    const uint32_t blocksX = (width + 3u) / 4u;
+    const uint32_t blocksY = (height + 3u) / 4u;
+    const uint32_t blockSize = getBlockSize(format);
+    blocks.resize(static_cast<size_t>(blocksX) * blocksY * blockSize);
+
+    workerPool.parallelFor(blocksY, [&](uint32_t blockY)
+    {
+        for (uint32_t blockX = 0u; blockX < blocksX; ++blockX)
+        {
+            uint8_t texels[64];
+            for (uint32_t y = 0u; y < 4u; ++y)
+            {
+                const uint32_t sourceY = std::min(blockY * 4u + y, height - 1u);
+                for (uint32_t x = 0u; x < 4u; ++x)
+                {
+                    const uint32_t sourceX = std::min(blockX * 4u + x, width - 1u);
+                    std::memcpy(&texels[(y * 4u + x) * 4u], &rgba[(static_cast<size_t>(sourceY) * width + sourceX) * 4u], 4u);
+                }
+            }
+
+            encodeBlock(format, texels, &blocks[(static_cast<size_t>(blockY) * blocksX + blockX) * blockSize]);
+        }
+    });
+}
+
+void decompressImage(BlockFormat format, const uint8_t *blocks, uint32_t width, uint32_t height, std::vector<uint8_t> &rgba)
+{
+    const uint32_t blocksX = (width + 3u) / 4u;
+    const uint32_t blocksY = (height + 3u) / 4u;
+    const uint32_t blockSize = getBlockSize(format);
+    rgba.resize(static_cast<size_t>(width) * height * 4u);
+
+    for (uint32_t blockY = 0u; blockY < blocksY; ++blockY)
+    {
+        for (uint32_t blockX = 0u; blockX < blocksX; ++blockX)
+        {
+            uint8_t texels[64];
+            decodeBlock(format, &blocks[(static_cast<size_t>(blockY) * blocksX + blockX) * blockSize], texels);
+
+            for (uint32_t y = 0u; y < 4u && blockY * 4u + y < height; ++y)
+            {
+                for (uint32_t x = 0u; x < 4u && blockX * 4u + x < width; ++x)
+                {
+                    std::memcpy(&rgba[((static_cast<size_t>(blockY) * 4u + y) * width + blockX * 4u + x) * 4u], &texels[(y * 4u + x) * 4u], 4u);
+                }
+            }
+        }
+    }
+}
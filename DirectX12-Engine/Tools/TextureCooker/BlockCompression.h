@@ -0,0 +1,33 @@
+#pragma once
+
+// BCn block encoders and decoders for the texture cooker.
+// Every format works on 4x4 blocks of RGBA8 texels. The encoders fit endpoints along the principal axis
+// of the block and then refine them with a least squares solve for the chosen indices. BC7 only emits
+// mode 6, a single subset with RGBA endpoints and 4 bit indices, which suits most colour content well.
+// The decoders exist to measure encoder quality and only need to understand what the encoders write.
+
+#include <cstdint>
+#include <vector>
+
+class WorkerPool;
+
+enum class BlockFormat
+{
+    BC1, // RGB
+    BC3, // RGBA, BC1 colour plus BC4 alpha
+    BC4, // R
+    BC5, // RG
+    BC7  // RGBA
+};
+
+uint32_t getBlockSize(BlockFormat format);
+
+// Channels the format stores, for error measurements
+uint32_t getChannelMask(BlockFormat format);
+
+void encodeBlock(BlockFormat format, const uint8_t texels[64], uint8_t *block);
+void decodeBlock(BlockFormat format, const uint8_t *block, uint8_t texels[64]);
+
+// Compress an RGBA8 image, edge blocks repeat the last row and column. Blocks are written row by row.
+void compressImage(BlockFormat format, const uint8_t *rgba, uint32_t width, uint32_t height, std::vector<uint8_t> &blocks, WorkerPool &workerPool);
+void decompressImage(BlockFormat format, const uint8_t *blocks, uint32_t width, uint32_t height, std::vector<uint8_t> &rgba);
@@ -0,0 +1,284 @@
+#include "MipGenerator.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "WorkerPool.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <xmmintrin.h>
+#define MIP_GENERATOR_SSE2
+#endif
+
+namespace
+{
+    // Radius of the Kaiser filter in destination texels and the shape of its window
+    const float KaiserRadius = 3.0f;
+    const float KaiserAlpha = 4.0f;
+    const float Pi = 3.14159265358979f;
+
+    // Rows are handed to the worker pool in chunks of this size
+    const uint32_t RowsPerJob = 16u;
+
+#if defined(MIP_GENERATOR_SSE2)
+    typedef __m128 Pixel;
+
+    inline Pixel loadPixel(const float *p) { return _mm_loadu_ps(p); }
+    inline void storePixel(float *p, Pixel value) { _mm_storeu_ps(p, value); }
+    inline Pixel zeroPixel() { return _mm_setzero_ps(); }
+    inline Pixel addPixel(Pixel a, Pixel b) { return _mm_add_ps(a, b); }
+    inline Pixel scalePixel(Pixel a, float s) { return _mm_mul_ps(a, _mm_set1_ps(s)); }
+    inline Pixel multiplyAddPixel(Pixel acc, Pixel a, float s) { return _mm_add_ps(acc, _mm_mul_ps(a, _mm_set1_ps(s))); }
+#else
+    struct Pixel
+    {
+        float v[4];
+    };
+
+    inline Pixel loadPixel(const float *p) { return Pixel{ { p[0], p[1], p[2], p[3] } }; }
+    inline void storePixel(float *p, Pixel value) { std::copy(value.v, value.v + 4, p); }
+    inline Pixel zeroPixel() { return Pixel{ { 0.0f, 0.0f, 0.0f, 0.0f } }; }
+    inline Pixel addPixel(Pixel a, Pixel b) { return Pixel{ { a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3] } }; }
+    inline Pixel scalePixel(Pixel a, float s) { return Pixel{ { a.v[0] * s, a.v[1] * s, a.v[2] * s, a.v[3] * s } }; }
+    inline Pixel multiplyAddPixel(Pixel acc, Pixel a, float s) { return addPixel(acc, scalePixel(a, s)); }
+#endif
+
+    float srgbToLinear(float value)
+    {
+        return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+    }
+
+    float linearToSrgb(float value)
+    {
+        return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+    }
+
+    // Zeroth order modified Bessel function of the first kind, used by the Kaiser window
+    float besselI0(float x)
+    {
+        float sum = 1.0f;
+        float term = 1.0f;
+        const float halfX = 0.5f * x;
+        for (int k = 1; k < 32; ++k)
+        {
+            term *= (halfX / k) * (halfX / k);
+            sum += term;
+            if (term < sum * 1e-8f)
+            {
+                break;
+            }
+        }
+        return sum;
+    }
+
+    float kaiserSinc(float x)
+    {
+        const float t = x / KaiserRadius;
+        if (t <= -1.0f || t >= 1.0f)
+        {
+            return 0.0f;
+        }
+
+        const float sinc = std::fabs(x) < 1e-5f ? 1.0f : std::sin(Pi * x) / (Pi * x);
+        return sinc * besselI0(KaiserAlpha * std::sqrt(1.0f - t * t)) / besselI0(KaiserAlpha);
+    }
+
+    // Source taps for every destination texel along one axis
+    struct FilterTaps
+    {
+        std::vector<uint32_t> first; // Index of the first tap of each destination texel, plus one past the end
+        std::vector<uint32_t> source;
+        std::vector<float> weight;
+    };
+
+    FilterTaps buildKaiserTaps(uint32_t sourceSize, uint32_t destinationSize)
+    {
+        FilterTaps taps;
+        const float scale = static_cast<float>(sourceSize) / static_cast<float>(destinationSize);
+        const float radius = KaiserRadius * scale;
+
+        for (uint32_t i = 0u; i < destinationSize; ++i)
+        {
+            taps.first.push_back(static_cast<uint32_t>(taps.source.size()));
+
+            const float center = (i + 0.5f) * scale;
+            const int begin = static_cast<int>(std::floor(center - radius));
+            const int end = static_cast<int>(std::ceil(center + radius));
+
+            float total = 0.0f;
+            const size_t firstTap = taps.weight.size();
+            for (int s = begin; s <= end; ++s)
+            {
+                const float weight = kaiserSinc((s + 0.5f - center) / scale);
+                if (weight == 0.0f)
+                {
+                    continue;
+                }
+
+                // Clamp to the edge
+                taps.source.push_back(static_cast<uint32_t>(std::clamp(s, 0, static_cast<int>(sourceSize) - 1)));
+                taps.weight.push_back(weight);
+                total += weight;
+            }
+
+            for (size_t t = firstTap; t < taps.weight.size(); ++t)
+            {
+                taps.weight[t] /= total;
+            }
+        }
+        taps.first.push_back(static_cast<uint32_t>(taps.source.size()));
+
+        return taps;
+    }
+
+    void forEachRowChunk(uint32_t rows, WorkerPool &workerPool, const std::function<void(uint32_t, uint32_t)> &func)
+    {
+        const uint32_t jobs = (rows + RowsPerJob - 1u) / RowsPerJob;
+        workerPool.parallelFor(jobs, [&](uint32_t job)
+        {
+            func(job * RowsPerJob, std::min(rows, (job + 1u) * RowsPerJob));
+        });
+    }
+
+    LinearImage downsampleBox(const LinearImage &source, WorkerPool &workerPool)
+    {
+        LinearImage destination;
+        destination.width = std::max(source.width / 2u, 1u);
+        destination.height = std::max(source.height / 2u, 1u);
+        destination.pixels.resize(static_cast<size_t>(destination.width) * destination.height * 4u);
+
+        forEachRowChunk(destination.height, workerPool, [&](uint32_t rowBegin, uint32_t rowEnd)
+        {
+            for (uint32_t y = rowBegin; y < rowEnd; ++y)
+            {
+                const float *row0 = &source.pixels[static_cast<size_t>(std::min(2u * y, source.height - 1u)) * source.width * 4u];
+                const float *row1 = &source.pixels[static_cast<size_t>(std::min(2u * y + 1u, source.height - 1u)) * source.width * 4u];
+                float *output = &destination.pixels[static_cast<size_t>(y) * destination.width * 4u];
+
+                for (uint32_t x = 0u; x < destination.width; ++x)
+                {
+                    const uint32_t x0 = std::min(2u * x, source.width - 1u) * 4u;
+                    const uint32_t x1 = std::min(2u * x + 1u, source.width - 1u) * 4u;
+
+                    Pixel sum = addPixel(loadPixel(row0 + x0), loadPixel(row0 + x1));
+                    sum = addPixel(sum, addPixel(loadPixel(row1 + x0), loadPixel(row1 + x1)));
+                    storePixel(output + x * 4u, scalePixel(sum, 0.25f));
+                }
+            }
+        });
+
+        return destination;
+    }
+
+    LinearImage downsampleKaiser(const LinearImage &source, WorkerPool &workerPool)
+    {
+        LinearImage destination;
+        destination.width = std::max(source.width / 2u, 1u);
+        destination.height = std::max(source.height / 2u, 1u);
+        destination.pixels.resize(static_cast<size_t>(destination.width) * destination.height * 4u);
+
+        const FilterTaps horizontal = buildKaiserTaps(source.width, destination.width);
+        const FilterTaps vertical = buildKaiserTaps(source.height, destination.height);
+
+        // Horizontal pass into an intermediate image with the destination width and source height
+        std::vector<float> intermediate(static_cast<size_t>(destination.width) * source.height * 4u);
+        forEachRowChunk(source.height, workerPool, [&](uint32_t rowBegin, uint32_t rowEnd)
+        {
+            for (uint32_t y = rowBegin; y < rowEnd; ++y)
+            {
+                const float *input = &source.pixels[static_cast<size_t>(y) * source.width * 4u];
+                float *output = &intermediate[static_cast<size_t>(y) * destination.width * 4u];
+
+                for (uint32_t x = 0u; x < destination.width; ++x)
+                {
+                    Pixel sum = zeroPixel();
+                    for (uint32_t t = horizontal.first[x]; t < horizontal.first[x + 1u]; ++t)
+                    {
+                        sum = multiplyAddPixel(sum, loadPixel(input + horizontal.source[t] * 4u), horizontal.weight[t]);
+                    }
+                    storePixel(output + x * 4u, sum);
+                }
+            }
+        });
+
+        // Vertical pass, whole rows at a time so the reads stay sequential
+        const size_t rowFloats = static_cast<size_t>(destination.width) * 4u;
+        forEachRowChunk(destination.height, workerPool, [&](uint32_t rowBegin, uint32_t rowEnd)
+        {
+            for (uint32_t y = rowBegin; y < rowEnd; ++y)
+            {
+                float *output = &destination.pixels[y * rowFloats];
+                std::fill(output, output + rowFloats, 0.0f);
+
+                for (uint32_t t = vertical.first[y]; t < vertical.first[y + 1u]; ++t)
+                {
+                    const float *input = &intermediate[vertical.source[t] * rowFloats];
+                    const float weight = vertical.weight[t];
+                    for (size_t i = 0u; i < rowFloats; i += 4u)
+                    {
+                        storePixel(output + i, multiplyAddPixel(loadPixel(output + i), loadPixel(input + i), weight));
+                    }
+                }
+            }
+        });
+
+        return destination;
+    }
+}
+
+LinearImage decodeRgba8(const uint8_t *rgba, uint32_t width, uint32_t height, bool srgb)
+{
+    float table[256];
+    for (uint32_t i = 0u; i < 256u; ++i)
+    {
+        const float value = i / 255.0f;
+        table[i] = srgb ? srgbToLinear(value) : value;
+    }
+
+    LinearImage image;
+    image.width = width;
+    image.height = height;
+    image.pixels.resize(static_cast<size_t>(width) * height * 4u);
+
+    for (size_t i = 0u; i < image.pixels.size(); i += 4u)
+    {
+        image.pixels[i + 0u] = table[rgba[i + 0u]];
+        image.pixels[i + 1u] = table[rgba[i + 1u]];
+        image.pixels[i + 2u] = table[rgba[i + 2u]];
+        image.pixels[i + 3u] = rgba[i + 3u] / 255.0f; // Alpha is always linear
+    }
+
+    return image;
+}
+
+void encodeRgba8(const LinearImage &image, bool srgb, std::vector<uint8_t> &rgba)
+{
+    rgba.resize(image.pixels.size());
+
+    for (size_t i = 0u; i < image.pixels.size(); ++i)
+    {
+        // The Kaiser filter can over and undershoot
+        float value = std::clamp(image.pixels[i], 0.0f, 1.0f);
+        if (srgb && (i & 3u) != 3u)
+        {
+            value = linearToSrgb(value);
+        }
+        rgba[i] = static_cast<uint8_t>(value * 255.0f + 0.5f);
+    }
+}
+
+std::vector<LinearImage> generateMipChain(const LinearImage &base, MipFilter filter, WorkerPool &workerPool)
+{
+    std::vector<LinearImage> chain;
+    chain.push_back(base);
+
+    while (chain.back().width > 1u || chain.back().height > 1u)
+    {
+        // Always filter from the level above, the chain is short and the error does not build up noticeably
+        const LinearImage &source = chain.back();
+        LinearImage next = filter == MipFilter::Kaiser ? downsampleKaiser(source, workerPool) : downsampleBox(source, workerPool);
+        chain.push_back(std::move(next));
+    }
+
+    return chain;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+// Mip chain generation for the texture cooker.
+// Images are filtered as linear light RGBA floats so colour textures darken correctly as they shrink;
+// sRGB data is decoded on the way in and encoded again on the way out. Each pixel is one SSE register.
+
+#include <cstdint>
+#include <vector>
+
+class WorkerPool;
+
+enum class MipFilter
+{
+    Box,    // 2x2 average, cheap and soft
+    Kaiser  // Kaiser windowed sinc, keeps more detail at the cost of slight ringing
+};
+
+struct LinearImage
+{
+    uint32_t width = 0u;
+    uint32_t height = 0u;
+    std::vector<float> pixels; // RGBA, four floats per pixel
+};
+
+LinearImage decodeRgba8(const uint8_t *rgba, uint32_t width, uint32_t height, bool srgb);
+void encodeRgba8(const LinearImage &image, bool srgb, std::vector<uint8_t> &rgba);
+
+// Returns every level from the base down to 1x1, the base included
+std::vector<LinearImage> generateMipChain(const LinearImage &base, MipFilter filter, WorkerPool &workerPool);
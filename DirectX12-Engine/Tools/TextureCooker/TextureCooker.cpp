@@ -0,0 +1,566 @@
+// Offline texture cook tool.
+//
+// Loads an image, builds a full mip chain in linear light and writes every level either as plain
+// RGBA8 or block compressed. The output is a DDS file (with the DX10 header) or, for any other
+// extension, the engine's own CookedTexture container whose subresources are already padded for
+// CopyTextureRegion. Block encoding and mip filtering are spread over a worker pool.
+//
+// Only uncompressed TGA (24 and 32 bit) and binary PPM (P6) images are read; there is no PNG or
+// JPEG decoder in the tree, convert those first.
+//
+// --report compresses mip 0 of every image in every block format and prints the encode rate and
+// the PSNR over the channels the format stores, for comparing encoders on a reference image set.
+//
+// Usage:
+//   TextureCooker --in <image> --out <file.dds|file.ctex> [--format bc1|bc3|bc4|bc5|bc7|rgba8]
+//                 [--filter box|kaiser] [--linear] [--jobs <n>]
+//   TextureCooker --report <image>... [--filter box|kaiser] [--jobs <n>]
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "BlockCompression.h"
+#include "CookedTexture.h"
+#include "MipGenerator.h"
+#include "WorkerPool.h"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    struct Options
+    {
+        fs::path inputPath;
+        fs::path outputPath;
+        std::vector<fs::path> reportPaths;
+        std::string format = "bc7";
+        MipFilter filter = MipFilter::Kaiser;
+        bool linear = false;
+        uint32_t jobs = 0u;
+    };
+
+    struct Image
+    {
+        uint32_t width = 0u;
+        uint32_t height = 0u;
+        std::vector<uint8_t> rgba;
+    };
+
+    // One cooked mip level, rows tightly packed
+    struct Level
+    {
+        uint32_t width;
+        uint32_t height;
+        uint32_t rowSize;
+        uint32_t rowCount;
+        std::vector<uint8_t> data;
+    };
+
+    using Clock = std::chrono::steady_clock;
+
+    double millisecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    bool readFile(const fs::path &path, std::vector<uint8_t> &contents)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+        {
+            return false;
+        }
+        contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        return true;
+    }
+
+    bool loadTga(const std::vector<uint8_t> &file, Image &image)
+    {
+        if (file.size() < 18u)
+        {
+            return false;
+        }
+
+        const uint32_t idLength = file[0];
+        const uint32_t colorMapType = file[1];
+        const uint32_t imageType = file[2];
+        const uint32_t bitsPerPixel = file[16];
+        const bool topToBottom = (file[17] & 0x20u) != 0u;
+
+        // Uncompressed true colour only
+        if (colorMapType != 0u || imageType != 2u || (bitsPerPixel != 24u && bitsPerPixel != 32u))
+        {
+            return false;
+        }
+
+        image.width = file[12] | (file[13] << 8);
+        image.height = file[14] | (file[15] << 8);
+
+        const uint32_t bytesPerPixel = bitsPerPixel / 8u;
+        const size_t dataOffset = 18u + idLength;
+        if (image.width == 0u || image.height == 0u || file.size() < dataOffset + static_cast<size_t>(image.width) * image.height * bytesPerPixel)
+        {
+            return false;
+        }
+
+        image.rgba.resize(static_cast<size_t>(image.width) * image.height * 4u);
+        for (uint32_t y = 0u; y < image.height; ++y)
+        {
+            const uint32_t sourceY = topToBottom ? y : image.height - 1u - y;
+            const uint8_t *input = &file[dataOffset + static_cast<size_t>(sourceY) * image.width * bytesPerPixel];
+            uint8_t *output = &image.rgba[static_cast<size_t>(y) * image.width * 4u];
+
+            for (uint32_t x = 0u; x < image.width; ++x, input += bytesPerPixel, output += 4)
+            {
+                output[0] = input[2];
+                output[1] = input[1];
+                output[2] = input[0];
+                output[3] = bytesPerPixel == 4u ? input[3] : 255u;
+            }
+        }
+        return true;
+    }
+
+    bool loadPpm(const std::vector<uint8_t> &file, Image &image)
+    {
+        // Header is "P6 <width> <height> <max value>" separated by whitespace, comments start with '#'
+        size_t position = 2u;
+        uint32_t values[3] = {};
+        for (uint32_t &value : values)
+        {
+            while (position < file.size() && (std::isspace(file[position]) || file[position] == '#'))
+            {
+                if (file[position] == '#')
+                {
+                    while (position < file.size() && file[position] != '\n')
+                    {
+                        ++position;
+                    }
+                }
+                else
+                {
+                    ++position;
+                }
+            }
+            while (position < file.size() && std::isdigit(file[position]))
+            {
+                value = value * 10u + (file[position++] - '0');
+            }
+        }
+        ++position; // Single whitespace before the data
+
+        image.width = values[0];
+        image.height = values[1];
+        if (values[2] != 255u || image.width == 0u || image.height == 0u || file.size() < position + static_cast<size_t>(image.width) * image.height * 3u)
+        {
+            return false;
+        }
+
+        image.rgba.resize(static_cast<size_t>(image.width) * image.height * 4u);
+        for (size_t i = 0u; i < static_cast<size_t>(image.width) * image.height; ++i)
+        {
+            image.rgba[i * 4u + 0u] = file[position + i * 3u + 0u];
+            image.rgba[i * 4u + 1u] = file[position + i * 3u + 1u];
+            image.rgba[i * 4u + 2u] = file[position + i * 3u + 2u];
+            image.rgba[i * 4u + 3u] = 255u;
+        }
+        return true;
+    }
+
+    bool loadImage(const fs::path &path, Image &image)
+    {
+        std::vector<uint8_t> file;
+        if (!readFile(path, file))
+        {
+            std::cerr << "Unable to open " << path << std::endl;
+            return false;
+        }
+
+        const bool loaded = file.size() > 2u && file[0] == 'P' && file[1] == '6' ? loadPpm(file, image) : loadTga(file, image);
+        if (!loaded)
+        {
+            std::cerr << "Unsupported image " << path << ", expected an uncompressed TGA or a binary PPM" << std::endl;
+        }
+        return loaded;
+    }
+
+    bool parseBlockFormat(const std::string &name, BlockFormat &format)
+    {
+        static const std::pair<const char *, BlockFormat> formats[] =
+        {
+            { "bc1", BlockFormat::BC1 },
+            { "bc3", BlockFormat::BC3 },
+            { "bc4", BlockFormat::BC4 },
+            { "bc5", BlockFormat::BC5 },
+            { "bc7", BlockFormat::BC7 }
+        };
+
+        for (const auto &entry : formats)
+        {
+            if (name == entry.first)
+            {
+                format = entry.second;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    uint32_t dxgiFormat(const std::string &name, bool srgb)
+    {
+        // DXGI_FORMAT values, the sRGB variant always follows the UNORM one
+        uint32_t format = 28u; // DXGI_FORMAT_R8G8B8A8_UNORM
+        if (name == "bc1")
+        {
+            format = 71u;
+        }
+        else if (name == "bc3")
+        {
+            format = 77u;
+        }
+        else if (name == "bc4")
+        {
+            return 80u; // No sRGB variant
+        }
+        else if (name == "bc5")
+        {
+            return 83u;
+        }
+        else if (name == "bc7")
+        {
+            format = 98u;
+        }
+        return srgb ? format + 1u : format;
+    }
+
+    // Two channel and single channel formats hold data, not colour
+    bool isColorFormat(const std::string &name)
+    {
+        return name != "bc4" && name != "bc5";
+    }
+
+    std::vector<Level> cook(const Image &image, const Options &options, WorkerPool &workerPool)
+    {
+        const bool srgb = !options.linear && isColorFormat(options.format);
+
+        BlockFormat blockFormat;
+        const bool compressed = parseBlockFormat(options.format, blockFormat);
+
+        const LinearImage base = decodeRgba8(image.rgba.data(), image.width, image.height, srgb);
+        const std::vector<LinearImage> chain = generateMipChain(base, options.filter, workerPool);
+
+        std::vector<Level> levels;
+        for (size_t i = 0u; i < chain.size(); ++i)
+        {
+            Level level;
+            level.width = chain[i].width;
+            level.height = chain[i].height;
+
+            // Mip 0 is the source itself, skip the float round trip
+            std::vector<uint8_t> rgba;
+            if (i == 0u)
+            {
+                rgba = image.rgba;
+            }
+            else
+            {
+                encodeRgba8(chain[i], srgb, rgba);
+            }
+
+            if (compressed)
+            {
+                compressImage(blockFormat, rgba.data(), level.width, level.height, level.data, workerPool);
+                level.rowSize = (level.width + 3u) / 4u * getBlockSize(blockFormat);
+                level.rowCount = (level.height + 3u) / 4u;
+            }
+            else
+            {
+                level.data = std::move(rgba);
+                level.rowSize = level.width * 4u;
+                level.rowCount = level.height;
+            }
+
+            levels.push_back(std::move(level));
+        }
+        return levels;
+    }
+
+    template <typename T>
+    void writeValue(std::ofstream &file, const T &value)
+    {
+        file.write(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    bool writeDds(const fs::path &path, const std::vector<Level> &levels, uint32_t format)
+    {
+        std::ofstream file(path, std::ios::binary);
+
+        // DDS_HEADER followed by DDS_HEADER_DXT10
+        uint32_t header[31] = {};
+        header[0] = 124u;                                  // dwSize
+        header[1] = 0x1u | 0x2u | 0x4u | 0x1000u | 0x20000u | 0x80000u; // CAPS | HEIGHT | WIDTH | PIXELFORMAT | MIPMAPCOUNT | LINEARSIZE
+        header[2] = levels[0].height;
+        header[3] = levels[0].width;
+        header[4] = static_cast<uint32_t>(levels[0].data.size());
+        header[6] = static_cast<uint32_t>(levels.size());
+        header[18] = 32u;                                  // ddspf.dwSize
+        header[19] = 0x4u;                                 // DDPF_FOURCC
+        header[20] = 0x30315844u;                          // "DX10"
+        header[26] = 0x1000u | 0x8u | 0x400000u;           // TEXTURE | COMPLEX | MIPMAP
+
+        const uint32_t dx10Header[5] = { format, 3u /* TEXTURE2D */, 0u, 1u, 0u };
+
+        writeValue(file, 0x20534444u); // "DDS "
+        file.write(reinterpret_cast<const char *>(header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(dx10Header), sizeof(dx10Header));
+        for (const Level &level : levels)
+        {
+            file.write(reinterpret_cast<const char *>(level.data.data()), level.data.size());
+        }
+        return static_cast<bool>(file);
+    }
+
+    bool writeCookedTexture(const fs::path &path, const std::vector<Level> &levels, uint32_t format)
+    {
+        std::vector<CookedSubresource> subresources;
+        uint64_t dataSize = 0u;
+        for (const Level &level : levels)
+        {
+            CookedSubresource subresource = {};
+            subresource.offset = alignCookedTexture(dataSize, CookedTextureSubresourceAlignment);
+            subresource.width = level.width;
+            subresource.height = level.height;
+            subresource.rowPitch = static_cast<uint32_t>(alignCookedTexture(level.rowSize, CookedTextureRowPitchAlignment));
+            subresource.rowCount = level.rowCount;
+            subresource.rowSize = level.rowSize;
+            subresources.push_back(subresource);
+
+            dataSize = subresource.offset + static_cast<uint64_t>(subresource.rowPitch) * subresource.rowCount;
+        }
+
+        CookedTextureHeader header = {};
+        header.magic = CookedTextureMagic;
+        header.version = CookedTextureVersion;
+        header.dxgiFormat = format;
+        header.width = levels[0].width;
+        header.height = levels[0].height;
+        header.mipCount = static_cast<uint32_t>(levels.size());
+        header.dataOffset = alignCookedTexture(sizeof(header) + sizeof(CookedSubresource) * subresources.size(), CookedTextureSubresourceAlignment);
+        header.dataSize = dataSize;
+
+        std::vector<uint8_t> contents(static_cast<size_t>(header.dataOffset + dataSize), 0u);
+        std::memcpy(contents.data(), &header, sizeof(header));
+        std::memcpy(contents.data() + sizeof(header), subresources.data(), sizeof(CookedSubresource) * subresources.size());
+
+        for (size_t i = 0u; i < levels.size(); ++i)
+        {
+            uint8_t *output = contents.data() + header.dataOffset + subresources[i].offset;
+            for (uint32_t row = 0u; row < levels[i].rowCount; ++row)
+            {
+                std::memcpy(output + static_cast<size_t>(row) * subresources[i].rowPitch, &levels[i].data[static_cast<size_t>(row) * levels[i].rowSize], levels[i].rowSize);
+            }
+        }
+
+        std::ofstream file(path, std::ios::binary);
+        file.write(reinterpret_cast<const char *>(contents.data()), contents.size());
+        return static_cast<bool>(file);
+    }
+
+    // PSNR over the channels in the mask, infinite for an exact match
+    double computePsnr(const std::vector<uint8_t> &reference, const std::vector<uint8_t> &decoded, uint32_t channelMask)
+    {
+        double squaredError = 0.0;
+        size_t samples = 0u;
+        for (size_t i = 0u; i < reference.size(); ++i)
+        {
+            if (channelMask & (1u << (i & 3u)))
+            {
+                const double difference = static_cast<double>(reference[i]) - decoded[i];
+                squaredError += difference * difference;
+                ++samples;
+            }
+        }
+
+        if (squaredError == 0.0)
+        {
+            return INFINITY;
+        }
+        return 10.0 * std::log10(255.0 * 255.0 * samples / squaredError);
+    }
+
+    void report(const Options &options, WorkerPool &workerPool)
+    {
+        static const std::pair<const char *, BlockFormat> formats[] =
+        {
+            { "BC1", BlockFormat::BC1 },
+            { "BC3", BlockFormat::BC3 },
+            { "BC4", BlockFormat::BC4 },
+            { "BC5", BlockFormat::BC5 },
+            { "BC7", BlockFormat::BC7 }
+        };
+
+        std::cout << std::fixed << std::setprecision(2);
+        std::cout << "Threads: " << workerPool.getThreadCount() << "\n\n";
+        std::cout << std::left << std::setw(32) << "Image" << std::setw(8) << "Format" << std::right
+                  << std::setw(12) << "MPix/s" << std::setw(12) << "PSNR dB" << "\n";
+
+        for (const fs::path &path : options.reportPaths)
+        {
+            Image image;
+            if (!loadImage(path, image))
+            {
+                continue;
+            }
+
+            const double megapixels = static_cast<double>(image.width) * image.height / 1e6;
+
+            const Clock::time_point mipStart = Clock::now();
+            generateMipChain(decodeRgba8(image.rgba.data(), image.width, image.height, true), options.filter, workerPool);
+            const double mipMilliseconds = millisecondsSince(mipStart);
+
+            std::cout << std::left << std::setw(32) << path.filename().string() << std::setw(8) << "mips" << std::right
+                      << std::setw(12) << megapixels / (mipMilliseconds / 1000.0) << std::setw(12) << "-" << "\n";
+
+            for (const auto &format : formats)
+            {
+                // Repeat small images so the timing is not dominated by thread wake up
+                std::vector<uint8_t> blocks;
+                uint32_t runs = 0u;
+                const Clock::time_point encodeStart = Clock::now();
+                do
+                {
+                    compressImage(format.second, image.rgba.data(), image.width, image.height, blocks, workerPool);
+                    ++runs;
+                } while (millisecondsSince(encodeStart) < 200.0);
+                const double encodeMilliseconds = millisecondsSince(encodeStart) / runs;
+
+                std::vector<uint8_t> decoded;
+                decompressImage(format.second, blocks.data(), image.width, image.height, decoded);
+
+                std::cout << std::left << std::setw(32) << path.filename().string() << std::setw(8) << format.first << std::right
+                          << std::setw(12) << megapixels / (encodeMilliseconds / 1000.0)
+                          << std::setw(12) << computePsnr(image.rgba, decoded, getChannelMask(format.second)) << "\n";
+            }
+        }
+        std::cout << std::flush;
+    }
+
+    bool parseArguments(int argc, char **argv, Options &options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string argument = argv[i];
+            const bool hasValue = i + 1 < argc;
+
+            if (argument == "--in" && hasValue)
+            {
+                options.inputPath = argv[++i];
+            }
+            else if (argument == "--out" && hasValue)
+            {
+                options.outputPath = argv[++i];
+            }
+            else if (argument == "--format" && hasValue)
+            {
+                BlockFormat unused;
+                options.format = argv[++i];
+                if (options.format != "rgba8" && !parseBlockFormat(options.format, unused))
+                {
+                    return false;
+                }
+            }
+            else if (argument == "--filter" && hasValue)
+            {
+                const std::string filter = argv[++i];
+                if (filter != "box" && filter != "kaiser")
+                {
+                    return false;
+                }
+                options.filter = filter == "box" ? MipFilter::Box : MipFilter::Kaiser;
+            }
+            else if (argument == "--linear")
+            {
+                options.linear = true;
+            }
+            else if (argument == "--jobs" && hasValue)
+            {
+                options.jobs = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (argument == "--report")
+            {
+                while (i + 1 < argc && std::strncmp(argv[i + 1], "--", 2) != 0)
+                {
+                    options.reportPaths.push_back(argv[++i]);
+                }
+            }
+            else
+            {
+                return false;
+            }
+        }
+        return !options.reportPaths.empty() || (!options.inputPath.empty() && !options.outputPath.empty());
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseArguments(argc, argv, options))
+    {
+        std::cerr << "Usage: TextureCooker --in <image> --out <file.dds|file.ctex> [--format bc1|bc3|bc4|bc5|bc7|rgba8] [--filter box|kaiser] [--linear] [--jobs <n>]\n"
+                  << "       TextureCooker --report <image>... [--filter box|kaiser] [--jobs <n>]" << std::endl;
+        return 1;
+    }
+
+    WorkerPool workerPool(options.jobs);
+
+    if (!options.reportPaths.empty())
+    {
+        report(options, workerPool);
+        return 0;
+    }
+
+    const Clock::time_point start = Clock::now();
+
+    Image image;
+    if (!loadImage(options.inputPath, image))
+    {
+        return 1;
+    }
+
+    const std::vector<Level> levels = cook(image, options, workerPool);
+    const uint32_t format = dxgiFormat(options.format, !options.linear);
+
+    const bool written = options.outputPath.extension() == ".dds" ? writeDds(options.outputPath, levels, format) : writeCookedTexture(options.outputPath, levels, format);
+    if (!written)
+    {
+        std::cerr << "Unable to write " << options.outputPath << std::endl;
+        return 1;
+    }
+
+    size_t outputSize = 0u;
+    for (const Level &level : levels)
+    {
+        outputSize += level.data.size();
+    }
+
+    std::cout << "Size:       " << image.width << "x" << image.height << "\n"
+              << "Mip levels: " << levels.size() << "\n"
+              << "Format:     " << options.format << (!options.linear && isColorFormat(options.format) ? " sRGB" : "") << "\n"
+              << "Texel data: " << outputSize << " bytes (" << image.rgba.size() << " uncompressed mip 0)\n"
+              << "Threads:    " << workerPool.getThreadCount() << "\n"
+              << "Total time: " << millisecondsSince(start) << " ms" << std::endl;
+
+    return 0;
+}
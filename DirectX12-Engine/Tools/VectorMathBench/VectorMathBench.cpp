@@ -0,0 +1,435 @@
+// VectorMath check and benchmark.
+//
+// Runs the SIMD paths of VectorMath against their constexpr scalar twins on random inputs and
+// checks that:
+//  - transform() and multiply() agree with transformScalar() and multiplyScalar() to rounding,
+//    and multiplyMatrices() still does when the output aliases an input
+//  - transformPoints() agrees with transformPoint() for every count around the vector width,
+//    with and without the w output
+//  - cullSpheres() agrees with intersects() except for spheres touching a plane to rounding
+//  - inverse(), transformAabb() and extractFrustum() hold on to their contracts
+// Then every kernel is timed against a loop over its scalar twin.
+//
+// Usage:
+//   VectorMathBench [--count <n>] [--seed <n>]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "VectorMath.h"
+
+// The scalar twins must stay usable in constant expressions
+static_assert(multiplyScalar(translationMatrix(Vec3{ 1.0f, 2.0f, 3.0f }), scalingMatrix(Vec3{ 2.0f, 2.0f, 2.0f })).r[3].z == 6.0f, "multiplyScalar is not constexpr");
+static_assert(transformPoint(Vec3{ 1.0f, 0.0f, 0.0f }, translationMatrix(Vec3{ 0.0f, 1.0f, 0.0f })).y == 1.0f, "transformPoint is not constexpr");
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    double millisecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    struct Options
+    {
+        uint32_t count = 65536u;
+        uint32_t seed = 1u;
+    };
+
+    const char *simdPath()
+    {
+#if defined(VECTOR_MATH_AVX2)
+        return "AVX2";
+#elif defined(VECTOR_MATH_SSE)
+        return "SSE2";
+#elif defined(VECTOR_MATH_NEON)
+        return "NEON";
+#else
+        return "scalar only";
+#endif
+    }
+
+    struct Points
+    {
+        std::vector<float> x;
+        std::vector<float> y;
+        std::vector<float> z;
+        std::vector<float> radius;
+    };
+
+    class Generator
+    {
+    public:
+        explicit Generator(uint32_t seed)
+            : m_random(seed)
+        {
+        }
+
+        float value(float range)
+        {
+            return std::uniform_real_distribution<float>(-range, range)(m_random);
+        }
+
+        Vec4 vector(float range)
+        {
+            return Vec4{ value(range), value(range), value(range), value(range) };
+        }
+
+        // General matrices exercise every lane, affine ones are what the engine mostly multiplies
+        Mat4 matrix()
+        {
+            return Mat4{ { vector(4.0f), vector(4.0f), vector(4.0f), vector(4.0f) } };
+        }
+
+        Mat4 affine()
+        {
+            const Vec3 axis = normalize(Vec3{ value(1.0f), value(1.0f), value(1.0f) + 2.0f });
+            const Quat rotation = quatFromAxisAngle(axis, value(3.14159265f));
+            const Vec3 scale{ 1.0f + value(0.5f), 1.0f + value(0.5f), 1.0f + value(0.5f) };
+            return affineMatrix(scale, rotation, Vec3{ value(100.0f), value(100.0f), value(100.0f) });
+        }
+
+        Points points(size_t count, float range)
+        {
+            Points points;
+            for (size_t i = 0; i < count; ++i)
+            {
+                points.x.push_back(value(range));
+                points.y.push_back(value(range));
+                points.z.push_back(value(range));
+                points.radius.push_back(std::fabs(value(range * 0.05f)));
+            }
+            return points;
+        }
+
+    private:
+        std::mt19937 m_random;
+    };
+
+    // Rounding allowance for a sum of four products, scaled by the size of the products
+    bool closeTo(float value, float reference, float magnitude)
+    {
+        return std::fabs(value - reference) <= 8.0f * std::numeric_limits<float>::epsilon() * (magnitude + 1e-30f);
+    }
+
+    bool closeTo(const Vec4 &value, const Vec4 &v, const Mat4 &m)
+    {
+        const float *result = &value.x;
+        const Vec4 reference = transformScalar(v, m);
+        const float *expected = &reference.x;
+        for (int c = 0; c < 4; ++c)
+        {
+            const float magnitude = std::fabs((&m.r[0].x)[c] * v.x) + std::fabs((&m.r[1].x)[c] * v.y) + std::fabs((&m.r[2].x)[c] * v.z) + std::fabs((&m.r[3].x)[c] * v.w);
+            if (!closeTo(result[c], expected[c], magnitude))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool closeTo(const Mat4 &value, const Mat4 &a, const Mat4 &b)
+    {
+        for (int row = 0; row < 4; ++row)
+        {
+            if (!closeTo(value.r[row], a.r[row], b))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // The smallest distance by which any plane accepts or rejects the sphere
+    float planeMargin(const Frustum &frustum, const Sphere &sphere)
+    {
+        float margin = std::numeric_limits<float>::max();
+        for (const Vec4 &plane : frustum.planes)
+        {
+            margin = (std::min)(margin, std::fabs(dot(toVec3(plane), sphere.center) + plane.w + sphere.radius));
+        }
+        return margin;
+    }
+
+    Frustum makeFrustum()
+    {
+        const Mat4 view = lookAtMatrix(Vec3{ 10.0f, 20.0f, -30.0f }, Vec3{ 0.0f, 0.0f, 0.0f }, Vec3{ 0.0f, 1.0f, 0.0f });
+        return extractFrustum(multiply(view, perspectiveMatrix(1.0f, 16.0f / 9.0f, 0.1f, 100.0f)));
+    }
+
+    bool check(const Options &options)
+    {
+        bool passed = true;
+        auto report = [&passed](bool condition, const std::string &what)
+        {
+            std::cout << std::left << std::setw(64) << what << (condition ? "ok" : "FAILED") << "\n";
+            passed = passed && condition;
+        };
+
+        Generator generator(options.seed);
+
+        {
+            bool transformMatches = true;
+            bool multiplyMatches = true;
+            for (uint32_t i = 0; i < 10000u; ++i)
+            {
+                const Mat4 a = (i & 1u) != 0u ? generator.matrix() : generator.affine();
+                const Mat4 b = (i & 2u) != 0u ? generator.matrix() : generator.affine();
+                const Vec4 v = generator.vector(100.0f);
+                transformMatches = transformMatches && closeTo(transform(v, a), v, a);
+                multiplyMatches = multiplyMatches && closeTo(multiply(a, b), a, b);
+            }
+            report(transformMatches, "transform() matches transformScalar()");
+            report(multiplyMatches, "multiply() matches multiplyScalar()");
+        }
+
+        {
+            std::vector<Mat4> a(37u);
+            std::vector<Mat4> b(37u);
+            for (size_t i = 0; i < a.size(); ++i)
+            {
+                a[i] = generator.matrix();
+                b[i] = generator.affine();
+            }
+            std::vector<Mat4> out(a.size());
+            multiplyMatrices(a.data(), b.data(), out.data(), a.size());
+            const std::vector<Mat4> original = a;
+            multiplyMatrices(a.data(), b.data(), a.data(), a.size());
+
+            bool matches = true;
+            for (size_t i = 0; i < a.size(); ++i)
+            {
+                matches = matches && closeTo(out[i], original[i], b[i]);
+                matches = matches && std::equal(&a[i].r[0].x, &a[i].r[0].x + 16, &out[i].r[0].x);
+            }
+            report(matches, "multiplyMatrices() matches, also in place");
+        }
+
+        {
+            bool matches = true;
+            bool tailUntouched = true;
+            const Mat4 projection = multiply(generator.affine(), perspectiveMatrix(1.0f, 1.5f, 0.1f, 100.0f));
+            for (size_t count = 0; count <= 19u; ++count)
+            {
+                const Points points = generator.points(count, 50.0f);
+                for (const bool withW : { false, true })
+                {
+                    const size_t padded = count + 1u;
+                    std::vector<float> outX(padded, -1.0f), outY(padded, -1.0f), outZ(padded, -1.0f), outW(padded, -1.0f);
+                    transformPoints(projection, points.x.data(), points.y.data(), points.z.data(), outX.data(), outY.data(), outZ.data(), withW ? outW.data() : nullptr, count);
+
+                    for (size_t i = 0; i < count; ++i)
+                    {
+                        const Vec4 p{ points.x[i], points.y[i], points.z[i], 1.0f };
+                        const Vec4 result{ outX[i], outY[i], outZ[i], withW ? outW[i] : transformScalar(p, projection).w };
+                        matches = matches && closeTo(result, p, projection);
+                    }
+                    tailUntouched = tailUntouched && outX[count] == -1.0f && outY[count] == -1.0f && outZ[count] == -1.0f && outW[count] == -1.0f;
+                    tailUntouched = tailUntouched && (withW || outW[0] == -1.0f);
+                }
+            }
+            report(matches, "transformPoints() matches for counts 0 to 19, with or without w");
+            report(tailUntouched, "transformPoints() writes nothing past count or to a null w");
+        }
+
+        {
+            const Frustum frustum = makeFrustum();
+            const Points points = generator.points(options.count + 3u, 60.0f);
+            std::vector<uint8_t> visible(points.x.size() + 1u, 7u);
+            cullSpheres(frustum, points.x.data(), points.y.data(), points.z.data(), points.radius.data(), visible.data(), points.x.size());
+
+            uint32_t inside = 0u;
+            uint32_t boundary = 0u;
+            bool matches = true;
+            for (size_t i = 0; i < points.x.size(); ++i)
+            {
+                const Sphere sphere{ Vec3{ points.x[i], points.y[i], points.z[i] }, points.radius[i] };
+                const bool expected = intersects(frustum, sphere);
+                inside += expected ? 1u : 0u;
+                if (visible[i] != (expected ? 1u : 0u))
+                {
+                    ++boundary;
+                    matches = matches && visible[i] <= 1u && planeMargin(frustum, sphere) < 1e-4f * (length(sphere.center) + 1.0f);
+                }
+            }
+            report(matches && visible.back() == 7u, "cullSpheres() matches intersects(), " + std::to_string(boundary) + " boundary cases");
+            report(inside > 0u && inside < points.x.size(), "the frustum keeps " + std::to_string(inside) + " of " + std::to_string(points.x.size()) + " spheres");
+        }
+
+        {
+            bool inverts = true;
+            bool boxesHold = true;
+            for (uint32_t i = 0; i < 1000u; ++i)
+            {
+                const Mat4 m = generator.affine();
+                const Mat4 product = multiply(m, inverse(m));
+                const Mat4 identity = identityMatrix();
+                for (int j = 0; j < 16; ++j)
+                {
+                    inverts = inverts && std::fabs((&product.r[0].x)[j] - (&identity.r[0].x)[j]) < 1e-3f;
+                }
+
+                const Vec3 corner{ generator.value(10.0f), generator.value(10.0f), generator.value(10.0f) };
+                const Aabb box{ corner, corner + Vec3{ 1.0f + std::fabs(generator.value(5.0f)), 1.0f, 2.0f } };
+                const Aabb moved = transformAabb(box, m);
+                for (int c = 0; c < 8; ++c)
+                {
+                    const Vec3 point{ (c & 1) != 0 ? box.max.x : box.min.x, (c & 2) != 0 ? box.max.y : box.min.y, (c & 4) != 0 ? box.max.z : box.min.z };
+                    const Vec3 p = transformPoint(point, m);
+                    const float slack = 1e-3f;
+                    boxesHold = boxesHold && p.x >= moved.min.x - slack && p.y >= moved.min.y - slack && p.z >= moved.min.z - slack;
+                    boxesHold = boxesHold && p.x <= moved.max.x + slack && p.y <= moved.max.y + slack && p.z <= moved.max.z + slack;
+                }
+            }
+            report(inverts, "inverse() of affine matrices gives the identity back");
+            report(boxesHold, "transformAabb() contains every transformed corner");
+
+            const Frustum frustum = makeFrustum();
+            const Vec3 eye{ 10.0f, 20.0f, -30.0f };
+            const Vec3 forward = normalize(Vec3{ 0.0f, 0.0f, 0.0f } - eye);
+            const bool ahead = intersects(frustum, Sphere{ eye + forward * 50.0f, 0.1f });
+            const bool behind = intersects(frustum, Sphere{ eye - forward * 5.0f, 0.1f });
+            const bool beyond = intersects(frustum, Sphere{ eye + forward * 150.0f, 0.1f });
+            report(ahead && !behind && !beyond, "extractFrustum() keeps what is ahead and inside the far plane");
+        }
+
+        std::cout << "\n";
+        return passed;
+    }
+
+    // Repeats the workload for 200 ms and returns the nanoseconds per item
+    template <typename Work>
+    double measure(size_t items, Work work)
+    {
+        uint64_t runs = 0u;
+        const Clock::time_point start = Clock::now();
+        do
+        {
+            work();
+            ++runs;
+        } while (millisecondsSince(start) < 200.0);
+        return millisecondsSince(start) * 1e6 / (static_cast<double>(runs) * items);
+    }
+
+    void benchmark(const Options &options)
+    {
+        Generator generator(options.seed);
+        const size_t count = options.count;
+
+        std::vector<Mat4> a(count);
+        std::vector<Mat4> b(count);
+        std::vector<Mat4> out(count);
+        std::vector<Vec4> vectors(count);
+        std::vector<Vec4> transformed(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            a[i] = generator.affine();
+            b[i] = generator.matrix();
+            vectors[i] = generator.vector(100.0f);
+        }
+        const Mat4 m = generator.matrix();
+        const Points points = generator.points(count, 60.0f);
+        std::vector<float> outX(count), outY(count), outZ(count), outW(count);
+        std::vector<uint8_t> visible(count);
+        const Frustum frustum = makeFrustum();
+
+        // Keeps the results alive so nothing is optimized away
+        volatile float sink = 0.0f;
+
+        struct Row
+        {
+            const char *name;
+            double simd;
+            double scalar;
+        };
+        const Row rows[] =
+        {
+            { "transform",
+                measure(count, [&]() { for (size_t i = 0; i < count; ++i) transformed[i] = transform(vectors[i], m); sink = sink + transformed[count / 2u].x; }),
+                measure(count, [&]() { for (size_t i = 0; i < count; ++i) transformed[i] = transformScalar(vectors[i], m); sink = sink + transformed[count / 2u].x; }) },
+            { "multiply",
+                measure(count, [&]() { multiplyMatrices(a.data(), b.data(), out.data(), count); sink = sink + out[count / 2u].r[3].x; }),
+                measure(count, [&]() { for (size_t i = 0; i < count; ++i) out[i] = multiplyScalar(a[i], b[i]); sink = sink + out[count / 2u].r[3].x; }) },
+            { "transformPoints",
+                measure(count, [&]() { transformPoints(m, points.x.data(), points.y.data(), points.z.data(), outX.data(), outY.data(), outZ.data(), outW.data(), count); sink = sink + outW[count / 2u]; }),
+                measure(count, [&]()
+                {
+                    for (size_t i = 0; i < count; ++i)
+                    {
+                        const Vec4 p = transformScalar(Vec4{ points.x[i], points.y[i], points.z[i], 1.0f }, m);
+                        outX[i] = p.x;
+                        outY[i] = p.y;
+                        outZ[i] = p.z;
+                        outW[i] = p.w;
+                    }
+                    sink = sink + outW[count / 2u];
+                }) },
+            { "cullSpheres",
+                measure(count, [&]() { cullSpheres(frustum, points.x.data(), points.y.data(), points.z.data(), points.radius.data(), visible.data(), count); sink = sink + visible[count / 2u]; }),
+                measure(count, [&]()
+                {
+                    for (size_t i = 0; i < count; ++i)
+                    {
+                        visible[i] = intersects(frustum, Sphere{ Vec3{ points.x[i], points.y[i], points.z[i] }, points.radius[i] }) ? 1u : 0u;
+                    }
+                    sink = sink + visible[count / 2u];
+                }) },
+        };
+
+        std::cout << std::left << std::setw(20) << "Kernel" << std::right << std::setw(12) << "SIMD ns" << std::setw(12) << "Scalar ns" << std::setw(12) << "Speedup" << "\n";
+        std::cout << std::fixed << std::setprecision(2);
+        for (const Row &row : rows)
+        {
+            std::cout << std::left << std::setw(20) << row.name << std::right << std::setw(12) << row.simd << std::setw(12) << row.scalar
+                      << std::setw(11) << row.scalar / row.simd << "x\n";
+        }
+        std::cout << std::flush;
+    }
+
+    bool parseArguments(int argc, char **argv, Options &options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string argument = argv[i];
+            const bool hasValue = i + 1 < argc;
+
+            if (argument == "--count" && hasValue)
+            {
+                options.count = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (argument == "--seed" && hasValue)
+            {
+                options.seed = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else
+            {
+                return false;
+            }
+        }
+        return options.count > 0u;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseArguments(argc, argv, options))
+    {
+        std::cerr << "Usage: VectorMathBench [--count <n>] [--seed <n>]" << std::endl;
+        return 1;
+    }
+
+    std::cout << "SIMD path: " << simdPath() << ", items per run: " << options.count << ", seed: " << options.seed << "\n\n";
+
+    const bool passed = check(options);
+    benchmark(options);
+    return passed ? 0 : 1;
+}